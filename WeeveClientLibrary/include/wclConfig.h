@@ -49,6 +49,24 @@ extern "C" {
 /* The location of self signing key. */
 #define WCL_SMP_SELF_SIGNING_KEY_PATH "self.key"
 
+/* Number of messages, and of bytes of standard protocol packets, a session
+ * protects under one traffic key before moving to the next. AES-GCM with
+ * random IVs is good for 2^32 messages per key. */
+#define WCL_SMP_REKEY_MAX_MESSAGES (1ULL << 24)
+#define WCL_SMP_REKEY_MAX_BYTES (1ULL << 36)
+
+/* Standard protocol packets shorter than this are not worth compressing. */
+#define WCL_SMP_COMPRESSION_MIN_BYTES (128)
+
+/* Number of compression dictionaries that can be set at once. */
+#define WCL_SMP_COMPRESSION_MAX_DICTIONARIES (8)
+
+/* Seconds a resumed CONNECT carrying early data stays acceptable after the
+ * client built it, and number of such CONNECTs a broker accepts within that
+ * window. The broker remembers each of them until its window ends. */
+#define WCL_SMP_EARLY_DATA_WINDOW_SECONDS (10)
+#define WCL_SMP_EARLY_DATA_MAX_CONNECTS (4096)
+
 /* ========================================================================== */
 /*                                Types                                       */
 /* ========================================================================== */
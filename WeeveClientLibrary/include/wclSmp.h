@@ -54,9 +54,64 @@ typedef enum tWclSmpMessageType {
   WCL_SMP_MESSAGE_MQTTS_UNSUBACK = 11,
   WCL_SMP_MESSAGE_MQTTS_PINGREQ = 12,
   WCL_SMP_MESSAGE_MQTTS_PINGRESP = 13,
-  WCL_SMP_MESSAGE_MQTTS_DISCONNECT = 14
+  WCL_SMP_MESSAGE_MQTTS_DISCONNECT = 14,
+  /* Record carrying a sequence of MQTT packets other than CONNECT and CONNACK,
+   * sealed as one message once the session is established. */
+  WCL_SMP_MESSAGE_MQTTS_BATCH = 15
 } WclSmpMessageType_t;
 
+/* Side of the MQTTS exchange a SMP session plays. It decides which messages
+ * the session sends and receives, so a broker can hold client sessions for
+ * its bridges next to the broker sessions of its own clients. */
+typedef enum tWclSmpRole {
+  WCL_SMP_ROLE_MQTTS_CLIENT = 0,
+  WCL_SMP_ROLE_MQTTS_BROKER = 1
+} WclSmpRole_t;
+
+/* A message built by wclSmpGetMessages(). */
+typedef struct tWclSmpMessageRequest {
+  /* Input: as for wclSmpGetMessage(). */
+  WclSession_t smpSession;
+  WclSmpMessageType_t messageType;
+  const WosBuffer_t *pStdProtocolPacket;
+  /* Output: the SMP message on success, caller should free this using
+   * wclFreeBuffer(), and what wclSmpGetMessage() would have returned. */
+  WosBuffer_t smpMessage;
+  WclError_t result;
+} WclSmpMessageRequest_t;
+
+/* Outcome of a message submitted to wclSmpGetMessageAsync() or
+ * wclSmpProcessMessageAsync(). */
+typedef struct tWclSmpCompletion {
+  /* Session the message was submitted on. */
+  WclSession_t smpSession;
+  /* What wclSmpGetMessage() or wclSmpProcessMessage() returned. */
+  WclError_t result;
+  /* The SMP message or standard protocol packet, on success. Caller should
+   * free this using wclFreeBuffer(). */
+  WosBuffer_t output;
+  /* User data given with the message. */
+  void *pUserData;
+} WclSmpCompletion_t;
+
+/* Called with the completion of a message, on the thread which ran it. */
+typedef void (*WclSmpCompletionCallback_t)(WclSmpCompletion_t *pCompletion);
+
+/* Work item of a submitted message, to be run once by an executor. */
+typedef void (*WclSmpJobFunction_t)(void *pJob);
+
+/* Runs the work of the asynchronous API, for instance on a thread pool. */
+typedef struct tWclSmpExecutor {
+  /* Have jobFunction(pJob) run once, on any thread, now or later. Returns
+   * WCL_SUCCESS if the job will be run. */
+  WclError_t (*submit)(void *pContext, WclSmpJobFunction_t jobFunction,
+                       void *pJob);
+  /* Optional, called once a completion has been queued for
+   * wclSmpPollCompletion(), for instance to wake up the event loop. */
+  void (*notify)(void *pContext);
+  void *pContext;
+} WclSmpExecutor_t;
+
 /* ========================================================================== */
 /*                                Global Variables                            */
 /* ========================================================================== */
@@ -69,8 +124,10 @@ typedef enum tWclSmpMessageType {
  * @brief Open a SMP session.
  * @param[out] pSmpSession hold the session context to be used in other SMP
  * interfaces.
+ * @param[in] role whether the session is the mqtts Client or the mqtts Broker
+ * end of the connection.
  */
-WclError_t wclSmpOpen(WclSession_t *pSmpSession);
+WclError_t wclSmpOpen(WclSession_t *pSmpSession, WclSmpRole_t role);
 
 /**
  * @brief Initiator uses this interface to get the authenticated and private
@@ -86,29 +143,49 @@ WclError_t wclSmpOpen(WclSession_t *pSmpSession);
  *             pStdProtocolPacket. Caller should free this using
  *             wclFreeBuffer().
  *
- * Valid MQTTS messageType for this API for a mqtts Client:
+ * Valid MQTTS messageType for this API for a WCL_SMP_ROLE_MQTTS_CLIENT session:
      WCL_SMP_MESSAGE_MQTTS_CONNECT
      WCL_SMP_MESSAGE_MQTTS_SUBSCRIBE
      WCL_SMP_MESSAGE_MQTTS_UNSUBSCRIBE
      WCL_SMP_MESSAGE_MQTTS_DISCONNECT
 
- * Valid MQTTS messageType for this API for a mqtts Broker:
+ * Valid MQTTS messageType for this API for a WCL_SMP_ROLE_MQTTS_BROKER session:
      WCL_SMP_MESSAGE_MQTTS_CONNACK
      WCL_SMP_MESSAGE_MQTTS_SUBACK
      WCL_SMP_MESSAGE_MQTTS_UNSUBACK
 
- * Valid MQTTS messageType for this API for both mqtts Client and Broker:
+ * Valid MQTTS messageType for this API for both roles:
      WCL_SMP_MESSAGE_MQTTS_PUBLISH
      WCL_SMP_MESSAGE_MQTTS_PUBACK
      WCL_SMP_MESSAGE_MQTTS_PUBREC
      WCL_SMP_MESSAGE_MQTTS_PUBREL
      WCL_SMP_MESSAGE_MQTTS_PUBCOMP
+     WCL_SMP_MESSAGE_MQTTS_BATCH, pStdProtocolPacket being MQTT packets
+     back to back. The receiver gets them back the same way from
+     wclSmpProcessMessage() and splits them on their fixed headers.
  */
 WclError_t wclSmpGetMessage(WclSession_t smpSession,
                             WclSmpMessageType_t messageType,
                             const WosBuffer_t *pStdProtocolPacket,
                             WosBuffer_t *pSmpMessage);
 
+/**
+ * @brief Build the SMP messages of several packets, of the same session or of
+ *        different ones, as wclSmpGetMessage() would one after the other. A
+ *        broker sending a message to many subscribers saves the overhead of
+ *        a call per subscriber, and the messages are encrypted back to back.
+ *
+ * @param[in,out] pRequests the packets to be protected, each getting its
+ *                SMP message and result.
+ * @param[in] numRequests the number of requests.
+ *
+ * Returns WCL_SUCCESS if every request succeeded, otherwise the result of the
+ * first one which failed. The messages of a session are numbered in the
+ * order of the requests.
+ */
+WclError_t wclSmpGetMessages(WclSmpMessageRequest_t *pRequests,
+                             size_t numRequests);
+
 /**
  * @brief Responder uses this interface to processe the authenticated and
           private message coming from Initiator. SMP will check the integrity
@@ -121,23 +198,29 @@ WclError_t wclSmpGetMessage(WclSession_t smpSession,
  * @param[out] pStdProtocolPacket the standard MQTT or other protocol packet
  *             in clear. Caller should free this using wclFreeBuffer().
  *
- * Valid MQTTS messageType for this API for a mqtts Client:
+ * Valid MQTTS messageType for this API for a WCL_SMP_ROLE_MQTTS_CLIENT session:
      WCL_SMP_MESSAGE_MQTTS_CONNACK
      WCL_SMP_MESSAGE_MQTTS_SUBACK
      WCL_SMP_MESSAGE_MQTTS_UNSUBACK
 
- * Valid MQTTS messageType for this API for a mqtts Broker:
+ * Valid MQTTS messageType for this API for a WCL_SMP_ROLE_MQTTS_BROKER session:
      WCL_SMP_MESSAGE_MQTTS_CONNECT
      WCL_SMP_MESSAGE_MQTTS_SUBSCRIBE
      WCL_SMP_MESSAGE_MQTTS_UNSUBSCRIBE
      WCL_SMP_MESSAGE_MQTTS_DISCONNECT
 
- * Valid MQTTS messageType for this API for both mqtts Client and Broker:
+ * Valid MQTTS messageType for this API for both roles:
      WCL_SMP_MESSAGE_MQTTS_PUBLISH
      WCL_SMP_MESSAGE_MQTTS_PUBACK
      WCL_SMP_MESSAGE_MQTTS_PUBREC
      WCL_SMP_MESSAGE_MQTTS_PUBREL
      WCL_SMP_MESSAGE_MQTTS_PUBCOMP
+     WCL_SMP_MESSAGE_MQTTS_BATCH
+
+ * Each message id is accepted once. Once the session has been established,
+ * messages may be processed in any order, and from several threads at once,
+ * as long as none falls 32 or more message ids behind the highest one
+ * accepted. Those are rejected like replays.
  */
 WclError_t wclSmpProcessMessage(WclSession_t smpSession,
                                 const WosBuffer_t *pSmpMessage,
@@ -149,6 +232,239 @@ WclError_t wclSmpProcessMessage(WclSession_t smpSession,
  */
 WclError_t wclSmpClose(WclSession_t smpSession);
 
+/**
+ * @brief Set the key sealing the session tickets a broker issues in the
+ *        CONNACK of a full session establishment. A client presenting a
+ *        ticket resumes its session without the ECDH exchange and the
+ *        certificate signatures. Tickets sealed under the previous key are
+ *        still accepted, so rotating the key every ticketLifetime seconds
+ *        keeps every issued ticket valid for its whole lifetime.
+ *
+ * @param[in] pTicketKey WOS_CRYPTO_AE_AES256_KEY_LENGTH bytes of key, NULL to
+ *            draw a random one.
+ * @param[in] ticketLifetime seconds a ticket stays valid, 0 wipes the keys
+ *            and stops issuing and accepting tickets (the default).
+ */
+WclError_t wclSmpRotateTicketKey(const WosBuffer_t *pTicketKey,
+                                 uint32_t ticketLifetime);
+
+/**
+ * @brief Export the session ticket an established client session got from
+ *        the broker, to resume the session on the next connection.
+ *
+ * @param[in] smpSession established WCL_SMP_ROLE_MQTTS_CLIENT session.
+ * @param[out] pTicket the ticket with its secret, to be kept confidential.
+ *             Caller should free this using wclFreeBuffer().
+ *
+ * Returns WCL_ERROR_BAD_SESSION when the session holds no valid ticket.
+ */
+WclError_t wclSmpExportTicket(WclSession_t smpSession, WosBuffer_t *pTicket);
+
+/**
+ * @brief Import a ticket exported by wclSmpExportTicket() into a client
+ *        session opened for a new connection, before its CONNECT is built.
+ *        The CONNECT then resumes the session. If the broker rejects the
+ *        ticket the connection fails and the next session, opened without
+ *        ticket, goes through a full session establishment.
+ *
+ * @param[in] smpSession new WCL_SMP_ROLE_MQTTS_CLIENT session.
+ * @param[in] pTicket ticket exported by wclSmpExportTicket().
+ *
+ * Returns WCL_ERROR_INVALID_MESSAGE when the ticket has expired.
+ */
+WclError_t wclSmpImportTicket(WclSession_t smpSession,
+                              const WosBuffer_t *pTicket);
+
+/**
+ * @brief Set after how many messages, or bytes of standard protocol packets,
+ *        a session moves its messages to the next traffic key. Each key is
+ *        derived from the previous one, the epoch carried in the SMP header
+ *        tells the receiver, so both ends need no other exchange and may use
+ *        different limits. Defaults to WCL_SMP_REKEY_MAX_MESSAGES and
+ *        WCL_SMP_REKEY_MAX_BYTES.
+ *
+ * @param[in] smpSession session value obtained in wclSmpOpen() API.
+ * @param[in] maxMessages messages protected under one key, not 0.
+ * @param[in] maxBytes bytes protected under one key, not 0.
+ *
+ * A received message protected under the key before the current one is still
+ * accepted, others are rejected.
+ */
+WclError_t wclSmpSetRekeyLimits(WclSession_t smpSession, uint64_t maxMessages,
+                                uint64_t maxBytes);
+
+/**
+ * @brief Compress the packets a session encrypts, that is PUBLISH, SUBSCRIBE,
+ *        SUBACK, UNSUBSCRIBE and BATCH, before encrypting them. A client
+ *        offers it in its CONNECT, a broker session on which it is enabled
+ *        accepts it in the CONNACK, then both directions are compressed.
+ *        Packets shorter than WCL_SMP_COMPRESSION_MIN_BYTES, or which do not
+ *        shrink, are sent as they are. Resumed sessions are not compressed.
+ *
+ * @param[in] smpSession session opened using wclSmpOpen() API, before its
+ *            CONNECT or CONNACK is built.
+ * @param[in] isEnabled whether to offer or accept compression, off by
+ *            default.
+ *
+ * Compressing secret data next to data an attacker controls, in the same
+ * packet or batch, leaks the secret through the size of the messages.
+ */
+WclError_t wclSmpSetCompression(WclSession_t smpSession, bool isEnabled);
+
+/**
+ * @brief Set a dictionary of data typical of the PUBLISH packets of some
+ *        topics, for instance a few sample payloads. Compressing a short
+ *        packet with it saves much more than compressing the packet alone.
+ *        Both ends need the same dictionary under the same id, a packet
+ *        compressed with a dictionary the receiver does not have is rejected.
+ *        Dictionaries are shared by all the sessions and are to be set
+ *        before the sessions using them are opened.
+ *
+ * @param[in] dictionaryId identifier carried by the compressed packets, not 0.
+ * @param[in] pTopicPrefix prefix of the topics of the PUBLISH packets, or of
+ *            the first packet of a BATCH, compressed with the dictionary. The
+ *            dictionary of the longest matching prefix is used.
+ * @param[in] pDictionary the dictionary, only its last 64 KiB are used. NULL
+ *            removes the dictionary.
+ */
+WclError_t wclSmpSetCompressionDictionary(uint8_t dictionaryId,
+                                          const char *pTopicPrefix,
+                                          const WosBuffer_t *pDictionary);
+
+/**
+ * @brief Send a packet, typically a PUBLISH, encrypted in the resumed CONNECT
+ *        of a client session, saving the round trip of the CONNACK. It is
+ *        protected with a key bound to the ticket secret and the CONNECT.
+ *        Since a recorded CONNECT can be replayed, the broker accepts the
+ *        early data of a CONNECT only once, and only within the window set
+ *        by wclSmpSetEarlyDataWindow() after the CONNECT was built, so it
+ *        declines it from a client whose clock is off. Check
+ *        wclSmpIsEarlyDataAccepted() after the CONNACK and send the packet
+ *        again as usual if it was not.
+ *
+ * @param[in] smpSession WCL_SMP_ROLE_MQTTS_CLIENT session a ticket has been
+ *            imported into, before its CONNECT is built.
+ * @param[in] pStdProtocolPacket the standard MQTT packet sent as early data.
+ */
+WclError_t wclSmpSetEarlyData(WclSession_t smpSession,
+                              const WosBuffer_t *pStdProtocolPacket);
+
+/**
+ * @brief Get the early data a broker session accepted from a resumed CONNECT.
+ *        The packet is available from the processing of the CONNECT until
+ *        the CONNACK is built, and is to be handled once the CONNECT has
+ *        been accepted.
+ *
+ * @param[in] smpSession WCL_SMP_ROLE_MQTTS_BROKER session.
+ * @param[out] pStdProtocolPacket the standard MQTT packet in clear. Caller
+ *             should free this using wclFreeBuffer().
+ *
+ * Returns WCL_ERROR_BAD_SESSION when there is no early data.
+ */
+WclError_t wclSmpGetEarlyData(WclSession_t smpSession,
+                              WosBuffer_t *pStdProtocolPacket);
+
+/**
+ * @brief Tell whether the broker accepted the early data of the CONNECT.
+ *
+ * @param[in] smpSession WCL_SMP_ROLE_MQTTS_CLIENT session whose CONNACK has
+ *            been processed.
+ * @param[out] pIsAccepted true if the early data was accepted.
+ */
+WclError_t wclSmpIsEarlyDataAccepted(WclSession_t smpSession,
+                                     bool *pIsAccepted);
+
+/**
+ * @brief Set the anti-replay window of the early data a broker accepts. The
+ *        broker remembers the early data CONNECTs it accepted for
+ *        windowSeconds, and declines the early data of a CONNECT built more
+ *        than windowSeconds ago, or ahead of its clock, as well as the early
+ *        data of the CONNECTs over maxConnects within the window. Defaults to
+ *        WCL_SMP_EARLY_DATA_WINDOW_SECONDS and WCL_SMP_EARLY_DATA_MAX_CONNECTS.
+ *
+ * @param[in] windowSeconds seconds, not 0, to allow for the time a CONNECT
+ *            takes to arrive and the skew between the clocks.
+ * @param[in] maxConnects early data CONNECTs accepted within the window,
+ *            not 0 nor over 2^24, each takes about 28 bytes.
+ *
+ * Returns WCL_ERROR_BAD_SESSION while early data accepted under the current
+ * window is still remembered, it is to be set before the broker starts.
+ */
+WclError_t wclSmpSetEarlyDataWindow(uint32_t windowSeconds,
+                                    uint32_t maxConnects);
+
+/**
+ * @brief Set the executor running the messages submitted to
+ *        wclSmpGetMessageAsync() and wclSmpProcessMessageAsync(). The default
+ *        one runs them inline, before the submission returns. The executor is
+ *        to be set while no message is pending, and is kept until
+ *        wclTerminate(). wclTerminate() restores the default executor and
+ *        drops the completions still queued, so it is to be called once no
+ *        message is pending. Reconnecting only closes and opens sessions.
+ *
+ * The mosquitto client and broker still build and process their messages
+ * with wclSmpGetMessage() and wclSmpProcessMessage(), this API is for
+ * callers running the SMP work off their event loop.
+ *
+ * @param[in] pExecutor the executor, copied. NULL restores the default one.
+ */
+WclError_t wclSmpSetExecutor(const WclSmpExecutor_t *pExecutor);
+
+/**
+ * @brief Submit a packet to wclSmpGetMessage() on the executor. Its
+ *        completion is given to the callback, or queued for
+ *        wclSmpPollCompletion() when there is none.
+ *
+ * @param[in] smpSession session value obtained in wclSmpOpen() API.
+ * @param[in] messageType the type of message.
+ * @param[in] pStdProtocolPacket the packet to be protected, which must stay
+ *            valid until the completion.
+ * @param[in] callback the completion callback, or NULL.
+ * @param[in] pUserData given back in the completion.
+ *
+ * The messages a session sends are numbered in the order they are built, so
+ * the messages of a session are to be submitted one after the other, each
+ * once the previous one completed, unless the executor runs the jobs of a
+ * session in order. A session is not to be closed while it has messages
+ * pending, wclSmpClose() returns WCL_ERROR_BAD_SESSION then.
+ */
+WclError_t wclSmpGetMessageAsync(WclSession_t smpSession,
+                                 WclSmpMessageType_t messageType,
+                                 const WosBuffer_t *pStdProtocolPacket,
+                                 WclSmpCompletionCallback_t callback,
+                                 void *pUserData);
+
+/**
+ * @brief Submit a SMP message to wclSmpProcessMessage() on the executor. Its
+ *        completion is given to the callback, or queued for
+ *        wclSmpPollCompletion() when there is none.
+ *
+ * @param[in] smpSession session value obtained in wclSmpOpen() API.
+ * @param[in] pSmpMessage the SMP message, which must stay valid until the
+ *            completion.
+ * @param[in] callback the completion callback, or NULL.
+ * @param[in] pUserData given back in the completion.
+ *
+ * The messages of an established session may run in parallel, the session
+ * establishment messages are to complete before the next message is
+ * submitted.
+ */
+WclError_t wclSmpProcessMessageAsync(WclSession_t smpSession,
+                                     const WosBuffer_t *pSmpMessage,
+                                     WclSmpCompletionCallback_t callback,
+                                     void *pUserData);
+
+/**
+ * @brief Get the oldest queued completion. Completions are queued by any
+ *        thread but are to be polled from a single one.
+ *
+ * @param[out] pCompletion the completion, whose output the caller should
+ *             free using wclFreeBuffer().
+ * @param[out] pHasCompletion false if the queue was empty.
+ */
+WclError_t wclSmpPollCompletion(WclSmpCompletion_t *pCompletion,
+                                bool *pHasCompletion);
+
 #ifdef __cplusplus
 }
 #endif
@@ -65,14 +65,6 @@ void wclLog()
     WLOGLICENSE("Weeve Client Library\nTerms and Conditions...\nEnd-User "
                 "License Agreement...\n\n");
 
-    /* Type */
-#if defined(SMP_MQTTS_CLIENT)
-    WLOGLICENSE("Library built with LIB_SMP_ROLE: SMP_MQTTS_CLIENT\n\n");
-#endif
-#if defined(SMP_MQTTS_BROKER)
-    WLOGLICENSE("Library built with LIB_SMP_ROLE: SMP_MQTTS_BROKER\n\n");
-#endif
-
     /* Version */
     /* TODO Add the version to the build scripts, and log it here. */
     WLOGLICENSE("Weeve Client Library\nversion %d.%d revision %d\n\n", WCL_VERSION_MAJOR, WCL_VERSION_MINOR, WCL_VERSION_REVISION );
@@ -30,7 +30,10 @@
 #include "smp.h"
 #include "wclSmp.h"
 
+#include "smpAsync.h"
+#include "smpCompress.h"
 #include "smpInternal.h"
+#include "smpTicket.h"
 
 /* ========================================================================== */
 /*                                Constants                                   */
@@ -83,6 +86,9 @@ void smpTerminate(void)
     FUNCTION_ENTRY();
 
     /* Destroy global configurations. */
+    smpTicketWipeKeys();
+    smpCompressWipeDictionaries();
+    smpAsyncTerminate();
     wclResult = smpDeInitGlobalCreds();
     if (WCL_SUCCESS != wclResult) {
         WLOGE("SMP initialization failed %x", wclResult);
@@ -93,7 +99,7 @@ void smpTerminate(void)
 }
 
 /* Open a Smp session. */
-WclError_t wclSmpOpen(WclSession_t *pSmpSession)
+WclError_t wclSmpOpen(WclSession_t *pSmpSession, WclSmpRole_t role)
 {
     WclError_t wclResult = WCL_ERROR;
     SmpSessionContext_t *pSmpCtx = NULL;
@@ -108,7 +114,7 @@ WclError_t wclSmpOpen(WclSession_t *pSmpSession)
     }
 
     /* Initialize session params, cert validation, dh-params generation etc. */
-    wclResult = smpInitialiseSessionParams(&pSmpCtx);
+    wclResult = smpInitialiseSessionParams(&pSmpCtx, role);
     if (WCL_SUCCESS != wclResult) {
         WLOGE("session initialization failed %x", wclResult);
         goto exit;
@@ -163,7 +169,7 @@ WclError_t wclSmpGetMessage(WclSession_t smpSession,
         goto exit;
     }
     if (((messageType < WCL_SMP_MESSAGE_MQTTS_CONNECT) ||
-         (messageType > WCL_SMP_MESSAGE_MQTTS_DISCONNECT)) ||
+         (messageType > WCL_SMP_MESSAGE_MQTTS_BATCH)) ||
         (!WOS_IS_VALID_BUFFER(pStdProtocolPacket)) || (NULL == pSmpMessage)) {
         WLOGE("bad parameter");
         smpResult = WCL_ERROR_BAD_PARAMS;
@@ -175,40 +181,15 @@ WclError_t wclSmpGetMessage(WclSession_t smpSession,
     pSmpCtx = (SmpSessionContext_t *)smpSession;
 
     /* Build the message. */
-    switch (messageType) {
-#if defined(SMP_MQTTS_CLIENT)
-    case WCL_SMP_MESSAGE_MQTTS_CONNECT:
-#elif defined(SMP_MQTTS_BROKER)
-    case WCL_SMP_MESSAGE_MQTTS_CONNACK:
-#endif
+    if (!smpIsSentMessageType(pSmpCtx, messageType)) {
+        WLOGW("message-type %x is not a valid use-case for the session role %x",
+              messageType, pSmpCtx->role);
+    } else if (SMP_SE_SEND_MESSAGE_TYPE(pSmpCtx) == messageType) {
         smpResult = smpExportSessionEstablishmentParams(
             pSmpCtx, pStdProtocolPacket, pSmpMessage);
-        break;
-
-    case WCL_SMP_MESSAGE_MQTTS_PUBLISH:
-    case WCL_SMP_MESSAGE_MQTTS_PUBACK:
-    case WCL_SMP_MESSAGE_MQTTS_PUBREC:
-    case WCL_SMP_MESSAGE_MQTTS_PUBREL:
-    case WCL_SMP_MESSAGE_MQTTS_PUBCOMP:
-    case WCL_SMP_MESSAGE_MQTTS_PINGREQ:
-    case WCL_SMP_MESSAGE_MQTTS_PINGRESP:
-#if defined(SMP_MQTTS_CLIENT)
-    case WCL_SMP_MESSAGE_MQTTS_SUBSCRIBE:
-    case WCL_SMP_MESSAGE_MQTTS_UNSUBSCRIBE:
-    case WCL_SMP_MESSAGE_MQTTS_DISCONNECT:
-#elif defined(SMP_MQTTS_BROKER)
-    case WCL_SMP_MESSAGE_MQTTS_SUBACK:
-    case WCL_SMP_MESSAGE_MQTTS_UNSUBACK:
-#endif
-
+    } else {
         smpResult = smpSecureMessage(pSmpCtx, messageType, pStdProtocolPacket,
                                      pSmpMessage);
-        break;
-
-    default:
-        WLOGW("message-type %x is not a valid use-case for mqtts-client",
-              messageType);
-        break;
     }
     if (!WOS_IS_VALID_BUFFER(pStdProtocolPacket)) {
         WLOGE("unexpected error");
@@ -222,6 +203,60 @@ exit:
     return smpResult;
 }
 
+/* Build the SMP messages of several packets. */
+WclError_t wclSmpGetMessages(WclSmpMessageRequest_t *pRequests,
+                             size_t numRequests)
+{
+    WclError_t smpResult = WCL_ERROR;
+    WclSmpMessageRequest_t *pRequest = NULL;
+    size_t i = 0;
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation. */
+    if ((NULL == pRequests) || (0 == numRequests)) {
+        WLOGE("bad parameter");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+    WLOGI("%u requests", (uint32_t)numRequests);
+
+    for (i = 0; i < numRequests; i++) {
+        pRequest = &pRequests[i];
+        pRequest->smpMessage.data = NULL;
+        pRequest->smpMessage.length = 0;
+        if (WCL_SESSION_INVALID == pRequest->smpSession) {
+            pRequest->result = WCL_ERROR_BAD_SESSION;
+        } else if ((pRequest->messageType < WCL_SMP_MESSAGE_MQTTS_CONNECT) ||
+                   (pRequest->messageType > WCL_SMP_MESSAGE_MQTTS_BATCH) ||
+                   (!WOS_IS_VALID_BUFFER(pRequest->pStdProtocolPacket))) {
+            pRequest->result = WCL_ERROR_BAD_PARAMS;
+        } else if (!smpIsSentMessageType(
+                       (SmpSessionContext_t *)pRequest->smpSession,
+                       pRequest->messageType)) {
+            WLOGW("message-type %x is not a valid use-case for the session "
+                  "role", pRequest->messageType);
+            pRequest->result = WCL_ERROR;
+        } else {
+            pRequest->result = WCL_SUCCESS;
+        }
+    }
+
+    smpSecureMessages(pRequests, numRequests);
+
+    smpResult = WCL_SUCCESS;
+    for (i = 0; (i < numRequests) && (WCL_SUCCESS == smpResult); i++) {
+        smpResult = pRequests[i].result;
+    }
+    if (WCL_SUCCESS != smpResult) {
+        WLOGE("request %u failed %x", (uint32_t)(i - 1), smpResult);
+    }
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
 /* Process a SMP message. */
 WclError_t wclSmpProcessMessage(WclSession_t smpSession,
                                 const WosBuffer_t *pSmpMessage,
@@ -268,6 +303,295 @@ exit:
     return smpResult;
 }
 
+/* Set the key sealing the session tickets of the broker sessions. */
+WclError_t wclSmpRotateTicketKey(const WosBuffer_t *pTicketKey,
+                                 uint32_t ticketLifetime)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    smpResult = smpTicketRotateKey(pTicketKey, ticketLifetime);
+    if (WCL_SUCCESS != smpResult) {
+        WLOGE("ticket key rotation failed %x", smpResult);
+    }
+
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Export the session ticket of a client session. */
+WclError_t wclSmpExportTicket(WclSession_t smpSession, WosBuffer_t *pTicket)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    if (WCL_SESSION_INVALID == smpSession) {
+        WLOGE("invalid session");
+        smpResult = WCL_ERROR_BAD_SESSION;
+        goto exit;
+    }
+
+    smpResult = smpExportTicket((SmpSessionContext_t *)smpSession, pTicket);
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Import a session ticket into a new client session. */
+WclError_t wclSmpImportTicket(WclSession_t smpSession,
+                              const WosBuffer_t *pTicket)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    if (WCL_SESSION_INVALID == smpSession) {
+        WLOGE("invalid session");
+        smpResult = WCL_ERROR_BAD_SESSION;
+        goto exit;
+    }
+
+    smpResult = smpImportTicket((SmpSessionContext_t *)smpSession, pTicket);
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Set when the session updates its send key. */
+WclError_t wclSmpSetRekeyLimits(WclSession_t smpSession, uint64_t maxMessages,
+                                uint64_t maxBytes)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    if (WCL_SESSION_INVALID == smpSession) {
+        WLOGE("invalid session");
+        smpResult = WCL_ERROR_BAD_SESSION;
+        goto exit;
+    }
+
+    smpResult = smpSetRekeyLimits((SmpSessionContext_t *)smpSession,
+                                  maxMessages, maxBytes);
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Set whether the session compresses the packets it encrypts. */
+WclError_t wclSmpSetCompression(WclSession_t smpSession, bool isEnabled)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    if (WCL_SESSION_INVALID == smpSession) {
+        WLOGE("invalid session");
+        smpResult = WCL_ERROR_BAD_SESSION;
+        goto exit;
+    }
+
+    smpResult = smpSetCompression((SmpSessionContext_t *)smpSession, isEnabled);
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Set the dictionary compressing the packets of a topic prefix. */
+WclError_t wclSmpSetCompressionDictionary(uint8_t dictionaryId,
+                                          const char *pTopicPrefix,
+                                          const WosBuffer_t *pDictionary)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    smpResult = smpCompressSetDictionary(dictionaryId,
+                                         (WosString_t)pTopicPrefix,
+                                         pDictionary);
+    if (WCL_SUCCESS != smpResult) {
+        WLOGE("setting the compression dictionary failed %x", smpResult);
+    }
+
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Set the early data of a resumed CONNECT. */
+WclError_t wclSmpSetEarlyData(WclSession_t smpSession,
+                              const WosBuffer_t *pStdProtocolPacket)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    if (WCL_SESSION_INVALID == smpSession) {
+        WLOGE("invalid session");
+        smpResult = WCL_ERROR_BAD_SESSION;
+        goto exit;
+    }
+
+    smpResult =
+        smpSetEarlyData((SmpSessionContext_t *)smpSession, pStdProtocolPacket);
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Get the early data of a resumed CONNECT. */
+WclError_t wclSmpGetEarlyData(WclSession_t smpSession,
+                              WosBuffer_t *pStdProtocolPacket)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    if (WCL_SESSION_INVALID == smpSession) {
+        WLOGE("invalid session");
+        smpResult = WCL_ERROR_BAD_SESSION;
+        goto exit;
+    }
+
+    smpResult =
+        smpGetEarlyData((SmpSessionContext_t *)smpSession, pStdProtocolPacket);
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Whether the broker accepted the early data. */
+WclError_t wclSmpIsEarlyDataAccepted(WclSession_t smpSession,
+                                     bool *pIsAccepted)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    if (WCL_SESSION_INVALID == smpSession) {
+        WLOGE("invalid session");
+        smpResult = WCL_ERROR_BAD_SESSION;
+        goto exit;
+    }
+
+    smpResult =
+        smpIsEarlyDataAccepted((SmpSessionContext_t *)smpSession, pIsAccepted);
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Set the anti-replay window of the early data. */
+WclError_t wclSmpSetEarlyDataWindow(uint32_t windowSeconds,
+                                    uint32_t maxConnects)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    smpResult = smpTicketSetEarlyDataWindow(windowSeconds, maxConnects);
+    if (WCL_SUCCESS != smpResult) {
+        WLOGE("setting the early data window failed %x", smpResult);
+    }
+
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Set the executor of the asynchronous API. */
+WclError_t wclSmpSetExecutor(const WclSmpExecutor_t *pExecutor)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    smpResult = smpAsyncSetExecutor(pExecutor);
+
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Build a SMP message on the executor. */
+WclError_t wclSmpGetMessageAsync(WclSession_t smpSession,
+                                 WclSmpMessageType_t messageType,
+                                 const WosBuffer_t *pStdProtocolPacket,
+                                 WclSmpCompletionCallback_t callback,
+                                 void *pUserData)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    if (WCL_SESSION_INVALID == smpSession) {
+        WLOGE("invalid session");
+        smpResult = WCL_ERROR_BAD_SESSION;
+        goto exit;
+    }
+
+    smpResult = smpAsyncSubmit((SmpSessionContext_t *)smpSession, false,
+                               messageType, pStdProtocolPacket, callback,
+                               pUserData);
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Process a SMP message on the executor. */
+WclError_t wclSmpProcessMessageAsync(WclSession_t smpSession,
+                                     const WosBuffer_t *pSmpMessage,
+                                     WclSmpCompletionCallback_t callback,
+                                     void *pUserData)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    if (WCL_SESSION_INVALID == smpSession) {
+        WLOGE("invalid session");
+        smpResult = WCL_ERROR_BAD_SESSION;
+        goto exit;
+    }
+
+    smpResult = smpAsyncSubmit((SmpSessionContext_t *)smpSession, true,
+                               WCL_SMP_MESSAGE_RESERVED, pSmpMessage, callback,
+                               pUserData);
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Get the oldest queued completion of the asynchronous API. */
+WclError_t wclSmpPollCompletion(WclSmpCompletion_t *pCompletion,
+                                bool *pHasCompletion)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    if ((NULL == pCompletion) || (NULL == pHasCompletion)) {
+        WLOGE("bad parameter");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+
+    *pHasCompletion = smpAsyncPollCompletion(pCompletion);
+    smpResult = WCL_SUCCESS;
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
 /* ========================================================================== */
 /*                                End of File                                 */
 /* ========================================================================== */
@@ -0,0 +1,261 @@
+/* Licensed to weeveMQ under one or more contributor license agreements.
+* See the LICENCE file distributed with this work for additional information
+* regarding copyright ownership. You may obtain a copy of the License at
+*
+*     https://github.com/weeveiot/weeveMQ/blob/master/LICENCE
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+/**
+ * @file smpAsync.c
+ * @brief
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+/* ========================================================================== */
+/*                                Includes                                    */
+/* ========================================================================== */
+
+#include "wosCommon.h"
+#include "wosLog.h"
+#include "wosMemory.h"
+
+#include "smpAsync.h"
+
+/* ========================================================================== */
+/*                                Constants                                   */
+/* ========================================================================== */
+
+#define LOG_TAG "SMP"
+
+/* ========================================================================== */
+/*                                Types                                       */
+/* ========================================================================== */
+
+/* A submitted message, then its completion until it is delivered. */
+typedef struct tSmpAsyncJob {
+    /* Next completion in the queue. */
+    struct tSmpAsyncJob *pNext;
+    SmpSessionContext_t *pSmpCtx;
+    bool isProcess;
+    WclSmpMessageType_t messageType;
+    const WosBuffer_t *pInput;
+    WclSmpCompletionCallback_t callback;
+    /* Notification of the executor the job was submitted to. */
+    void (*notify)(void *pContext);
+    void *pNotifyContext;
+    WclSmpCompletion_t completion;
+} SmpAsyncJob_t;
+
+/* ========================================================================== */
+/*                                Local Function Declarations                 */
+/* ========================================================================== */
+
+/* Default executor, running the job before returning. */
+static WclError_t lSmpAsyncRunInline(void *pContext,
+                                     WclSmpJobFunction_t jobFunction,
+                                     void *pJob);
+
+/* Build or process the message of a job, then deliver its completion. */
+static void lSmpAsyncRunJob(void *pJob);
+
+/* ========================================================================== */
+/*                                Global Variables                            */
+/* ========================================================================== */
+
+static WclSmpExecutor_t gExecutor = {lSmpAsyncRunInline, NULL, NULL};
+
+/* Completions queued by any thread, the last one first. */
+static SmpAsyncJob_t *gpQueuedCompletions = NULL;
+
+/* Completions taken from the queue by the polling thread, the oldest one
+ * first. */
+static SmpAsyncJob_t *gpPolledCompletions = NULL;
+
+/* ========================================================================== */
+/*                                Local Function Definitions                  */
+/* ========================================================================== */
+
+static WclError_t lSmpAsyncRunInline(void *pContext,
+                                     WclSmpJobFunction_t jobFunction,
+                                     void *pJob)
+{
+    (void)pContext;
+    jobFunction(pJob);
+    return WCL_SUCCESS;
+}
+
+static void lSmpAsyncRunJob(void *pJob)
+{
+    SmpAsyncJob_t *pAsyncJob = (SmpAsyncJob_t *)pJob;
+    SmpAsyncJob_t *pNext = NULL;
+    void (*notify)(void *pContext) = pAsyncJob->notify;
+    void *pNotifyContext = pAsyncJob->pNotifyContext;
+
+    FUNCTION_ENTRY();
+
+    if (pAsyncJob->isProcess) {
+        pAsyncJob->completion.result = wclSmpProcessMessage(
+            pAsyncJob->completion.smpSession, pAsyncJob->pInput,
+            &pAsyncJob->completion.output);
+    } else {
+        pAsyncJob->completion.result = wclSmpGetMessage(
+            pAsyncJob->completion.smpSession, pAsyncJob->messageType,
+            pAsyncJob->pInput, &pAsyncJob->completion.output);
+    }
+
+    /* The session may be closed from here on, even by the callback. */
+    __atomic_sub_fetch(&pAsyncJob->pSmpCtx->numPendingJobs, 1,
+                       __ATOMIC_RELEASE);
+    pAsyncJob->pSmpCtx = NULL;
+
+    if (NULL != pAsyncJob->callback) {
+        pAsyncJob->callback(&pAsyncJob->completion);
+        wosMemFree(pAsyncJob);
+    } else {
+        /* The job belongs to the polling thread once queued. */
+        pNext = __atomic_load_n(&gpQueuedCompletions, __ATOMIC_RELAXED);
+        do {
+            pAsyncJob->pNext = pNext;
+        } while (!__atomic_compare_exchange_n(&gpQueuedCompletions, &pNext,
+                                              pAsyncJob, true,
+                                              __ATOMIC_RELEASE,
+                                              __ATOMIC_RELAXED));
+        if (NULL != notify) {
+            notify(pNotifyContext);
+        }
+    }
+
+    FUNCTION_EXIT();
+}
+
+/* ========================================================================== */
+/*                                Function Definitions                        */
+/* ========================================================================== */
+
+WclError_t smpAsyncSetExecutor(const WclSmpExecutor_t *pExecutor)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    if (NULL == pExecutor) {
+        gExecutor.submit = lSmpAsyncRunInline;
+        gExecutor.notify = NULL;
+        gExecutor.pContext = NULL;
+    } else if (NULL == pExecutor->submit) {
+        WLOGE("invalid parameter");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    } else {
+        gExecutor = *pExecutor;
+    }
+    smpResult = WCL_SUCCESS;
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+WclError_t smpAsyncSubmit(SmpSessionContext_t *pSmpCtx, bool isProcess,
+                          WclSmpMessageType_t messageType,
+                          const WosBuffer_t *pInput,
+                          WclSmpCompletionCallback_t callback,
+                          void *pUserData)
+{
+    WclError_t smpResult = WCL_ERROR;
+    SmpAsyncJob_t *pAsyncJob = NULL;
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation. */
+    if ((NULL == pSmpCtx) || (!WOS_IS_VALID_BUFFER(pInput))) {
+        WLOGE("invalid parameter");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+
+    pAsyncJob = wosMemAlloc(sizeof(SmpAsyncJob_t));
+    if (NULL == pAsyncJob) {
+        WLOGE("out of memory");
+        smpResult = WCL_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+    wosMemSet(pAsyncJob, 0, sizeof(SmpAsyncJob_t));
+    pAsyncJob->pSmpCtx = pSmpCtx;
+    pAsyncJob->isProcess = isProcess;
+    pAsyncJob->messageType = messageType;
+    pAsyncJob->pInput = pInput;
+    pAsyncJob->callback = callback;
+    pAsyncJob->notify = gExecutor.notify;
+    pAsyncJob->pNotifyContext = gExecutor.pContext;
+    pAsyncJob->completion.smpSession = (WclSession_t)pSmpCtx;
+    pAsyncJob->completion.result = WCL_ERROR;
+    pAsyncJob->completion.pUserData = pUserData;
+
+    __atomic_add_fetch(&pSmpCtx->numPendingJobs, 1, __ATOMIC_RELAXED);
+    smpResult =
+        gExecutor.submit(gExecutor.pContext, lSmpAsyncRunJob, pAsyncJob);
+    if (WCL_SUCCESS != smpResult) {
+        WLOGE("job submission failed %x", smpResult);
+        __atomic_sub_fetch(&pSmpCtx->numPendingJobs, 1, __ATOMIC_RELEASE);
+        wosMemFree(pAsyncJob);
+        goto exit;
+    }
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+bool smpAsyncPollCompletion(WclSmpCompletion_t *pCompletion)
+{
+    SmpAsyncJob_t *pAsyncJob = NULL;
+    SmpAsyncJob_t *pNext = NULL;
+
+    /* Take the whole queue and put it back in the order it was filled. */
+    if (NULL == gpPolledCompletions) {
+        pAsyncJob = __atomic_exchange_n(&gpQueuedCompletions, NULL,
+                                        __ATOMIC_ACQUIRE);
+        while (NULL != pAsyncJob) {
+            pNext = pAsyncJob->pNext;
+            pAsyncJob->pNext = gpPolledCompletions;
+            gpPolledCompletions = pAsyncJob;
+            pAsyncJob = pNext;
+        }
+    }
+    if (NULL == gpPolledCompletions) {
+        return false;
+    }
+
+    pAsyncJob = gpPolledCompletions;
+    gpPolledCompletions = pAsyncJob->pNext;
+    *pCompletion = pAsyncJob->completion;
+    wosMemFree(pAsyncJob);
+    return true;
+}
+
+void smpAsyncTerminate(void)
+{
+    WclSmpCompletion_t completion;
+
+    FUNCTION_ENTRY();
+
+    while (smpAsyncPollCompletion(&completion)) {
+        WOS_FREE_DATA(&completion.output);
+    }
+    (void)smpAsyncSetExecutor(NULL);
+
+    FUNCTION_EXIT();
+}
+
+/* ========================================================================== */
+/*                                End of File                                 */
+/* ========================================================================== */
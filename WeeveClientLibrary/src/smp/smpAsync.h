@@ -0,0 +1,79 @@
+/* Licensed to weeveMQ under one or more contributor license agreements.
+* See the LICENCE file distributed with this work for additional information
+* regarding copyright ownership. You may obtain a copy of the License at
+*
+*     https://github.com/weeveiot/weeveMQ/blob/master/LICENCE
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+/**
+ * @file smpAsync.h
+ * @brief Asynchronous building and processing of SMP messages, run by a
+ * pluggable executor.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#ifndef SMP_ASYNC_H_
+#define SMP_ASYNC_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========================================================================== */
+/*                                Includes                                    */
+/* ========================================================================== */
+
+#include "wclTypes.h"
+#include "wclSmp.h"
+#include "smpInternal.h"
+
+/* ========================================================================== */
+/*                                Constants                                   */
+/* ========================================================================== */
+
+/* ========================================================================== */
+/*                                Types                                       */
+/* ========================================================================== */
+
+/* ========================================================================== */
+/*                                Global Variables                            */
+/* ========================================================================== */
+
+/* ========================================================================== */
+/*                                Function Declarations                       */
+/* ========================================================================== */
+
+/* Set the executor of the jobs, NULL for the inline one. */
+WclError_t smpAsyncSetExecutor(const WclSmpExecutor_t *pExecutor);
+
+/* Submit a job building, or processing when isProcess is set, a message of
+ * the session. The input is not copied. */
+WclError_t smpAsyncSubmit(SmpSessionContext_t *pSmpCtx, bool isProcess,
+                          WclSmpMessageType_t messageType,
+                          const WosBuffer_t *pInput,
+                          WclSmpCompletionCallback_t callback,
+                          void *pUserData);
+
+/* Take the oldest queued completion, false when there is none. */
+bool smpAsyncPollCompletion(WclSmpCompletion_t *pCompletion);
+
+/* Free the queued completions and restore the inline executor. */
+void smpAsyncTerminate(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SMP_ASYNC_H_ */
+
+/* ========================================================================== */
+/*                                End of File                                 */
+/* ========================================================================== */
@@ -0,0 +1,682 @@
+/* Licensed to weeveMQ under one or more contributor license agreements.
+* See the LICENCE file distributed with this work for additional information
+* regarding copyright ownership. You may obtain a copy of the License at
+*
+*     https://github.com/weeveiot/weeveMQ/blob/master/LICENCE
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+/**
+ * @file smpCompress.c
+ * @brief
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+/* ========================================================================== */
+/*                                Includes                                    */
+/* ========================================================================== */
+
+#include "wclConfig.h"
+#include "wosCommon.h"
+#include "wosLog.h"
+#include "wosMemory.h"
+#include "wosString.h"
+
+#include "smpCompress.h"
+
+/* ========================================================================== */
+/*                                Constants                                   */
+/* ========================================================================== */
+
+#define LOG_TAG "SMP"
+
+/* Matches are found through a table of the last position of each hash of 4
+ * bytes. */
+#define SMP_COMPRESS_HASH_BITS (12)
+#define SMP_COMPRESS_HASH_SIZE (1 << SMP_COMPRESS_HASH_BITS)
+#define SMP_COMPRESS_MIN_MATCH (4)
+#define SMP_COMPRESS_MAX_OFFSET (SMP_COMPRESS_MAX_DICTIONARY_LENGTH)
+
+/* Each 64 positions in a row without a match, the search skips one more
+ * byte, which gets through incompressible data quickly. */
+#define SMP_COMPRESS_SKIP_TRIGGER (6)
+
+/* Compression is given up if the first bytes of a packet did not shrink. */
+#define SMP_COMPRESS_PROBE_LENGTH (1024)
+
+/* Each token, byte of length or offset of the LZ4 block format makes at most
+ * 255 bytes of output. */
+#define SMP_COMPRESS_MAX_RATIO (255)
+
+/* MQTT PUBLISH control packet type, in the upper nibble of the first byte. */
+#define SMP_COMPRESS_MQTT_PUBLISH (3)
+
+/* ========================================================================== */
+/*                                Types                                       */
+/* ========================================================================== */
+
+/* Dictionary matches may point into, as if it preceded the packet. */
+typedef struct tSmpCompressDictionary {
+    /* Identifier carried by the packets compressed with the dictionary. */
+    uint8_t dictionaryId;
+    /* Topics of the PUBLISH packets compressed with the dictionary. */
+    WosString_t pTopicPrefix;
+    size_t topicPrefixLength;
+    WosBuffer_t dictionary;
+    /* Hash table of the dictionary, positions plus one, 0 for none. */
+    uint32_t *pHashTable;
+} SmpCompressDictionary_t;
+
+/* ========================================================================== */
+/*                                Global Variables                            */
+/* ========================================================================== */
+
+static SmpCompressDictionary_t
+    gDictionaries[WCL_SMP_COMPRESSION_MAX_DICTIONARIES];
+
+/* ========================================================================== */
+/*                                Local Function Declarations                 */
+/* ========================================================================== */
+
+/* The 4 bytes at pData. */
+static uint32_t lSmpCompressRead32(const uint8_t *pData);
+
+/* Hash of the 4 bytes at pData. */
+static uint32_t lSmpCompressHash(const uint8_t *pData);
+
+/* Fill a hash table with the positions of pData, the last ones win. */
+static void lSmpCompressHashPositions(const uint8_t *pData, size_t length,
+                                      uint32_t *pHashTable);
+
+/* Append a sequence of literals followed by a match, or by nothing when
+ * matchLength is 0. Fails if it does not fit in pOut. */
+static bool lSmpCompressEmit(WosBuffer_t *pOut, size_t *pOffset,
+                             const uint8_t *pLiterals, size_t numLiterals,
+                             size_t matchOffset, size_t matchLength);
+
+/* Compress pData[start, length), pData[0, start) being the dictionary whose
+ * positions are already in pHashTable. Returns the compressed length, 0 if
+ * it does not fit in pOut or compression is not worth it. */
+static size_t lSmpCompressBlock(const uint8_t *pData, size_t start,
+                                size_t length, uint32_t *pHashTable,
+                                WosBuffer_t *pOut);
+
+/* Decompress a block into the whole of pOut. */
+static bool lSmpDecompressBlock(const WosBuffer_t *pDictionary,
+                                const uint8_t *pData, size_t length,
+                                WosBuffer_t *pOut);
+
+/* Free the content of a dictionary slot. */
+static void lSmpCompressFreeDictionary(SmpCompressDictionary_t *pDictionary);
+
+/* Dictionary by identifier, NULL if there is none. */
+static SmpCompressDictionary_t *lSmpCompressGetDictionary(uint8_t dictionaryId);
+
+/* Dictionary of the topic of a PUBLISH packet, or of the first packet of a
+ * batch, NULL if there is none. */
+static SmpCompressDictionary_t *
+lSmpCompressFindDictionary(const WosBuffer_t *pPacket);
+
+/* ========================================================================== */
+/*                                Local Function Definitions                  */
+/* ========================================================================== */
+
+static uint32_t lSmpCompressRead32(const uint8_t *pData)
+{
+    return (uint32_t)pData[0] | ((uint32_t)pData[1] << 8) |
+           ((uint32_t)pData[2] << 16) | ((uint32_t)pData[3] << 24);
+}
+
+static uint32_t lSmpCompressHash(const uint8_t *pData)
+{
+    return (lSmpCompressRead32(pData) * 2654435761U) >>
+           (32 - SMP_COMPRESS_HASH_BITS);
+}
+
+static void lSmpCompressHashPositions(const uint8_t *pData, size_t length,
+                                      uint32_t *pHashTable)
+{
+    size_t position = 0;
+
+    for (position = 0; position + SMP_COMPRESS_MIN_MATCH <= length;
+         position++) {
+        pHashTable[lSmpCompressHash(pData + position)] =
+            (uint32_t)position + 1;
+    }
+}
+
+static bool lSmpCompressEmit(WosBuffer_t *pOut, size_t *pOffset,
+                             const uint8_t *pLiterals, size_t numLiterals,
+                             size_t matchOffset, size_t matchLength)
+{
+    uint8_t *pCursor = pOut->data + *pOffset;
+    size_t available = pOut->length - *pOffset;
+    size_t needed = 1 + numLiterals / 255 + 1 + numLiterals;
+    size_t extra = 0;
+    uint8_t token = 0;
+
+    if (0 != matchLength) {
+        needed += 2 + (matchLength - SMP_COMPRESS_MIN_MATCH) / 255 + 1;
+    }
+    if (needed > available) {
+        return false;
+    }
+
+    token = (numLiterals < 15) ? (uint8_t)(numLiterals << 4) : 0xF0;
+    if (0 != matchLength) {
+        extra = matchLength - SMP_COMPRESS_MIN_MATCH;
+        token |= (extra < 15) ? (uint8_t)extra : 0x0F;
+    }
+    *pCursor++ = token;
+    if (numLiterals >= 15) {
+        for (extra = numLiterals - 15; extra >= 255; extra -= 255) {
+            *pCursor++ = 255;
+        }
+        *pCursor++ = (uint8_t)extra;
+    }
+    wosMemCopy(pCursor, pLiterals, numLiterals);
+    pCursor += numLiterals;
+
+    if (0 != matchLength) {
+        *pCursor++ = (uint8_t)matchOffset;
+        *pCursor++ = (uint8_t)(matchOffset >> 8);
+        if (matchLength - SMP_COMPRESS_MIN_MATCH >= 15) {
+            for (extra = matchLength - SMP_COMPRESS_MIN_MATCH - 15;
+                 extra >= 255; extra -= 255) {
+                *pCursor++ = 255;
+            }
+            *pCursor++ = (uint8_t)extra;
+        }
+    }
+    *pOffset = (size_t)(pCursor - pOut->data);
+    return true;
+}
+
+static size_t lSmpCompressBlock(const uint8_t *pData, size_t start,
+                                size_t length, uint32_t *pHashTable,
+                                WosBuffer_t *pOut)
+{
+    size_t position = start;
+    size_t anchor = start;
+    size_t candidate = 0;
+    size_t matchLength = 0;
+    size_t outOffset = 0;
+    uint32_t numMisses = 0;
+    uint32_t hash = 0;
+    bool isProbed = false;
+
+    while (position + SMP_COMPRESS_MIN_MATCH <= length) {
+        if ((!isProbed) && (position - start >= SMP_COMPRESS_PROBE_LENGTH)) {
+            /* Give up on data which has not shrunk so far. */
+            if (outOffset + (position - anchor) >= position - start) {
+                return 0;
+            }
+            isProbed = true;
+        }
+
+        hash = lSmpCompressHash(pData + position);
+        candidate = pHashTable[hash];
+        pHashTable[hash] = (uint32_t)position + 1;
+        if ((0 == candidate) || (position - (candidate - 1) >
+                                 SMP_COMPRESS_MAX_OFFSET) ||
+            (lSmpCompressRead32(pData + candidate - 1) !=
+             lSmpCompressRead32(pData + position))) {
+            position += 1 + (numMisses++ >> SMP_COMPRESS_SKIP_TRIGGER);
+            continue;
+        }
+        candidate--;
+        numMisses = 0;
+
+        matchLength = SMP_COMPRESS_MIN_MATCH;
+        while ((position + matchLength < length) &&
+               (pData[candidate + matchLength] ==
+                pData[position + matchLength])) {
+            matchLength++;
+        }
+        if (!lSmpCompressEmit(pOut, &outOffset, pData + anchor,
+                              position - anchor, position - candidate,
+                              matchLength)) {
+            return 0;
+        }
+        position += matchLength;
+        anchor = position;
+    }
+
+    /* The last sequence only has literals. */
+    if (!lSmpCompressEmit(pOut, &outOffset, pData + anchor, length - anchor, 0,
+                          0)) {
+        return 0;
+    }
+    return outOffset;
+}
+
+static bool lSmpDecompressBlock(const WosBuffer_t *pDictionary,
+                                const uint8_t *pData, size_t length,
+                                WosBuffer_t *pOut)
+{
+    size_t inOffset = 0;
+    size_t outOffset = 0;
+    size_t dictionaryLength = (NULL == pDictionary) ? 0 : pDictionary->length;
+    size_t numLiterals = 0;
+    size_t matchOffset = 0;
+    size_t matchLength = 0;
+    uint8_t token = 0;
+    uint8_t extra = 0;
+
+    while (inOffset < length) {
+        token = pData[inOffset++];
+
+        numLiterals = token >> 4;
+        if (15 == numLiterals) {
+            do {
+                if (inOffset >= length) {
+                    return false;
+                }
+                extra = pData[inOffset++];
+                numLiterals += extra;
+            } while (255 == extra);
+        }
+        if ((numLiterals > length - inOffset) ||
+            (numLiterals > pOut->length - outOffset)) {
+            return false;
+        }
+        wosMemCopy(pOut->data + outOffset, pData + inOffset, numLiterals);
+        inOffset += numLiterals;
+        outOffset += numLiterals;
+
+        /* The last sequence has no match. */
+        if (inOffset == length) {
+            break;
+        }
+
+        if (length - inOffset < 2) {
+            return false;
+        }
+        matchOffset =
+            (size_t)pData[inOffset] | ((size_t)pData[inOffset + 1] << 8);
+        inOffset += 2;
+        if ((0 == matchOffset) || (matchOffset > outOffset + dictionaryLength)) {
+            return false;
+        }
+        matchLength = (token & 0x0F) + SMP_COMPRESS_MIN_MATCH;
+        if (15 + SMP_COMPRESS_MIN_MATCH == matchLength) {
+            do {
+                if (inOffset >= length) {
+                    return false;
+                }
+                extra = pData[inOffset++];
+                matchLength += extra;
+            } while (255 == extra);
+        }
+        if (matchLength > pOut->length - outOffset) {
+            return false;
+        }
+
+        if ((matchOffset <= outOffset) && (matchOffset >= matchLength)) {
+            wosMemCopy(pOut->data + outOffset,
+                       pOut->data + outOffset - matchOffset, matchLength);
+            outOffset += matchLength;
+        } else {
+            /* Overlapping, or starting in the dictionary. */
+            for (; matchLength > 0; matchLength--, outOffset++) {
+                if (matchOffset > outOffset) {
+                    pOut->data[outOffset] =
+                        pDictionary->data[dictionaryLength -
+                                          (matchOffset - outOffset)];
+                } else {
+                    pOut->data[outOffset] =
+                        pOut->data[outOffset - matchOffset];
+                }
+            }
+        }
+    }
+
+    return (outOffset == pOut->length);
+}
+
+static void lSmpCompressFreeDictionary(SmpCompressDictionary_t *pDictionary)
+{
+    if (NULL != pDictionary->pTopicPrefix) {
+        wosMemFree(pDictionary->pTopicPrefix);
+    }
+    WOS_FREE_DATA(&pDictionary->dictionary);
+    if (NULL != pDictionary->pHashTable) {
+        wosMemFree(pDictionary->pHashTable);
+    }
+    wosMemSet(pDictionary, 0, sizeof(SmpCompressDictionary_t));
+}
+
+static SmpCompressDictionary_t *lSmpCompressGetDictionary(uint8_t dictionaryId)
+{
+    uint8_t i = 0;
+
+    for (i = 0; i < WCL_SMP_COMPRESSION_MAX_DICTIONARIES; i++) {
+        if ((NULL != gDictionaries[i].pHashTable) &&
+            (dictionaryId == gDictionaries[i].dictionaryId)) {
+            return &gDictionaries[i];
+        }
+    }
+    return NULL;
+}
+
+static SmpCompressDictionary_t *
+lSmpCompressFindDictionary(const WosBuffer_t *pPacket)
+{
+    SmpCompressDictionary_t *pFound = NULL;
+    size_t offset = 1;
+    size_t topicLength = 0;
+    uint8_t i = 0;
+
+    if ((SMP_COMPRESS_MQTT_PUBLISH != (pPacket->data[0] >> 4))) {
+        return NULL;
+    }
+    /* Skip the remaining length. */
+    while ((offset < pPacket->length) && (offset < 5) &&
+           (0 != (pPacket->data[offset] & 0x80))) {
+        offset++;
+    }
+    offset++;
+    if (offset + 2 > pPacket->length) {
+        return NULL;
+    }
+    topicLength = ((size_t)pPacket->data[offset] << 8) |
+                  (size_t)pPacket->data[offset + 1];
+    offset += 2;
+    if (topicLength > pPacket->length - offset) {
+        return NULL;
+    }
+
+    for (i = 0; i < WCL_SMP_COMPRESSION_MAX_DICTIONARIES; i++) {
+        if ((NULL != gDictionaries[i].pHashTable) &&
+            (gDictionaries[i].topicPrefixLength <= topicLength) &&
+            (0 == wosMemComparison((uint8_t *)gDictionaries[i].pTopicPrefix,
+                                   pPacket->data + offset,
+                                   gDictionaries[i].topicPrefixLength)) &&
+            ((NULL == pFound) || (gDictionaries[i].topicPrefixLength >
+                                  pFound->topicPrefixLength))) {
+            pFound = &gDictionaries[i];
+        }
+    }
+    return pFound;
+}
+
+/* ========================================================================== */
+/*                                Implementation                              */
+/* ========================================================================== */
+
+WclError_t smpCompressSetDictionary(uint8_t dictionaryId,
+                                    WosString_t pTopicPrefix,
+                                    const WosBuffer_t *pDictionary)
+{
+    WclError_t smpResult = WCL_ERROR;
+    SmpCompressDictionary_t *pSlot = NULL;
+    size_t topicPrefixLength = 0;
+    uint8_t i = 0;
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation, 0 stands for no dictionary. */
+    if ((0 == dictionaryId) ||
+        ((NULL != pDictionary) &&
+         ((!WOS_IS_VALID_BUFFER(pDictionary)) || (NULL == pTopicPrefix)))) {
+        WLOGE("invalid parameter");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+
+    pSlot = lSmpCompressGetDictionary(dictionaryId);
+    if (NULL != pSlot) {
+        lSmpCompressFreeDictionary(pSlot);
+    }
+    if (NULL == pDictionary) {
+        smpResult = WCL_SUCCESS;
+        goto exit;
+    }
+    for (i = 0; (NULL == pSlot) && (i < WCL_SMP_COMPRESSION_MAX_DICTIONARIES);
+         i++) {
+        if (NULL == gDictionaries[i].pHashTable) {
+            pSlot = &gDictionaries[i];
+        }
+    }
+    if (NULL == pSlot) {
+        WLOGE("too many dictionaries");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+
+    /* Only the end of a long dictionary can be reached by the matches. */
+    topicPrefixLength = wosStringLength(pTopicPrefix);
+    pSlot->pTopicPrefix = wosMemAlloc(topicPrefixLength + 1);
+    pSlot->dictionary.length =
+        (pDictionary->length > SMP_COMPRESS_MAX_DICTIONARY_LENGTH)
+            ? SMP_COMPRESS_MAX_DICTIONARY_LENGTH
+            : pDictionary->length;
+    pSlot->dictionary.data = wosMemAlloc(pSlot->dictionary.length);
+    pSlot->pHashTable =
+        wosMemAlloc(SMP_COMPRESS_HASH_SIZE * sizeof(pSlot->pHashTable[0]));
+    if ((NULL == pSlot->pTopicPrefix) || (NULL == pSlot->dictionary.data) ||
+        (NULL == pSlot->pHashTable)) {
+        WLOGE("error allocating memory");
+        lSmpCompressFreeDictionary(pSlot);
+        smpResult = WCL_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+    pSlot->dictionaryId = dictionaryId;
+    wosMemCopy(pSlot->pTopicPrefix, pTopicPrefix, topicPrefixLength + 1);
+    pSlot->topicPrefixLength = topicPrefixLength;
+    wosMemCopy(pSlot->dictionary.data,
+               pDictionary->data + pDictionary->length -
+                   pSlot->dictionary.length,
+               pSlot->dictionary.length);
+    /* Hashed once here rather than for each packet. */
+    wosMemSet(pSlot->pHashTable, 0,
+              SMP_COMPRESS_HASH_SIZE * sizeof(pSlot->pHashTable[0]));
+    lSmpCompressHashPositions(pSlot->dictionary.data, pSlot->dictionary.length,
+                              pSlot->pHashTable);
+    smpResult = WCL_SUCCESS;
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+void smpCompressWipeDictionaries(void)
+{
+    uint8_t i = 0;
+
+    for (i = 0; i < WCL_SMP_COMPRESSION_MAX_DICTIONARIES; i++) {
+        lSmpCompressFreeDictionary(&gDictionaries[i]);
+    }
+}
+
+WclError_t smpCompressPack(const WosBuffer_t *pPacket, WosBuffer_t *pPacked)
+{
+    WclError_t smpResult = WCL_ERROR;
+    SmpCompressDictionary_t *pDictionary = NULL;
+    WosBuffer_t window = {.data = NULL, .length = 0};
+    WosBuffer_t block = {.data = NULL, .length = 0};
+    uint32_t *pHashTable = NULL;
+    size_t start = 0;
+    size_t compressedLength = 0;
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation. */
+    if ((!WOS_IS_VALID_BUFFER(pPacket)) || (NULL == pPacked) ||
+        (pPacket->length > UINT32_MAX)) {
+        WLOGE("invalid parameter");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+
+    /* Room for the packet stored as is, compressed it has to be shorter. */
+    pPacked->data = wosMemAlloc(1 + pPacket->length);
+    if (NULL == pPacked->data) {
+        WLOGE("error allocating memory");
+        smpResult = WCL_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+    pPacked->length = 1 + pPacket->length;
+
+    if (pPacket->length >= WCL_SMP_COMPRESSION_MIN_BYTES) {
+        pHashTable =
+            wosMemAlloc(SMP_COMPRESS_HASH_SIZE * sizeof(pHashTable[0]));
+        if (NULL == pHashTable) {
+            WLOGE("error allocating memory");
+            smpResult = WCL_ERROR_OUT_OF_MEMORY;
+            goto exit;
+        }
+        /* Matches may point into the dictionary as if it preceded the
+         * packet. */
+        pDictionary = lSmpCompressFindDictionary(pPacket);
+        if (NULL != pDictionary) {
+            window.length = pDictionary->dictionary.length + pPacket->length;
+            window.data = wosMemAlloc(window.length);
+            if (NULL == window.data) {
+                WLOGE("error allocating memory");
+                smpResult = WCL_ERROR_OUT_OF_MEMORY;
+                goto exit;
+            }
+            wosMemCopy(window.data, pDictionary->dictionary.data,
+                       pDictionary->dictionary.length);
+            wosMemCopy(window.data + pDictionary->dictionary.length,
+                       pPacket->data, pPacket->length);
+            wosMemCopy(pHashTable, pDictionary->pHashTable,
+                       SMP_COMPRESS_HASH_SIZE * sizeof(pHashTable[0]));
+            start = pDictionary->dictionary.length;
+        } else {
+            window.data = pPacket->data;
+            window.length = pPacket->length;
+            wosMemSet(pHashTable, 0,
+                      SMP_COMPRESS_HASH_SIZE * sizeof(pHashTable[0]));
+        }
+        /* Compressing is only worth it when it saves a thirty-second. */
+        block.data = pPacked->data + SMP_COMPRESS_HEADER_LENGTH;
+        block.length = pPacket->length + 1 - SMP_COMPRESS_HEADER_LENGTH -
+                       (pPacket->length >> 5);
+        compressedLength = lSmpCompressBlock(window.data, start, window.length,
+                                             pHashTable, &block);
+    }
+
+    if (0 != compressedLength) {
+        pPacked->data[0] = SMP_COMPRESS_METHOD_LZ;
+        pPacked->data[1] =
+            (NULL == pDictionary) ? 0 : pDictionary->dictionaryId;
+        pPacked->data[2] = (uint8_t)(pPacket->length >> 24);
+        pPacked->data[3] = (uint8_t)(pPacket->length >> 16);
+        pPacked->data[4] = (uint8_t)(pPacket->length >> 8);
+        pPacked->data[5] = (uint8_t)pPacket->length;
+        pPacked->length = SMP_COMPRESS_HEADER_LENGTH + compressedLength;
+    } else {
+        pPacked->data[0] = SMP_COMPRESS_METHOD_NONE;
+        wosMemCopy(pPacked->data + 1, pPacket->data, pPacket->length);
+    }
+    smpResult = WCL_SUCCESS;
+
+exit:
+    if (NULL != pDictionary) {
+        WOS_FREE_DATA(&window);
+    }
+    if (NULL != pHashTable) {
+        wosMemFree(pHashTable);
+    }
+    if (WCL_SUCCESS != smpResult) {
+        WOS_FREE_DATA(pPacked);
+    }
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+WclError_t smpCompressUnpack(const WosBuffer_t *pPacked, WosBuffer_t *pPacket)
+{
+    WclError_t smpResult = WCL_ERROR;
+    SmpCompressDictionary_t *pDictionary = NULL;
+    size_t blockLength = 0;
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation. */
+    if ((!WOS_IS_VALID_BUFFER(pPacked)) || (NULL == pPacket)) {
+        WLOGE("invalid parameter");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+    pPacket->data = NULL;
+    pPacket->length = 0;
+
+    if ((SMP_COMPRESS_METHOD_NONE == pPacked->data[0]) &&
+        (1 < pPacked->length)) {
+        pPacket->length = pPacked->length - 1;
+        pPacket->data = wosMemAlloc(pPacket->length);
+        if (NULL == pPacket->data) {
+            WLOGE("error allocating memory");
+            smpResult = WCL_ERROR_OUT_OF_MEMORY;
+            goto exit;
+        }
+        wosMemCopy(pPacket->data, pPacked->data + 1, pPacket->length);
+        smpResult = WCL_SUCCESS;
+        goto exit;
+    }
+
+    if ((SMP_COMPRESS_METHOD_LZ != pPacked->data[0]) ||
+        (SMP_COMPRESS_HEADER_LENGTH >= pPacked->length)) {
+        WLOGE("bad compressed packet");
+        smpResult = WCL_ERROR_INVALID_MESSAGE;
+        goto exit;
+    }
+    if (0 != pPacked->data[1]) {
+        pDictionary = lSmpCompressGetDictionary(pPacked->data[1]);
+        if (NULL == pDictionary) {
+            WLOGE("unknown dictionary %u", pPacked->data[1]);
+            smpResult = WCL_ERROR_INVALID_MESSAGE;
+            goto exit;
+        }
+    }
+    /* Bound what is allocated for a packet to what the block can make. */
+    blockLength = pPacked->length - SMP_COMPRESS_HEADER_LENGTH;
+    pPacket->length = ((size_t)pPacked->data[2] << 24) |
+                      ((size_t)pPacked->data[3] << 16) |
+                      ((size_t)pPacked->data[4] << 8) |
+                      (size_t)pPacked->data[5];
+    if ((0 == pPacket->length) ||
+        (pPacket->length / SMP_COMPRESS_MAX_RATIO > blockLength)) {
+        WLOGE("bad compressed packet length");
+        pPacket->length = 0;
+        smpResult = WCL_ERROR_INVALID_MESSAGE;
+        goto exit;
+    }
+    pPacket->data = wosMemAlloc(pPacket->length);
+    if (NULL == pPacket->data) {
+        WLOGE("error allocating memory");
+        pPacket->length = 0;
+        smpResult = WCL_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+    if (!lSmpDecompressBlock(
+            (NULL == pDictionary) ? NULL : &pDictionary->dictionary,
+            pPacked->data + SMP_COMPRESS_HEADER_LENGTH, blockLength,
+            pPacket)) {
+        WLOGE("bad compressed packet");
+        smpResult = WCL_ERROR_INVALID_MESSAGE;
+        goto exit;
+    }
+    smpResult = WCL_SUCCESS;
+
+exit:
+    if (WCL_SUCCESS != smpResult) {
+        WOS_FREE_DATA(pPacket);
+    }
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* ========================================================================== */
+/*                                End of File                                 */
+/* ========================================================================== */
@@ -0,0 +1,94 @@
+/* Licensed to weeveMQ under one or more contributor license agreements.
+* See the LICENCE file distributed with this work for additional information
+* regarding copyright ownership. You may obtain a copy of the License at
+*
+*     https://github.com/weeveiot/weeveMQ/blob/master/LICENCE
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+/**
+ * @file smpCompress.h
+ * @brief Compression of the standard protocol packets a SMP session encrypts,
+ * applied before the encryption once both ends have agreed on it.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#ifndef SMP_COMPRESS_H_
+#define SMP_COMPRESS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========================================================================== */
+/*                                Includes                                    */
+/* ========================================================================== */
+
+#include "wclTypes.h"
+
+/* ========================================================================== */
+/*                                Constants                                   */
+/* ========================================================================== */
+
+/* First byte of a packed packet, telling how the rest is to be read. */
+/* The packet follows as is. */
+#define SMP_COMPRESS_METHOD_NONE (0)
+/* A dictionary id and the 32 bits big endian length of the packet follow,
+ * then the packet compressed as LZ77 sequences in the LZ4 block format. */
+#define SMP_COMPRESS_METHOD_LZ (1)
+
+/* Length of the method, dictionary id and packet length of a compressed
+ * packet. */
+#define SMP_COMPRESS_HEADER_LENGTH (6)
+
+/* Matches reach at most this many bytes back, only as much of a dictionary
+ * is useful. */
+#define SMP_COMPRESS_MAX_DICTIONARY_LENGTH (65535)
+
+/* ========================================================================== */
+/*                                Types                                       */
+/* ========================================================================== */
+
+/* ========================================================================== */
+/*                                Global Variables                            */
+/* ========================================================================== */
+
+/* ========================================================================== */
+/*                                Function Declarations                       */
+/* ========================================================================== */
+
+/* Install, or remove when pDictionary is NULL, the dictionary compressing the
+ * PUBLISH packets whose topic starts with pTopicPrefix. The longest matching
+ * prefix wins. Dictionaries are shared by all sessions and are not locked, so
+ * they are to be set before any session uses them. */
+WclError_t smpCompressSetDictionary(uint8_t dictionaryId,
+                                    WosString_t pTopicPrefix,
+                                    const WosBuffer_t *pDictionary);
+
+/* Remove all the dictionaries. */
+void smpCompressWipeDictionaries(void);
+
+/* Pack a packet, compressed when it is long enough and compression saves
+ * space, stored otherwise. Caller should free pPacked data. */
+WclError_t smpCompressPack(const WosBuffer_t *pPacket, WosBuffer_t *pPacked);
+
+/* Get back the packet of smpCompressPack(). Caller should free pPacket data.
+ */
+WclError_t smpCompressUnpack(const WosBuffer_t *pPacked, WosBuffer_t *pPacket);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SMP_COMPRESS_H_ */
+
+/* ========================================================================== */
+/*                                End of File                                 */
+/* ========================================================================== */
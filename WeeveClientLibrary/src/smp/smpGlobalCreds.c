@@ -409,8 +409,8 @@ exit:
     return smpResult;
 }
 
-/* Config the path of different certificate and key files in Smp Context. */
-WclError_t smpConfigGlobalCreds(SmpSessionContext_t *pSmpCtx)
+/* Check the global crypto assets are ready to be used by a new session. */
+WclError_t smpCheckGlobalCreds(void)
 {
     WclError_t smpResult = WCL_ERROR;
 
@@ -423,19 +423,6 @@ WclError_t smpConfigGlobalCreds(SmpSessionContext_t *pSmpCtx)
     }
 #endif
 
-    /* Input parameters validation. */
-    if (NULL == pSmpCtx) {
-        WLOGE("bad params");
-        smpResult = WCL_ERROR_BAD_PARAMS;
-        goto exit;
-    }
-
-    // Shallow copy
-    pSmpCtx->rootCaStorageId = gRootCaStorageId;
-    pSmpCtx->selfCertChainStorageId = gSelfCertStorageId;
-    pSmpCtx->selfPrivKeyStorageId = gSelfPrivKeyStorageId;
-    pSmpCtx->selfCertChainSize = gSelfCertChainSize;
-
     smpResult = WCL_SUCCESS;
 
 exit:
@@ -444,6 +431,12 @@ exit:
     return smpResult;
 }
 
+/* Storage context holding the global crypto assets. */
+void *smpGetGlobalStorageContext(void)
+{
+    return gpStorageContext;
+}
+
 /* ========================================================================== */
 /*                                End of File                                 */
 /* ========================================================================== */
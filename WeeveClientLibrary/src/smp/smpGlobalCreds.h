@@ -45,6 +45,13 @@ extern "C" {
 /*                                Global Variables                            */
 /* ========================================================================== */
 
+/* Storage ID for Root CA. */
+extern const WosString_t gRootCaStorageId;
+/* Storage ID for Self Certificate. */
+extern const WosString_t gSelfCertStorageId;
+/* Storage ID for Self Private Key. */
+extern const WosString_t gSelfPrivKeyStorageId;
+
 /* ========================================================================== */
 /*                                Function Declarations                       */
 /* ========================================================================== */
@@ -55,8 +62,11 @@ WclError_t smpInitGlobalCreds(void);
 /* Destroy the global crypto assets. */
 WclError_t smpDeInitGlobalCreds(void);
 
-/* Config the path of different certificate and key files in Smp Context. */
-WclError_t smpConfigGlobalCreds(SmpSessionContext_t *pSmpCtx);
+/* Check the global crypto assets are ready to be used by a new session. */
+WclError_t smpCheckGlobalCreds(void);
+
+/* Storage context holding the global crypto assets. */
+void *smpGetGlobalStorageContext(void);
 
 #ifdef __cplusplus
 }
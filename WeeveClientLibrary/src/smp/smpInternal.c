@@ -32,9 +32,13 @@
 #include "wosMsgSmp.h"
 #include "wosStorage.h"
 #include "wosString.h"
+#include "wosTime.h"
 
+#include "smpCompress.h"
 #include "smpGlobalCreds.h"
 #include "smpInternalUtils.h"
+#include "smpReplay.h"
+#include "smpTicket.h"
 
 #include "smp.h"
 #include "smpInternal.h"
@@ -51,13 +55,38 @@
  * number of elements in WosSmpHeader_t, WosMsgMqttsSeParams_t and
  * WosMsgMqttsControlParams_t.
  */
-#define SMP_HEADER_MSG_SERIALIZER_SIZE_OVERHEAD (3 + 8 + 8)
+#define SMP_HEADER_MSG_SERIALIZER_SIZE_OVERHEAD (3 + 8 + 8 + 5)
 #define SMP_MQTTS_SE_MSG_SERIALIZER_SIZE_OVERHEAD (10 * 4)
 #define SMP_MQTTS_CONTROL_MSG_SERIALIZER_SIZE_OVERHEAD (4 * 4)
 
 #define SMP_ENCODED_HEADER_LENGTH                                              \
     (SMP_HEADER_MSG_SERIALIZER_SIZE_OVERHEAD + WCL_SMP_CLIENT_ID_LENGTH)
 
+/* Labels of a resumed CONNECT and CONNACK. */
+#define SMP_CLIENT_RESUME_LABEL "C2B_RESUME"
+#define SMP_BROKER_RESUME_LABEL "B2C_RESUME"
+/* Label of a resumed CONNACK accepting the early data of the CONNECT. */
+#define SMP_BROKER_RESUME_EARLY_LABEL "B2C_RESUME_EARLY"
+
+/* Content of the marker a CONNACK accepting the early data carries. */
+#define SMP_EARLY_DATA_ACCEPTED (0x01)
+
+/* HKDF info of the keys derived for session resumption. */
+#define SMP_RESUMPTION_SECRET_INFO "SMP resumption secret"
+#define SMP_RESUMPTION_BINDER_INFO "SMP resumption binder"
+#define SMP_RESUMED_SESSION_KEY_INFO "SMP resumed session key"
+
+/* HKDF info ratcheting the traffic key of each direction. */
+#define SMP_CLIENT_TRAFFIC_KEY_INFO "SMP C2B traffic key update"
+#define SMP_BROKER_TRAFFIC_KEY_INFO "SMP B2C traffic key update"
+
+/* Messages of a smpSecureMessages() call going through each step together. */
+#define SMP_SEAL_BATCH_SIZE (16)
+
+/* Length of a ticket exported by a client: expiry || secret || ticket. */
+#define SMP_EXPORTED_TICKET_LENGTH                                             \
+    (8 + SMP_TICKET_SECRET_LENGTH + SMP_TICKET_LENGTH)
+
 /* The below constant are based on WCL_SMP_CIPHER_SCHEME_ID0, not hardcoding in
  * deeper in code so that in future we can easily parameterized it to configure
  * SMP for other crypto schemes. */
@@ -85,7 +114,8 @@ const WosString_t gClientToBrokerMsgLabels[] = {
     "C2B_USUBAC", /* MQTTS_UNSUBACK = 11, */
     "C2B_PINGRQ", /* MQTTS_PINGREQ = 12, */
     "C2B_PINGRS", /* MQTTS_PINGRESP = 13, */
-    "C2B_DISCON"  /* MQTTS_DISCONNECT = 14 */
+    "C2B_DISCON", /* MQTTS_DISCONNECT = 14, */
+    "C2B_MBATCH"  /* MQTTS_BATCH = 15 */
 };
 const WosString_t gBrokerToClientMsgLabels[] = {
     NULL,         /* MQTTS_CONNECT = 1, */
@@ -101,13 +131,50 @@ const WosString_t gBrokerToClientMsgLabels[] = {
     "B2C_USUBAC", /* MQTTS_UNSUBACK = 11, */
     "B2C_PINGRQ", /* MQTTS_PINGREQ = 12, */
     "B2C_PINGRS", /* MQTTS_PINGRESP = 13, */
-    "B2C_DISCON"  /* MQTTS_DISCONNECT = 14 */
+    "B2C_DISCON", /* MQTTS_DISCONNECT = 14, */
+    "B2C_MBATCH"  /* MQTTS_BATCH = 15 */
 };
 
+/* Labels of the messages a session sends and of those it receives. */
+#define SMP_SEND_LABELS(pSmpCtx)                                               \
+    (SMP_IS_MQTTS_CLIENT(pSmpCtx) ? gClientToBrokerMsgLabels                   \
+                                  : gBrokerToClientMsgLabels)
+#define SMP_RECEIVE_LABELS(pSmpCtx)                                            \
+    (SMP_IS_MQTTS_CLIENT(pSmpCtx) ? gBrokerToClientMsgLabels                   \
+                                  : gClientToBrokerMsgLabels)
+
+/* Info ratcheting the keys of the messages a session sends and receives. */
+#define SMP_SEND_TRAFFIC_KEY_INFO(pSmpCtx)                                     \
+    (SMP_IS_MQTTS_CLIENT(pSmpCtx) ? SMP_CLIENT_TRAFFIC_KEY_INFO                \
+                                  : SMP_BROKER_TRAFFIC_KEY_INFO)
+#define SMP_RECEIVE_TRAFFIC_KEY_INFO(pSmpCtx)                                  \
+    (SMP_IS_MQTTS_CLIENT(pSmpCtx) ? SMP_BROKER_TRAFFIC_KEY_INFO                \
+                                  : SMP_CLIENT_TRAFFIC_KEY_INFO)
+
 /* ========================================================================== */
 /*                                Types                                       */
 /* ========================================================================== */
 
+/* A message being built, from the preparation of its header and
+ * authentication data to its serialization. */
+typedef struct tSmpSealJob {
+    SmpSessionContext_t *pSmpCtx;
+    WclSmpMessageType_t messageType;
+    const WosBuffer_t *pClearMessage;
+    bool encryptMqttPacket;
+    WosBuffer_t encodedHeader;
+    WosBuffer_t aad;
+    WosBuffer_t packedMessage;
+    /* Data encrypted, NULL when the packet is only authenticated. */
+    WosBuffer_t *pPlainText;
+    /* Send key of the message, the session may move to the next one before
+     * the message is encrypted. */
+    uint8_t key[WOS_CRYPTO_ECC_NIST_P256_SHARED_SECRET_LENGTH];
+    WosBuffer_t *pIv;
+    WosBuffer_t *pCipherText;
+    WosBuffer_t *pAuthTag;
+} SmpSealJob_t;
+
 /* ========================================================================== */
 /*                                Global Variables                            */
 /* ========================================================================== */
@@ -147,21 +214,117 @@ lSmpImportSessionEstablishmentParams(SmpSessionContext_t *pSmpCtx,
 /* Validate the SMP common header data like client-id, context,
  * message-counter etc. */
 static WclError_t lSmpValidateSmpHeader(SmpSessionContext_t *pSmpCtx,
-                                        const WosSmpHeader_t *pSmpHeader);
+                                        const WosMsgSmpView_t *pSmpView);
 
-/* Process the Session Establishment message, generate and persist the
- * session key. */
+/* Process the Session Establishment message and generate the session key. */
 static WclError_t lSmpProcessSeMessage(SmpSessionContext_t *pSmpCtx,
                                        const WosBuffer_t *pSmpSEMessage,
                                        WosBuffer_t *pClearMessage);
 
-/* Process the MQTTS control message. */
-
+/* Process the MQTTS control message, already parsed by smpProcessMessage. */
 static WclError_t lSmpProcessControlMessage(SmpSessionContext_t *pSmpCtx,
-                                            WclSmpMessageType_t messageType,
-                                            const WosBuffer_t *pSecuredMessage,
+                                            WosMsgSmpView_t *pSmpView,
                                             WosBuffer_t *pClearMessage);
 
+/* Wipe and release the session key exchange key pair. */
+static void lSmpFreeHandshake(SmpSessionContext_t *pSmpCtx);
+
+/* Get the session key exchange key pair, generated on first use. Fails once
+ * the key pair has been released. */
+static WclError_t lSmpGetHandshake(SmpSessionContext_t *pSmpCtx);
+
+/* Derive a key of WOS_CRYPTO_AE_AES256_KEY_LENGTH bytes with HKDF. */
+static WclError_t lSmpDeriveKey(const WosBuffer_t *pSalt,
+                                const uint8_t *pSecret, WosString_t info,
+                                uint8_t *pKey);
+
+/* Issue a ticket carrying the resumption secret of an established session. */
+static WclError_t lSmpIssueTicket(SmpSessionContext_t *pSmpCtx,
+                                  uint8_t *pTicket);
+
+/* Keep the ticket a broker issued in its CONNACK. */
+static WclError_t lSmpStoreTicket(SmpSessionContext_t *pSmpCtx,
+                                  const WosMsgMqttsSeParams_t *pMqttSeParams);
+
+/* Prepare the authentication data of a resumed session establishment,
+ * SMP-header || label || nonce (|| ticket) || MQTT packet. */
+static WclError_t lSmpPrepareResumptionAad(const WosBuffer_t *pEncodedHeader,
+                                           WosString_t label,
+                                           const WosBuffer_t *pNonce,
+                                           const WosBuffer_t *pTicket,
+                                           const WosBuffer_t *pMqttPacket,
+                                           WosBuffer_t *pAad);
+
+/* Whether a received session establishment message resumes a session. */
+static bool lSmpIsResumedSeMessage(const SmpSessionContext_t *pSmpCtx,
+                                   const WosMsgSmpView_t *pSmpView);
+
+/* Build a resumed CONNECT or CONNACK, authenticated with symmetric keys only.
+ */
+static WclError_t
+lSmpExportResumedSeMessage(SmpSessionContext_t *pSmpCtx,
+                           const WosBuffer_t *pStdProtocolSEParams,
+                           WosBuffer_t *pSmpSEMessage);
+
+/* Process a resumed CONNECT or CONNACK and derive the session key. */
+static WclError_t lSmpProcessResumedSeMessage(SmpSessionContext_t *pSmpCtx,
+                                              WosMsgSmpView_t *pSmpView,
+                                              WosBuffer_t *pClearMessage);
+
+/* Wipe and release the early data of a session resumption. */
+static void lSmpFreeEarlyData(SmpResumption_t *pResumption);
+
+/* Wipe and release the session resumption state. */
+static void lSmpFreeResumption(SmpSessionContext_t *pSmpCtx);
+
+/* Mark the session as established and start the traffic keys of both
+ * directions from the session key. */
+static void lSmpStartTraffic(SmpSessionContext_t *pSmpCtx);
+
+/* Derive the traffic key of the epoch following that of pKey. */
+static WclError_t lSmpRatchetKey(WosString_t info,
+                                 const SmpTrafficKey_t *pKey,
+                                 SmpTrafficKey_t *pNextKey);
+
+/* Get a copy of the key of the epoch a received message was protected in.
+ * The key of the epoch after the current one is derived, and only kept by
+ * lSmpCommitReceiveKey() once a message has been verified with it. */
+static WclError_t lSmpGetReceiveKey(SmpSessionContext_t *pSmpCtx,
+                                    uint32_t epoch, SmpTrafficKey_t *pKey);
+
+/* Make a verified key of the epoch after the current one the current key. */
+static void lSmpCommitReceiveKey(SmpSessionContext_t *pSmpCtx,
+                                 const SmpTrafficKey_t *pKey);
+
+/* Check a message to be built and set its job up. */
+static WclError_t lSmpSealInit(SmpSealJob_t *pJob, SmpSessionContext_t *pSmpCtx,
+                               WclSmpMessageType_t messageType,
+                               const WosBuffer_t *pClearMessage);
+
+/* Pack the header of a message and its authentication data. The message id
+ * and the send key are taken at this point, so the messages of a session are
+ * numbered in the order they are prepared. */
+static WclError_t lSmpSealPrepare(SmpSealJob_t *pJob);
+
+/* Encrypt and authenticate a prepared message. */
+static WclError_t lSmpSealEncrypt(SmpSealJob_t *pJob);
+
+/* Encrypt and authenticate the prepared messages of a group together. A
+ * message failing has the result of its request set and its job cleared. */
+static void lSmpSealEncryptMany(SmpSealJob_t *pJobs, size_t count,
+                                WclSmpMessageRequest_t *pRequests);
+
+/* Check the outputs of the encryption of a message. */
+static WclError_t lSmpSealCheckEncrypted(SmpSealJob_t *pJob,
+                                         WosCryptoError_t cryptoResult);
+
+/* Serialize an encrypted message. */
+static WclError_t lSmpSealSerialize(SmpSealJob_t *pJob,
+                                    WosBuffer_t *pSecuredMessage);
+
+/* Free what a job holds and wipe its key. */
+static void lSmpSealFree(SmpSealJob_t *pJob);
+
 /* ========================================================================== */
 /*                                Local Function Definitions */
 /* ========================================================================== */
@@ -190,6 +353,7 @@ static WclError_t lSmpPackHeader(SmpSessionContext_t *pSmpCtx,
     smpHeader.messageType = messageType;
     smpHeader.clientId = pSmpCtx->clientId;
     smpHeader.messageId = pSmpCtx->toBeSentMessageId;
+    smpHeader.epoch = pSmpCtx->sendKey.epoch;
     /* Allocate the output. */
     pEncodedHeader->data = wosMemAlloc(SMP_ENCODED_HEADER_LENGTH);
     if (NULL == pEncodedHeader->data) {
@@ -239,16 +403,23 @@ static WclError_t lSmpSignSeParams(SmpSessionContext_t *pSmpCtx,
     }
 
     /* Concat the encoded SMP header, cipher scheme, ECC-DH public params and
-     * protocol packet for sigining. */
-#if defined(SMP_MQTTS_CLIENT)
-    pMqttSeParams->cipherSchemeId = WCL_SMP_CIPHER_SCHEME_ID0;
-#endif
+     * protocol packet for sigining. Only the client proposes a cipher scheme. */
+    if (SMP_IS_MQTTS_CLIENT(pSmpCtx)) {
+        pMqttSeParams->cipherSchemeId = WCL_SMP_CIPHER_SCHEME_ID0;
+        pMqttSeParams->hasCipherSchemeId = true;
+        pMqttSeParams->hasCompression = pSmpCtx->isCompressionEnabled;
+    } else {
+        pMqttSeParams->hasCompression = pSmpCtx->isCompressionNegotiated;
+    }
     toBeSignedData.length = (pMqttSeParams->pEncodedSmpHeader)->length +
                             (pMqttSeParams->pEccDhPubParams)->length +
                             (pMqttSeParams->pMqttPacket)->length;
-#if defined(SMP_MQTTS_CLIENT)
-    toBeSignedData.length += 1; // cipher-scheme-id
-#endif
+    if (pMqttSeParams->hasCipherSchemeId) {
+        toBeSignedData.length += 1; // cipher-scheme-id
+    }
+    if (pMqttSeParams->hasCompression) {
+        toBeSignedData.length += 1; // compression
+    }
     toBeSignedData.data = wosMemAlloc(toBeSignedData.length);
     if (NULL == toBeSignedData.data) {
         WLOGE("error allocating memory.");
@@ -258,21 +429,26 @@ static WclError_t lSmpSignSeParams(SmpSessionContext_t *pSmpCtx,
     wosMemCopy(toBeSignedData.data, (pMqttSeParams->pEncodedSmpHeader)->data,
                (pMqttSeParams->pEncodedSmpHeader)->length);
     offset = (pMqttSeParams->pEncodedSmpHeader)->length;
-#if defined(SMP_MQTTS_CLIENT)
-    toBeSignedData.data[offset] = pMqttSeParams->cipherSchemeId;
-    offset += 1;
-#endif
+    if (pMqttSeParams->hasCipherSchemeId) {
+        toBeSignedData.data[offset] = pMqttSeParams->cipherSchemeId;
+        offset += 1;
+    }
     wosMemCopy(toBeSignedData.data + offset,
                (pMqttSeParams->pEccDhPubParams)->data,
                (pMqttSeParams->pEccDhPubParams)->length);
     offset += (pMqttSeParams->pEccDhPubParams)->length;
     wosMemCopy(toBeSignedData.data + offset, (pMqttSeParams->pMqttPacket)->data,
                (pMqttSeParams->pMqttPacket)->length);
+    offset += (pMqttSeParams->pMqttPacket)->length;
+    /* Signing the flag keeps it from being stripped or added on the way. */
+    if (pMqttSeParams->hasCompression) {
+        toBeSignedData.data[offset] = 1;
+    }
 
     /* Sign */
     cryptoResult =
-        wosCryptoEccSign(pSmpCtx->pEccOptions, pSmpCtx->pStorageContext,
-                         pSmpCtx->selfPrivKeyStorageId, &toBeSignedData,
+        wosCryptoEccSign(pSmpCtx->pEccOptions, smpGetGlobalStorageContext(),
+                         gSelfPrivKeyStorageId, &toBeSignedData,
                          &(pMqttSeParams->pSignature));
     if (cryptoResult != WOS_CRYPTO_SUCCESS) {
         WLOGE("signing failed %x", cryptoResult);
@@ -314,10 +490,8 @@ lSmpGetDeviceCertificates(SmpSessionContext_t *pSmpCtx,
 
     FUNCTION_ENTRY();
 
-    // TODO FIX and remove const
-    // As of now we are supporting only one level certificate-chain
-    pSmpCtx->selfCertChainSize = 1;
     // TODO Parse larger chain
+    // As of now we are supporting only one level certificate-chain
     pMqttSeParams->ppCerts = wosMemAlloc(sizeof(WosBuffer_t *));
     if (NULL == pMqttSeParams->ppCerts) {
         WLOGE("error allocating memory.");
@@ -325,15 +499,15 @@ lSmpGetDeviceCertificates(SmpSessionContext_t *pSmpCtx,
         goto exit;
     }
 
-    storageResult = wosStorageRead(pSmpCtx->pStorageContext,
-                                   pSmpCtx->selfCertChainStorageId,
+    storageResult = wosStorageRead(smpGetGlobalStorageContext(),
+                                   gSelfCertStorageId,
                                    &(pMqttSeParams->ppCerts[0]));
     if (storageResult != WOS_STORAGE_SUCCESS) {
         WLOGE("error getting buffer with root certificate.");
         smpResult = WCL_ERROR_STORAGE_OPERATION;
         goto exit;
     }
-    pMqttSeParams->numCerts = pSmpCtx->selfCertChainSize;
+    pMqttSeParams->numCerts = 1;
     smpResult = WCL_SUCCESS;
 
 exit:
@@ -367,11 +541,10 @@ static WclError_t lSmpVerifySeParams(SmpSessionContext_t *pSmpCtx,
     if ((!WOS_IS_VALID_BUFFER(pMqttSeParams->pEncodedSmpHeader)) ||
         (!WOS_IS_VALID_BUFFER(pMqttSeParams->pEccDhPubParams)) ||
         (!WOS_IS_VALID_BUFFER(pMqttSeParams->pMqttPacket)) ||
-#if defined(SMP_MQTTS_BROKER)
         /* We get cipher-scheme-id on broker side, as of now we expect only one
            value "0". */
+        (SMP_IS_MQTTS_CLIENT(pSmpCtx) == pMqttSeParams->hasCipherSchemeId) ||
         (WCL_SMP_CIPHER_SCHEME_ID0 != pMqttSeParams->cipherSchemeId) ||
-#endif
         (pMqttSeParams->numCerts < 1) || (NULL == pMqttSeParams->ppCerts)) {
         WLOGE("bad message");
         smpResult = WCL_ERROR_INVALID_MESSAGE;
@@ -387,11 +560,14 @@ static WclError_t lSmpVerifySeParams(SmpSessionContext_t *pSmpCtx,
     /* Concat the encoded SMP header, ECC-DH public params and
      * protocol packet for verifying. */
     signedData.length = (pMqttSeParams->pEncodedSmpHeader)->length +
-#if defined(SMP_MQTTS_BROKER)
-                        sizeof(pMqttSeParams->cipherSchemeId) +
-#endif
                         (pMqttSeParams->pEccDhPubParams)->length +
                         (pMqttSeParams->pMqttPacket)->length;
+    if (pMqttSeParams->hasCipherSchemeId) {
+        signedData.length += sizeof(pMqttSeParams->cipherSchemeId);
+    }
+    if (pMqttSeParams->hasCompression) {
+        signedData.length += 1;
+    }
     signedData.data = wosMemAlloc(signedData.length);
     if (NULL == signedData.data) {
         WLOGE("error allocating memory.");
@@ -401,21 +577,25 @@ static WclError_t lSmpVerifySeParams(SmpSessionContext_t *pSmpCtx,
     wosMemCopy(signedData.data, (pMqttSeParams->pEncodedSmpHeader)->data,
                (pMqttSeParams->pEncodedSmpHeader)->length);
     offset = (pMqttSeParams->pEncodedSmpHeader)->length;
-#if defined(SMP_MQTTS_BROKER)
-    /* WARNING if datatype of cipherSchemeId is changed from uint8_t, this
-     * should be reimplemented. */
-    *(signedData.data + offset) = pMqttSeParams->cipherSchemeId;
-    offset += 1;
-#endif
+    if (pMqttSeParams->hasCipherSchemeId) {
+        /* WARNING if datatype of cipherSchemeId is changed from uint8_t, this
+         * should be reimplemented. */
+        *(signedData.data + offset) = pMqttSeParams->cipherSchemeId;
+        offset += 1;
+    }
     wosMemCopy(signedData.data + offset, (pMqttSeParams->pEccDhPubParams)->data,
                (pMqttSeParams->pEccDhPubParams)->length);
     offset += (pMqttSeParams->pEccDhPubParams)->length;
     wosMemCopy(signedData.data + offset, (pMqttSeParams->pMqttPacket)->data,
                (pMqttSeParams->pMqttPacket)->length);
+    offset += (pMqttSeParams->pMqttPacket)->length;
+    if (pMqttSeParams->hasCompression) {
+        *(signedData.data + offset) = 1;
+    }
 
     /* Verify the message. */
-    storageResult = wosStorageRead(pSmpCtx->pStorageContext,
-                                   pSmpCtx->rootCaStorageId, &pRootCa);
+    storageResult = wosStorageRead(smpGetGlobalStorageContext(),
+                                   gRootCaStorageId, &pRootCa);
     if (storageResult != WOS_STORAGE_SUCCESS) {
         WLOGE("error getting buffer with root certificate.");
         smpResult = WCL_ERROR_STORAGE_OPERATION;
@@ -441,14 +621,14 @@ exit:
 }
 
 static WclError_t lSmpValidateSmpHeader(SmpSessionContext_t *pSmpCtx,
-                                        const WosSmpHeader_t *pSmpHeader)
+                                        const WosMsgSmpView_t *pSmpView)
 {
     WclError_t smpResult = WCL_ERROR;
 
     FUNCTION_ENTRY();
 
     /* Input parameters validation. */
-    if ((NULL == pSmpCtx) || (NULL == pSmpHeader)) {
+    if ((NULL == pSmpCtx) || (NULL == pSmpView)) {
         WLOGE("invalid parameter");
         smpResult = WCL_ERROR_BAD_PARAMS;
         goto exit;
@@ -456,7 +636,7 @@ static WclError_t lSmpValidateSmpHeader(SmpSessionContext_t *pSmpCtx,
 
     /* Check if context is correct. */
     if (WOS_MSG_CONTEXT_SMP_MQTTS !=
-        ((pSmpHeader->commonHeader).messageContext)) {
+        ((pSmpView->commonHeader).messageContext)) {
         WLOGE("bad message context");
         smpResult = WCL_ERROR_INVALID_MESSAGE;
         goto exit;
@@ -464,32 +644,17 @@ static WclError_t lSmpValidateSmpHeader(SmpSessionContext_t *pSmpCtx,
     /* As of now, we dont care the context version. */
     /* Check if message-type is valid for the client or broker side processing.
      */
-    if (!((WCL_SMP_MESSAGE_MQTTS_PUBLISH == pSmpHeader->messageType) ||
-          (WCL_SMP_MESSAGE_MQTTS_PUBACK == pSmpHeader->messageType) ||
-          (WCL_SMP_MESSAGE_MQTTS_PUBREC == pSmpHeader->messageType) ||
-          (WCL_SMP_MESSAGE_MQTTS_PUBREL == pSmpHeader->messageType) ||
-          (WCL_SMP_MESSAGE_MQTTS_PUBCOMP == pSmpHeader->messageType) ||
-#if defined(SMP_MQTTS_CLIENT)
-          (WCL_SMP_MESSAGE_MQTTS_CONNACK == pSmpHeader->messageType) ||
-          (WCL_SMP_MESSAGE_MQTTS_SUBACK == pSmpHeader->messageType) ||
-          (WCL_SMP_MESSAGE_MQTTS_UNSUBACK == pSmpHeader->messageType) ||
-          (WCL_SMP_MESSAGE_MQTTS_PINGRESP == pSmpHeader->messageType))) {
-#else
-          (WCL_SMP_MESSAGE_MQTTS_CONNECT == pSmpHeader->messageType) ||
-          (WCL_SMP_MESSAGE_MQTTS_SUBSCRIBE == pSmpHeader->messageType) ||
-          (WCL_SMP_MESSAGE_MQTTS_UNSUBSCRIBE == pSmpHeader->messageType) ||
-          (WCL_SMP_MESSAGE_MQTTS_PINGREQ == pSmpHeader->messageType) ||
-          (WCL_SMP_MESSAGE_MQTTS_DISCONNECT == pSmpHeader->messageType))) {
-#endif
-        WLOGE("bad message type %x", pSmpHeader->messageType);
+    if (!smpIsReceivedMessageType(pSmpCtx, pSmpView->messageType)) {
+        WLOGE("bad message type %x", pSmpView->messageType);
         smpResult = WCL_ERROR_INVALID_MESSAGE;
         goto exit;
     }
 
-    /* Message-id of current received message must be greater than message-id of
-     * last received message. */
-    if (pSmpHeader->messageId < pSmpCtx->lastReceivedMessageId) {
-        WLOGE("bad message");
+    /* Message-id of current received message must not have been seen, nor be
+     * too far behind the highest one seen. It is only recorded once the
+     * message has been verified, see smpProcessMessage(). */
+    if (!smpReplayCheck(&pSmpCtx->replayWindow, pSmpView->messageId)) {
+        WLOGE("replayed or stale message %u", pSmpView->messageId);
         smpResult = WCL_ERROR_INVALID_MESSAGE;
         goto exit;
     }
@@ -509,8 +674,9 @@ static WclError_t lSmpProcessSeMessage(SmpSessionContext_t *pSmpCtx,
     WclError_t smpResult = WCL_ERROR;
     WosMsgError_t msgResult = WOS_MSG_ERROR;
     WosCryptoError_t cryptoResult = WOS_CRYPTO_ERROR;
-    WosStorageError_t storageResult = WOS_STORAGE_ERROR;
     WosMsgMqttsSeParams_t mqttsSeParams = {NULL, 0, NULL, NULL, NULL, 0, NULL};
+    WosBuffer_t privateKey = {.data = NULL, .length = 0};
+    WosBuffer_t sessionKey = {.data = NULL, .length = 0};
 
     FUNCTION_ENTRY();
 
@@ -521,6 +687,12 @@ static WclError_t lSmpProcessSeMessage(SmpSessionContext_t *pSmpCtx,
         goto exit;
     }
 
+    /* The key pair is gone once a session key has been derived. */
+    smpResult = lSmpGetHandshake(pSmpCtx);
+    if (WCL_SUCCESS != smpResult) {
+        goto exit;
+    }
+
     /* Deserialize the ack-message. */
     msgResult = wosMsgUnpackSmpMqttsSEMessage(pSmpSEAckMessage, &mqttsSeParams);
     if (WOS_MSG_SUCCESS != msgResult) {
@@ -536,34 +708,49 @@ static WclError_t lSmpProcessSeMessage(SmpSessionContext_t *pSmpCtx,
         goto exit;
     }
 
-    /* Generate and store the session key. */
-    cryptoResult = wosCryptoDeriveSymKey(
-        pSmpCtx->pEccOptions, pSmpCtx->pStorageContext,
-        mqttsSeParams.pEccDhPubParams, pSmpCtx->sessionPrivateKeyStorageId,
-        pSmpCtx->sessionSharedKeyStorageId);
+    /* A broker accepts compression if it is enabled on its session too, a
+     * client only takes it if it offered it. */
+    if (SMP_IS_MQTTS_CLIENT(pSmpCtx)) {
+        if (mqttsSeParams.hasCompression && (!pSmpCtx->isCompressionEnabled)) {
+            WLOGE("compression has not been offered");
+            smpResult = WCL_ERROR_INVALID_MESSAGE;
+            goto exit;
+        }
+        pSmpCtx->isCompressionNegotiated = mqttsSeParams.hasCompression;
+    } else {
+        pSmpCtx->isCompressionNegotiated =
+            mqttsSeParams.hasCompression && pSmpCtx->isCompressionEnabled;
+    }
+
+    /* Generate the session key. */
+    privateKey.data = pSmpCtx->pHandshake->privateKey;
+    privateKey.length = pSmpCtx->pHandshake->privateKeyLength;
+    sessionKey.data = pSmpCtx->sessionKey;
+    sessionKey.length = sizeof(pSmpCtx->sessionKey);
+    cryptoResult =
+        wosCryptoDeriveSymKeyBuffer(pSmpCtx->pEccOptions,
+                                    mqttsSeParams.pEccDhPubParams, &privateKey,
+                                    &sessionKey);
     if (WOS_CRYPTO_SUCCESS != cryptoResult) {
         WLOGE("generating session-key failed %x", cryptoResult);
         smpResult = WCL_ERROR_CRYPTO_OPERATION;
         goto exit;
     }
-    pSmpCtx->isSessionKeyEstablished = true;
-    /* We generated the session key, now we can remove EC DH Keys from storage.
-     */
-    storageResult = wosStorageDelete(pSmpCtx->pStorageContext,
-                                     pSmpCtx->sessionPrivateKeyStorageId);
-    if (WOS_STORAGE_SUCCESS != storageResult) {
-        /* We log the error and continue. */
-        WLOGW("removing session private key from storage failed %x",
-              storageResult);
-    }
-#if defined(SMP_MQTTS_CLIENT)
-    storageResult = wosStorageDelete(pSmpCtx->pStorageContext,
-                                     pSmpCtx->sessionPublicKeyStorageId);
-    if (WOS_STORAGE_SUCCESS != storageResult) {
-        /* We log the error and continue. */
-        WLOGW("removing ecc dh pub key from storage failed %x", storageResult);
-    }
-#endif
+    lSmpStartTraffic(pSmpCtx);
+    /* We generated the session key, now we can wipe the EC DH Keys. The broker
+     * still has to send its public key in the CONNACK. */
+    if (SMP_IS_MQTTS_CLIENT(pSmpCtx)) {
+        lSmpFreeHandshake(pSmpCtx);
+        /* A client without ticket just does a full handshake next time. */
+        if ((NULL != mqttsSeParams.pTicket) &&
+            (WCL_SUCCESS != lSmpStoreTicket(pSmpCtx, &mqttsSeParams))) {
+            WLOGW("ignoring the session ticket");
+        }
+    } else {
+        wosMemSet(pSmpCtx->pHandshake->privateKey, 0,
+                  sizeof(pSmpCtx->pHandshake->privateKey));
+        pSmpCtx->pHandshake->privateKeyLength = 0;
+    }
     /* Copy the standard MQTT packet to output. */
     pClearMessage->data = wosMemAlloc((mqttsSeParams.pMqttPacket)->length);
     if (NULL == pClearMessage->data) {
@@ -584,25 +771,32 @@ exit:
 }
 
 static WclError_t lSmpProcessControlMessage(SmpSessionContext_t *pSmpCtx,
-                                            WclSmpMessageType_t messageType,
-                                            const WosBuffer_t *pSecuredMessage,
+                                            WosMsgSmpView_t *pSmpView,
                                             WosBuffer_t *pClearMessage)
 {
     WclError_t smpResult = WCL_ERROR;
-    WosMsgError_t msgResult = WOS_MSG_ERROR;
     WosCryptoError_t cryptoResult = WOS_CRYPTO_ERROR;
-    WosMsgMqttsControlParams_t mqttsControlParams = {NULL, NULL, NULL, NULL};
+    WclSmpMessageType_t messageType = WCL_SMP_MESSAGE_RESERVED;
+    const WosBuffer_t *pEncodedSmpHeader = NULL;
+    WosBuffer_t *pMqttPacket = NULL;
+    WosBuffer_t *pIV = NULL;
+    WosBuffer_t *pAuthTag = NULL;
     WosBuffer_t aad = {.data = NULL, .length = 0};
+    WosString_t pLabel = NULL;
     size_t labelLength = 0;
     bool hasClearMqttPacket = false;
     uint32_t offset = 0;
     WosBuffer_t *pCipherText = NULL;
     WosBuffer_t *pPlainText = NULL;
+    WosBuffer_t trafficKey = {.data = NULL, .length = 0};
+    SmpTrafficKey_t receiveKey;
 
     FUNCTION_ENTRY();
 
+    wosMemSet(&receiveKey, 0, sizeof(receiveKey));
+
     /* Input parameters validation. */
-    if ((NULL == pSmpCtx) || (!WOS_IS_VALID_BUFFER(pSecuredMessage))) {
+    if ((NULL == pSmpCtx) || (NULL == pSmpView)) {
         WLOGE("invalid parameter");
         smpResult = WCL_ERROR_BAD_PARAMS;
         goto exit;
@@ -615,51 +809,45 @@ static WclError_t lSmpProcessControlMessage(SmpSessionContext_t *pSmpCtx,
         goto exit;
     }
 
-    /* Deserialize the mqtts-control-message. */
-    msgResult = wosMsgUnpackSmpMqttsControlMessage(pSecuredMessage,
-                                                   &mqttsControlParams);
-    if (WOS_MSG_SUCCESS != msgResult) {
-        WLOGE("deserializing the mqtts-control-message failed", msgResult);
-        smpResult = WCL_ERROR_SERIALIZATION;
-        goto exit;
-    }
+    /* The header and payload segments point into the received message. */
+    messageType = pSmpView->messageType;
+    pEncodedSmpHeader = &pSmpView->encodedSmpHeader;
+    pMqttPacket = &pSmpView->segments[WOS_MSG_SMP_CONTROL_SEGMENT_MQTT_PACKET];
+    pIV = &pSmpView->segments[WOS_MSG_SMP_CONTROL_SEGMENT_IV];
+    pAuthTag = &pSmpView->segments[WOS_MSG_SMP_CONTROL_SEGMENT_AUTH_TAG];
+
     /* Check if parsed message has all the values to further process. */
-    if ((!WOS_IS_VALID_BUFFER(mqttsControlParams.pEncodedSmpHeader)) ||
-        (!WOS_IS_VALID_BUFFER(mqttsControlParams.pMqttPacket)) ||
-        (!WOS_IS_VALID_BUFFER(mqttsControlParams.pIV)) ||
-        (!WOS_IS_VALID_BUFFER(mqttsControlParams.pAuthTag))) {
+    if ((pSmpView->numSegments <= WOS_MSG_SMP_CONTROL_SEGMENT_AUTH_TAG) ||
+        (!WOS_IS_VALID_BUFFER(pEncodedSmpHeader)) ||
+        (!WOS_IS_VALID_BUFFER(pMqttPacket)) || (!WOS_IS_VALID_BUFFER(pIV)) ||
+        (!WOS_IS_VALID_BUFFER(pAuthTag))) {
         WLOGE("bad message");
         smpResult = WCL_ERROR_INVALID_MESSAGE;
         goto exit;
     }
 
-    /* A PUBLISH message received at client end has authentically encrypted MQTT
-     * payload. Other messages has MQTT payload in clear since they are
-     * only authenticated. Similarly only PUBLISH, SUBSCRIBE and UNSUBSCRIBE
-     * message message received at broker end has authentically encrypted MQTT
-     * payload.*/
-#if defined(SMP_MQTTS_CLIENT)
+    /* A PUBLISH or BATCH message received at either end has authentically
+     * encrypted MQTT payload, as does a SUBACK received at client end and a
+     * SUBSCRIBE or UNSUBSCRIBE received at broker end. Other messages has MQTT
+     * payload in clear since they are only authenticated. */
     if ((WCL_SMP_MESSAGE_MQTTS_PUBLISH == messageType) ||
-        (WCL_SMP_MESSAGE_MQTTS_SUBACK == messageType)) {
-#else
-    if ((WCL_SMP_MESSAGE_MQTTS_PUBLISH == messageType) ||
-        (WCL_SMP_MESSAGE_MQTTS_SUBSCRIBE == messageType) ||
-        (WCL_SMP_MESSAGE_MQTTS_UNSUBSCRIBE == messageType)) {
-#endif
+        (WCL_SMP_MESSAGE_MQTTS_BATCH == messageType) ||
+        (SMP_IS_MQTTS_CLIENT(pSmpCtx) &&
+         (WCL_SMP_MESSAGE_MQTTS_SUBACK == messageType)) ||
+        (!SMP_IS_MQTTS_CLIENT(pSmpCtx) &&
+         ((WCL_SMP_MESSAGE_MQTTS_SUBSCRIBE == messageType) ||
+          (WCL_SMP_MESSAGE_MQTTS_UNSUBSCRIBE == messageType)))) {
         hasClearMqttPacket = false;
     } else {
         hasClearMqttPacket = true;
     }
 
     /* Prepare the authentication data, SMP-header || label (|| MQTT packet). */
-#if defined(SMP_MQTTS_CLIENT)
-    labelLength = wosStringLength(gBrokerToClientMsgLabels[messageType]);
-#else
-    labelLength = wosStringLength(gClientToBrokerMsgLabels[messageType]);
-#endif
-    aad.length = (mqttsControlParams.pEncodedSmpHeader)->length + labelLength;
+    pLabel = SMP_RECEIVE_LABELS(pSmpCtx)[messageType - 1];
+    labelLength = wosStringLength(pLabel);
+    aad.length = pEncodedSmpHeader->length + labelLength;
     if (hasClearMqttPacket) {
-        aad.length += (mqttsControlParams.pMqttPacket)->length;
+        aad.length += pMqttPacket->length;
     }
     aad.data = wosMemAlloc(aad.length);
     if (NULL == aad.data) {
@@ -667,57 +855,68 @@ static WclError_t lSmpProcessControlMessage(SmpSessionContext_t *pSmpCtx,
         smpResult = WCL_ERROR_OUT_OF_MEMORY;
         goto exit;
     }
-    wosMemCopy(aad.data, (mqttsControlParams.pEncodedSmpHeader)->data,
-               (mqttsControlParams.pEncodedSmpHeader)->length);
-    offset = (mqttsControlParams.pEncodedSmpHeader)->length;
-#if defined(SMP_MQTTS_CLIENT)
-    wosMemCopy(aad.data + offset, gBrokerToClientMsgLabels[messageType],
-               labelLength);
-#else
-    wosMemCopy(aad.data + offset, gClientToBrokerMsgLabels[messageType],
-               labelLength);
-#endif
+    wosMemCopy(aad.data, pEncodedSmpHeader->data,
+               pEncodedSmpHeader->length);
+    offset = pEncodedSmpHeader->length;
+    wosMemCopy(aad.data + offset, pLabel, labelLength);
     if (hasClearMqttPacket) {
         offset += labelLength;
-        wosMemCopy(aad.data + offset, (mqttsControlParams.pMqttPacket)->data,
-                   (mqttsControlParams.pMqttPacket)->length);
+        wosMemCopy(aad.data + offset, pMqttPacket->data,
+                   pMqttPacket->length);
     }
 
     /* Only authenticate or authenticate and decrypt. */
     if (hasClearMqttPacket) {
         pCipherText = NULL;
     } else {
-        pCipherText = mqttsControlParams.pMqttPacket;
+        pCipherText = pMqttPacket;
+    }
+    smpResult = lSmpGetReceiveKey(pSmpCtx, pSmpView->epoch, &receiveKey);
+    if (WCL_SUCCESS != smpResult) {
+        goto exit;
     }
-    cryptoResult = wosCryptoAeDecrypt(
-        pSmpCtx->pAeadOptions, pSmpCtx->pStorageContext,
-        pSmpCtx->sessionSharedKeyStorageId, pCipherText, &aad,
-        mqttsControlParams.pIV, mqttsControlParams.pAuthTag, &pPlainText);
+    trafficKey.data = receiveKey.key;
+    trafficKey.length = sizeof(receiveKey.key);
+    cryptoResult = wosCryptoAeDecryptKeyBuffer(
+        pSmpCtx->pAeadOptions, &trafficKey, pCipherText, &aad,
+        pIV, pAuthTag, &pPlainText);
     if (WOS_CRYPTO_SUCCESS != cryptoResult) {
         WLOGE("message authentication failed");
         smpResult = WCL_ERROR_CRYPTO_OPERATION;
         goto exit;
     }
+    /* The sender has moved to the epoch of an authentic message. */
+    lSmpCommitReceiveKey(pSmpCtx, &receiveKey);
     /* Assign the clear MQTT packet to output data. */
     if (hasClearMqttPacket) {
         pClearMessage->data =
-            wosMemAlloc((mqttsControlParams.pMqttPacket)->length);
+            wosMemAlloc(pMqttPacket->length);
         if (NULL == pClearMessage->data) {
             WLOGE("error allocating memory for output data");
             smpResult = WCL_ERROR_OUT_OF_MEMORY;
             goto exit;
         }
-        wosMemCopy(pClearMessage->data, (mqttsControlParams.pMqttPacket)->data,
-                   (mqttsControlParams.pMqttPacket)->length);
-        pClearMessage->length = (mqttsControlParams.pMqttPacket)->length;
+        wosMemCopy(pClearMessage->data, pMqttPacket->data,
+                   pMqttPacket->length);
+        pClearMessage->length = pMqttPacket->length;
     } else {
         if (NULL == pPlainText) {
             WLOGE("message decryption failed");
             smpResult = WCL_ERROR_CRYPTO_OPERATION;
             goto exit;
         }
-        pClearMessage->data = pPlainText->data;
-        pClearMessage->length = pPlainText->length;
+        if (pSmpCtx->isCompressionNegotiated) {
+            /* Packed before the encryption, see smpSecureMessage(). */
+            smpResult = smpCompressUnpack(pPlainText, pClearMessage);
+            WOS_FREE_DATA(pPlainText);
+            if (WCL_SUCCESS != smpResult) {
+                wosMemFree(pPlainText);
+                goto exit;
+            }
+        } else {
+            pClearMessage->data = pPlainText->data;
+            pClearMessage->length = pPlainText->length;
+        }
     }
     if (pPlainText != NULL) {
         /* Just free the buffer pointer not data. */
@@ -727,255 +926,687 @@ static WclError_t lSmpProcessControlMessage(SmpSessionContext_t *pSmpCtx,
     smpResult = WCL_SUCCESS;
 
 exit:
-    wosMsgFreeSmpMqttsControlMessage(&mqttsControlParams);
     if (NULL != aad.data) {
         wosMemFree(aad.data);
     }
+    wosMemSet(&receiveKey, 0, sizeof(receiveKey));
     FUNCTION_EXIT_RETURN(smpResult);
     return smpResult;
 }
 
-/* ========================================================================== */
-/*                                Implementation                              */
-/* ========================================================================== */
+static void lSmpFreeHandshake(SmpSessionContext_t *pSmpCtx)
+{
+    if (NULL != pSmpCtx->pHandshake) {
+        wosMemSet(pSmpCtx->pHandshake, 0, sizeof(SmpHandshakeContext_t));
+        wosMemFree(pSmpCtx->pHandshake);
+        pSmpCtx->pHandshake = NULL;
+    }
+}
 
-/* Generate the crypto assets. */
-WclError_t smpInitialiseSessionParams(SmpSessionContext_t **ppSmpCtx)
+static WclError_t lSmpGetHandshake(SmpSessionContext_t *pSmpCtx)
 {
     WclError_t smpResult = WCL_ERROR;
-    WosStorageError_t storageResult = WOS_STORAGE_ERROR;
     WosCryptoError_t cryptoResult = WOS_CRYPTO_ERROR;
-    SmpSessionContext_t *pSmpCtx = NULL;
+    WosBuffer_t privateKey = {.data = NULL, .length = 0};
+    WosBuffer_t publicKey = {.data = NULL, .length = 0};
 
     FUNCTION_ENTRY();
 
-    /* Input parameters validation. */
-    if (NULL == ppSmpCtx) {
-        WLOGE("bad params");
-        smpResult = WCL_ERROR_BAD_PARAMS;
-        goto exitBadParam;
+    if (pSmpCtx->isPreSessionSecretsGenerated) {
+        if (NULL == pSmpCtx->pHandshake) {
+            WLOGE("session key exchange is over");
+            smpResult = WCL_ERROR_BAD_SESSION;
+        } else {
+            smpResult = WCL_SUCCESS;
+        }
+        goto exit;
     }
 
-    /* Allocate context. */
-    pSmpCtx = wosMemAlloc(sizeof(SmpSessionContext_t));
-    if (NULL == pSmpCtx) {
+    /* Generate ECC dh params only when a full handshake needs them, a resumed
+     * session never does. As of now we support only one curve as defined by
+     * gEccDHOptions. */
+    pSmpCtx->pHandshake = wosMemAlloc(sizeof(SmpHandshakeContext_t));
+    if (NULL == pSmpCtx->pHandshake) {
         WLOGE("error allocating memory");
         smpResult = WCL_ERROR_OUT_OF_MEMORY;
         goto exit;
     }
-    WLOGI("context %x", pSmpCtx);
-    wosMemSet(pSmpCtx, 0, sizeof(SmpSessionContext_t));
+    wosMemSet(pSmpCtx->pHandshake, 0, sizeof(SmpHandshakeContext_t));
+    privateKey.data = pSmpCtx->pHandshake->privateKey;
+    privateKey.length = sizeof(pSmpCtx->pHandshake->privateKey);
+    publicKey.data = pSmpCtx->pHandshake->publicKey;
+    publicKey.length = sizeof(pSmpCtx->pHandshake->publicKey);
+    cryptoResult = wosCryptoEccGenerateKeyBuffer(pSmpCtx->pEccOptions,
+                                                 &privateKey, &publicKey);
+    if (WOS_CRYPTO_SUCCESS != cryptoResult) {
+        WLOGE("session keys generation failed %x", cryptoResult);
+        smpResult = WCL_ERROR_CRYPTO_OPERATION;
+        lSmpFreeHandshake(pSmpCtx);
+        goto exit;
+    }
+    pSmpCtx->pHandshake->privateKeyLength = privateKey.length;
+    pSmpCtx->pHandshake->publicKeyLength = publicKey.length;
 
-    /* Initialize storage. */
-#if defined(WOS_STORAGE_IMPL_REDIS)
-    /* Initialize with REDIS default hostname/port. Check config. */
-    storageResult = wosStorageInitialize(&(pSmpCtx->pStorageContext), NULL);
-#elif defined(WOS_STORAGE_IMPL_STDC)
-    storageResult = wosStorageInitialize(NULL, NULL);
-#else
-#error "Specify how storage need to be initialized."
-#endif
-    if (WOS_STORAGE_SUCCESS != storageResult) {
-        WLOGE("storage-initialization failed %x", storageResult);
-        smpResult = WCL_ERROR_STORAGE_OPERATION;
+    pSmpCtx->isPreSessionSecretsGenerated = true;
+    smpResult = WCL_SUCCESS;
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+static WclError_t lSmpDeriveKey(const WosBuffer_t *pSalt,
+                                const uint8_t *pSecret, WosString_t info,
+                                uint8_t *pKey)
+{
+    WclError_t smpResult = WCL_ERROR;
+    WosCryptoError_t cryptoResult = WOS_CRYPTO_ERROR;
+    WosBuffer_t secret = {.data = (uint8_t *)pSecret,
+                          .length = WOS_CRYPTO_HASH_SHA256_LENGTH};
+    WosBuffer_t infoBuffer = {.data = (uint8_t *)info,
+                              .length = wosStringLength(info)};
+    WosBuffer_t key = {.data = pKey, .length = WOS_CRYPTO_AE_AES256_KEY_LENGTH};
+
+    FUNCTION_ENTRY();
+
+    cryptoResult =
+        wosCryptoHkdf((WosBuffer_t *)pSalt, &secret, &infoBuffer, &key);
+    if (WOS_CRYPTO_SUCCESS != cryptoResult) {
+        WLOGE("key derivation failed %x", cryptoResult);
+        smpResult = WCL_ERROR_CRYPTO_OPERATION;
         goto exit;
     }
+    smpResult = WCL_SUCCESS;
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+static WclError_t lSmpIssueTicket(SmpSessionContext_t *pSmpCtx,
+                                  uint8_t *pTicket)
+{
+    WclError_t smpResult = WCL_ERROR;
+    uint8_t secret[SMP_TICKET_SECRET_LENGTH];
 
-    /* Initialize global configurations and static config validation. */
-    smpResult = smpConfigGlobalCreds(pSmpCtx);
+    FUNCTION_ENTRY();
+
+    /* The resumption secret is derived from, but independent of, the session
+     * key, which keeps protecting this session. */
+    smpResult = lSmpDeriveKey(NULL, pSmpCtx->sessionKey,
+                              SMP_RESUMPTION_SECRET_INFO, secret);
     if (WCL_SUCCESS != smpResult) {
-        WLOGE("SMP initialization failed %x", smpResult);
         goto exit;
     }
+    smpResult = smpTicketSeal(secret, pTicket);
 
-    /* Generate ECC dh params. As of now we support only one curve as defined by
-     * gEccDHOptions. */
-    pSmpCtx->pEccOptions = &gEccDHOptions;
-    smpResult = smpUtilsGen32CharRandomId(pSmpCtx->sessionPrivateKeyStorageId);
-    if (WCL_SUCCESS != smpResult) {
-        WLOGE("generating random storage id for session private key failed");
-        smpResult = WCL_ERROR;
+exit:
+    wosMemSet(secret, 0, sizeof(secret));
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+static WclError_t lSmpStoreTicket(SmpSessionContext_t *pSmpCtx,
+                                  const WosMsgMqttsSeParams_t *pMqttSeParams)
+{
+    WclError_t smpResult = WCL_ERROR;
+    SmpResumption_t *pResumption = NULL;
+
+    FUNCTION_ENTRY();
+
+    if ((!WOS_IS_VALID_BUFFER(pMqttSeParams->pTicket)) ||
+        (SMP_TICKET_LENGTH != pMqttSeParams->pTicket->length) ||
+        (0 == pMqttSeParams->ticketLifetime)) {
+        WLOGE("bad ticket");
+        smpResult = WCL_ERROR_INVALID_MESSAGE;
         goto exit;
     }
-    smpResult = smpUtilsGen32CharRandomId(pSmpCtx->sessionPublicKeyStorageId);
-    if (WCL_SUCCESS != smpResult) {
-        WLOGE("generating random storage id for session public key failed");
-        smpResult = WCL_ERROR;
+
+    pResumption = wosMemAlloc(sizeof(SmpResumption_t));
+    if (NULL == pResumption) {
+        WLOGE("error allocating memory");
+        smpResult = WCL_ERROR_OUT_OF_MEMORY;
         goto exit;
     }
-    cryptoResult =
-        wosCryptoEccGenerateKey(pSmpCtx->pEccOptions, pSmpCtx->pStorageContext,
-                                pSmpCtx->sessionPrivateKeyStorageId,
-                                pSmpCtx->sessionPublicKeyStorageId);
-    if (WOS_CRYPTO_SUCCESS != cryptoResult) {
-        WLOGE("session keys generation failed %x", cryptoResult);
-        smpResult = WCL_ERROR_CRYPTO_OPERATION;
+    wosMemSet(pResumption, 0, sizeof(SmpResumption_t));
+    smpResult = lSmpDeriveKey(NULL, pSmpCtx->sessionKey,
+                              SMP_RESUMPTION_SECRET_INFO, pResumption->secret);
+    if (WCL_SUCCESS != smpResult) {
         goto exit;
     }
+    wosMemCopy(pResumption->ticket, pMqttSeParams->pTicket->data,
+               SMP_TICKET_LENGTH);
+    pResumption->ticketExpiry =
+        wosTimeGetSeconds() + pMqttSeParams->ticketLifetime;
 
-    pSmpCtx->isPreSessionSecretsGenerated = true;
+    lSmpFreeResumption(pSmpCtx);
+    pSmpCtx->pResumption = pResumption;
+    pResumption = NULL;
 
-    pSmpCtx->pAeadOptions = &gAeadOptions;
-    smpResult = smpUtilsGen32CharRandomId(pSmpCtx->sessionSharedKeyStorageId);
-    if (WCL_SUCCESS != smpResult) {
-        WLOGE("generating random session-key storage Id failed");
-        smpResult = WCL_ERROR;
+exit:
+    if (NULL != pResumption) {
+        wosMemSet(pResumption, 0, sizeof(SmpResumption_t));
+        wosMemFree(pResumption);
+    }
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+static WclError_t lSmpPrepareResumptionAad(const WosBuffer_t *pEncodedHeader,
+                                           WosString_t label,
+                                           const WosBuffer_t *pNonce,
+                                           const WosBuffer_t *pTicket,
+                                           const WosBuffer_t *pMqttPacket,
+                                           WosBuffer_t *pAad)
+{
+    WclError_t smpResult = WCL_ERROR;
+    size_t labelLength = wosStringLength(label);
+    size_t offset = 0;
+
+    FUNCTION_ENTRY();
+
+    pAad->length = pEncodedHeader->length + labelLength + pNonce->length +
+                   pMqttPacket->length;
+    if (NULL != pTicket) {
+        pAad->length += pTicket->length;
+    }
+    pAad->data = wosMemAlloc(pAad->length);
+    if (NULL == pAad->data) {
+        WLOGE("error allocating memory for aad");
+        pAad->length = 0;
+        smpResult = WCL_ERROR_OUT_OF_MEMORY;
         goto exit;
     }
+    wosMemCopy(pAad->data, pEncodedHeader->data, pEncodedHeader->length);
+    offset = pEncodedHeader->length;
+    wosMemCopy(pAad->data + offset, label, labelLength);
+    offset += labelLength;
+    wosMemCopy(pAad->data + offset, pNonce->data, pNonce->length);
+    offset += pNonce->length;
+    if (NULL != pTicket) {
+        wosMemCopy(pAad->data + offset, pTicket->data, pTicket->length);
+        offset += pTicket->length;
+    }
+    wosMemCopy(pAad->data + offset, pMqttPacket->data, pMqttPacket->length);
 
-    *ppSmpCtx = pSmpCtx;
     smpResult = WCL_SUCCESS;
 
 exit:
-    if (WCL_SUCCESS != smpResult) {
-        if (NULL != pSmpCtx->pStorageContext) {
-            storageResult = wosStorageTerminate(pSmpCtx->pStorageContext);
-        }
-        if (NULL != pSmpCtx) {
-            wosMemFree(pSmpCtx);
-        }
-    }
-exitBadParam:
     FUNCTION_EXIT_RETURN(smpResult);
     return smpResult;
 }
 
-/* Export the session establishment message containing public keys for
- * key-exchange. */
-WclError_t
-smpExportSessionEstablishmentParams(SmpSessionContext_t *pSmpCtx,
-                                    const WosBuffer_t *pStdProtocolSEParams,
-                                    WosBuffer_t *pSmpSEMessage)
+static bool lSmpIsResumedSeMessage(const SmpSessionContext_t *pSmpCtx,
+                                   const WosMsgSmpView_t *pSmpView)
+{
+    /* A client resumes when it still holds a ticket at the CONNACK, it only
+     * gets a new one from a full CONNACK. A resumed CONNECT has byte strings
+     * right after the header where a full one has the cipher-scheme-id. */
+    if (SMP_IS_MQTTS_CLIENT(pSmpCtx)) {
+        return (NULL != pSmpCtx->pResumption);
+    }
+    return (0 < pSmpView->numSegments);
+}
+
+static WclError_t
+lSmpExportResumedSeMessage(SmpSessionContext_t *pSmpCtx,
+                           const WosBuffer_t *pStdProtocolSEParams,
+                           WosBuffer_t *pSmpSEMessage)
 {
     WclError_t smpResult = WCL_ERROR;
-    WosCryptoError_t cryptoResult = WOS_CRYPTO_ERROR;
     WosMsgError_t msgResult = WOS_MSG_ERROR;
+    WosCryptoError_t cryptoResult = WOS_CRYPTO_ERROR;
+    SmpResumption_t *pResumption = pSmpCtx->pResumption;
+    bool isClient = SMP_IS_MQTTS_CLIENT(pSmpCtx);
     WosBuffer_t encodedHeader = {.data = NULL, .length = 0};
-    WosMsgMqttsSeParams_t mqttsSeParams = {NULL, 0, NULL, NULL, NULL, 0, NULL};
-    WosSmpHeader_t smpHeader = {{0, 0}, 0, NULL, 0};
-    uint32_t seParamsTotalBytesLength = 0;
-    uint8_t indexCert = 0;
+    WosBuffer_t nonce = {.data = pResumption->nonce,
+                         .length = sizeof(pResumption->nonce)};
+    WosBuffer_t ticket = {.data = pResumption->ticket,
+                          .length = sizeof(pResumption->ticket)};
+    uint8_t earlyDataAccepted = SMP_EARLY_DATA_ACCEPTED;
+    WosBuffer_t earlyDataMarker = {.data = &earlyDataAccepted,
+                                   .length = sizeof(earlyDataAccepted)};
+    uint8_t binderKey[WOS_CRYPTO_AE_AES256_KEY_LENGTH];
+    WosBuffer_t key = {.data = NULL, .length = WOS_CRYPTO_AE_AES256_KEY_LENGTH};
+    WosBuffer_t aad = {.data = NULL, .length = 0};
+    WosBuffer_t *pIv = NULL;
+    WosBuffer_t *pCipherText = NULL;
+    WosBuffer_t *pAuthTag = NULL;
+    WosBuffer_t segments[WOS_MSG_SMP_VIEW_MAX_SEGMENTS];
+    uint8_t numSegments = 0;
+    uint8_t i = 0;
 
     FUNCTION_ENTRY();
 
-    /* Input parameters validation. */
-    if ((NULL == pSmpCtx) || (!WOS_IS_VALID_BUFFER(pStdProtocolSEParams)) ||
-        (NULL == pSmpSEMessage)) {
-        WLOGE("invalid parameter");
-        smpResult = WCL_ERROR_BAD_PARAMS;
+    /* A client resumes instead of a full handshake, a broker answers a resumed
+     * CONNECT which already established the session key. */
+    if (isClient == pSmpCtx->isSessionKeyEstablished) {
+        WLOGE("no session to resume");
+        smpResult = WCL_ERROR_BAD_SESSION;
         goto exit;
     }
-    WLOGI("context %x", pSmpCtx);
 
     /* Pack SMP header. */
-    smpResult = lSmpPackHeader(pSmpCtx,
-#if defined(SMP_MQTTS_CLIENT)
-                               WCL_SMP_MESSAGE_MQTTS_CONNECT,
-#else
-                               WCL_SMP_MESSAGE_MQTTS_CONNACK,
-#endif
+    smpResult = lSmpPackHeader(pSmpCtx, SMP_SE_SEND_MESSAGE_TYPE(pSmpCtx),
                                &encodedHeader);
-
     if (WCL_SUCCESS != smpResult) {
         WLOGE("error packing header");
         goto exit;
     }
 
-    /* Read the ECC-DH params. */
-    cryptoResult = wosCryptoEccReadPubKey(
-        pSmpCtx->pEccOptions, pSmpCtx->pStorageContext,
-        pSmpCtx->sessionPublicKeyStorageId, &(mqttsSeParams.pEccDhPubParams));
-    if (WOS_CRYPTO_SUCCESS != cryptoResult ||
-        (!WOS_IS_VALID_BUFFER(mqttsSeParams.pEccDhPubParams))) {
-        WLOGE("reading ecc-dh-public-params header failed %x", cryptoResult);
-        smpResult = WCL_ERROR_CRYPTO_OPERATION;
+    /* The client binds its CONNECT to the ticket secret, the broker answers
+     * under the new session key. The broker nonce has been drawn with it. */
+    if (isClient) {
+        cryptoResult = wosCryptoGetRandomBytes(&nonce);
+        if (WOS_CRYPTO_SUCCESS != cryptoResult) {
+            WLOGE("nonce generation failed %x", cryptoResult);
+            smpResult = WCL_ERROR_CRYPTO_OPERATION;
+            goto exit;
+        }
+        /* Lets the broker bound how long it remembers the nonce. */
+        smpTicketStampNonce(pResumption->nonce);
+        smpResult = lSmpDeriveKey(&nonce, pResumption->secret,
+                                  SMP_RESUMPTION_BINDER_INFO, binderKey);
+        if (WCL_SUCCESS != smpResult) {
+            goto exit;
+        }
+        key.data = binderKey;
+        smpResult = lSmpPrepareResumptionAad(
+            &encodedHeader, SMP_CLIENT_RESUME_LABEL, &nonce, &ticket,
+            pStdProtocolSEParams, &aad);
+    } else {
+        key.data = pSmpCtx->sessionKey;
+        smpResult = lSmpPrepareResumptionAad(
+            &encodedHeader,
+            pResumption->isEarlyDataAccepted ? SMP_BROKER_RESUME_EARLY_LABEL
+                                             : SMP_BROKER_RESUME_LABEL,
+            &nonce, NULL, pStdProtocolSEParams, &aad);
+    }
+    if (WCL_SUCCESS != smpResult) {
         goto exit;
     }
 
-    /* Concatenate the encoded SMP header, cipher scheme, ECC-DH public params
-     * and protocol packet for sigining. */
-    mqttsSeParams.pEncodedSmpHeader = &encodedHeader;
-    mqttsSeParams.pMqttPacket = pStdProtocolSEParams;
-    smpResult =
-        lSmpSignSeParams(pSmpCtx, &mqttsSeParams, &seParamsTotalBytesLength);
-    if (WCL_SUCCESS != smpResult) {
-        WLOGE("siginging the se-params failed");
+    /* The MQTT packet is only authenticated, it is sent in clear like in a
+     * full session establishment. Early data is encrypted under the same
+     * key, a tampered CONNECT loses both. */
+    cryptoResult = wosCryptoAeEncryptKeyBuffer(
+        pSmpCtx->pAeadOptions, &key, isClient ? pResumption->pEarlyData : NULL,
+        &aad, &pIv, &pCipherText, &pAuthTag);
+    if ((WOS_CRYPTO_SUCCESS != cryptoResult) || (!WOS_IS_VALID_BUFFER(pIv)) ||
+        (!WOS_IS_VALID_BUFFER(pAuthTag))) {
+        WLOGE("authentication failed %x", cryptoResult);
+        smpResult = WCL_ERROR_CRYPTO_OPERATION;
         goto exit;
     }
-    WLOGD("SE-params total byte length %x", seParamsTotalBytesLength);
 
-    /* Finally serialize the SMP Session Establishment Packet. */
-    /* Allocate the memory for serialized buffer. */
-    pSmpSEMessage->data = wosMemAlloc(seParamsTotalBytesLength);
+    /* Serialize header, nonce, MQTT packet, IV, tag, and the ticket and
+     * early data or the early data marker. */
+    segments[WOS_MSG_SMP_RESUME_SEGMENT_NONCE] = nonce;
+    segments[WOS_MSG_SMP_RESUME_SEGMENT_MQTT_PACKET] = *pStdProtocolSEParams;
+    segments[WOS_MSG_SMP_RESUME_SEGMENT_IV] = *pIv;
+    segments[WOS_MSG_SMP_RESUME_SEGMENT_AUTH_TAG] = *pAuthTag;
+    numSegments = WOS_MSG_SMP_RESUME_SEGMENT_AUTH_TAG + 1;
+    if (isClient) {
+        segments[WOS_MSG_SMP_RESUME_SEGMENT_TICKET] = ticket;
+        numSegments = WOS_MSG_SMP_RESUME_SEGMENT_TICKET + 1;
+        if (WOS_IS_VALID_BUFFER(pCipherText)) {
+            segments[WOS_MSG_SMP_RESUME_SEGMENT_EARLY_DATA] = *pCipherText;
+            numSegments = WOS_MSG_SMP_RESUME_SEGMENT_EARLY_DATA + 1;
+        }
+    } else if (pResumption->isEarlyDataAccepted) {
+        segments[WOS_MSG_SMP_RESUME_SEGMENT_EARLY_DATA_ACCEPTED] =
+            earlyDataMarker;
+        numSegments = WOS_MSG_SMP_RESUME_SEGMENT_EARLY_DATA_ACCEPTED + 1;
+    }
+    pSmpSEMessage->length =
+        SMP_MQTTS_SE_MSG_SERIALIZER_SIZE_OVERHEAD + encodedHeader.length;
+    for (i = 0; i < numSegments; i++) {
+        pSmpSEMessage->length += segments[i].length;
+    }
+    pSmpSEMessage->data = wosMemAlloc(pSmpSEMessage->length);
     if (NULL == pSmpSEMessage->data) {
         WLOGE("error allocating memory");
+        pSmpSEMessage->length = 0;
         smpResult = WCL_ERROR_OUT_OF_MEMORY;
         goto exit;
     }
-    pSmpSEMessage->length = seParamsTotalBytesLength;
-    /* Serialize the SE-Params. */
-    msgResult = wosMsgPackSmpMqttsSEMessage(&mqttsSeParams, pSmpSEMessage);
+    msgResult = wosMsgPackSmpMessage(&encodedHeader, segments, numSegments,
+                                     pSmpSEMessage);
     if (WOS_MSG_SUCCESS != msgResult) {
         WLOGE("serializing the se-message failed %x", msgResult);
         smpResult = WCL_ERROR_SERIALIZATION;
         goto exit;
     }
 
+    /* The broker is done with the resumption, early data not picked up by now
+     * is dropped. The client still needs its nonce for the CONNACK and keeps
+     * the ticket for later reconnects, the early data is gone. */
+    if (!isClient) {
+        lSmpFreeResumption(pSmpCtx);
+    } else {
+        lSmpFreeEarlyData(pResumption);
+    }
+
     /* Increment the message counter. */
     pSmpCtx->toBeSentMessageId++;
     smpResult = WCL_SUCCESS;
 
 exit:
+    wosMemSet(binderKey, 0, sizeof(binderKey));
     WOS_FREE_DATA(&encodedHeader);
-    WOS_FREE_BUF_AND_DATA(mqttsSeParams.pEccDhPubParams);
-    for (indexCert = 0; indexCert < mqttsSeParams.numCerts; indexCert++) {
-        WOS_FREE_BUF_AND_DATA(mqttsSeParams.ppCerts[indexCert]);
+    WOS_FREE_DATA(&aad);
+    WOS_FREE_BUF_AND_DATA(pIv);
+    WOS_FREE_BUF_AND_DATA(pAuthTag);
+    WOS_FREE_BUF_AND_DATA(pCipherText);
+    if (WCL_SUCCESS != smpResult) {
+        WOS_FREE_DATA(pSmpSEMessage);
     }
-    if (mqttsSeParams.ppCerts != NULL) {
-        wosMemFree(mqttsSeParams.ppCerts);
-    }
-    WOS_FREE_BUF_AND_DATA(mqttsSeParams.pSignature);
     FUNCTION_EXIT_RETURN(smpResult);
     return smpResult;
 }
 
-/* Secure(encrypt/sign) an initiator's payload to be sent. */
-WclError_t smpSecureMessage(SmpSessionContext_t *pSmpCtx,
-                            WclSmpMessageType_t messageType,
-                            const WosBuffer_t *pClearMessage,
-                            WosBuffer_t *pSecuredMessage)
+static WclError_t lSmpProcessResumedSeMessage(SmpSessionContext_t *pSmpCtx,
+                                              WosMsgSmpView_t *pSmpView,
+                                              WosBuffer_t *pClearMessage)
 {
     WclError_t smpResult = WCL_ERROR;
-    WosMsgError_t msgResult = WOS_MSG_ERROR;
     WosCryptoError_t cryptoResult = WOS_CRYPTO_ERROR;
-    WosBuffer_t encodedHeader = {.data = NULL, .length = 0};
-    WosMsgMqttsControlParams_t mqttsControlParams = {NULL, NULL, NULL, NULL};
-    bool encryptMqttPacket = false;
-    WosBuffer_t aad = {NULL, 0};
-    size_t labelLength = 0;
-    size_t offset = 0;
-    WosBuffer_t *pCipherText = NULL;
+    bool isClient = SMP_IS_MQTTS_CLIENT(pSmpCtx);
+    WosBuffer_t *pNonce = &pSmpView->segments[WOS_MSG_SMP_RESUME_SEGMENT_NONCE];
+    WosBuffer_t *pMqttPacket =
+        &pSmpView->segments[WOS_MSG_SMP_RESUME_SEGMENT_MQTT_PACKET];
+    WosBuffer_t *pIV = &pSmpView->segments[WOS_MSG_SMP_RESUME_SEGMENT_IV];
+    WosBuffer_t *pAuthTag =
+        &pSmpView->segments[WOS_MSG_SMP_RESUME_SEGMENT_AUTH_TAG];
+    WosBuffer_t *pTicket = &pSmpView->segments[WOS_MSG_SMP_RESUME_SEGMENT_TICKET];
+    WosBuffer_t *pEarlyData = NULL;
+    uint8_t numSegments = WOS_MSG_SMP_RESUME_SEGMENT_AUTH_TAG + 1;
+    bool isEarlyDataAccepted = false;
+    WosString_t label = NULL;
+    SmpResumption_t *pResumption = NULL;
+    uint8_t binderKey[WOS_CRYPTO_AE_AES256_KEY_LENGTH];
+    WosBuffer_t key = {.data = NULL, .length = WOS_CRYPTO_AE_AES256_KEY_LENGTH};
+    uint8_t saltData[2 * SMP_RESUMPTION_NONCE_LENGTH];
+    WosBuffer_t salt = {.data = saltData, .length = sizeof(saltData)};
+    WosBuffer_t aad = {.data = NULL, .length = 0};
     WosBuffer_t *pPlainText = NULL;
-    WosBuffer_t *pIv = NULL;
-    WosBuffer_t *pAuthTag = NULL;
-    size_t seializedBufSize = 0;
 
     FUNCTION_ENTRY();
 
+    /* Check if parsed message has all the values to further process. */
+    if (!isClient) {
+        numSegments = WOS_MSG_SMP_RESUME_SEGMENT_TICKET + 1;
+    }
+    if ((pSmpView->numSegments < numSegments) ||
+        (SMP_RESUMPTION_NONCE_LENGTH != pNonce->length) ||
+        (!WOS_IS_VALID_BUFFER(pMqttPacket)) || (!WOS_IS_VALID_BUFFER(pIV)) ||
+        (!WOS_IS_VALID_BUFFER(pAuthTag))) {
+        WLOGE("bad message");
+        smpResult = WCL_ERROR_INVALID_MESSAGE;
+        goto exit;
+    }
+    if (pSmpCtx->isSessionKeyEstablished || pSmpCtx->isPreSessionSecretsGenerated) {
+        WLOGE("session establishment is over");
+        smpResult = WCL_ERROR_BAD_SESSION;
+        goto exit;
+    }
+
+    if (isClient) {
+        /* Session key from both nonces, the CONNACK is authenticated with it.
+         */
+        pResumption = pSmpCtx->pResumption;
+        wosMemCopy(saltData, pResumption->nonce, SMP_RESUMPTION_NONCE_LENGTH);
+        wosMemCopy(saltData + SMP_RESUMPTION_NONCE_LENGTH, pNonce->data,
+                   SMP_RESUMPTION_NONCE_LENGTH);
+        smpResult = lSmpDeriveKey(&salt, pResumption->secret,
+                                  SMP_RESUMED_SESSION_KEY_INFO,
+                                  pSmpCtx->sessionKey);
+        if (WCL_SUCCESS != smpResult) {
+            goto exit;
+        }
+        key.data = pSmpCtx->sessionKey;
+        /* The marker is authenticated through the label. */
+        isEarlyDataAccepted =
+            (pSmpView->numSegments >
+             WOS_MSG_SMP_RESUME_SEGMENT_EARLY_DATA_ACCEPTED) &&
+            (1 == pTicket->length) &&
+            (SMP_EARLY_DATA_ACCEPTED == pTicket->data[0]);
+        label = isEarlyDataAccepted ? SMP_BROKER_RESUME_EARLY_LABEL
+                                    : SMP_BROKER_RESUME_LABEL;
+        smpResult = lSmpPrepareResumptionAad(&pSmpView->encodedSmpHeader,
+                                             label, pNonce, NULL, pMqttPacket,
+                                             &aad);
+    } else {
+        /* Get the secret back from the ticket, the CONNECT is authenticated
+         * with a key bound to it and to the client nonce. */
+        pResumption = wosMemAlloc(sizeof(SmpResumption_t));
+        if (NULL == pResumption) {
+            WLOGE("error allocating memory");
+            smpResult = WCL_ERROR_OUT_OF_MEMORY;
+            goto exit;
+        }
+        wosMemSet(pResumption, 0, sizeof(SmpResumption_t));
+        pSmpCtx->pResumption = pResumption;
+        smpResult = smpTicketOpen(pTicket, pResumption->secret,
+                                  &pResumption->ticketExpiry);
+        if (WCL_SUCCESS != smpResult) {
+            WLOGE("rejecting the ticket");
+            goto exit;
+        }
+        smpResult = lSmpDeriveKey(pNonce, pResumption->secret,
+                                  SMP_RESUMPTION_BINDER_INFO, binderKey);
+        if (WCL_SUCCESS != smpResult) {
+            goto exit;
+        }
+        key.data = binderKey;
+        smpResult = lSmpPrepareResumptionAad(&pSmpView->encodedSmpHeader,
+                                             SMP_CLIENT_RESUME_LABEL, pNonce,
+                                             pTicket, pMqttPacket, &aad);
+        if (pSmpView->numSegments > WOS_MSG_SMP_RESUME_SEGMENT_EARLY_DATA) {
+            pEarlyData =
+                &pSmpView->segments[WOS_MSG_SMP_RESUME_SEGMENT_EARLY_DATA];
+        }
+    }
+    if (WCL_SUCCESS != smpResult) {
+        goto exit;
+    }
+
+    cryptoResult =
+        wosCryptoAeDecryptKeyBuffer(pSmpCtx->pAeadOptions, &key, pEarlyData,
+                                    &aad, pIV, pAuthTag, &pPlainText);
+    if (WOS_CRYPTO_SUCCESS != cryptoResult) {
+        WLOGE("message authentication failed");
+        smpResult = WCL_ERROR_CRYPTO_OPERATION;
+        goto exit;
+    }
+
+    /* Early data is only accepted once per CONNECT, a replay still resumes
+     * the session but without its early data. */
+    if (isClient) {
+        pResumption->isEarlyDataAccepted = isEarlyDataAccepted;
+    } else if (WOS_IS_VALID_BUFFER(pPlainText) &&
+               (WCL_SUCCESS == smpTicketCheckEarlyData(pNonce->data))) {
+        pResumption->pEarlyData = pPlainText;
+        pResumption->isEarlyDataAccepted = true;
+        pPlainText = NULL;
+    }
+
+    /* The broker draws its nonce, sent in the CONNACK, and derives the session
+     * key from both. */
+    if (!isClient) {
+        WosBuffer_t brokerNonce = {.data = pResumption->nonce,
+                                   .length = sizeof(pResumption->nonce)};
+        cryptoResult = wosCryptoGetRandomBytes(&brokerNonce);
+        if (WOS_CRYPTO_SUCCESS != cryptoResult) {
+            WLOGE("nonce generation failed %x", cryptoResult);
+            smpResult = WCL_ERROR_CRYPTO_OPERATION;
+            goto exit;
+        }
+        wosMemCopy(saltData, pNonce->data, SMP_RESUMPTION_NONCE_LENGTH);
+        wosMemCopy(saltData + SMP_RESUMPTION_NONCE_LENGTH, pResumption->nonce,
+                   SMP_RESUMPTION_NONCE_LENGTH);
+        smpResult = lSmpDeriveKey(&salt, pResumption->secret,
+                                  SMP_RESUMED_SESSION_KEY_INFO,
+                                  pSmpCtx->sessionKey);
+        if (WCL_SUCCESS != smpResult) {
+            goto exit;
+        }
+    }
+
+    /* Copy the standard MQTT packet to output. */
+    pClearMessage->data = wosMemAlloc(pMqttPacket->length);
+    if (NULL == pClearMessage->data) {
+        WLOGE("error allocating memory");
+        smpResult = WCL_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+    pClearMessage->length = pMqttPacket->length;
+    wosMemCopy(pClearMessage->data, pMqttPacket->data, pClearMessage->length);
+
+    lSmpStartTraffic(pSmpCtx);
+    smpResult = WCL_SUCCESS;
+
+exit:
+    wosMemSet(binderKey, 0, sizeof(binderKey));
+    WOS_FREE_DATA(&aad);
+    if (WOS_IS_VALID_BUFFER(pPlainText)) {
+        wosMemSet(pPlainText->data, 0, pPlainText->length);
+    }
+    WOS_FREE_BUF_AND_DATA(pPlainText);
+    if (WCL_SUCCESS != smpResult) {
+        wosMemSet(pSmpCtx->sessionKey, 0, sizeof(pSmpCtx->sessionKey));
+        /* The client keeps its ticket, a broker rejecting it starts over with
+         * a full handshake on the next connection. */
+        if (!isClient) {
+            lSmpFreeResumption(pSmpCtx);
+        }
+    }
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+static void lSmpFreeEarlyData(SmpResumption_t *pResumption)
+{
+    if (WOS_IS_VALID_BUFFER(pResumption->pEarlyData)) {
+        wosMemSet(pResumption->pEarlyData->data, 0,
+                  pResumption->pEarlyData->length);
+    }
+    WOS_FREE_BUF_AND_DATA(pResumption->pEarlyData);
+}
+
+static void lSmpFreeResumption(SmpSessionContext_t *pSmpCtx)
+{
+    if (NULL != pSmpCtx->pResumption) {
+        lSmpFreeEarlyData(pSmpCtx->pResumption);
+        wosMemSet(pSmpCtx->pResumption, 0, sizeof(SmpResumption_t));
+        wosMemFree(pSmpCtx->pResumption);
+        pSmpCtx->pResumption = NULL;
+    }
+}
+
+static void lSmpStartTraffic(SmpSessionContext_t *pSmpCtx)
+{
+    wosMemCopy(pSmpCtx->sendKey.key, pSmpCtx->sessionKey,
+               sizeof(pSmpCtx->sendKey.key));
+    pSmpCtx->sendKey.epoch = 0;
+    pSmpCtx->numSentMessages = 0;
+    pSmpCtx->numSentBytes = 0;
+    pSmpCtx->receiveKeys[0] = pSmpCtx->sendKey;
+    wosMemSet(&pSmpCtx->receiveKeys[1], 0, sizeof(SmpTrafficKey_t));
+    pSmpCtx->isSessionKeyEstablished = true;
+}
+
+static WclError_t lSmpRatchetKey(WosString_t info,
+                                 const SmpTrafficKey_t *pKey,
+                                 SmpTrafficKey_t *pNextKey)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    smpResult = lSmpDeriveKey(NULL, pKey->key, info, pNextKey->key);
+    if (WCL_SUCCESS != smpResult) {
+        WLOGE("traffic key update failed");
+        goto exit;
+    }
+    pNextKey->epoch = pKey->epoch + 1;
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+static WclError_t lSmpGetReceiveKey(SmpSessionContext_t *pSmpCtx,
+                                    uint32_t epoch, SmpTrafficKey_t *pKey)
+{
+    WclError_t smpResult = WCL_ERROR_INVALID_MESSAGE;
+    SmpTrafficKey_t currentKey;
+    bool isNextEpoch = false;
+
+    FUNCTION_ENTRY();
+
+    /* Only held to copy the keys out, messages are verified without it. */
+    while (__atomic_test_and_set(&pSmpCtx->isReceiveKeysLocked,
+                                 __ATOMIC_ACQUIRE)) {
+    }
+    currentKey = pSmpCtx->receiveKeys[0];
+    if (epoch == currentKey.epoch) {
+        *pKey = currentKey;
+        smpResult = WCL_SUCCESS;
+    } else if ((0 != currentKey.epoch) && (epoch == currentKey.epoch - 1)) {
+        *pKey = pSmpCtx->receiveKeys[1];
+        smpResult = WCL_SUCCESS;
+    } else if (epoch == currentKey.epoch + 1) {
+        isNextEpoch = true;
+    }
+    __atomic_clear(&pSmpCtx->isReceiveKeysLocked, __ATOMIC_RELEASE);
+
+    if (isNextEpoch) {
+        smpResult = lSmpRatchetKey(SMP_RECEIVE_TRAFFIC_KEY_INFO(pSmpCtx),
+                                   &currentKey, pKey);
+    } else if (WCL_SUCCESS != smpResult) {
+        WLOGE("bad epoch %u", epoch);
+    }
+    wosMemSet(&currentKey, 0, sizeof(currentKey));
+
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+static void lSmpCommitReceiveKey(SmpSessionContext_t *pSmpCtx,
+                                 const SmpTrafficKey_t *pKey)
+{
+    while (__atomic_test_and_set(&pSmpCtx->isReceiveKeysLocked,
+                                 __ATOMIC_ACQUIRE)) {
+    }
+    /* Nothing to do for a key already known, or if another message of the
+     * epoch got here first. The key of the epoch before the previous one is
+     * overwritten, so it can't be used anymore. */
+    if (pKey->epoch == pSmpCtx->receiveKeys[0].epoch + 1) {
+        pSmpCtx->receiveKeys[1] = pSmpCtx->receiveKeys[0];
+        pSmpCtx->receiveKeys[0] = *pKey;
+    }
+    __atomic_clear(&pSmpCtx->isReceiveKeysLocked, __ATOMIC_RELEASE);
+}
+
+static WclError_t lSmpSealInit(SmpSealJob_t *pJob, SmpSessionContext_t *pSmpCtx,
+                               WclSmpMessageType_t messageType,
+                               const WosBuffer_t *pClearMessage)
+{
+    WclError_t smpResult = WCL_ERROR;
+
     /* Input parameters validation. */
-    if ((NULL == pSmpCtx) || (!WOS_IS_VALID_BUFFER(pClearMessage)) ||
-        (NULL == pSecuredMessage)) {
+    if ((NULL == pSmpCtx) || (!WOS_IS_VALID_BUFFER(pClearMessage))) {
         WLOGE("invalid parameter");
         smpResult = WCL_ERROR_BAD_PARAMS;
         goto exit;
     }
     if ((messageType < WCL_SMP_MESSAGE_MQTTS_CONNECT) ||
-        (messageType > WCL_SMP_MESSAGE_MQTTS_DISCONNECT)) {
+        (messageType > WCL_SMP_MESSAGE_MQTTS_BATCH)) {
         WLOGE("bad message type %x", messageType);
         smpResult = WCL_ERROR_INVALID_MESSAGE;
         goto exit;
     }
-    WLOGI("context %x", pSmpCtx);
 
     /* Check if session keys has been generated. */
     if (!pSmpCtx->isSessionKeyEstablished) {
@@ -984,90 +1615,217 @@ WclError_t smpSecureMessage(SmpSessionContext_t *pSmpCtx,
         goto exit;
     }
 
+    pJob->pSmpCtx = pSmpCtx;
+    pJob->messageType = messageType;
+    pJob->pClearMessage = pClearMessage;
+    smpResult = WCL_SUCCESS;
+
+exit:
+    return smpResult;
+}
+
+static WclError_t lSmpSealPrepare(SmpSealJob_t *pJob)
+{
+    WclError_t smpResult = WCL_ERROR;
+    SmpSessionContext_t *pSmpCtx = pJob->pSmpCtx;
+    WclSmpMessageType_t messageType = pJob->messageType;
+    const WosBuffer_t *pClearMessage = pJob->pClearMessage;
+    SmpTrafficKey_t nextKey;
+    WosString_t pLabel = NULL;
+    size_t labelLength = 0;
+    size_t offset = 0;
+
+    /* Move to the next traffic key once the current one has protected enough
+     * messages or bytes. The epoch in the header tells the receiver. */
+    if ((pSmpCtx->numSentMessages >= pSmpCtx->rekeyMaxMessages) ||
+        (pSmpCtx->numSentBytes >= pSmpCtx->rekeyMaxBytes)) {
+        smpResult = lSmpRatchetKey(SMP_SEND_TRAFFIC_KEY_INFO(pSmpCtx),
+                                   &pSmpCtx->sendKey, &nextKey);
+        if (WCL_SUCCESS != smpResult) {
+            goto exit;
+        }
+        pSmpCtx->sendKey = nextKey;
+        wosMemSet(&nextKey, 0, sizeof(nextKey));
+        pSmpCtx->numSentMessages = 0;
+        pSmpCtx->numSentBytes = 0;
+    }
+
     /* Pack SMP header. */
-    smpResult = lSmpPackHeader(pSmpCtx, messageType, &encodedHeader);
+    smpResult = lSmpPackHeader(pSmpCtx, messageType, &pJob->encodedHeader);
     if (WOS_MSG_SUCCESS != smpResult) {
         WLOGE("Error packing header.");
         goto exit;
     }
 
-    /* A PUBLISH or SUBSCRIBE or SUB_ACK MQTT payload to be sent
+    /* A PUBLISH or SUBSCRIBE or SUB_ACK or BATCH MQTT payload to be sent
     from client/broker end has to be authentically encrypted. MQTT payload of
     other messages will be only authenticated. */
     if ((WCL_SMP_MESSAGE_MQTTS_PUBLISH == messageType) ||
         (WCL_SMP_MESSAGE_MQTTS_SUBSCRIBE == messageType) ||
         (WCL_SMP_MESSAGE_MQTTS_SUBACK == messageType) ||
-        (WCL_SMP_MESSAGE_MQTTS_UNSUBSCRIBE == messageType)) {
-        encryptMqttPacket = true;
+        (WCL_SMP_MESSAGE_MQTTS_UNSUBSCRIBE == messageType) ||
+        (WCL_SMP_MESSAGE_MQTTS_BATCH == messageType)) {
+        pJob->encryptMqttPacket = true;
     }
 
     /* Prepare the authentication data, SMP-header || label (|| MQTT packet). */
-#if defined(SMP_MQTTS_CLIENT)
-    labelLength = wosStringLength(gClientToBrokerMsgLabels[messageType]);
-#else
-    labelLength = wosStringLength(gBrokerToClientMsgLabels[messageType]);
-#endif
-    aad.length = encodedHeader.length + labelLength;
-    if (!encryptMqttPacket) {
-        aad.length += pClearMessage->length;
-    }
-    aad.data = wosMemAlloc(aad.length);
-    if (NULL == aad.data) {
+    pLabel = SMP_SEND_LABELS(pSmpCtx)[messageType - 1];
+    labelLength = wosStringLength(pLabel);
+    pJob->aad.length = pJob->encodedHeader.length + labelLength;
+    if (!pJob->encryptMqttPacket) {
+        pJob->aad.length += pClearMessage->length;
+    }
+    pJob->aad.data = wosMemAlloc(pJob->aad.length);
+    if (NULL == pJob->aad.data) {
         WLOGE("error allocating memory for aad");
         smpResult = WCL_ERROR_OUT_OF_MEMORY;
         goto exit;
     }
-    wosMemCopy(aad.data, encodedHeader.data, encodedHeader.length);
-    offset = encodedHeader.length;
-#if defined(SMP_MQTTS_CLIENT)
-    wosMemCopy(aad.data + offset, gClientToBrokerMsgLabels[messageType],
-               labelLength);
-#else
-    wosMemCopy(aad.data + offset, gBrokerToClientMsgLabels[messageType],
-               labelLength);
-#endif
-    if (!encryptMqttPacket) {
+    wosMemCopy(pJob->aad.data, pJob->encodedHeader.data,
+               pJob->encodedHeader.length);
+    offset = pJob->encodedHeader.length;
+    wosMemCopy(pJob->aad.data + offset, pLabel, labelLength);
+    if (!pJob->encryptMqttPacket) {
         offset += labelLength;
-        wosMemCopy(aad.data + offset, pClearMessage->data,
+        wosMemCopy(pJob->aad.data + offset, pClearMessage->data,
                    pClearMessage->length);
     }
 
-    /* Only authenticate or authenticate and encrypt. */
-    if (encryptMqttPacket) {
-        pPlainText = pClearMessage;
+    /* Only authenticate or authenticate and encrypt. Once agreed on, packets
+     * are compressed before being encrypted, since ciphertext does not
+     * compress. */
+    if (pJob->encryptMqttPacket && pSmpCtx->isCompressionNegotiated) {
+        smpResult = smpCompressPack(pClearMessage, &pJob->packedMessage);
+        if (WCL_SUCCESS != smpResult) {
+            goto exit;
+        }
+        pJob->pPlainText = &pJob->packedMessage;
+    } else if (pJob->encryptMqttPacket) {
+        pJob->pPlainText = pClearMessage;
     } else {
-        pPlainText = NULL;
+        pJob->pPlainText = NULL;
     }
-    cryptoResult =
-        wosCryptoAeEncrypt(pSmpCtx->pAeadOptions, pSmpCtx->pStorageContext,
-                           pSmpCtx->sessionSharedKeyStorageId, pPlainText, &aad,
-                           &pIv, &pCipherText, &pAuthTag);
-    if ((WOS_CRYPTO_SUCCESS != cryptoResult) || (!WOS_IS_VALID_BUFFER(pIv)) ||
-        (!WOS_IS_VALID_BUFFER(pAuthTag)) ||
-        (encryptMqttPacket && (!WOS_IS_VALID_BUFFER(pCipherText)))) {
+    wosMemCopy(pJob->key, pSmpCtx->sendKey.key, sizeof(pJob->key));
+
+    /* Increment the message counter. A message failing from here on leaves
+     * a gap in the message ids, which the receiver does not mind. */
+    pSmpCtx->toBeSentMessageId++;
+    pSmpCtx->numSentMessages++;
+    pSmpCtx->numSentBytes += pClearMessage->length;
+    smpResult = WCL_SUCCESS;
+
+exit:
+    return smpResult;
+}
+
+static WclError_t lSmpSealEncrypt(SmpSealJob_t *pJob)
+{
+    WclError_t smpResult = WCL_ERROR;
+    WosCryptoError_t cryptoResult = WOS_CRYPTO_ERROR;
+    WosBuffer_t trafficKey = {.data = pJob->key, .length = sizeof(pJob->key)};
+
+    cryptoResult = wosCryptoAeEncryptKeyBuffer(
+        pJob->pSmpCtx->pAeadOptions, &trafficKey, pJob->pPlainText,
+        &pJob->aad, &pJob->pIv, &pJob->pCipherText, &pJob->pAuthTag);
+    smpResult = lSmpSealCheckEncrypted(pJob, cryptoResult);
+
+    return smpResult;
+}
+
+static void lSmpSealEncryptMany(SmpSealJob_t *pJobs, size_t count,
+                                WclSmpMessageRequest_t *pRequests)
+{
+    WosCryptoAeJob_t aeJobs[SMP_SEAL_BATCH_SIZE];
+    WosBuffer_t trafficKeys[SMP_SEAL_BATCH_SIZE];
+    size_t jobIndexes[SMP_SEAL_BATCH_SIZE];
+    WosCryptoAeOptions_t *pAeadOptions = NULL;
+    SmpSealJob_t *pJob = NULL;
+    size_t numAeJobs = 0;
+    size_t i = 0;
+
+    for (i = 0; i < count; i++) {
+        pJob = &pJobs[i];
+        if (NULL == pJob->pSmpCtx) {
+            continue;
+        }
+        /* All the sessions use gAeadOptions. */
+        pAeadOptions = pJob->pSmpCtx->pAeadOptions;
+        trafficKeys[numAeJobs].data = pJob->key;
+        trafficKeys[numAeJobs].length = sizeof(pJob->key);
+        aeJobs[numAeJobs].pKeyBuf = &trafficKeys[numAeJobs];
+        aeJobs[numAeJobs].pPlainText = pJob->pPlainText;
+        aeJobs[numAeJobs].pAad = &pJob->aad;
+        aeJobs[numAeJobs].pIv = pJob->pIv;
+        jobIndexes[numAeJobs] = i;
+        numAeJobs++;
+    }
+    if (0 == numAeJobs) {
+        return;
+    }
+
+    /* Messages to different sessions are independent, the crypto layer
+     * encrypts them side by side. The result of each is checked below. */
+    (void)wosCryptoAeEncryptMulti(pAeadOptions, aeJobs, numAeJobs);
+    for (i = 0; i < numAeJobs; i++) {
+        pJob = &pJobs[jobIndexes[i]];
+        pJob->pIv = aeJobs[i].pIv;
+        pJob->pCipherText = aeJobs[i].pCipherText;
+        pJob->pAuthTag = aeJobs[i].pTag;
+        pRequests[jobIndexes[i]].result =
+            lSmpSealCheckEncrypted(pJob, aeJobs[i].result);
+        if (WCL_SUCCESS != pRequests[jobIndexes[i]].result) {
+            pJob->pSmpCtx = NULL;
+        }
+    }
+}
+
+static WclError_t lSmpSealCheckEncrypted(SmpSealJob_t *pJob,
+                                         WosCryptoError_t cryptoResult)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    if ((WOS_CRYPTO_SUCCESS != cryptoResult) ||
+        (!WOS_IS_VALID_BUFFER(pJob->pIv)) ||
+        (!WOS_IS_VALID_BUFFER(pJob->pAuthTag)) ||
+        (pJob->encryptMqttPacket &&
+         (!WOS_IS_VALID_BUFFER(pJob->pCipherText)))) {
         WLOGE("encryption failed %x", cryptoResult);
         smpResult = WCL_ERROR_CRYPTO_OPERATION;
         goto exit;
     }
+    smpResult = WCL_SUCCESS;
+
+exit:
+    return smpResult;
+}
+
+static WclError_t lSmpSealSerialize(SmpSealJob_t *pJob,
+                                    WosBuffer_t *pSecuredMessage)
+{
+    WclError_t smpResult = WCL_ERROR;
+    WosMsgError_t msgResult = WOS_MSG_ERROR;
+    WosMsgMqttsControlParams_t mqttsControlParams = {NULL, NULL, NULL, NULL};
+    size_t seializedBufSize = 0;
 
     /* Serialize the SMP MQTTS Control Message. */
     /* Prepare the input params. */
-    mqttsControlParams.pEncodedSmpHeader = &encodedHeader;
-    if (encryptMqttPacket) {
-        mqttsControlParams.pMqttPacket = pCipherText;
+    mqttsControlParams.pEncodedSmpHeader = &pJob->encodedHeader;
+    if (pJob->encryptMqttPacket) {
+        mqttsControlParams.pMqttPacket = pJob->pCipherText;
     } else {
-        mqttsControlParams.pMqttPacket = pClearMessage;
+        mqttsControlParams.pMqttPacket = pJob->pClearMessage;
     }
-    mqttsControlParams.pIV = pIv;
-    mqttsControlParams.pAuthTag = pAuthTag;
+    mqttsControlParams.pIV = pJob->pIv;
+    mqttsControlParams.pAuthTag = pJob->pAuthTag;
     /* Allocate memory for the output buffer. */
     seializedBufSize = SMP_MQTTS_CONTROL_MSG_SERIALIZER_SIZE_OVERHEAD +
-                       encodedHeader.length + pIv->length + pAuthTag->length;
+                       pJob->encodedHeader.length + pJob->pIv->length +
+                       pJob->pAuthTag->length;
     /* In case of padding if CT size is greater than PT size. */
-    if (encryptMqttPacket) {
-        seializedBufSize += pCipherText->length;
+    if (pJob->encryptMqttPacket) {
+        seializedBufSize += pJob->pCipherText->length;
     } else {
-        seializedBufSize += pClearMessage->length;
+        seializedBufSize += pJob->pClearMessage->length;
     }
     pSecuredMessage->data = wosMemAlloc(seializedBufSize);
     if (NULL == pSecuredMessage->data) {
@@ -1083,152 +1841,677 @@ WclError_t smpSecureMessage(SmpSessionContext_t *pSmpCtx,
         smpResult = WCL_ERROR_SERIALIZATION;
         goto exit;
     }
-
-    /* Increment the message counter. */
-    pSmpCtx->toBeSentMessageId++;
     smpResult = WCL_SUCCESS;
 
 exit:
-    WOS_FREE_DATA(&encodedHeader);
-    WOS_FREE_DATA(&aad);
-    WOS_FREE_BUF_AND_DATA(pIv);
-    WOS_FREE_BUF_AND_DATA(pAuthTag);
-    WOS_FREE_BUF_AND_DATA(pCipherText);
     if (WCL_SUCCESS != smpResult) {
         WOS_FREE_DATA(pSecuredMessage);
     }
-
-    FUNCTION_EXIT_RETURN(smpResult);
     return smpResult;
 }
 
-/* Process Session Establishment Ack Message or Validate(decrypt/verify) a
- * payload from responder. */
-WclError_t smpProcessMessage(SmpSessionContext_t *pSmpCtx,
-                             const WosBuffer_t *pSecuredMessage,
-                             WosBuffer_t *pClearMessage)
+static void lSmpSealFree(SmpSealJob_t *pJob)
+{
+    WOS_FREE_DATA(&pJob->encodedHeader);
+    WOS_FREE_DATA(&pJob->aad);
+    WOS_FREE_DATA(&pJob->packedMessage);
+    WOS_FREE_BUF_AND_DATA(pJob->pIv);
+    WOS_FREE_BUF_AND_DATA(pJob->pAuthTag);
+    WOS_FREE_BUF_AND_DATA(pJob->pCipherText);
+    wosMemSet(pJob->key, 0, sizeof(pJob->key));
+}
+
+/* ========================================================================== */
+/*                                Implementation                              */
+/* ========================================================================== */
+
+/* Generate the crypto assets. */
+WclError_t smpInitialiseSessionParams(SmpSessionContext_t **ppSmpCtx,
+                                      WclSmpRole_t role)
 {
     WclError_t smpResult = WCL_ERROR;
-    WosMsgError_t msgError = WOS_MSG_ERROR;
-    WosSmpHeader_t smpHeader = {{0, 0}, 0, NULL, 0};
+    SmpSessionContext_t *pSmpCtx = NULL;
 
     FUNCTION_ENTRY();
 
     /* Input parameters validation. */
-    if ((NULL == pSmpCtx) || (!WOS_IS_VALID_BUFFER(pSecuredMessage)) ||
-        (NULL == pClearMessage)) {
-        WLOGE("invalid parameter");
+    if ((NULL == ppSmpCtx) || ((WCL_SMP_ROLE_MQTTS_CLIENT != role) &&
+                               (WCL_SMP_ROLE_MQTTS_BROKER != role))) {
+        WLOGE("bad params");
         smpResult = WCL_ERROR_BAD_PARAMS;
-        goto exit;
+        goto exitBadParam;
     }
-    WLOGI("context %x", pSmpCtx);
 
-    /* First we need to find out what type of message it is and if it contains
-     * the right context and client-id etc. */
-    /* Unpack SMP header. */
-    smpHeader.clientId = wosMemAlloc(WCL_SMP_CLIENT_ID_LENGTH * sizeof(char));
-    if (NULL == smpHeader.clientId) {
+    /* Allocate context. */
+    pSmpCtx = wosMemAlloc(sizeof(SmpSessionContext_t));
+    if (NULL == pSmpCtx) {
         WLOGE("error allocating memory");
         smpResult = WCL_ERROR_OUT_OF_MEMORY;
         goto exit;
     }
-    msgError = wosMsgUnpackSmpHeaderFromSmpMsg(pSecuredMessage, &smpHeader);
-    if (WOS_MSG_SUCCESS != msgError) {
-        WLOGE("deserializing smp-header failed %x", msgError);
-        goto exit;
-    }
-    /* Validate the SMP common header data like client-id, context,
-     * message-counter etc. */
-    smpResult = lSmpValidateSmpHeader(pSmpCtx, &smpHeader);
-    if (WCL_SUCCESS != smpResult) {
-        WLOGE("invalid message");
-        goto exit;
-    }
+    WLOGI("context %x", pSmpCtx);
+    wosMemSet(pSmpCtx, 0, sizeof(SmpSessionContext_t));
+    pSmpCtx->role = role;
+    pSmpCtx->rekeyMaxMessages = WCL_SMP_REKEY_MAX_MESSAGES;
+    pSmpCtx->rekeyMaxBytes = WCL_SMP_REKEY_MAX_BYTES;
 
-    WLOGD("message type %x", smpHeader.messageType);
-    /* Process the message. */
-#if defined(SMP_MQTTS_CLIENT)
-    if (WCL_SMP_MESSAGE_MQTTS_CONNACK == smpHeader.messageType) {
-#else
-    if (WCL_SMP_MESSAGE_MQTTS_CONNECT == smpHeader.messageType) {
-#endif
-        smpResult =
-            lSmpProcessSeMessage(pSmpCtx, pSecuredMessage, pClearMessage);
-    } else {
-        smpResult = lSmpProcessControlMessage(pSmpCtx, smpHeader.messageType,
-                                              pSecuredMessage, pClearMessage);
-    }
+    /* Sessions share the storage of the global configuration, check it has
+     * been initialized. */
+    smpResult = smpCheckGlobalCreds();
     if (WCL_SUCCESS != smpResult) {
-        WLOGE("message processing failed");
+        WLOGE("SMP initialization failed %x", smpResult);
         goto exit;
     }
 
-    /* Update the last received message-id. */
-    pSmpCtx->lastReceivedMessageId = smpHeader.messageId;
+    /* The ECC dh params are generated by the first full handshake message,
+     * see lSmpGetHandshake(). */
+    pSmpCtx->pEccOptions = &gEccDHOptions;
+    pSmpCtx->pAeadOptions = &gAeadOptions;
 
+    *ppSmpCtx = pSmpCtx;
     smpResult = WCL_SUCCESS;
 
 exit:
-    if (NULL != smpHeader.clientId) {
-        wosMemFree(smpHeader.clientId);
+    if (WCL_SUCCESS != smpResult) {
+        if (NULL != pSmpCtx) {
+            wosMemFree(pSmpCtx);
+        }
     }
+exitBadParam:
     FUNCTION_EXIT_RETURN(smpResult);
     return smpResult;
 }
 
-/* Delete the crypto assets. */
-WclError_t smpDeleteSessionCredentials(SmpSessionContext_t *pSmpCtx)
-{
-    WclError_t smpResult = WCL_ERROR;
-    WosStorageError_t storageResult = WOS_STORAGE_ERROR;
-
+/* Export the session establishment message containing public keys for
+ * key-exchange. */
+WclError_t
+smpExportSessionEstablishmentParams(SmpSessionContext_t *pSmpCtx,
+                                    const WosBuffer_t *pStdProtocolSEParams,
+                                    WosBuffer_t *pSmpSEMessage)
+{
+    WclError_t smpResult = WCL_ERROR;
+    WosMsgError_t msgResult = WOS_MSG_ERROR;
+    WosBuffer_t encodedHeader = {.data = NULL, .length = 0};
+    WosBuffer_t eccDhPubParams = {.data = NULL, .length = 0};
+    WosMsgMqttsSeParams_t mqttsSeParams = {NULL, 0, NULL, NULL, NULL, 0, NULL};
+    WosSmpHeader_t smpHeader = {{0, 0}, 0, NULL, 0};
+    uint32_t seParamsTotalBytesLength = 0;
+    uint8_t indexCert = 0;
+    uint8_t ticketData[SMP_TICKET_LENGTH];
+    WosBuffer_t ticket = {.data = ticketData, .length = sizeof(ticketData)};
+
     FUNCTION_ENTRY();
 
     /* Input parameters validation. */
-    if (NULL == pSmpCtx) {
+    if ((NULL == pSmpCtx) || (!WOS_IS_VALID_BUFFER(pStdProtocolSEParams)) ||
+        (NULL == pSmpSEMessage)) {
         WLOGE("invalid parameter");
         smpResult = WCL_ERROR_BAD_PARAMS;
         goto exit;
     }
     WLOGI("context %x", pSmpCtx);
 
-    /* We removed ECC-DH params from transient storage after generating
-     * session-key, as a safety measure, removing again for the case when user
-     * generated ECC-DH params but didn't generated session-key and decided to
-     * close the session. */
-    if (pSmpCtx->isPreSessionSecretsGenerated) {
-        storageResult = wosStorageDelete(pSmpCtx->pStorageContext,
-                                         pSmpCtx->sessionPrivateKeyStorageId);
-        if (WOS_STORAGE_SUCCESS != storageResult) {
-            /* We log the error and continue. */
-            WLOGW("removing session private key from storage failed %x",
-                  storageResult);
-        }
-        storageResult = wosStorageDelete(pSmpCtx->pStorageContext,
-                                         pSmpCtx->sessionPublicKeyStorageId);
-        if (WOS_STORAGE_SUCCESS != storageResult) {
-            /* We log the error and continue. */
-            WLOGW("removing session public key from storage failed %x",
-                  storageResult);
+    /* A resumed session skips the key exchange and the signatures. */
+    if (NULL != pSmpCtx->pResumption) {
+        smpResult = lSmpExportResumedSeMessage(pSmpCtx, pStdProtocolSEParams,
+                                               pSmpSEMessage);
+        goto exit;
+    }
+
+    smpResult = lSmpGetHandshake(pSmpCtx);
+    if (WCL_SUCCESS != smpResult) {
+        goto exit;
+    }
+
+    /* Pack SMP header. */
+    smpResult = lSmpPackHeader(pSmpCtx, SMP_SE_SEND_MESSAGE_TYPE(pSmpCtx),
+                               &encodedHeader);
+
+    if (WCL_SUCCESS != smpResult) {
+        WLOGE("error packing header");
+        goto exit;
+    }
+
+    /* The ECC-DH params. */
+    eccDhPubParams.data = pSmpCtx->pHandshake->publicKey;
+    eccDhPubParams.length = pSmpCtx->pHandshake->publicKeyLength;
+    mqttsSeParams.pEccDhPubParams = &eccDhPubParams;
+
+    /* Concatenate the encoded SMP header, cipher scheme, ECC-DH public params
+     * and protocol packet for sigining. */
+    mqttsSeParams.pEncodedSmpHeader = &encodedHeader;
+    mqttsSeParams.pMqttPacket = pStdProtocolSEParams;
+    smpResult =
+        lSmpSignSeParams(pSmpCtx, &mqttsSeParams, &seParamsTotalBytesLength);
+    if (WCL_SUCCESS != smpResult) {
+        WLOGE("siginging the se-params failed");
+        goto exit;
+    }
+
+    /* Issue a ticket with the CONNACK when tickets are enabled, the session is
+     * still established without. */
+    if ((!SMP_IS_MQTTS_CLIENT(pSmpCtx)) && pSmpCtx->isSessionKeyEstablished &&
+        (0 < smpTicketGetLifetime())) {
+        if (WCL_SUCCESS == lSmpIssueTicket(pSmpCtx, ticketData)) {
+            mqttsSeParams.ticketLifetime = smpTicketGetLifetime();
+            mqttsSeParams.pTicket = &ticket;
+            seParamsTotalBytesLength += 2 * 5 + ticket.length;
+        } else {
+            WLOGW("issuing a session ticket failed");
         }
     }
+    WLOGD("SE-params total byte length %x", seParamsTotalBytesLength);
+
+    /* Finally serialize the SMP Session Establishment Packet. */
+    /* Allocate the memory for serialized buffer. */
+    pSmpSEMessage->data = wosMemAlloc(seParamsTotalBytesLength);
+    if (NULL == pSmpSEMessage->data) {
+        WLOGE("error allocating memory");
+        smpResult = WCL_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+    pSmpSEMessage->length = seParamsTotalBytesLength;
+    /* Serialize the SE-Params. */
+    msgResult = wosMsgPackSmpMqttsSEMessage(&mqttsSeParams, pSmpSEMessage);
+    if (WOS_MSG_SUCCESS != msgResult) {
+        WLOGE("serializing the se-message failed %x", msgResult);
+        smpResult = WCL_ERROR_SERIALIZATION;
+        goto exit;
+    }
+
+    /* The CONNACK was the last use of the key pair. */
+    if ((!SMP_IS_MQTTS_CLIENT(pSmpCtx)) && pSmpCtx->isSessionKeyEstablished) {
+        lSmpFreeHandshake(pSmpCtx);
+    }
+
+    /* Increment the message counter. */
+    pSmpCtx->toBeSentMessageId++;
+    smpResult = WCL_SUCCESS;
+
+exit:
+    WOS_FREE_DATA(&encodedHeader);
+    for (indexCert = 0; indexCert < mqttsSeParams.numCerts; indexCert++) {
+        WOS_FREE_BUF_AND_DATA(mqttsSeParams.ppCerts[indexCert]);
+    }
+    if (mqttsSeParams.ppCerts != NULL) {
+        wosMemFree(mqttsSeParams.ppCerts);
+    }
+    WOS_FREE_BUF_AND_DATA(mqttsSeParams.pSignature);
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Secure(encrypt/sign) an initiator's payload to be sent. */
+WclError_t smpSecureMessage(SmpSessionContext_t *pSmpCtx,
+                            WclSmpMessageType_t messageType,
+                            const WosBuffer_t *pClearMessage,
+                            WosBuffer_t *pSecuredMessage)
+{
+    WclError_t smpResult = WCL_ERROR;
+    SmpSealJob_t job;
+
+    FUNCTION_ENTRY();
+
+    wosMemSet(&job, 0, sizeof(job));
+
+    /* Input parameters validation. */
+    if (NULL == pSecuredMessage) {
+        WLOGE("invalid parameter");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+    smpResult = lSmpSealInit(&job, pSmpCtx, messageType, pClearMessage);
+    if (WCL_SUCCESS != smpResult) {
+        goto exit;
+    }
+    WLOGI("context %x", pSmpCtx);
+
+    smpResult = lSmpSealPrepare(&job);
+    if (WCL_SUCCESS == smpResult) {
+        smpResult = lSmpSealEncrypt(&job);
+    }
+    if (WCL_SUCCESS == smpResult) {
+        smpResult = lSmpSealSerialize(&job, pSecuredMessage);
+    }
+
+exit:
+    lSmpSealFree(&job);
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Build the messages of several requests at once. */
+void smpSecureMessages(WclSmpMessageRequest_t *pRequests, size_t numRequests)
+{
+    SmpSealJob_t jobs[SMP_SEAL_BATCH_SIZE];
+    WclSmpMessageRequest_t *pRequest = NULL;
+    SmpSessionContext_t *pSmpCtx = NULL;
+    size_t first = 0;
+    size_t count = 0;
+    size_t i = 0;
+
+    FUNCTION_ENTRY();
 
-    /* Remove session-key storage. */
-    if (pSmpCtx->isSessionKeyEstablished) {
-        storageResult = wosStorageDelete(pSmpCtx->pStorageContext,
-                                         pSmpCtx->sessionSharedKeyStorageId);
-        if (WOS_STORAGE_SUCCESS != storageResult) {
-            /* We log the error and continue. */
-            WLOGW("removing session shared key from storage failed %x",
-                  storageResult);
+    /* Each step runs over a group of messages before the next one, so the
+     * messages of a group are encrypted together. */
+    for (first = 0; first < numRequests; first += count) {
+        count = numRequests - first;
+        if (count > SMP_SEAL_BATCH_SIZE) {
+            count = SMP_SEAL_BATCH_SIZE;
         }
+        wosMemSet(jobs, 0, sizeof(jobs));
+
+        for (i = 0; i < count; i++) {
+            pRequest = &pRequests[first + i];
+            if (WCL_SUCCESS != pRequest->result) {
+                continue;
+            }
+            pSmpCtx = (SmpSessionContext_t *)pRequest->smpSession;
+            if (SMP_SE_SEND_MESSAGE_TYPE(pSmpCtx) == pRequest->messageType) {
+                pRequest->result = smpExportSessionEstablishmentParams(
+                    pSmpCtx, pRequest->pStdProtocolPacket,
+                    &pRequest->smpMessage);
+                continue;
+            }
+            pRequest->result =
+                lSmpSealInit(&jobs[i], pSmpCtx, pRequest->messageType,
+                             pRequest->pStdProtocolPacket);
+            if (WCL_SUCCESS == pRequest->result) {
+                pRequest->result = lSmpSealPrepare(&jobs[i]);
+            }
+            if (WCL_SUCCESS != pRequest->result) {
+                jobs[i].pSmpCtx = NULL;
+            }
+        }
+
+        lSmpSealEncryptMany(jobs, count, &pRequests[first]);
+
+        for (i = 0; i < count; i++) {
+            if (NULL != jobs[i].pSmpCtx) {
+                pRequests[first + i].result = lSmpSealSerialize(
+                    &jobs[i], &pRequests[first + i].smpMessage);
+            }
+            lSmpSealFree(&jobs[i]);
+        }
+    }
+
+    FUNCTION_EXIT();
+}
+
+/* Process Session Establishment Ack Message or Validate(decrypt/verify) a
+ * payload from responder. */
+WclError_t smpProcessMessage(SmpSessionContext_t *pSmpCtx,
+                             const WosBuffer_t *pSecuredMessage,
+                             WosBuffer_t *pClearMessage)
+{
+    WclError_t smpResult = WCL_ERROR;
+    WosMsgError_t msgError = WOS_MSG_ERROR;
+    WosMsgSmpView_t smpView;
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation. */
+    if ((NULL == pSmpCtx) || (!WOS_IS_VALID_BUFFER(pSecuredMessage)) ||
+        (NULL == pClearMessage)) {
+        WLOGE("invalid parameter");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+    WLOGI("context %x", pSmpCtx);
+
+    /* First we need to find out what type of message it is and if it contains
+     * the right context and client-id etc. The message is parsed once, in
+     * place, and the view feeds both validation and decryption. */
+    msgError = wosMsgParseSmpMessage(pSecuredMessage, &smpView);
+    if (WOS_MSG_SUCCESS != msgError) {
+        WLOGE("deserializing smp-header failed %x", msgError);
+        goto exit;
+    }
+    /* Validate the SMP common header data like client-id, context,
+     * message-counter etc. */
+    smpResult = lSmpValidateSmpHeader(pSmpCtx, &smpView);
+    if (WCL_SUCCESS != smpResult) {
+        WLOGE("invalid message");
+        goto exit;
+    }
+
+    WLOGD("message type %x", smpView.messageType);
+    /* Process the message. */
+    if ((SMP_SE_RECEIVE_MESSAGE_TYPE(pSmpCtx) == smpView.messageType) &&
+        lSmpIsResumedSeMessage(pSmpCtx, &smpView)) {
+        smpResult =
+            lSmpProcessResumedSeMessage(pSmpCtx, &smpView, pClearMessage);
+    } else if (SMP_SE_RECEIVE_MESSAGE_TYPE(pSmpCtx) == smpView.messageType) {
+        smpResult =
+            lSmpProcessSeMessage(pSmpCtx, pSecuredMessage, pClearMessage);
+    } else {
+        smpResult =
+            lSmpProcessControlMessage(pSmpCtx, &smpView, pClearMessage);
+    }
+    if (WCL_SUCCESS != smpResult) {
+        WLOGE("message processing failed");
+        goto exit;
+    }
+
+    /* Record the message-id. A concurrent call may have accepted a message
+     * with the same id since it was checked, in which case this one is a
+     * replay. */
+    if (!smpReplayCommit(&pSmpCtx->replayWindow, smpView.messageId)) {
+        WLOGE("replayed message %u", smpView.messageId);
+        WOS_FREE_DATA(pClearMessage);
+        smpResult = WCL_ERROR_INVALID_MESSAGE;
+        goto exit;
+    }
+
+    smpResult = WCL_SUCCESS;
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Export the ticket of an established client session with its secret. */
+WclError_t smpExportTicket(const SmpSessionContext_t *pSmpCtx,
+                           WosBuffer_t *pTicket)
+{
+    WclError_t smpResult = WCL_ERROR;
+    const SmpResumption_t *pResumption = NULL;
+    uint8_t i = 0;
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation. */
+    if ((NULL == pSmpCtx) || (NULL == pTicket)) {
+        WLOGE("invalid parameter");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+    pResumption = pSmpCtx->pResumption;
+    if ((!SMP_IS_MQTTS_CLIENT(pSmpCtx)) ||
+        (!pSmpCtx->isSessionKeyEstablished) || (NULL == pResumption) ||
+        (pResumption->ticketExpiry <= wosTimeGetSeconds())) {
+        WLOGE("session holds no ticket");
+        smpResult = WCL_ERROR_BAD_SESSION;
+        goto exit;
+    }
+
+    pTicket->data = wosMemAlloc(SMP_EXPORTED_TICKET_LENGTH);
+    if (NULL == pTicket->data) {
+        WLOGE("error allocating memory");
+        smpResult = WCL_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+    pTicket->length = SMP_EXPORTED_TICKET_LENGTH;
+    /* expiry (big endian) || secret || ticket. */
+    for (i = 0; i < 8; i++) {
+        pTicket->data[i] = (uint8_t)(pResumption->ticketExpiry >> (56 - 8 * i));
+    }
+    wosMemCopy(pTicket->data + 8, pResumption->secret,
+               sizeof(pResumption->secret));
+    wosMemCopy(pTicket->data + 8 + sizeof(pResumption->secret),
+               pResumption->ticket, sizeof(pResumption->ticket));
+
+    smpResult = WCL_SUCCESS;
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Import a ticket exported by smpExportTicket() into a fresh client session. */
+WclError_t smpImportTicket(SmpSessionContext_t *pSmpCtx,
+                           const WosBuffer_t *pTicket)
+{
+    WclError_t smpResult = WCL_ERROR;
+    SmpResumption_t *pResumption = NULL;
+    uint64_t ticketExpiry = 0;
+    uint8_t i = 0;
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation. */
+    if ((NULL == pSmpCtx) || (!WOS_IS_VALID_BUFFER(pTicket)) ||
+        (SMP_EXPORTED_TICKET_LENGTH != pTicket->length)) {
+        WLOGE("invalid parameter");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+    /* Only before the CONNECT. */
+    if ((!SMP_IS_MQTTS_CLIENT(pSmpCtx)) ||
+        pSmpCtx->isPreSessionSecretsGenerated ||
+        pSmpCtx->isSessionKeyEstablished || (NULL != pSmpCtx->pResumption) ||
+        (0 != pSmpCtx->toBeSentMessageId)) {
+        WLOGE("session has already started");
+        smpResult = WCL_ERROR_BAD_SESSION;
+        goto exit;
+    }
+
+    for (i = 0; i < 8; i++) {
+        ticketExpiry = (ticketExpiry << 8) | pTicket->data[i];
+    }
+    if (ticketExpiry <= wosTimeGetSeconds()) {
+        WLOGE("expired ticket");
+        smpResult = WCL_ERROR_INVALID_MESSAGE;
+        goto exit;
+    }
+
+    pResumption = wosMemAlloc(sizeof(SmpResumption_t));
+    if (NULL == pResumption) {
+        WLOGE("error allocating memory");
+        smpResult = WCL_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+    wosMemSet(pResumption, 0, sizeof(SmpResumption_t));
+    pResumption->ticketExpiry = ticketExpiry;
+    wosMemCopy(pResumption->secret, pTicket->data + 8,
+               sizeof(pResumption->secret));
+    wosMemCopy(pResumption->ticket,
+               pTicket->data + 8 + sizeof(pResumption->secret),
+               sizeof(pResumption->ticket));
+    pSmpCtx->pResumption = pResumption;
+
+    smpResult = WCL_SUCCESS;
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Set after how many messages or bytes the session updates its send key. */
+WclError_t smpSetRekeyLimits(SmpSessionContext_t *pSmpCtx,
+                             uint64_t maxMessages, uint64_t maxBytes)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation. */
+    if ((NULL == pSmpCtx) || (0 == maxMessages) || (0 == maxBytes)) {
+        WLOGE("invalid parameter");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+    pSmpCtx->rekeyMaxMessages = maxMessages;
+    pSmpCtx->rekeyMaxBytes = maxBytes;
+    smpResult = WCL_SUCCESS;
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Set whether the session compresses the packets it encrypts. */
+WclError_t smpSetCompression(SmpSessionContext_t *pSmpCtx, bool isEnabled)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation. */
+    if (NULL == pSmpCtx) {
+        WLOGE("invalid parameter");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+    /* Only before the session establishment. */
+    if (pSmpCtx->isSessionKeyEstablished ||
+        (0 != pSmpCtx->toBeSentMessageId)) {
+        WLOGE("session is already established");
+        smpResult = WCL_ERROR_BAD_SESSION;
+        goto exit;
+    }
+    pSmpCtx->isCompressionEnabled = isEnabled;
+    smpResult = WCL_SUCCESS;
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Set the packet a client sends as early data in its resumed CONNECT. */
+WclError_t smpSetEarlyData(SmpSessionContext_t *pSmpCtx,
+                           const WosBuffer_t *pEarlyData)
+{
+    WclError_t smpResult = WCL_ERROR;
+    WosBuffer_t *pCopy = NULL;
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation. */
+    if ((NULL == pSmpCtx) || (!WOS_IS_VALID_BUFFER(pEarlyData))) {
+        WLOGE("invalid parameter");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+    /* Only with a ticket and before the CONNECT. */
+    if ((!SMP_IS_MQTTS_CLIENT(pSmpCtx)) || (NULL == pSmpCtx->pResumption) ||
+        pSmpCtx->isSessionKeyEstablished ||
+        (0 != pSmpCtx->toBeSentMessageId)) {
+        WLOGE("session can't send early data");
+        smpResult = WCL_ERROR_BAD_SESSION;
+        goto exit;
+    }
+
+    pCopy = wosMemAlloc(sizeof(WosBuffer_t));
+    if (NULL == pCopy) {
+        WLOGE("error allocating memory");
+        smpResult = WCL_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+    pCopy->data = wosMemAlloc(pEarlyData->length);
+    if (NULL == pCopy->data) {
+        WLOGE("error allocating memory");
+        wosMemFree(pCopy);
+        smpResult = WCL_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+    pCopy->length = pEarlyData->length;
+    wosMemCopy(pCopy->data, pEarlyData->data, pEarlyData->length);
+
+    lSmpFreeEarlyData(pSmpCtx->pResumption);
+    pSmpCtx->pResumption->pEarlyData = pCopy;
+
+    smpResult = WCL_SUCCESS;
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Take the early data a broker accepted from a resumed CONNECT. */
+WclError_t smpGetEarlyData(SmpSessionContext_t *pSmpCtx,
+                           WosBuffer_t *pEarlyData)
+{
+    WclError_t smpResult = WCL_ERROR;
+    WosBuffer_t *pAccepted = NULL;
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation. */
+    if ((NULL == pSmpCtx) || (NULL == pEarlyData)) {
+        WLOGE("invalid parameter");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+    /* Most CONNECTs carry none, not worth an error log. */
+    if (SMP_IS_MQTTS_CLIENT(pSmpCtx) || (NULL == pSmpCtx->pResumption) ||
+        (NULL == pSmpCtx->pResumption->pEarlyData)) {
+        smpResult = WCL_ERROR_BAD_SESSION;
+        goto exit;
+    }
+
+    /* Hand the data over, the buffer holding it goes. */
+    pAccepted = pSmpCtx->pResumption->pEarlyData;
+    pSmpCtx->pResumption->pEarlyData = NULL;
+    pEarlyData->data = pAccepted->data;
+    pEarlyData->length = pAccepted->length;
+    wosMemFree(pAccepted);
+
+    smpResult = WCL_SUCCESS;
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Whether the broker accepted the early data a client sent. */
+WclError_t smpIsEarlyDataAccepted(const SmpSessionContext_t *pSmpCtx,
+                                  bool *pIsAccepted)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation. */
+    if ((NULL == pSmpCtx) || (NULL == pIsAccepted)) {
+        WLOGE("invalid parameter");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
     }
+    /* Only known once the CONNACK has been processed. */
+    if ((!SMP_IS_MQTTS_CLIENT(pSmpCtx)) ||
+        (!pSmpCtx->isSessionKeyEstablished)) {
+        WLOGE("session establishment is not over");
+        smpResult = WCL_ERROR_BAD_SESSION;
+        goto exit;
+    }
+
+    *pIsAccepted = (NULL != pSmpCtx->pResumption) &&
+                   pSmpCtx->pResumption->isEarlyDataAccepted;
+    smpResult = WCL_SUCCESS;
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
 
-    storageResult = wosStorageTerminate(pSmpCtx->pStorageContext);
-    if (WOS_STORAGE_SUCCESS != storageResult) {
-        /* We log the error and continue. */
-        WLOGW("storage termination failed %x", storageResult);
+/* Delete the crypto assets. */
+WclError_t smpDeleteSessionCredentials(SmpSessionContext_t *pSmpCtx)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation. */
+    if (NULL == pSmpCtx) {
+        WLOGE("invalid parameter");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
     }
+    WLOGI("context %x", pSmpCtx);
+    if (0 != __atomic_load_n(&pSmpCtx->numPendingJobs, __ATOMIC_ACQUIRE)) {
+        WLOGE("session has pending messages");
+        smpResult = WCL_ERROR_BAD_SESSION;
+        goto exit;
+    }
+
+    /* The key pair is normally wiped once the session key is derived and
+     * sent, wiping it here covers a session closed during the handshake. */
+    lSmpFreeHandshake(pSmpCtx);
+    lSmpFreeResumption(pSmpCtx);
+    wosMemSet(pSmpCtx->sessionKey, 0, sizeof(pSmpCtx->sessionKey));
+    wosMemSet(&pSmpCtx->sendKey, 0, sizeof(pSmpCtx->sendKey));
+    wosMemSet(pSmpCtx->receiveKeys, 0, sizeof(pSmpCtx->receiveKeys));
 
     /* Free context. */
     wosMemFree(pSmpCtx);
@@ -1241,6 +2524,68 @@ exit:
     return smpResult;
 }
 
+/* Whether a session sends messages of this type, depends on its role. */
+bool smpIsSentMessageType(const SmpSessionContext_t *pSmpCtx,
+                          WclSmpMessageType_t messageType)
+{
+    switch (messageType) {
+    case WCL_SMP_MESSAGE_MQTTS_PUBLISH:
+    case WCL_SMP_MESSAGE_MQTTS_PUBACK:
+    case WCL_SMP_MESSAGE_MQTTS_PUBREC:
+    case WCL_SMP_MESSAGE_MQTTS_PUBREL:
+    case WCL_SMP_MESSAGE_MQTTS_PUBCOMP:
+    case WCL_SMP_MESSAGE_MQTTS_PINGREQ:
+    case WCL_SMP_MESSAGE_MQTTS_PINGRESP:
+    case WCL_SMP_MESSAGE_MQTTS_BATCH:
+        return true;
+
+    case WCL_SMP_MESSAGE_MQTTS_CONNECT:
+    case WCL_SMP_MESSAGE_MQTTS_SUBSCRIBE:
+    case WCL_SMP_MESSAGE_MQTTS_UNSUBSCRIBE:
+    case WCL_SMP_MESSAGE_MQTTS_DISCONNECT:
+        return SMP_IS_MQTTS_CLIENT(pSmpCtx);
+
+    case WCL_SMP_MESSAGE_MQTTS_CONNACK:
+    case WCL_SMP_MESSAGE_MQTTS_SUBACK:
+    case WCL_SMP_MESSAGE_MQTTS_UNSUBACK:
+        return !SMP_IS_MQTTS_CLIENT(pSmpCtx);
+
+    default:
+        return false;
+    }
+}
+
+/* Whether a session receives messages of this type, depends on its role. */
+bool smpIsReceivedMessageType(const SmpSessionContext_t *pSmpCtx,
+                              WclSmpMessageType_t messageType)
+{
+    switch (messageType) {
+    case WCL_SMP_MESSAGE_MQTTS_PUBLISH:
+    case WCL_SMP_MESSAGE_MQTTS_PUBACK:
+    case WCL_SMP_MESSAGE_MQTTS_PUBREC:
+    case WCL_SMP_MESSAGE_MQTTS_PUBREL:
+    case WCL_SMP_MESSAGE_MQTTS_PUBCOMP:
+    case WCL_SMP_MESSAGE_MQTTS_BATCH:
+        return true;
+
+    case WCL_SMP_MESSAGE_MQTTS_CONNACK:
+    case WCL_SMP_MESSAGE_MQTTS_SUBACK:
+    case WCL_SMP_MESSAGE_MQTTS_UNSUBACK:
+    case WCL_SMP_MESSAGE_MQTTS_PINGRESP:
+        return SMP_IS_MQTTS_CLIENT(pSmpCtx);
+
+    case WCL_SMP_MESSAGE_MQTTS_CONNECT:
+    case WCL_SMP_MESSAGE_MQTTS_SUBSCRIBE:
+    case WCL_SMP_MESSAGE_MQTTS_UNSUBSCRIBE:
+    case WCL_SMP_MESSAGE_MQTTS_PINGREQ:
+    case WCL_SMP_MESSAGE_MQTTS_DISCONNECT:
+        return !SMP_IS_MQTTS_CLIENT(pSmpCtx);
+
+    default:
+        return false;
+    }
+}
+
 /* ========================================================================== */
 /*                                End of File                                 */
 /* ========================================================================== */
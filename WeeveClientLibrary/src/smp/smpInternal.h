@@ -37,6 +37,9 @@ extern "C" {
 
 #include "wclConfig.h"
 
+#include "smpReplay.h"
+#include "smpTicket.h"
+
 /* ========================================================================== */
 /*                                Constants                                   */
 /* ========================================================================== */
@@ -44,44 +47,113 @@ extern "C" {
 /* Length of random IDs. */
 #define SMP_INTERNAL_ID_LENGTH (0x20)
 
+/* Whether a session is the mqtts Client end of the connection. */
+#define SMP_IS_MQTTS_CLIENT(pSmpCtx)                                           \
+    (WCL_SMP_ROLE_MQTTS_CLIENT == (pSmpCtx)->role)
+
+/* Session establishment message a session sends and the one it receives. */
+#define SMP_SE_SEND_MESSAGE_TYPE(pSmpCtx)                                      \
+    (SMP_IS_MQTTS_CLIENT(pSmpCtx) ? WCL_SMP_MESSAGE_MQTTS_CONNECT              \
+                                  : WCL_SMP_MESSAGE_MQTTS_CONNACK)
+#define SMP_SE_RECEIVE_MESSAGE_TYPE(pSmpCtx)                                   \
+    (SMP_IS_MQTTS_CLIENT(pSmpCtx) ? WCL_SMP_MESSAGE_MQTTS_CONNACK              \
+                                  : WCL_SMP_MESSAGE_MQTTS_CONNECT)
+
 /* ========================================================================== */
 /*                                Types                                       */
 /* ========================================================================== */
 
 typedef WosBuffer_t SmpStorageId_t;
 
-/* Context to hold a SMP session */
+/* Session key exchange (ECDH) key pair. It is only needed until the session
+ * key has been derived and sent, so it lives outside the session context and
+ * is wiped and freed as soon as possible. */
+typedef struct tSmpHandshakeContext {
+  /* ECDH Private Key. */
+  uint8_t privateKey[WOS_CRYPTO_ECC_NIST_P256_KEY_LENGTH];
+  uint32_t privateKeyLength;
+  /* ECDH Public Key. */
+  uint8_t publicKey[WOS_CRYPTO_ECC_NIST_P256_PUBLIC_KEY_LENGTH];
+  uint32_t publicKeyLength;
+} SmpHandshakeContext_t;
+
+/* Session resumption state. A client keeps the ticket and secret it got in a
+ * full CONNACK, or imported for a resumed CONNECT. A broker only holds it
+ * between a resumed CONNECT and its CONNACK. */
+typedef struct tSmpResumption {
+  /* Resumption secret, sealed in the ticket. */
+  uint8_t secret[SMP_TICKET_SECRET_LENGTH];
+  /* Own nonce of the resumed session establishment. */
+  uint8_t nonce[SMP_RESUMPTION_NONCE_LENGTH];
+  /* Ticket, opaque to the client. */
+  uint8_t ticket[SMP_TICKET_LENGTH];
+  /* Expiry of the ticket, seconds since the epoch. */
+  uint64_t ticketExpiry;
+  /* Early data, the packet sent in the CONNECT by a client, the packet
+   * waiting to be picked up by a broker. NULL if none. */
+  WosBuffer_t *pEarlyData;
+  /* Whether the broker accepted the early data of the CONNECT. */
+  bool isEarlyDataAccepted;
+} SmpResumption_t;
+
+/* Traffic key protecting the messages of one direction once the session has
+ * been established. It starts out as the session key, epoch 0, and each epoch
+ * derives the key of the next. */
+typedef struct tSmpTrafficKey {
+  /* AEAD key. */
+  uint8_t key[WOS_CRYPTO_ECC_NIST_P256_SHARED_SECRET_LENGTH];
+  /* Epoch, carried in the SMP header of the messages protected with key. */
+  uint32_t epoch;
+} SmpTrafficKey_t;
+
+/* Context to hold a SMP session. A broker keeps one of these for every
+ * connected client, so it only carries what is needed once the session has
+ * been established. Global credentials are looked up through
+ * smpGlobalCreds.h rather than copied in. */
 typedef struct tSmpSessionContext {
   /* Client-Id. */
   char clientId[WCL_SMP_CLIENT_ID_LENGTH + 1];
   /* Indicates whether pre-session secrets has been generated. */
   bool isPreSessionSecretsGenerated;
-  /* Indiacates whether session key has been generated. */
+  /* Indicates whether session key has been established. */
   bool isSessionKeyEstablished;
-  /* Storage context for stored keys. */
-  void *pStorageContext;
-  /* Session Key Exchange: ECDH Private Key storage id. */
-  char sessionPrivateKeyStorageId[SMP_INTERNAL_ID_LENGTH + 1];
-  /* Session Key Exchange: ECDH Public Key storage id. */
-  char sessionPublicKeyStorageId[SMP_INTERNAL_ID_LENGTH + 1];
-  /* Session Key Exchange: ECDH Shared Secret storage id. */
-  char sessionSharedKeyStorageId[SMP_INTERNAL_ID_LENGTH + 1];
+  /* mqtts Client or mqtts Broker end of the connection. */
+  WclSmpRole_t role;
+  /* Message id of the message to be sent. */
+  uint32_t toBeSentMessageId;
+  /* Message ids received, messages may be processed concurrently and out of
+   * order once the session has been established. */
+  SmpReplayWindow_t replayWindow;
   /* ECC Cipher suite options. */
   WosCryptoEccOptions_t *pEccOptions;
   /* AEAD Cipher options. */
   WosCryptoAeOptions_t *pAeadOptions;
-  /* Message id of the message to be sent. */
-  uint32_t toBeSentMessageId;
-  /* Message id of the last message received. */
-  uint32_t lastReceivedMessageId;
-  /* Storage ID for self's Private Key. */
-  WosString_t selfPrivKeyStorageId;
-  /* Storage ID for self's certificate + chain. */
-  WosString_t selfCertChainStorageId;
-  /* Storage ID for number of certificates on the chain. */
-  uint8_t selfCertChainSize;
-  /* Storage ID for Root CA certificate. */
-  WosString_t rootCaStorageId;
+  /* Session Key Exchange: key pair, NULL once the handshake is over. */
+  SmpHandshakeContext_t *pHandshake;
+  /* Session resumption, NULL unless resuming or holding a ticket. */
+  SmpResumption_t *pResumption;
+  /* Session Key Exchange: ECDH Shared Secret, used as AEAD key. */
+  uint8_t sessionKey[WOS_CRYPTO_ECC_NIST_P256_SHARED_SECRET_LENGTH];
+  /* Key of the messages sent, and what it has protected so far. */
+  SmpTrafficKey_t sendKey;
+  uint64_t numSentMessages;
+  uint64_t numSentBytes;
+  /* Limits of the send key, it is ratcheted once either is reached. */
+  uint64_t rekeyMaxMessages;
+  uint64_t rekeyMaxBytes;
+  /* Keys of the messages received, those of the current epoch first and of
+   * the previous one second, for messages processed out of order. */
+  SmpTrafficKey_t receiveKeys[2];
+  /* Guards receiveKeys, which is read by every thread processing a message
+   * and only updated by the first message of an epoch. */
+  bool isReceiveKeysLocked;
+  /* Whether the session offers, as a client, or accepts, as a broker, to
+   * compress the packets it encrypts. */
+  bool isCompressionEnabled;
+  /* Whether both ends agreed on compression in the session establishment. */
+  bool isCompressionNegotiated;
+  /* Messages submitted to the asynchronous API and not completed yet. */
+  uint32_t numPendingJobs;
 } SmpSessionContext_t;
 
 /* ========================================================================== */
@@ -93,7 +165,8 @@ typedef struct tSmpSessionContext {
 /* ========================================================================== */
 
 /* Generate the crypto assets. */
-WclError_t smpInitialiseSessionParams(SmpSessionContext_t **ppSmpCtx);
+WclError_t smpInitialiseSessionParams(SmpSessionContext_t **ppSmpCtx,
+                                      WclSmpRole_t role);
 
 /* Export the session establishment message containing public keys for
  * key-exchange. */
@@ -108,15 +181,55 @@ WclError_t smpSecureMessage(SmpSessionContext_t *pSmpCtx,
                             const WosBuffer_t *pClearMessage,
                             WosBuffer_t *pSecuredMessage);
 
+/* Build the messages of the requests whose result is WCL_SUCCESS, already
+ * checked against their session, and set the result of each. */
+void smpSecureMessages(WclSmpMessageRequest_t *pRequests, size_t numRequests);
+
 /* Process Session Establishment Ack Message or Validate(decrypt/verify) a
  * payload from responder. */
 WclError_t smpProcessMessage(SmpSessionContext_t *pSmpCtx,
                              const WosBuffer_t *pSecuredMessage,
                              WosBuffer_t *pClearMessage);
 
+/* Export the ticket of an established client session with its secret. */
+WclError_t smpExportTicket(const SmpSessionContext_t *pSmpCtx,
+                           WosBuffer_t *pTicket);
+
+/* Import a ticket exported by smpExportTicket() into a fresh client session,
+ * its CONNECT will resume the session. */
+WclError_t smpImportTicket(SmpSessionContext_t *pSmpCtx,
+                           const WosBuffer_t *pTicket);
+
+/* Set the number of messages and bytes sent under one traffic key. */
+WclError_t smpSetRekeyLimits(SmpSessionContext_t *pSmpCtx,
+                             uint64_t maxMessages, uint64_t maxBytes);
+
+/* Set whether the session compresses the packets it encrypts. */
+WclError_t smpSetCompression(SmpSessionContext_t *pSmpCtx, bool isEnabled);
+
+/* Set the packet a client sends as early data in its resumed CONNECT. */
+WclError_t smpSetEarlyData(SmpSessionContext_t *pSmpCtx,
+                           const WosBuffer_t *pEarlyData);
+
+/* Take the early data a broker accepted from a resumed CONNECT. */
+WclError_t smpGetEarlyData(SmpSessionContext_t *pSmpCtx,
+                           WosBuffer_t *pEarlyData);
+
+/* Whether the broker accepted the early data a client sent. */
+WclError_t smpIsEarlyDataAccepted(const SmpSessionContext_t *pSmpCtx,
+                                  bool *pIsAccepted);
+
 /* Delete the crypto assets. */
 WclError_t smpDeleteSessionCredentials(SmpSessionContext_t *pSmpCtx);
 
+/* Whether a session sends messages of this type, depends on its role. */
+bool smpIsSentMessageType(const SmpSessionContext_t *pSmpCtx,
+                          WclSmpMessageType_t messageType);
+
+/* Whether a session receives messages of this type, depends on its role. */
+bool smpIsReceivedMessageType(const SmpSessionContext_t *pSmpCtx,
+                              WclSmpMessageType_t messageType);
+
 #ifdef __cplusplus
 }
 #endif
@@ -51,10 +51,7 @@ extern "C" {
 /* Generate a random string(length=32) used as id.
  * Important:
  * This function must be called passing as argument an already allocated string
- * of size 32 + 1. Good example of that are:
- * - SmpSessionContext_t.sessionPublicKeyStorageId,
- * - SmpSessionContext_t.sessionPrivateKeyStorageId,
- * - SmpSessionContext_t.sessionSharedKeyStorageId.
+ * of size 32 + 1.
  */
 WclError_t smpUtilsGen32CharRandomId(WosString_t randomId);
 
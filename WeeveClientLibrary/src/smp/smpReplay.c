@@ -0,0 +1,119 @@
+/* Licensed to weeveMQ under one or more contributor license agreements.
+* See the LICENCE file distributed with this work for additional information
+* regarding copyright ownership. You may obtain a copy of the License at
+*
+*     https://github.com/weeveiot/weeveMQ/blob/master/LICENCE
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+/**
+ * @file smpReplay.c
+ * @brief
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+/* ========================================================================== */
+/*                                Includes                                    */
+/* ========================================================================== */
+
+#include "smpReplay.h"
+
+/* ========================================================================== */
+/*                                Constants                                   */
+/* ========================================================================== */
+
+/* ========================================================================== */
+/*                                Types                                       */
+/* ========================================================================== */
+
+/* ========================================================================== */
+/*                                Global Variables                            */
+/* ========================================================================== */
+
+/* ========================================================================== */
+/*                                Local Function Declarations                 */
+/* ========================================================================== */
+
+/* Whether a message id is new to a snapshot of the window. */
+static bool lSmpReplayIsNew(SmpReplayWindow_t window, uint32_t messageId);
+
+/* The window once a new message id has been accepted. */
+static SmpReplayWindow_t lSmpReplayRecord(SmpReplayWindow_t window,
+                                          uint32_t messageId);
+
+/* ========================================================================== */
+/*                                Local Function Definitions                  */
+/* ========================================================================== */
+
+static bool lSmpReplayIsNew(SmpReplayWindow_t window, uint32_t messageId)
+{
+    uint32_t highest = (uint32_t)(window >> 32);
+    uint32_t bitmap = (uint32_t)window;
+    uint32_t offset = 0;
+
+    if (messageId > highest) {
+        return true;
+    }
+    offset = highest - messageId;
+    if (offset >= SMP_REPLAY_WINDOW_SIZE) {
+        /* Too old to tell whether it has been seen. */
+        return false;
+    }
+    return (0 == (bitmap & ((uint32_t)1 << offset)));
+}
+
+static SmpReplayWindow_t lSmpReplayRecord(SmpReplayWindow_t window,
+                                          uint32_t messageId)
+{
+    uint32_t highest = (uint32_t)(window >> 32);
+    uint32_t bitmap = (uint32_t)window;
+    uint32_t shift = 0;
+
+    if (messageId > highest) {
+        /* Slide the window up to the new highest id. */
+        shift = messageId - highest;
+        bitmap = (shift < SMP_REPLAY_WINDOW_SIZE) ? (bitmap << shift) : 0;
+        bitmap |= 1;
+        highest = messageId;
+    } else {
+        bitmap |= (uint32_t)1 << (highest - messageId);
+    }
+    return (((SmpReplayWindow_t)highest << 32) | bitmap);
+}
+
+/* ========================================================================== */
+/*                                Function Definitions                        */
+/* ========================================================================== */
+
+bool smpReplayCheck(const SmpReplayWindow_t *pWindow, uint32_t messageId)
+{
+    return lSmpReplayIsNew(__atomic_load_n(pWindow, __ATOMIC_RELAXED),
+                           messageId);
+}
+
+bool smpReplayCommit(SmpReplayWindow_t *pWindow, uint32_t messageId)
+{
+    SmpReplayWindow_t window = __atomic_load_n(pWindow, __ATOMIC_RELAXED);
+
+    /* Retried whenever another commit got in first, the id being checked
+     * again against the window that commit left. */
+    do {
+        if (!lSmpReplayIsNew(window, messageId)) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(
+        pWindow, &window, lSmpReplayRecord(window, messageId), true,
+        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return true;
+}
+
+/* ========================================================================== */
+/*                                End of File                                 */
+/* ========================================================================== */
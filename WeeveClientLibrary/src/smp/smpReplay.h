@@ -0,0 +1,83 @@
+/* Licensed to weeveMQ under one or more contributor license agreements.
+* See the LICENCE file distributed with this work for additional information
+* regarding copyright ownership. You may obtain a copy of the License at
+*
+*     https://github.com/weeveiot/weeveMQ/blob/master/LICENCE
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+/**
+ * @file smpReplay.h
+ * @brief Anti-replay window over the message ids a SMP session receives,
+ * letting messages be verified concurrently and accepted in any order.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#ifndef SMP_REPLAY_H_
+#define SMP_REPLAY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========================================================================== */
+/*                                Includes                                    */
+/* ========================================================================== */
+
+#include "wclTypes.h"
+
+/* ========================================================================== */
+/*                                Constants                                   */
+/* ========================================================================== */
+
+/* Number of message ids, counting the highest one accepted, a message may
+ * arrive behind and still be accepted if it has not been seen. */
+#define SMP_REPLAY_WINDOW_SIZE (32)
+
+/* ========================================================================== */
+/*                                Types                                       */
+/* ========================================================================== */
+
+/* Window of RFC 4303 section 3.4.3. The upper 32 bits hold the highest
+ * message id accepted, the lower 32 a bitmap of the ids accepted below it,
+ * bit n standing for the highest id minus n. Holding both in one word lets
+ * the window be updated with a single compare-and-swap. Zero is the window
+ * of a new session, which accepts message id 0. */
+typedef uint64_t SmpReplayWindow_t;
+
+/* ========================================================================== */
+/*                                Global Variables                            */
+/* ========================================================================== */
+
+/* ========================================================================== */
+/*                                Function Declarations                       */
+/* ========================================================================== */
+
+/* Whether a message id is new to the window, that is above the highest one
+ * accepted, or within the window and not accepted yet. Nothing is recorded,
+ * so a message passing this is only accepted once it has been verified and
+ * committed. */
+bool smpReplayCheck(const SmpReplayWindow_t *pWindow, uint32_t messageId);
+
+/* Record a message id once its message has been verified. Fails if the id is
+ * no longer new, because another message with the same id has been committed
+ * or the window has moved past it since the check. Safe to call from several
+ * threads at once. */
+bool smpReplayCommit(SmpReplayWindow_t *pWindow, uint32_t messageId);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SMP_REPLAY_H_ */
+
+/* ========================================================================== */
+/*                                End of File                                 */
+/* ========================================================================== */
@@ -0,0 +1,644 @@
+/* Licensed to weeveMQ under one or more contributor license agreements.
+* See the LICENCE file distributed with this work for additional information
+* regarding copyright ownership. You may obtain a copy of the License at
+*
+*     https://github.com/weeveiot/weeveMQ/blob/master/LICENCE
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+/**
+ * @file smpTicket.c
+ * @brief
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+/* ========================================================================== */
+/*                                Includes                                    */
+/* ========================================================================== */
+
+#include "wclConfig.h"
+#include "wosCommon.h"
+#include "wosCrypto.h"
+#include "wosLog.h"
+#include "wosMemory.h"
+#include "wosTime.h"
+
+#include "smpTicket.h"
+
+/* ========================================================================== */
+/*                                Constants                                   */
+/* ========================================================================== */
+
+#define LOG_TAG "SMP"
+
+/* Offsets of the ticket fields. */
+#define SMP_TICKET_IV_OFFSET (SMP_TICKET_KEY_ID_LENGTH)
+#define SMP_TICKET_TAG_OFFSET                                                  \
+    (SMP_TICKET_IV_OFFSET + WOS_CRYPTO_AE_AES_GCM_IV_LENGTH)
+#define SMP_TICKET_SEALED_OFFSET                                               \
+    (SMP_TICKET_TAG_OFFSET + WOS_CRYPTO_AE_AES_BLOCK_LENGTH)
+#define SMP_TICKET_SEALED_LENGTH (SMP_TICKET_SECRET_LENGTH + 8)
+
+/* HKDF info deriving the key-id from a ticket key. */
+#define SMP_TICKET_KEY_ID_INFO "SMP ticket key id"
+
+/* Largest number of early data CONNECTs accepted within the window. */
+#define SMP_TICKET_REPLAY_MAX_ENTRIES (1U << 24)
+
+/* End of a bucket of the replay cache. */
+#define SMP_TICKET_REPLAY_NO_ENTRY (UINT32_MAX)
+
+/* FNV-1a 32 bits parameters, hashing the nonces. */
+#define SMP_TICKET_FNV_OFFSET_BASIS (2166136261U)
+#define SMP_TICKET_FNV_PRIME (16777619U)
+
+/* ========================================================================== */
+/*                                Types                                       */
+/* ========================================================================== */
+
+/* Key sealing the tickets. */
+typedef struct tSmpTicketKey {
+    /* Whether the key has been set. */
+    bool isValid;
+    /* Identifier written in front of the tickets sealed with the key. */
+    uint8_t keyId[SMP_TICKET_KEY_ID_LENGTH];
+    /* AES-256-GCM key. */
+    uint8_t key[WOS_CRYPTO_AE_AES256_KEY_LENGTH];
+} SmpTicketKey_t;
+
+/* Client nonce of a CONNECT whose early data has been accepted. */
+typedef struct tSmpTicketReplayEntry {
+    /* Next entry of the same bucket, SMP_TICKET_REPLAY_NO_ENTRY if none. */
+    uint32_t next;
+    uint8_t nonce[SMP_RESUMPTION_NONCE_LENGTH];
+} SmpTicketReplayEntry_t;
+
+/* Hash set of the nonces accepted within the window. The entries are taken
+ * from a ring in the order the nonces are recorded, and given back from its
+ * head once their window has ended. */
+typedef struct tSmpTicketReplayCache {
+    /* Ring of capacity entries. */
+    SmpTicketReplayEntry_t *pEntries;
+    /* First entry of each bucket, numBuckets is a power of two. */
+    uint32_t *pBuckets;
+    uint32_t numBuckets;
+    uint32_t capacity;
+    /* Oldest entry of the ring and number of entries in use. */
+    uint32_t head;
+    uint32_t count;
+    /* Random hash seed, the nonces are chosen by the clients. */
+    uint32_t seed;
+} SmpTicketReplayCache_t;
+
+/* ========================================================================== */
+/*                                Global Variables                            */
+/* ========================================================================== */
+
+/* Key sealing new tickets. */
+static SmpTicketKey_t gCurrentTicketKey;
+/* Key replaced by the last rotation, still opens the tickets it sealed. */
+static SmpTicketKey_t gPreviousTicketKey;
+/* Lifetime of new tickets in seconds, 0 when tickets are disabled. */
+static uint32_t gTicketLifetime = 0;
+
+/* Tickets are sealed with AES-GCM like the session messages. */
+static WosCryptoAeOptions_t gTicketAeadOptions = {
+    .algorithm = WOS_CRYPTO_AE_ALGORITHM_AES, .mode = WOS_CRYPTO_AE_MODE_GCM};
+
+/* Anti-replay window of the early data. The client nonce is bound to the
+ * CONNECT and starts with the time it was drawn at, so a replayed CONNECT
+ * either carries a nonce in gReplayCache or is older than the window.
+ * Entries outlive a key rotation since so do the tickets. */
+static uint32_t gEarlyDataWindow = WCL_SMP_EARLY_DATA_WINDOW_SECONDS;
+static uint32_t gEarlyDataMaxConnects = WCL_SMP_EARLY_DATA_MAX_CONNECTS;
+static SmpTicketReplayCache_t gReplayCache;
+/* Broker sessions of several threads may check their early data at once. */
+static bool gIsReplayCacheLocked = false;
+
+/* ========================================================================== */
+/*                                Local Function Declarations                 */
+/* ========================================================================== */
+
+/* Open a ticket with one key. */
+static WclError_t lSmpTicketOpenWithKey(const SmpTicketKey_t *pTicketKey,
+                                        const WosBuffer_t *pTicket,
+                                        uint8_t *pSealed);
+
+/* Seconds from the time stamp of a client nonce to now, negative for a nonce
+ * stamped ahead of the broker clock. */
+static int32_t lSmpTicketNonceAge(const uint8_t *pNonce, uint64_t now);
+
+/* Bucket of a nonce in gReplayCache. */
+static uint32_t lSmpTicketNonceBucket(const uint8_t *pNonce);
+
+/* Allocate gReplayCache for gEarlyDataMaxConnects entries. */
+static WclError_t lSmpTicketAllocReplayCache(void);
+
+/* Free gReplayCache, the nonces it holds are forgotten. */
+static void lSmpTicketFreeReplayCache(void);
+
+/* Give back the entries of gReplayCache whose window has ended. */
+static void lSmpTicketExpireReplayCache(uint64_t now);
+
+/* ========================================================================== */
+/*                                Local Function Definitions                  */
+/* ========================================================================== */
+
+static WclError_t lSmpTicketOpenWithKey(const SmpTicketKey_t *pTicketKey,
+                                        const WosBuffer_t *pTicket,
+                                        uint8_t *pSealed)
+{
+    WclError_t smpResult = WCL_ERROR;
+    WosCryptoError_t cryptoResult = WOS_CRYPTO_ERROR;
+    WosBuffer_t key = {.data = (uint8_t *)pTicketKey->key,
+                       .length = sizeof(pTicketKey->key)};
+    WosBuffer_t keyId = {.data = pTicket->data,
+                         .length = SMP_TICKET_KEY_ID_LENGTH};
+    WosBuffer_t iv = {.data = pTicket->data + SMP_TICKET_IV_OFFSET,
+                      .length = WOS_CRYPTO_AE_AES_GCM_IV_LENGTH};
+    WosBuffer_t tag = {.data = pTicket->data + SMP_TICKET_TAG_OFFSET,
+                       .length = WOS_CRYPTO_AE_AES_BLOCK_LENGTH};
+    WosBuffer_t cipherText = {.data = pTicket->data + SMP_TICKET_SEALED_OFFSET,
+                              .length = SMP_TICKET_SEALED_LENGTH};
+    WosBuffer_t *pPlainText = NULL;
+
+    FUNCTION_ENTRY();
+
+    if ((!pTicketKey->isValid) ||
+        (0 != wosMemComparison((uint8_t *)pTicketKey->keyId, pTicket->data,
+                               SMP_TICKET_KEY_ID_LENGTH))) {
+        smpResult = WCL_ERROR_INVALID_MESSAGE;
+        goto exit;
+    }
+
+    cryptoResult =
+        wosCryptoAeDecryptKeyBuffer(&gTicketAeadOptions, &key, &cipherText,
+                                    &keyId, &iv, &tag, &pPlainText);
+    if ((WOS_CRYPTO_SUCCESS != cryptoResult) ||
+        (SMP_TICKET_SEALED_LENGTH != pPlainText->length)) {
+        WLOGE("ticket authentication failed");
+        smpResult = WCL_ERROR_CRYPTO_OPERATION;
+        goto exit;
+    }
+    wosMemCopy(pSealed, pPlainText->data, SMP_TICKET_SEALED_LENGTH);
+
+    smpResult = WCL_SUCCESS;
+
+exit:
+    if (WOS_CRYPTO_SUCCESS == cryptoResult) {
+        wosMemSet(pPlainText->data, 0, pPlainText->length);
+        WOS_FREE_BUF_AND_DATA(pPlainText);
+    }
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+static int32_t lSmpTicketNonceAge(const uint8_t *pNonce, uint64_t now)
+{
+    uint32_t stamp = 0;
+    uint8_t i = 0;
+
+    for (i = 0; i < SMP_RESUMPTION_NONCE_TIME_LENGTH; i++) {
+        stamp = (stamp << 8) | pNonce[i];
+    }
+    /* Both are seconds modulo 2^32, the difference is taken the same way. */
+    return (int32_t)((uint32_t)now - stamp);
+}
+
+static uint32_t lSmpTicketNonceBucket(const uint8_t *pNonce)
+{
+    uint32_t hash = SMP_TICKET_FNV_OFFSET_BASIS ^ gReplayCache.seed;
+    uint8_t i = 0;
+
+    for (i = 0; i < SMP_RESUMPTION_NONCE_LENGTH; i++) {
+        hash = (hash ^ pNonce[i]) * SMP_TICKET_FNV_PRIME;
+    }
+    return hash & (gReplayCache.numBuckets - 1);
+}
+
+static WclError_t lSmpTicketAllocReplayCache(void)
+{
+    WclError_t smpResult = WCL_ERROR;
+    WosCryptoError_t cryptoResult = WOS_CRYPTO_ERROR;
+    WosBuffer_t seed = {.data = (uint8_t *)&gReplayCache.seed,
+                        .length = sizeof(gReplayCache.seed)};
+    uint32_t numBuckets = 1;
+    uint32_t i = 0;
+
+    FUNCTION_ENTRY();
+
+    /* At most one entry per two buckets keeps the chains short. */
+    while (numBuckets < 2 * gEarlyDataMaxConnects) {
+        numBuckets <<= 1;
+    }
+    gReplayCache.pEntries =
+        wosMemAlloc(gEarlyDataMaxConnects * sizeof(SmpTicketReplayEntry_t));
+    gReplayCache.pBuckets = wosMemAlloc(numBuckets * sizeof(uint32_t));
+    if ((NULL == gReplayCache.pEntries) || (NULL == gReplayCache.pBuckets)) {
+        WLOGE("early data replay cache allocation failed");
+        smpResult = WCL_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+    cryptoResult = wosCryptoGetRandomBytes(&seed);
+    if (WOS_CRYPTO_SUCCESS != cryptoResult) {
+        WLOGE("replay cache seed generation failed %x", cryptoResult);
+        smpResult = WCL_ERROR_CRYPTO_OPERATION;
+        goto exit;
+    }
+    for (i = 0; i < numBuckets; i++) {
+        gReplayCache.pBuckets[i] = SMP_TICKET_REPLAY_NO_ENTRY;
+    }
+    gReplayCache.numBuckets = numBuckets;
+    gReplayCache.capacity = gEarlyDataMaxConnects;
+    gReplayCache.head = 0;
+    gReplayCache.count = 0;
+
+    smpResult = WCL_SUCCESS;
+
+exit:
+    if (WCL_SUCCESS != smpResult) {
+        lSmpTicketFreeReplayCache();
+    }
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+static void lSmpTicketFreeReplayCache(void)
+{
+    if (NULL != gReplayCache.pEntries) {
+        wosMemFree(gReplayCache.pEntries);
+    }
+    if (NULL != gReplayCache.pBuckets) {
+        wosMemFree(gReplayCache.pBuckets);
+    }
+    wosMemSet(&gReplayCache, 0, sizeof(gReplayCache));
+}
+
+static void lSmpTicketExpireReplayCache(uint64_t now)
+{
+    SmpTicketReplayEntry_t *pEntry = NULL;
+    uint32_t *pLink = NULL;
+
+    /* Nonces are mostly recorded in the order of their time stamps. One
+     * stamped ahead only holds back the entries behind it for a while. */
+    while (0 != gReplayCache.count) {
+        pEntry = &gReplayCache.pEntries[gReplayCache.head];
+        if (lSmpTicketNonceAge(pEntry->nonce, now) <=
+            (int32_t)gEarlyDataWindow) {
+            break;
+        }
+        pLink = &gReplayCache.pBuckets[lSmpTicketNonceBucket(pEntry->nonce)];
+        while (*pLink != gReplayCache.head) {
+            pLink = &gReplayCache.pEntries[*pLink].next;
+        }
+        *pLink = pEntry->next;
+        gReplayCache.head = (gReplayCache.head + 1) % gReplayCache.capacity;
+        gReplayCache.count--;
+    }
+}
+
+/* ========================================================================== */
+/*                                Implementation                              */
+/* ========================================================================== */
+
+/* Install a new ticket key. */
+WclError_t smpTicketRotateKey(const WosBuffer_t *pTicketKey,
+                              uint32_t ticketLifetime)
+{
+    WclError_t smpResult = WCL_ERROR;
+    WosCryptoError_t cryptoResult = WOS_CRYPTO_ERROR;
+    SmpTicketKey_t newKey;
+    WosBuffer_t key = {.data = newKey.key, .length = sizeof(newKey.key)};
+    WosBuffer_t keyId = {.data = newKey.keyId, .length = sizeof(newKey.keyId)};
+    WosBuffer_t info = {.data = (uint8_t *)SMP_TICKET_KEY_ID_INFO,
+                        .length = sizeof(SMP_TICKET_KEY_ID_INFO) - 1};
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation. */
+    if ((NULL != pTicketKey) &&
+        ((!WOS_IS_VALID_BUFFER(pTicketKey)) ||
+         (sizeof(newKey.key) != pTicketKey->length))) {
+        WLOGE("bad params");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+
+    if (0 == ticketLifetime) {
+        smpTicketWipeKeys();
+        smpResult = WCL_SUCCESS;
+        goto exit;
+    }
+
+    wosMemSet(&newKey, 0, sizeof(newKey));
+    if (NULL != pTicketKey) {
+        wosMemCopy(newKey.key, pTicketKey->data, sizeof(newKey.key));
+    } else {
+        cryptoResult = wosCryptoGetRandomBytes(&key);
+        if (WOS_CRYPTO_SUCCESS != cryptoResult) {
+            WLOGE("ticket key generation failed %x", cryptoResult);
+            smpResult = WCL_ERROR_CRYPTO_OPERATION;
+            goto exit;
+        }
+    }
+    cryptoResult = wosCryptoHkdf(NULL, &key, &info, &keyId);
+    if (WOS_CRYPTO_SUCCESS != cryptoResult) {
+        WLOGE("ticket key-id derivation failed %x", cryptoResult);
+        smpResult = WCL_ERROR_CRYPTO_OPERATION;
+        goto exit;
+    }
+    newKey.isValid = true;
+
+    wosMemCopy(&gPreviousTicketKey, &gCurrentTicketKey,
+               sizeof(gCurrentTicketKey));
+    wosMemCopy(&gCurrentTicketKey, &newKey, sizeof(newKey));
+    gTicketLifetime = ticketLifetime;
+
+    smpResult = WCL_SUCCESS;
+
+exit:
+    wosMemSet(&newKey, 0, sizeof(newKey));
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Wipe the ticket keys. */
+void smpTicketWipeKeys(void)
+{
+    wosMemSet(&gCurrentTicketKey, 0, sizeof(gCurrentTicketKey));
+    wosMemSet(&gPreviousTicketKey, 0, sizeof(gPreviousTicketKey));
+    gTicketLifetime = 0;
+    while (__atomic_test_and_set(&gIsReplayCacheLocked, __ATOMIC_ACQUIRE)) {
+    }
+    lSmpTicketFreeReplayCache();
+    __atomic_clear(&gIsReplayCacheLocked, __ATOMIC_RELEASE);
+}
+
+/* Lifetime of the tickets sealed now. */
+uint32_t smpTicketGetLifetime(void)
+{
+    return gCurrentTicketKey.isValid ? gTicketLifetime : 0;
+}
+
+/* Seal a resumption secret into a ticket. */
+WclError_t smpTicketSeal(const uint8_t *pSecret, uint8_t *pTicket)
+{
+    WclError_t smpResult = WCL_ERROR;
+    WosCryptoError_t cryptoResult = WOS_CRYPTO_ERROR;
+    uint8_t sealed[SMP_TICKET_SEALED_LENGTH];
+    uint64_t expiry = 0;
+    WosBuffer_t key = {.data = gCurrentTicketKey.key,
+                       .length = sizeof(gCurrentTicketKey.key)};
+    WosBuffer_t keyId = {.data = gCurrentTicketKey.keyId,
+                         .length = sizeof(gCurrentTicketKey.keyId)};
+    WosBuffer_t plainText = {.data = sealed, .length = sizeof(sealed)};
+    WosBuffer_t *pIv = NULL;
+    WosBuffer_t *pCipherText = NULL;
+    WosBuffer_t *pAuthTag = NULL;
+    uint8_t i = 0;
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation. */
+    if ((NULL == pSecret) || (NULL == pTicket)) {
+        WLOGE("bad params");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+    if (0 == smpTicketGetLifetime()) {
+        WLOGE("tickets are disabled");
+        smpResult = WCL_ERROR_BAD_SESSION;
+        goto exit;
+    }
+
+    /* secret || expiry, big endian. */
+    expiry = wosTimeGetSeconds() + gTicketLifetime;
+    wosMemCopy(sealed, pSecret, SMP_TICKET_SECRET_LENGTH);
+    for (i = 0; i < 8; i++) {
+        sealed[SMP_TICKET_SECRET_LENGTH + i] = (uint8_t)(expiry >> (56 - 8 * i));
+    }
+
+    /* The key-id is authenticated too, a ticket cannot be moved to a key with
+     * a colliding id. */
+    cryptoResult =
+        wosCryptoAeEncryptKeyBuffer(&gTicketAeadOptions, &key, &plainText,
+                                    &keyId, &pIv, &pCipherText, &pAuthTag);
+    if ((WOS_CRYPTO_SUCCESS != cryptoResult) ||
+        (WOS_CRYPTO_AE_AES_GCM_IV_LENGTH != pIv->length) ||
+        (WOS_CRYPTO_AE_AES_BLOCK_LENGTH != pAuthTag->length) ||
+        (SMP_TICKET_SEALED_LENGTH != pCipherText->length)) {
+        WLOGE("sealing the ticket failed %x", cryptoResult);
+        smpResult = WCL_ERROR_CRYPTO_OPERATION;
+        goto exit;
+    }
+    wosMemCopy(pTicket, keyId.data, SMP_TICKET_KEY_ID_LENGTH);
+    wosMemCopy(pTicket + SMP_TICKET_IV_OFFSET, pIv->data, pIv->length);
+    wosMemCopy(pTicket + SMP_TICKET_TAG_OFFSET, pAuthTag->data,
+               pAuthTag->length);
+    wosMemCopy(pTicket + SMP_TICKET_SEALED_OFFSET, pCipherText->data,
+               pCipherText->length);
+
+    smpResult = WCL_SUCCESS;
+
+exit:
+    wosMemSet(sealed, 0, sizeof(sealed));
+    if (WOS_CRYPTO_SUCCESS == cryptoResult) {
+        WOS_FREE_BUF_AND_DATA(pIv);
+        WOS_FREE_BUF_AND_DATA(pAuthTag);
+        WOS_FREE_BUF_AND_DATA(pCipherText);
+    }
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Open a ticket and get the resumption secret back. */
+WclError_t smpTicketOpen(const WosBuffer_t *pTicket, uint8_t *pSecret,
+                         uint64_t *pExpiry)
+{
+    WclError_t smpResult = WCL_ERROR;
+    uint8_t sealed[SMP_TICKET_SEALED_LENGTH];
+    uint64_t expiry = 0;
+    uint8_t i = 0;
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation. */
+    if ((!WOS_IS_VALID_BUFFER(pTicket)) || (NULL == pSecret) ||
+        (NULL == pExpiry)) {
+        WLOGE("bad params");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+    if (SMP_TICKET_LENGTH != pTicket->length) {
+        WLOGE("bad ticket length %u", pTicket->length);
+        smpResult = WCL_ERROR_INVALID_MESSAGE;
+        goto exit;
+    }
+
+    /* Try the current key first, the previous one covers tickets sealed
+     * before the last rotation. */
+    smpResult = lSmpTicketOpenWithKey(&gCurrentTicketKey, pTicket, sealed);
+    if (WCL_SUCCESS != smpResult) {
+        smpResult = lSmpTicketOpenWithKey(&gPreviousTicketKey, pTicket, sealed);
+    }
+    if (WCL_SUCCESS != smpResult) {
+        WLOGE("unknown or forged ticket");
+        smpResult = WCL_ERROR_INVALID_MESSAGE;
+        goto exit;
+    }
+
+    for (i = 0; i < 8; i++) {
+        expiry = (expiry << 8) | sealed[SMP_TICKET_SECRET_LENGTH + i];
+    }
+    if (expiry <= wosTimeGetSeconds()) {
+        WLOGE("expired ticket");
+        smpResult = WCL_ERROR_INVALID_MESSAGE;
+        goto exit;
+    }
+    wosMemCopy(pSecret, sealed, SMP_TICKET_SECRET_LENGTH);
+    *pExpiry = expiry;
+
+    smpResult = WCL_SUCCESS;
+
+exit:
+    wosMemSet(sealed, 0, sizeof(sealed));
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Set the anti-replay window of the early data. */
+WclError_t smpTicketSetEarlyDataWindow(uint32_t windowSeconds,
+                                       uint32_t maxConnects)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation. */
+    if ((0 == windowSeconds) || (windowSeconds > INT32_MAX) ||
+        (0 == maxConnects) || (maxConnects > SMP_TICKET_REPLAY_MAX_ENTRIES)) {
+        WLOGE("bad params");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+
+    while (__atomic_test_and_set(&gIsReplayCacheLocked, __ATOMIC_ACQUIRE)) {
+    }
+    /* The nonces recorded under the current window are needed until it
+     * ends, the cache is only resized once it is empty. */
+    lSmpTicketExpireReplayCache(wosTimeGetSeconds());
+    if (0 != gReplayCache.count) {
+        WLOGE("early data is being accepted");
+        smpResult = WCL_ERROR_BAD_SESSION;
+    } else {
+        lSmpTicketFreeReplayCache();
+        gEarlyDataWindow = windowSeconds;
+        gEarlyDataMaxConnects = maxConnects;
+        smpResult = WCL_SUCCESS;
+    }
+    __atomic_clear(&gIsReplayCacheLocked, __ATOMIC_RELEASE);
+
+exit:
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* Stamp a client nonce with the time. */
+void smpTicketStampNonce(uint8_t *pNonce)
+{
+    uint64_t now = wosTimeGetSeconds();
+    uint8_t i = 0;
+
+    for (i = 0; i < SMP_RESUMPTION_NONCE_TIME_LENGTH; i++) {
+        pNonce[i] =
+            (uint8_t)(now >> (8 * (SMP_RESUMPTION_NONCE_TIME_LENGTH - 1 - i)));
+    }
+}
+
+/* Record the client nonce of a CONNECT carrying early data. */
+WclError_t smpTicketCheckEarlyData(const uint8_t *pNonce)
+{
+    WclError_t smpResult = WCL_ERROR;
+    SmpTicketReplayEntry_t *pEntry = NULL;
+    uint64_t now = wosTimeGetSeconds();
+    int32_t age = 0;
+    uint32_t bucket = 0;
+    uint32_t index = 0;
+    bool isLocked = false;
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation. */
+    if (NULL == pNonce) {
+        WLOGE("bad params");
+        smpResult = WCL_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+
+    while (__atomic_test_and_set(&gIsReplayCacheLocked, __ATOMIC_ACQUIRE)) {
+    }
+    isLocked = true;
+
+    /* A nonce out of the window can't be told from a replay. */
+    age = lSmpTicketNonceAge(pNonce, now);
+    if ((age > (int32_t)gEarlyDataWindow) ||
+        (age < -(int32_t)gEarlyDataWindow)) {
+        WLOGW("early data out of the window, %d s old", age);
+        smpResult = WCL_ERROR_INVALID_MESSAGE;
+        goto exit;
+    }
+
+    if (NULL == gReplayCache.pEntries) {
+        smpResult = lSmpTicketAllocReplayCache();
+        if (WCL_SUCCESS != smpResult) {
+            goto exit;
+        }
+    }
+    lSmpTicketExpireReplayCache(now);
+
+    bucket = lSmpTicketNonceBucket(pNonce);
+    for (index = gReplayCache.pBuckets[bucket];
+         SMP_TICKET_REPLAY_NO_ENTRY != index;
+         index = gReplayCache.pEntries[index].next) {
+        if (0 == wosMemComparison(gReplayCache.pEntries[index].nonce,
+                                  (uint8_t *)pNonce,
+                                  SMP_RESUMPTION_NONCE_LENGTH)) {
+            WLOGE("replayed early data");
+            smpResult = WCL_ERROR_INVALID_MESSAGE;
+            goto exit;
+        }
+    }
+    /* Evicting a live entry would let its CONNECT be replayed. */
+    if (gReplayCache.count == gReplayCache.capacity) {
+        WLOGW("more than %u early data CONNECTs within %u s",
+              gReplayCache.capacity, gEarlyDataWindow);
+        smpResult = WCL_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+    index = (gReplayCache.head + gReplayCache.count) % gReplayCache.capacity;
+    pEntry = &gReplayCache.pEntries[index];
+    wosMemCopy(pEntry->nonce, pNonce, SMP_RESUMPTION_NONCE_LENGTH);
+    pEntry->next = gReplayCache.pBuckets[bucket];
+    gReplayCache.pBuckets[bucket] = index;
+    gReplayCache.count++;
+
+    smpResult = WCL_SUCCESS;
+
+exit:
+    if (isLocked) {
+        __atomic_clear(&gIsReplayCacheLocked, __ATOMIC_RELEASE);
+    }
+    FUNCTION_EXIT_RETURN(smpResult);
+    return smpResult;
+}
+
+/* ========================================================================== */
+/*                                End of File                                 */
+/* ========================================================================== */
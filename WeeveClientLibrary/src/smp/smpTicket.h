@@ -0,0 +1,115 @@
+/* Licensed to weeveMQ under one or more contributor license agreements.
+* See the LICENCE file distributed with this work for additional information
+* regarding copyright ownership. You may obtain a copy of the License at
+*
+*     https://github.com/weeveiot/weeveMQ/blob/master/LICENCE
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+/**
+ * @file smpTicket.h
+ * @brief Session tickets, sealed by the broker and presented back by a
+ * reconnecting client to resume a SMP session without a new key exchange.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#ifndef SMP_TICKET_H_
+#define SMP_TICKET_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========================================================================== */
+/*                                Includes                                    */
+/* ========================================================================== */
+
+#include "wclTypes.h"
+#include "wosCrypto.h"
+
+/* ========================================================================== */
+/*                                Constants                                   */
+/* ========================================================================== */
+
+/* Length of the secret a ticket carries. */
+#define SMP_TICKET_SECRET_LENGTH (WOS_CRYPTO_HASH_SHA256_LENGTH)
+
+/* Length of the nonces exchanged in a resumed session establishment. */
+#define SMP_RESUMPTION_NONCE_LENGTH (16)
+
+/* Length of the time stamp opening the client nonce, big endian seconds. */
+#define SMP_RESUMPTION_NONCE_TIME_LENGTH (4)
+
+/* Length of the identifier of the key a ticket is sealed with. */
+#define SMP_TICKET_KEY_ID_LENGTH (4)
+
+/* Length of a ticket: key-id || IV || tag || encrypted(secret || expiry). */
+#define SMP_TICKET_LENGTH                                                      \
+    (SMP_TICKET_KEY_ID_LENGTH + WOS_CRYPTO_AE_AES_GCM_IV_LENGTH +              \
+     WOS_CRYPTO_AE_AES_BLOCK_LENGTH + SMP_TICKET_SECRET_LENGTH + 8)
+
+/* ========================================================================== */
+/*                                Types                                       */
+/* ========================================================================== */
+
+/* ========================================================================== */
+/*                                Global Variables                            */
+/* ========================================================================== */
+
+/* ========================================================================== */
+/*                                Function Declarations                       */
+/* ========================================================================== */
+
+/* Install a new ticket key, the current one is kept to open tickets it has
+ * already sealed. A NULL key draws a random one, a zero lifetime disables
+ * tickets and wipes both keys. */
+WclError_t smpTicketRotateKey(const WosBuffer_t *pTicketKey,
+                              uint32_t ticketLifetime);
+
+/* Wipe the ticket keys, tickets are disabled until the next rotation. */
+void smpTicketWipeKeys(void);
+
+/* Lifetime of the tickets sealed now, 0 when tickets are disabled. */
+uint32_t smpTicketGetLifetime(void);
+
+/* Seal a resumption secret into a ticket of SMP_TICKET_LENGTH bytes. */
+WclError_t smpTicketSeal(const uint8_t *pSecret, uint8_t *pTicket);
+
+/* Open a ticket sealed under the current or previous key and not yet expired,
+ * and get the resumption secret of SMP_TICKET_SECRET_LENGTH bytes and the
+ * expiry of the ticket back. */
+WclError_t smpTicketOpen(const WosBuffer_t *pTicket, uint8_t *pSecret,
+                         uint64_t *pExpiry);
+
+/* Set the anti-replay window of the early data: seconds a client nonce stays
+ * acceptable, and number of nonces recorded within that time. Fails while
+ * nonces recorded under the current window are still in it. */
+WclError_t smpTicketSetEarlyDataWindow(uint32_t windowSeconds,
+                                       uint32_t maxConnects);
+
+/* Write the time in the first SMP_RESUMPTION_NONCE_TIME_LENGTH bytes of a
+ * random client nonce. */
+void smpTicketStampNonce(uint8_t *pNonce);
+
+/* Record the client nonce of a resumed CONNECT carrying early data. Fails if
+ * the time stamp of the nonce is out of the window, if the nonce has been
+ * recorded within the window, that is if the CONNECT is a replay, or if the
+ * window already holds as many nonces as it is sized for. */
+WclError_t smpTicketCheckEarlyData(const uint8_t *pNonce);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SMP_TICKET_H_ */
+
+/* ========================================================================== */
+/*                                End of File                                 */
+/* ========================================================================== */
@@ -0,0 +1,415 @@
+/* Licensed to weeveMQ under one or more contributor license agreements.
+* See the LICENCE file distributed with this work for additional information
+* regarding copyright ownership. You may obtain a copy of the License at
+*
+*     https://github.com/weeveiot/weeveMQ/blob/master/LICENCE
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+/**
+ * @brief Multi-buffer AES-256-GCM encryption with AES-NI and PCLMULQDQ
+ *
+ * A single message keeps the AES unit waiting on the previous round of the
+ * same block and the carry-less multiplier waiting on the previous GHASH
+ * block. Independent messages have no such dependency, so the messages are
+ * taken WOS_CRYPTO_AES_GCM_MB_LANES at a time and every AES round and GHASH
+ * step is issued for all of them before the next one.
+ *
+ * GHASH works on byte reflected blocks, as in the Intel carry-less
+ * multiplication white paper.
+ *
+ * @file wosCryptoAesGcmMb.c
+ * @date 2026-10-19
+ *
+ */
+
+/* ========================================================================== */
+/*                                Includes                                    */
+/* ========================================================================== */
+
+#include "wosCryptoAesGcmMb.h"
+#include "wosMemory.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define WOS_CRYPTO_AES_GCM_MB_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+/* ========================================================================== */
+/*                                Constants                                   */
+/* ========================================================================== */
+
+#define AES256_ROUNDS (14)
+#define AES_BLOCK_LENGTH (16)
+
+#ifdef WOS_CRYPTO_AES_GCM_MB_X86
+
+#define WOS_AES_GCM_MB_TARGET __attribute__((target("aes,pclmul,ssse3")))
+
+/* ========================================================================== */
+/*                                Types                                       */
+/* ========================================================================== */
+
+/* ========================================================================== */
+/*                                Global Variables                            */
+/* ========================================================================== */
+
+/* -1 until the CPU has been asked, then whether it runs the kernel. */
+static int gIsSupported = -1;
+
+/* ========================================================================== */
+/*                                Local Function Declarations                 */
+/* ========================================================================== */
+
+/* Expand a 32 bytes key into the AES256_ROUNDS + 1 round keys. */
+static void lWosAesGcmMbExpandKey(const uint8_t *pKey, __m128i *pRoundKeys);
+
+/* Multiply two byte reflected GHASH blocks. */
+static __m128i lWosAesGcmMbGfMul(__m128i a, __m128i b);
+
+/* Encrypt the first count lanes, count at most WOS_CRYPTO_AES_GCM_MB_LANES. */
+static void lWosAesGcmMbEncryptGroup(const WosCryptoAesGcmMbLane_t *pLanes,
+                                     size_t count);
+
+/* ========================================================================== */
+/*                                Local Function Definitions                  */
+/* ========================================================================== */
+
+/* One half of the AES-256 key schedule: the previous even round key t1 mixed
+ * with the key generation assist t2 of the previous odd round key. */
+static inline WOS_AES_GCM_MB_TARGET __m128i lWosAesGcmMbAssist1(__m128i t1,
+                                                                __m128i t2)
+{
+    __m128i t4;
+
+    t2 = _mm_shuffle_epi32(t2, 0xff);
+    t4 = _mm_slli_si128(t1, 4);
+    t1 = _mm_xor_si128(t1, t4);
+    t4 = _mm_slli_si128(t4, 4);
+    t1 = _mm_xor_si128(t1, t4);
+    t4 = _mm_slli_si128(t4, 4);
+    t1 = _mm_xor_si128(t1, t4);
+    return _mm_xor_si128(t1, t2);
+}
+
+/* Other half: the previous odd round key t3 mixed with the S-box of the new
+ * even round key t1. */
+static inline WOS_AES_GCM_MB_TARGET __m128i lWosAesGcmMbAssist2(__m128i t1,
+                                                                __m128i t3)
+{
+    __m128i t2;
+    __m128i t4;
+
+    t4 = _mm_aeskeygenassist_si128(t1, 0x00);
+    t2 = _mm_shuffle_epi32(t4, 0xaa);
+    t4 = _mm_slli_si128(t3, 4);
+    t3 = _mm_xor_si128(t3, t4);
+    t4 = _mm_slli_si128(t4, 4);
+    t3 = _mm_xor_si128(t3, t4);
+    t4 = _mm_slli_si128(t4, 4);
+    t3 = _mm_xor_si128(t3, t4);
+    return _mm_xor_si128(t3, t2);
+}
+
+/* The round constant of _mm_aeskeygenassist_si128() has to be an immediate. */
+#define WOS_AES_GCM_MB_EXPAND(i, rcon)                                         \
+    do {                                                                       \
+        t1 = lWosAesGcmMbAssist1(t1, _mm_aeskeygenassist_si128(t3, rcon));     \
+        pRoundKeys[(i)] = t1;                                                  \
+        if ((i) < AES256_ROUNDS) {                                             \
+            t3 = lWosAesGcmMbAssist2(t1, t3);                                  \
+            pRoundKeys[(i) + 1] = t3;                                          \
+        }                                                                      \
+    } while (0)
+
+static WOS_AES_GCM_MB_TARGET void lWosAesGcmMbExpandKey(const uint8_t *pKey,
+                                                        __m128i *pRoundKeys)
+{
+    __m128i t1 = _mm_loadu_si128((const __m128i *)pKey);
+    __m128i t3 = _mm_loadu_si128((const __m128i *)(pKey + 16));
+
+    pRoundKeys[0] = t1;
+    pRoundKeys[1] = t3;
+    WOS_AES_GCM_MB_EXPAND(2, 0x01);
+    WOS_AES_GCM_MB_EXPAND(4, 0x02);
+    WOS_AES_GCM_MB_EXPAND(6, 0x04);
+    WOS_AES_GCM_MB_EXPAND(8, 0x08);
+    WOS_AES_GCM_MB_EXPAND(10, 0x10);
+    WOS_AES_GCM_MB_EXPAND(12, 0x20);
+    WOS_AES_GCM_MB_EXPAND(14, 0x40);
+}
+
+#undef WOS_AES_GCM_MB_EXPAND
+
+static WOS_AES_GCM_MB_TARGET __m128i lWosAesGcmMbGfMul(__m128i a, __m128i b)
+{
+    __m128i lo = _mm_clmulepi64_si128(a, b, 0x00);
+    __m128i mid = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10),
+                                _mm_clmulepi64_si128(a, b, 0x01));
+    __m128i hi = _mm_clmulepi64_si128(a, b, 0x11);
+    __m128i t7;
+    __m128i t8;
+    __m128i t9;
+
+    /* 256 bits product hi:lo. */
+    lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+    /* Shift it left by one, the operands being bit reflected. */
+    t7 = _mm_srli_epi32(lo, 31);
+    t8 = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    t9 = _mm_srli_si128(t7, 12);
+    t8 = _mm_slli_si128(t8, 4);
+    t7 = _mm_slli_si128(t7, 4);
+    lo = _mm_or_si128(lo, t7);
+    hi = _mm_or_si128(hi, t8);
+    hi = _mm_or_si128(hi, t9);
+
+    /* Reduce modulo x^128 + x^7 + x^2 + x + 1. */
+    t7 = _mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30));
+    t7 = _mm_xor_si128(t7, _mm_slli_epi32(lo, 25));
+    t8 = _mm_srli_si128(t7, 4);
+    t7 = _mm_slli_si128(t7, 12);
+    lo = _mm_xor_si128(lo, t7);
+    t9 = _mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2));
+    t9 = _mm_xor_si128(t9, _mm_srli_epi32(lo, 7));
+    t9 = _mm_xor_si128(t9, t8);
+    lo = _mm_xor_si128(lo, t9);
+    return _mm_xor_si128(hi, lo);
+}
+
+static WOS_AES_GCM_MB_TARGET void
+lWosAesGcmMbEncryptGroup(const WosCryptoAesGcmMbLane_t *pLanes, size_t count)
+{
+    const __m128i bswap =
+        _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+    __m128i roundKeys[WOS_CRYPTO_AES_GCM_MB_LANES][AES256_ROUNDS + 1];
+    __m128i h[WOS_CRYPTO_AES_GCM_MB_LANES];
+    __m128i ghash[WOS_CRYPTO_AES_GCM_MB_LANES];
+    __m128i counter[WOS_CRYPTO_AES_GCM_MB_LANES];
+    __m128i tagMask[WOS_CRYPTO_AES_GCM_MB_LANES];
+    __m128i x[WOS_CRYPTO_AES_GCM_MB_LANES];
+    size_t aadBlocks[WOS_CRYPTO_AES_GCM_MB_LANES];
+    size_t blocks[WOS_CRYPTO_AES_GCM_MB_LANES];
+    size_t maxAadBlocks = 0;
+    size_t maxBlocks = 0;
+    uint8_t partial[AES_BLOCK_LENGTH];
+    uint8_t j0[AES_BLOCK_LENGTH];
+    size_t lane;
+    size_t block;
+    size_t offset;
+    size_t n;
+    int round;
+
+    /* The lanes past count repeat the first one and store nothing, so that
+     * every loop below runs over all the lanes. */
+    for (lane = 0; lane < WOS_CRYPTO_AES_GCM_MB_LANES; lane++) {
+        const WosCryptoAesGcmMbLane_t *pLane = &pLanes[lane < count ? lane : 0];
+
+        if (lane < count) {
+            lWosAesGcmMbExpandKey(pLane->pKey, roundKeys[lane]);
+            aadBlocks[lane] =
+                (pLane->aadLength + AES_BLOCK_LENGTH - 1) / AES_BLOCK_LENGTH;
+            blocks[lane] =
+                (pLane->length + AES_BLOCK_LENGTH - 1) / AES_BLOCK_LENGTH;
+        } else {
+            wosMemCopy(roundKeys[lane], roundKeys[0], sizeof(roundKeys[0]));
+            aadBlocks[lane] = 0;
+            blocks[lane] = 0;
+        }
+        if (aadBlocks[lane] > maxAadBlocks) {
+            maxAadBlocks = aadBlocks[lane];
+        }
+        if (blocks[lane] > maxBlocks) {
+            maxBlocks = blocks[lane];
+        }
+
+        /* J0 = IV || 0^31 || 1 */
+        wosMemCopy(j0, pLane->pIv, 12);
+        j0[12] = 0;
+        j0[13] = 0;
+        j0[14] = 0;
+        j0[15] = 1;
+        counter[lane] = _mm_loadu_si128((const __m128i *)j0);
+        h[lane] = _mm_setzero_si128();
+        ghash[lane] = _mm_setzero_si128();
+    }
+
+    /* H = E(K, 0^128) and E(K, J0), which masks the tag. */
+    for (lane = 0; lane < WOS_CRYPTO_AES_GCM_MB_LANES; lane++) {
+        h[lane] = _mm_xor_si128(h[lane], roundKeys[lane][0]);
+        tagMask[lane] = _mm_xor_si128(counter[lane], roundKeys[lane][0]);
+    }
+    for (round = 1; round < AES256_ROUNDS; round++) {
+        for (lane = 0; lane < WOS_CRYPTO_AES_GCM_MB_LANES; lane++) {
+            h[lane] = _mm_aesenc_si128(h[lane], roundKeys[lane][round]);
+            tagMask[lane] =
+                _mm_aesenc_si128(tagMask[lane], roundKeys[lane][round]);
+        }
+    }
+    for (lane = 0; lane < WOS_CRYPTO_AES_GCM_MB_LANES; lane++) {
+        h[lane] = _mm_aesenclast_si128(h[lane], roundKeys[lane][AES256_ROUNDS]);
+        h[lane] = _mm_shuffle_epi8(h[lane], bswap);
+        tagMask[lane] = _mm_aesenclast_si128(tagMask[lane],
+                                             roundKeys[lane][AES256_ROUNDS]);
+        /* Counters are kept reflected so that inc32 is an add. */
+        counter[lane] = _mm_add_epi32(_mm_shuffle_epi8(counter[lane], bswap),
+                                      one);
+    }
+
+    /* GHASH of the additional data. */
+    for (block = 0; block < maxAadBlocks; block++) {
+        offset = block * AES_BLOCK_LENGTH;
+        for (lane = 0; lane < count; lane++) {
+            if (block >= aadBlocks[lane]) {
+                continue;
+            }
+            n = pLanes[lane].aadLength - offset;
+            if (n >= AES_BLOCK_LENGTH) {
+                x[lane] = _mm_loadu_si128(
+                    (const __m128i *)(pLanes[lane].pAad + offset));
+            } else {
+                wosMemSet(partial, 0, sizeof(partial));
+                wosMemCopy(partial, pLanes[lane].pAad + offset, n);
+                x[lane] = _mm_loadu_si128((const __m128i *)partial);
+            }
+            ghash[lane] = lWosAesGcmMbGfMul(
+                _mm_xor_si128(ghash[lane], _mm_shuffle_epi8(x[lane], bswap)),
+                h[lane]);
+        }
+    }
+
+    /* Counter mode, each cipher text block hashed as soon as it is out. */
+    for (block = 0; block < maxBlocks; block++) {
+        offset = block * AES_BLOCK_LENGTH;
+        for (lane = 0; lane < WOS_CRYPTO_AES_GCM_MB_LANES; lane++) {
+            x[lane] = _mm_xor_si128(_mm_shuffle_epi8(counter[lane], bswap),
+                                    roundKeys[lane][0]);
+            counter[lane] = _mm_add_epi32(counter[lane], one);
+        }
+        for (round = 1; round < AES256_ROUNDS; round++) {
+            for (lane = 0; lane < WOS_CRYPTO_AES_GCM_MB_LANES; lane++) {
+                x[lane] = _mm_aesenc_si128(x[lane], roundKeys[lane][round]);
+            }
+        }
+        for (lane = 0; lane < WOS_CRYPTO_AES_GCM_MB_LANES; lane++) {
+            x[lane] =
+                _mm_aesenclast_si128(x[lane], roundKeys[lane][AES256_ROUNDS]);
+        }
+        for (lane = 0; lane < count; lane++) {
+            if (block >= blocks[lane]) {
+                continue;
+            }
+            n = pLanes[lane].length - offset;
+            if (n >= AES_BLOCK_LENGTH) {
+                x[lane] = _mm_xor_si128(
+                    x[lane], _mm_loadu_si128((const __m128i *)(
+                                 pLanes[lane].pPlainText + offset)));
+                _mm_storeu_si128((__m128i *)(pLanes[lane].pCipherText + offset),
+                                 x[lane]);
+            } else {
+                /* Last partial block, hashed padded with zeroes. */
+                wosMemSet(partial, 0, sizeof(partial));
+                wosMemCopy(partial, pLanes[lane].pPlainText + offset, n);
+                x[lane] = _mm_xor_si128(
+                    x[lane], _mm_loadu_si128((const __m128i *)partial));
+                _mm_storeu_si128((__m128i *)partial, x[lane]);
+                wosMemCopy(pLanes[lane].pCipherText + offset, partial, n);
+                wosMemSet(partial + n, 0, AES_BLOCK_LENGTH - n);
+                x[lane] = _mm_loadu_si128((const __m128i *)partial);
+            }
+            ghash[lane] = lWosAesGcmMbGfMul(
+                _mm_xor_si128(ghash[lane], _mm_shuffle_epi8(x[lane], bswap)),
+                h[lane]);
+        }
+    }
+
+    /* Lengths in bits, then T = E(K, J0) ^ GHASH. */
+    for (lane = 0; lane < count; lane++) {
+        x[lane] = _mm_set_epi64x((long long)pLanes[lane].aadLength * 8,
+                                 (long long)pLanes[lane].length * 8);
+        ghash[lane] =
+            lWosAesGcmMbGfMul(_mm_xor_si128(ghash[lane], x[lane]), h[lane]);
+        x[lane] = _mm_xor_si128(_mm_shuffle_epi8(ghash[lane], bswap),
+                                tagMask[lane]);
+        _mm_storeu_si128((__m128i *)pLanes[lane].pTag, x[lane]);
+    }
+
+    wosMemSet(roundKeys, 0, sizeof(roundKeys));
+    wosMemSet(h, 0, sizeof(h));
+    wosMemSet(tagMask, 0, sizeof(tagMask));
+    wosMemSet(x, 0, sizeof(x));
+    wosMemSet(partial, 0, sizeof(partial));
+}
+
+/* ========================================================================== */
+/*                                Function Definitions                        */
+/* ========================================================================== */
+
+bool wosCryptoAesGcmMbIsSupported(void)
+{
+    int isSupported = __atomic_load_n(&gIsSupported, __ATOMIC_RELAXED);
+    unsigned int eax;
+    unsigned int ebx;
+    unsigned int ecx;
+    unsigned int edx;
+
+    if (isSupported < 0) {
+        isSupported = 0;
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) != 0 &&
+            (ecx & bit_AES) != 0 && (ecx & bit_PCLMUL) != 0 &&
+            (ecx & bit_SSSE3) != 0) {
+            isSupported = 1;
+        }
+        __atomic_store_n(&gIsSupported, isSupported, __ATOMIC_RELAXED);
+    }
+    return isSupported != 0;
+}
+
+void wosCryptoAesGcmMbEncrypt(const WosCryptoAesGcmMbLane_t *pLanes,
+                              size_t numLanes)
+{
+    size_t i;
+    size_t count;
+
+    for (i = 0; i < numLanes; i += count) {
+        count = numLanes - i;
+        if (count > WOS_CRYPTO_AES_GCM_MB_LANES) {
+            count = WOS_CRYPTO_AES_GCM_MB_LANES;
+        }
+        lWosAesGcmMbEncryptGroup(&pLanes[i], count);
+    }
+}
+
+#else /* WOS_CRYPTO_AES_GCM_MB_X86 */
+
+/* ========================================================================== */
+/*                                Function Definitions                        */
+/* ========================================================================== */
+
+bool wosCryptoAesGcmMbIsSupported(void)
+{
+    return false;
+}
+
+void wosCryptoAesGcmMbEncrypt(const WosCryptoAesGcmMbLane_t *pLanes,
+                              size_t numLanes)
+{
+    (void)pLanes;
+    (void)numLanes;
+}
+
+#endif /* WOS_CRYPTO_AES_GCM_MB_X86 */
+
+/* ========================================================================== */
+/*                                End of File                                 */
+/* ========================================================================== */
@@ -0,0 +1,89 @@
+/* Licensed to weeveMQ under one or more contributor license agreements.
+* See the LICENCE file distributed with this work for additional information
+* regarding copyright ownership. You may obtain a copy of the License at
+*
+*     https://github.com/weeveiot/weeveMQ/blob/master/LICENCE
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+/**
+ * @file wosCryptoAesGcmMb.h
+ * @brief Multi-buffer AES-256-GCM encryption, sealing several independent
+ * messages at once by interleaving their AES and GHASH computations.
+ * @version 0.1
+ * @date 2026-10-19
+ *
+ */
+
+#ifndef WOS_CRYPTO_AES_GCM_MB_H_
+#define WOS_CRYPTO_AES_GCM_MB_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ========================================================================== */
+/*                                Includes                                    */
+/* ========================================================================== */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ========================================================================== */
+/*                                Constants                                   */
+/* ========================================================================== */
+
+/* Messages encrypted side by side. */
+#define WOS_CRYPTO_AES_GCM_MB_LANES (4)
+
+/* ========================================================================== */
+/*                                Types                                       */
+/* ========================================================================== */
+
+/* One message of wosCryptoAesGcmMbEncrypt(). The key is 32 bytes, the iv 12
+ * bytes and the tag 16 bytes. The cipher text is as long as the plain text
+ * and may be the same memory. */
+typedef struct WosCryptoAesGcmMbLane {
+  const uint8_t *pKey;
+  const uint8_t *pIv;
+  const uint8_t *pAad;
+  size_t aadLength;
+  const uint8_t *pPlainText;
+  size_t length;
+  uint8_t *pCipherText;
+  uint8_t *pTag;
+} WosCryptoAesGcmMbLane_t;
+
+/* ========================================================================== */
+/*                                Global Variables                            */
+/* ========================================================================== */
+
+/* ========================================================================== */
+/*                                Function Declarations                       */
+/* ========================================================================== */
+
+/* Whether this CPU runs wosCryptoAesGcmMbEncrypt(). When it does not, the
+ * messages are to be encrypted one by one with the crypto library. */
+bool wosCryptoAesGcmMbIsSupported(void);
+
+/* Encrypt numLanes messages, WOS_CRYPTO_AES_GCM_MB_LANES at a time. The output
+ * is the one of AES-256-GCM with a 16 bytes tag. Only to be called when
+ * wosCryptoAesGcmMbIsSupported(). */
+void wosCryptoAesGcmMbEncrypt(const WosCryptoAesGcmMbLane_t *pLanes,
+                              size_t numLanes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WOS_CRYPTO_AES_GCM_MB_H_ */
+
+/* ========================================================================== */
+/*                                End of File                                 */
+/* ========================================================================== */
@@ -25,6 +25,7 @@
 
 #include "wosCommon.h"
 #include "wosCrypto.h"
+#include "wosCryptoAesGcmMb.h"
 #include "wosLog.h"
 #include "wosStorage.h"
 #include "wosString.h"
@@ -38,6 +39,10 @@
 
 #define LOG_TAG "CRYPTO_LIBTOM"
 
+/* Messages of wosCryptoAeEncryptMulti() handed to the multi-buffer kernel at
+ * once. */
+#define AE_MULTI_BATCH_SIZE (16)
+
 /* ========================================================================== */
 /*                                Types                                       */
 /* ========================================================================== */
@@ -88,6 +93,12 @@ static WosCryptoError_t lWosCryptoEccSign(WosBuffer_t *pHash,
                                           ecc_key *pTomEccKey,
                                           WosBuffer_t **ppSignature);
 
+/**
+ * @brief Auxiliary function allocating the outputs of a job of
+ * wosCryptoAeEncryptMulti(), and generating its iv when not supplied.
+ */
+static WosCryptoError_t lWosCryptoAeAllocateJob(WosCryptoAeJob_t *pJob);
+
 /* ========================================================================== */
 /*                                Local Function Definitions                  */
 /* ========================================================================== */
@@ -364,6 +375,71 @@ exit:
     return ret;
 }
 
+static WosCryptoError_t lWosCryptoAeAllocateJob(WosCryptoAeJob_t *pJob)
+{
+    WosCryptoError_t ret = WOS_CRYPTO_ERROR;
+    uint8_t ivSupplied = (pJob->pIv != NULL);
+    size_t length = (pJob->pPlainText != NULL) ? pJob->pPlainText->length : 0;
+
+    FUNCTION_ENTRY();
+    pJob->pCipherText = (WosBuffer_t *)wosMemAlloc(sizeof(WosBuffer_t));
+    pJob->pTag = (WosBuffer_t *)wosMemAlloc(sizeof(WosBuffer_t));
+    if (pJob->pCipherText == NULL || pJob->pTag == NULL) {
+        WLOGE("could not allocate: %lu", sizeof(WosBuffer_t));
+        ret = WOS_CRYPTO_ERROR_OUT_OF_MEMORY;
+        goto exitFree;
+    }
+    pJob->pCipherText->data = NULL;
+    pJob->pCipherText->length = length;
+    pJob->pTag->length = WOS_CRYPTO_AE_AES_BLOCK_LENGTH;
+    pJob->pTag->data = (uint8_t *)wosMemAlloc(WOS_CRYPTO_AE_AES_BLOCK_LENGTH);
+    if (length != 0) {
+        pJob->pCipherText->data = (uint8_t *)wosMemAlloc(length);
+    }
+    if (pJob->pTag->data == NULL ||
+        (length != 0 && pJob->pCipherText->data == NULL)) {
+        WLOGE("could not allocate data buffer: %lu", length);
+        ret = WOS_CRYPTO_ERROR_OUT_OF_MEMORY;
+        goto exitFree;
+    }
+
+    if (!ivSupplied) {
+        pJob->pIv = (WosBuffer_t *)wosMemAlloc(sizeof(WosBuffer_t));
+        if (pJob->pIv == NULL) {
+            WLOGE("could not allocate: %lu", sizeof(WosBuffer_t));
+            ret = WOS_CRYPTO_ERROR_OUT_OF_MEMORY;
+            goto exitFree;
+        }
+        pJob->pIv->length = WOS_CRYPTO_AE_AES_GCM_IV_LENGTH;
+        pJob->pIv->data =
+            (uint8_t *)wosMemAlloc(WOS_CRYPTO_AE_AES_GCM_IV_LENGTH);
+        if (pJob->pIv->data == NULL) {
+            WLOGE("could not allocate data buffer: %lu",
+                  WOS_CRYPTO_AE_AES_GCM_IV_LENGTH);
+            ret = WOS_CRYPTO_ERROR_OUT_OF_MEMORY;
+            goto exitFree;
+        }
+        ret = wosCryptoGetRandomBytes(pJob->pIv);
+        if (ret != WOS_CRYPTO_SUCCESS) {
+            WLOGE("wosCryptoGetRandomBytes error");
+            goto exitFree;
+        }
+    }
+
+    ret = WOS_CRYPTO_SUCCESS;
+    goto exit;
+
+exitFree:
+    WOS_FREE_BUF_AND_DATA(pJob->pCipherText);
+    WOS_FREE_BUF_AND_DATA(pJob->pTag);
+    if (!ivSupplied) {
+        WOS_FREE_BUF_AND_DATA(pJob->pIv);
+    }
+exit:
+    FUNCTION_EXIT_RETURN(ret);
+    return ret;
+}
+
 /* ========================================================================== */
 /*                                Implementation                              */
 /* ========================================================================== */
@@ -443,11 +519,64 @@ WosCryptoError_t wosCryptoEccGenerateKey(WosCryptoEccOptions_t *pOptions,
                                          void *pStorageContext,
                                          WosString_t privateKeyStorageId,
                                          WosString_t publicKeyStorageId)
+{
+    WosCryptoError_t ret = WOS_CRYPTO_ERROR;
+    uint8_t privateKeyData[WOS_CRYPTO_ECC_NIST_P256_KEY_LENGTH];
+    uint8_t publicKeyData[WOS_CRYPTO_ECC_NIST_P256_PUBLIC_KEY_LENGTH];
+    WosBuffer_t privateKey = {.data = privateKeyData,
+                              .length = sizeof(privateKeyData)};
+    WosBuffer_t publicKey = {.data = publicKeyData,
+                             .length = sizeof(publicKeyData)};
+
+    /* Storage */
+    WosStorageError_t storageError = WOS_STORAGE_ERROR;
+
+    FUNCTION_ENTRY();
+    if (!WOS_IS_VALID_STRING(privateKeyStorageId) ||
+        !WOS_IS_VALID_STRING(publicKeyStorageId)) {
+        WLOGE("bad params");
+        ret = WOS_CRYPTO_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+
+    ret = wosCryptoEccGenerateKeyBuffer(pOptions, &privateKey, &publicKey);
+    if (ret != WOS_CRYPTO_SUCCESS) {
+        WLOGE("wosCryptoEccGenerateKeyBuffer error");
+        goto exitWipeKeys;
+    }
+
+    /* Save both private and public keys to Storage */
+    storageError =
+        wosStorageWrite(pStorageContext, privateKeyStorageId, &privateKey);
+    if (storageError != WOS_STORAGE_SUCCESS) {
+        WLOGE("storage error writing private key");
+        ret = WOS_CRYPTO_ERROR_STORAGE;
+        goto exitWipeKeys;
+    }
+    storageError =
+        wosStorageWrite(pStorageContext, publicKeyStorageId, &publicKey);
+    if (storageError != WOS_STORAGE_SUCCESS) {
+        WLOGE("storage error writing public key");
+        ret = WOS_CRYPTO_ERROR_STORAGE;
+        goto exitWipeKeys;
+    }
+
+    ret = WOS_CRYPTO_SUCCESS;
+
+exitWipeKeys:
+    wosMemSet(privateKeyData, 0, sizeof(privateKeyData));
+    wosMemSet(publicKeyData, 0, sizeof(publicKeyData));
+exit:
+    FUNCTION_EXIT_RETURN(ret);
+    return ret;
+}
+
+WosCryptoError_t wosCryptoEccGenerateKeyBuffer(WosCryptoEccOptions_t *pOptions,
+                                               WosBuffer_t *pPrivateKey,
+                                               WosBuffer_t *pPublicKey)
 {
     /* TODO Start using WosCryptoEccOptions_t: SECP256R1, fortuna_prng, etc */
-    // TODO This thing is long, convoluted, etc. Split into parts urgently.
     WosCryptoError_t ret = WOS_CRYPTO_ERROR;
-    WosBuffer_t *pPrivateKey = NULL, *pPublicKey = NULL;
 
     /* Libtomcrypt */
     int tomError = CRYPT_ERROR;
@@ -455,12 +584,9 @@ WosCryptoError_t wosCryptoEccGenerateKey(WosCryptoEccOptions_t *pOptions,
     ecc_key tomEccKeyPair;
     uint64_t length_aux = 0;
 
-    /* Storage */
-    WosStorageError_t storageError = WOS_STORAGE_ERROR;
-
     FUNCTION_ENTRY();
-    if (!WOS_IS_VALID_STRING(privateKeyStorageId) ||
-        !WOS_IS_VALID_STRING(publicKeyStorageId)) {
+    if (!WOS_IS_VALID_BUFFER(pPrivateKey) || !WOS_IS_VALID_BUFFER(pPublicKey) ||
+        pPublicKey->length < WOS_CRYPTO_ECC_NIST_P256_PUBLIC_KEY_LENGTH) {
         WLOGE("bad params");
         ret = WOS_CRYPTO_ERROR_BAD_PARAMS;
         goto exit;
@@ -477,94 +603,35 @@ WosCryptoError_t wosCryptoEccGenerateKey(WosCryptoEccOptions_t *pOptions,
     if (tomError != CRYPT_OK) {
         WLOGE("ecc_make_key: %d, %s", tomError, error_to_string(tomError));
         ret = WOS_CRYPTO_ERROR;
-        goto exitFreeKeyTom;
+        goto exit;
     }
 
     /* Private Part */
-    pPrivateKey = (WosBuffer_t *)wosMemAlloc(sizeof(WosBuffer_t));
-    if (pPrivateKey == NULL) {
-        WLOGE("could not allocate: %lu", sizeof(WosBuffer_t));
-        ret = WOS_CRYPTO_ERROR_OUT_OF_MEMORY;
-        goto exitFreeKeyTom;
-    }
-    pPrivateKey->data = NULL;
-    pPrivateKey->length = 0;
-    pPrivateKey->data =
-        (uint8_t *)wosMemAlloc(WOS_CRYPTO_ECC_NIST_P256_KEY_LENGTH);
-    if (pPrivateKey->data == NULL) {
-        WLOGE("could not allocate data buffer: %lu",
-              WOS_CRYPTO_ECC_NIST_P256_KEY_LENGTH);
-        ret = WOS_CRYPTO_ERROR_OUT_OF_MEMORY;
-        goto exitFreeKeyPrivate;
-    }
-    pPrivateKey->length = WOS_CRYPTO_ECC_NIST_P256_KEY_LENGTH;
     length_aux = pPrivateKey->length;
     tomError =
         ecc_export(pPrivateKey->data, &length_aux, PK_PRIVATE, &tomEccKeyPair);
-    pPrivateKey->length = length_aux; /* uint64_t to uint32_t */
     if ((tomError != CRYPT_OK)) {
         WLOGE("ecc_export: %d, %s", tomError, error_to_string(tomError));
         ret = WOS_CRYPTO_ERROR;
-        goto exitFreeKeyPrivateData;
+        goto exitFreeKeyTom;
     }
+    pPrivateKey->length = length_aux; /* uint64_t to uint32_t */
 
     /* Public Part */
-    pPublicKey = (WosBuffer_t *)wosMemAlloc(sizeof(WosBuffer_t));
-    if (pPublicKey == NULL) {
-        WLOGE("could not allocate: %lu", sizeof(WosBuffer_t));
-        ret = WOS_CRYPTO_ERROR_OUT_OF_MEMORY;
-        goto exitFreeKeyPrivateData;
-    }
-    pPublicKey->data = NULL;
-    pPublicKey->length = 0;
-    pPublicKey->data =
-        (uint8_t *)wosMemAlloc(WOS_CRYPTO_ECC_NIST_P256_KEY_LENGTH);
-    if (pPublicKey->data == NULL) {
-        WLOGE("could not allocate data buffer: %lu",
-              WOS_CRYPTO_ECC_NIST_P256_KEY_LENGTH);
-        ret = WOS_CRYPTO_ERROR_OUT_OF_MEMORY;
-        goto exitFreeKeyPublic;
-    }
-    pPublicKey->length = WOS_CRYPTO_ECC_NIST_P256_KEY_LENGTH;
     length_aux = pPublicKey->length;
     tomError =
         ecc_ansi_x963_export(&tomEccKeyPair, pPublicKey->data, &length_aux);
-    pPublicKey->length = length_aux; /* uint64_t to uint32_t */
     if ((tomError != CRYPT_OK)) {
         WLOGE("ecc_ansi_x963_export: %d, %s", tomError,
               error_to_string(tomError));
+        wosMemSet(pPrivateKey->data, 0, pPrivateKey->length);
         ret = WOS_CRYPTO_ERROR;
-        goto exitFreeKeyPublicData;
-    }
-
-    /* Save both private and public keys to Storage */
-    storageError =
-        wosStorageWrite(pStorageContext, privateKeyStorageId, pPrivateKey);
-    if (storageError != WOS_STORAGE_SUCCESS) {
-        WLOGE("storage error writing private key");
-        ret = WOS_CRYPTO_ERROR_STORAGE;
-        goto exitFreeKeyPublicData;
-    }
-    storageError =
-        wosStorageWrite(pStorageContext, publicKeyStorageId, pPublicKey);
-    if (storageError != WOS_STORAGE_SUCCESS) {
-        WLOGE("storage error writing public key");
-        ret = WOS_CRYPTO_ERROR_STORAGE;
-        goto exitFreeKeyPublicData;
+        goto exitFreeKeyTom;
     }
+    pPublicKey->length = length_aux; /* uint64_t to uint32_t */
 
     ret = WOS_CRYPTO_SUCCESS;
 
-exitFreeKeyPublicData:
-    wosMemSet(pPublicKey->data, 0, pPublicKey->length);
-    wosMemFree(pPublicKey->data);
-exitFreeKeyPublic:
-    wosMemFree(pPublicKey);
-exitFreeKeyPrivateData:
-    wosMemSet(pPrivateKey->data, 0, pPrivateKey->length);
-    wosMemFree(pPrivateKey->data);
-exitFreeKeyPrivate:
-    wosMemFree(pPrivateKey);
 exitFreeKeyTom:
     ecc_free(&tomEccKeyPair);
 exit:
@@ -758,9 +825,55 @@ WosCryptoError_t wosCryptoAeEncrypt(WosCryptoAeOptions_t *pOptions,
                                     WosBuffer_t **ppCipherText,
                                     WosBuffer_t **ppTag)
 {
-    // TODO Start using WosCryptoAeOptions_t to produce different results.
     WosCryptoError_t ret = WOS_CRYPTO_ERROR;
     WosBuffer_t *pSecretKey = NULL;
+
+    /* Storage */
+    WosStorageError_t storageError = WOS_STORAGE_ERROR;
+
+    FUNCTION_ENTRY();
+    if (!WOS_IS_VALID_STRING(symKeyStorageId)) {
+        WLOGE("bad params");
+        ret = WOS_CRYPTO_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+
+    /* Read Key */
+    storageError =
+        wosStorageRead(pStorageContext, symKeyStorageId, &pSecretKey);
+    if (storageError != WOS_STORAGE_SUCCESS) {
+        WLOGE("storage error reading secret key: %d", storageError);
+        ret = WOS_CRYPTO_ERROR_STORAGE;
+        goto exit;
+    }
+    if (pSecretKey->length != WOS_CRYPTO_AE_AES256_KEY_LENGTH) {
+        WLOGE("secret key has wrong length");
+        ret = WOS_CRYPTO_ERROR_STORAGE;
+        goto exitFreeKeySecret;
+    }
+
+    ret = wosCryptoAeEncryptKeyBuffer(pOptions, pSecretKey, pPlainText, pAad,
+                                      ppIv, ppCipherText, ppTag);
+
+exitFreeKeySecret:
+    wosMemSet(pSecretKey->data, 0, pSecretKey->length);
+    wosMemFree(pSecretKey->data);
+    wosMemFree(pSecretKey);
+exit:
+    FUNCTION_EXIT_RETURN(ret);
+    return ret;
+}
+
+WosCryptoError_t wosCryptoAeEncryptKeyBuffer(WosCryptoAeOptions_t *pOptions,
+                                             WosBuffer_t *pKeyBuf,
+                                             WosBuffer_t *pPlainText,
+                                             WosBuffer_t *pAad,
+                                             WosBuffer_t **ppIv,
+                                             WosBuffer_t **ppCipherText,
+                                             WosBuffer_t **ppTag)
+{
+    // TODO Start using WosCryptoAeOptions_t to produce different results.
+    WosCryptoError_t ret = WOS_CRYPTO_ERROR;
     uint8_t ivSupplied = 0;
     WosBuffer_t emptyBuffer = {.data = NULL, .length = 0};
 
@@ -770,11 +883,9 @@ WosCryptoError_t wosCryptoAeEncrypt(WosCryptoAeOptions_t *pOptions,
     int cipherId = -1;
     uint64_t length_aux = 0;
 
-    /* Storage */
-    WosStorageError_t storageError = WOS_STORAGE_ERROR;
-
     FUNCTION_ENTRY();
-    if (!WOS_IS_VALID_STRING(symKeyStorageId)) {
+    if (!WOS_IS_VALID_BUFFER(pKeyBuf) ||
+        pKeyBuf->length != WOS_CRYPTO_AE_AES256_KEY_LENGTH) {
         WLOGE("bad params");
         ret = WOS_CRYPTO_ERROR_BAD_PARAMS;
         goto exit;
@@ -792,26 +903,12 @@ WosCryptoError_t wosCryptoAeEncrypt(WosCryptoAeOptions_t *pOptions,
         goto exit;
     }
 
-    /* Read Key */
-    storageError =
-        wosStorageRead(pStorageContext, symKeyStorageId, &pSecretKey);
-    if (storageError != WOS_STORAGE_SUCCESS) {
-        WLOGE("storage error reading secret key: %d", storageError);
-        ret = WOS_CRYPTO_ERROR_STORAGE;
-        goto exit;
-    }
-    if (pSecretKey->length != WOS_CRYPTO_AE_AES256_KEY_LENGTH) {
-        WLOGE("secret key has wrong length");
-        ret = WOS_CRYPTO_ERROR_STORAGE;
-        goto exitFreeKeySecret;
-    }
-
     /* Allocate memory space && Generate IV */
     (*ppCipherText) = (WosBuffer_t *)wosMemAlloc(sizeof(WosBuffer_t));
     if ((*ppCipherText) == NULL) {
         WLOGE("could not allocate: %lu", sizeof(WosBuffer_t));
         ret = WOS_CRYPTO_ERROR_OUT_OF_MEMORY;
-        goto exitFreeKeySecret;
+        goto exit;
     }
     (*ppCipherText)->data = NULL;
     (*ppCipherText)->length = 0;
@@ -880,7 +977,7 @@ WosCryptoError_t wosCryptoAeEncrypt(WosCryptoAeOptions_t *pOptions,
     }
     length_aux = (*ppTag)->length;
     tomError = gcm_memory(cipherId,                             /* cipher */
-                          pSecretKey->data, pSecretKey->length, /* key */
+                          pKeyBuf->data, pKeyBuf->length,       /* key */
                           (*ppIv)->data, (*ppIv)->length,       /* iv */
                           pAad->data, pAad->length, /* additional data */
                           pPlainText->data, pPlainText->length, /* plain text */
@@ -895,7 +992,7 @@ WosCryptoError_t wosCryptoAeEncrypt(WosCryptoAeOptions_t *pOptions,
     }
 
     ret = WOS_CRYPTO_SUCCESS;
-    goto exitFreeKeySecret; /* skip freeing the good work we just did. */
+    goto exit; /* skip freeing the good work we just did. */
 
 exitFreeTagData:
     wosMemFree((*ppTag)->data);
@@ -915,10 +1012,87 @@ exitFreeCipherData:
     }
 exitFreeCipher:
     wosMemFree(*ppCipherText);
-exitFreeKeySecret:
-    wosMemSet(pSecretKey->data, 0, pSecretKey->length);
-    wosMemFree(pSecretKey->data);
-    wosMemFree(pSecretKey);
+exit:
+    FUNCTION_EXIT_RETURN(ret);
+    return ret;
+}
+
+WosCryptoError_t wosCryptoAeEncryptMulti(WosCryptoAeOptions_t *pOptions,
+                                         WosCryptoAeJob_t *pJobs,
+                                         size_t numJobs)
+{
+    WosCryptoError_t ret = WOS_CRYPTO_SUCCESS;
+    WosCryptoAesGcmMbLane_t lanes[AE_MULTI_BATCH_SIZE];
+    size_t numLanes = 0;
+    bool useKernel = wosCryptoAesGcmMbIsSupported();
+    WosCryptoAeJob_t *pJob = NULL;
+    uint8_t ivSupplied = 0;
+    size_t i;
+
+    FUNCTION_ENTRY();
+    if (pJobs == NULL && numJobs != 0) {
+        WLOGE("bad params");
+        ret = WOS_CRYPTO_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+
+    for (i = 0; i < numJobs; i++) {
+        pJob = &pJobs[i];
+        pJob->pCipherText = NULL;
+        pJob->pTag = NULL;
+        ivSupplied = (pJob->pIv != NULL);
+        if (!WOS_IS_VALID_BUFFER(pJob->pKeyBuf) ||
+            pJob->pKeyBuf->length != WOS_CRYPTO_AE_AES256_KEY_LENGTH ||
+            (pJob->pAad != NULL && pJob->pAad->length != 0 &&
+             pJob->pAad->data == NULL) ||
+            (pJob->pPlainText != NULL && pJob->pPlainText->length != 0 &&
+             pJob->pPlainText->data == NULL) ||
+            (ivSupplied && !WOS_IS_VALID_BUFFER(pJob->pIv))) {
+            WLOGE("bad params");
+            pJob->result = WOS_CRYPTO_ERROR_BAD_PARAMS;
+        } else if (!useKernel ||
+                   (ivSupplied &&
+                    pJob->pIv->length != WOS_CRYPTO_AE_AES_GCM_IV_LENGTH)) {
+            /* Encrypted by itself, with the crypto library. */
+            pJob->result = wosCryptoAeEncryptKeyBuffer(
+                pOptions, pJob->pKeyBuf, pJob->pPlainText, pJob->pAad,
+                &pJob->pIv, &pJob->pCipherText, &pJob->pTag);
+            if (pJob->result != WOS_CRYPTO_SUCCESS) {
+                pJob->pCipherText = NULL;
+                pJob->pTag = NULL;
+                if (!ivSupplied) {
+                    pJob->pIv = NULL;
+                }
+            }
+        } else {
+            pJob->result = lWosCryptoAeAllocateJob(pJob);
+            if (pJob->result == WOS_CRYPTO_SUCCESS) {
+                lanes[numLanes].pKey = pJob->pKeyBuf->data;
+                lanes[numLanes].pIv = pJob->pIv->data;
+                lanes[numLanes].pAad =
+                    (pJob->pAad != NULL) ? pJob->pAad->data : NULL;
+                lanes[numLanes].aadLength =
+                    (pJob->pAad != NULL) ? pJob->pAad->length : 0;
+                lanes[numLanes].pPlainText =
+                    (pJob->pPlainText != NULL) ? pJob->pPlainText->data : NULL;
+                lanes[numLanes].length = pJob->pCipherText->length;
+                lanes[numLanes].pCipherText = pJob->pCipherText->data;
+                lanes[numLanes].pTag = pJob->pTag->data;
+                numLanes++;
+            }
+        }
+        if (pJob->result != WOS_CRYPTO_SUCCESS && ret == WOS_CRYPTO_SUCCESS) {
+            ret = pJob->result;
+        }
+
+        if (numLanes == AE_MULTI_BATCH_SIZE ||
+            (numLanes != 0 && i + 1 == numJobs)) {
+            wosCryptoAesGcmMbEncrypt(lanes, numLanes);
+            numLanes = 0;
+        }
+    }
+    wosMemSet(lanes, 0, sizeof(lanes));
+
 exit:
     FUNCTION_EXIT_RETURN(ret);
     return ret;
@@ -933,9 +1107,56 @@ WosCryptoError_t wosCryptoAeDecrypt(WosCryptoAeOptions_t *pOptions,
                                     WosBuffer_t *pTag,
                                     WosBuffer_t **ppPlainText)
 {
-    /* TODO Start using WosCryptoAeOptions_t: key_length, etc */
     WosCryptoError_t ret = WOS_CRYPTO_ERROR;
     WosBuffer_t *pSecretKey = NULL;
+
+    /* Storage */
+    WosStorageError_t storageError = WOS_STORAGE_ERROR;
+
+    FUNCTION_ENTRY();
+    if (!WOS_IS_VALID_STRING(symKeyStorageId) || !WOS_IS_VALID_BUFFER(pIv) ||
+        !WOS_IS_VALID_BUFFER(pTag)) {
+        WLOGE("bad params");
+        ret = WOS_CRYPTO_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+
+    /* Read Key */
+    storageError =
+        wosStorageRead(pStorageContext, symKeyStorageId, &pSecretKey);
+    if (storageError != WOS_STORAGE_SUCCESS) {
+        WLOGE("storage error reading secret key: %d", storageError);
+        ret = WOS_CRYPTO_ERROR_STORAGE;
+        goto exit;
+    }
+    if (pSecretKey->length != WOS_CRYPTO_AE_AES256_KEY_LENGTH) {
+        WLOGE("secret key has wrong length");
+        ret = WOS_CRYPTO_ERROR_STORAGE;
+        goto exitFreeKeySecret;
+    }
+
+    ret = wosCryptoAeDecryptKeyBuffer(pOptions, pSecretKey, pCipherText, pAad,
+                                      pIv, pTag, ppPlainText);
+
+exitFreeKeySecret:
+    wosMemSet(pSecretKey->data, 0, pSecretKey->length);
+    wosMemFree(pSecretKey->data);
+    wosMemFree(pSecretKey);
+exit:
+    FUNCTION_EXIT_RETURN(ret);
+    return ret;
+}
+
+WosCryptoError_t wosCryptoAeDecryptKeyBuffer(WosCryptoAeOptions_t *pOptions,
+                                             WosBuffer_t *pKeyBuf,
+                                             WosBuffer_t *pCipherText,
+                                             WosBuffer_t *pAad,
+                                             WosBuffer_t *pIv,
+                                             WosBuffer_t *pTag,
+                                             WosBuffer_t **ppPlainText)
+{
+    /* TODO Start using WosCryptoAeOptions_t: key_length, etc */
+    WosCryptoError_t ret = WOS_CRYPTO_ERROR;
     WosBuffer_t emptyBuffer = {.data = NULL, .length = 0};
 
     /* Libtomcrypt */
@@ -949,12 +1170,10 @@ WosCryptoError_t wosCryptoAeDecrypt(WosCryptoAeOptions_t *pOptions,
                           .length = WOS_CRYPTO_AE_AES_BLOCK_LENGTH};
     uint8_t compareTags = 1;
 
-    /* Storage */
-    WosStorageError_t storageError = WOS_STORAGE_ERROR;
-
     FUNCTION_ENTRY();
-    if (!WOS_IS_VALID_STRING(symKeyStorageId) || !WOS_IS_VALID_BUFFER(pIv) ||
-        !WOS_IS_VALID_BUFFER(pTag)) {
+    if (!WOS_IS_VALID_BUFFER(pKeyBuf) ||
+        pKeyBuf->length != WOS_CRYPTO_AE_AES256_KEY_LENGTH ||
+        !WOS_IS_VALID_BUFFER(pIv) || !WOS_IS_VALID_BUFFER(pTag)) {
         WLOGE("bad params");
         ret = WOS_CRYPTO_ERROR_BAD_PARAMS;
         goto exit;
@@ -972,26 +1191,12 @@ WosCryptoError_t wosCryptoAeDecrypt(WosCryptoAeOptions_t *pOptions,
         goto exit;
     }
 
-    /* Read Key */
-    storageError =
-        wosStorageRead(pStorageContext, symKeyStorageId, &pSecretKey);
-    if (storageError != WOS_STORAGE_SUCCESS) {
-        WLOGE("storage error reading secret key: %d", storageError);
-        ret = WOS_CRYPTO_ERROR_STORAGE;
-        goto exit;
-    }
-    if (pSecretKey->length != WOS_CRYPTO_AE_AES256_KEY_LENGTH) {
-        WLOGE("secret key has wrong length");
-        ret = WOS_CRYPTO_ERROR_STORAGE;
-        goto exitFreeKeySecret;
-    }
-
     /* Allocate Plain Text */
     (*ppPlainText) = (WosBuffer_t *)wosMemAlloc(sizeof(WosBuffer_t));
     if ((*ppPlainText) == NULL) {
         WLOGE("could not allocate: %lu", sizeof(WosBuffer_t));
         ret = WOS_CRYPTO_ERROR_OUT_OF_MEMORY;
-        goto exitFreeKeySecret;
+        goto exit;
     }
     (*ppPlainText)->data = NULL;
     (*ppPlainText)->length = 0;
@@ -1014,7 +1219,7 @@ WosCryptoError_t wosCryptoAeDecrypt(WosCryptoAeOptions_t *pOptions,
     }
     length_aux = tagAux.length;
     tomError = gcm_memory(cipherId,                             /* cipher */
-                          pSecretKey->data, pSecretKey->length, /* key */
+                          pKeyBuf->data, pKeyBuf->length,       /* key */
                           pIv->data, pIv->length,               /* iv */
                           pAad->data, pAad->length, /* additional data */
                           (*ppPlainText)->data,
@@ -1037,7 +1242,7 @@ WosCryptoError_t wosCryptoAeDecrypt(WosCryptoAeOptions_t *pOptions,
         if (compareTags == 0) {
             /* skip freeing the good work we just did. */
             ret = WOS_CRYPTO_SUCCESS;
-            goto exitFreeKeySecret;
+            goto exit;
         }
     }
     /* Error */
@@ -1050,10 +1255,6 @@ exitFreePlainData:
     }
 exitFreePlain:
     wosMemFree(*ppPlainText);
-exitFreeKeySecret:
-    wosMemSet(pSecretKey->data, 0, pSecretKey->length);
-    wosMemFree(pSecretKey->data);
-    wosMemFree(pSecretKey);
 exit:
     FUNCTION_EXIT_RETURN(ret);
     return ret;
@@ -1065,14 +1266,11 @@ WosCryptoError_t wosCryptoDeriveSymKey(WosCryptoEccOptions_t *pOptions,
                                        WosString_t privateKeyStorageId,
                                        WosString_t symmetricKeyStorageId)
 {
-    // TODO This thing is long, convoluted, etc. Split into parts urgently.
     WosCryptoError_t ret = WOS_CRYPTO_ERROR;
-    WosBuffer_t *pPrivateKey = NULL, *pSharedSecret = NULL;
-
-    /* Libtomcrypt */
-    int tomError = CRYPT_ERROR;
-    ecc_key tomOtherPublicKey, tomDevicePrivateKey;
-    uint64_t length_aux = 0;
+    WosBuffer_t *pPrivateKey = NULL;
+    uint8_t sharedSecretData[WOS_CRYPTO_ECC_NIST_P256_SHARED_SECRET_LENGTH];
+    WosBuffer_t sharedSecret = {.data = sharedSecretData,
+                                .length = sizeof(sharedSecretData)};
 
     /* Storage */
     WosStorageError_t storageError = WOS_STORAGE_ERROR;
@@ -1095,13 +1293,61 @@ WosCryptoError_t wosCryptoDeriveSymKey(WosCryptoEccOptions_t *pOptions,
         goto exit;
     }
 
+    ret = wosCryptoDeriveSymKeyBuffer(pOptions, pPublicKey, pPrivateKey,
+                                      &sharedSecret);
+    if (ret != WOS_CRYPTO_SUCCESS) {
+        WLOGE("wosCryptoDeriveSymKeyBuffer error");
+        goto exitFreeKeyPrivate;
+    }
+
+    /* Save to storage */
+    storageError =
+        wosStorageWrite(pStorageContext, symmetricKeyStorageId, &sharedSecret);
+    if (storageError != WOS_STORAGE_SUCCESS) {
+        WLOGE("storage error writing shared secret");
+        ret = WOS_CRYPTO_ERROR_STORAGE;
+        goto exitFreeKeyPrivate;
+    }
+
+    ret = WOS_CRYPTO_SUCCESS;
+
+exitFreeKeyPrivate:
+    wosMemSet(sharedSecretData, 0, sizeof(sharedSecretData));
+    wosMemSet(pPrivateKey->data, 0, pPrivateKey->length);
+    WOS_FREE_BUF_AND_DATA(pPrivateKey);
+exit:
+    FUNCTION_EXIT_RETURN(ret);
+    return ret;
+}
+
+WosCryptoError_t wosCryptoDeriveSymKeyBuffer(WosCryptoEccOptions_t *pOptions,
+                                             WosBuffer_t *pPublicKey,
+                                             WosBuffer_t *pPrivateKey,
+                                             WosBuffer_t *pSymmetricKey)
+{
+    WosCryptoError_t ret = WOS_CRYPTO_ERROR;
+
+    /* Libtomcrypt */
+    int tomError = CRYPT_ERROR;
+    ecc_key tomOtherPublicKey, tomDevicePrivateKey;
+    uint64_t length_aux = 0;
+
+    FUNCTION_ENTRY();
+    if (!WOS_IS_VALID_BUFFER(pPublicKey) || !WOS_IS_VALID_BUFFER(pPrivateKey) ||
+        !WOS_IS_VALID_BUFFER(pSymmetricKey) ||
+        pSymmetricKey->length < WOS_CRYPTO_ECC_NIST_P256_SHARED_SECRET_LENGTH) {
+        WLOGE("bad params");
+        ret = WOS_CRYPTO_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+
     /* Convert the device's private key to libtomcrypt object */
     tomError = ecc_import(pPrivateKey->data, pPrivateKey->length,
                           &tomDevicePrivateKey);
     if ((tomError != CRYPT_OK)) {
         WLOGE("ecc_import: %d, %s", tomError, error_to_string(tomError));
         ret = WOS_CRYPTO_ERROR;
-        goto exitFreeKeyPrivate;
+        goto exit;
     }
 
     /* NOTE: Convert the other party's public key to libtomcrypt object. The
@@ -1118,57 +1364,73 @@ WosCryptoError_t wosCryptoDeriveSymKey(WosCryptoEccOptions_t *pOptions,
     }
 
     /* Derive shared secret */
-    pSharedSecret = (WosBuffer_t *)wosMemAlloc(sizeof(WosBuffer_t));
-    if (pSharedSecret == NULL) {
-        WLOGE("could not allocate: %lu", sizeof(WosBuffer_t));
-        ret = WOS_CRYPTO_ERROR_OUT_OF_MEMORY;
-        goto exitFreeKeyTomPublic;
-    }
-    pSharedSecret->data = NULL;
-    pSharedSecret->length = 0;
-    pSharedSecret->data =
-        (uint8_t *)wosMemAlloc(WOS_CRYPTO_ECC_NIST_P256_SHARED_SECRET_LENGTH);
-    if (pSharedSecret->data == NULL) {
-        WLOGE("could not allocate data buffer: %lu",
-              WOS_CRYPTO_ECC_NIST_P256_SHARED_SECRET_LENGTH);
-        ret = WOS_CRYPTO_ERROR_OUT_OF_MEMORY;
-        goto exitFreeShared;
-    }
-    pSharedSecret->length = WOS_CRYPTO_ECC_NIST_P256_SHARED_SECRET_LENGTH;
-
-    length_aux = pSharedSecret->length;
+    length_aux = pSymmetricKey->length;
     tomError = ecc_shared_secret(&tomDevicePrivateKey, &tomOtherPublicKey,
-                                 pSharedSecret->data, &length_aux);
-    pSharedSecret->length = length_aux;
+                                 pSymmetricKey->data, &length_aux);
     if ((tomError != CRYPT_OK)) {
         WLOGE("ecc_shared_secret: %d, %s", tomError, error_to_string(tomError));
         ret = WOS_CRYPTO_ERROR;
-        goto exitFreeSharedData;
-    }
-
-    /* Save to storage */
-    storageError =
-        wosStorageWrite(pStorageContext, symmetricKeyStorageId, pSharedSecret);
-    if (storageError != WOS_STORAGE_SUCCESS) {
-        WLOGE("storage error writing shared secret");
-        ret = WOS_CRYPTO_ERROR_STORAGE;
-        goto exitFreeSharedData;
+        goto exitFreeKeyTomPublic;
     }
+    pSymmetricKey->length = length_aux;
 
     ret = WOS_CRYPTO_SUCCESS;
 
-exitFreeSharedData:
-    wosMemSet(pSharedSecret->data, 0, pSharedSecret->length);
-    wosMemFree(pSharedSecret->data);
-exitFreeShared:
-    wosMemFree(pSharedSecret);
 exitFreeKeyTomPublic:
     ecc_free(&tomOtherPublicKey);
 exitFreeKeyTomPrivate:
     ecc_free(&tomDevicePrivateKey);
-exitFreeKeyPrivate:
-    wosMemSet(pPrivateKey->data, 0, pPrivateKey->length);
-    WOS_FREE_BUF_AND_DATA(pPrivateKey);
+exit:
+    FUNCTION_EXIT_RETURN(ret);
+    return ret;
+}
+
+WosCryptoError_t wosCryptoHkdf(WosBuffer_t *pSalt,
+                               WosBuffer_t *pInputKey,
+                               WosBuffer_t *pInfo,
+                               WosBuffer_t *pOutputKey)
+{
+    WosCryptoError_t ret = WOS_CRYPTO_ERROR;
+    int tomError = CRYPT_ERROR;
+    int hashId = -1;
+    const unsigned char *pSaltData = (const unsigned char *)"";
+    unsigned long saltLength = 0;
+    const unsigned char *pInfoData = (const unsigned char *)"";
+    unsigned long infoLength = 0;
+
+    FUNCTION_ENTRY();
+    if (!WOS_IS_VALID_BUFFER(pInputKey) || !WOS_IS_VALID_BUFFER(pOutputKey) ||
+        (pOutputKey->length > 255 * WOS_CRYPTO_HASH_SHA256_LENGTH)) {
+        WLOGE("bad params");
+        ret = WOS_CRYPTO_ERROR_BAD_PARAMS;
+        goto exit;
+    }
+    if (WOS_IS_VALID_BUFFER(pSalt)) {
+        pSaltData = pSalt->data;
+        saltLength = pSalt->length;
+    }
+    if (WOS_IS_VALID_BUFFER(pInfo)) {
+        pInfoData = pInfo->data;
+        infoLength = pInfo->length;
+    }
+
+    hashId = find_hash("sha256");
+    if (hashId < 0) {
+        WLOGE("find_hash error");
+        ret = WOS_CRYPTO_ERROR;
+        goto exit;
+    }
+    tomError = hkdf(hashId, pSaltData, saltLength, pInfoData, infoLength,
+                    pInputKey->data, pInputKey->length, pOutputKey->data,
+                    pOutputKey->length);
+    if (tomError != CRYPT_OK) {
+        WLOGE("hkdf: %d, %s", tomError, error_to_string(tomError));
+        ret = WOS_CRYPTO_ERROR;
+        goto exit;
+    }
+
+    ret = WOS_CRYPTO_SUCCESS;
+
 exit:
     FUNCTION_EXIT_RETURN(ret);
     return ret;
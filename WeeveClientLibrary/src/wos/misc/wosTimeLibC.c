@@ -0,0 +1,62 @@
+/* Licensed to weeveMQ under one or more contributor license agreements.
+* See the LICENCE file distributed with this work for additional information
+* regarding copyright ownership. You may obtain a copy of the License at
+*
+*     https://github.com/weeveiot/weeveMQ/blob/master/LICENCE
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+/**
+ * @brief Implementation of Time Functions using Lib C
+ *
+ * @file wosTimeLibC.c
+ * @date 2026-10-19
+ * 
+ */
+
+/* ========================================================================== */
+/*                                Includes                                    */
+/* ========================================================================== */
+
+#include "wosTime.h"
+#include <time.h>
+
+/* ========================================================================== */
+/*                                Constants                                   */
+/* ========================================================================== */
+
+/* ========================================================================== */
+/*                                Types                                       */
+/* ========================================================================== */
+
+/* ========================================================================== */
+/*                                Global Variables                            */
+/* ========================================================================== */
+
+/* ========================================================================== */
+/*                                Local Function Declarations                 */
+/* ========================================================================== */
+
+/* ========================================================================== */
+/*                                Local Function Definitions                  */
+/* ========================================================================== */
+
+/* ========================================================================== */
+/*                                Implementation                              */
+/* ========================================================================== */
+
+uint64_t wosTimeGetSeconds(void)
+{
+    time_t now = time(NULL);
+
+    return (now < 0) ? 0 : (uint64_t)now;
+}
+
+/* ========================================================================== */
+/*                                End of File                                 */
+/* ========================================================================== */
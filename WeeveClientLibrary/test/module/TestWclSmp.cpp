@@ -1,6 +1,16 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include "gtest/gtest.h"
 
 #include "wclCommon.h"
+#include "wclConfig.h"
 #include "wclSmp.h"
 #include "wosMemory.h"
 
@@ -24,6 +34,177 @@ class TestSmp : public testing::Test
     virtual void TearDown() { wclTerminate(); }
 };
 
+/* Exchange the CONNECT and CONNACK of a client and a broker session. */
+static WclError_t lConnect(WclSession_t clientSession,
+                           WclSession_t brokerSession)
+{
+    WclError_t smpResult = WCL_ERROR;
+    WosBuffer_t mqttPacket = {.data = (uint8_t *)MQTT_MESSAGE,
+                              .length = (uint32_t)strlen(MQTT_MESSAGE)};
+    WosBuffer_t smpMessage = {.data = NULL, .length = 0};
+    WosBuffer_t clearPacket = {.data = NULL, .length = 0};
+
+    smpResult = wclSmpGetMessage(clientSession, WCL_SMP_MESSAGE_MQTTS_CONNECT,
+                                 &mqttPacket, &smpMessage);
+    if (WCL_SUCCESS == smpResult) {
+        smpResult =
+            wclSmpProcessMessage(brokerSession, &smpMessage, &clearPacket);
+    }
+    wclFreeBuffer(&smpMessage);
+    wclFreeBuffer(&clearPacket);
+    if (WCL_SUCCESS == smpResult) {
+        smpResult =
+            wclSmpGetMessage(brokerSession, WCL_SMP_MESSAGE_MQTTS_CONNACK,
+                             &mqttPacket, &smpMessage);
+    }
+    if (WCL_SUCCESS == smpResult) {
+        smpResult =
+            wclSmpProcessMessage(clientSession, &smpMessage, &clearPacket);
+    }
+    wclFreeBuffer(&smpMessage);
+    wclFreeBuffer(&clearPacket);
+    return smpResult;
+}
+
+/* Open a client and a broker session, the client importing pTicket if any,
+ * and connect them. */
+static WclError_t lOpenAndConnect(WclSession_t *pClientSession,
+                                  WclSession_t *pBrokerSession,
+                                  const WosBuffer_t *pTicket)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    smpResult = wclSmpOpen(pClientSession, WCL_SMP_ROLE_MQTTS_CLIENT);
+    if (WCL_SUCCESS == smpResult) {
+        smpResult = wclSmpOpen(pBrokerSession, WCL_SMP_ROLE_MQTTS_BROKER);
+    }
+    if ((WCL_SUCCESS == smpResult) && (NULL != pTicket)) {
+        smpResult = wclSmpImportTicket(*pClientSession, pTicket);
+    }
+    if (WCL_SUCCESS == smpResult) {
+        smpResult = lConnect(*pClientSession, *pBrokerSession);
+    }
+    return smpResult;
+}
+
+/* Open a client and a broker session, set whether each compresses, and
+ * connect them. */
+static WclError_t lOpenAndConnectCompressed(WclSession_t *pClientSession,
+                                            WclSession_t *pBrokerSession,
+                                            bool isClientCompressing,
+                                            bool isBrokerCompressing)
+{
+    WclError_t smpResult = WCL_ERROR;
+
+    smpResult = wclSmpOpen(pClientSession, WCL_SMP_ROLE_MQTTS_CLIENT);
+    if (WCL_SUCCESS == smpResult) {
+        smpResult = wclSmpOpen(pBrokerSession, WCL_SMP_ROLE_MQTTS_BROKER);
+    }
+    if (WCL_SUCCESS == smpResult) {
+        smpResult = wclSmpSetCompression(*pClientSession, isClientCompressing);
+    }
+    if (WCL_SUCCESS == smpResult) {
+        smpResult = wclSmpSetCompression(*pBrokerSession, isBrokerCompressing);
+    }
+    if (WCL_SUCCESS == smpResult) {
+        smpResult = lConnect(*pClientSession, *pBrokerSession);
+    }
+    return smpResult;
+}
+
+/* Append a QoS 0 PUBLISH packet of a topic and payload. */
+static void lAppendPublish(std::vector<uint8_t> &packet, const char *pTopic,
+                           const std::vector<uint8_t> &payload)
+{
+    size_t topicLength = strlen(pTopic);
+    size_t remainingLength = 2 + topicLength + payload.size();
+
+    packet.push_back(0x30);
+    do {
+        packet.push_back((uint8_t)((remainingLength & 0x7F) |
+                                   ((remainingLength > 0x7F) ? 0x80 : 0)));
+        remainingLength >>= 7;
+    } while (remainingLength > 0);
+    packet.push_back((uint8_t)(topicLength >> 8));
+    packet.push_back((uint8_t)topicLength);
+    packet.insert(packet.end(), pTopic, pTopic + topicLength);
+    packet.insert(packet.end(), payload.begin(), payload.end());
+}
+
+/* JSON telemetry of a sensor. */
+static std::vector<uint8_t> lJsonTelemetry(int i)
+{
+    char json[256];
+    int length = snprintf(
+        json, sizeof(json),
+        "{\"deviceId\":\"sensor-%04d\",\"timestamp\":%d,"
+        "\"temperature\":%.2f,\"humidity\":%.1f,\"pressure\":%.1f,"
+        "\"battery\":%d,\"status\":\"ok\"}",
+        i % 100, 1760000000 + i, 20 + (i % 50) / 10.0, 40 + (i % 30) / 2.0,
+        1013 + (i % 7) * 0.5, 90 - (i % 40));
+    return std::vector<uint8_t>(json, json + length);
+}
+
+/* The same telemetry as a CBOR map. */
+static std::vector<uint8_t> lCborTelemetry(int i)
+{
+    std::vector<uint8_t> cbor = {0xA7};
+    auto key = [&cbor](const char *pKey) {
+        cbor.push_back((uint8_t)(0x60 | strlen(pKey)));
+        cbor.insert(cbor.end(), pKey, pKey + strlen(pKey));
+    };
+    auto uint32 = [&cbor](uint32_t value) {
+        cbor.push_back(0x1A);
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            cbor.push_back((uint8_t)(value >> shift));
+        }
+    };
+    char deviceId[16];
+
+    snprintf(deviceId, sizeof(deviceId), "sensor-%04d", i % 100);
+    key("deviceId");
+    key(deviceId);
+    key("timestamp");
+    uint32(1760000000 + i);
+    key("temperature");
+    uint32(2000 + (i % 50) * 10);
+    key("humidity");
+    uint32(400 + (i % 30) * 5);
+    key("pressure");
+    uint32(10130 + (i % 7) * 5);
+    key("battery");
+    uint32(90 - (i % 40));
+    key("status");
+    key("ok");
+    return cbor;
+}
+
+/* Get a message from a session and process it with another, checking the
+ * packet goes through. Returns the length of the message. */
+static size_t lExchange(WclSession_t sender, WclSession_t receiver,
+                        WclSmpMessageType_t messageType,
+                        const std::vector<uint8_t> &packet)
+{
+    WosBuffer_t mqttPacket = {.data = (uint8_t *)packet.data(),
+                              .length = (uint32_t)packet.size()};
+    WosBuffer_t smpMessage = {.data = NULL, .length = 0};
+    WosBuffer_t clearPacket = {.data = NULL, .length = 0};
+    size_t length = 0;
+
+    EXPECT_EQ(WCL_SUCCESS, wclSmpGetMessage(sender, messageType, &mqttPacket,
+                                            &smpMessage));
+    EXPECT_EQ(WCL_SUCCESS,
+              wclSmpProcessMessage(receiver, &smpMessage, &clearPacket));
+    EXPECT_EQ(packet.size(), clearPacket.length);
+    if (packet.size() == clearPacket.length) {
+        EXPECT_EQ(0, memcmp(packet.data(), clearPacket.data, packet.size()));
+    }
+    length = smpMessage.length;
+    wclFreeBuffer(&smpMessage);
+    wclFreeBuffer(&clearPacket);
+    return length;
+}
+
 /* Test opening/closing of a SMP session.
  *
  * Step 1- Open a smp session.
@@ -34,7 +215,7 @@ TEST_F(TestSmp, Trivial_OpenClose)
     WclError_t smpResult = WCL_ERROR;
     WclSession_t smpSession = WCL_SESSION_INVALID;
 
-    smpResult = wclSmpOpen(&smpSession);
+    smpResult = wclSmpOpen(&smpSession, WCL_SMP_ROLE_MQTTS_CLIENT);
     ASSERT_EQ(WCL_SUCCESS, smpResult);
     EXPECT_NE(WCL_SESSION_INVALID, smpSession);
 
@@ -60,7 +241,7 @@ TEST_F(TestSmp, Trivial_GetMessageConnect)
     WosBuffer_t smpMessage = {.data = NULL, .length = 0};
     WclSmpMessageType_t messageType = WCL_SMP_MESSAGE_MQTTS_CONNECT;
 
-    smpResult = wclSmpOpen(&smpSession);
+    smpResult = wclSmpOpen(&smpSession, WCL_SMP_ROLE_MQTTS_CLIENT);
     ASSERT_EQ(WCL_SUCCESS, smpResult);
     ASSERT_NE(WCL_SESSION_INVALID, smpSession);
 
@@ -95,7 +276,7 @@ TEST_F(TestSmp, Trivial_GetMessageConnectAck)
     WosBuffer_t smpMessage = {.data = NULL, .length = 0};
     WclSmpMessageType_t messageType = WCL_SMP_MESSAGE_MQTTS_CONNACK;
 
-    smpResult = wclSmpOpen(&smpSession);
+    smpResult = wclSmpOpen(&smpSession, WCL_SMP_ROLE_MQTTS_BROKER);
     ASSERT_EQ(WCL_SUCCESS, smpResult);
     ASSERT_NE(WCL_SESSION_INVALID, smpSession);
 
@@ -127,7 +308,7 @@ TEST_F(TestSmp, Trivial_ProcessMessageConnect)
     WosBuffer_t mqttPacket = {.data = NULL, .length = 0};
     WosBuffer_t smpMessage; // TODO Pre-calculated test asset - CONNECT message
 
-    smpResult = wclSmpOpen(&smpSession);
+    smpResult = wclSmpOpen(&smpSession, WCL_SMP_ROLE_MQTTS_BROKER);
     ASSERT_EQ(WCL_SUCCESS, smpResult);
     ASSERT_NE(WCL_SESSION_INVALID, smpSession);
 
@@ -158,7 +339,7 @@ TEST_F(TestSmp, Trivial_ProcessMessageConnectAck)
     WosBuffer_t mqttPacket = {.data = NULL, .length = 0};
     WosBuffer_t smpMessage; // TODO Pre-calculated test asset - CONNACK message
 
-    smpResult = wclSmpOpen(&smpSession);
+    smpResult = wclSmpOpen(&smpSession, WCL_SMP_ROLE_MQTTS_CLIENT);
     ASSERT_EQ(WCL_SUCCESS, smpResult);
     ASSERT_NE(WCL_SESSION_INVALID, smpSession);
 
@@ -199,7 +380,7 @@ TEST_F(TestSmp, Trivial_GetMessagePublish)
                                      .length = length_SMP_CONNACK_MESSAGE_1};
     WclSmpMessageType_t messageType = WCL_SMP_MESSAGE_MQTTS_CONNECT;
 
-    smpResult = wclSmpOpen(&smpSession);
+    smpResult = wclSmpOpen(&smpSession, WCL_SMP_ROLE_MQTTS_CLIENT);
     ASSERT_EQ(WCL_SUCCESS, smpResult);
     ASSERT_NE(WCL_SESSION_INVALID, smpSession);
 
@@ -235,4 +416,1352 @@ TEST_F(TestSmp, Trivial_GetMessagePublish)
     EXPECT_EQ(WCL_SUCCESS, smpResult);
 }
 
+/* Test a client and a broker session held by the same process.
+ *
+ * Step 1- Open a client and a broker smp session.
+ * Step 2- Exchange CONNECT and CONNACK messages.
+ * Step 3- Exchange PUBLISH messages in both directions.
+ * Step 4- Close the sessions.
+ * */
+TEST_F(TestSmp, Trivial_ClientAndBrokerSession)
+{
+    WclError_t smpResult = WCL_ERROR;
+    WclSession_t clientSession = WCL_SESSION_INVALID;
+    WclSession_t brokerSession = WCL_SESSION_INVALID;
+    uint32_t mqttPacketLength = strlen(MQTT_MESSAGE);
+    WosBuffer_t mqttPacket = {.data = (uint8_t *)MQTT_MESSAGE,
+                              .length = mqttPacketLength};
+    WosBuffer_t smpMessage = {.data = NULL, .length = 0};
+    WosBuffer_t clearPacket = {.data = NULL, .length = 0};
+    WclSmpMessageType_t messageTypes[] = {WCL_SMP_MESSAGE_MQTTS_CONNECT,
+                                          WCL_SMP_MESSAGE_MQTTS_CONNACK,
+                                          WCL_SMP_MESSAGE_MQTTS_PUBLISH,
+                                          WCL_SMP_MESSAGE_MQTTS_PUBLISH};
+    uint32_t i = 0;
+
+    smpResult = wclSmpOpen(&clientSession, WCL_SMP_ROLE_MQTTS_CLIENT);
+    ASSERT_EQ(WCL_SUCCESS, smpResult);
+    smpResult = wclSmpOpen(&brokerSession, WCL_SMP_ROLE_MQTTS_BROKER);
+    ASSERT_EQ(WCL_SUCCESS, smpResult);
+
+    /* Sessions can only send the messages of their own role. */
+    smpResult = wclSmpGetMessage(brokerSession, WCL_SMP_MESSAGE_MQTTS_CONNECT,
+                                 &mqttPacket, &smpMessage);
+    EXPECT_NE(WCL_SUCCESS, smpResult);
+
+    WclSession_t senders[] = {clientSession, brokerSession, clientSession,
+                              brokerSession};
+    WclSession_t receivers[] = {brokerSession, clientSession, brokerSession,
+                                clientSession};
+    for (i = 0; i < sizeof(messageTypes) / sizeof(messageTypes[0]); i++) {
+        smpResult = wclSmpGetMessage(senders[i], messageTypes[i], &mqttPacket,
+                                     &smpMessage);
+        ASSERT_EQ(WCL_SUCCESS, smpResult);
+
+        smpResult =
+            wclSmpProcessMessage(receivers[i], &smpMessage, &clearPacket);
+        ASSERT_EQ(WCL_SUCCESS, smpResult);
+        ASSERT_EQ(mqttPacketLength, clearPacket.length);
+        EXPECT_EQ(0, memcmp(MQTT_MESSAGE, clearPacket.data, mqttPacketLength));
+
+        wosMemFree(smpMessage.data);
+        smpMessage.data = NULL;
+        smpMessage.length = 0;
+        wosMemFree(clearPacket.data);
+        clearPacket.data = NULL;
+        clearPacket.length = 0;
+    }
+
+    smpResult = wclSmpClose(clientSession);
+    EXPECT_EQ(WCL_SUCCESS, smpResult);
+    smpResult = wclSmpClose(brokerSession);
+    EXPECT_EQ(WCL_SUCCESS, smpResult);
+}
+
+/* Test carrying several MQTT packets in one BATCH message.
+ *
+ * Step 1- Open and connect a client and a broker session.
+ * Step 2- Send a BATCH of two PUBLISH packets in both directions.
+ * Step 3- Check the packets come out back to back as they went in.
+ * Step 4- Close the sessions.
+ * */
+TEST_F(TestSmp, Trivial_BatchMessage)
+{
+    WclError_t smpResult = WCL_ERROR;
+    WclSession_t clientSession = WCL_SESSION_INVALID;
+    WclSession_t brokerSession = WCL_SESSION_INVALID;
+    /* Two PUBLISH packets with the topic "a/b" and payloads "1" and "22". */
+    uint8_t batch[] = {0x30, 0x06, 0x00, 0x03, 'a', '/', 'b', '1',
+                       0x30, 0x07, 0x00, 0x03, 'a', '/', 'b', '2', '2'};
+    WosBuffer_t mqttPacket = {.data = batch, .length = sizeof(batch)};
+    WosBuffer_t smpMessage = {.data = NULL, .length = 0};
+    WosBuffer_t clearPacket = {.data = NULL, .length = 0};
+    uint32_t i = 0;
+
+    smpResult = lOpenAndConnect(&clientSession, &brokerSession, NULL);
+    ASSERT_EQ(WCL_SUCCESS, smpResult);
+
+    WclSession_t senders[] = {clientSession, brokerSession};
+    WclSession_t receivers[] = {brokerSession, clientSession};
+    for (i = 0; i < sizeof(senders) / sizeof(senders[0]); i++) {
+        smpResult = wclSmpGetMessage(senders[i], WCL_SMP_MESSAGE_MQTTS_BATCH,
+                                     &mqttPacket, &smpMessage);
+        ASSERT_EQ(WCL_SUCCESS, smpResult);
+        /* The packets are encrypted, not only authenticated. */
+        EXPECT_EQ(nullptr, memmem(smpMessage.data, smpMessage.length, "a/b",
+                                  strlen("a/b")));
+
+        smpResult =
+            wclSmpProcessMessage(receivers[i], &smpMessage, &clearPacket);
+        ASSERT_EQ(WCL_SUCCESS, smpResult);
+        ASSERT_EQ(sizeof(batch), clearPacket.length);
+        EXPECT_EQ(0, memcmp(batch, clearPacket.data, sizeof(batch)));
+
+        wclFreeBuffer(&smpMessage);
+        wclFreeBuffer(&clearPacket);
+    }
+
+    smpResult = wclSmpClose(clientSession);
+    EXPECT_EQ(WCL_SUCCESS, smpResult);
+    smpResult = wclSmpClose(brokerSession);
+    EXPECT_EQ(WCL_SUCCESS, smpResult);
+}
+
+/* Test processing messages out of order.
+ *
+ * Step 1- Open and connect a client and a broker session.
+ * Step 2- Secure a run of PUBLISH messages at the client.
+ * Step 3- Process them at the broker in reverse order, all are accepted.
+ * Step 4- Close the sessions.
+ * */
+TEST_F(TestSmp, Trivial_ReorderedMessages)
+{
+    const uint32_t count = 8;
+    WclSession_t clientSession = WCL_SESSION_INVALID;
+    WclSession_t brokerSession = WCL_SESSION_INVALID;
+    WosBuffer_t mqttPacket = {.data = (uint8_t *)MQTT_MESSAGE,
+                              .length = (uint32_t)strlen(MQTT_MESSAGE)};
+    WosBuffer_t smpMessages[count];
+    WosBuffer_t clearPacket = {.data = NULL, .length = 0};
+    uint32_t i = 0;
+
+    ASSERT_EQ(WCL_SUCCESS,
+              lOpenAndConnect(&clientSession, &brokerSession, NULL));
+    for (i = 0; i < count; i++) {
+        smpMessages[i] = {.data = NULL, .length = 0};
+        ASSERT_EQ(WCL_SUCCESS,
+                  wclSmpGetMessage(clientSession, WCL_SMP_MESSAGE_MQTTS_PUBLISH,
+                                   &mqttPacket, &smpMessages[i]));
+    }
+    for (i = count; i > 0; i--) {
+        EXPECT_EQ(WCL_SUCCESS, wclSmpProcessMessage(
+                                   brokerSession, &smpMessages[i - 1],
+                                   &clearPacket));
+        wclFreeBuffer(&clearPacket);
+    }
+
+    for (i = 0; i < count; i++) {
+        wclFreeBuffer(&smpMessages[i]);
+    }
+    wclSmpClose(clientSession);
+    wclSmpClose(brokerSession);
+}
+
+/* Test rejecting replayed and stale messages.
+ *
+ * Step 1- Open and connect a client and a broker session.
+ * Step 2- Process a PUBLISH message twice, the second time is rejected.
+ * Step 3- Process a message 32 message ids behind the highest one accepted,
+ *         it is rejected even though it has not been seen.
+ * Step 4- Process one behind the highest twice, the second time is rejected.
+ * Step 5- Close the sessions.
+ * */
+TEST_F(TestSmp, Negative_ReplayedMessage)
+{
+    const uint32_t count = 33;
+    WclSession_t clientSession = WCL_SESSION_INVALID;
+    WclSession_t brokerSession = WCL_SESSION_INVALID;
+    WosBuffer_t mqttPacket = {.data = (uint8_t *)MQTT_MESSAGE,
+                              .length = (uint32_t)strlen(MQTT_MESSAGE)};
+    WosBuffer_t smpMessages[count];
+    WosBuffer_t clearPacket = {.data = NULL, .length = 0};
+    uint32_t i = 0;
+
+    ASSERT_EQ(WCL_SUCCESS,
+              lOpenAndConnect(&clientSession, &brokerSession, NULL));
+    for (i = 0; i < count; i++) {
+        smpMessages[i] = {.data = NULL, .length = 0};
+        ASSERT_EQ(WCL_SUCCESS,
+                  wclSmpGetMessage(clientSession, WCL_SMP_MESSAGE_MQTTS_PUBLISH,
+                                   &mqttPacket, &smpMessages[i]));
+    }
+
+    EXPECT_EQ(WCL_SUCCESS, wclSmpProcessMessage(brokerSession, &smpMessages[1],
+                                                &clearPacket));
+    wclFreeBuffer(&clearPacket);
+    EXPECT_NE(WCL_SUCCESS, wclSmpProcessMessage(brokerSession, &smpMessages[1],
+                                                &clearPacket));
+    EXPECT_EQ(nullptr, clearPacket.data);
+
+    EXPECT_EQ(WCL_SUCCESS,
+              wclSmpProcessMessage(brokerSession, &smpMessages[count - 1],
+                                   &clearPacket));
+    wclFreeBuffer(&clearPacket);
+    EXPECT_NE(WCL_SUCCESS, wclSmpProcessMessage(brokerSession, &smpMessages[0],
+                                                &clearPacket));
+    EXPECT_EQ(WCL_SUCCESS, wclSmpProcessMessage(brokerSession, &smpMessages[2],
+                                                &clearPacket));
+    wclFreeBuffer(&clearPacket);
+    EXPECT_NE(WCL_SUCCESS, wclSmpProcessMessage(brokerSession, &smpMessages[2],
+                                                &clearPacket));
+    EXPECT_EQ(nullptr, clearPacket.data);
+
+    for (i = 0; i < count; i++) {
+        wclFreeBuffer(&smpMessages[i]);
+    }
+    wclSmpClose(clientSession);
+    wclSmpClose(brokerSession);
+}
+
+/* Test the traffic key updates of both directions.
+ *
+ * Step 1- Open and connect a client and a broker session, both moving to the
+ *         next traffic key every 2 messages.
+ * Step 2- Get 6 PUBLISH messages from the client, protected in 3 epochs.
+ * Step 3- Process them out of order across the key updates.
+ * Step 4- Do the same from the broker to the client.
+ * Step 5- Close the sessions.
+ * */
+TEST_F(TestSmp, Trivial_Rekey)
+{
+    const uint32_t count = 6;
+    const uint32_t order[count] = {2, 0, 3, 1, 4, 5};
+    WclSession_t clientSession = WCL_SESSION_INVALID;
+    WclSession_t brokerSession = WCL_SESSION_INVALID;
+    WosBuffer_t mqttPacket = {.data = (uint8_t *)MQTT_MESSAGE,
+                              .length = (uint32_t)strlen(MQTT_MESSAGE)};
+    WosBuffer_t smpMessages[count];
+    WosBuffer_t clearPacket = {.data = NULL, .length = 0};
+    WclSession_t senders[2];
+    WclSession_t receivers[2];
+    uint32_t i = 0;
+    uint32_t j = 0;
+
+    ASSERT_EQ(WCL_SUCCESS,
+              lOpenAndConnect(&clientSession, &brokerSession, NULL));
+    ASSERT_EQ(WCL_SUCCESS, wclSmpSetRekeyLimits(clientSession, 2, 1 << 20));
+    ASSERT_EQ(WCL_SUCCESS, wclSmpSetRekeyLimits(brokerSession, 2, 1 << 20));
+    senders[0] = clientSession;
+    receivers[0] = brokerSession;
+    senders[1] = brokerSession;
+    receivers[1] = clientSession;
+
+    for (j = 0; j < 2; j++) {
+        for (i = 0; i < count; i++) {
+            smpMessages[i] = {.data = NULL, .length = 0};
+            ASSERT_EQ(WCL_SUCCESS,
+                      wclSmpGetMessage(senders[j],
+                                       WCL_SMP_MESSAGE_MQTTS_PUBLISH,
+                                       &mqttPacket, &smpMessages[i]));
+        }
+        for (i = 0; i < count; i++) {
+            EXPECT_EQ(WCL_SUCCESS,
+                      wclSmpProcessMessage(receivers[j],
+                                           &smpMessages[order[i]],
+                                           &clearPacket));
+            ASSERT_EQ(mqttPacket.length, clearPacket.length);
+            EXPECT_EQ(0, memcmp(mqttPacket.data, clearPacket.data,
+                                mqttPacket.length));
+            wclFreeBuffer(&clearPacket);
+        }
+        for (i = 0; i < count; i++) {
+            wclFreeBuffer(&smpMessages[i]);
+        }
+    }
+
+    EXPECT_EQ(WCL_ERROR_BAD_PARAMS, wclSmpSetRekeyLimits(clientSession, 0, 1));
+    wclSmpClose(clientSession);
+    wclSmpClose(brokerSession);
+}
+
+/* Test moving through several traffic keys by message count and by bytes.
+ *
+ * Step 1- Open and connect a client and a broker session, the client moving
+ *         to the next traffic key every 3 messages.
+ * Step 2- Get 15 PUBLISH messages, protected in 5 epochs, and process them
+ *         in order but for the fifth one.
+ * Step 3- The fifth message, of epoch 1, is rejected as the broker is at
+ *         epoch 4.
+ * Step 4- Do the same with the client moving every 3 messages' worth of
+ *         bytes.
+ * Step 5- Close the sessions.
+ * */
+TEST_F(TestSmp, Trivial_RekeyLimits)
+{
+    const uint32_t count = 15;
+    const uint32_t heldBack = 4;
+    WclSession_t clientSession = WCL_SESSION_INVALID;
+    WclSession_t brokerSession = WCL_SESSION_INVALID;
+    WosBuffer_t mqttPacket = {.data = (uint8_t *)MQTT_MESSAGE,
+                              .length = (uint32_t)strlen(MQTT_MESSAGE)};
+    WosBuffer_t smpMessages[count];
+    WosBuffer_t clearPacket = {.data = NULL, .length = 0};
+    const uint64_t limits[2][2] = {{3, 1 << 20},
+                                   {1 << 20, 3 * mqttPacket.length}};
+    uint32_t i = 0;
+    uint32_t j = 0;
+
+    for (j = 0; j < 2; j++) {
+        ASSERT_EQ(WCL_SUCCESS,
+                  lOpenAndConnect(&clientSession, &brokerSession, NULL));
+        ASSERT_EQ(WCL_SUCCESS, wclSmpSetRekeyLimits(clientSession,
+                                                    limits[j][0],
+                                                    limits[j][1]));
+        for (i = 0; i < count; i++) {
+            smpMessages[i] = {.data = NULL, .length = 0};
+            ASSERT_EQ(WCL_SUCCESS,
+                      wclSmpGetMessage(clientSession,
+                                       WCL_SMP_MESSAGE_MQTTS_PUBLISH,
+                                       &mqttPacket, &smpMessages[i]));
+        }
+        for (i = 0; i < count; i++) {
+            if (heldBack == i) {
+                continue;
+            }
+            EXPECT_EQ(WCL_SUCCESS, wclSmpProcessMessage(
+                                       brokerSession, &smpMessages[i],
+                                       &clearPacket));
+            ASSERT_EQ(mqttPacket.length, clearPacket.length);
+            EXPECT_EQ(0, memcmp(mqttPacket.data, clearPacket.data,
+                                mqttPacket.length));
+            wclFreeBuffer(&clearPacket);
+        }
+        EXPECT_NE(WCL_SUCCESS,
+                  wclSmpProcessMessage(brokerSession, &smpMessages[heldBack],
+                                       &clearPacket));
+        EXPECT_EQ(nullptr, clearPacket.data);
+
+        for (i = 0; i < count; i++) {
+            wclFreeBuffer(&smpMessages[i]);
+        }
+        wclSmpClose(clientSession);
+        wclSmpClose(brokerSession);
+    }
+}
+
+/* Test rejecting a message from an epoch the receiver can't reach yet.
+ *
+ * Step 1- Open and connect a client and a broker session, the client moving
+ *         to the next traffic key every message.
+ * Step 2- Process the message of epoch 2 first, it is rejected.
+ * Step 3- Process the messages of epochs 0 and 1, then that of epoch 2 is
+ *         accepted.
+ * Step 4- Close the sessions.
+ * */
+TEST_F(TestSmp, Negative_SkippedEpoch)
+{
+    const uint32_t count = 3;
+    WclSession_t clientSession = WCL_SESSION_INVALID;
+    WclSession_t brokerSession = WCL_SESSION_INVALID;
+    WosBuffer_t mqttPacket = {.data = (uint8_t *)MQTT_MESSAGE,
+                              .length = (uint32_t)strlen(MQTT_MESSAGE)};
+    WosBuffer_t smpMessages[count];
+    WosBuffer_t clearPacket = {.data = NULL, .length = 0};
+    uint32_t i = 0;
+
+    ASSERT_EQ(WCL_SUCCESS,
+              lOpenAndConnect(&clientSession, &brokerSession, NULL));
+    ASSERT_EQ(WCL_SUCCESS, wclSmpSetRekeyLimits(clientSession, 1, 1 << 20));
+    for (i = 0; i < count; i++) {
+        smpMessages[i] = {.data = NULL, .length = 0};
+        ASSERT_EQ(WCL_SUCCESS,
+                  wclSmpGetMessage(clientSession, WCL_SMP_MESSAGE_MQTTS_PUBLISH,
+                                   &mqttPacket, &smpMessages[i]));
+    }
+
+    EXPECT_NE(WCL_SUCCESS, wclSmpProcessMessage(brokerSession, &smpMessages[2],
+                                                &clearPacket));
+    EXPECT_EQ(nullptr, clearPacket.data);
+    for (i = 0; i < count; i++) {
+        EXPECT_EQ(WCL_SUCCESS, wclSmpProcessMessage(
+                                   brokerSession, &smpMessages[i],
+                                   &clearPacket));
+        wclFreeBuffer(&clearPacket);
+    }
+
+    for (i = 0; i < count; i++) {
+        wclFreeBuffer(&smpMessages[i]);
+    }
+    wclSmpClose(clientSession);
+    wclSmpClose(brokerSession);
+}
+
+/* Compare the rate of PUBLISH messages of one session processed by one
+ * thread, and by several at once each taking every n-th message. A thread
+ * falling a whole window behind the others gets its messages rejected, the
+ * number of those is reported rather than checked. */
+TEST_F(TestSmp, Performance_ParallelDecrypt)
+{
+    const uint32_t count = 4000;
+    const uint32_t numThreads = 4;
+    WclSession_t clientSession = WCL_SESSION_INVALID;
+    WclSession_t brokerSession = WCL_SESSION_INVALID;
+    WosBuffer_t mqttPacket = {.data = (uint8_t *)MQTT_MESSAGE,
+                              .length = (uint32_t)strlen(MQTT_MESSAGE)};
+    std::vector<WosBuffer_t> smpMessages(2 * count);
+    std::vector<std::thread> threads;
+    std::atomic<uint32_t> failures(0);
+    uint32_t i = 0;
+
+    auto process = [&](WclSession_t session, uint32_t first, uint32_t end,
+                       uint32_t step) {
+        WosBuffer_t clearPacket = {.data = NULL, .length = 0};
+        for (uint32_t j = first; j < end; j += step) {
+            if (WCL_SUCCESS !=
+                wclSmpProcessMessage(session, &smpMessages[j], &clearPacket)) {
+                failures++;
+            }
+            wclFreeBuffer(&clearPacket);
+        }
+    };
+
+    ASSERT_EQ(WCL_SUCCESS,
+              lOpenAndConnect(&clientSession, &brokerSession, NULL));
+    for (i = 0; i < 2 * count; i++) {
+        smpMessages[i] = {.data = NULL, .length = 0};
+        ASSERT_EQ(WCL_SUCCESS,
+                  wclSmpGetMessage(clientSession, WCL_SMP_MESSAGE_MQTTS_PUBLISH,
+                                   &mqttPacket, &smpMessages[i]));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    process(brokerSession, 0, count, 1);
+    auto serial = std::chrono::steady_clock::now() - start;
+    EXPECT_EQ(0u, failures.load());
+
+    /* The threads take interleaved messages, so they mostly stay within the
+     * window of one another. */
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < numThreads; i++) {
+        threads.emplace_back(process, brokerSession, count + i, 2 * count,
+                             numThreads);
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    auto parallel = std::chrono::steady_clock::now() - start;
+
+    printf("serial: %.1f msg/s, %u threads: %.1f msg/s, %u rejected\n",
+           count / std::chrono::duration<double>(serial).count(), numThreads,
+           count / std::chrono::duration<double>(parallel).count(),
+           failures.load());
+
+    for (i = 0; i < 2 * count; i++) {
+        wclFreeBuffer(&smpMessages[i]);
+    }
+    wclSmpClose(clientSession);
+    wclSmpClose(brokerSession);
+}
+
+/* Test resuming a session with a ticket.
+ *
+ * Step 1- Enable tickets and establish a session with a full handshake.
+ * Step 2- Export the ticket and close the sessions.
+ * Step 3- Resume the session on new sessions importing the ticket.
+ * Step 4- Exchange PUBLISH messages in both directions.
+ * Step 5- Export the ticket again, it stays valid for its lifetime.
+ * */
+TEST_F(TestSmp, Trivial_ResumedSession)
+{
+    WclError_t smpResult = WCL_ERROR;
+    WclSession_t clientSession = WCL_SESSION_INVALID;
+    WclSession_t brokerSession = WCL_SESSION_INVALID;
+    uint32_t mqttPacketLength = strlen(MQTT_MESSAGE);
+    WosBuffer_t mqttPacket = {.data = (uint8_t *)MQTT_MESSAGE,
+                              .length = mqttPacketLength};
+    WosBuffer_t smpMessage = {.data = NULL, .length = 0};
+    WosBuffer_t clearPacket = {.data = NULL, .length = 0};
+    WosBuffer_t ticket = {.data = NULL, .length = 0};
+    WosBuffer_t secondTicket = {.data = NULL, .length = 0};
+
+    smpResult = wclSmpRotateTicketKey(NULL, 3600);
+    ASSERT_EQ(WCL_SUCCESS, smpResult);
+    smpResult = lOpenAndConnect(&clientSession, &brokerSession, NULL);
+    ASSERT_EQ(WCL_SUCCESS, smpResult);
+    smpResult = wclSmpExportTicket(clientSession, &ticket);
+    ASSERT_EQ(WCL_SUCCESS, smpResult);
+    EXPECT_NE(WCL_SUCCESS, wclSmpExportTicket(brokerSession, &secondTicket));
+    EXPECT_EQ(WCL_SUCCESS, wclSmpClose(clientSession));
+    EXPECT_EQ(WCL_SUCCESS, wclSmpClose(brokerSession));
+
+    smpResult = lOpenAndConnect(&clientSession, &brokerSession, &ticket);
+    ASSERT_EQ(WCL_SUCCESS, smpResult);
+
+    smpResult = wclSmpGetMessage(clientSession, WCL_SMP_MESSAGE_MQTTS_PUBLISH,
+                                 &mqttPacket, &smpMessage);
+    ASSERT_EQ(WCL_SUCCESS, smpResult);
+    smpResult = wclSmpProcessMessage(brokerSession, &smpMessage, &clearPacket);
+    ASSERT_EQ(WCL_SUCCESS, smpResult);
+    ASSERT_EQ(mqttPacketLength, clearPacket.length);
+    EXPECT_EQ(0, memcmp(MQTT_MESSAGE, clearPacket.data, mqttPacketLength));
+    wclFreeBuffer(&smpMessage);
+    wclFreeBuffer(&clearPacket);
+
+    smpResult = wclSmpGetMessage(brokerSession, WCL_SMP_MESSAGE_MQTTS_PUBLISH,
+                                 &mqttPacket, &smpMessage);
+    ASSERT_EQ(WCL_SUCCESS, smpResult);
+    smpResult = wclSmpProcessMessage(clientSession, &smpMessage, &clearPacket);
+    ASSERT_EQ(WCL_SUCCESS, smpResult);
+    ASSERT_EQ(mqttPacketLength, clearPacket.length);
+    EXPECT_EQ(0, memcmp(MQTT_MESSAGE, clearPacket.data, mqttPacketLength));
+    wclFreeBuffer(&smpMessage);
+    wclFreeBuffer(&clearPacket);
+
+    smpResult = wclSmpExportTicket(clientSession, &secondTicket);
+    ASSERT_EQ(WCL_SUCCESS, smpResult);
+    ASSERT_EQ(ticket.length, secondTicket.length);
+    EXPECT_EQ(0, memcmp(ticket.data, secondTicket.data, ticket.length));
+
+    wclFreeBuffer(&ticket);
+    wclFreeBuffer(&secondTicket);
+    EXPECT_EQ(WCL_SUCCESS, wclSmpClose(clientSession));
+    EXPECT_EQ(WCL_SUCCESS, wclSmpClose(brokerSession));
+}
+
+/* Test rejected session tickets.
+ *
+ * Step 1- No ticket is issued while tickets are disabled.
+ * Step 2- A tampered ticket is rejected.
+ * Step 3- A ticket is still accepted after one key rotation, not after two.
+ * Step 4- A ticket can't be imported into a session that has started.
+ * */
+TEST_F(TestSmp, Negative_ResumedSession)
+{
+    WclError_t smpResult = WCL_ERROR;
+    WclSession_t clientSession = WCL_SESSION_INVALID;
+    WclSession_t brokerSession = WCL_SESSION_INVALID;
+    WosBuffer_t ticket = {.data = NULL, .length = 0};
+
+    smpResult = lOpenAndConnect(&clientSession, &brokerSession, NULL);
+    ASSERT_EQ(WCL_SUCCESS, smpResult);
+    EXPECT_EQ(WCL_ERROR_BAD_SESSION,
+              wclSmpExportTicket(clientSession, &ticket));
+    wclSmpClose(clientSession);
+    wclSmpClose(brokerSession);
+
+    ASSERT_EQ(WCL_SUCCESS, wclSmpRotateTicketKey(NULL, 3600));
+    smpResult = lOpenAndConnect(&clientSession, &brokerSession, NULL);
+    ASSERT_EQ(WCL_SUCCESS, smpResult);
+    ASSERT_EQ(WCL_SUCCESS, wclSmpExportTicket(clientSession, &ticket));
+    EXPECT_EQ(WCL_ERROR_BAD_SESSION,
+              wclSmpImportTicket(clientSession, &ticket));
+    wclSmpClose(clientSession);
+    wclSmpClose(brokerSession);
+
+    ticket.data[ticket.length - 1] ^= 0x01;
+    smpResult = lOpenAndConnect(&clientSession, &brokerSession, &ticket);
+    EXPECT_NE(WCL_SUCCESS, smpResult);
+    wclSmpClose(clientSession);
+    wclSmpClose(brokerSession);
+    ticket.data[ticket.length - 1] ^= 0x01;
+
+    ASSERT_EQ(WCL_SUCCESS, wclSmpRotateTicketKey(NULL, 3600));
+    smpResult = lOpenAndConnect(&clientSession, &brokerSession, &ticket);
+    EXPECT_EQ(WCL_SUCCESS, smpResult);
+    wclSmpClose(clientSession);
+    wclSmpClose(brokerSession);
+
+    ASSERT_EQ(WCL_SUCCESS, wclSmpRotateTicketKey(NULL, 3600));
+    smpResult = lOpenAndConnect(&clientSession, &brokerSession, &ticket);
+    EXPECT_NE(WCL_SUCCESS, smpResult);
+    wclSmpClose(clientSession);
+    wclSmpClose(brokerSession);
+
+    wclFreeBuffer(&ticket);
+}
+
+/* Test expired session tickets.
+ *
+ * Step 1- Issue tickets valid for 1 second and export one.
+ * Step 2- Once it has expired the client session can export it no more, nor
+ *         can a new one import it.
+ * Step 3- Its client side expiry pushed back, the broker rejects it.
+ * */
+TEST_F(TestSmp, Negative_ExpiredTicket)
+{
+    WclError_t smpResult = WCL_ERROR;
+    WclSession_t clientSession = WCL_SESSION_INVALID;
+    WclSession_t brokerSession = WCL_SESSION_INVALID;
+    WosBuffer_t ticket = {.data = NULL, .length = 0};
+    WosBuffer_t expiredTicket = {.data = NULL, .length = 0};
+
+    ASSERT_EQ(WCL_SUCCESS, wclSmpRotateTicketKey(NULL, 1));
+    smpResult = lOpenAndConnect(&clientSession, &brokerSession, NULL);
+    ASSERT_EQ(WCL_SUCCESS, smpResult);
+    ASSERT_EQ(WCL_SUCCESS, wclSmpExportTicket(clientSession, &ticket));
+
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    EXPECT_EQ(WCL_ERROR_BAD_SESSION,
+              wclSmpExportTicket(clientSession, &expiredTicket));
+    wclSmpClose(clientSession);
+    wclSmpClose(brokerSession);
+    ASSERT_EQ(WCL_SUCCESS, wclSmpOpen(&clientSession,
+                                      WCL_SMP_ROLE_MQTTS_CLIENT));
+    EXPECT_EQ(WCL_ERROR_INVALID_MESSAGE,
+              wclSmpImportTicket(clientSession, &ticket));
+    wclSmpClose(clientSession);
+
+    /* The expiry leading the exported ticket is the client's copy, the
+     * broker checks the one sealed in the ticket. */
+    ticket.data[0] = 0x7f;
+    smpResult = lOpenAndConnect(&clientSession, &brokerSession, &ticket);
+    EXPECT_NE(WCL_SUCCESS, smpResult);
+    wclSmpClose(clientSession);
+    wclSmpClose(brokerSession);
+
+    wclFreeBuffer(&ticket);
+}
+
+/* Test early data in a resumed CONNECT.
+ *
+ * Step 1- Establish a session with a full handshake and export the ticket.
+ * Step 2- Resume it with a PUBLISH as early data.
+ * Step 3- The broker gets the PUBLISH and the client sees it accepted.
+ * Step 4- A replay of the CONNECT resumes without its early data.
+ * */
+TEST_F(TestSmp, Trivial_EarlyData)
+{
+    WclError_t smpResult = WCL_ERROR;
+    WclSession_t clientSession = WCL_SESSION_INVALID;
+    WclSession_t brokerSession = WCL_SESSION_INVALID;
+    WclSession_t replaySession = WCL_SESSION_INVALID;
+    uint32_t mqttPacketLength = strlen(MQTT_MESSAGE);
+    WosBuffer_t mqttPacket = {.data = (uint8_t *)MQTT_MESSAGE,
+                              .length = mqttPacketLength};
+    WosBuffer_t connectMessage = {.data = NULL, .length = 0};
+    WosBuffer_t smpMessage = {.data = NULL, .length = 0};
+    WosBuffer_t clearPacket = {.data = NULL, .length = 0};
+    WosBuffer_t earlyData = {.data = NULL, .length = 0};
+    WosBuffer_t ticket = {.data = NULL, .length = 0};
+    bool isAccepted = false;
+
+    ASSERT_EQ(WCL_SUCCESS, wclSmpRotateTicketKey(NULL, 3600));
+    ASSERT_EQ(WCL_SUCCESS,
+              lOpenAndConnect(&clientSession, &brokerSession, NULL));
+    ASSERT_EQ(WCL_SUCCESS, wclSmpExportTicket(clientSession, &ticket));
+    EXPECT_EQ(WCL_SUCCESS,
+              wclSmpIsEarlyDataAccepted(clientSession, &isAccepted));
+    EXPECT_FALSE(isAccepted);
+    wclSmpClose(clientSession);
+    wclSmpClose(brokerSession);
+
+    ASSERT_EQ(WCL_SUCCESS,
+              wclSmpOpen(&clientSession, WCL_SMP_ROLE_MQTTS_CLIENT));
+    ASSERT_EQ(WCL_SUCCESS,
+              wclSmpOpen(&brokerSession, WCL_SMP_ROLE_MQTTS_BROKER));
+    EXPECT_EQ(WCL_ERROR_BAD_SESSION,
+              wclSmpSetEarlyData(clientSession, &mqttPacket));
+    ASSERT_EQ(WCL_SUCCESS, wclSmpImportTicket(clientSession, &ticket));
+    ASSERT_EQ(WCL_SUCCESS, wclSmpSetEarlyData(clientSession, &mqttPacket));
+
+    smpResult = wclSmpGetMessage(clientSession, WCL_SMP_MESSAGE_MQTTS_CONNECT,
+                                 &mqttPacket, &connectMessage);
+    ASSERT_EQ(WCL_SUCCESS, smpResult);
+    smpResult =
+        wclSmpProcessMessage(brokerSession, &connectMessage, &clearPacket);
+    ASSERT_EQ(WCL_SUCCESS, smpResult);
+    wclFreeBuffer(&clearPacket);
+    smpResult = wclSmpGetEarlyData(brokerSession, &earlyData);
+    ASSERT_EQ(WCL_SUCCESS, smpResult);
+    ASSERT_EQ(mqttPacketLength, earlyData.length);
+    EXPECT_EQ(0, memcmp(MQTT_MESSAGE, earlyData.data, mqttPacketLength));
+    wclFreeBuffer(&earlyData);
+    EXPECT_EQ(WCL_ERROR_BAD_SESSION,
+              wclSmpGetEarlyData(brokerSession, &earlyData));
+
+    smpResult = wclSmpGetMessage(brokerSession, WCL_SMP_MESSAGE_MQTTS_CONNACK,
+                                 &mqttPacket, &smpMessage);
+    ASSERT_EQ(WCL_SUCCESS, smpResult);
+    smpResult = wclSmpProcessMessage(clientSession, &smpMessage, &clearPacket);
+    ASSERT_EQ(WCL_SUCCESS, smpResult);
+    wclFreeBuffer(&smpMessage);
+    wclFreeBuffer(&clearPacket);
+    EXPECT_EQ(WCL_SUCCESS,
+              wclSmpIsEarlyDataAccepted(clientSession, &isAccepted));
+    EXPECT_TRUE(isAccepted);
+
+    ASSERT_EQ(WCL_SUCCESS,
+              wclSmpOpen(&replaySession, WCL_SMP_ROLE_MQTTS_BROKER));
+    smpResult =
+        wclSmpProcessMessage(replaySession, &connectMessage, &clearPacket);
+    EXPECT_EQ(WCL_SUCCESS, smpResult);
+    wclFreeBuffer(&clearPacket);
+    EXPECT_EQ(WCL_ERROR_BAD_SESSION,
+              wclSmpGetEarlyData(replaySession, &earlyData));
+
+    wclFreeBuffer(&connectMessage);
+    wclFreeBuffer(&ticket);
+    wclSmpClose(replaySession);
+    wclSmpClose(clientSession);
+    wclSmpClose(brokerSession);
+}
+
+/* Test the anti-replay window of the early data.
+ *
+ * Step 1- Size the window for 300 CONNECTs, more than the broker used to
+ *         remember, and export a ticket.
+ * Step 2- Resume the session 300 times with early data, all accepted.
+ * Step 3- A replay of the last CONNECT is declined, and so is the early data
+ *         of one CONNECT more within the window.
+ * Step 4- The window can't be resized while it holds CONNECTs.
+ * */
+TEST_F(TestSmp, Trivial_EarlyDataWindow)
+{
+    const int resumptions = 300;
+    WclSession_t clientSession = WCL_SESSION_INVALID;
+    WclSession_t brokerSession = WCL_SESSION_INVALID;
+    uint32_t mqttPacketLength = strlen(MQTT_MESSAGE);
+    WosBuffer_t mqttPacket = {.data = (uint8_t *)MQTT_MESSAGE,
+                              .length = mqttPacketLength};
+    WosBuffer_t connectMessage = {.data = NULL, .length = 0};
+    WosBuffer_t clearPacket = {.data = NULL, .length = 0};
+    WosBuffer_t earlyData = {.data = NULL, .length = 0};
+    WosBuffer_t ticket = {.data = NULL, .length = 0};
+    int i = 0;
+
+    EXPECT_EQ(WCL_ERROR_BAD_PARAMS, wclSmpSetEarlyDataWindow(0, resumptions));
+    EXPECT_EQ(WCL_ERROR_BAD_PARAMS, wclSmpSetEarlyDataWindow(10, 0));
+    ASSERT_EQ(WCL_SUCCESS, wclSmpSetEarlyDataWindow(60, resumptions));
+    ASSERT_EQ(WCL_SUCCESS, wclSmpRotateTicketKey(NULL, 3600));
+    ASSERT_EQ(WCL_SUCCESS,
+              lOpenAndConnect(&clientSession, &brokerSession, NULL));
+    ASSERT_EQ(WCL_SUCCESS, wclSmpExportTicket(clientSession, &ticket));
+    wclSmpClose(clientSession);
+    wclSmpClose(brokerSession);
+
+    for (i = 0; i <= resumptions; i++) {
+        ASSERT_EQ(WCL_SUCCESS,
+                  wclSmpOpen(&clientSession, WCL_SMP_ROLE_MQTTS_CLIENT));
+        ASSERT_EQ(WCL_SUCCESS,
+                  wclSmpOpen(&brokerSession, WCL_SMP_ROLE_MQTTS_BROKER));
+        ASSERT_EQ(WCL_SUCCESS, wclSmpImportTicket(clientSession, &ticket));
+        ASSERT_EQ(WCL_SUCCESS, wclSmpSetEarlyData(clientSession, &mqttPacket));
+        wclFreeBuffer(&connectMessage);
+        ASSERT_EQ(WCL_SUCCESS,
+                  wclSmpGetMessage(clientSession,
+                                   WCL_SMP_MESSAGE_MQTTS_CONNECT, &mqttPacket,
+                                   &connectMessage));
+        ASSERT_EQ(WCL_SUCCESS, wclSmpProcessMessage(brokerSession,
+                                                    &connectMessage,
+                                                    &clearPacket));
+        wclFreeBuffer(&clearPacket);
+        if (i < resumptions) {
+            ASSERT_EQ(WCL_SUCCESS,
+                      wclSmpGetEarlyData(brokerSession, &earlyData));
+            EXPECT_EQ(mqttPacketLength, earlyData.length);
+            wclFreeBuffer(&earlyData);
+        } else {
+            EXPECT_EQ(WCL_ERROR_BAD_SESSION,
+                      wclSmpGetEarlyData(brokerSession, &earlyData));
+        }
+        wclSmpClose(clientSession);
+        wclSmpClose(brokerSession);
+
+        /* The CONNECT of the last accepted early data is replayed. */
+        if (i == resumptions - 1) {
+            ASSERT_EQ(WCL_SUCCESS,
+                      wclSmpOpen(&brokerSession, WCL_SMP_ROLE_MQTTS_BROKER));
+            EXPECT_EQ(WCL_SUCCESS, wclSmpProcessMessage(brokerSession,
+                                                        &connectMessage,
+                                                        &clearPacket));
+            wclFreeBuffer(&clearPacket);
+            EXPECT_EQ(WCL_ERROR_BAD_SESSION,
+                      wclSmpGetEarlyData(brokerSession, &earlyData));
+            wclSmpClose(brokerSession);
+        }
+    }
+
+    EXPECT_EQ(WCL_ERROR_BAD_SESSION,
+              wclSmpSetEarlyDataWindow(60, 2 * resumptions));
+
+    wclFreeBuffer(&connectMessage);
+    wclFreeBuffer(&ticket);
+}
+
+/* Test compressing the packets of a session.
+ *
+ * Step 1- Open and connect a pair of sessions without compression, and a
+ *         pair with.
+ * Step 2- Exchange a batch of telemetry PUBLISH packets both ways, the
+ *         compressed messages are shorter.
+ * Step 3- Set a dictionary for the topic, a single PUBLISH gets shorter.
+ * Step 4- A short packet still goes through.
+ * Step 5- Random bytes are sent as they are, one byte longer than without
+ *         compression.
+ * Step 6- A run of one byte, compressed as far as the format goes, is
+ *         within the decompressed size the receiver allows for its length.
+ * Step 7- Close the sessions.
+ * */
+TEST_F(TestSmp, Trivial_Compression)
+{
+    WclSession_t clientSession = WCL_SESSION_INVALID;
+    WclSession_t brokerSession = WCL_SESSION_INVALID;
+    WclSession_t plainClientSession = WCL_SESSION_INVALID;
+    WclSession_t plainBrokerSession = WCL_SESSION_INVALID;
+    std::vector<uint8_t> batch;
+    std::vector<uint8_t> publish;
+    std::vector<uint8_t> shortPacket(MQTT_MESSAGE,
+                                     MQTT_MESSAGE + strlen(MQTT_MESSAGE));
+    std::vector<uint8_t> noise(4096);
+    std::vector<uint8_t> noisePacket;
+    std::vector<uint8_t> runPacket;
+    std::string dictionaryData;
+    WosBuffer_t dictionary = {.data = NULL, .length = 0};
+    size_t plainLength = 0;
+    size_t length = 0;
+    int i = 0;
+
+    ASSERT_EQ(WCL_SUCCESS,
+              lOpenAndConnectCompressed(&plainClientSession,
+                                        &plainBrokerSession, false, false));
+    ASSERT_EQ(WCL_SUCCESS, lOpenAndConnectCompressed(
+                               &clientSession, &brokerSession, true, true));
+    EXPECT_EQ(WCL_ERROR_BAD_SESSION, wclSmpSetCompression(clientSession, false));
+
+    for (i = 0; i < 16; i++) {
+        lAppendPublish(batch, "tele/sensor", lJsonTelemetry(i));
+    }
+    plainLength = lExchange(plainClientSession, plainBrokerSession,
+                            WCL_SMP_MESSAGE_MQTTS_BATCH, batch);
+    length = lExchange(clientSession, brokerSession,
+                       WCL_SMP_MESSAGE_MQTTS_BATCH, batch);
+    EXPECT_LT(length, plainLength / 2);
+    length = lExchange(brokerSession, clientSession,
+                       WCL_SMP_MESSAGE_MQTTS_BATCH, batch);
+    EXPECT_LT(length, plainLength / 2);
+
+    /* A single message only shrinks with a dictionary. */
+    lAppendPublish(publish, "tele/sensor", lJsonTelemetry(100));
+    plainLength = lExchange(plainClientSession, plainBrokerSession,
+                            WCL_SMP_MESSAGE_MQTTS_PUBLISH, publish);
+    for (i = 0; i < 4; i++) {
+        auto sample = lJsonTelemetry(i * 7);
+        dictionaryData.append(sample.begin(), sample.end());
+    }
+    dictionary.data = (uint8_t *)dictionaryData.data();
+    dictionary.length = (uint32_t)dictionaryData.size();
+    ASSERT_EQ(WCL_SUCCESS,
+              wclSmpSetCompressionDictionary(1, "tele/", &dictionary));
+    length = lExchange(clientSession, brokerSession,
+                       WCL_SMP_MESSAGE_MQTTS_PUBLISH, publish);
+    EXPECT_LT(length, plainLength * 2 / 3);
+
+    lExchange(clientSession, brokerSession, WCL_SMP_MESSAGE_MQTTS_PUBLISH,
+              shortPacket);
+
+    srand(1);
+    for (i = 0; i < (int)noise.size(); i++) {
+        noise[i] = (uint8_t)rand();
+    }
+    lAppendPublish(noisePacket, "raw/noise", noise);
+    plainLength = lExchange(plainClientSession, plainBrokerSession,
+                            WCL_SMP_MESSAGE_MQTTS_PUBLISH, noisePacket);
+    length = lExchange(clientSession, brokerSession,
+                       WCL_SMP_MESSAGE_MQTTS_PUBLISH, noisePacket);
+    EXPECT_EQ(plainLength + 1, length);
+
+    /* The receiver allocates at most 255 bytes per byte of block. */
+    lAppendPublish(runPacket, "raw/run", std::vector<uint8_t>(1 << 20, 'a'));
+    length = lExchange(clientSession, brokerSession,
+                       WCL_SMP_MESSAGE_MQTTS_PUBLISH, runPacket);
+    EXPECT_LT(length, runPacket.size() / 200);
+
+    EXPECT_EQ(WCL_SUCCESS, wclSmpSetCompressionDictionary(1, NULL, NULL));
+    wclSmpClose(clientSession);
+    wclSmpClose(brokerSession);
+    wclSmpClose(plainClientSession);
+    wclSmpClose(plainBrokerSession);
+}
+
+/* Test a broker declining compression, and a dictionary missing on the
+ * receiving end.
+ *
+ * Step 1- Open and connect a client offering compression to a broker which
+ *         does not accept it, messages are as long as without compression.
+ * Step 2- Open and connect a compressed pair, compress a PUBLISH with a
+ *         dictionary then remove it before processing, it is rejected.
+ * Step 3- Close the sessions.
+ * */
+TEST_F(TestSmp, Negative_Compression)
+{
+    WclSession_t clientSession = WCL_SESSION_INVALID;
+    WclSession_t brokerSession = WCL_SESSION_INVALID;
+    WclSession_t plainClientSession = WCL_SESSION_INVALID;
+    WclSession_t plainBrokerSession = WCL_SESSION_INVALID;
+    std::vector<uint8_t> batch;
+    std::vector<uint8_t> dictionaryData = lJsonTelemetry(0);
+    WosBuffer_t dictionary = {.data = dictionaryData.data(),
+                              .length = (uint32_t)dictionaryData.size()};
+    WosBuffer_t mqttPacket = {.data = NULL, .length = 0};
+    WosBuffer_t smpMessage = {.data = NULL, .length = 0};
+    WosBuffer_t clearPacket = {.data = NULL, .length = 0};
+    int i = 0;
+
+    for (i = 0; i < 16; i++) {
+        lAppendPublish(batch, "tele/sensor", lJsonTelemetry(i));
+    }
+    ASSERT_EQ(WCL_SUCCESS,
+              lOpenAndConnectCompressed(&plainClientSession,
+                                        &plainBrokerSession, false, false));
+    ASSERT_EQ(WCL_SUCCESS, lOpenAndConnectCompressed(
+                               &clientSession, &brokerSession, true, false));
+    EXPECT_EQ(lExchange(plainClientSession, plainBrokerSession,
+                        WCL_SMP_MESSAGE_MQTTS_BATCH, batch),
+              lExchange(clientSession, brokerSession,
+                        WCL_SMP_MESSAGE_MQTTS_BATCH, batch));
+    wclSmpClose(clientSession);
+    wclSmpClose(brokerSession);
+
+    ASSERT_EQ(WCL_SUCCESS, lOpenAndConnectCompressed(
+                               &clientSession, &brokerSession, true, true));
+    ASSERT_EQ(WCL_SUCCESS,
+              wclSmpSetCompressionDictionary(2, "tele/", &dictionary));
+    mqttPacket.data = batch.data();
+    mqttPacket.length = (uint32_t)batch.size();
+    ASSERT_EQ(WCL_SUCCESS,
+              wclSmpGetMessage(clientSession, WCL_SMP_MESSAGE_MQTTS_BATCH,
+                               &mqttPacket, &smpMessage));
+    ASSERT_EQ(WCL_SUCCESS, wclSmpSetCompressionDictionary(2, NULL, NULL));
+    EXPECT_NE(WCL_SUCCESS,
+              wclSmpProcessMessage(brokerSession, &smpMessage, &clearPacket));
+    EXPECT_EQ(nullptr, clearPacket.data);
+
+    wclFreeBuffer(&smpMessage);
+    wclSmpClose(clientSession);
+    wclSmpClose(brokerSession);
+    wclSmpClose(plainClientSession);
+    wclSmpClose(plainBrokerSession);
+}
+
+/* Report the size and rate of compressed and plain telemetry messages, JSON
+ * and CBOR, as single PUBLISH packets and batches of 16, without and with a
+ * dictionary of a few samples. */
+TEST_F(TestSmp, Performance_Compression)
+{
+    const int iterations = 2000;
+    const char *pFormats[] = {"JSON", "CBOR"};
+    std::vector<uint8_t> (*pTelemetry[])(int) = {lJsonTelemetry,
+                                                 lCborTelemetry};
+    const int batchSizes[] = {1, 16};
+    WclSession_t clientSession = WCL_SESSION_INVALID;
+    WclSession_t brokerSession = WCL_SESSION_INVALID;
+    WclSession_t plainClientSession = WCL_SESSION_INVALID;
+    WclSession_t plainBrokerSession = WCL_SESSION_INVALID;
+    std::vector<uint8_t> dictionaryData;
+    WosBuffer_t dictionary = {.data = NULL, .length = 0};
+    int format = 0;
+    int batchSize = 0;
+    int withDictionary = 0;
+    int i = 0;
+    int j = 0;
+
+    ASSERT_EQ(WCL_SUCCESS,
+              lOpenAndConnectCompressed(&plainClientSession,
+                                        &plainBrokerSession, false, false));
+    ASSERT_EQ(WCL_SUCCESS, lOpenAndConnectCompressed(
+                               &clientSession, &brokerSession, true, true));
+
+    for (format = 0; format < 2; format++) {
+        for (withDictionary = 0; withDictionary < 2; withDictionary++) {
+            if (withDictionary) {
+                dictionaryData.clear();
+                for (i = 0; i < 4; i++) {
+                    auto sample = pTelemetry[format](i * 7);
+                    dictionaryData.insert(dictionaryData.end(),
+                                          sample.begin(), sample.end());
+                }
+                dictionary.data = dictionaryData.data();
+                dictionary.length = (uint32_t)dictionaryData.size();
+                ASSERT_EQ(WCL_SUCCESS, wclSmpSetCompressionDictionary(
+                                           1, "tele/", &dictionary));
+            }
+            for (batchSize = 0; batchSize < 2; batchSize++) {
+                size_t plainBytes = 0;
+                size_t bytes = 0;
+                size_t packetBytes = 0;
+                std::chrono::steady_clock::duration plainTime{0};
+                std::chrono::steady_clock::duration time{0};
+
+                for (i = 0; i < iterations; i++) {
+                    std::vector<uint8_t> packet;
+                    for (j = 0; j < batchSizes[batchSize]; j++) {
+                        lAppendPublish(packet, "tele/sensor",
+                                       pTelemetry[format](i * 16 + j));
+                    }
+                    packetBytes = packet.size();
+                    WclSmpMessageType_t messageType =
+                        (1 == batchSizes[batchSize])
+                            ? WCL_SMP_MESSAGE_MQTTS_PUBLISH
+                            : WCL_SMP_MESSAGE_MQTTS_BATCH;
+                    auto start = std::chrono::steady_clock::now();
+                    plainBytes += lExchange(plainClientSession,
+                                            plainBrokerSession, messageType,
+                                            packet);
+                    auto middle = std::chrono::steady_clock::now();
+                    bytes += lExchange(clientSession, brokerSession,
+                                       messageType, packet);
+                    time += std::chrono::steady_clock::now() - middle;
+                    plainTime += middle - start;
+                }
+                printf("%s x%d%s: %.1f -> %.1f bytes (%.0f%%), "
+                       "%.2f -> %.2f us per message\n",
+                       pFormats[format], batchSizes[batchSize],
+                       withDictionary ? " with dictionary" : "",
+                       (double)plainBytes / iterations,
+                       (double)bytes / iterations, 100.0 * bytes / plainBytes,
+                       std::chrono::duration<double, std::micro>(plainTime)
+                               .count() /
+                           iterations,
+                       std::chrono::duration<double, std::micro>(time)
+                               .count() /
+                           iterations);
+                /* Packets under the threshold are never compressed. */
+                if ((16 == batchSizes[batchSize]) ||
+                    (withDictionary &&
+                     (packetBytes >= WCL_SMP_COMPRESSION_MIN_BYTES))) {
+                    EXPECT_LT(bytes, plainBytes);
+                }
+            }
+        }
+    }
+
+    wclSmpSetCompressionDictionary(1, NULL, NULL);
+    wclSmpClose(clientSession);
+    wclSmpClose(brokerSession);
+    wclSmpClose(plainClientSession);
+    wclSmpClose(plainBrokerSession);
+}
+
+/* Compare the rate of full and resumed session establishments. */
+TEST_F(TestSmp, Performance_HandshakeRate)
+{
+    const int iterations = 50;
+    WclSession_t clientSession = WCL_SESSION_INVALID;
+    WclSession_t brokerSession = WCL_SESSION_INVALID;
+    WosBuffer_t ticket = {.data = NULL, .length = 0};
+    int i = 0;
+
+    ASSERT_EQ(WCL_SUCCESS, wclSmpRotateTicketKey(NULL, 3600));
+
+    auto start = std::chrono::steady_clock::now();
+    for (i = 0; i < iterations; i++) {
+        ASSERT_EQ(WCL_SUCCESS,
+                  lOpenAndConnect(&clientSession, &brokerSession, NULL));
+        if (NULL == ticket.data) {
+            ASSERT_EQ(WCL_SUCCESS, wclSmpExportTicket(clientSession, &ticket));
+        }
+        wclSmpClose(clientSession);
+        wclSmpClose(brokerSession);
+    }
+    auto full = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < iterations; i++) {
+        ASSERT_EQ(WCL_SUCCESS,
+                  lOpenAndConnect(&clientSession, &brokerSession, &ticket));
+        wclSmpClose(clientSession);
+        wclSmpClose(brokerSession);
+    }
+    auto resumed = std::chrono::steady_clock::now() - start;
+
+    printf("full handshake: %.1f /s, resumed handshake: %.1f /s\n",
+           iterations / std::chrono::duration<double>(full).count(),
+           iterations / std::chrono::duration<double>(resumed).count());
+    EXPECT_LT(resumed, full);
+
+    wclFreeBuffer(&ticket);
+}
+
+/* Test building the messages of several sessions in one call.
+ *
+ * Step 1- Establish a few sessions.
+ * Step 2- Build PUBLISH messages for all of them in one call, one request
+ *         having an invalid session.
+ * Step 3- The other requests succeed and their receivers process them.
+ * */
+TEST_F(TestSmp, Trivial_GetMessages)
+{
+    const uint32_t numSessions = 4;
+    const uint32_t numMessages = 3;
+    WclSession_t clientSessions[numSessions];
+    WclSession_t brokerSessions[numSessions];
+    WosBuffer_t mqttPacket = {.data = (uint8_t *)MQTT_MESSAGE,
+                              .length = (uint32_t)strlen(MQTT_MESSAGE)};
+    std::vector<WclSmpMessageRequest_t> requests;
+    WclSmpMessageRequest_t request = {};
+    WosBuffer_t clearPacket = {.data = NULL, .length = 0};
+    uint32_t i = 0;
+    uint32_t j = 0;
+
+    for (i = 0; i < numSessions; i++) {
+        ASSERT_EQ(WCL_SUCCESS, lOpenAndConnect(&clientSessions[i],
+                                               &brokerSessions[i], NULL));
+    }
+    /* Interleaved like a fan-out, the messages of a session in order. */
+    request.messageType = WCL_SMP_MESSAGE_MQTTS_PUBLISH;
+    request.pStdProtocolPacket = &mqttPacket;
+    for (j = 0; j < numMessages; j++) {
+        for (i = 0; i < numSessions; i++) {
+            request.smpSession = brokerSessions[i];
+            requests.push_back(request);
+        }
+    }
+    request.smpSession = WCL_SESSION_INVALID;
+    requests.insert(requests.begin() + 1, request);
+
+    EXPECT_EQ(WCL_ERROR_BAD_SESSION,
+              wclSmpGetMessages(requests.data(), requests.size()));
+    EXPECT_EQ(WCL_ERROR_BAD_SESSION, requests[1].result);
+    EXPECT_EQ(NULL, requests[1].smpMessage.data);
+    requests.erase(requests.begin() + 1);
+
+    for (j = 0; j < requests.size(); j++) {
+        ASSERT_EQ(WCL_SUCCESS, requests[j].result);
+        ASSERT_EQ(WCL_SUCCESS,
+                  wclSmpProcessMessage(clientSessions[j % numSessions],
+                                       &requests[j].smpMessage, &clearPacket));
+        ASSERT_EQ(mqttPacket.length, clearPacket.length);
+        EXPECT_EQ(0,
+                  memcmp(mqttPacket.data, clearPacket.data, mqttPacket.length));
+        wclFreeBuffer(&clearPacket);
+        wclFreeBuffer(&requests[j].smpMessage);
+    }
+
+    for (i = 0; i < numSessions; i++) {
+        wclSmpClose(clientSessions[i]);
+        wclSmpClose(brokerSessions[i]);
+    }
+}
+
+/* Compare building the messages of a fan-out one call at a time and in one
+ * call. */
+TEST_F(TestSmp, Performance_GetMessages)
+{
+    const uint32_t numSessions = 16;
+    const uint32_t numMessages = 500;
+    WclSession_t clientSessions[numSessions];
+    WclSession_t brokerSessions[numSessions];
+    std::vector<uint8_t> payload = lJsonTelemetry(0);
+    WosBuffer_t mqttPacket = {.data = payload.data(),
+                              .length = (uint32_t)payload.size()};
+    std::vector<WclSmpMessageRequest_t> requests(numSessions);
+    WosBuffer_t smpMessage = {.data = NULL, .length = 0};
+    uint32_t i = 0;
+    uint32_t j = 0;
+
+    for (i = 0; i < numSessions; i++) {
+        ASSERT_EQ(WCL_SUCCESS, lOpenAndConnect(&clientSessions[i],
+                                               &brokerSessions[i], NULL));
+        requests[i].smpSession = brokerSessions[i];
+        requests[i].messageType = WCL_SMP_MESSAGE_MQTTS_PUBLISH;
+        requests[i].pStdProtocolPacket = &mqttPacket;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (j = 0; j < numMessages; j++) {
+        for (i = 0; i < numSessions; i++) {
+            ASSERT_EQ(WCL_SUCCESS,
+                      wclSmpGetMessage(brokerSessions[i],
+                                       WCL_SMP_MESSAGE_MQTTS_PUBLISH,
+                                       &mqttPacket, &smpMessage));
+            wclFreeBuffer(&smpMessage);
+        }
+    }
+    auto single = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (j = 0; j < numMessages; j++) {
+        ASSERT_EQ(WCL_SUCCESS,
+                  wclSmpGetMessages(requests.data(), requests.size()));
+        for (i = 0; i < numSessions; i++) {
+            wclFreeBuffer(&requests[i].smpMessage);
+        }
+    }
+    auto batched = std::chrono::steady_clock::now() - start;
+
+    printf("one call per message: %.1f msg/s, one call per fan-out: %.1f "
+           "msg/s\n",
+           numSessions * numMessages /
+               std::chrono::duration<double>(single).count(),
+           numSessions * numMessages /
+               std::chrono::duration<double>(batched).count());
+
+    for (i = 0; i < numSessions; i++) {
+        wclSmpClose(clientSessions[i]);
+        wclSmpClose(brokerSessions[i]);
+    }
+}
+
+/* Executor keeping the jobs for the test to run them. */
+struct TestExecutor {
+    std::vector<std::pair<WclSmpJobFunction_t, void *>> jobs;
+    std::atomic<uint32_t> numNotified;
+};
+
+static WclError_t lTestExecutorSubmit(void *pContext,
+                                      WclSmpJobFunction_t jobFunction,
+                                      void *pJob)
+{
+    ((TestExecutor *)pContext)->jobs.emplace_back(jobFunction, pJob);
+    return WCL_SUCCESS;
+}
+
+static void lTestExecutorNotify(void *pContext)
+{
+    ((TestExecutor *)pContext)->numNotified++;
+}
+
+/* Keep the completion given to the callback. */
+static void lKeepCompletion(WclSmpCompletion_t *pCompletion)
+{
+    *(WclSmpCompletion_t *)pCompletion->pUserData = *pCompletion;
+}
+
+/* Test the asynchronous API with the default executor.
+ *
+ * Step 1- Establish a session.
+ * Step 2- Build a PUBLISH message, its completion is given to the callback
+ *         before the submission returns.
+ * Step 3- Process it without a callback and poll the completion.
+ * */
+TEST_F(TestSmp, Trivial_AsyncMessages)
+{
+    WclSession_t clientSession = WCL_SESSION_INVALID;
+    WclSession_t brokerSession = WCL_SESSION_INVALID;
+    WosBuffer_t mqttPacket = {.data = (uint8_t *)MQTT_MESSAGE,
+                              .length = (uint32_t)strlen(MQTT_MESSAGE)};
+    WclSmpCompletion_t sent = {};
+    WclSmpCompletion_t received = {};
+    bool hasCompletion = false;
+    int userData = 0;
+
+    ASSERT_EQ(WCL_SUCCESS,
+              lOpenAndConnect(&clientSession, &brokerSession, NULL));
+
+    ASSERT_EQ(WCL_SUCCESS,
+              wclSmpGetMessageAsync(clientSession,
+                                    WCL_SMP_MESSAGE_MQTTS_PUBLISH, &mqttPacket,
+                                    lKeepCompletion, &sent));
+    EXPECT_EQ(clientSession, sent.smpSession);
+    ASSERT_EQ(WCL_SUCCESS, sent.result);
+    EXPECT_EQ(&sent, sent.pUserData);
+
+    ASSERT_EQ(WCL_SUCCESS, wclSmpProcessMessageAsync(
+                               brokerSession, &sent.output, NULL, &userData));
+    ASSERT_EQ(WCL_SUCCESS, wclSmpPollCompletion(&received, &hasCompletion));
+    ASSERT_TRUE(hasCompletion);
+    EXPECT_EQ(brokerSession, received.smpSession);
+    ASSERT_EQ(WCL_SUCCESS, received.result);
+    EXPECT_EQ(&userData, received.pUserData);
+    ASSERT_EQ(mqttPacket.length, received.output.length);
+    EXPECT_EQ(0, memcmp(mqttPacket.data, received.output.data,
+                        mqttPacket.length));
+    ASSERT_EQ(WCL_SUCCESS, wclSmpPollCompletion(&received, &hasCompletion));
+    EXPECT_FALSE(hasCompletion);
+
+    wclFreeBuffer(&sent.output);
+    wclFreeBuffer(&received.output);
+    wclSmpClose(clientSession);
+    wclSmpClose(brokerSession);
+}
+
+/* Test the asynchronous API with an executor running the jobs on threads.
+ *
+ * Step 1- Establish a session and build PUBLISH messages.
+ * Step 2- Submit them for processing, the session cannot be closed while
+ *         they are pending.
+ * Step 3- Run the jobs on several threads.
+ * Step 4- Poll the completions, each one notified.
+ * */
+TEST_F(TestSmp, Trivial_AsyncExecutor)
+{
+    const uint32_t count = 400;
+    const uint32_t numThreads = 4;
+    const uint32_t windowSize = 32;
+    WclSession_t clientSession = WCL_SESSION_INVALID;
+    WclSession_t brokerSession = WCL_SESSION_INVALID;
+    WosBuffer_t mqttPacket = {.data = (uint8_t *)MQTT_MESSAGE,
+                              .length = (uint32_t)strlen(MQTT_MESSAGE)};
+    std::vector<WosBuffer_t> smpMessages(count);
+    std::vector<bool> isCompleted(count, false);
+    std::vector<std::thread> threads;
+    TestExecutor executor;
+    WclSmpExecutor_t wclExecutor = {lTestExecutorSubmit, lTestExecutorNotify,
+                                    &executor};
+    WclSmpCompletion_t completion = {};
+    bool hasCompletion = false;
+    uint32_t i = 0;
+
+    executor.numNotified = 0;
+    ASSERT_EQ(WCL_SUCCESS,
+              lOpenAndConnect(&clientSession, &brokerSession, NULL));
+    for (i = 0; i < count; i++) {
+        smpMessages[i] = {.data = NULL, .length = 0};
+        ASSERT_EQ(WCL_SUCCESS,
+                  wclSmpGetMessage(clientSession, WCL_SMP_MESSAGE_MQTTS_PUBLISH,
+                                   &mqttPacket, &smpMessages[i]));
+    }
+
+    ASSERT_EQ(WCL_SUCCESS, wclSmpSetExecutor(&wclExecutor));
+    for (i = 0; i < count; i++) {
+        ASSERT_EQ(WCL_SUCCESS,
+                  wclSmpProcessMessageAsync(brokerSession, &smpMessages[i],
+                                            NULL, &smpMessages[i]));
+    }
+    ASSERT_EQ(count, executor.jobs.size());
+    ASSERT_EQ(WCL_SUCCESS, wclSmpPollCompletion(&completion, &hasCompletion));
+    EXPECT_FALSE(hasCompletion);
+    EXPECT_EQ(WCL_ERROR_BAD_SESSION, wclSmpClose(brokerSession));
+
+    /* The broker accepts messages up to its replay window behind the newest
+     * one, so the threads share out the jobs a window at a time. */
+    for (uint32_t round = 0; round < count; round += windowSize) {
+        threads.clear();
+        for (i = 0; i < numThreads; i++) {
+            threads.emplace_back([&](uint32_t first) {
+                for (uint32_t j = round + first;
+                     (j < count) && (j < round + windowSize);
+                     j += numThreads) {
+                    executor.jobs[j].first(executor.jobs[j].second);
+                }
+            }, i);
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+    EXPECT_EQ(count, executor.numNotified.load());
+
+    for (i = 0; i < count; i++) {
+        ASSERT_EQ(WCL_SUCCESS,
+                  wclSmpPollCompletion(&completion, &hasCompletion));
+        ASSERT_TRUE(hasCompletion);
+        EXPECT_EQ(WCL_SUCCESS, completion.result);
+        EXPECT_EQ(mqttPacket.length, completion.output.length);
+        isCompleted[(WosBuffer_t *)completion.pUserData - &smpMessages[0]] =
+            true;
+        wclFreeBuffer(&completion.output);
+    }
+    ASSERT_EQ(WCL_SUCCESS, wclSmpPollCompletion(&completion, &hasCompletion));
+    EXPECT_FALSE(hasCompletion);
+    for (i = 0; i < count; i++) {
+        EXPECT_TRUE(isCompleted[i]);
+        wclFreeBuffer(&smpMessages[i]);
+    }
+
+    ASSERT_EQ(WCL_SUCCESS, wclSmpSetExecutor(NULL));
+    EXPECT_EQ(WCL_SUCCESS, wclSmpClose(clientSession));
+    EXPECT_EQ(WCL_SUCCESS, wclSmpClose(brokerSession));
+}
+
 } // namespace
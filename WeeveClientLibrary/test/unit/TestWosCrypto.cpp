@@ -960,4 +960,422 @@ TEST_F(TestWosCrypto, NegativeAe)
     tag = {.data = aesGcmTests[i].T, .length = WOS_CRYPTO_AE_AES_BLOCK_LENGTH};
 }
 
+/* ========================================================================== */
+/*                         wosCryptoEccGenerateKeyBuffer                      */
+/*                         wosCryptoDeriveSymKeyBuffer                        */
+/* ========================================================================== */
+
+TEST_F(TestWosCrypto, TrivialEccKeyBuffer)
+{
+    WosCryptoError_t cryptoError = WOS_CRYPTO_ERROR;
+    WosCryptoEccOptions_t eccOptions;
+    uint8_t privateKeyData[WOS_CRYPTO_ECC_NIST_P256_KEY_LENGTH];
+    uint8_t publicKeyData[WOS_CRYPTO_ECC_NIST_P256_PUBLIC_KEY_LENGTH];
+    uint8_t symKeyData[WOS_CRYPTO_ECC_NIST_P256_SHARED_SECRET_LENGTH];
+    uint8_t otherSymKeyData[WOS_CRYPTO_ECC_NIST_P256_SHARED_SECRET_LENGTH];
+    WosBuffer_t privateKey, publicKey, symKey, otherSymKey;
+    WosBuffer_t devicePrivateKey, serverPublicKey;
+    int ret;
+
+    /* Known keys give the known shared secret */
+    devicePrivateKey = {.data = alicePrivateKey,
+                        .length = sizeof(alicePrivateKey)};
+    serverPublicKey = {.data = bobPublicKey, .length = sizeof(bobPublicKey)};
+    symKey = {.data = symKeyData, .length = sizeof(symKeyData)};
+    cryptoError = wosCryptoDeriveSymKeyBuffer(&eccOptions, &serverPublicKey,
+                                              &devicePrivateKey, &symKey);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_SUCCESS);
+    EXPECT_EQ(symKey.length, sizeof(sharedSecret));
+    ret = wosMemComparison(symKey.data, sharedSecret, sizeof(sharedSecret));
+    EXPECT_EQ(ret, 0);
+
+    /* A generated key pair agrees with the other party */
+    privateKey = {.data = privateKeyData, .length = sizeof(privateKeyData)};
+    publicKey = {.data = publicKeyData, .length = sizeof(publicKeyData)};
+    cryptoError =
+        wosCryptoEccGenerateKeyBuffer(&eccOptions, &privateKey, &publicKey);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_SUCCESS);
+    EXPECT_EQ(publicKey.length, WOS_CRYPTO_ECC_NIST_P256_PUBLIC_KEY_LENGTH);
+
+    symKey = {.data = symKeyData, .length = sizeof(symKeyData)};
+    cryptoError = wosCryptoDeriveSymKeyBuffer(&eccOptions, &serverPublicKey,
+                                              &privateKey, &symKey);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_SUCCESS);
+    devicePrivateKey = {.data = bobPrivateKey, .length = sizeof(bobPrivateKey)};
+    otherSymKey = {.data = otherSymKeyData, .length = sizeof(otherSymKeyData)};
+    cryptoError = wosCryptoDeriveSymKeyBuffer(&eccOptions, &publicKey,
+                                              &devicePrivateKey, &otherSymKey);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_SUCCESS);
+    EXPECT_EQ(symKey.length, otherSymKey.length);
+    ret = wosMemComparison(symKey.data, otherSymKey.data, symKey.length);
+    EXPECT_EQ(ret, 0);
+}
+
+TEST_F(TestWosCrypto, NegativeEccKeyBuffer)
+{
+    WosCryptoError_t cryptoError = WOS_CRYPTO_ERROR;
+    WosCryptoEccOptions_t eccOptions;
+    uint8_t privateKeyData[WOS_CRYPTO_ECC_NIST_P256_KEY_LENGTH];
+    uint8_t publicKeyData[WOS_CRYPTO_ECC_NIST_P256_PUBLIC_KEY_LENGTH];
+    uint8_t symKeyData[WOS_CRYPTO_ECC_NIST_P256_SHARED_SECRET_LENGTH];
+    WosBuffer_t privateKey, publicKey, symKey;
+    WosBuffer_t devicePrivateKey, serverPublicKey;
+
+    privateKey = {.data = privateKeyData, .length = sizeof(privateKeyData)};
+    publicKey = {.data = publicKeyData, .length = sizeof(publicKeyData)};
+    cryptoError = wosCryptoEccGenerateKeyBuffer(&eccOptions, NULL, &publicKey);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_ERROR_BAD_PARAMS);
+    cryptoError = wosCryptoEccGenerateKeyBuffer(&eccOptions, &privateKey, NULL);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_ERROR_BAD_PARAMS);
+    publicKey = {.data = publicKeyData, .length = sizeof(publicKeyData) - 1};
+    cryptoError =
+        wosCryptoEccGenerateKeyBuffer(&eccOptions, &privateKey, &publicKey);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_ERROR_BAD_PARAMS);
+
+    devicePrivateKey = {.data = alicePrivateKey,
+                        .length = sizeof(alicePrivateKey)};
+    serverPublicKey = {.data = bobPublicKey, .length = sizeof(bobPublicKey)};
+    symKey = {.data = symKeyData, .length = sizeof(symKeyData)};
+    cryptoError = wosCryptoDeriveSymKeyBuffer(&eccOptions, NULL,
+                                              &devicePrivateKey, &symKey);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_ERROR_BAD_PARAMS);
+    cryptoError = wosCryptoDeriveSymKeyBuffer(&eccOptions, &serverPublicKey,
+                                              NULL, &symKey);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_ERROR_BAD_PARAMS);
+    cryptoError = wosCryptoDeriveSymKeyBuffer(&eccOptions, &serverPublicKey,
+                                              &devicePrivateKey, NULL);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_ERROR_BAD_PARAMS);
+    symKey = {.data = symKeyData, .length = sizeof(symKeyData) - 1};
+    cryptoError = wosCryptoDeriveSymKeyBuffer(&eccOptions, &serverPublicKey,
+                                              &devicePrivateKey, &symKey);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_ERROR_BAD_PARAMS);
+}
+
+/* ========================================================================== */
+/*                         wosCryptoAeEncryptKeyBuffer                        */
+/*                         wosCryptoAeDecryptKeyBuffer                        */
+/* ========================================================================== */
+
+TEST_F(TestWosCrypto, TrivialAeKeyBuffer)
+{
+    WosCryptoError_t cryptoError = WOS_CRYPTO_ERROR;
+    WosCryptoAeOptions_t aeOptions;
+    WosBuffer_t *pPlainText = NULL, *pCipherText = NULL, *pIv = NULL,
+                *pTag = NULL;
+    WosBuffer_t plainText, aad, cipherText, tag, iv;
+    WosBuffer_t symKey;
+    int ret;
+    unsigned int i;
+
+    for (i = 0; i < (int)(sizeof(aesGcmTests) / sizeof(aesGcmTests[0])); ++i) {
+        symKey = {.data = aesGcmTests[i].K, .length = aesGcmTests[i].keylen};
+
+        /***** Encrypt *****/
+        plainText = {.data = aesGcmTests[i].P, .length = aesGcmTests[i].ptlen};
+        aad = {.data = aesGcmTests[i].A, .length = aesGcmTests[i].alen};
+        iv = {.data = aesGcmTests[i].IV, .length = aesGcmTests[i].IVlen};
+        pIv = &iv;
+
+        cryptoError =
+            wosCryptoAeEncryptKeyBuffer(&aeOptions, &symKey, &plainText, &aad,
+                                        &pIv, &pCipherText, &pTag);
+        EXPECT_EQ(cryptoError, WOS_CRYPTO_SUCCESS);
+
+        EXPECT_EQ(pCipherText->length, aesGcmTests[i].ptlen);
+        if (pCipherText->length != 0) {
+            ret = wosMemComparison(pCipherText->data, aesGcmTests[i].C,
+                                   pCipherText->length);
+            EXPECT_EQ(ret, 0);
+        }
+        EXPECT_EQ(pTag->length, WOS_CRYPTO_AE_AES_BLOCK_LENGTH);
+        ret = wosMemComparison(pTag->data, aesGcmTests[i].T, pTag->length);
+        EXPECT_EQ(ret, 0);
+
+        WOS_FREE_BUF_AND_DATA(pCipherText);
+        WOS_FREE_BUF_AND_DATA(pTag);
+
+        /***** Decrypt *****/
+        cipherText = {.data = aesGcmTests[i].C, .length = aesGcmTests[i].ptlen};
+        tag = {.data = aesGcmTests[i].T,
+               .length = WOS_CRYPTO_AE_AES_BLOCK_LENGTH};
+
+        cryptoError = wosCryptoAeDecryptKeyBuffer(
+            &aeOptions, &symKey, &cipherText, &aad, pIv, &tag, &pPlainText);
+        EXPECT_EQ(cryptoError, WOS_CRYPTO_SUCCESS);
+
+        EXPECT_EQ(pPlainText->length, aesGcmTests[i].ptlen);
+        if (pPlainText->length != 0) {
+            ret = wosMemComparison(pPlainText->data, aesGcmTests[i].P,
+                                   pPlainText->length);
+            EXPECT_EQ(ret, 0);
+        }
+
+        WOS_FREE_BUF_AND_DATA(pPlainText);
+    }
+}
+
+TEST_F(TestWosCrypto, NegativeAeKeyBuffer)
+{
+    WosCryptoError_t cryptoError = WOS_CRYPTO_ERROR;
+    WosCryptoAeOptions_t aeOptions;
+    WosBuffer_t *pPlainText = NULL, *pCipherText = NULL, *pIv = NULL,
+                *pTag = NULL;
+    WosBuffer_t plainText, aad, cipherText, tag, iv;
+    WosBuffer_t symKey;
+
+    int i = 4; /* The first "Normal" case, with both PT and AAD */
+
+    plainText = {.data = aesGcmTests[i].P, .length = aesGcmTests[i].ptlen};
+    aad = {.data = aesGcmTests[i].A, .length = aesGcmTests[i].alen};
+    iv = {.data = aesGcmTests[i].IV, .length = aesGcmTests[i].IVlen};
+    pIv = &iv;
+    cipherText = {.data = aesGcmTests[i].C, .length = aesGcmTests[i].ptlen};
+    tag = {.data = aesGcmTests[i].T, .length = WOS_CRYPTO_AE_AES_BLOCK_LENGTH};
+
+    /* Missing key */
+    cryptoError = wosCryptoAeEncryptKeyBuffer(
+        &aeOptions, NULL, &plainText, &aad, &pIv, &pCipherText, &pTag);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_ERROR_BAD_PARAMS);
+    cryptoError = wosCryptoAeDecryptKeyBuffer(&aeOptions, NULL, &cipherText,
+                                              &aad, &iv, &tag, &pPlainText);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_ERROR_BAD_PARAMS);
+
+    /* Key of the wrong length */
+    symKey = {.data = aesGcmTests[i].K, .length = aesGcmTests[i].keylen - 1};
+    cryptoError = wosCryptoAeEncryptKeyBuffer(
+        &aeOptions, &symKey, &plainText, &aad, &pIv, &pCipherText, &pTag);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_ERROR_BAD_PARAMS);
+    cryptoError = wosCryptoAeDecryptKeyBuffer(&aeOptions, &symKey, &cipherText,
+                                              &aad, &iv, &tag, &pPlainText);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_ERROR_BAD_PARAMS);
+
+    /* Wrong tag */
+    symKey = {.data = aesGcmTests[i].K, .length = aesGcmTests[i].keylen};
+    tag = {.data = aesGcmTests[i - 1].T,
+           .length = WOS_CRYPTO_AE_AES_BLOCK_LENGTH};
+    cryptoError = wosCryptoAeDecryptKeyBuffer(&aeOptions, &symKey, &cipherText,
+                                              &aad, &iv, &tag, &pPlainText);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_ERROR);
+}
+
+/* ========================================================================== */
+/*                         wosCryptoAeEncryptMulti                            */
+/* ========================================================================== */
+
+TEST_F(TestWosCrypto, TrivialAeMulti)
+{
+    WosCryptoError_t cryptoError = WOS_CRYPTO_ERROR;
+    WosCryptoAeOptions_t aeOptions;
+    const size_t numVectors = sizeof(aesGcmTests) / sizeof(aesGcmTests[0]);
+    /* More than one group of the multi-buffer kernel, with lengths ending
+     * on and off a block boundary. */
+    const size_t numJobs = 37;
+    WosCryptoAeJob_t jobs[numJobs];
+    WosBuffer_t symKeys[numJobs], plainTexts[numJobs], aads[numJobs],
+        ivs[numJobs];
+    uint8_t keyData[numJobs][WOS_CRYPTO_AE_AES256_KEY_LENGTH];
+    uint8_t plainData[numJobs][300];
+    uint8_t aadData[numJobs][40];
+    uint8_t ivData[numJobs][WOS_CRYPTO_AE_AES_GCM_IV_LENGTH];
+    WosBuffer_t *pCipherText = NULL, *pIv = NULL, *pTag = NULL;
+    int ret;
+    size_t i;
+
+    /* The test vectors, both with 12 bytes and longer ivs. */
+    for (i = 0; i < numVectors; ++i) {
+        symKeys[i] = {.data = aesGcmTests[i].K,
+                      .length = aesGcmTests[i].keylen};
+        plainTexts[i] = {.data = aesGcmTests[i].P,
+                         .length = aesGcmTests[i].ptlen};
+        aads[i] = {.data = aesGcmTests[i].A, .length = aesGcmTests[i].alen};
+        ivs[i] = {.data = aesGcmTests[i].IV, .length = aesGcmTests[i].IVlen};
+        jobs[i] = {.pKeyBuf = &symKeys[i],
+                   .pPlainText = &plainTexts[i],
+                   .pAad = &aads[i],
+                   .pIv = &ivs[i]};
+    }
+    cryptoError = wosCryptoAeEncryptMulti(&aeOptions, jobs, numVectors);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_SUCCESS);
+    for (i = 0; i < numVectors; ++i) {
+        EXPECT_EQ(jobs[i].result, WOS_CRYPTO_SUCCESS);
+        EXPECT_EQ(jobs[i].pIv, &ivs[i]);
+        EXPECT_EQ(jobs[i].pCipherText->length, aesGcmTests[i].ptlen);
+        if (jobs[i].pCipherText->length != 0) {
+            ret = wosMemComparison(jobs[i].pCipherText->data, aesGcmTests[i].C,
+                                   jobs[i].pCipherText->length);
+            EXPECT_EQ(ret, 0);
+        }
+        EXPECT_EQ(jobs[i].pTag->length, WOS_CRYPTO_AE_AES_BLOCK_LENGTH);
+        ret = wosMemComparison(jobs[i].pTag->data, aesGcmTests[i].T,
+                               jobs[i].pTag->length);
+        EXPECT_EQ(ret, 0);
+        WOS_FREE_BUF_AND_DATA(jobs[i].pCipherText);
+        WOS_FREE_BUF_AND_DATA(jobs[i].pTag);
+    }
+
+    /* Random messages, bit for bit the same as one by one. */
+    for (i = 0; i < numJobs; ++i) {
+        symKeys[i] = {.data = keyData[i], .length = sizeof(keyData[i])};
+        EXPECT_EQ(wosCryptoGetRandomBytes(&symKeys[i]), WOS_CRYPTO_SUCCESS);
+        plainTexts[i] = {.data = plainData[i], .length = sizeof(plainData[i])};
+        EXPECT_EQ(wosCryptoGetRandomBytes(&plainTexts[i]), WOS_CRYPTO_SUCCESS);
+        plainTexts[i].length = (uint32_t)((i * 37) % sizeof(plainData[i]));
+        aads[i] = {.data = aadData[i], .length = sizeof(aadData[i])};
+        EXPECT_EQ(wosCryptoGetRandomBytes(&aads[i]), WOS_CRYPTO_SUCCESS);
+        aads[i].length = (uint32_t)((i * 7) % sizeof(aadData[i]));
+        ivs[i] = {.data = ivData[i], .length = sizeof(ivData[i])};
+        EXPECT_EQ(wosCryptoGetRandomBytes(&ivs[i]), WOS_CRYPTO_SUCCESS);
+        jobs[i] = {.pKeyBuf = &symKeys[i],
+                   .pPlainText = &plainTexts[i],
+                   .pAad = (aads[i].length != 0) ? &aads[i] : NULL,
+                   /* Generated for some of the messages. */
+                   .pIv = (i % 5 != 0) ? &ivs[i] : NULL};
+    }
+    cryptoError = wosCryptoAeEncryptMulti(&aeOptions, jobs, numJobs);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_SUCCESS);
+    for (i = 0; i < numJobs; ++i) {
+        EXPECT_EQ(jobs[i].result, WOS_CRYPTO_SUCCESS);
+        ASSERT_TRUE(WOS_IS_VALID_BUFFER(jobs[i].pIv));
+        EXPECT_EQ(jobs[i].pIv->length, WOS_CRYPTO_AE_AES_GCM_IV_LENGTH);
+
+        pIv = jobs[i].pIv;
+        cryptoError = wosCryptoAeEncryptKeyBuffer(
+            &aeOptions, &symKeys[i], &plainTexts[i], jobs[i].pAad, &pIv,
+            &pCipherText, &pTag);
+        EXPECT_EQ(cryptoError, WOS_CRYPTO_SUCCESS);
+        EXPECT_EQ(jobs[i].pCipherText->length, pCipherText->length);
+        if (pCipherText->length != 0) {
+            ret = wosMemComparison(jobs[i].pCipherText->data,
+                                   pCipherText->data, pCipherText->length);
+            EXPECT_EQ(ret, 0);
+        }
+        ret = wosMemComparison(jobs[i].pTag->data, pTag->data,
+                               WOS_CRYPTO_AE_AES_BLOCK_LENGTH);
+        EXPECT_EQ(ret, 0);
+
+        WOS_FREE_BUF_AND_DATA(pCipherText);
+        WOS_FREE_BUF_AND_DATA(pTag);
+        WOS_FREE_BUF_AND_DATA(jobs[i].pCipherText);
+        WOS_FREE_BUF_AND_DATA(jobs[i].pTag);
+        if (jobs[i].pIv != &ivs[i]) {
+            WOS_FREE_BUF_AND_DATA(jobs[i].pIv);
+        }
+    }
+}
+
+TEST_F(TestWosCrypto, NegativeAeMulti)
+{
+    WosCryptoError_t cryptoError = WOS_CRYPTO_ERROR;
+    WosCryptoAeOptions_t aeOptions;
+    WosCryptoAeJob_t jobs[2];
+    WosBuffer_t plainText, aad, iv;
+    WosBuffer_t symKey, shortKey;
+
+    int i = 4; /* The first "Normal" case, with both PT and AAD */
+
+    symKey = {.data = aesGcmTests[i].K, .length = aesGcmTests[i].keylen};
+    shortKey = {.data = aesGcmTests[i].K, .length = aesGcmTests[i].keylen - 1};
+    plainText = {.data = aesGcmTests[i].P, .length = aesGcmTests[i].ptlen};
+    aad = {.data = aesGcmTests[i].A, .length = aesGcmTests[i].alen};
+    iv = {.data = aesGcmTests[i].IV, .length = aesGcmTests[i].IVlen};
+
+    /* Missing jobs */
+    cryptoError = wosCryptoAeEncryptMulti(&aeOptions, NULL, 1);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_ERROR_BAD_PARAMS);
+    cryptoError = wosCryptoAeEncryptMulti(&aeOptions, NULL, 0);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_SUCCESS);
+
+    /* Key of the wrong length, the other job is still encrypted */
+    jobs[0] = {.pKeyBuf = &shortKey,
+               .pPlainText = &plainText,
+               .pAad = &aad,
+               .pIv = NULL};
+    jobs[1] = {.pKeyBuf = &symKey,
+               .pPlainText = &plainText,
+               .pAad = &aad,
+               .pIv = &iv};
+    cryptoError = wosCryptoAeEncryptMulti(&aeOptions, jobs, 2);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_ERROR_BAD_PARAMS);
+    EXPECT_EQ(jobs[0].result, WOS_CRYPTO_ERROR_BAD_PARAMS);
+    EXPECT_EQ(jobs[0].pIv, (WosBuffer_t *)NULL);
+    EXPECT_EQ(jobs[0].pCipherText, (WosBuffer_t *)NULL);
+    EXPECT_EQ(jobs[0].pTag, (WosBuffer_t *)NULL);
+    EXPECT_EQ(jobs[1].result, WOS_CRYPTO_SUCCESS);
+    EXPECT_EQ(wosMemComparison(jobs[1].pTag->data, aesGcmTests[i].T,
+                               WOS_CRYPTO_AE_AES_BLOCK_LENGTH),
+              0);
+    WOS_FREE_BUF_AND_DATA(jobs[1].pCipherText);
+    WOS_FREE_BUF_AND_DATA(jobs[1].pTag);
+}
+
+/* ========================================================================== */
+/*                               wosCryptoHkdf                                */
+/* ========================================================================== */
+
+/* RFC 5869 Appendix A, test cases 1 and 3. */
+TEST_F(TestWosCrypto, TrivialHkdf)
+{
+    WosCryptoError_t cryptoError = WOS_CRYPTO_ERROR;
+    uint8_t ikmData[22];
+    uint8_t saltData[13];
+    uint8_t infoData[10];
+    uint8_t okmData[42];
+    uint8_t expectedOkm1[42] = {
+        0x3c, 0xb2, 0x5f, 0x25, 0xfa, 0xac, 0xd5, 0x7a, 0x90, 0x43, 0x4f,
+        0x64, 0xd0, 0x36, 0x2f, 0x2a, 0x2d, 0x2d, 0x0a, 0x90, 0xcf, 0x1a,
+        0x5a, 0x4c, 0x5d, 0xb0, 0x2d, 0x56, 0xec, 0xc4, 0xc5, 0xbf, 0x34,
+        0x00, 0x72, 0x08, 0xd5, 0xb8, 0x87, 0x18, 0x58, 0x65};
+    uint8_t expectedOkm3[42] = {
+        0x8d, 0xa4, 0xe7, 0x75, 0xa5, 0x63, 0xc1, 0x8f, 0x71, 0x5f, 0x80,
+        0x2a, 0x06, 0x3c, 0x5a, 0x31, 0xb8, 0xa1, 0x1f, 0x5c, 0x5e, 0xe1,
+        0x87, 0x9e, 0xc3, 0x45, 0x4e, 0x5f, 0x3c, 0x73, 0x8d, 0x2d, 0x9d,
+        0x20, 0x13, 0x95, 0xfa, 0xa4, 0xb6, 0x1a, 0x96, 0xc8};
+    WosBuffer_t ikm = {.data = ikmData, .length = sizeof(ikmData)};
+    WosBuffer_t salt = {.data = saltData, .length = sizeof(saltData)};
+    WosBuffer_t info = {.data = infoData, .length = sizeof(infoData)};
+    WosBuffer_t okm = {.data = okmData, .length = sizeof(okmData)};
+    unsigned int i;
+
+    wosMemSet(ikmData, 0x0b, sizeof(ikmData));
+    for (i = 0; i < sizeof(saltData); ++i) {
+        saltData[i] = i;
+    }
+    for (i = 0; i < sizeof(infoData); ++i) {
+        infoData[i] = 0xf0 + i;
+    }
+
+    cryptoError = wosCryptoHkdf(&salt, &ikm, &info, &okm);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_SUCCESS);
+    EXPECT_EQ(wosMemComparison(okmData, expectedOkm1, sizeof(okmData)), 0);
+
+    cryptoError = wosCryptoHkdf(NULL, &ikm, NULL, &okm);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_SUCCESS);
+    EXPECT_EQ(wosMemComparison(okmData, expectedOkm3, sizeof(okmData)), 0);
+}
+
+TEST_F(TestWosCrypto, NegativeHkdf)
+{
+    WosCryptoError_t cryptoError = WOS_CRYPTO_ERROR;
+    uint8_t ikmData[32] = {0};
+    uint8_t okmData[32];
+    WosBuffer_t ikm = {.data = ikmData, .length = sizeof(ikmData)};
+    WosBuffer_t okm = {.data = okmData, .length = sizeof(okmData)};
+    WosBuffer_t empty = {.data = NULL, .length = 0};
+
+    /* Missing input key */
+    cryptoError = wosCryptoHkdf(NULL, NULL, NULL, &okm);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_ERROR_BAD_PARAMS);
+    cryptoError = wosCryptoHkdf(NULL, &empty, NULL, &okm);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_ERROR_BAD_PARAMS);
+
+    /* Missing output */
+    cryptoError = wosCryptoHkdf(NULL, &ikm, NULL, NULL);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_ERROR_BAD_PARAMS);
+
+    /* Output longer than HKDF can expand to */
+    okm.length = 255 * WOS_CRYPTO_HASH_SHA256_LENGTH + 1;
+    cryptoError = wosCryptoHkdf(NULL, &ikm, NULL, &okm);
+    EXPECT_EQ(cryptoError, WOS_CRYPTO_ERROR_BAD_PARAMS);
+}
+
 } // namespace
@@ -11,14 +11,6 @@ set(WOS_COMMON_INCLUDES_DIR ${WOS_ROOT_DIR}/include)
 set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} -DLOG_LEVEL=${LOG_LEVEL}")
 set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -DLOG_LEVEL=${LOG_LEVEL}")
 
-if(${LIB_SMP_ROLE} STREQUAL "MQTTS_CLIENT")
-    add_definitions(-DSMP_MQTTS_CLIENT)
-elseif(${LIB_SMP_ROLE} STREQUAL "MQTTS_BROKER")
-    add_definitions(-DSMP_MQTTS_BROKER)
-else()
-    message(FATAL_ERROR "library build role type is not defined.")
-endif()
-
 #WCL public headers i.e. interfaces for WCL application developer
 set(WCL_PUBLIC_HEADERS ${WCL_PUBLIC_INCLUDES_DIR}/wclCommon.h
                        ${WCL_PUBLIC_INCLUDES_DIR}/wclConfig.h
@@ -34,13 +26,21 @@ set(WCL_COMMON_SRCS ${WCL_COMMON_ROOT_DIR}/wclCommon.c)
 set(WCL_SMP_ROOT_DIR ${WCL_SRC_DIR}/smp)
 set(WCL_SMP_INCS     ${WCL_SMP_ROOT_DIR}/smp.h
                      ${WCL_SMP_ROOT_DIR}/smpInternal.h
+                     ${WCL_SMP_ROOT_DIR}/smpAsync.h
+                     ${WCL_SMP_ROOT_DIR}/smpCompress.h
                      ${WCL_SMP_ROOT_DIR}/smpGlobalCreds.h
                      ${WCL_SMP_ROOT_DIR}/smpInternalUtils.h
+                     ${WCL_SMP_ROOT_DIR}/smpReplay.h
+                     ${WCL_SMP_ROOT_DIR}/smpTicket.h
                      )
 set(WCL_SMP_SRCS     ${WCL_SMP_ROOT_DIR}/smp.c
                      ${WCL_SMP_ROOT_DIR}/smpInternal.c
+                     ${WCL_SMP_ROOT_DIR}/smpAsync.c
+                     ${WCL_SMP_ROOT_DIR}/smpCompress.c
                      ${WCL_SMP_ROOT_DIR}/smpGlobalCreds.c
                      ${WCL_SMP_ROOT_DIR}/smpInternalUtils.c
+                     ${WCL_SMP_ROOT_DIR}/smpReplay.c
+                     ${WCL_SMP_ROOT_DIR}/smpTicket.c
                      )
 
 # WeeveOSCommon Headers
@@ -54,6 +54,7 @@ set(WOS_COMMON_INCS    ${WOS_COMMON_INCLUDES_DIR}/wosCborCert.h
                        ${WOS_COMMON_INCLUDES_DIR}/wosMsgSmp.h
                        ${WOS_COMMON_INCLUDES_DIR}/wosStorage.h
                        ${WOS_COMMON_INCLUDES_DIR}/wosString.h
+                       ${WOS_COMMON_INCLUDES_DIR}/wosTime.h
                        ${WOS_COMMON_INCLUDES_DIR}/wosTypes.h
                        )
 
@@ -62,6 +63,7 @@ set(WCL_WOS_SRCS            ${WCL_SRC_DIR}/wos/crypto/wosCert.c
                             ${WCL_SRC_DIR}/wos/misc/wosLogLibC.c
                             ${WCL_SRC_DIR}/wos/misc/wosMemoryLibC.c
                             ${WCL_SRC_DIR}/wos/misc/wosStringLibC.c
+                            ${WCL_SRC_DIR}/wos/misc/wosTimeLibC.c
                             )
 
 # Libraries
@@ -90,7 +92,8 @@ if(${CRYPTO} STREQUAL "TOMCRYPT")
     endif()
     set(TOMMATH_INC_DIR ${WCL_EXTERNAL_DIR}/libtommath)
 
-    list(APPEND WCL_WOS_SRCS ${WCL_SRC_DIR}/wos/crypto/wosCryptoLibtom.c)
+    list(APPEND WCL_WOS_SRCS ${WCL_SRC_DIR}/wos/crypto/wosCryptoLibtom.c
+                             ${WCL_SRC_DIR}/wos/crypto/wosCryptoAesGcmMb.c)
 else()
     message(FATAL_ERROR "crypto type is not defined.")
 endif()
@@ -109,11 +112,14 @@ else()
     message(FATAL_ERROR "storage type is not defined.")
 endif()
 
-#Set WCL target
-if(${LIB_SMP_ROLE} STREQUAL "MQTTS_CLIENT")
+#Set WCL target. The SMP role is chosen per session in wclSmpOpen(), so both
+#targets are the same library. LIB_SMP_ROLE only picks the name to link with.
+if(NOT DEFINED LIB_SMP_ROLE OR ${LIB_SMP_ROLE} STREQUAL "MQTTS_CLIENT")
     set(WCL_TARGET wcl_client)
 elseif(${LIB_SMP_ROLE} STREQUAL "MQTTS_BROKER")
     set(WCL_TARGET wcl_broker)
+else()
+    message(FATAL_ERROR "library build role type is not defined.")
 endif()
 set(WCL_TARGET_SRCS ${WCL_COMMON_SRCS} ${WCL_SMP_SRCS} ${WCL_WOS_SRCS})
 set(WCL_TARGET_INCS ${WCL_SMP_INCS} ${WOS_COMMON_INCS})
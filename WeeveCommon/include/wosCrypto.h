@@ -122,6 +122,18 @@ typedef struct WosCryptoAeOptions {
     WosCryptoAeOptionsMode_t mode;
 } WosCryptoAeOptions_t;
 
+/* One message of wosCryptoAeEncryptMulti(), with the parameters of
+ * wosCryptoAeEncryptKeyBuffer(). */
+typedef struct WosCryptoAeJob {
+    WosBuffer_t *pKeyBuf;     /* in */
+    WosBuffer_t *pPlainText;  /* in */
+    WosBuffer_t *pAad;        /* in, optional */
+    WosBuffer_t *pIv;         /* inout, generated when NULL */
+    WosBuffer_t *pCipherText; /* out, to be freed by the caller */
+    WosBuffer_t *pTag;        /* out, to be freed by the caller */
+    WosCryptoError_t result;  /* out */
+} WosCryptoAeJob_t;
+
 /* ========================================================================== */
 /*                                Global Variables                            */
 /* ========================================================================== */
@@ -165,6 +177,23 @@ WosCryptoError_t wosCryptoEccGenerateKey(WosCryptoEccOptions_t *pOptions,
                                          WosString_t privateKeyStorageId,
                                          WosString_t publicKeyStorageId);
 
+/**
+ * @brief Generates a key pair for using elliptic curve cryptographic into
+ * buffers owned by the caller, without touching storage.
+ *
+ * @param[in] pOptions The options for generating the ECC key.
+ * @param[inout] pPrivateKey Buffer for the ECC private key. On input its
+ * length is the space available (#WOS_CRYPTO_ECC_NIST_P256_KEY_LENGTH is
+ * enough), on output the length of the exported key.
+ * @param[inout] pPublicKey Buffer for the ECC public key, of at least
+ * #WOS_CRYPTO_ECC_NIST_P256_PUBLIC_KEY_LENGTH bytes. On output its length is
+ * the length of the exported key.
+ * @return WosCryptoError_t The result of the call.
+ */
+WosCryptoError_t wosCryptoEccGenerateKeyBuffer(WosCryptoEccOptions_t *pOptions,
+                                               WosBuffer_t *pPrivateKey,
+                                               WosBuffer_t *pPublicKey);
+
 /**
  * @brief Generates an ECC signature data using a key that is already stored,
  * returning its signature.
@@ -250,6 +279,46 @@ WosCryptoError_t wosCryptoAeEncrypt(WosCryptoAeOptions_t *pOptions,
                                     WosBuffer_t **ppCipherText,
                                     WosBuffer_t **ppTag);
 
+/**
+ * @brief Encrypts data using Symmetric Authenticated Encryption with a key
+ * held by the caller.
+ *
+ * @param[in] pOptions The options used during the process.
+ * @param[in] pKeyBuf The symmetric key, #WOS_CRYPTO_AE_AES256_KEY_LENGTH bytes.
+ * @param[in] pPlainText The plain data to be encrypted.
+ * @param[in] pAad The (optional) additional authenticated data.
+ * @param[inout] ppIv The initialization vector, see wosCryptoAeEncrypt().
+ * @param[out] ppCipherText The generated encrypted data. It must be freed by
+ *                          the caller after usage.
+ * @param[out] ppTag The generated authentication tag. It must be freed by the
+ *                   caller after usage.
+ * @return WosCryptoError_t The result of the call.
+ */
+WosCryptoError_t wosCryptoAeEncryptKeyBuffer(WosCryptoAeOptions_t *pOptions,
+                                             WosBuffer_t *pKeyBuf,
+                                             WosBuffer_t *pPlainText,
+                                             WosBuffer_t *pAad,
+                                             WosBuffer_t **ppIv,
+                                             WosBuffer_t **ppCipherText,
+                                             WosBuffer_t **ppTag);
+
+/**
+ * @brief Encrypts several independent messages using Symmetric Authenticated
+ * Encryption with keys held by the caller. The messages are encrypted side by
+ * side when the CPU allows it, and the output of each is the one of
+ * wosCryptoAeEncryptKeyBuffer().
+ *
+ * @param[in] pOptions The options used during the process, for all the jobs.
+ * @param[inout] pJobs The messages. The result of each is set, and its cipher
+ *                     text and tag (and iv when generated) are only allocated
+ *                     when that result is #WOS_CRYPTO_SUCCESS.
+ * @param[in] numJobs The number of jobs.
+ * @return WosCryptoError_t #WOS_CRYPTO_SUCCESS, or the first failed result.
+ */
+WosCryptoError_t wosCryptoAeEncryptMulti(WosCryptoAeOptions_t *pOptions,
+                                         WosCryptoAeJob_t *pJobs,
+                                         size_t numJobs);
+
 /**
  * @brief Decrypts data using Symmetric Authenticated Encryption. The key used
  * has to be already stored.
@@ -276,6 +345,28 @@ WosCryptoError_t wosCryptoAeDecrypt(WosCryptoAeOptions_t *pOptions,
                                     WosBuffer_t *pTag,
                                     WosBuffer_t **ppPlainText);
 
+/**
+ * @brief Decrypts data using Symmetric Authenticated Encryption with a key
+ * held by the caller.
+ *
+ * @param[in] pOptions The options used during the process.
+ * @param[in] pKeyBuf The symmetric key, #WOS_CRYPTO_AE_AES256_KEY_LENGTH bytes.
+ * @param[in] pCipherText The encrypted data.
+ * @param[in] pAad The (optional) additional authenticated data used during
+ *                 encryption.
+ * @param[in] pIv The initialization vector used during encryption.
+ * @param[in] pTag The authentication tag is verified during decryption.
+ * @param[out] ppPlainText The generated plain data.
+ * @return WosCryptoError_t The result of the call.
+ */
+WosCryptoError_t wosCryptoAeDecryptKeyBuffer(WosCryptoAeOptions_t *pOptions,
+                                             WosBuffer_t *pKeyBuf,
+                                             WosBuffer_t *pCipherText,
+                                             WosBuffer_t *pAad,
+                                             WosBuffer_t *pIv,
+                                             WosBuffer_t *pTag,
+                                             WosBuffer_t **ppPlainText);
+
 /**
  * @brief Derives a shared secret from a key exchange using Elliptic Curve
  * Diffie Hellman. This shared secret is used to generate a symmetric key that
@@ -297,6 +388,41 @@ WosCryptoError_t wosCryptoDeriveSymKey(WosCryptoEccOptions_t *pOptions,
                                        WosString_t privateKeyStorageId,
                                        WosString_t symmetricKeyStorageId);
 
+/**
+ * @brief Derives a shared secret from a key exchange using Elliptic Curve
+ * Diffie Hellman, with both keys held by the caller.
+ *
+ * @param[in] pOptions The options for the ECC used.
+ * @param[in] pPublicKey The other party's public key.
+ * @param[in] pPrivateKey This party's private key, as exported by
+ *                        wosCryptoEccGenerateKeyBuffer().
+ * @param[inout] pSymmetricKey Buffer of at least
+ * #WOS_CRYPTO_ECC_NIST_P256_SHARED_SECRET_LENGTH bytes for the symmetric key.
+ * On output its length is the length of the key.
+ * @return WosCryptoError_t The result of the call.
+ */
+WosCryptoError_t wosCryptoDeriveSymKeyBuffer(WosCryptoEccOptions_t *pOptions,
+                                             WosBuffer_t *pPublicKey,
+                                             WosBuffer_t *pPrivateKey,
+                                             WosBuffer_t *pSymmetricKey);
+
+/**
+ * @brief Derives keying material from a secret with HKDF (RFC 5869) using
+ * SHA-256.
+ *
+ * @param[in] pSalt The (optional) salt, NULL for none.
+ * @param[in] pInputKey The input keying material.
+ * @param[in] pInfo The (optional) context and application specific
+ *                  information, NULL for none.
+ * @param[inout] pOutputKey Buffer filled with pOutputKey->length bytes of
+ * keying material, at most 255 * #WOS_CRYPTO_HASH_SHA256_LENGTH.
+ * @return WosCryptoError_t The result of the call.
+ */
+WosCryptoError_t wosCryptoHkdf(WosBuffer_t *pSalt,
+                               WosBuffer_t *pInputKey,
+                               WosBuffer_t *pInfo,
+                               WosBuffer_t *pOutputKey);
+
 /**
  * @brief Reads the public part of a ECC key from storage.
  *
@@ -67,6 +67,26 @@ extern "C" {
 /*                                Constants                                   */
 /* ========================================================================== */
 
+/* Maximum number of byte strings kept after the header in WosMsgSmpView_t. */
+#define WOS_MSG_SMP_VIEW_MAX_SEGMENTS (6)
+
+/* Segments of a parsed Mqtts Control Message. */
+#define WOS_MSG_SMP_CONTROL_SEGMENT_MQTT_PACKET (0)
+#define WOS_MSG_SMP_CONTROL_SEGMENT_IV (1)
+#define WOS_MSG_SMP_CONTROL_SEGMENT_AUTH_TAG (2)
+
+/* Segments of a parsed resumed Session Establishment Message. Only the CONNECT
+ * sent by a client carries the ticket, optionally followed by the encrypted
+ * early data. In the CONNACK the ticket is replaced by a marker telling the
+ * early data was accepted. */
+#define WOS_MSG_SMP_RESUME_SEGMENT_NONCE (0)
+#define WOS_MSG_SMP_RESUME_SEGMENT_MQTT_PACKET (1)
+#define WOS_MSG_SMP_RESUME_SEGMENT_IV (2)
+#define WOS_MSG_SMP_RESUME_SEGMENT_AUTH_TAG (3)
+#define WOS_MSG_SMP_RESUME_SEGMENT_TICKET (4)
+#define WOS_MSG_SMP_RESUME_SEGMENT_EARLY_DATA_ACCEPTED (4)
+#define WOS_MSG_SMP_RESUME_SEGMENT_EARLY_DATA (5)
+
 /* ========================================================================== */
 /*                                Types                                       */
 /* ========================================================================== */
@@ -85,6 +105,9 @@ typedef struct tWosSmpHeader {
     WosString_t clientId;
     /* Message Id. */
     uint32_t messageId;
+    /* Epoch of the traffic key protecting the message, only packed when not
+     * zero. */
+    uint32_t epoch;
 } WosSmpHeader_t;
 
 /**
@@ -108,6 +131,17 @@ typedef struct tWosMsgMqttsSeParams {
     uint8_t numCerts;
     /* Certificate list, first certificate is verification certificate. */
     WosBuffer_t **ppCerts;
+    /* Whether cipherSchemeId is present, only the CONNECT sent by a client
+     * carries it. */
+    bool hasCipherSchemeId;
+    /* Lifetime of pTicket in seconds. */
+    uint32_t ticketLifetime;
+    /* Optional session ticket, only a CONNACK sent by a broker carries it. */
+    WosBuffer_t *pTicket;
+    /* Whether the sender compresses the packets it encrypts, offered in a
+     * CONNECT and accepted in the CONNACK. Packed as a trailing boolean, only
+     * when true, so that older peers skip it. */
+    bool hasCompression;
 } WosMsgMqttsSeParams_t;
 
 /**
@@ -128,6 +162,32 @@ typedef struct tWosMsgMqttsControlParams {
     WosBuffer_t *pAuthTag;
 } WosMsgMqttsControlParams_t;
 
+/**
+ * @brief SMP message parsed in place.
+ *
+ * All buffers point into the parsed message, nothing is allocated, so the
+ * view is only valid as long as that message is.
+ */
+typedef struct tWosMsgSmpView {
+    /* Context of message. */
+    WosMsgCommonHeader_t commonHeader;
+    /* Type of message. */
+    WclSmpMessageType_t messageType;
+    /* Client-Id, not null-terminated. */
+    WosBuffer_t clientId;
+    /* Message Id. */
+    uint32_t messageId;
+    /* Epoch of the traffic key, zero when the header has none. */
+    uint32_t epoch;
+    /* Serialized SMP Header. */
+    WosBuffer_t encodedSmpHeader;
+    /* Byte strings following the header, for a control message the AEAD
+     * protected mqtt packet, IV and authentication tag. */
+    WosBuffer_t segments[WOS_MSG_SMP_VIEW_MAX_SEGMENTS];
+    /* Number of segments found. */
+    uint8_t numSegments;
+} WosMsgSmpView_t;
+
 /* ========================================================================== */
 /*                                Global Variables                            */
 /* ========================================================================== */
@@ -158,6 +218,32 @@ WosMsgError_t wosMsgPackSmpHeader(const WosSmpHeader_t *pSmpHeader,
 WosMsgError_t wosMsgUnpackSmpHeaderFromSmpMsg(const WosBuffer_t *pPackedBuffer,
                                               WosSmpHeader_t *pSmpHeader);
 
+/**
+ * @brief Parse the header and payload segments of a SMP message in a single
+ * pass, without allocating or copying.
+ *
+ * @param pPackedBuffer[in] The binary packed serialized SMP message.
+ * @param pView[out] The parsed message, pointing into pPackedBuffer.
+ *
+ */
+WosMsgError_t wosMsgParseSmpMessage(const WosBuffer_t *pPackedBuffer,
+                                    WosMsgSmpView_t *pView);
+
+/**
+ * @brief Pack a SMP message made of the header followed by byte strings, the
+ * counterpart of wosMsgParseSmpMessage().
+ *
+ * @param pEncodedSmpHeader[in] Serialized SMP header.
+ * @param pSegments[in] Byte strings to append after the header.
+ * @param numSegments[in] Number of entries in pSegments.
+ * @param pPackedBuffer[out] The binary packed serialized buffer.
+ *
+ */
+WosMsgError_t wosMsgPackSmpMessage(const WosBuffer_t *pEncodedSmpHeader,
+                                   const WosBuffer_t *pSegments,
+                                   uint8_t numSegments,
+                                   WosBuffer_t *pPackedBuffer);
+
 /**
  * @brief Pack the Session Establishment Message.
  *
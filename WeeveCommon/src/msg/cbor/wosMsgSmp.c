@@ -86,6 +86,185 @@
 /*                                Local Function Definitions                  */
 /* ========================================================================== */
 
+/*
+ * Read the head of the CBOR data item at *ppCursor and move the cursor past
+ * it. Only the heads found in SMP messages are accepted: unsigned integers,
+ * definite length byte and text strings, arrays and the break stop code.
+ */
+static WosMsgError_t lMsgReadCborHead(const uint8_t **ppCursor,
+                                      const uint8_t *pEnd,
+                                      uint8_t *pMajorType, uint64_t *pValue,
+                                      bool *pIsIndefinite)
+{
+    const uint8_t *pCursor = *ppCursor;
+    uint8_t additionalInfo = 0;
+    uint8_t numBytes = 0;
+    uint64_t value = 0;
+
+    if (pCursor >= pEnd) {
+        return WOS_MSG_ERROR_BAD_FORMAT;
+    }
+
+    *pMajorType = (uint8_t)(*pCursor >> 5);
+    additionalInfo = (uint8_t)(*pCursor & 0x1f);
+    pCursor++;
+    *pIsIndefinite = false;
+
+    if (additionalInfo < 24) {
+        value = additionalInfo;
+    } else if (additionalInfo <= 27) {
+        numBytes = (uint8_t)(1 << (additionalInfo - 24));
+        if ((pEnd - pCursor) < numBytes) {
+            return WOS_MSG_ERROR_BAD_FORMAT;
+        }
+        while (numBytes--) {
+            value = (value << 8) | *pCursor++;
+        }
+    } else if ((31 == additionalInfo) &&
+               ((4 == *pMajorType) || (7 == *pMajorType))) {
+        /* Indefinite length array or the break ending it. */
+        *pIsIndefinite = true;
+    } else {
+        return WOS_MSG_ERROR_BAD_FORMAT;
+    }
+
+    if ((7 == *pMajorType) && (false == *pIsIndefinite)) {
+        return WOS_MSG_ERROR_BAD_FORMAT;
+    }
+
+    *pValue = value;
+    *ppCursor = pCursor;
+    return WOS_MSG_SUCCESS;
+}
+
+/*
+ * Read an unsigned integer, which must fit in maxValue.
+ */
+static WosMsgError_t lMsgReadCborUint(const uint8_t **ppCursor,
+                                      const uint8_t *pEnd, uint64_t maxValue,
+                                      uint64_t *pValue)
+{
+    uint8_t majorType = 0;
+    bool isIndefinite = false;
+
+    if ((WOS_MSG_SUCCESS !=
+         lMsgReadCborHead(ppCursor, pEnd, &majorType, pValue, &isIndefinite)) ||
+        (0 != majorType) || (*pValue > maxValue)) {
+        return WOS_MSG_ERROR_BAD_FORMAT;
+    }
+    return WOS_MSG_SUCCESS;
+}
+
+/*
+ * Point pString at the contents of the byte or text string at *ppCursor,
+ * without copying it.
+ */
+static WosMsgError_t lMsgReadCborString(const uint8_t **ppCursor,
+                                        const uint8_t *pEnd, uint8_t majorType,
+                                        WosBuffer_t *pString)
+{
+    uint8_t foundType = 0;
+    uint64_t length = 0;
+    bool isIndefinite = false;
+
+    if ((WOS_MSG_SUCCESS != lMsgReadCborHead(ppCursor, pEnd, &foundType,
+                                             &length, &isIndefinite)) ||
+        (majorType != foundType) ||
+        (length > (uint64_t)(pEnd - *ppCursor))) {
+        return WOS_MSG_ERROR_BAD_FORMAT;
+    }
+    pString->data = (uint8_t *)*ppCursor;
+    pString->length = (uint32_t)length;
+    *ppCursor += length;
+    return WOS_MSG_SUCCESS;
+}
+
+/*
+ * Enter the array at *ppCursor. pNumItems is set to the number of items, or
+ * to UINT64_MAX for an indefinite length array, which ends with a break.
+ */
+static WosMsgError_t lMsgEnterCborArray(const uint8_t **ppCursor,
+                                        const uint8_t *pEnd,
+                                        uint64_t *pNumItems)
+{
+    uint8_t majorType = 0;
+    bool isIndefinite = false;
+
+    if ((WOS_MSG_SUCCESS != lMsgReadCborHead(ppCursor, pEnd, &majorType,
+                                             pNumItems, &isIndefinite)) ||
+        (4 != majorType)) {
+        return WOS_MSG_ERROR_BAD_FORMAT;
+    }
+    if (isIndefinite) {
+        *pNumItems = UINT64_MAX;
+    }
+    return WOS_MSG_SUCCESS;
+}
+
+/*
+ * Parse the fields of a serialized SMP header.
+ */
+static WosMsgError_t lMsgParseSmpHeader(const WosBuffer_t *pEncodedHeader,
+                                        WosMsgSmpView_t *pView)
+{
+    const uint8_t *pCursor = pEncodedHeader->data;
+    const uint8_t *pEnd = pEncodedHeader->data + pEncodedHeader->length;
+    uint64_t numItems = 0;
+    uint64_t value = 0;
+
+    if (WOS_MSG_SUCCESS != lMsgEnterCborArray(&pCursor, pEnd, &numItems) ||
+        (numItems < 5)) {
+        WLOGE("badly formatted smp-header");
+        return WOS_MSG_ERROR_BAD_FORMAT;
+    }
+
+    if (WOS_MSG_SUCCESS != lMsgReadCborUint(&pCursor, pEnd, UINT8_MAX, &value)) {
+        WLOGE("extracting message context failed");
+        return WOS_MSG_ERROR_BAD_FORMAT;
+    }
+    pView->commonHeader.messageContext = (uint8_t)value;
+
+    if (WOS_MSG_SUCCESS != lMsgReadCborUint(&pCursor, pEnd, UINT8_MAX, &value)) {
+        WLOGE("extracting message context version failed");
+        return WOS_MSG_ERROR_BAD_FORMAT;
+    }
+    pView->commonHeader.messageContextVersion = (uint8_t)value;
+
+    if (WOS_MSG_SUCCESS != lMsgReadCborUint(&pCursor, pEnd, UINT8_MAX, &value)) {
+        WLOGE("extracting message type failed");
+        return WOS_MSG_ERROR_BAD_FORMAT;
+    }
+    pView->messageType = (WclSmpMessageType_t)value;
+
+    if ((WOS_MSG_SUCCESS !=
+         lMsgReadCborString(&pCursor, pEnd, 3, &pView->clientId)) ||
+        (pView->clientId.length > WCL_SMP_CLIENT_ID_LENGTH)) {
+        WLOGE("bad client-id");
+        return WOS_MSG_ERROR_BAD_FORMAT;
+    }
+
+    if (WOS_MSG_SUCCESS !=
+        lMsgReadCborUint(&pCursor, pEnd, UINT32_MAX, &value)) {
+        WLOGE("extracting message-id failed");
+        return WOS_MSG_ERROR_BAD_FORMAT;
+    }
+    pView->messageId = (uint32_t)value;
+
+    /* The epoch is left out while it is zero, so it is read when an unsigned
+     * integer follows the message-id. */
+    pView->epoch = 0;
+    if ((5 < numItems) && (pCursor < pEnd) && ((*pCursor >> 5) == 0)) {
+        if (WOS_MSG_SUCCESS !=
+            lMsgReadCborUint(&pCursor, pEnd, UINT32_MAX, &value)) {
+            WLOGE("extracting epoch failed");
+            return WOS_MSG_ERROR_BAD_FORMAT;
+        }
+        pView->epoch = (uint32_t)value;
+    }
+
+    return WOS_MSG_SUCCESS;
+}
+
 /* ========================================================================== */
 /*                                Implementation                              */
 /* ========================================================================== */
@@ -166,6 +345,15 @@ WosMsgError_t wosMsgPackSmpHeader(const WosSmpHeader_t *pMessageHeader,
         goto exit;
     }
 
+    /* Add epoch, peers not rekeying never send or expect one. */
+    if (0 != pMessageHeader->epoch) {
+        cborStatus = cbor_encode_uint(&dataArray, pMessageHeader->epoch);
+        if (CborNoError != cborStatus) {
+            WLOGE("encode epoch failed %x", cborStatus);
+            goto exit;
+        }
+    }
+
     /* Close the top level array container. */
     cborStatus = cbor_encoder_close_container_checked(&encoder, &dataArray);
     if (CborNoError != cborStatus) {
@@ -197,16 +385,7 @@ WosMsgError_t wosMsgUnpackSmpHeaderFromSmpMsg(const WosBuffer_t *pPackedBuffer,
                                               WosSmpHeader_t *pMessageHeader)
 {
     WosMsgError_t msgStatus = WOS_MSG_ERROR;
-    CborError cborStatus = CborNoError;
-    CborParser parser;
-    CborValue value;
-    CborValue dataArray;
-    uint64_t messageContext = WOS_MSG_CONTEXT_UNDEFINED;
-    uint64_t messageType = WOS_MSG_MESSAGE_TYPE_UNDEFINED;
-    uint64_t messageContextVersion = WOS_MSG_MESSAGE_TYPE_VERSION_UNDEFINED;
-    uint64_t messageId = 0;
-    size_t clientIdLength = WCL_SMP_CLIENT_ID_LENGTH + 1;
-    WosBuffer_t *pExtractedSmpCborHeader = NULL;
+    WosMsgSmpView_t smpView;
 
     FUNCTION_ENTRY();
 
@@ -218,144 +397,170 @@ WosMsgError_t wosMsgUnpackSmpHeaderFromSmpMsg(const WosBuffer_t *pPackedBuffer,
     }
 
     /* Initialize the output. */
-    pMessageHeader->commonHeader.messageContext = (uint8_t)messageContext;
+    pMessageHeader->commonHeader.messageContext = WOS_MSG_CONTEXT_UNDEFINED;
     pMessageHeader->commonHeader.messageContextVersion =
-        (uint8_t)messageContextVersion;
-    pMessageHeader->messageType = (uint8_t)messageType;
-    pMessageHeader->messageId = (uint32_t)messageId;
+        WOS_MSG_MESSAGE_TYPE_VERSION_UNDEFINED;
+    pMessageHeader->messageType = WOS_MSG_MESSAGE_TYPE_UNDEFINED;
+    pMessageHeader->messageId = 0;
+    pMessageHeader->epoch = 0;
 
-    /* First get the SMP header cbor byte-buffer from SMP message. */
-    /* Initialize the parser. */
-    cborStatus = cbor_parser_init(pPackedBuffer->data, pPackedBuffer->length, 0,
-                                  &parser, &value);
-    if (CborNoError != cborStatus) {
-        WLOGE("parser initialization failed %x", cborStatus);
-        goto exit;
-    }
-    /* Check if top level container is an array. */
-    if (false == cbor_value_is_array(&value)) {
-        WLOGE("Badly formatted packet");
-        msgStatus = WOS_MSG_ERROR_BAD_FORMAT;
-        goto exit;
-    }
-    /* Enter into root array. */
-    cborStatus = cbor_value_enter_container(&value, &dataArray);
-    if (CborNoError != cborStatus) {
-        WLOGE("entering root array failed %x", cborStatus);
-        goto exit;
-    }
-    /* Get the CBOR-encoded-smp-header. */
-    msgStatus =
-        msgCborParseByteString(&dataArray, &pExtractedSmpCborHeader, NULL);
+    msgStatus = wosMsgParseSmpMessage(pPackedBuffer, &smpView);
     if (WOS_MSG_SUCCESS != msgStatus) {
-        WLOGE("extracting smp-header failed %x", msgStatus);
         goto exit;
     }
-    WLOGD_BUFFER("smp-header-cbor-buffer", pExtractedSmpCborHeader->data,
-                 pExtractedSmpCborHeader->length);
 
-    /* Now extract the SMP header. */
-    /* Initialize the parser. */
-    cborStatus =
-        cbor_parser_init(pExtractedSmpCborHeader->data,
-                         pExtractedSmpCborHeader->length, 0, &parser, &value);
-    if (CborNoError != cborStatus) {
-        WLOGE("parser initialization failed %x", cborStatus);
-        goto exit;
-    }
+    /* Copy the client-id out as a null-terminated string. */
+    wosMemCopy(pMessageHeader->clientId, smpView.clientId.data,
+               smpView.clientId.length);
+    pMessageHeader->clientId[smpView.clientId.length] = WOS_STRING_NULL_TERM;
+    WLOGD("extracted client-id = %s", pMessageHeader->clientId);
 
-    /* Check if top level container is an array. */
-    if (false == cbor_value_is_array(&value)) {
-        WLOGE("Badly formatted packet");
-        msgStatus = WOS_MSG_ERROR_BAD_FORMAT;
+    /* Update the output. */
+    pMessageHeader->commonHeader = smpView.commonHeader;
+    pMessageHeader->messageType = smpView.messageType;
+    pMessageHeader->messageId = smpView.messageId;
+    pMessageHeader->epoch = smpView.epoch;
+
+exit:
+    FUNCTION_EXIT_RETURN(msgStatus);
+    return msgStatus;
+}
+
+/*
+ * Parse a SMP message in place.
+ */
+WosMsgError_t wosMsgParseSmpMessage(const WosBuffer_t *pPackedBuffer,
+                                    WosMsgSmpView_t *pView)
+{
+    WosMsgError_t msgStatus = WOS_MSG_ERROR;
+    const uint8_t *pCursor = NULL;
+    const uint8_t *pEnd = NULL;
+    uint64_t numItems = 0;
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation. */
+    if ((!WOS_IS_VALID_BUFFER(pPackedBuffer)) || (NULL == pView)) {
+        WLOGE("bad parameter");
+        msgStatus = WOS_MSG_ERROR_BAD_PARAMS;
         goto exit;
     }
 
+    wosMemSet(pView, 0, sizeof(WosMsgSmpView_t));
+    pCursor = pPackedBuffer->data;
+    pEnd = pPackedBuffer->data + pPackedBuffer->length;
+
     /* Enter into root array. */
-    cborStatus = cbor_value_enter_container(&value, &dataArray);
-    if (CborNoError != cborStatus) {
-        WLOGE("entering root array failed %x", cborStatus);
+    msgStatus = lMsgEnterCborArray(&pCursor, pEnd, &numItems);
+    if ((WOS_MSG_SUCCESS != msgStatus) || (0 == numItems)) {
+        WLOGE("Badly formatted packet");
+        msgStatus = WOS_MSG_ERROR_BAD_FORMAT;
         goto exit;
     }
 
-    /* Extract the message context. */
-    msgStatus = msgCborParseUint64(&dataArray, &messageContext);
+    /* Get the CBOR-encoded-smp-header and the fields inside it. */
+    msgStatus =
+        lMsgReadCborString(&pCursor, pEnd, 2, &pView->encodedSmpHeader);
     if (WOS_MSG_SUCCESS != msgStatus) {
-        WLOGE("extracting message context failed %x", msgStatus);
+        WLOGE("extracting smp-header failed %x", msgStatus);
         goto exit;
     }
+    numItems--;
+    WLOGD_BUFFER("smp-header-cbor-buffer", pView->encodedSmpHeader.data,
+                 pView->encodedSmpHeader.length);
 
-    /* Extract message context version. */
-    cborStatus = cbor_value_advance_fixed(&dataArray);
-    if (CborNoError != cborStatus) {
-        WLOGE("advancing to message context version failed %x", cborStatus);
-        goto exit;
-    }
-    msgStatus = msgCborParseUint64(&dataArray, &messageContextVersion);
+    msgStatus = lMsgParseSmpHeader(&pView->encodedSmpHeader, pView);
     if (WOS_MSG_SUCCESS != msgStatus) {
-        WLOGE("extracting message context version failed %x", msgStatus);
         goto exit;
     }
 
-    /* Extract message type. */
-    cborStatus = cbor_value_advance_fixed(&dataArray);
-    if (CborNoError != cborStatus) {
-        WLOGW("advancing to message type failed %x", cborStatus);
-        goto exit;
+    /* Collect the byte strings that directly follow the header; stop at the
+     * first item of any other type, or at the end of the array. */
+    while ((numItems > 0) && (pCursor < pEnd) && ((*pCursor >> 5) == 2) &&
+           (pView->numSegments < WOS_MSG_SMP_VIEW_MAX_SEGMENTS)) {
+        msgStatus = lMsgReadCborString(&pCursor, pEnd, 2,
+                                       &pView->segments[pView->numSegments]);
+        if (WOS_MSG_SUCCESS != msgStatus) {
+            WLOGE("extracting segment %u failed", pView->numSegments);
+            goto exit;
+        }
+        pView->numSegments++;
+        numItems--;
     }
-    msgStatus = msgCborParseUint64(&dataArray, &messageType);
-    if (WOS_MSG_SUCCESS != msgStatus) {
-        WLOGE("extracting message type version failed %x", msgStatus);
+
+    msgStatus = WOS_MSG_SUCCESS;
+
+exit:
+    FUNCTION_EXIT_RETURN(msgStatus);
+    return msgStatus;
+}
+
+/*
+ * Pack a SMP message made of the header followed by byte strings.
+ */
+WosMsgError_t wosMsgPackSmpMessage(const WosBuffer_t *pEncodedSmpHeader,
+                                   const WosBuffer_t *pSegments,
+                                   uint8_t numSegments,
+                                   WosBuffer_t *pPackedBuffer)
+{
+    WosMsgError_t msgStatus = WOS_MSG_ERROR;
+    CborError cborStatus = CborNoError;
+    CborEncoder encoder;
+    CborEncoder dataArray;
+    uint8_t i = 0;
+
+    FUNCTION_ENTRY();
+
+    /* Input parameters validation. */
+    if ((!WOS_IS_VALID_BUFFER(pEncodedSmpHeader)) ||
+        ((numSegments > 0) && (NULL == pSegments)) ||
+        (!WOS_IS_VALID_BUFFER(pPackedBuffer))) {
+        WLOGE("bad parameter");
+        msgStatus = WOS_MSG_ERROR_BAD_PARAMS;
         goto exit;
     }
 
-    /* Get the client-id. */
-    cborStatus = cbor_value_advance(&dataArray);
+    /* Initialize the CBOR encoder. */
+    cbor_encoder_init(&encoder, pPackedBuffer->data, pPackedBuffer->length, 0);
+
+    /* Create the top level array container. */
+    cborStatus =
+        cbor_encoder_create_array(&encoder, &dataArray, CborIndefiniteLength);
     if (CborNoError != cborStatus) {
-        WLOGW("advancing to next item failed %x", cborStatus);
-        goto exit;
-    }
-    /* Check the type. */
-    if (false == cbor_value_is_text_string(&dataArray)) {
-        WLOGE("badly formatted header, expecting text string");
-        msgStatus = WOS_MSG_ERROR_BAD_FORMAT;
+        WLOGE("create root array failed %x", cborStatus);
         goto exit;
     }
-    /* Copy byte string to buffer. */
-    cborStatus = cbor_value_copy_text_string(
-        &dataArray, pMessageHeader->clientId, &clientIdLength, NULL);
+
+    /* Add CBOR-encoded SMP header. */
+    cborStatus = cbor_encode_byte_string(&dataArray, pEncodedSmpHeader->data,
+                                         pEncodedSmpHeader->length);
     if (CborNoError != cborStatus) {
-        WLOGE("copy client-id string failed %x %s", cborStatus,
-              cbor_error_string(cborStatus));
+        WLOGE("encode smp-header failed %x", cborStatus);
         goto exit;
     }
-    /* We expect a null-terminated client-id with permissible length. */
-    if ((clientIdLength > WCL_SMP_CLIENT_ID_LENGTH) ||
-        (WOS_STRING_NULL_TERM != pMessageHeader->clientId[clientIdLength])) {
-        WLOGE("bad client-id");
-        msgStatus = WOS_MSG_ERROR_BAD_FORMAT;
-        goto exit;
+
+    /* Add the segments. */
+    for (i = 0; i < numSegments; ++i) {
+        cborStatus = cbor_encode_byte_string(&dataArray, pSegments[i].data,
+                                             pSegments[i].length);
+        if (CborNoError != cborStatus) {
+            WLOGE("encode segment %u failed %x", i, cborStatus);
+            goto exit;
+        }
     }
-    WLOGD("extracted client-id = %s", pMessageHeader->clientId);
 
-    /* Extract message-id. */
-    cborStatus = cbor_value_advance(&dataArray);
+    /* Close the top level array container. */
+    cborStatus = cbor_encoder_close_container_checked(&encoder, &dataArray);
     if (CborNoError != cborStatus) {
-        WLOGW("advancing to message-id failed %x", cborStatus);
-        goto exit;
-    }
-    msgStatus = msgCborParseUint64(&dataArray, &messageId);
-    if (WOS_MSG_SUCCESS != msgStatus) {
-        WLOGE("extracting message-id failed %x", msgStatus);
+        WLOGE("close root array failed %x", cborStatus);
         goto exit;
     }
 
-    /* Update the output. */
-    pMessageHeader->commonHeader.messageContext = (uint8_t)messageContext;
-    pMessageHeader->commonHeader.messageContextVersion =
-        (uint8_t)messageContextVersion;
-    pMessageHeader->messageType = (uint8_t)messageType;
-    pMessageHeader->messageId = (uint32_t)messageId;
+    /* Get the actual encoded buffer size. */
+    pPackedBuffer->length =
+        cbor_encoder_get_buffer_size(&encoder, pPackedBuffer->data);
+
+    WLOGD("total encoded length %d", pPackedBuffer->length);
 
     msgStatus = WOS_MSG_SUCCESS;
 
@@ -364,8 +569,6 @@ exit:
         msgStatus = WOS_MSG_ERROR;
     }
 
-    WOS_FREE_BUF_AND_DATA(pExtractedSmpCborHeader);
-
     FUNCTION_EXIT_RETURN(msgStatus);
     return msgStatus;
 }
@@ -419,14 +622,14 @@ wosMsgPackSmpMqttsSEMessage(const WosMsgMqttsSeParams_t *pSeParams,
         goto exit;
     }
 
-#if defined(SMP_MQTTS_CLIENT)
     /* encode cipher scheme id. */
-    cborStatus = cbor_encode_uint(&dataArray, pSeParams->cipherSchemeId);
-    if (CborNoError != cborStatus) {
-        WLOGE("encode cipher-scheme-id failed %x", cborStatus);
-        goto exit;
+    if (pSeParams->hasCipherSchemeId) {
+        cborStatus = cbor_encode_uint(&dataArray, pSeParams->cipherSchemeId);
+        if (CborNoError != cborStatus) {
+            WLOGE("encode cipher-scheme-id failed %x", cborStatus);
+            goto exit;
+        }
     }
-#endif
     /* Add ECC-DH public param. */
     cborStatus =
         cbor_encode_byte_string(&dataArray, pSeParams->pEccDhPubParams->data,
@@ -476,6 +679,31 @@ wosMsgPackSmpMqttsSEMessage(const WosMsgMqttsSeParams_t *pSeParams,
         }
     }
 
+    /* Add the optional session ticket and its lifetime. */
+    if (WOS_IS_VALID_BUFFER(pSeParams->pTicket)) {
+        cborStatus = cbor_encode_uint(&dataArray, pSeParams->ticketLifetime);
+        if (CborNoError != cborStatus) {
+            WLOGE("encode ticket lifetime failed %x", cborStatus);
+            goto exit;
+        }
+        cborStatus = cbor_encode_byte_string(&dataArray,
+                                             pSeParams->pTicket->data,
+                                             pSeParams->pTicket->length);
+        if (CborNoError != cborStatus) {
+            WLOGE("encode ticket failed %x", cborStatus);
+            goto exit;
+        }
+    }
+
+    /* Add the optional compression flag. */
+    if (pSeParams->hasCompression) {
+        cborStatus = cbor_encode_boolean(&dataArray, true);
+        if (CborNoError != cborStatus) {
+            WLOGE("encode compression failed %x", cborStatus);
+            goto exit;
+        }
+    }
+
     /* Close the top level array container. */
     cborStatus = cbor_encoder_close_container_checked(&encoder, &dataArray);
     if (CborNoError != cborStatus) {
@@ -516,9 +744,8 @@ WosMsgError_t wosMsgUnpackSmpMqttsSEMessage(const WosBuffer_t *pPackedBuffer,
     size_t length = 0;
     uint64_t version = 0;
     uint64_t numCerts = 0;
-#if defined(SMP_MQTTS_BROKER)
     uint64_t cipherSchemeId = 0;
-#endif
+    uint64_t ticketLifetime = 0;
     uint8_t i = 0;
 
     FUNCTION_ENTRY();
@@ -534,6 +761,10 @@ WosMsgError_t wosMsgUnpackSmpMqttsSEMessage(const WosBuffer_t *pPackedBuffer,
     /* This is to prevent to an undefined number of loops in free routine in
      * case an error occurs. */
     pSeParams->numCerts = 0;
+    pSeParams->hasCipherSchemeId = false;
+    pSeParams->ticketLifetime = 0;
+    pSeParams->pTicket = NULL;
+    pSeParams->hasCompression = false;
 
     /* Initialize the parser. */
     cborStatus = cbor_parser_init(pPackedBuffer->data, pPackedBuffer->length, 0,
@@ -565,21 +796,24 @@ WosMsgError_t wosMsgUnpackSmpMqttsSEMessage(const WosBuffer_t *pPackedBuffer,
         goto exit;
     }
 
-#if defined(SMP_MQTTS_BROKER)
-    /* Extract the cipher-scheme-id. */
-    msgStatus = msgCborParseUint64(&value1, &cipherSchemeId);
-    if (WOS_MSG_SUCCESS != msgStatus) {
-        WLOGE("extracting number of certificates failed %x", msgStatus);
-        goto exit;
-    }
-    pSeParams->cipherSchemeId = (uint8_t)cipherSchemeId;
-    /* Advance to next item. */
-    cborStatus = cbor_value_advance(&value1);
-    if (CborNoError != cborStatus) {
-        WLOGW("advancing to next item mecdh-publik-key failed %x", cborStatus);
-        goto exit;
+    /* Extract the cipher-scheme-id, a CONNECT has it in front of the ECC-DH
+     * public params which are a byte string. */
+    if (cbor_value_is_unsigned_integer(&value1)) {
+        msgStatus = msgCborParseUint64(&value1, &cipherSchemeId);
+        if (WOS_MSG_SUCCESS != msgStatus) {
+            WLOGE("extracting cipher-scheme-id failed %x", msgStatus);
+            goto exit;
+        }
+        pSeParams->cipherSchemeId = (uint8_t)cipherSchemeId;
+        pSeParams->hasCipherSchemeId = true;
+        /* Advance to next item. */
+        cborStatus = cbor_value_advance(&value1);
+        if (CborNoError != cborStatus) {
+            WLOGW("advancing to next item mecdh-publik-key failed %x",
+                  cborStatus);
+            goto exit;
+        }
     }
-#endif
 
     /* Get the ECC-DH-public-params, value2 is iterated to the next element. */
     msgStatus =
@@ -645,6 +879,38 @@ WosMsgError_t wosMsgUnpackSmpMqttsSEMessage(const WosBuffer_t *pPackedBuffer,
         }
     }
 
+    /* Extract the optional session ticket, older peers do not send it. */
+    if (cbor_value_is_unsigned_integer(&value2)) {
+        msgStatus = msgCborParseUint64(&value2, &ticketLifetime);
+        if ((WOS_MSG_SUCCESS != msgStatus) || (ticketLifetime > UINT32_MAX)) {
+            WLOGE("extracting ticket lifetime failed %x", msgStatus);
+            msgStatus = WOS_MSG_ERROR_BAD_FORMAT;
+            goto exit;
+        }
+        pSeParams->ticketLifetime = (uint32_t)ticketLifetime;
+        cborStatus = cbor_value_advance(&value2);
+        if (CborNoError != cborStatus) {
+            WLOGE("advancing to ticket failed %x", cborStatus);
+            goto exit;
+        }
+        msgStatus =
+            msgCborParseByteString(&value2, &(pSeParams->pTicket), &value1);
+        if (WOS_MSG_SUCCESS != msgStatus) {
+            WLOGE("extracting ticket failed %x", msgStatus);
+            goto exit;
+        }
+        value2 = value1;
+    }
+
+    /* Extract the optional compression flag, older peers do not send it. */
+    if (cbor_value_is_boolean(&value2)) {
+        cborStatus = cbor_value_get_boolean(&value2, &pSeParams->hasCompression);
+        if (CborNoError != cborStatus) {
+            WLOGE("extracting compression failed %x", cborStatus);
+            goto exit;
+        }
+    }
+
     msgStatus = WOS_MSG_SUCCESS;
 
 exit:
@@ -675,6 +941,7 @@ void wosMsgFreeSmpMqttsSEMessage(WosMsgMqttsSeParams_t *pSeParams)
         WOS_FREE_BUF_AND_DATA(pSeParams->pMqttPacket);
         WOS_FREE_BUF_AND_DATA(pSeParams->pEccDhPubParams);
         WOS_FREE_BUF_AND_DATA(pSeParams->pSignature);
+        WOS_FREE_BUF_AND_DATA(pSeParams->pTicket);
         if (NULL != pSeParams->ppCerts) {
             for (i = 0; i < pSeParams->numCerts; ++i) {
                 WOS_FREE_BUF_AND_DATA(pSeParams->ppCerts[i]);
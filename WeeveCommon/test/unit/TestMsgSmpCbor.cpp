@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <chrono>
+
 #include "gtest/gtest.h"
 
 #include "wosLog.h"
@@ -30,6 +32,9 @@ namespace
 #define TEST_IV "IVIVIVIVIV"
 #define TEST_AUTHTAG "AUTHTAG_AUTHTAG"
 
+#define TEST_TICKET "SESSION_TICKET"
+#define TEST_TICKET_LIFETIME (86400u)
+
 /* Test packing/parsing of SMP header.
  *
  * Step 1- Pack using wosMsgPackSmpHeader() API.
@@ -61,6 +66,7 @@ TEST(TestUnitMsgSmp, Trivial_SmpHeader)
     smpHeader1.messageType = WCL_SMP_MESSAGE_MQTTS_CONNECT;
     smpHeader1.clientId = TEST_CLIENT_ID;
     smpHeader1.messageId = TEST_MESSAGE_ID;
+    smpHeader1.epoch = 0;
 
     ///// Step 1 - Pack
     msgStatus = wosMsgPackSmpHeader(&smpHeader1, &packedBuffer);
@@ -130,25 +136,33 @@ TEST(TestUnitMsgSmp, Trivial_SeMessage)
 
     WosMsgMqttsSeParams_t seParams1 = {
         &encodedSmpHeaderBuffer,
-#if defined(SMP_MQTTS_CLIENT)
         TEST_CIPHER_SCHEME_ID_5,
-#endif
         &eccDhPubParam,
         &mqttPacket,
         &signature,
         numCerts,
-        pCertList
+        pCertList,
+        true
     };
     WosMsgMqttsSeParams_t seParams2 = {
         NULL,
-#if defined(SMP_MQTTS_CLIENT)
         0,
-#endif
         NULL,
         NULL,
         NULL,
         0,
-        NULL
+        NULL,
+        false
+    };
+    WosMsgMqttsSeParams_t seParams3 = {
+        NULL,
+        0,
+        NULL,
+        NULL,
+        NULL,
+        0,
+        NULL,
+        false
     };
     // This is expected CBOR-packed buffer
     uint8_t expectedPackedBuffer[] = {
@@ -197,10 +211,9 @@ TEST(TestUnitMsgSmp, Trivial_SeMessage)
     EXPECT_EQ(encodedSmpHeaderLength, (seParams1.pEncodedSmpHeader)->length);
     EXPECT_EQ(0, memcmp(encodedSmpHeader, (seParams1.pEncodedSmpHeader)->data,
                         encodedSmpHeaderLength));
-#if defined(SMP_MQTTS_CLIENT)
     // Check if cipher-scheme-id matches
     EXPECT_EQ(TEST_CIPHER_SCHEME_ID_5, seParams1.cipherSchemeId);
-#endif
+    EXPECT_TRUE(seParams1.hasCipherSchemeId);
     // Check if ecc-pub-param content matches
     ASSERT_NE((void *)0, seParams1.pEccDhPubParams);
     EXPECT_EQ(seParams1.pEccDhPubParams->length, strlen(TEST_ECC_DH_PUB_PARAM));
@@ -258,6 +271,8 @@ TEST(TestUnitMsgSmp, Trivial_SeMessage)
     ASSERT_EQ(0, msgStatus);
 
     ///// Step 7 - Check if parseed values are correct
+    // A SE-Ack message has no cipher-scheme-id
+    EXPECT_FALSE(seParams2.hasCipherSchemeId);
     // Check if header values are correct
     ASSERT_NE((void *)0, seParams2.pEncodedSmpHeader);
     EXPECT_EQ(encodedSmpHeaderLength, (seParams2.pEncodedSmpHeader)->length);
@@ -293,14 +308,21 @@ TEST(TestUnitMsgSmp, Trivial_SeMessage)
     EXPECT_EQ(0, memcmp((seParams2.ppCerts[1])->data, TEST_INTERMEDIATE_CA_CERT,
                         strlen(TEST_INTERMEDIATE_CA_CERT)));
 
-    ///// Step 8 - Free
+    ///// Step 8 - Parse the SE message with cipher-scheme-id and free both
+    msgStatus = wosMsgUnpackSmpMqttsSEMessage(&packedBuffer, &seParams3);
+    ASSERT_EQ(0, msgStatus);
+    EXPECT_TRUE(seParams3.hasCipherSchemeId);
+    EXPECT_EQ(TEST_CIPHER_SCHEME_ID_5, seParams3.cipherSchemeId);
+    ASSERT_NE((void *)0, seParams3.pEccDhPubParams);
+    EXPECT_EQ(0, memcmp(seParams3.pEccDhPubParams->data, TEST_ECC_DH_PUB_PARAM,
+                        strlen(TEST_ECC_DH_PUB_PARAM)));
+    ASSERT_EQ(2, seParams3.numCerts);
+    wosMsgFreeSmpMqttsSEMessage(&seParams3);
     wosMsgFreeSmpMqttsSEMessage(&seParams2);
 
     ///// Step 9 - Check if atleast members are set to NULL
     ASSERT_EQ((void *)0, seParams2.pEncodedSmpHeader);
-#if defined(SMP_MQTTS_CLIENT)
     ASSERT_EQ(0, seParams2.cipherSchemeId);
-#endif
     ASSERT_EQ((void *)0, seParams2.pEccDhPubParams);
     ASSERT_EQ((void *)0, seParams2.pMqttPacket);
     ASSERT_EQ((void *)0, seParams2.pSignature);
@@ -450,4 +472,258 @@ TEST(TestUnitMsgSmp, Trivial_ControlMessage)
     ASSERT_EQ((void *)0, controlParams2.pAuthTag);
 }
 
+/* CBor-packed control message carrying TEST_MQTT_PACKET, TEST_IV and
+ * TEST_AUTHTAG, as packed in Trivial_ControlMessage. */
+static const uint8_t gPackedControlMessage[] = {
+    0x9f, 0x58, 0x2c, 0x9f, 0x03, 0x04, 0x01, 0x78, 0x20, 0x43, 0x6c,
+    0x69, 0x65, 0x6e, 0x74, 0x49, 0x64, 0x30, 0x30, 0x30, 0x31, 0x30,
+    0x32, 0x30, 0x33, 0x30, 0x34, 0x30, 0x35, 0x30, 0x36, 0x30, 0x37,
+    0x30, 0x38, 0x30, 0x39, 0x31, 0x30, 0x31, 0x31, 0x1a, 0xaa, 0xbb,
+    0xcc, 0xdd, 0xff, 0x4b, 0x4d, 0x51, 0x54, 0x54, 0x5f, 0x50, 0x41,
+    0x43, 0x4b, 0x45, 0x54, 0x4a, 0x49, 0x56, 0x49, 0x56, 0x49, 0x56,
+    0x49, 0x56, 0x49, 0x56, 0x4f, 0x41, 0x55, 0x54, 0x48, 0x54, 0x41,
+    0x47, 0x5f, 0x41, 0x55, 0x54, 0x48, 0x54, 0x41, 0x47, 0xff};
+
+/* Test single pass parsing of a SMP message.
+ *
+ * Step 1- Parse a packed control message using wosMsgParseSmpMessage() API.
+ * Step 2- Validate the header fields.
+ * Step 3- Validate that the encoded header and the segments point into the
+ *         packed message and match the packed values.
+ */
+TEST(TestUnitMsgSmp, Trivial_ParseSmpMessage)
+{
+    WosMsgError_t msgStatus = WOS_MSG_ERROR;
+    WosBuffer_t packedBuffer = {(uint8_t *)gPackedControlMessage,
+                                sizeof(gPackedControlMessage)};
+    WosMsgSmpView_t smpView;
+
+    ///// Step 1 - Parse
+    msgStatus = wosMsgParseSmpMessage(&packedBuffer, &smpView);
+    ASSERT_EQ(0, msgStatus);
+
+    ///// Step 2 - Check if header values are correct
+    EXPECT_EQ(TEST_MESSAGE_CONTEXT_3, smpView.commonHeader.messageContext);
+    EXPECT_EQ(TEST_MESSAGE_CONTEXT_VERSION_4,
+              smpView.commonHeader.messageContextVersion);
+    EXPECT_EQ(WCL_SMP_MESSAGE_MQTTS_CONNECT, smpView.messageType);
+    EXPECT_EQ(TEST_MESSAGE_ID, smpView.messageId);
+    ASSERT_EQ(strlen(TEST_CLIENT_ID), smpView.clientId.length);
+    EXPECT_EQ(0, memcmp(smpView.clientId.data, TEST_CLIENT_ID,
+                        strlen(TEST_CLIENT_ID)));
+
+    ///// Step 3 - Check the encoded header and segments
+    EXPECT_EQ(packedBuffer.data + 3, smpView.encodedSmpHeader.data);
+    EXPECT_EQ(44u, smpView.encodedSmpHeader.length);
+    ASSERT_EQ(3, smpView.numSegments);
+    ASSERT_EQ(
+        strlen(TEST_MQTT_PACKET),
+        smpView.segments[WOS_MSG_SMP_CONTROL_SEGMENT_MQTT_PACKET].length);
+    EXPECT_EQ(
+        0, memcmp(smpView.segments[WOS_MSG_SMP_CONTROL_SEGMENT_MQTT_PACKET].data,
+                  TEST_MQTT_PACKET, strlen(TEST_MQTT_PACKET)));
+    ASSERT_EQ(strlen(TEST_IV),
+              smpView.segments[WOS_MSG_SMP_CONTROL_SEGMENT_IV].length);
+    EXPECT_EQ(0, memcmp(smpView.segments[WOS_MSG_SMP_CONTROL_SEGMENT_IV].data,
+                        TEST_IV, strlen(TEST_IV)));
+    ASSERT_EQ(strlen(TEST_AUTHTAG),
+              smpView.segments[WOS_MSG_SMP_CONTROL_SEGMENT_AUTH_TAG].length);
+    EXPECT_EQ(
+        0, memcmp(smpView.segments[WOS_MSG_SMP_CONTROL_SEGMENT_AUTH_TAG].data,
+                  TEST_AUTHTAG, strlen(TEST_AUTHTAG)));
+}
+
+/* Test that a truncated SMP message is either rejected or parsed without
+ * reading past its end, and never yields more segments than it holds.
+ */
+TEST(TestUnitMsgSmp, Negative_ParseTruncatedSmpMessage)
+{
+    WosBuffer_t packedBuffer = {(uint8_t *)gPackedControlMessage, 0};
+    WosMsgSmpView_t smpView;
+    uint8_t i = 0;
+
+    for (packedBuffer.length = 1;
+         packedBuffer.length < sizeof(gPackedControlMessage) - 1;
+         packedBuffer.length++) {
+        if (WOS_MSG_SUCCESS !=
+            wosMsgParseSmpMessage(&packedBuffer, &smpView)) {
+            continue;
+        }
+        EXPECT_GE(packedBuffer.length, 47u);
+        EXPECT_LT(smpView.numSegments, 3);
+        for (i = 0; i < smpView.numSegments; i++) {
+            EXPECT_LE(smpView.segments[i].data + smpView.segments[i].length,
+                      packedBuffer.data + packedBuffer.length);
+        }
+    }
+}
+
+/* Test that malformed CBOR is rejected.
+ *
+ * Step 1- Parse copies of gPackedControlMessage with one byte changed: a
+ *         root map, an empty root array, a text string or a reserved length
+ *         instead of the header, a header longer than the message, a header
+ *         which is not an array, a negative message context, a segment
+ *         longer than the message and an indefinite length segment.
+ * Step 2- Parse a header whose 64-bit length overflows the message.
+ */
+TEST(TestUnitMsgSmp, Negative_ParseMalformedSmpMessage)
+{
+    const struct {
+        size_t offset;
+        uint8_t value;
+    } mutations[] = {{0, 0xbf},  {0, 0x80},  {1, 0x78}, {1, 0x5c},
+                     {2, 0xff},  {3, 0xa0},  {4, 0x23}, {59, 0x58},
+                     {47, 0x5f}};
+    const uint8_t longHeader[] = {0x9f, 0x5b, 0xff, 0xff, 0xff, 0xff,
+                                  0xff, 0xff, 0xff, 0xf0, 0xff};
+    uint8_t message[sizeof(gPackedControlMessage)];
+    WosBuffer_t packedBuffer = {message, sizeof(message)};
+    WosMsgSmpView_t smpView;
+    size_t i = 0;
+
+    ///// Step 1 - One byte changed
+    for (i = 0; i < sizeof(mutations) / sizeof(mutations[0]); i++) {
+        memcpy(message, gPackedControlMessage, sizeof(message));
+        message[mutations[i].offset] = mutations[i].value;
+        EXPECT_NE(WOS_MSG_SUCCESS,
+                  wosMsgParseSmpMessage(&packedBuffer, &smpView))
+            << "byte " << mutations[i].offset;
+    }
+
+    ///// Step 2 - Header length overflowing the message
+    packedBuffer.data = (uint8_t *)longHeader;
+    packedBuffer.length = sizeof(longHeader);
+    EXPECT_NE(WOS_MSG_SUCCESS, wosMsgParseSmpMessage(&packedBuffer, &smpView));
+}
+
+/* Test packing of a SMP message from a header and byte strings.
+ *
+ * Step 1- Pack the header and segments of gPackedControlMessage using
+ *         wosMsgPackSmpMessage() API.
+ * Step 2- Validate the packed buffer matches gPackedControlMessage.
+ * Step 3- Validate that a too small output buffer is rejected.
+ */
+TEST(TestUnitMsgSmp, Trivial_PackSmpMessage)
+{
+    WosMsgError_t msgStatus = WOS_MSG_ERROR;
+    WosBuffer_t encodedSmpHeader = {(uint8_t *)gPackedControlMessage + 3, 44};
+    WosBuffer_t segments[3] = {
+        {(uint8_t *)TEST_MQTT_PACKET, strlen(TEST_MQTT_PACKET)},
+        {(uint8_t *)TEST_IV, strlen(TEST_IV)},
+        {(uint8_t *)TEST_AUTHTAG, strlen(TEST_AUTHTAG)}};
+    uint8_t pack[128] = {0};
+    WosBuffer_t packedBuffer = {pack, sizeof(pack)};
+
+    ///// Step 1 - Pack
+    msgStatus =
+        wosMsgPackSmpMessage(&encodedSmpHeader, segments, 3, &packedBuffer);
+    ASSERT_EQ(0, msgStatus);
+
+    ///// Step 2 - Check if expected CBOR-packed buffer match
+    ASSERT_EQ(sizeof(gPackedControlMessage), packedBuffer.length);
+    EXPECT_EQ(0, memcmp(packedBuffer.data, gPackedControlMessage,
+                        sizeof(gPackedControlMessage)));
+
+    ///// Step 3 - Output buffer too small
+    packedBuffer.length = sizeof(gPackedControlMessage) - 1;
+    msgStatus =
+        wosMsgPackSmpMessage(&encodedSmpHeader, segments, 3, &packedBuffer);
+    EXPECT_NE(0, msgStatus);
+}
+
+/* Test the optional session ticket of a Session Establishment Message.
+ *
+ * Step 1- Pack a SE message carrying a ticket.
+ * Step 2- Unpack it and validate the ticket and its lifetime.
+ * Step 3- Validate that a SE message without ticket unpacks with none.
+ */
+TEST(TestUnitMsgSmp, Trivial_SeMessageWithTicket)
+{
+    WosMsgError_t msgStatus = WOS_MSG_ERROR;
+    WosBuffer_t encodedSmpHeader = {(uint8_t *)gPackedControlMessage + 3, 44};
+    WosBuffer_t mqttPacket = {(uint8_t *)TEST_MQTT_PACKET,
+                              strlen(TEST_MQTT_PACKET)};
+    WosBuffer_t eccDhPubParam = {(uint8_t *)TEST_ECC_DH_PUB_PARAM,
+                                 strlen(TEST_ECC_DH_PUB_PARAM)};
+    WosBuffer_t signature = {(uint8_t *)TEST_SIGNATURE, strlen(TEST_SIGNATURE)};
+    WosBuffer_t validationCert = {(uint8_t *)TEST_VALIDATION_CERT,
+                                  strlen(TEST_VALIDATION_CERT)};
+    WosBuffer_t *pCertList[1] = {&validationCert};
+    WosBuffer_t ticket = {(uint8_t *)TEST_TICKET, strlen(TEST_TICKET)};
+    uint8_t pack[160] = {0};
+    WosBuffer_t packedBuffer = {pack, sizeof(pack)};
+    WosMsgMqttsSeParams_t seParams1 = {
+        &encodedSmpHeader, 0,    &eccDhPubParam, &mqttPacket, &signature, 1,
+        pCertList,         false, TEST_TICKET_LIFETIME, &ticket};
+    WosMsgMqttsSeParams_t seParams2 = {NULL, 0, NULL, NULL, NULL, 0, NULL};
+
+    ///// Step 1 - Pack
+    msgStatus = wosMsgPackSmpMqttsSEMessage(&seParams1, &packedBuffer);
+    ASSERT_EQ(0, msgStatus);
+
+    ///// Step 2 - Unpack and check the ticket
+    msgStatus = wosMsgUnpackSmpMqttsSEMessage(&packedBuffer, &seParams2);
+    ASSERT_EQ(0, msgStatus);
+    ASSERT_EQ(1, seParams2.numCerts);
+    EXPECT_EQ(TEST_TICKET_LIFETIME, seParams2.ticketLifetime);
+    ASSERT_NE((void *)0, seParams2.pTicket);
+    ASSERT_EQ(strlen(TEST_TICKET), seParams2.pTicket->length);
+    EXPECT_EQ(0, memcmp(seParams2.pTicket->data, TEST_TICKET,
+                        strlen(TEST_TICKET)));
+    wosMsgFreeSmpMqttsSEMessage(&seParams2);
+    EXPECT_EQ((void *)0, seParams2.pTicket);
+
+    ///// Step 3 - No ticket
+    seParams1.pTicket = NULL;
+    packedBuffer.length = sizeof(pack);
+    msgStatus = wosMsgPackSmpMqttsSEMessage(&seParams1, &packedBuffer);
+    ASSERT_EQ(0, msgStatus);
+    msgStatus = wosMsgUnpackSmpMqttsSEMessage(&packedBuffer, &seParams2);
+    ASSERT_EQ(0, msgStatus);
+    EXPECT_EQ(0u, seParams2.ticketLifetime);
+    EXPECT_EQ((void *)0, seParams2.pTicket);
+    wosMsgFreeSmpMqttsSEMessage(&seParams2);
+}
+
+/* Compare the cost of parsing a received control message with
+ * wosMsgUnpackSmpHeaderFromSmpMsg() followed by
+ * wosMsgUnpackSmpMqttsControlMessage(), as done before, against a single
+ * wosMsgParseSmpMessage().
+ */
+TEST(TestUnitMsgSmp, Performance_ParseSmpMessage)
+{
+    const int iterations = 100000;
+    WosBuffer_t packedBuffer = {(uint8_t *)gPackedControlMessage,
+                                sizeof(gPackedControlMessage)};
+    char clientId[TEST_CLIENT_ID_LENGTH] = {0};
+    WosSmpHeader_t smpHeader = {{0, 0}, (WclSmpMessageType_t)0, clientId, 0};
+    WosMsgMqttsControlParams_t controlParams = {NULL, NULL, NULL, NULL};
+    WosMsgSmpView_t smpView;
+    int i = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (i = 0; i < iterations; i++) {
+        ASSERT_EQ(0,
+                  wosMsgUnpackSmpHeaderFromSmpMsg(&packedBuffer, &smpHeader));
+        ASSERT_EQ(0, wosMsgUnpackSmpMqttsControlMessage(&packedBuffer,
+                                                        &controlParams));
+        wosMsgFreeSmpMqttsControlMessage(&controlParams);
+    }
+    auto twoPass = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (i = 0; i < iterations; i++) {
+        ASSERT_EQ(0, wosMsgParseSmpMessage(&packedBuffer, &smpView));
+    }
+    auto singlePass = std::chrono::steady_clock::now() - start;
+
+    printf("two pass unpack: %.1f ns/message, single pass parse: %.1f "
+           "ns/message\n",
+           std::chrono::duration<double, std::nano>(twoPass).count() /
+               iterations,
+           std::chrono::duration<double, std::nano>(singlePass).count() /
+               iterations);
+}
+
 } // namespace
@@ -7,14 +7,6 @@ set(WOS_COMMON_SRC_DIR ${WOS_ROOT_DIR}/src)
 set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} -DLOG_LEVEL=${LOG_LEVEL}")
 set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -DLOG_LEVEL=${LOG_LEVEL}")
 
-if(${LIB_SMP_ROLE} STREQUAL "MQTTS_CLIENT")
-    add_definitions(-DSMP_MQTTS_CLIENT)
-elseif(${LIB_SMP_ROLE} STREQUAL "MQTTS_BROKER")
-    add_definitions(-DSMP_MQTTS_BROKER)
-else()
-    message(FATAL_ERROR "library build role type is not defined.")
-endif()
-
 if(${MESSAGE_PACK} STREQUAL "TINYCBOR")
     set(TINYCBOR_LIB_NAME tinycbor)
     if(${WCL_LIB_TYPE} STREQUAL "static")
@@ -24,6 +24,11 @@
 #endif
 
 
+#if defined(WITH_IO_URING) && defined(WITH_EPOLL)
+   /* io_uring replaces epoll rather than adding to it. */
+#  undef WITH_EPOLL
+#endif
+
 #define uthash_malloc(sz) mosquitto__malloc(sz)
 #define uthash_free(ptr,sz) mosquitto__free(ptr)
 
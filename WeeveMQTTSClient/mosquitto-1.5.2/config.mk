@@ -43,6 +43,10 @@ WITH_BRIDGE:=yes
 # suggested by the MQTT spec), but it can be disabled if required.
 WITH_PERSISTENCE:=yes
 
+# Comment out to decode the persistent database on a single thread at startup.
+# If enabled, large databases are restored on several threads.
+WITH_PARALLEL_RESTORE:=yes
+
 # Comment out to remove memory tracking support from the broker. If disabled,
 # mosquitto won't track heap memory usage nor export '$SYS/broker/heap/current
 # size', but will use slightly less memory and CPU time.
@@ -92,6 +96,10 @@ WITH_STATIC_LIBRARIES:=no
 # Build with epoll support.
 WITH_EPOLL:=yes
 
+# Build with an io_uring event loop in place of epoll. Requires Linux 6.0 or
+# later.
+WITH_IO_URING:=no
+
 # Build with bundled uthash.h
 WITH_BUNDLED_DEPS:=yes
 
@@ -218,6 +226,10 @@ endif
 
 ifeq ($(WITH_PERSISTENCE),yes)
 	BROKER_CFLAGS:=$(BROKER_CFLAGS) -DWITH_PERSISTENCE
+	ifeq ($(WITH_PARALLEL_RESTORE),yes)
+		BROKER_CFLAGS:=$(BROKER_CFLAGS) -DWITH_PARALLEL_RESTORE
+		BROKER_LIBS:=$(BROKER_LIBS) -lpthread
+	endif
 endif
 
 ifeq ($(WITH_MEMORY_TRACKING),yes)
@@ -284,7 +296,11 @@ ifeq ($(WITH_STRIP),yes)
 	STRIP_OPTS?=-s --strip-program=${CROSS_COMPILE}${STRIP}
 endif
 
-ifeq ($(WITH_EPOLL),yes)
+ifeq ($(WITH_IO_URING),yes)
+	ifeq ($(UNAME),Linux)
+		BROKER_CFLAGS:=$(BROKER_CFLAGS) -DWITH_IO_URING
+	endif
+else ifeq ($(WITH_EPOLL),yes)
 	ifeq ($(UNAME),Linux)
 		BROKER_CFLAGS:=$(BROKER_CFLAGS) -DWITH_EPOLL
 	endif
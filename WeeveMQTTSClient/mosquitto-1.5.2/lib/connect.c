@@ -53,14 +53,7 @@ static int mosquitto__connect_init(struct mosquitto *mosq, const char *host, int
 
 	mosq->keepalive = keepalive;
 
-	if(mosq->sockpairR != INVALID_SOCKET){
-		COMPAT_CLOSE(mosq->sockpairR);
-		mosq->sockpairR = INVALID_SOCKET;
-	}
-	if(mosq->sockpairW != INVALID_SOCKET){
-		COMPAT_CLOSE(mosq->sockpairW);
-		mosq->sockpairW = INVALID_SOCKET;
-	}
+	net__socketpair_close(&mosq->sockpairR, &mosq->sockpairW);
 
 	if(net__socketpair(&mosq->sockpairR, &mosq->sockpairW)){
 		log__printf(mosq, MOSQ_LOG_WARNING,
@@ -131,24 +124,30 @@ static int mosquitto__reconnect(struct mosquitto *mosq, bool blocking)
 
 #if defined(WITH_WEEVE_SMP)
 	WclError_t wclStatus = WCL_SUCCESS;
+	WosBuffer_t ticket = {NULL, 0};
 	if(mosq->smpSession) {
+		/* Resume the session on the new connection if the broker gave us a
+		 * ticket, otherwise this is a full session establishment. */
+		wclSmpExportTicket(mosq->smpSession, &ticket);
 		wclStatus = wclSmpClose(mosq->smpSession);
 		mosq->smpSession = NULL;
 		if (WCL_SUCCESS != wclStatus) {
 		
 		}
 	}
-	wclTerminate();
-	
-	wclStatus = wclInit();
-	if (WCL_SUCCESS != wclStatus) {
-
-	}
-	
-	wclStatus = wclSmpOpen(&mosq->smpSession);
+	/* Only the session is replaced, the library stays initialised from
+	 * mosquitto_lib_init() with its executor and dictionaries. */
+	wclStatus = wclSmpOpen(&mosq->smpSession, WCL_SMP_ROLE_MQTTS_CLIENT);
 	if(WCL_SUCCESS != wclStatus){
 
 	}
+	if(mosq->smpSession && ticket.data){
+		wclSmpImportTicket(mosq->smpSession, &ticket);
+	}
+	wclFreeBuffer(&ticket);
+	if(mosq->smpSession && mosq->smp_compression){
+		wclSmpSetCompression(mosq->smpSession, true);
+	}
 
 #endif
 
@@ -174,6 +173,7 @@ static int mosquitto__reconnect(struct mosquitto *mosq, bool blocking)
 	packet__cleanup(&mosq->in_packet);
 		
 	pthread_mutex_lock(&mosq->current_out_packet_mutex);
+	packet__intake_collect(mosq, false);
 	pthread_mutex_lock(&mosq->out_packet_mutex);
 
 	if(mosq->out_packet && !mosq->current_out_packet){
@@ -44,7 +44,6 @@ int mosquitto_loop(struct mosquitto *mosq, int timeout, int max_packets)
 	fd_set readfds, writefds;
 	int fdcount;
 	int rc;
-	char pairbuf;
 	int maxfd = 0;
 	time_t now;
 
@@ -62,7 +61,9 @@ int mosquitto_loop(struct mosquitto *mosq, int timeout, int max_packets)
 		FD_SET(mosq->sock, &readfds);
 		pthread_mutex_lock(&mosq->current_out_packet_mutex);
 		pthread_mutex_lock(&mosq->out_packet_mutex);
-		if(mosq->out_packet || mosq->current_out_packet){
+		if(mosq->out_packet || mosq->current_out_packet
+				|| __atomic_load_n(&mosq->out_packet_intake, __ATOMIC_RELAXED)){
+
 			FD_SET(mosq->sock, &writefds);
 		}
 #ifdef WITH_TLS
@@ -159,16 +160,11 @@ int mosquitto_loop(struct mosquitto *mosq, int timeout, int max_packets)
 						if(rc || mosq->sock == INVALID_SOCKET){
 							return rc;
 						}
-					}while(SSL_DATA_PENDING(mosq));
+					}while(SSL_DATA_PENDING(mosq) || NET_DATA_PENDING(mosq));
 				}
 			}
 			if(mosq->sockpairR != INVALID_SOCKET && FD_ISSET(mosq->sockpairR, &readfds)){
-#ifndef WIN32
-				if(read(mosq->sockpairR, &pairbuf, 1) == 0){
-				}
-#else
-				recv(mosq->sockpairR, &pairbuf, 1, 0);
-#endif
+				net__socketpair_drain(mosq->sockpairR);
 				/* Fake write possible, to stimulate output write even though
 				 * we didn't ask for it, because at that point the publish or
 				 * other command wasn't present. */
@@ -34,7 +34,25 @@ Contributors:
 
 #ifdef REAL_WITH_MEMORY_TRACKING
 static unsigned long memcount = 0;
+
+#  if defined(WITH_PARALLEL_RESTORE) && defined(__GNUC__)
+/* The broker restores its persistent database on several threads. Each keeps
+ * its own peak, which the main thread collects with memory__max_merge(). */
+static __thread unsigned long max_memcount = 0;
+#    define memcount_add(size) memcount_peak(__sync_add_and_fetch(&memcount, (size)))
+#    define memcount_sub(size) __sync_sub_and_fetch(&memcount, (size))
+#  else
 static unsigned long max_memcount = 0;
+#    define memcount_add(size) memcount_peak(memcount += (size))
+#    define memcount_sub(size) (memcount -= (size))
+#  endif
+
+static void memcount_peak(unsigned long used)
+{
+	if(used > max_memcount){
+		max_memcount = used;
+	}
+}
 #endif
 
 #ifdef WITH_BROKER
@@ -67,10 +85,7 @@ void *mosquitto__calloc(size_t nmemb, size_t size)
 
 #ifdef REAL_WITH_MEMORY_TRACKING
 	if(mem){
-		memcount += malloc_usable_size(mem);
-		if(memcount > max_memcount){
-			max_memcount = memcount;
-		}
+		memcount_add(malloc_usable_size(mem));
 	}
 #endif
 
@@ -83,7 +98,7 @@ void mosquitto__free(void *mem)
 	if(!mem){
 		return;
 	}
-	memcount -= malloc_usable_size(mem);
+	memcount_sub(malloc_usable_size(mem));
 #endif
 	free(mem);
 }
@@ -99,10 +114,7 @@ void *mosquitto__malloc(size_t size)
 
 #ifdef REAL_WITH_MEMORY_TRACKING
 	if(mem){
-		memcount += malloc_usable_size(mem);
-		if(memcount > max_memcount){
-			max_memcount = memcount;
-		}
+		memcount_add(malloc_usable_size(mem));
 	}
 #endif
 
@@ -119,6 +131,11 @@ unsigned long mosquitto__max_memory_used(void)
 {
 	return max_memcount;
 }
+
+void memory__max_merge(unsigned long peak)
+{
+	memcount_peak(peak);
+}
 #endif
 
 void *mosquitto__realloc(void *ptr, size_t size)
@@ -131,17 +148,14 @@ void *mosquitto__realloc(void *ptr, size_t size)
 	void *mem;
 #ifdef REAL_WITH_MEMORY_TRACKING
 	if(ptr){
-		memcount -= malloc_usable_size(ptr);
+		memcount_sub(malloc_usable_size(ptr));
 	}
 #endif
 	mem = realloc(ptr, size);
 
 #ifdef REAL_WITH_MEMORY_TRACKING
 	if(mem){
-		memcount += malloc_usable_size(mem);
-		if(memcount > max_memcount){
-			max_memcount = memcount;
-		}
+		memcount_add(malloc_usable_size(mem));
 	}
 #endif
 
@@ -159,10 +173,7 @@ char *mosquitto__strdup(const char *s)
 
 #ifdef REAL_WITH_MEMORY_TRACKING
 	if(str){
-		memcount += malloc_usable_size(str);
-		if(memcount > max_memcount){
-			max_memcount = memcount;
-		}
+		memcount_add(malloc_usable_size(str));
 	}
 #endif
 
@@ -29,7 +29,10 @@ void mosquitto__free(void *mem);
 void *mosquitto__malloc(size_t size);
 #ifdef REAL_WITH_MEMORY_TRACKING
 unsigned long mosquitto__memory_used(void);
+/* The peak as seen by the calling thread. */
 unsigned long mosquitto__max_memory_used(void);
+/* Fold in the peak reported by another thread. */
+void memory__max_merge(unsigned long peak);
 #endif
 void *mosquitto__realloc(void *ptr, size_t size);
 char *mosquitto__strdup(const char *s);
@@ -221,10 +221,13 @@ int mosquitto_reinitialise(struct mosquitto *mosq, const char *id, bool clean_se
 	pthread_mutex_init(&mosq->in_message_mutex, NULL);
 	pthread_mutex_init(&mosq->out_message_mutex, NULL);
 	pthread_mutex_init(&mosq->mid_mutex, NULL);
+#  ifdef WITH_WEEVE_SMP
+	pthread_mutex_init(&mosq->smp_mutex, NULL);
+#  endif
 	mosq->thread_id = pthread_self();
 #endif
 #if defined(WITH_WEEVE_SMP)
-	wclStatus = wclSmpOpen(&mosq->smpSession);
+	wclStatus = wclSmpOpen(&mosq->smpSession, WCL_SMP_ROLE_MQTTS_CLIENT);
 	if(WCL_SUCCESS != wclStatus){
 		errno = EINVAL;
 		return NULL;
@@ -272,6 +275,9 @@ void mosquitto__destroy(struct mosquitto *mosq)
 		pthread_mutex_destroy(&mosq->in_message_mutex);
 		pthread_mutex_destroy(&mosq->out_message_mutex);
 		pthread_mutex_destroy(&mosq->mid_mutex);
+#  ifdef WITH_WEEVE_SMP
+		pthread_mutex_destroy(&mosq->smp_mutex);
+#  endif
 	}
 #endif
 	if(mosq->sock != INVALID_SOCKET){
@@ -315,7 +321,13 @@ void mosquitto__destroy(struct mosquitto *mosq)
 	mosquitto__free(mosq->bind_address);
 	mosq->bind_address = NULL;
 
-	/* Out packet cleanup */
+	/* Out packet cleanup. No other thread is left to queue packets. */
+	while(mosq->out_packet_intake){
+		packet = mosq->out_packet_intake;
+		mosq->out_packet_intake = packet->next;
+		packet__cleanup(packet);
+		mosquitto__free(packet);
+	}
 	if(mosq->out_packet && !mosq->current_out_packet){
 		mosq->current_out_packet = mosq->out_packet;
 		mosq->out_packet = mosq->out_packet->next;
@@ -333,14 +345,7 @@ void mosquitto__destroy(struct mosquitto *mosq)
 	}
 
 	packet__cleanup(&mosq->in_packet);
-	if(mosq->sockpairR != INVALID_SOCKET){
-		COMPAT_CLOSE(mosq->sockpairR);
-		mosq->sockpairR = INVALID_SOCKET;
-	}
-	if(mosq->sockpairW != INVALID_SOCKET){
-		COMPAT_CLOSE(mosq->sockpairW);
-		mosq->sockpairW = INVALID_SOCKET;
-	}
+	net__socketpair_close(&mosq->sockpairR, &mosq->sockpairW);
 }
 
 void mosquitto_destroy(struct mosquitto *mosq)
@@ -361,7 +366,9 @@ int mosquitto_socket(struct mosquitto *mosq)
 bool mosquitto_want_write(struct mosquitto *mosq)
 {
 	bool result = false;
-	if(mosq->out_packet || mosq->current_out_packet){
+	if(mosq->out_packet || mosq->current_out_packet
+			|| __atomic_load_n(&mosq->out_packet_intake, __ATOMIC_RELAXED)){
+
 		result = true;
 	}
 #ifdef WITH_TLS
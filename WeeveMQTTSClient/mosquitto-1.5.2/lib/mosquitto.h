@@ -94,6 +94,9 @@ enum mosq_opt_t {
 	MOSQ_OPT_PROTOCOL_VERSION = 1,
 	MOSQ_OPT_SSL_CTX = 2,
 	MOSQ_OPT_SSL_CTX_WITH_DEFAULTS = 3,
+	MOSQ_OPT_SMP_ENCRYPT_IN_CALLER = 4,
+	MOSQ_OPT_SMP_BATCH_MAX_BYTES = 5,
+	MOSQ_OPT_SMP_COMPRESSION = 6,
 };
 
 /* MQTT specification restricts client ids to a maximum of 23 characters */
@@ -987,6 +990,36 @@ libmosq_EXPORT int mosquitto_threaded_set(struct mosquitto *mosq, bool threaded)
  *	          you should use <mosquitto_tls_set> to configure the cafile/capath
  *	          as a minimum.
  *	          This option is only available for openssl 1.1.0 and higher.
+ *
+ *	MOSQ_OPT_SMP_ENCRYPT_IN_CALLER
+ *	          Value must be an int set to 1 or 0. If set to 1, outgoing packets
+ *	          are encrypted for the SMP session by the thread that sends them,
+ *	          for example the one calling <mosquitto_publish>, rather than by
+ *	          the network thread. Encryption is serialised either way, but
+ *	          this takes the work off the network thread when several
+ *	          application threads publish. If set to 0, an encryption failure
+ *	          is reported by the network loop rather than by the call that
+ *	          sent the packet. Must be set before the client connects.
+ *	          Defaults to 0. Only available when built with SMP support.
+ *
+ *	MOSQ_OPT_SMP_BATCH_MAX_BYTES
+ *	          Value must be an int, 0 or greater. Packets the network thread
+ *	          picks up together are sealed as one SMP record of up to this
+ *	          many bytes of MQTT data, rather than one record each. Packets
+ *	          are never held back to fill a record. CONNECT, DISCONNECT and
+ *	          QoS 0 PUBLISH packets, whose completion is reported on their
+ *	          own, are always sent alone. Has no effect when
+ *	          MOSQ_OPT_SMP_ENCRYPT_IN_CALLER is set. The broker must
+ *	          understand batched records. Defaults to 0, which sends every
+ *	          packet in its own record. Only available when built with SMP
+ *	          support.
+ *
+ *	MOSQ_OPT_SMP_COMPRESSION
+ *	          Value must be an int, 0 or 1. If 1, offer the broker to
+ *	          compress the packets of the SMP session before encrypting them.
+ *	          Takes effect on the next connection, if the broker accepts.
+ *	          Connections resumed with a session ticket are not compressed.
+ *	          Defaults to 0. Only available when built with SMP support.
  */
 libmosq_EXPORT int mosquitto_opts_set(struct mosquitto *mosq, enum mosq_opt_t option, void *value);
 
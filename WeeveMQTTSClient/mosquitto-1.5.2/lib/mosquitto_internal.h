@@ -62,6 +62,17 @@ Contributors:
 #  endif
 #  include "uthash.h"
 struct mosquitto_client_msg;
+struct mosquitto__retain_pending;
+struct mosquitto__spool;
+struct mosquitto_db;
+
+struct mosquitto__timer{
+	struct mosquitto__timer *next;
+	struct mosquitto__timer **pprev; /* NULL when the timer isn't pending. */
+	time_t expires;
+	void (*callback)(struct mosquitto_db *db, struct mosquitto__timer *timer);
+	void *userdata;
+};
 #endif
 
 #if defined(WITH_WEEVE_SMP)
@@ -154,6 +165,7 @@ struct mosquitto__packet{
 	uint32_t smp_to_process;
 	uint32_t smp_pos;
 	int8_t smp_remaining_count;
+	bool smp_pending; /* Queued unencrypted, see packet__smp_seal_pending_many(). */
 #endif
 };
 
@@ -166,15 +178,17 @@ struct mosquitto_message_all{
 	struct mosquitto_message msg;
 };
 
+/* The broker keeps one of these for every client, connected or not, so keep
+ * an eye on padding when adding fields. */
 struct mosquitto {
 	mosq_sock_t sock;
 #ifndef WITH_BROKER
 	mosq_sock_t sockpairR, sockpairW;
 #endif
+	enum mosquitto__protocol protocol;
 #if defined(__GLIBC__) && defined(WITH_ADNS)
 	struct gaicb *adns; /* For getaddrinfo_a */
 #endif
-	enum mosquitto__protocol protocol;
 	char *address;
 	char *id;
 	char *username;
@@ -186,6 +200,9 @@ struct mosquitto {
 	time_t next_msg_out;
 	time_t ping_t;
 	struct mosquitto__packet in_packet;
+	uint8_t *in_buf; /* Received data not yet decoded, see net__read_buffered(). */
+	uint32_t in_buf_pos;
+	uint32_t in_buf_len;
 	struct mosquitto__packet *current_out_packet;
 	struct mosquitto__packet *out_packet;
 	struct mosquitto_message *will;
@@ -217,28 +234,40 @@ struct mosquitto {
 	pthread_mutex_t in_message_mutex;
 	pthread_mutex_t out_message_mutex;
 	pthread_mutex_t mid_mutex;
+#  ifdef WITH_WEEVE_SMP
+	pthread_mutex_t smp_mutex;
+#  endif
 	pthread_t thread_id;
 #endif
 	bool clean_session;
 #ifdef WITH_BROKER
 	bool is_dropping;
 	bool is_bridge;
+	bool ws_want_write;
+	bool write_deferred; /* packet__queue() leaves the writing to the caller. */
 	struct mosquitto__bridge *bridge;
 	struct mosquitto_client_msg *inflight_msgs;
 	struct mosquitto_client_msg *last_inflight_msg;
 	struct mosquitto_client_msg *queued_msgs;
 	struct mosquitto_client_msg *last_queued_msg;
+	struct mosquitto_client_msg **msg_index; /* Messages that can be acknowledged, by mid. */
+	uint32_t msg_index_size;
+	uint32_t msg_index_used;
+	struct mosquitto_client_msg *inflight_send_msg; /* No in-flight message before this one needs sending. */
+	struct mosquitto__retain_pending *retain_pending;
+	struct mosquitto__retain_pending *last_retain_pending;
+	struct mosquitto__spool *spool;
 	unsigned long msg_bytes;
 	unsigned long msg_bytes12;
+	int inflight_count;
 	int msg_count;
 	int msg_count12;
+	int sub_count;
 	struct mosquitto__acl_user *acl_list;
 	struct mosquitto__listener *listener;
 	time_t disconnect_t;
 	struct mosquitto__packet *out_packet_last;
 	struct mosquitto__subhier **subs;
-	int sub_count;
-	int pollfd_index;
 #  ifdef WITH_WEBSOCKETS
 #    if defined(LWS_LIBRARY_VERSION_NUMBER)
 	struct lws *wsi;
@@ -247,7 +276,7 @@ struct mosquitto {
 	struct libwebsocket *wsi;
 #    endif
 #  endif
-	bool ws_want_write;
+	int pollfd_index;
 #else
 #  ifdef WITH_SOCKS
 	char *socks5_host;
@@ -280,6 +309,12 @@ struct mosquitto {
 	bool reconnect_exponential_backoff;
 	char threaded;
 	struct mosquitto__packet *out_packet_last;
+	struct mosquitto__packet *out_packet_intake; /* Newest first, see packet__queue(). */
+#  ifdef WITH_WEEVE_SMP
+	bool smp_encrypt_in_caller;
+	int smp_batch_max_bytes;
+	bool smp_compression;
+#  endif
 	int inflight_messages;
 	int max_inflight_messages;
 #  ifdef WITH_SRV
@@ -291,13 +326,25 @@ struct mosquitto {
 	UT_hash_handle hh_id;
 	UT_hash_handle hh_sock;
 	struct mosquitto *for_free_next;
+	struct mosquitto *ready_next;
+	struct mosquitto **ready_pprev; /* NULL when not on the ready list. */
+	struct mosquitto__timer keepalive_timer;
 #endif
-#ifdef WITH_EPOLL
+#if defined(WITH_EPOLL) || defined(WITH_IO_URING)
 	uint32_t events;
 #endif
+#ifdef WITH_IO_URING
+	uint32_t uring_gen; /* Tells this socket's completions from stale ones. */
+	bool uring_recv; /* in_buf is lent by the io_uring buffer ring. */
+#endif
 #if defined(WITH_WEEVE_SMP)
 	WclSession_t smpSession;
 #endif
+#if defined(WITH_BROKER) && defined(WITH_WEEVE_SMP)
+	/* Received SMP messages, oldest first, see smp_async__queue(). */
+	struct mosquitto__smp_job *smp_jobs;
+	struct mosquitto__smp_job *smp_jobs_last;
+#endif
 };
 
 #define STREMPTY(str) (str[0] == '\0')
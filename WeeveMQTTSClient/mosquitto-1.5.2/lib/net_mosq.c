@@ -32,6 +32,10 @@ Contributors:
 #include <ws2tcpip.h>
 #endif
 
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
 #ifdef __ANDROID__
 #include <linux/in.h>
 #include <linux/in6.h>
@@ -73,6 +77,13 @@ Contributors:
 int tls_ex_index_mosq = -1;
 #endif
 
+#ifdef WITH_BROKER
+/* The broker reads from one client at a time and empties its receive buffer
+ * before moving on, so a buffer handed back is kept here for the next client
+ * rather than each connection holding one of its own. */
+static uint8_t *net__spare_in_buf = NULL;
+#endif
+
 int net__init(void)
 {
 #ifdef WIN32
@@ -119,6 +130,40 @@ void net__cleanup(void)
 #ifdef WIN32
 	WSACleanup();
 #endif
+
+#ifdef WITH_BROKER
+	mosquitto__free(net__spare_in_buf);
+	net__spare_in_buf = NULL;
+#endif
+}
+
+
+static void net__read_buffer_free(struct mosquitto *mosq)
+{
+#ifdef WITH_IO_URING
+	if(mosq->uring_recv){
+		/* Lent by the io_uring buffer ring, which takes it back itself. */
+		mosq->in_buf = NULL;
+	}
+#endif
+#ifdef WITH_BROKER
+	if(!net__spare_in_buf){
+		net__spare_in_buf = mosq->in_buf;
+		mosq->in_buf = NULL;
+	}
+#endif
+	mosquitto__free(mosq->in_buf);
+	mosq->in_buf = NULL;
+	mosq->in_buf_pos = 0;
+	mosq->in_buf_len = 0;
+}
+
+
+void net__read_buffer_release(struct mosquitto *mosq)
+{
+	if(mosq->in_buf && !NET_DATA_PENDING(mosq)){
+		net__read_buffer_free(mosq);
+	}
 }
 
 
@@ -165,12 +210,17 @@ int net__socket_close(struct mosquitto *mosq)
 		if((int)mosq->sock >= 0){
 #ifdef WITH_BROKER
 			HASH_DELETE(hh_sock, db->contexts_by_sock, mosq);
+#endif
+#ifdef WITH_IO_URING
+			uring__remove(db, mosq);
 #endif
 			rc = COMPAT_CLOSE(mosq->sock);
 			mosq->sock = INVALID_SOCKET;
 		}
 	}
 
+	net__read_buffer_free(mosq);
+
 #ifdef WITH_BROKER
 	if(mosq->listener){
 		mosq->listener->client_count--;
@@ -698,6 +748,66 @@ ssize_t net__read(struct mosquitto *mosq, void *buf, size_t count)
 #endif
 }
 
+/* Read through the receive buffer. When it is empty it is refilled with a
+ * single read of up to NET_RX_BUF_SIZE bytes, so decoding a packet a few bytes
+ * at a time doesn't cost a system call for each, and several packets that
+ * arrived together come out of one read. Reads at least as large as the buffer
+ * go straight to the socket once it is empty. The buffer is freed whenever the
+ * socket has nothing more to give, or handed back with
+ * net__read_buffer_release(), so idle connections don't hold one. */
+ssize_t net__read_buffered(struct mosquitto *mosq, void *buf, size_t count)
+{
+	ssize_t len;
+	int err;
+
+	assert(mosq);
+
+	if(mosq->in_buf_pos == mosq->in_buf_len){
+#ifdef WITH_IO_URING
+		if(mosq->uring_recv){
+			/* The ring does the reading, nothing more until its next
+			 * completion. */
+			errno = EAGAIN;
+			return -1;
+		}
+#endif
+		if(count >= NET_RX_BUF_SIZE){
+			return net__read(mosq, buf, count);
+		}
+#ifdef WITH_BROKER
+		if(!mosq->in_buf){
+			mosq->in_buf = net__spare_in_buf;
+			net__spare_in_buf = NULL;
+		}
+#endif
+		if(!mosq->in_buf){
+			mosq->in_buf = mosquitto__malloc(NET_RX_BUF_SIZE);
+			if(!mosq->in_buf){
+				errno = ENOMEM;
+				return -1;
+			}
+		}
+		len = net__read(mosq, mosq->in_buf, NET_RX_BUF_SIZE);
+		if(len <= 0){
+			err = errno;
+			net__read_buffer_free(mosq);
+			errno = err;
+			return len;
+		}
+		mosq->in_buf_pos = 0;
+		mosq->in_buf_len = len;
+	}
+
+	if(count > mosq->in_buf_len - mosq->in_buf_pos){
+		count = mosq->in_buf_len - mosq->in_buf_pos;
+	}
+	memcpy(buf, &mosq->in_buf[mosq->in_buf_pos], count);
+	mosq->in_buf_pos += count;
+	errno = 0;
+	return count;
+}
+
+
 ssize_t net__write(struct mosquitto *mosq, void *buf, size_t count)
 {
 #ifdef WITH_TLS
@@ -746,6 +856,19 @@ ssize_t net__write(struct mosquitto *mosq, void *buf, size_t count)
 }
 
 
+#ifndef WIN32
+/* Gathered write of several buffers in one call. Not for TLS connections,
+ * which have to go through net__write() one buffer at a time. */
+ssize_t net__writev(struct mosquitto *mosq, const struct iovec *iov, int iovcnt)
+{
+	assert(mosq);
+
+	errno = 0;
+	return writev(mosq->sock, iov, iovcnt);
+}
+#endif
+
+
 int net__socket_nonblock(mosq_sock_t *sock)
 {
 #ifndef WIN32
@@ -773,7 +896,7 @@ int net__socket_nonblock(mosq_sock_t *sock)
 }
 
 
-#ifndef WITH_BROKER
+#if !defined(WITH_BROKER) || defined(WITH_WEEVE_SMP)
 int net__socketpair(mosq_sock_t *pairR, mosq_sock_t *pairW)
 {
 #ifdef WIN32
@@ -880,6 +1003,16 @@ int net__socketpair(mosq_sock_t *pairR, mosq_sock_t *pairW)
 		return MOSQ_ERR_SUCCESS;
 	}
 	return MOSQ_ERR_UNKNOWN;
+#elif defined(HAVE_EVENTFD)
+	int efd;
+
+	efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if(efd == -1){
+		return MOSQ_ERR_ERRNO;
+	}
+	*pairR = efd;
+	*pairW = efd;
+	return MOSQ_ERR_SUCCESS;
 #else
 	int sv[2];
 
@@ -899,4 +1032,58 @@ int net__socketpair(mosq_sock_t *pairR, mosq_sock_t *pairW)
 	return MOSQ_ERR_SUCCESS;
 #endif
 }
+
+
+void net__socketpair_close(mosq_sock_t *pairR, mosq_sock_t *pairW)
+{
+	if(*pairR != INVALID_SOCKET){
+		COMPAT_CLOSE(*pairR);
+	}
+	if(*pairW != INVALID_SOCKET && *pairW != *pairR){
+		COMPAT_CLOSE(*pairW);
+	}
+	*pairR = INVALID_SOCKET;
+	*pairW = INVALID_SOCKET;
+}
+
+
+/* Make pairR readable, to break out of select() in the network thread. */
+void net__socketpair_wake(mosq_sock_t pairW)
+{
+#ifdef HAVE_EVENTFD
+	uint64_t count = 1;
+
+	if(write(pairW, &count, sizeof(count))){
+	}
+#elif !defined(WIN32)
+	char pair_data = 0;
+
+	if(write(pairW, &pair_data, 1)){
+	}
+#else
+	char pair_data = 0;
+
+	send(pairW, &pair_data, 1, 0);
+#endif
+}
+
+
+void net__socketpair_drain(mosq_sock_t pairR)
+{
+#ifdef HAVE_EVENTFD
+	uint64_t count;
+
+	if(read(pairR, &count, sizeof(count)) == 0){
+	}
+#elif !defined(WIN32)
+	char pair_data;
+
+	if(read(pairR, &pair_data, 1) == 0){
+	}
+#else
+	char pair_data;
+
+	recv(pairR, &pair_data, 1, 0);
+#endif
+}
 #endif
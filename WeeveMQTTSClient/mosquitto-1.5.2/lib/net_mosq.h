@@ -17,6 +17,7 @@ Contributors:
 #define NET_MOSQ_H
 
 #ifndef WIN32
+#include <sys/uio.h>
 #include <unistd.h>
 #else
 #include <winsock2.h>
@@ -45,6 +46,19 @@ struct mosquitto_db;
 #define INVALID_SOCKET -1
 #endif
 
+/* On Linux a single eventfd stands in for the socket pair that wakes the
+ * network thread, so sockpairR and sockpairW are the same descriptor. The
+ * broker only needs one to be woken by its SMP workers. */
+#if defined(__linux__) && (!defined(WITH_BROKER) || defined(WITH_WEEVE_SMP))
+#  define HAVE_EVENTFD
+#endif
+
+/* Size of the per-connection receive buffer used by net__read_buffered(). */
+#define NET_RX_BUF_SIZE 16384
+
+/* True when received data is buffered that packet__read() hasn't decoded yet. */
+#define NET_DATA_PENDING(A) ((A)->in_buf_pos < (A)->in_buf_len)
+
 /* Macros for accessing the MSB and LSB of a uint16_t */
 #define MOSQ_MSB(A) (uint8_t)((A & 0xFF00) >> 8)
 #define MOSQ_LSB(A) (uint8_t)(A & 0x00FF)
@@ -64,9 +78,18 @@ int net__try_connect_step2(struct mosquitto *mosq, uint16_t port, mosq_sock_t *s
 int net__socket_connect_step3(struct mosquitto *mosq, const char *host, uint16_t port, const char *bind_address, bool blocking);
 int net__socket_nonblock(mosq_sock_t *sock);
 int net__socketpair(mosq_sock_t *sp1, mosq_sock_t *sp2);
+void net__socketpair_close(mosq_sock_t *sp1, mosq_sock_t *sp2);
+void net__socketpair_wake(mosq_sock_t sp2);
+void net__socketpair_drain(mosq_sock_t sp1);
 
 ssize_t net__read(struct mosquitto *mosq, void *buf, size_t count);
+ssize_t net__read_buffered(struct mosquitto *mosq, void *buf, size_t count);
+/* Give up the receive buffer once everything in it has been decoded. */
+void net__read_buffer_release(struct mosquitto *mosq);
 ssize_t net__write(struct mosquitto *mosq, void *buf, size_t count);
+#ifndef WIN32
+ssize_t net__writev(struct mosquitto *mosq, const struct iovec *iov, int iovcnt);
+#endif
 
 #ifdef WITH_TLS
 int net__socket_apply_tls(struct mosquitto *mosq);
@@ -287,6 +287,32 @@ int mosquitto_opts_set(struct mosquitto *mosq, enum mosq_opt_t option, void *val
 			break;
 #else
 			return MOSQ_ERR_NOT_SUPPORTED;
+#endif
+		case MOSQ_OPT_SMP_ENCRYPT_IN_CALLER:
+#if defined(WITH_WEEVE_SMP)
+			ival = *((int *)value);
+			mosq->smp_encrypt_in_caller = (ival != 0);
+			break;
+#else
+			return MOSQ_ERR_NOT_SUPPORTED;
+#endif
+		case MOSQ_OPT_SMP_BATCH_MAX_BYTES:
+#if defined(WITH_WEEVE_SMP)
+			ival = *((int *)value);
+			if(ival < 0) return MOSQ_ERR_INVAL;
+			mosq->smp_batch_max_bytes = ival;
+			break;
+#else
+			return MOSQ_ERR_NOT_SUPPORTED;
+#endif
+		case MOSQ_OPT_SMP_COMPRESSION:
+#if defined(WITH_WEEVE_SMP)
+			ival = *((int *)value);
+			if(ival != 0 && ival != 1) return MOSQ_ERR_INVAL;
+			mosq->smp_compression = (ival == 1);
+			break;
+#else
+			return MOSQ_ERR_NOT_SUPPORTED;
 #endif
 		default:
 			return MOSQ_ERR_INVAL;
@@ -41,34 +41,33 @@ Contributors:
 #  define G_BYTES_SENT_INC(A)
 #  define G_MSGS_SENT_INC(A)
 #  define G_PUB_MSGS_SENT_INC(A)
+#  define G_SOCKET_WRITES_INC(A)
 #endif
 
+/* Most queued packets gathered into a single writev() call. */
+#define PACKET_WRITEV_MAX 64
+
+/* Most packets sealed by a single wclSmpGetMessages() call. */
+#define PACKET_SMP_SEAL_MAX 64
+
 #if defined(WITH_WEEVE_SMP)
 
 #include "wclTypes.h"
 #include "wclCommon.h"
 #include "wclSmp.h"
 
-WclError_t mosq_wclSmpGetMessage(WclSession_t smpSession,
-                            WclSmpMessageType_t messageType,
-                            const WosBuffer_t *pStdProtocolPacket,
-                            WosBuffer_t *pSmpMessage) {
-	WclError_t wclStatus = WCL_SUCCESS;
+/* Prefix a SMP message with its length, as the remaining length of an MQTT
+ * fixed header would be encoded. */
+static WclError_t mosq_wclSmpFrame(const WosBuffer_t *pSmpMessage, WosBuffer_t *pFramed)
+{
 	uint32_t remainingLength = 0;
 	uint8_t remainingCount = 0;
 	uint8_t byte = 0;
 	uint8_t remainingBytes[5] = {0};
 	uint32_t smpMessageLength = 0;
 	uint8_t i = 0;
-	WosBuffer_t tempSmpMessage = {NULL, 0};
 
-	wclStatus = wclSmpGetMessage(smpSession, messageType, pStdProtocolPacket, &tempSmpMessage);
-    if(WCL_SUCCESS != wclStatus) {
-		return wclStatus;
-	}
-
-	//printf("\nsmp-get-message in-len %d\n", pSmpMessage->length);
-	remainingLength = tempSmpMessage.length;
+	remainingLength = pSmpMessage->length;
 	do{
 		byte = remainingLength % 128;
 		remainingLength = remainingLength / 128;
@@ -80,31 +79,37 @@ WclError_t mosq_wclSmpGetMessage(WclSession_t smpSession,
 		remainingCount++;
 	}while(remainingLength > 0 && remainingCount < 5);
 	if(5 == remainingCount) return MOSQ_ERR_PAYLOAD_SIZE;
-	smpMessageLength = tempSmpMessage.length + remainingCount;
+	smpMessageLength = pSmpMessage->length + remainingCount;
 
-	pSmpMessage->data = malloc(smpMessageLength);
-	if(NULL == pSmpMessage->data) {
-		//printf("malloc-error");
+	pFramed->data = malloc(smpMessageLength);
+	if(NULL == pFramed->data) {
 		return WCL_ERROR_OUT_OF_MEMORY;
 	}
 	for(; i<remainingCount; i++){
-		//printf("rem-byte %x\n", remainingBytes[i]);
-		pSmpMessage->data[i] = remainingBytes[i];
+		pFramed->data[i] = remainingBytes[i];
 	}
-	pSmpMessage->length = smpMessageLength;
+	pFramed->length = smpMessageLength;
 
-	memcpy(pSmpMessage->data + remainingCount, tempSmpMessage.data, tempSmpMessage.length);
-	wclFreeBuffer(&tempSmpMessage);
-#if 0
-	printf("\nmqtt start\n");
-	for(int temp=0; temp < pStdProtocolPacket->length; temp++) { printf("%x ", pStdProtocolPacket->data[temp]);}
-	printf("\ndata start\n");
-	for(int temp=0; temp < pSmpMessage->length; temp++) { printf("%x ", pSmpMessage->data[temp]);}
-	printf("\ndata end\n");
-#endif
+	memcpy(pFramed->data + remainingCount, pSmpMessage->data, pSmpMessage->length);
 	return WCL_SUCCESS;
 }
 
+WclError_t mosq_wclSmpGetMessage(WclSession_t smpSession,
+                            WclSmpMessageType_t messageType,
+                            const WosBuffer_t *pStdProtocolPacket,
+                            WosBuffer_t *pSmpMessage) {
+	WclError_t wclStatus = WCL_SUCCESS;
+	WosBuffer_t tempSmpMessage = {NULL, 0};
+
+	wclStatus = wclSmpGetMessage(smpSession, messageType, pStdProtocolPacket, &tempSmpMessage);
+    if(WCL_SUCCESS != wclStatus) {
+		return wclStatus;
+	}
+	wclStatus = mosq_wclSmpFrame(&tempSmpMessage, pSmpMessage);
+	wclFreeBuffer(&tempSmpMessage);
+	return wclStatus;
+}
+
 #endif
 
 int packet__alloc(struct mosquitto__packet *packet)
@@ -151,10 +156,15 @@ int packet__alloc(struct mosquitto__packet *packet)
 	packet->smp_to_process = 0;
 	packet->smp_pos = 0;
 	packet->smp_remaining_count = 0;
+	packet->smp_pending = false;
 #endif
 	return MOSQ_ERR_SUCCESS;
 }
 
+#if defined(WITH_WEEVE_SMP)
+static void packet__cleanup_mqtt(struct mosquitto__packet *packet);
+#endif
+
 void packet__cleanup(struct mosquitto__packet *packet)
 {
 	if(!packet) return;
@@ -163,6 +173,8 @@ void packet__cleanup(struct mosquitto__packet *packet)
 	if (packet->mqttPacket.data != NULL) {
 		mosquitto__free(packet->mqttPacket.data);
 	}
+	mosquitto__free(packet->smp_payload);
+	packet->smp_payload = NULL;
 	packet->mqttPacket.data = NULL;
 	packet->mqttPacket.length = 0;
 	packet->smp_remaining_mult = 1;
@@ -170,8 +182,14 @@ void packet__cleanup(struct mosquitto__packet *packet)
 	packet->smp_to_process = 0;
 	packet->smp_pos = 0;
 	packet->smp_remaining_count = 0;
-#endif
+	packet__cleanup_mqtt(packet);
+}
 
+/* Free the MQTT data of a packet and reset its values, leaving the SMP
+ * message being read into it alone. */
+static void packet__cleanup_mqtt(struct mosquitto__packet *packet)
+{
+#endif
 	/* Free data and reset values */
 	packet->command = 0;
 	packet->remaining_count = 0;
@@ -183,29 +201,21 @@ void packet__cleanup(struct mosquitto__packet *packet)
 	packet->pos = 0;
 }
 
-int packet__queue(struct mosquitto *mosq, struct mosquitto__packet *packet)
-{
-#ifndef WITH_BROKER
-	char sockpair_data = 0;
-#endif
 #if defined(WITH_WEEVE_SMP)
+/* Replace the MQTT data in the packet with the SMP message of the given type
+ * carrying it. */
+static int packet__smp_seal(struct mosquitto *mosq, struct mosquitto__packet *packet, WclSmpMessageType_t messageType)
+{
 	WclError_t wclStatus = WCL_SUCCESS;
     WosBuffer_t mqttPacket = {NULL, 0};
     WosBuffer_t smpMessage = {NULL, 0};
-	uint8_t messageType = 0;
-#endif
 
-	assert(mosq);
-	assert(packet);
-#if defined(WITH_WEEVE_SMP)
 	assert(packet->payload);
-	/* MQTT message type and SMP-mqtts type has same value. */
-	messageType = (packet->payload[0]) >> 4;
     /* Prepare input mqtt-packet-buffer. */
     mqttPacket.data = packet->payload;
     mqttPacket.length = packet->packet_length;
     wclStatus = mosq_wclSmpGetMessage(mosq->smpSession,
-				(WclSmpMessageType_t)messageType, &mqttPacket, &smpMessage);
+				messageType, &mqttPacket, &smpMessage);
     if (WCL_SUCCESS != wclStatus) {
         // log error #TODO
         //printf("write failed\n");
@@ -216,42 +226,279 @@ int packet__queue(struct mosquitto *mosq, struct mosquitto__packet *packet)
     /* Assigning smp-packet to outgoing message. */
     packet->payload = smpMessage.data;
     packet->packet_length = smpMessage.length;
+	packet->to_process = packet->packet_length;
+	return MOSQ_ERR_SUCCESS;
+}
+
+/* Replace the MQTT packet with the SMP message carrying it. */
+static int packet__smp_encrypt(struct mosquitto *mosq, struct mosquitto__packet *packet)
+{
+	assert(packet->payload);
+	/* MQTT message type and SMP-mqtts type has same value. */
+	return packet__smp_seal(mosq, packet, (WclSmpMessageType_t)((packet->payload[0]) >> 4));
+}
+
+/* Whether a packet may share a BATCH record with others. CONNECT and CONNACK
+ * set the session up, and the client acts on a DISCONNECT or a QoS 0 PUBLISH
+ * once it has been written, so these always go on their own. */
+static bool packet__smp_batchable(struct mosquitto__packet *packet)
+{
+	switch((packet->command)&0xF0){
+		case CONNECT:
+		case CONNACK:
+		case DISCONNECT:
+			return false;
+#ifndef WITH_BROKER
+		case PUBLISH:
+			return ((packet->command)&0x06) != 0;
 #endif
+		default:
+			return true;
+	}
+}
+
+/* Packets waiting to be encrypted together. */
+struct packet__smp_sealer{
+	WclSmpMessageRequest_t requests[PACKET_SMP_SEAL_MAX];
+	WosBuffer_t mqttPackets[PACKET_SMP_SEAL_MAX];
+	struct mosquitto__packet *packets[PACKET_SMP_SEAL_MAX];
+	int *results[PACKET_SMP_SEAL_MAX];
+	int count;
+};
+
+/* Encrypt the packets gathered so far in one call, each one that fails
+ * setting the result it was added with. */
+static void packet__smp_sealer_flush(struct packet__smp_sealer *sealer)
+{
+	struct mosquitto__packet *packet;
+	WosBuffer_t smpMessage;
+	int i;
+
+	if(sealer->count == 0) return;
+	wclSmpGetMessages(sealer->requests, (size_t)sealer->count);
+	for(i=0; i<sealer->count; i++){
+		packet = sealer->packets[i];
+		if(sealer->requests[i].result == WCL_SUCCESS
+				&& mosq_wclSmpFrame(&sealer->requests[i].smpMessage, &smpMessage) == WCL_SUCCESS){
+
+			mosquitto__free(packet->payload);
+			packet->payload = smpMessage.data;
+			packet->packet_length = smpMessage.length;
+			packet->to_process = packet->packet_length;
+		}else if(*sealer->results[i] == MOSQ_ERR_SUCCESS){
+			*sealer->results[i] = MOSQ_ERR_UNKNOWN;
+		}
+		wclFreeBuffer(&sealer->requests[i].smpMessage);
+	}
+	sealer->count = 0;
+}
+
+/* Have a packet encrypted as a SMP message of the given type by the next
+ * flush. */
+static void packet__smp_sealer_add(struct packet__smp_sealer *sealer, struct mosquitto *mosq, struct mosquitto__packet *packet, WclSmpMessageType_t messageType, int *result)
+{
+	int i;
+
+	if(sealer->count == PACKET_SMP_SEAL_MAX){
+		packet__smp_sealer_flush(sealer);
+	}
+	i = sealer->count++;
+	sealer->mqttPackets[i].data = packet->payload;
+	sealer->mqttPackets[i].length = packet->packet_length;
+	sealer->requests[i].smpSession = mosq->smpSession;
+	sealer->requests[i].messageType = messageType;
+	sealer->requests[i].pStdProtocolPacket = &sealer->mqttPackets[i];
+	sealer->packets[i] = packet;
+	sealer->results[i] = result;
+}
+
+/* Add the packets from first to the end of the list to the sealer. Each run
+ * of packets fitting in max_bytes together is merged into the first of the
+ * run and sealed as one BATCH record, the others being freed, so the caller
+ * has to find the end of the list again afterwards. */
+static void packet__smp_seal_list(struct packet__smp_sealer *sealer, struct mosquitto *mosq, struct mosquitto__packet *first, uint32_t max_bytes, int *result)
+{
+	struct mosquitto__packet *packet, *tail, *merged, *end;
+	uint32_t length;
+	uint8_t *payload;
+
+	for(packet=first; packet; packet=packet->next){
+		length = packet->packet_length;
+		tail = packet;
+		if(packet__smp_batchable(packet)){
+			while(tail->next && packet__smp_batchable(tail->next)
+					&& length + tail->next->packet_length <= max_bytes){
+
+				tail = tail->next;
+				length += tail->packet_length;
+			}
+		}
+		if(tail == packet){
+			/* MQTT message type and SMP-mqtts type has same value. */
+			packet__smp_sealer_add(sealer, mosq, packet,
+					(WclSmpMessageType_t)((packet->payload[0]) >> 4), result);
+			continue;
+		}
+
+		payload = mosquitto__malloc(length);
+		if(!payload){
+			*result = MOSQ_ERR_NOMEM;
+			return;
+		}
+		memcpy(payload, packet->payload, packet->packet_length);
+		length = packet->packet_length;
+		end = tail->next;
+		while(packet->next != end){
+			merged = packet->next;
+			memcpy(&payload[length], merged->payload, merged->packet_length);
+			length += merged->packet_length;
+			packet->next = merged->next;
+			packet__cleanup(merged);
+			mosquitto__free(merged);
+		}
+		mosquitto__free(packet->payload);
+		packet->payload = payload;
+		packet->packet_length = length;
+		packet__smp_sealer_add(sealer, mosq, packet, WCL_SMP_MESSAGE_MQTTS_BATCH, result);
+	}
+}
+
+#ifndef WITH_BROKER
+/* Encrypt the packets from first to the end of the list, merging runs of
+ * them into BATCH records as packet__smp_seal_list() does. */
+static int packet__smp_encrypt_batched(struct mosquitto *mosq, struct mosquitto__packet *first, uint32_t max_bytes)
+{
+	struct packet__smp_sealer sealer;
+	int rc = MOSQ_ERR_SUCCESS;
+
+	sealer.count = 0;
+	packet__smp_seal_list(&sealer, mosq, first, max_bytes, &rc);
+	packet__smp_sealer_flush(&sealer);
+	return rc;
+}
+#endif
+#endif
+
+#if defined(WITH_BROKER) && defined(WITH_WEEVE_SMP)
+/* Encrypt the packets packet__queue() left pending while writing was
+ * deferred, for several clients at once. They go out together in any case,
+ * so sealing the packets of a client as BATCH records costs them no
+ * latency, and a message sent to many clients is encrypted for all of them
+ * in a few calls into the SMP library. results[i] is set to an error if
+ * some packet of contexts[i] could not be encrypted, unless it holds one
+ * already. */
+void packet__smp_seal_pending_many(struct mosquitto **contexts, int *results, int count)
+{
+	struct packet__smp_sealer sealer;
+	struct mosquitto *mosq;
+	struct mosquitto__packet *packet, *first;
+	uint32_t max_bytes = (uint32_t)mosquitto__get_db()->config->smp_batch_max_bytes;
+	int i;
+
+	sealer.count = 0;
+	for(i=0; i<count; i++){
+		mosq = contexts[i];
+		/* Pending packets were queued last, so they make up the end of the
+		 * queue. */
+		for(first=mosq->out_packet; first && !first->smp_pending; first=first->next){
+		}
+		if(!first) continue;
+		for(packet=first; packet; packet=packet->next){
+			packet->smp_pending = false;
+		}
+
+		packet__smp_seal_list(&sealer, mosq, first, max_bytes, &results[i]);
+		for(packet=first; packet->next; packet=packet->next){
+		}
+		mosq->out_packet_last = packet;
+	}
+	packet__smp_sealer_flush(&sealer);
+}
+#endif
+
+int packet__queue(struct mosquitto *mosq, struct mosquitto__packet *packet)
+{
+#ifdef WITH_BROKER
+	int rc;
+#else
+	bool wake;
+#endif
+
+	assert(mosq);
+	assert(packet);
 
 	packet->pos = 0;
 	packet->to_process = packet->packet_length;
 
+#ifdef WITH_BROKER
+#  if defined(WITH_WEEVE_SMP)
+	if(mosq->write_deferred){
+		/* Encrypted together with the packets queued after it, see
+		 * packet__smp_seal_pending_many(). */
+		packet->smp_pending = true;
+	}else if(packet__smp_encrypt(mosq, packet)){
+		return MOSQ_ERR_UNKNOWN;
+	}
+#  endif
 	packet->next = NULL;
-	pthread_mutex_lock(&mosq->out_packet_mutex);
 	if(mosq->out_packet){
 		mosq->out_packet_last->next = packet;
 	}else{
 		mosq->out_packet = packet;
 	}
 	mosq->out_packet_last = packet;
-	pthread_mutex_unlock(&mosq->out_packet_mutex);
-#ifdef WITH_BROKER
+
 #  ifdef WITH_WEBSOCKETS
 	if(mosq->wsi){
 		libwebsocket_callback_on_writable(mosq->ws_context, mosq->wsi);
 		return MOSQ_ERR_SUCCESS;
-	}else{
-		return packet__write(mosq);
 	}
-#  else
-	return packet__write(mosq);
 #  endif
+	if(mosq->write_deferred){
+		return MOSQ_ERR_SUCCESS;
+	}
+	rc = packet__write(mosq);
+	if(mosq->out_packet || mosq->current_out_packet){
+		/* Couldn't all be written now, the main loop needs to wait for the
+		 * socket to become writable. */
+		context__add_to_ready(mosquitto__get_db(), mosq);
+	}
+	return rc;
 #else
-
-	/* Write a single byte to sockpairW (connected to sockpairR) to break out
-	 * of select() if in threaded mode. */
-	if(mosq->sockpairW != INVALID_SOCKET){
-#ifndef WIN32
-		if(write(mosq->sockpairW, &sockpair_data, 1)){
+#  if defined(WITH_WEEVE_SMP)
+	/* Encrypting here spreads the work over the publishing threads, but the
+	 * session must see packets in the order they are sent, so encrypting
+	 * and queueing have to happen under one lock. Otherwise the network
+	 * thread encrypts packets as it collects them. */
+	if(mosq->smp_encrypt_in_caller){
+		pthread_mutex_lock(&mosq->smp_mutex);
+		if(packet__smp_encrypt(mosq, packet)){
+			pthread_mutex_unlock(&mosq->smp_mutex);
+			return MOSQ_ERR_UNKNOWN;
 		}
-#else
-		send(mosq->sockpairW, &sockpair_data, 1, 0);
-#endif
+	}
+#  endif
+
+	/* Any thread may queue packets, so they are pushed onto
+	 * out_packet_intake without a lock and put in order by whichever thread
+	 * writes, in packet__intake_collect(). */
+	packet->next = __atomic_load_n(&mosq->out_packet_intake, __ATOMIC_RELAXED);
+	while(!__atomic_compare_exchange_n(&mosq->out_packet_intake, &packet->next, packet,
+				true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)){
+	}
+	wake = (packet->next == NULL);
+
+#  if defined(WITH_WEEVE_SMP)
+	if(mosq->smp_encrypt_in_caller){
+		pthread_mutex_unlock(&mosq->smp_mutex);
+	}
+#  endif
+
+	/* Break out of select() if in threaded mode. Packets already waiting
+	 * mean the network thread has been woken and not yet collected them, so
+	 * only the first one needs to do this. */
+	if(wake && mosq->sockpairW != INVALID_SOCKET){
+		net__socketpair_wake(mosq->sockpairW);
 	}
 
 	if(mosq->in_callback == false && mosq->threaded == false){
@@ -365,15 +612,145 @@ void packet__write_uint16(struct mosquitto__packet *packet, uint16_t word)
 }
 
 
+#ifndef WITH_BROKER
+/* Move the packets queued since the last call onto the end of out_packet,
+ * oldest first, encrypting them first if they are to be sent. Must be called
+ * with current_out_packet_mutex held, so there is only one collector. */
+int packet__intake_collect(struct mosquitto *mosq, bool send)
+{
+	struct mosquitto__packet *intake, *packet, *first, *last;
+	int rc = MOSQ_ERR_SUCCESS;
+
+	intake = __atomic_exchange_n(&mosq->out_packet_intake, NULL, __ATOMIC_ACQUIRE);
+	if(!intake) return MOSQ_ERR_SUCCESS;
+
+	/* Reverse the newest first list. */
+	first = NULL;
+	last = intake;
+	while(intake){
+		packet = intake;
+		intake = intake->next;
+		packet->next = first;
+		first = packet;
+	}
+
+#  if defined(WITH_WEEVE_SMP)
+	if(send && !mosq->smp_encrypt_in_caller){
+		if(mosq->smp_batch_max_bytes > 0){
+			/* Packets collected together go out together, so they can
+			 * share records without waiting for each other. */
+			rc = packet__smp_encrypt_batched(mosq, first, (uint32_t)mosq->smp_batch_max_bytes);
+			for(last=first; last->next; last=last->next){
+			}
+		}else{
+			for(packet=first; packet; packet=packet->next){
+				if(packet__smp_encrypt(mosq, packet)){
+					/* The session can't carry anything after this, so
+					 * report the error and let the connection be
+					 * dropped. */
+					rc = MOSQ_ERR_UNKNOWN;
+				}
+			}
+		}
+	}
+#  endif
+
+	pthread_mutex_lock(&mosq->out_packet_mutex);
+	if(mosq->out_packet){
+		mosq->out_packet_last->next = first;
+	}else{
+		mosq->out_packet = first;
+	}
+	mosq->out_packet_last = last;
+	pthread_mutex_unlock(&mosq->out_packet_mutex);
+
+	return rc;
+}
+#endif
+
+
+/* Write out as much of the current packet as the socket will take. Packets
+ * queued behind it go out in the same call, so a burst of small packets costs
+ * one system call rather than one each. Whatever part of the queued packets
+ * was written is marked as done, so they complete without another write when
+ * they reach the front. Must be called with current_out_packet_mutex held. */
+static ssize_t packet__write_some(struct mosquitto *mosq)
+{
+	struct mosquitto__packet *packets[PACKET_WRITEV_MAX];
+	struct mosquitto__packet *packet;
+	ssize_t write_length;
+	size_t remaining, len;
+	int count = 0;
+	int i;
+#ifndef WIN32
+	struct iovec iov[PACKET_WRITEV_MAX];
+#endif
+
+	packet = mosq->current_out_packet;
+	packets[count++] = packet;
+
+#ifndef WIN32
+	if(((packet->command)&0xF0) != DISCONNECT
+#  ifdef WITH_TLS
+			&& !mosq->ssl
+#  endif
+			){
+
+		pthread_mutex_lock(&mosq->out_packet_mutex);
+		for(packet=mosq->out_packet; packet && count<PACKET_WRITEV_MAX; packet=packet->next){
+			packets[count++] = packet;
+			if(((packet->command)&0xF0) == DISCONNECT){
+				/* Nothing may follow a DISCONNECT on the wire. */
+				break;
+			}
+		}
+		pthread_mutex_unlock(&mosq->out_packet_mutex);
+	}
+
+	if(count > 1){
+		for(i=0; i<count; i++){
+			iov[i].iov_base = &(packets[i]->payload[packets[i]->pos]);
+			iov[i].iov_len = packets[i]->to_process;
+		}
+		write_length = net__writev(mosq, iov, count);
+	}else
+#endif
+	{
+		write_length = net__write(mosq, &(packets[0]->payload[packets[0]->pos]), packets[0]->to_process);
+	}
+
+	if(write_length > 0){
+		remaining = write_length;
+		for(i=0; i<count && remaining > 0; i++){
+			len = remaining < packets[i]->to_process ? remaining : packets[i]->to_process;
+			packets[i]->to_process -= len;
+			packets[i]->pos += len;
+			remaining -= len;
+		}
+	}
+	return write_length;
+}
+
+
 int packet__write(struct mosquitto *mosq)
 {
 	ssize_t write_length;
 	struct mosquitto__packet *packet;
+#ifndef WITH_BROKER
+	int rc;
+#endif
 
 	if(!mosq) return MOSQ_ERR_INVAL;
 	if(mosq->sock == INVALID_SOCKET) return MOSQ_ERR_NO_CONN;
 
 	pthread_mutex_lock(&mosq->current_out_packet_mutex);
+#ifndef WITH_BROKER
+	rc = packet__intake_collect(mosq, true);
+	if(rc){
+		pthread_mutex_unlock(&mosq->current_out_packet_mutex);
+		return rc;
+	}
+#endif
 	pthread_mutex_lock(&mosq->out_packet_mutex);
 	if(mosq->out_packet && !mosq->current_out_packet){
 		mosq->current_out_packet = mosq->out_packet;
@@ -397,11 +774,10 @@ int packet__write(struct mosquitto *mosq)
 		packet = mosq->current_out_packet;
 
 		while(packet->to_process > 0){
-			write_length = net__write(mosq, &(packet->payload[packet->pos]), packet->to_process);
+			write_length = packet__write_some(mosq);
+			G_SOCKET_WRITES_INC();
 			if(write_length > 0){
 				G_BYTES_SENT_INC(write_length);
-				packet->to_process -= write_length;
-				packet->pos += write_length;
 			}else{
 #ifdef WIN32
 				errno = WSAGetLastError();
@@ -472,6 +848,12 @@ int packet__write(struct mosquitto *mosq)
 		}
 
 		/* Free data and reset values */
+#ifndef WITH_BROKER
+		if(!mosq->out_packet){
+			/* Pick up anything queued while this packet was being written. */
+			rc = packet__intake_collect(mosq, true);
+		}
+#endif
 		pthread_mutex_lock(&mosq->out_packet_mutex);
 		mosq->current_out_packet = mosq->out_packet;
 		if(mosq->out_packet){
@@ -488,6 +870,12 @@ int packet__write(struct mosquitto *mosq)
 		pthread_mutex_lock(&mosq->msgtime_mutex);
 		mosq->next_msg_out = mosquitto_time() + mosq->keepalive;
 		pthread_mutex_unlock(&mosq->msgtime_mutex);
+#ifndef WITH_BROKER
+		if(rc){
+			pthread_mutex_unlock(&mosq->current_out_packet_mutex);
+			return rc;
+		}
+#endif
 	}
 	pthread_mutex_unlock(&mosq->current_out_packet_mutex);
 	return MOSQ_ERR_SUCCESS;
@@ -501,6 +889,9 @@ int packet__read_smp(struct mosquitto *mosq)
 	ssize_t read_length;
 	int rc = 0;
 	WosBuffer_t smpPacket = {NULL, 0};
+#ifdef WITH_BROKER
+	uint8_t *smp_message;
+#endif
 
 	/* remaining_count is the number of bytes that the remaining_length
 	 * parameter occupied in this incoming packet. We don't use it here as such
@@ -513,7 +904,7 @@ int packet__read_smp(struct mosquitto *mosq)
 	 */
 	if(mosq->in_packet.smp_remaining_count <= 0){
 		do{
-			read_length = net__read(mosq, &byte, 1);
+			read_length = net__read_buffered(mosq, &byte, 1);
 			//printf("read_length=%d byte=%x remaining=%d\n", read_length, byte, mosq->in_packet.smp_remaining_count);
 			if(read_length == 1){
 				mosq->in_packet.smp_remaining_count--;
@@ -545,7 +936,15 @@ int packet__read_smp(struct mosquitto *mosq)
 		 * positive. */
 		mosq->in_packet.smp_remaining_count *= -1;
 
-		if(mosq->in_packet.smp_remaining_length > 0){
+		if(mosq->in_packet.smp_remaining_length > 0
+				&& mosq->in_packet.smp_remaining_length <= mosq->in_buf_len - mosq->in_buf_pos){
+
+			/* The whole frame is already in the receive buffer, so it is
+			 * processed where it is rather than copied out first. */
+			smpPacket.data = &mosq->in_buf[mosq->in_buf_pos];
+			smpPacket.length = mosq->in_packet.smp_remaining_length;
+			mosq->in_buf_pos += mosq->in_packet.smp_remaining_length;
+		}else if(mosq->in_packet.smp_remaining_length > 0){
 			mosq->in_packet.smp_payload = mosquitto__malloc(mosq->in_packet.smp_remaining_length*sizeof(uint8_t));
 			if(!mosq->in_packet.smp_payload) return MOSQ_ERR_NOMEM;
 			mosq->in_packet.smp_to_process = mosq->in_packet.smp_remaining_length;
@@ -553,7 +952,7 @@ int packet__read_smp(struct mosquitto *mosq)
 		}
 	}
 	while(mosq->in_packet.smp_to_process>0){
-		read_length = net__read(mosq, &(mosq->in_packet.smp_payload[mosq->in_packet.smp_pos]), mosq->in_packet.smp_to_process);
+		read_length = net__read_buffered(mosq, &(mosq->in_packet.smp_payload[mosq->in_packet.smp_pos]), mosq->in_packet.smp_to_process);
 		//printf("read_length %d\n", read_length);
 		if(read_length > 0){
 			mosq->in_packet.smp_to_process -= read_length;
@@ -575,11 +974,33 @@ int packet__read_smp(struct mosquitto *mosq)
 		}
 	}
 
-	/* All data for this packet is read. */
+	/* All data for this packet is read. Start on the next one, the MQTT
+	 * packets of this one may be handled while it is being read. */
+	if(!smpPacket.data){
+		smpPacket.data = mosq->in_packet.smp_payload;
+		smpPacket.length = mosq->in_packet.smp_remaining_length;
+	}
+	mosq->in_packet.smp_remaining_mult = 1;
+	mosq->in_packet.smp_remaining_length = 0;
+	mosq->in_packet.smp_remaining_count = 0;
 	mosq->in_packet.smp_pos = 0;
 
-	smpPacket.data = mosq->in_packet.smp_payload;
-	smpPacket.length = mosq->in_packet.smp_remaining_length;
+#ifdef WITH_BROKER
+	if(mosquitto__get_db()->smp_async){
+		/* Processed on a worker thread, see smp_async__queue(), which takes
+		 * the message over. */
+		if(!smpPacket.length) return MOSQ_ERR_PROTOCOL;
+		smp_message = mosq->in_packet.smp_payload;
+		mosq->in_packet.smp_payload = NULL;
+		if(!smp_message){
+			/* Still in the receive buffer. */
+			smp_message = mosquitto__malloc(smpPacket.length);
+			if(!smp_message) return MOSQ_ERR_NOMEM;
+			memcpy(smp_message, smpPacket.data, smpPacket.length);
+		}
+		return smp_async__queue(mosquitto__get_db(), mosq, smp_message, smpPacket.length);
+	}
+#endif
 	wclStatus = wclSmpProcessMessage(mosq->smpSession, &smpPacket, &(mosq->in_packet.mqttPacket));
 	if(WCL_SUCCESS != wclStatus){
 		//printf("read error");
@@ -587,6 +1008,7 @@ int packet__read_smp(struct mosquitto *mosq)
 		return MOSQ_ERR_UNKNOWN;
 	}
 	mosquitto__free(mosq->in_packet.smp_payload);
+	mosq->in_packet.smp_payload = NULL;
 	if((NULL == (mosq->in_packet.mqttPacket).data) || (((mosq->in_packet.mqttPacket).length) <= 0)){
 		/* #TODO Log the SMP error. */
 		return MOSQ_ERR_UNKNOWN;
@@ -594,38 +1016,18 @@ int packet__read_smp(struct mosquitto *mosq)
 	return rc;
 }
 
+/* Handle the MQTT packet at the start of pMqttPacket, returning the number of
+ * bytes it took up through used. */
 #ifdef WITH_BROKER
-int packet__read(struct mosquitto_db *db, struct mosquitto *mosq)
+static int packet__handle_smp_mqtt_packet(struct mosquitto_db *db, struct mosquitto *mosq, const uint8_t *pMqttPacket, uint32_t mqtt_packet_length, uint32_t *used)
 #else
-int packet__read(struct mosquitto *mosq)
+static int packet__handle_smp_mqtt_packet(struct mosquitto *mosq, const uint8_t *pMqttPacket, uint32_t mqtt_packet_length, uint32_t *used)
 #endif
 {
 	uint8_t byte;
-	ssize_t read_length;
 	int rc = 0;
-	int smperr = 0;
 	uint32_t offset = 0;
-	size_t mqtt_packet_length = 0;
-	uint8_t *pMqttPacket = NULL;
 
-	if(!mosq) return MOSQ_ERR_INVAL;
-	if(mosq->sock == INVALID_SOCKET) return MOSQ_ERR_NO_CONN;
-	if(mosq->state == mosq_cs_connect_pending){
-		return MOSQ_ERR_SUCCESS;
-	}
-
-	if(!mosq->in_packet.command){
-		smperr = packet__read_smp(mosq);
-		if(smperr){
-			return smperr;
-		}else{
-				if(errno == EAGAIN || errno == COMPAT_EWOULDBLOCK){
-					return MOSQ_ERR_SUCCESS;
-				}
-		}
-	}
-	mqtt_packet_length = (mosq->in_packet.mqttPacket).length;
-	pMqttPacket = (mosq->in_packet.mqttPacket).data;
 	if(mqtt_packet_length < 2) return MOSQ_ERR_PROTOCOL;
 	if(!mosq->in_packet.command){
 		byte = pMqttPacket[offset];
@@ -637,7 +1039,6 @@ int packet__read(struct mosquitto *mosq)
 			if(!(mosq->bridge) && mosq->state == mosq_cs_new && (byte&0xF0) != CONNECT) return MOSQ_ERR_PROTOCOL;
 #endif
 	}
-	//printf("command=%x\n", mosq->in_packet.command);
 	/* remaining_count is the number of bytes that the remaining_length
 	 * parameter occupied in this incoming packet. We don't use it here as such
 	 * (it is used when allocating an outgoing packet), but we must be able to
@@ -649,6 +1050,7 @@ int packet__read(struct mosquitto *mosq)
 	 */
 	if(mosq->in_packet.remaining_count <= 0){
 		do{
+			if(offset >= mqtt_packet_length) return MOSQ_ERR_PROTOCOL;
 			byte = pMqttPacket[offset++];
 			mosq->in_packet.remaining_count--;
 			/* Max 4 bytes length for remaining length as defined by protocol.
@@ -658,12 +1060,13 @@ int packet__read(struct mosquitto *mosq)
 			G_BYTES_RECEIVED_INC(1);
 			mosq->in_packet.remaining_length += (byte & 127) * mosq->in_packet.remaining_mult;
 			mosq->in_packet.remaining_mult *= 128;
-		}while(((byte & 128) != 0) && ( offset <= mqtt_packet_length));
+		}while((byte & 128) != 0);
 		/* We have finished reading remaining_length, so make remaining_count
 		 * positive. */
 		mosq->in_packet.remaining_count *= -1;
 	}
-	//printf("remaining=%d\n", mosq->in_packet.remaining_length);
+	if(mosq->in_packet.remaining_length > mqtt_packet_length - offset) return MOSQ_ERR_PROTOCOL;
+	*used = offset + mosq->in_packet.remaining_length;
 	if(mosq->in_packet.remaining_length > 0){
 		mosq->in_packet.payload = mosquitto__malloc(mosq->in_packet.remaining_length*sizeof(uint8_t));
 		if(!mosq->in_packet.payload) return MOSQ_ERR_NOMEM;
@@ -672,14 +1075,6 @@ int packet__read(struct mosquitto *mosq)
 		mosq->in_packet.pos = 0;
 	}
 
-#if 0
-	printf("\nsmp start\n");
-	for(int i=0; i<(mosq->in_packet.mqttPacket).length; i++) { printf("%x ", pMqttPacket[i]);}
-	printf("\nmqtt start\n");
-	for(int i=0; i<mosq->in_packet.remaining_length; i++) { printf("%x ", mosq->in_packet.payload[i]);}
-	printf("end\n");
-#endif
-
 #ifdef WITH_BROKER
 	G_MSGS_RECEIVED_INC(1);
 	if(((mosq->in_packet.command)&0xF5) == PUBLISH){
@@ -691,13 +1086,107 @@ int packet__read(struct mosquitto *mosq)
 #endif
 
 	/* Free data and reset values */
-	packet__cleanup(&mosq->in_packet);
+	packet__cleanup_mqtt(&mosq->in_packet);
 
 	pthread_mutex_lock(&mosq->msgtime_mutex);
 	mosq->last_msg_in = mosquitto_time();
 	pthread_mutex_unlock(&mosq->msgtime_mutex);
 	return rc;
 }
+
+/* Handle the MQTT packets the SMP layer got out of the last SMP message. A
+ * BATCH record carries several back to back, any other message just one. */
+#ifdef WITH_BROKER
+static int packet__handle_smp_mqtt(struct mosquitto_db *db, struct mosquitto *mosq)
+#else
+static int packet__handle_smp_mqtt(struct mosquitto *mosq)
+#endif
+{
+	WosBuffer_t mqttPacket = mosq->in_packet.mqttPacket;
+	uint32_t offset = 0;
+	uint32_t used = 0;
+	int rc = MOSQ_ERR_PROTOCOL;
+
+	/* Handling a packet resets in_packet, so keep hold of the data. */
+	mosq->in_packet.mqttPacket.data = NULL;
+	mosq->in_packet.mqttPacket.length = 0;
+	while(offset < mqttPacket.length){
+#ifdef WITH_BROKER
+		rc = packet__handle_smp_mqtt_packet(db, mosq, &mqttPacket.data[offset], mqttPacket.length - offset, &used);
+#else
+		rc = packet__handle_smp_mqtt_packet(mosq, &mqttPacket.data[offset], mqttPacket.length - offset, &used);
+#endif
+		if(rc || mosq->sock == INVALID_SOCKET || mosq->state == mosq_cs_disconnecting){
+			/* Nothing after a DISCONNECT or an error is looked at. */
+			break;
+		}
+		offset += used;
+	}
+	mosquitto__free(mqttPacket.data);
+	return rc;
+}
+
+#ifdef WITH_BROKER
+/* Handle the MQTT packets of the SMP message processed into
+ * in_packet.mqttPacket. */
+int packet__handle_smp_message(struct mosquitto_db *db, struct mosquitto *mosq)
+{
+	WosBuffer_t early_data = {NULL, 0};
+	int rc;
+
+	/* A resumed CONNECT can carry a packet as early data. It has to be taken
+	 * before the CONNACK is built, and is only handled once the CONNECT has
+	 * been accepted. */
+	if(mosq->in_packet.mqttPacket.data && (mosq->in_packet.mqttPacket.data[0]&0xF0) == CONNECT){
+		wclSmpGetEarlyData(mosq->smpSession, &early_data);
+	}
+	rc = packet__handle_smp_mqtt(db, mosq);
+	if(early_data.data){
+		if(rc == MOSQ_ERR_SUCCESS && mosq->state == mosq_cs_connected){
+			mosq->in_packet.mqttPacket = early_data;
+			rc = packet__handle_smp_mqtt(db, mosq);
+		}else{
+			wclFreeBuffer(&early_data);
+		}
+	}
+	return rc;
+}
+#endif
+
+#ifdef WITH_BROKER
+int packet__read(struct mosquitto_db *db, struct mosquitto *mosq)
+#else
+int packet__read(struct mosquitto *mosq)
+#endif
+{
+	int smperr = 0;
+
+	if(!mosq) return MOSQ_ERR_INVAL;
+	if(mosq->sock == INVALID_SOCKET) return MOSQ_ERR_NO_CONN;
+	if(mosq->state == mosq_cs_connect_pending){
+		return MOSQ_ERR_SUCCESS;
+	}
+
+	if(!mosq->in_packet.command){
+		smperr = packet__read_smp(mosq);
+		if(smperr){
+			return smperr;
+		}else{
+				if(errno == EAGAIN || errno == COMPAT_EWOULDBLOCK){
+					return MOSQ_ERR_SUCCESS;
+				}
+		}
+	}
+#ifdef WITH_BROKER
+	if(db->smp_async){
+		/* Handed to the SMP workers. */
+		return MOSQ_ERR_SUCCESS;
+	}
+	return packet__handle_smp_message(db, mosq);
+#else
+	return packet__handle_smp_mqtt(mosq);
+#endif
+}
 #else
 #ifdef WITH_BROKER
 int packet__read(struct mosquitto_db *db, struct mosquitto *mosq)
@@ -730,7 +1219,7 @@ int packet__read(struct mosquitto *mosq)
 	 * Finally, free the memory and reset everything to starting conditions.
 	 */
 	if(!mosq->in_packet.command){
-		read_length = net__read(mosq, &byte, 1);
+		read_length = net__read_buffered(mosq, &byte, 1);
 		if(read_length == 1){
 			mosq->in_packet.command = byte;
 #ifdef WITH_BROKER
@@ -766,7 +1255,7 @@ int packet__read(struct mosquitto *mosq)
 	 */
 	if(mosq->in_packet.remaining_count <= 0){
 		do{
-			read_length = net__read(mosq, &byte, 1);
+			read_length = net__read_buffered(mosq, &byte, 1);
 			if(read_length == 1){
 				mosq->in_packet.remaining_count--;
 				/* Max 4 bytes length for remaining length as defined by protocol.
@@ -805,7 +1294,7 @@ int packet__read(struct mosquitto *mosq)
 		}
 	}
 	while(mosq->in_packet.to_process>0){
-		read_length = net__read(mosq, &(mosq->in_packet.payload[mosq->in_packet.pos]), mosq->in_packet.to_process);
+		read_length = net__read_buffered(mosq, &(mosq->in_packet.payload[mosq->in_packet.pos]), mosq->in_packet.to_process);
 		if(read_length > 0){
 			G_BYTES_RECEIVED_INC(read_length);
 			mosq->in_packet.to_process -= read_length;
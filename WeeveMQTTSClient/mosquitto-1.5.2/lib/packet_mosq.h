@@ -38,6 +38,13 @@ void packet__write_string(struct mosquitto__packet *packet, const char *str, uin
 void packet__write_uint16(struct mosquitto__packet *packet, uint16_t word);
 
 int packet__write(struct mosquitto *mosq);
+#if defined(WITH_BROKER) && defined(WITH_WEEVE_SMP)
+void packet__smp_seal_pending_many(struct mosquitto **contexts, int *results, int count);
+int packet__handle_smp_message(struct mosquitto_db *db, struct mosquitto *mosq);
+#endif
+#ifndef WITH_BROKER
+int packet__intake_collect(struct mosquitto *mosq, bool send);
+#endif
 #ifdef WITH_BROKER
 int packet__read(struct mosquitto_db *db, struct mosquitto *mosq);
 #else
@@ -41,8 +41,45 @@ Contributors:
 #include "util_mosq.h"
 #include "will_mosq.h"
 
+#if defined(WITH_WEEVE_SMP)
+#include "wclCommon.h"
+#include "wclSmp.h"
+#endif
+
 #ifdef WITH_BRIDGE
 
+#if defined(WITH_WEEVE_SMP)
+/* Every context starts out with a broker role SMP session, but a bridge is the
+ * client end of its connection. It also needs a fresh session for each
+ * connection attempt, because a session only does the key exchange once. The
+ * ticket of the previous session, if any, resumes it instead. */
+static int bridge__smp_open(struct mosquitto *context)
+{
+	WclError_t wclStatus = WCL_SUCCESS;
+	WosBuffer_t ticket = {NULL, 0};
+
+	if(context->smpSession){
+		wclSmpExportTicket(context->smpSession, &ticket);
+	}
+	smp_async__close_session(mosquitto__get_db(), context);
+	wclStatus = wclSmpOpen(&context->smpSession, WCL_SMP_ROLE_MQTTS_CLIENT);
+	if(WCL_SUCCESS != wclStatus){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Unable to open SMP session for bridge %s.", context->bridge->name);
+		context->smpSession = NULL;
+		wclFreeBuffer(&ticket);
+		return MOSQ_ERR_UNKNOWN;
+	}
+	if(ticket.data){
+		wclSmpImportTicket(context->smpSession, &ticket);
+		wclFreeBuffer(&ticket);
+	}
+	if(mosquitto__get_db()->config->smp_compression){
+		wclSmpSetCompression(context->smpSession, true);
+	}
+	return MOSQ_ERR_SUCCESS;
+}
+#endif
+
 int bridge__new(struct mosquitto_db *db, struct mosquitto__bridge *bridge)
 {
 	struct mosquitto *new_context = NULL;
@@ -130,6 +167,10 @@ int bridge__connect_step1(struct mosquitto_db *db, struct mosquitto *context)
 	context->bridge->lazy_reconnect = false;
 	bridge__packet_cleanup(context);
 	db__message_reconnect_reset(db, context);
+#if defined(WITH_WEEVE_SMP)
+	rc = bridge__smp_open(context);
+	if(rc) return rc;
+#endif
 
 	if(context->clean_session){
 		db__messages_delete(db, context);
@@ -293,6 +334,10 @@ int bridge__connect(struct mosquitto_db *db, struct mosquitto *context)
 	context->bridge->lazy_reconnect = false;
 	bridge__packet_cleanup(context);
 	db__message_reconnect_reset(db, context);
+#if defined(WITH_WEEVE_SMP)
+	rc = bridge__smp_open(context);
+	if(rc) return rc;
+#endif
 
 	if(context->clean_session){
 		db__messages_delete(db, context);
@@ -212,14 +212,23 @@ static void config__init_reload(struct mosquitto_db *db, struct mosquitto__confi
 	}
 #endif
 	config->log_timestamp = true;
+	config->accept_budget = 100;
 	config->persistence = false;
 	mosquitto__free(config->persistence_location);
 	config->persistence_location = NULL;
 	mosquitto__free(config->persistence_file);
 	config->persistence_file = NULL;
+	config->persistence_log_sync_interval = 0;
 	config->persistent_client_expiration = 0;
 	config->queue_qos0_messages = false;
+	config->queue_spill_bytes = 0;
+	mosquitto__free(config->queue_spill_location);
+	config->queue_spill_location = NULL;
+	config->retained_batch_size = 100;
 	config->set_tcp_nodelay = false;
+	config->shared_sub_policy = ssp_round_robin;
+	config->smp_batch_max_bytes = 0;
+	config->smp_compression = false;
 	config->sys_interval = 10;
 	config->upgrade_outgoing_qos = false;
 
@@ -260,6 +269,8 @@ void config__init(struct mosquitto_db *db, struct mosquitto__config *config)
 	config__init_reload(db, config);
 
 	config->daemon = false;
+	config->smp_early_data_max_connects = 4096;
+	config->smp_early_data_window = 10;
 	memset(&config->default_listener, 0, sizeof(struct mosquitto__listener));
 	config->default_listener.max_connections = -1;
 	config->default_listener.protocol = mp_mqtt;
@@ -275,6 +286,7 @@ void config__cleanup(struct mosquitto__config *config)
 	mosquitto__free(config->persistence_location);
 	mosquitto__free(config->persistence_file);
 	mosquitto__free(config->persistence_filepath);
+	mosquitto__free(config->queue_spill_location);
 	mosquitto__free(config->security_options.auto_id_prefix);
 	mosquitto__free(config->security_options.acl_file);
 	mosquitto__free(config->security_options.password_file);
@@ -444,6 +456,7 @@ int config__parse_args(struct mosquitto_db *db, struct mosquitto__config *config
 			|| config->default_listener.host
 			|| config->default_listener.port
 			|| config->default_listener.max_connections != -1
+			|| config->default_listener.accept_rate
 			|| config->default_listener.mount_point
 			|| config->default_listener.protocol != mp_mqtt
 			|| config->default_listener.security_options.password_file
@@ -475,6 +488,8 @@ int config__parse_args(struct mosquitto_db *db, struct mosquitto__config *config
 			config->listeners[config->listener_count-1].mount_point = NULL;
 		}
 		config->listeners[config->listener_count-1].max_connections = config->default_listener.max_connections;
+		config->listeners[config->listener_count-1].accept_rate = config->default_listener.accept_rate;
+		config->listeners[config->listener_count-1].accept_burst = config->default_listener.accept_burst;
 		config->listeners[config->listener_count-1].protocol = config->default_listener.protocol;
 		config->listeners[config->listener_count-1].client_count = 0;
 		config->listeners[config->listener_count-1].socks = NULL;
@@ -562,10 +577,22 @@ void config__copy(struct mosquitto__config *src, struct mosquitto__config *dest)
 	mosquitto__free(dest->persistence_filepath);
 	dest->persistence_filepath = src->persistence_filepath;
 
+	dest->persistence_log_sync_interval = src->persistence_log_sync_interval;
+
 	dest->persistent_client_expiration = src->persistent_client_expiration;
 
 
 	dest->queue_qos0_messages = src->queue_qos0_messages;
+	dest->queue_spill_bytes = src->queue_spill_bytes;
+
+	mosquitto__free(dest->queue_spill_location);
+	dest->queue_spill_location = src->queue_spill_location;
+
+	dest->retained_batch_size = src->retained_batch_size;
+	dest->shared_sub_policy = src->shared_sub_policy;
+	dest->smp_batch_max_bytes = src->smp_batch_max_bytes;
+	dest->smp_compression = src->smp_compression;
+	dest->accept_budget = src->accept_budget;
 	dest->sys_interval = src->sys_interval;
 	dest->upgrade_outgoing_qos = src->upgrade_outgoing_qos;
 
@@ -748,7 +775,34 @@ int config__read_file_core(struct mosquitto__config *config, bool reload, struct
 			}
 			token = strtok_r((*buf), " ", &saveptr);
 			if(token){
-				if(!strcmp(token, "acl_file")){
+				if(!strcmp(token, "accept_budget")){
+					if(conf__parse_int(&token, "accept_budget", &config->accept_budget, saveptr)) return MOSQ_ERR_INVAL;
+					if(config->accept_budget < 0){
+						log__printf(NULL, MOSQ_LOG_ERR, "Error: Invalid accept_budget value (%d).", config->accept_budget);
+						return MOSQ_ERR_INVAL;
+					}
+				}else if(!strcmp(token, "accept_rate")){
+					if(reload) continue; // Listeners not valid for reloading.
+					token = strtok_r(NULL, " ", &saveptr);
+					if(token){
+						cur_listener->accept_rate = atoi(token);
+						if(cur_listener->accept_rate < 0){
+							log__printf(NULL, MOSQ_LOG_ERR, "Error: Invalid accept_rate value (%d).", cur_listener->accept_rate);
+							return MOSQ_ERR_INVAL;
+						}
+						cur_listener->accept_burst = cur_listener->accept_rate;
+						token = strtok_r(NULL, " ", &saveptr);
+						if(token){
+							cur_listener->accept_burst = atoi(token);
+							if(cur_listener->accept_burst < cur_listener->accept_rate){
+								log__printf(NULL, MOSQ_LOG_ERR, "Error: accept_rate burst must be at least the rate.");
+								return MOSQ_ERR_INVAL;
+							}
+						}
+					}else{
+						log__printf(NULL, MOSQ_LOG_ERR, "Error: Empty accept_rate value in configuration.");
+					}
+				}else if(!strcmp(token, "acl_file")){
 					conf__set_cur_security_options(config, cur_listener, &cur_security_options);
 					if(reload){
 						mosquitto__free(cur_security_options->acl_file);
@@ -1611,12 +1665,42 @@ int config__read_file_core(struct mosquitto__config *config, bool reload, struct
 						log__printf(NULL, MOSQ_LOG_ERR, "Error: per_listener_settings must be set before any other security settings.");
 						return MOSQ_ERR_INVAL;
 					}
+				}else if(!strcmp(token, "retained_batch_size")){
+					if(conf__parse_int(&token, "retained_batch_size", &config->retained_batch_size, saveptr)) return MOSQ_ERR_INVAL;
+					if(config->retained_batch_size < 0){
+						log__printf(NULL, MOSQ_LOG_ERR, "Error: Invalid retained_batch_size value (%d).", config->retained_batch_size);
+						return MOSQ_ERR_INVAL;
+					}
+				}else if(!strcmp(token, "shared_subscription_policy")){
+					token = strtok_r(NULL, " ", &saveptr);
+					if(token){
+						if(!strcmp(token, "round_robin")){
+							config->shared_sub_policy = ssp_round_robin;
+						}else if(!strcmp(token, "least_inflight")){
+							config->shared_sub_policy = ssp_least_inflight;
+						}else{
+							log__printf(NULL, MOSQ_LOG_ERR, "Error: Invalid shared_subscription_policy value (%s).", token);
+							return MOSQ_ERR_INVAL;
+						}
+					}else{
+						log__printf(NULL, MOSQ_LOG_ERR, "Error: Empty shared_subscription_policy value in configuration.");
+						return MOSQ_ERR_INVAL;
+					}
 				}else if(!strcmp(token, "persistence") || !strcmp(token, "retained_persistence")){
 					if(conf__parse_bool(&token, token, &config->persistence, saveptr)) return MOSQ_ERR_INVAL;
 				}else if(!strcmp(token, "persistence_file")){
 					if(conf__parse_string(&token, "persistence_file", &config->persistence_file, saveptr)) return MOSQ_ERR_INVAL;
 				}else if(!strcmp(token, "persistence_location")){
 					if(conf__parse_string(&token, "persistence_location", &config->persistence_location, saveptr)) return MOSQ_ERR_INVAL;
+				}else if(!strcmp(token, "persistence_log")){
+					if(reload) continue; // Persistence log can't be switched on or off while running.
+					if(conf__parse_bool(&token, "persistence_log", &config->persistence_log, saveptr)) return MOSQ_ERR_INVAL;
+				}else if(!strcmp(token, "persistence_log_sync_interval")){
+					if(conf__parse_int(&token, "persistence_log_sync_interval", &config->persistence_log_sync_interval, saveptr)) return MOSQ_ERR_INVAL;
+					if(config->persistence_log_sync_interval < 0){
+						log__printf(NULL, MOSQ_LOG_ERR, "Error: Invalid persistence_log_sync_interval value (%d).", config->persistence_log_sync_interval);
+						return MOSQ_ERR_INVAL;
+					}
 				}else if(!strcmp(token, "persistent_client_expiration")){
 					token = strtok_r(NULL, " ", &saveptr);
 					if(token){
@@ -1707,6 +1791,15 @@ int config__read_file_core(struct mosquitto__config *config, bool reload, struct
 #endif
 				}else if(!strcmp(token, "queue_qos0_messages")){
 					if(conf__parse_bool(&token, token, &config->queue_qos0_messages, saveptr)) return MOSQ_ERR_INVAL;
+				}else if(!strcmp(token, "queue_spill_bytes")){
+					token = strtok_r(NULL, " ", &saveptr);
+					if(token){
+						config->queue_spill_bytes = atol(token);
+					}else{
+						log__printf(NULL, MOSQ_LOG_ERR, "Error: Empty queue_spill_bytes value in configuration.");
+					}
+				}else if(!strcmp(token, "queue_spill_location")){
+					if(conf__parse_string(&token, "queue_spill_location", &config->queue_spill_location, saveptr)) return MOSQ_ERR_INVAL;
 				}else if(!strcmp(token, "require_certificate")){
 #ifdef WITH_TLS
 					if(reload) continue; // Listeners not valid for reloading.
@@ -1772,6 +1865,66 @@ int config__read_file_core(struct mosquitto__config *config, bool reload, struct
 					}
 #else
 					log__printf(NULL, MOSQ_LOG_WARNING, "Warning: Bridge support not available.");
+#endif
+				}else if(!strcmp(token, "smp_batch_max_bytes")){
+#if defined(WITH_WEEVE_SMP)
+					if(conf__parse_int(&token, "smp_batch_max_bytes", &config->smp_batch_max_bytes, saveptr)) return MOSQ_ERR_INVAL;
+					if(config->smp_batch_max_bytes < 0){
+						log__printf(NULL, MOSQ_LOG_ERR, "Error: Invalid smp_batch_max_bytes value (%d).", config->smp_batch_max_bytes);
+						return MOSQ_ERR_INVAL;
+					}
+#else
+					log__printf(NULL, MOSQ_LOG_WARNING, "Warning: SMP support not available.");
+#endif
+				}else if(!strcmp(token, "smp_compression")){
+#if defined(WITH_WEEVE_SMP)
+					if(conf__parse_bool(&token, "smp_compression", &config->smp_compression, saveptr)) return MOSQ_ERR_INVAL;
+#else
+					log__printf(NULL, MOSQ_LOG_WARNING, "Warning: SMP support not available.");
+#endif
+				}else if(!strcmp(token, "smp_early_data_max_connects")){
+#if defined(WITH_WEEVE_SMP)
+					if(reload) continue; // The early data window is sized at startup.
+					if(conf__parse_int(&token, "smp_early_data_max_connects", &config->smp_early_data_max_connects, saveptr)) return MOSQ_ERR_INVAL;
+					if(config->smp_early_data_max_connects < 1 || config->smp_early_data_max_connects > 16777216){
+						log__printf(NULL, MOSQ_LOG_ERR, "Error: Invalid smp_early_data_max_connects value (%d).", config->smp_early_data_max_connects);
+						return MOSQ_ERR_INVAL;
+					}
+#else
+					log__printf(NULL, MOSQ_LOG_WARNING, "Warning: SMP support not available.");
+#endif
+				}else if(!strcmp(token, "smp_early_data_window")){
+#if defined(WITH_WEEVE_SMP)
+					if(reload) continue; // The early data window is sized at startup.
+					if(conf__parse_int(&token, "smp_early_data_window", &config->smp_early_data_window, saveptr)) return MOSQ_ERR_INVAL;
+					if(config->smp_early_data_window < 1){
+						log__printf(NULL, MOSQ_LOG_ERR, "Error: Invalid smp_early_data_window value (%d).", config->smp_early_data_window);
+						return MOSQ_ERR_INVAL;
+					}
+#else
+					log__printf(NULL, MOSQ_LOG_WARNING, "Warning: SMP support not available.");
+#endif
+				}else if(!strcmp(token, "smp_ticket_lifetime")){
+#if defined(WITH_WEEVE_SMP)
+					if(reload) continue; // The ticket key rotation is scheduled at startup.
+					if(conf__parse_int(&token, "smp_ticket_lifetime", &config->smp_ticket_lifetime, saveptr)) return MOSQ_ERR_INVAL;
+					if(config->smp_ticket_lifetime < 0){
+						log__printf(NULL, MOSQ_LOG_ERR, "Error: Invalid smp_ticket_lifetime value (%d).", config->smp_ticket_lifetime);
+						return MOSQ_ERR_INVAL;
+					}
+#else
+					log__printf(NULL, MOSQ_LOG_WARNING, "Warning: SMP support not available.");
+#endif
+				}else if(!strcmp(token, "smp_worker_threads")){
+#if defined(WITH_WEEVE_SMP)
+					if(reload) continue; // The workers are started at startup.
+					if(conf__parse_int(&token, "smp_worker_threads", &config->smp_worker_threads, saveptr)) return MOSQ_ERR_INVAL;
+					if(config->smp_worker_threads < 0 || config->smp_worker_threads > 1024){
+						log__printf(NULL, MOSQ_LOG_ERR, "Error: Invalid smp_worker_threads value (%d).", config->smp_worker_threads);
+						return MOSQ_ERR_INVAL;
+					}
+#else
+					log__printf(NULL, MOSQ_LOG_WARNING, "Warning: SMP support not available.");
 #endif
 				}else if(!strcmp(token, "store_clean_interval")){
 					log__printf(NULL, MOSQ_LOG_WARNING, "Warning: store_clean_interval is no longer needed.");
@@ -30,6 +30,47 @@ Contributors:
 #include "wclCommon.h"
 #include "wclSmp.h"
 #endif
+
+/* The keepalive timer is only moved on lazily. When it fires, the deadline is
+ * worked out again from last_msg_in, so reading a packet never has to touch
+ * the timer wheel. */
+static void context__keepalive_expired(struct mosquitto_db *db, struct mosquitto__timer *timer)
+{
+	struct mosquitto *context = timer->userdata;
+	time_t expires;
+	char *id;
+
+	/* Local bridges never time out in this fashion. */
+	if(context->sock == INVALID_SOCKET || !context->keepalive || context->bridge){
+		return;
+	}
+	expires = context->last_msg_in + (time_t)(context->keepalive)*3/2;
+	if(mosquitto_time() <= expires){
+		timer__add(db, timer, expires+1);
+		return;
+	}
+
+	if(db->config->connection_messages == true){
+		if(context->id){
+			id = context->id;
+		}else{
+			id = "<unknown>";
+		}
+		log__printf(NULL, MOSQ_LOG_NOTICE, "Client %s has exceeded timeout, disconnecting.", id);
+	}
+	/* Client has exceeded keepalive*1.5 */
+	do_disconnect(db, context);
+}
+
+void context__keepalive_arm(struct mosquitto_db *db, struct mosquitto *context)
+{
+	if(context->keepalive){
+		timer__add(db, &context->keepalive_timer, context->last_msg_in + (time_t)(context->keepalive)*3/2 + 1);
+	}else{
+		timer__remove(db, &context->keepalive_timer);
+	}
+}
+
 struct mosquitto *context__init(struct mosquitto_db *db, mosq_sock_t sock)
 {
 #if defined(WITH_WEEVE_SMP)
@@ -82,6 +123,8 @@ struct mosquitto *context__init(struct mosquitto_db *db, mosq_sock_t sock)
 	context->last_inflight_msg = NULL;
 	context->queued_msgs = NULL;
 	context->last_queued_msg = NULL;
+	context->retain_pending = NULL;
+	context->last_retain_pending = NULL;
 	context->msg_bytes = 0;
 	context->msg_bytes12 = 0;
 	context->msg_count = 0;
@@ -90,13 +133,19 @@ struct mosquitto *context__init(struct mosquitto_db *db, mosq_sock_t sock)
 	context->ssl = NULL;
 #endif
 #if defined(WITH_WEEVE_SMP)
-	wclStatus = wclSmpOpen(&context->smpSession);
+	wclStatus = wclSmpOpen(&context->smpSession, WCL_SMP_ROLE_MQTTS_BROKER);
 	if(WCL_SUCCESS != wclStatus){
 		return NULL;
 	}
+	if(db->config && db->config->smp_compression){
+		wclSmpSetCompression(context->smpSession, true);
+	}
 #endif
+	context->keepalive_timer.callback = context__keepalive_expired;
+	context->keepalive_timer.userdata = context;
 	if((int)context->sock >= 0){
 		HASH_ADD(hh_sock, db->contexts_by_sock, sock, sizeof(context->sock), context);
+		context__keepalive_arm(db, context);
 	}
 	return context;
 }
@@ -112,20 +161,13 @@ void context__cleanup(struct mosquitto_db *db, struct mosquitto *context, bool d
 	struct mosquitto__packet *packet;
 	struct mosquitto_client_msg *msg, *next;
 	int i;
-#if defined(WITH_WEEVE_SMP)
-	WclError_t wclStatus = WCL_SUCCESS;
-#endif
 
 	if(!context) return;
 
+	timer__remove(db, &context->keepalive_timer);
+	context__remove_from_ready(db, context);
 #if defined(WITH_WEEVE_SMP)
-	if(context->smpSession) {
-		wclStatus = wclSmpClose(context->smpSession);
-		context->smpSession = NULL;
-		if (WCL_SUCCESS != wclStatus){
-			/* errno = EINVAL; */
-		}
-	}
+	smp_async__close_session(db, context);
 #endif
 #ifdef WITH_BRIDGE
 	if(context->bridge){
@@ -207,6 +249,8 @@ void context__cleanup(struct mosquitto_db *db, struct mosquitto *context, bool d
 		}
 		context->inflight_msgs = NULL;
 		context->last_inflight_msg = NULL;
+		context->inflight_count = 0;
+		context->inflight_send_msg = NULL;
 		msg = context->queued_msgs;
 		while(msg){
 			next = msg->next;
@@ -216,6 +260,9 @@ void context__cleanup(struct mosquitto_db *db, struct mosquitto *context, bool d
 		}
 		context->queued_msgs = NULL;
 		context->last_queued_msg = NULL;
+		db__msg_index_free(context);
+		spool__free(context);
+		sub__retain_pending_free(db, context);
 	}
 	if(do_free){
 		mosquitto__free(context);
@@ -246,6 +293,10 @@ void context__disconnect(struct mosquitto_db *db, struct mosquitto *ctxt)
 	context__send_will(db, ctxt);
 
 	ctxt->disconnect_t = time(NULL);
+#ifdef WITH_PERSISTENCE
+	persist__log_client(db, ctxt);
+#endif
+	timer__remove(db, &ctxt->keepalive_timer);
 	net__socket_close(db, ctxt);
 }
 
@@ -259,6 +310,36 @@ void context__add_to_disused(struct mosquitto_db *db, struct mosquitto *context)
 	}
 }
 
+/* Only contexts on the ready list have their outgoing messages and EPOLLOUT
+ * state looked at by the main loop, rather than every connected client on
+ * every pass. A context is added when something is queued for it that may
+ * need writing out. */
+void context__add_to_ready(struct mosquitto_db *db, struct mosquitto *context)
+{
+	if(context->ready_pprev || context->sock == INVALID_SOCKET){
+		return;
+	}
+	context->ready_next = db->ready_contexts;
+	if(context->ready_next){
+		context->ready_next->ready_pprev = &context->ready_next;
+	}
+	context->ready_pprev = &db->ready_contexts;
+	db->ready_contexts = context;
+}
+
+void context__remove_from_ready(struct mosquitto_db *db, struct mosquitto *context)
+{
+	if(!context->ready_pprev){
+		return;
+	}
+	*context->ready_pprev = context->ready_next;
+	if(context->ready_next){
+		context->ready_next->ready_pprev = context->ready_pprev;
+	}
+	context->ready_next = NULL;
+	context->ready_pprev = NULL;
+}
+
 void context__free_disused(struct mosquitto_db *db)
 {
 	struct mosquitto *context, *next;
@@ -21,6 +21,7 @@ Contributors:
 
 #include "mosquitto_broker_internal.h"
 #include "memory_mosq.h"
+#include "packet_mosq.h"
 #include "send_mosq.h"
 #include "sys_tree.h"
 #include "time_mosq.h"
@@ -100,6 +101,192 @@ static bool db__ready_for_queue(struct mosquitto *context, int qos)
 }
 
 
+/* Messages a client can refer to by mid - QoS 1 and 2 messages in flight, and
+ * incoming QoS 2 messages wherever they are - are kept in a small open
+ * addressing table per context, so acknowledgements don't need a walk of the
+ * in-flight list. The table is kept at most half full. */
+static uint32_t db__msg_index_slot(uint16_t mid, enum mosquitto_msg_direction dir, uint32_t mask)
+{
+	return ((uint32_t)mid ^ ((uint32_t)dir << 15)) & mask;
+}
+
+
+static void db__msg_index_insert(struct mosquitto_client_msg **slots, uint32_t size, struct mosquitto_client_msg *msg)
+{
+	uint32_t i;
+
+	i = db__msg_index_slot(msg->mid, msg->direction, size-1);
+	while(slots[i]){
+		i = (i+1) & (size-1);
+	}
+	slots[i] = msg;
+}
+
+
+/* Build the table from the lists, sized for twice what it holds now. */
+static int db__msg_index_rebuild(struct mosquitto *context)
+{
+	struct mosquitto_client_msg **slots;
+	struct mosquitto_client_msg *msg;
+	uint32_t size, used = 0;
+
+	for(msg = context->inflight_msgs; msg; msg = msg->next){
+		if(msg->qos > 0) used++;
+	}
+	for(msg = context->queued_msgs; msg; msg = msg->next){
+		if(msg->qos > 0 && msg->direction == mosq_md_in) used++;
+	}
+	size = context->msg_index_size ? context->msg_index_size*2 : 8;
+	while(size < (used+1)*2){
+		size *= 2;
+	}
+
+	slots = mosquitto__calloc(size, sizeof(struct mosquitto_client_msg *));
+	if(!slots) return MOSQ_ERR_NOMEM;
+
+	for(msg = context->inflight_msgs; msg; msg = msg->next){
+		if(msg->qos > 0) db__msg_index_insert(slots, size, msg);
+	}
+	for(msg = context->queued_msgs; msg; msg = msg->next){
+		if(msg->qos > 0 && msg->direction == mosq_md_in) db__msg_index_insert(slots, size, msg);
+	}
+	mosquitto__free(context->msg_index);
+	context->msg_index = slots;
+	context->msg_index_size = size;
+	context->msg_index_used = used;
+	return MOSQ_ERR_SUCCESS;
+}
+
+
+/* The message must already be on the in-flight or queued list. */
+void db__msg_index_add(struct mosquitto *context, struct mosquitto_client_msg *msg)
+{
+	if(msg->qos == 0) return;
+
+	if(!context->msg_index || (context->msg_index_used+1)*2 > context->msg_index_size){
+		/* The rebuild picks up the new message from its list. If it fails,
+		 * lookups walk the lists until a later rebuild succeeds. */
+		if(db__msg_index_rebuild(context)){
+			db__msg_index_free(context);
+		}
+		return;
+	}
+	db__msg_index_insert(context->msg_index, context->msg_index_size, msg);
+	context->msg_index_used++;
+}
+
+
+void db__msg_index_remove(struct mosquitto *context, struct mosquitto_client_msg *msg)
+{
+	struct mosquitto_client_msg **slots = context->msg_index;
+	uint32_t mask = context->msg_index_size-1;
+	uint32_t i, j, k;
+
+	if(!slots || msg->qos == 0) return;
+
+	i = db__msg_index_slot(msg->mid, msg->direction, mask);
+	while(slots[i] != msg){
+		if(!slots[i]) return;
+		i = (i+1) & mask;
+	}
+	slots[i] = NULL;
+	context->msg_index_used--;
+
+	/* Shift back any entry in the same run that would no longer be
+	 * reachable from its home slot. */
+	j = i;
+	while(1){
+		j = (j+1) & mask;
+		if(!slots[j]) break;
+		k = db__msg_index_slot(slots[j]->mid, slots[j]->direction, mask);
+		if((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j)){
+			slots[i] = slots[j];
+			slots[j] = NULL;
+			i = j;
+		}
+	}
+}
+
+
+struct mosquitto_client_msg *db__msg_index_find(struct mosquitto *context, uint16_t mid, enum mosquitto_msg_direction dir, bool include_queued)
+{
+	struct mosquitto_client_msg *msg;
+	uint32_t i, mask;
+
+	if(!context->msg_index){
+		for(msg = context->inflight_msgs; msg; msg = msg->next){
+			if(msg->mid == mid && msg->direction == dir) return msg;
+		}
+		if(include_queued){
+			for(msg = context->queued_msgs; msg; msg = msg->next){
+				if(msg->mid == mid && msg->direction == dir) return msg;
+			}
+		}
+		return NULL;
+	}
+
+	mask = context->msg_index_size-1;
+	i = db__msg_index_slot(mid, dir, mask);
+	while((msg = context->msg_index[i])){
+		if(msg->mid == mid && msg->direction == dir
+				&& (include_queued || msg->state != mosq_ms_queued)){
+			return msg;
+		}
+		i = (i+1) & mask;
+	}
+	return NULL;
+}
+
+
+void db__msg_index_free(struct mosquitto *context)
+{
+	mosquitto__free(context->msg_index);
+	context->msg_index = NULL;
+	context->msg_index_size = 0;
+	context->msg_index_used = 0;
+}
+
+
+void db__inflight_append(struct mosquitto *context, struct mosquitto_client_msg *msg)
+{
+	msg->next = NULL;
+	msg->prev = context->last_inflight_msg;
+	if(context->last_inflight_msg){
+		context->last_inflight_msg->next = msg;
+	}else{
+		context->inflight_msgs = msg;
+	}
+	context->last_inflight_msg = msg;
+	context->inflight_count++;
+	if(!context->inflight_send_msg){
+		context->inflight_send_msg = msg;
+	}
+	db__msg_index_add(context, msg);
+}
+
+
+void db__inflight_unlink(struct mosquitto *context, struct mosquitto_client_msg *msg)
+{
+	if(msg->prev){
+		msg->prev->next = msg->next;
+	}else{
+		context->inflight_msgs = msg->next;
+	}
+	if(msg->next){
+		msg->next->prev = msg->prev;
+	}else{
+		context->last_inflight_msg = msg->prev;
+	}
+	if(context->inflight_send_msg == msg){
+		context->inflight_send_msg = msg->next;
+	}
+	msg->next = NULL;
+	msg->prev = NULL;
+	context->inflight_count--;
+	db__msg_index_remove(context, msg);
+}
+
+
 int db__open(struct mosquitto__config *config, struct mosquitto_db *db)
 {
 	struct mosquitto__subhier *subhier;
@@ -107,6 +294,7 @@ int db__open(struct mosquitto__config *config, struct mosquitto_db *db)
 	if(!config || !db) return MOSQ_ERR_INVAL;
 
 	db->last_db_id = 0;
+	timer__init(db);
 
 	db->contexts_by_id = NULL;
 	db->contexts_by_sock = NULL;
@@ -132,6 +320,7 @@ int db__open(struct mosquitto__config *config, struct mosquitto_db *db)
 #ifdef WITH_PERSISTENCE
 	if(config->persistence && config->persistence_filepath){
 		if(persist__restore(db)) return 1;
+		if(persist__log_open(db)) return 1;
 	}
 #endif
 
@@ -142,6 +331,7 @@ static void subhier_clean(struct mosquitto_db *db, struct mosquitto__subhier **s
 {
 	struct mosquitto__subhier *peer, *subhier_tmp;
 	struct mosquitto__subleaf *leaf, *nextleaf;
+	struct mosquitto__subshared *shared, *shared_tmp;
 
 	HASH_ITER(hh, *subhier, peer, subhier_tmp){
 		leaf = peer->subs;
@@ -150,6 +340,17 @@ static void subhier_clean(struct mosquitto_db *db, struct mosquitto__subhier **s
 			mosquitto__free(leaf);
 			leaf = nextleaf;
 		}
+		HASH_ITER(hh, peer->shared, shared, shared_tmp){
+			leaf = shared->subs;
+			while(leaf){
+				nextleaf = leaf->next;
+				mosquitto__free(leaf);
+				leaf = nextleaf;
+			}
+			HASH_DELETE(hh, peer->shared, shared);
+			mosquitto__free(shared->name);
+			mosquitto__free(shared);
+		}
 		if(peer->retained){
 			db__msg_store_deref(db, &peer->retained);
 		}
@@ -234,8 +435,10 @@ void db__msg_store_deref(struct mosquitto_db *db, struct mosquitto_msg_store **s
 }
 
 
-static void db__message_remove(struct mosquitto_db *db, struct mosquitto *context, struct mosquitto_client_msg **msg, struct mosquitto_client_msg *last)
+static void db__message_remove(struct mosquitto_db *db, struct mosquitto *context, struct mosquitto_client_msg **msg)
 {
+	struct mosquitto_client_msg *next;
+
 	if(!context || !msg || !(*msg)){
 		return;
 	}
@@ -249,23 +452,13 @@ static void db__message_remove(struct mosquitto_db *db, struct mosquitto *contex
 		}
 		db__msg_store_deref(db, &(*msg)->store);
 	}
-	if(last){
-		last->next = (*msg)->next;
-		if(!last->next){
-			context->last_inflight_msg = last;
-		}
-	}else{
-		context->inflight_msgs = (*msg)->next;
-		if(!context->inflight_msgs){
-			context->last_inflight_msg = NULL;
-		}
-	}
+#ifdef WITH_PERSISTENCE
+	persist__log_client_msg_delete(db, context, (*msg)->mid, (*msg)->direction);
+#endif
+	next = (*msg)->next;
+	db__inflight_unlink(context, *msg);
 	mosquitto__free(*msg);
-	if(last){
-		*msg = last->next;
-	}else{
-		*msg = context->inflight_msgs;
-	}
+	*msg = next;
 }
 
 void db__message_dequeue_first(struct mosquitto *context)
@@ -277,35 +470,25 @@ void db__message_dequeue_first(struct mosquitto *context)
 	if (context->last_queued_msg == msg){
 		context->last_queued_msg = NULL;
 	}
-
-	if (context->last_inflight_msg){
-		context->last_inflight_msg->next = msg;
-		context->last_inflight_msg = msg;
-	}else{
-		context->inflight_msgs = msg;
-		context->last_inflight_msg = msg;
+	if(msg->direction == mosq_md_in){
+		/* Already indexed while queued, it is added again in flight. */
+		db__msg_index_remove(context, msg);
 	}
-	msg->next = NULL;
+
+	db__inflight_append(context, msg);
 }
 
 int db__message_delete(struct mosquitto_db *db, struct mosquitto *context, uint16_t mid, enum mosquitto_msg_direction dir)
 {
-	struct mosquitto_client_msg *tail, *last = NULL;
-	int msg_index = 0;
+	struct mosquitto_client_msg *tail;
+	int msg_index;
 
 	if(!context) return MOSQ_ERR_INVAL;
 
-	tail = context->inflight_msgs;
-	while(tail){
-		msg_index++;
-		if(tail->mid == mid && tail->direction == dir){
-			msg_index--;
-			db__message_remove(db, context, &tail, last);
-		}else{
-			last = tail;
-			tail = tail->next;
-		}
+	while((tail = db__msg_index_find(context, mid, dir, false))){
+		db__message_remove(db, context, &tail);
 	}
+	msg_index = context->inflight_count;
 	while (context->queued_msgs && (max_inflight == 0 || msg_index < max_inflight)){
 		msg_index++;
 		tail = context->queued_msgs;
@@ -331,6 +514,12 @@ int db__message_delete(struct mosquitto_db *db, struct mosquitto *context, uint1
 			}
 		}
 	}
+	if(context->inflight_send_msg
+			|| (!context->queued_msgs && context->spool && context->spool->msg_count)){
+
+		/* Anything spilled to disk is paged in now there is room for it. */
+		context__add_to_ready(db, context);
+	}
 
 	return MOSQ_ERR_SUCCESS;
 }
@@ -338,11 +527,11 @@ int db__message_delete(struct mosquitto_db *db, struct mosquitto *context, uint1
 int db__message_insert(struct mosquitto_db *db, struct mosquitto *context, uint16_t mid, enum mosquitto_msg_direction dir, int qos, bool retain, struct mosquitto_msg_store *stored)
 {
 	struct mosquitto_client_msg *msg;
-	struct mosquitto_client_msg **msgs, **last_msg;
 	enum mosquitto_msg_state state = mosq_ms_invalid;
 	int rc = 0;
 	int i;
 	char **dest_ids;
+	bool spooled = false;
 
 	assert(stored);
 	if(!context) return MOSQ_ERR_INVAL;
@@ -438,6 +627,7 @@ int db__message_insert(struct mosquitto_db *db, struct mosquitto *context, uint1
 	msg = mosquitto__malloc(sizeof(struct mosquitto_client_msg));
 	if(!msg) return MOSQ_ERR_NOMEM;
 	msg->next = NULL;
+	msg->prev = NULL;
 	msg->store = stored;
 	msg->store->ref_count++;
 	msg->mid = mid;
@@ -448,19 +638,32 @@ int db__message_insert(struct mosquitto_db *db, struct mosquitto *context, uint1
 	msg->qos = qos;
 	msg->retain = retain;
 
-	if (state == mosq_ms_queued){
-		msgs = &(context->queued_msgs);
-		last_msg = &(context->last_queued_msg);
-	}else{
-		msgs = &(context->inflight_msgs);
-		last_msg = &(context->last_inflight_msg);
+	if(spool__wanted(db, context, dir, state, stored->payloadlen)){
+		msg->state = mosq_ms_queued;
+		if(spool__message_add(db, context, msg) == MOSQ_ERR_SUCCESS){
+			spooled = true;
+		}else if(state != mosq_ms_queued){
+			/* Couldn't spool behind the earlier messages, so hold it back
+			 * rather than let it overtake them. */
+			state = mosq_ms_queued;
+		}
 	}
-	if(*last_msg){
-		(*last_msg)->next = msg;
-		(*last_msg) = msg;
-	}else{
-		*msgs = msg;
-		*last_msg = msg;
+
+	if(!spooled){
+		if (state == mosq_ms_queued){
+			if(context->last_queued_msg){
+				context->last_queued_msg->next = msg;
+			}else{
+				context->queued_msgs = msg;
+			}
+			context->last_queued_msg = msg;
+			if(dir == mosq_md_in){
+				db__msg_index_add(context, msg);
+			}
+		}else{
+			db__inflight_append(context, msg);
+			context__add_to_ready(db, context);
+		}
 	}
 	context->msg_count++;
 	context->msg_bytes += msg->store->payloadlen;
@@ -468,6 +671,14 @@ int db__message_insert(struct mosquitto_db *db, struct mosquitto *context, uint1
 		context->msg_count12++;
 		context->msg_bytes12 += msg->store->payloadlen;
 	}
+#ifdef WITH_PERSISTENCE
+	persist__log_client_msg(db, context, msg);
+#endif
+	if(spooled){
+		/* The spool has its own copy of the message. */
+		db__msg_store_deref(db, &msg->store);
+		mosquitto__free(msg);
+	}
 
 	if(db->config->allow_duplicate_messages == false && dir == mosq_md_out && retain == false){
 		/* Record which client ids this message has been sent to so we can avoid duplicates.
@@ -513,14 +724,27 @@ int db__message_update(struct mosquitto *context, uint16_t mid, enum mosquitto_m
 {
 	struct mosquitto_client_msg *tail;
 
-	tail = context->inflight_msgs;
-	while(tail){
-		if(tail->mid == mid && tail->direction == dir){
-			tail->state = state;
-			tail->timestamp = mosquitto_time();
-			return MOSQ_ERR_SUCCESS;
+	tail = db__msg_index_find(context, mid, dir, false);
+	if(tail){
+		tail->state = state;
+		tail->timestamp = mosquitto_time();
+		switch(state){
+			case mosq_ms_publish_qos0:
+			case mosq_ms_publish_qos1:
+			case mosq_ms_publish_qos2:
+			case mosq_ms_send_pubrec:
+			case mosq_ms_resend_pubrel:
+			case mosq_ms_resend_pubcomp:
+				context->inflight_send_msg = context->inflight_msgs;
+				context__add_to_ready(mosquitto__get_db(), context);
+				break;
+			default:
+				break;
 		}
-		tail = tail->next;
+#ifdef WITH_PERSISTENCE
+		persist__log_client_msg_update(mosquitto__get_db(), context, mid, dir, state);
+#endif
+		return MOSQ_ERR_SUCCESS;
 	}
 	return MOSQ_ERR_NOT_FOUND;
 }
@@ -540,6 +764,8 @@ int db__messages_delete(struct mosquitto_db *db, struct mosquitto *context)
 	}
 	context->inflight_msgs = NULL;
 	context->last_inflight_msg = NULL;
+	context->inflight_count = 0;
+	context->inflight_send_msg = NULL;
 
 	tail = context->queued_msgs;
 	while(tail){
@@ -550,6 +776,8 @@ int db__messages_delete(struct mosquitto_db *db, struct mosquitto *context)
 	}
 	context->queued_msgs = NULL;
 	context->last_queued_msg = NULL;
+	db__msg_index_free(context);
+	spool__free(context);
 	context->msg_bytes = 0;
 	context->msg_bytes12 = 0;
 	context->msg_count = 0;
@@ -623,6 +851,7 @@ int db__message_store(struct mosquitto_db *db, const char *source, uint16_t sour
 	temp->mid = 0;
 	temp->qos = qos;
 	temp->retain = retain;
+	temp->persist_logged = false;
 	temp->topic = topic;
 	topic = NULL;
 	temp->payloadlen = payloadlen;
@@ -664,22 +893,11 @@ int db__message_store_find(struct mosquitto *context, uint16_t mid, struct mosqu
 	if(!context) return MOSQ_ERR_INVAL;
 
 	*stored = NULL;
-	tail = context->inflight_msgs;
-	while(tail){
-		if(tail->store->source_mid == mid && tail->direction == mosq_md_in){
-			*stored = tail->store;
-			return MOSQ_ERR_SUCCESS;
-		}
-		tail = tail->next;
-	}
-
-	tail = context->queued_msgs;
-	while(tail){
-		if(tail->store->source_mid == mid && tail->direction == mosq_md_in){
-			*stored = tail->store;
-			return MOSQ_ERR_SUCCESS;
-		}
-		tail = tail->next;
+	/* Incoming messages are stored with the client's mid as source_mid. */
+	tail = db__msg_index_find(context, mid, mosq_md_in, true);
+	if(tail && tail->store->source_mid == mid){
+		*stored = tail->store;
+		return MOSQ_ERR_SUCCESS;
 	}
 
 	return 1;
@@ -690,16 +908,21 @@ int db__message_store_find(struct mosquitto *context, uint16_t mid, struct mosqu
 int db__message_reconnect_reset(struct mosquitto_db *db, struct mosquitto *context)
 {
 	struct mosquitto_client_msg *msg;
-	struct mosquitto_client_msg *prev = NULL;
 
 	msg = context->inflight_msgs;
-	context->msg_bytes = 0;
-	context->msg_bytes12 = 0;
-	context->msg_count = 0;
-	context->msg_count12 = 0;
+	if(context->spool){
+		/* Spooled messages still count towards the queue limits. */
+		context->msg_bytes = context->spool->msg_bytes;
+		context->msg_bytes12 = context->spool->msg_bytes12;
+		context->msg_count = context->spool->msg_count;
+		context->msg_count12 = context->spool->msg_count12;
+	}else{
+		context->msg_bytes = 0;
+		context->msg_bytes12 = 0;
+		context->msg_count = 0;
+		context->msg_count12 = 0;
+	}
 	while(msg){
-		context->last_inflight_msg = msg;
-
 		context->msg_count++;
 		context->msg_bytes += msg->store->payloadlen;
 		if(msg->qos > 0){
@@ -727,15 +950,17 @@ int db__message_reconnect_reset(struct mosquitto_db *db, struct mosquitto *conte
 			if(msg->qos != 2){
 				/* Anything <QoS 2 can be completely retried by the client at
 				 * no harm. */
-				db__message_remove(db, context, &msg, prev);
+				db__message_remove(db, context, &msg);
+				continue;
 			}else{
 				/* Message state can be preserved here because it should match
 				 * whatever the client has got. */
 			}
 		}
-		prev = msg;
-		if(msg) msg = msg->next;
+		msg = msg->next;
 	}
+	context->inflight_send_msg = context->inflight_msgs;
+	context__add_to_ready(db, context);
 	/* Messages received when the client was disconnected are put
 	 * in the mosq_ms_queued state. If we don't change them to the
 	 * appropriate "publish" state, then the queued messages won't
@@ -779,40 +1004,34 @@ int db__message_reconnect_reset(struct mosquitto_db *db, struct mosquitto *conte
 
 int db__message_release(struct mosquitto_db *db, struct mosquitto *context, uint16_t mid, enum mosquitto_msg_direction dir)
 {
-	struct mosquitto_client_msg *tail, *last = NULL;
+	struct mosquitto_client_msg *tail;
 	int qos;
 	int retain;
 	char *topic;
 	char *source_id;
-	int msg_index = 0;
+	int msg_index;
 	bool deleted = false;
 
 	if(!context) return MOSQ_ERR_INVAL;
 
-	tail = context->inflight_msgs;
-	while(tail){
-		msg_index++;
-		if(tail->mid == mid && tail->direction == dir){
-			qos = tail->store->qos;
-			topic = tail->store->topic;
-			retain = tail->retain;
-			source_id = tail->store->source_id;
-
-			/* topic==NULL should be a QoS 2 message that was
-			 * denied/dropped and is being processed so the client doesn't
-			 * keep resending it. That means we don't send it to other
-			 * clients. */
-			if(!topic || !sub__messages_queue(db, source_id, topic, qos, retain, &tail->store)){
-				db__message_remove(db, context, &tail, last);
-				deleted = true;
-			}else{
-				return 1;
-			}
+	while((tail = db__msg_index_find(context, mid, dir, false))){
+		qos = tail->store->qos;
+		topic = tail->store->topic;
+		retain = tail->retain;
+		source_id = tail->store->source_id;
+
+		/* topic==NULL should be a QoS 2 message that was
+		 * denied/dropped and is being processed so the client doesn't
+		 * keep resending it. That means we don't send it to other
+		 * clients. */
+		if(!topic || !sub__messages_queue(db, source_id, topic, qos, retain, &tail->store)){
+			db__message_remove(db, context, &tail);
+			deleted = true;
 		}else{
-			last = tail;
-			tail = tail->next;
+			return 1;
 		}
 	}
+	msg_index = context->inflight_count;
 
 	while(context->queued_msgs && (max_inflight == 0 || msg_index < max_inflight)){
 		msg_index++;
@@ -839,6 +1058,12 @@ int db__message_release(struct mosquitto_db *db, struct mosquitto *context, uint
 			}
 		}
 	}
+	if(context->inflight_send_msg
+			|| (!context->queued_msgs && context->spool && context->spool->msg_count)){
+
+		/* Anything spilled to disk is paged in now there is room for it. */
+		context__add_to_ready(db, context);
+	}
 	if(deleted){
 		return MOSQ_ERR_SUCCESS;
 	}else{
@@ -846,10 +1071,10 @@ int db__message_release(struct mosquitto_db *db, struct mosquitto *context, uint
 	}
 }
 
-int db__message_write(struct mosquitto_db *db, struct mosquitto *context)
+static int db__message_write_queued(struct mosquitto_db *db, struct mosquitto *context)
 {
 	int rc;
-	struct mosquitto_client_msg *tail, *last = NULL;
+	struct mosquitto_client_msg *tail;
 	uint16_t mid;
 	int retries;
 	int retain;
@@ -868,9 +1093,10 @@ int db__message_write(struct mosquitto_db *db, struct mosquitto *context)
 		return MOSQ_ERR_SUCCESS;
 	}
 
-	tail = context->inflight_msgs;
+	/* Everything ahead of inflight_send_msg is waiting on the client, so there
+	 * is no need to walk it on every call. */
+	tail = context->inflight_send_msg;
 	while(tail){
-		msg_count++;
 		mid = tail->mid;
 		retries = tail->dup;
 		retain = tail->retain;
@@ -883,7 +1109,7 @@ int db__message_write(struct mosquitto_db *db, struct mosquitto *context)
 			case mosq_ms_publish_qos0:
 				rc = send__publish(context, mid, topic, payloadlen, payload, qos, retain, retries);
 				if(!rc){
-					db__message_remove(db, context, &tail, last);
+					db__message_remove(db, context, &tail);
 				}else{
 					return rc;
 				}
@@ -898,7 +1124,6 @@ int db__message_write(struct mosquitto_db *db, struct mosquitto *context)
 				}else{
 					return rc;
 				}
-				last = tail;
 				tail = tail->next;
 				break;
 
@@ -911,7 +1136,6 @@ int db__message_write(struct mosquitto_db *db, struct mosquitto *context)
 				}else{
 					return rc;
 				}
-				last = tail;
 				tail = tail->next;
 				break;
 
@@ -922,7 +1146,6 @@ int db__message_write(struct mosquitto_db *db, struct mosquitto *context)
 				}else{
 					return rc;
 				}
-				last = tail;
 				tail = tail->next;
 				break;
 
@@ -933,7 +1156,6 @@ int db__message_write(struct mosquitto_db *db, struct mosquitto *context)
 				}else{
 					return rc;
 				}
-				last = tail;
 				tail = tail->next;
 				break;
 
@@ -944,16 +1166,23 @@ int db__message_write(struct mosquitto_db *db, struct mosquitto *context)
 				}else{
 					return rc;
 				}
-				last = tail;
 				tail = tail->next;
 				break;
 
 			default:
-				last = tail;
 				tail = tail->next;
 				break;
 		}
 	}
+	context->inflight_send_msg = NULL;
+	msg_count = context->inflight_count;
+
+	if(context->spool && context->spool->msg_count
+			&& (max_inflight == 0 || msg_count < max_inflight)){
+
+		rc = spool__page_in(db, context);
+		if(rc) return rc;
+	}
 
 	while(context->queued_msgs && (max_inflight == 0 || msg_count < max_inflight)){
 		msg_count++;
@@ -988,6 +1217,57 @@ int db__message_write(struct mosquitto_db *db, struct mosquitto *context)
 	return MOSQ_ERR_SUCCESS;
 }
 
+int db__message_write(struct mosquitto_db *db, struct mosquitto *context)
+{
+	int rc;
+
+	db__message_write_many(db, &context, &rc, 1);
+	return rc;
+}
+
+/* Write the messages of several clients, setting the result of each. */
+void db__message_write_many(struct mosquitto_db *db, struct mosquitto **contexts, int *results, int count)
+{
+	struct mosquitto *context;
+	int i;
+
+	/* Packets are only queued while the messages are walked, then written
+	 * together so that a burst goes out in as few writes as possible. */
+	for(i=0; i<count; i++){
+		contexts[i]->write_deferred = true;
+	}
+	for(i=0; i<count; i++){
+		results[i] = db__message_write_queued(db, contexts[i]);
+	}
+#if defined(WITH_WEEVE_SMP)
+	/* Whatever the walks returned, nothing may stay queued unencrypted. The
+	 * packets of all the clients are encrypted together, so a message going
+	 * out to many subscribers costs a few calls into the SMP library. */
+	packet__smp_seal_pending_many(contexts, results, count);
+#endif
+	for(i=0; i<count; i++){
+		contexts[i]->write_deferred = false;
+	}
+
+	for(i=0; i<count; i++){
+		context = contexts[i];
+		if(results[i]){
+			continue;
+		}
+#ifdef WITH_WEBSOCKETS
+		if(context->wsi){
+			continue;
+		}
+#endif
+		if(context->out_packet){
+			results[i] = packet__write(context);
+			if(context->out_packet || context->current_out_packet){
+				context__add_to_ready(db, context);
+			}
+		}
+	}
+}
+
 void db__limits_set(int inflight, unsigned long inflight_bytes, int queued, unsigned long queued_bytes)
 {
 	max_inflight = inflight;
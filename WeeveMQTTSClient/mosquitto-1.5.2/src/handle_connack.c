@@ -92,6 +92,7 @@ int handle__connack(struct mosquitto_db *db, struct mosquitto *context)
 				}
 			}
 			context->state = mosq_cs_connected;
+			context__add_to_ready(db, context);
 			return MOSQ_ERR_SUCCESS;
 		case CONNACK_REFUSED_PROTOCOL_VERSION:
 			if(context->bridge){
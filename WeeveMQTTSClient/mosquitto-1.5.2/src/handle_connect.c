@@ -77,7 +77,7 @@ static char *client_id_gen(struct mosquitto_db *db, int *idlen, const char *auto
  * assuming a possible change of username. */
 void connection_check_acl(struct mosquitto_db *db, struct mosquitto *context, struct mosquitto_client_msg **msgs)
 {
-	struct mosquitto_client_msg *msg_tail, *msg_prev;
+	struct mosquitto_client_msg *msg_tail, *msg_prev, *msg_next;
 
 	msg_tail = *msgs;
 	msg_prev = NULL;
@@ -87,16 +87,21 @@ void connection_check_acl(struct mosquitto_db *db, struct mosquitto *context, st
 								   msg_tail->store->payloadlen, UHPA_ACCESS(msg_tail->store->payload, msg_tail->store->payloadlen),
 								   msg_tail->store->qos, msg_tail->store->retain, MOSQ_ACL_READ) != MOSQ_ERR_SUCCESS){
 				db__msg_store_deref(db, &msg_tail->store);
-				if(msg_prev){
-					msg_prev->next = msg_tail->next;
-					mosquitto__free(msg_tail);
-					msg_tail = msg_prev->next;
+				msg_next = msg_tail->next;
+				if(msgs == &context->inflight_msgs){
+					db__inflight_unlink(context, msg_tail);
 				}else{
-					*msgs = (*msgs)->next;
-					mosquitto__free(msg_tail);
-					msg_tail = (*msgs);
+					if(msg_prev){
+						msg_prev->next = msg_next;
+					}else{
+						*msgs = msg_next;
+					}
+					if(context->last_queued_msg == msg_tail){
+						context->last_queued_msg = msg_prev;
+					}
 				}
-				// XXX: why it does not update last_msg if msg_tail was the last message ?
+				mosquitto__free(msg_tail);
+				msg_tail = msg_next;
 			}else{
 				msg_prev = msg_tail;
 				msg_tail = msg_tail->next;
@@ -128,6 +133,7 @@ int handle__connect(struct mosquitto_db *db, struct mosquitto *context)
 	int slen;
 	uint16_t slen16;
 	struct mosquitto__subleaf *leaf;
+	struct mosquitto__subshared *shared, *shared_tmp;
 	int i;
 	struct mosquitto__security_options *security_opts;
 #ifdef WITH_TLS
@@ -577,13 +583,35 @@ int handle__connect(struct mosquitto_db *db, struct mosquitto *context)
 		context->clean_session = clean_session;
 
 		if(context->clean_session == false && found_context->clean_session == false){
-			if(found_context->inflight_msgs || found_context->queued_msgs){
+			if(found_context->inflight_msgs || found_context->queued_msgs || found_context->spool){
 				context->inflight_msgs = found_context->inflight_msgs;
+				context->last_inflight_msg = found_context->last_inflight_msg;
+				context->inflight_count = found_context->inflight_count;
+				context->inflight_send_msg = found_context->inflight_send_msg;
 				context->queued_msgs = found_context->queued_msgs;
+				context->last_queued_msg = found_context->last_queued_msg;
+				context->msg_index = found_context->msg_index;
+				context->msg_index_size = found_context->msg_index_size;
+				context->msg_index_used = found_context->msg_index_used;
+				context->spool = found_context->spool;
 				found_context->inflight_msgs = NULL;
+				found_context->last_inflight_msg = NULL;
+				found_context->inflight_count = 0;
+				found_context->inflight_send_msg = NULL;
 				found_context->queued_msgs = NULL;
+				found_context->last_queued_msg = NULL;
+				found_context->msg_index = NULL;
+				found_context->msg_index_size = 0;
+				found_context->msg_index_used = 0;
+				found_context->spool = NULL;
 				db__message_reconnect_reset(db, context);
 			}
+			if(found_context->retain_pending){
+				context->retain_pending = found_context->retain_pending;
+				context->last_retain_pending = found_context->last_retain_pending;
+				found_context->retain_pending = NULL;
+				found_context->last_retain_pending = NULL;
+			}
 			context->subs = found_context->subs;
 			found_context->subs = NULL;
 			context->sub_count = found_context->sub_count;
@@ -599,10 +627,26 @@ int handle__connect(struct mosquitto_db *db, struct mosquitto *context)
 						}
 						leaf = leaf->next;
 					}
+					HASH_ITER(hh, context->subs[i]->shared, shared, shared_tmp){
+						for(leaf=shared->subs; leaf; leaf=leaf->next){
+							if(leaf->context == found_context){
+								leaf->context = context;
+							}
+						}
+					}
 				}
 			}
+		}else{
+			/* The subscriptions the pending retained messages were found with
+			 * are discarded along with the old session. */
+			sub__retain_pending_free(db, found_context);
 		}
 
+#ifdef WITH_PERSISTENCE
+		if(context->clean_session == true && found_context->clean_session == false){
+			persist__log_client_delete(db, found_context->id);
+		}
+#endif
 		found_context->clean_session = true;
 		found_context->state = mosq_cs_duplicate;
 		do_disconnect(db, found_context);
@@ -684,6 +728,7 @@ int handle__connect(struct mosquitto_db *db, struct mosquitto *context)
 	if((protocol_version&0x80) == 0x80){
 		context->is_bridge = true;
 	}
+	context__keepalive_arm(db, context);
 
 	connection_check_acl(db, context, &context->inflight_msgs);
 	connection_check_acl(db, context, &context->queued_msgs);
@@ -693,9 +738,11 @@ int handle__connect(struct mosquitto_db *db, struct mosquitto *context)
 #ifdef WITH_PERSISTENCE
 	if(!clean_session){
 		db->persistence_changes++;
+		persist__log_client(db, context);
 	}
 #endif
 	context->state = mosq_cs_connected;
+	context__add_to_ready(db, context);
 	return send__connack(context, connect_ack, CONNACK_ACCEPTED);
 
 handle_connect_error:
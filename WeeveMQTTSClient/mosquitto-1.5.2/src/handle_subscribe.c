@@ -37,6 +37,7 @@ int handle__subscribe(struct mosquitto_db *db, struct mosquitto *context)
 	int len;
 	int slen;
 	char *sub_mount;
+	char *share_end;
 
 	if(!context) return MOSQ_ERR_INVAL;
 	log__printf(NULL, MOSQ_LOG_DEBUG, "Received SUBSCRIBE from %s", context->id);
@@ -102,7 +103,17 @@ int handle__subscribe(struct mosquitto_db *db, struct mosquitto *context)
 					mosquitto__free(payload);
 					return MOSQ_ERR_NOMEM;
 				}
-				snprintf(sub_mount, len, "%s%s", context->listener->mount_point, sub);
+				share_end = NULL;
+				if(!strncmp(sub, "$share/", strlen("$share/"))){
+					share_end = strchr(sub + strlen("$share/"), '/');
+				}
+				if(share_end){
+					/* The mount point goes in front of the filter, not the
+					 * group. */
+					snprintf(sub_mount, len, "%.*s%s%s", (int)(share_end - sub + 1), sub, context->listener->mount_point, share_end + 1);
+				}else{
+					snprintf(sub_mount, len, "%s%s", context->listener->mount_point, sub);
+				}
 				sub_mount[len] = '\0';
 
 				mosquitto__free(sub);
@@ -127,8 +138,16 @@ int handle__subscribe(struct mosquitto_db *db, struct mosquitto *context)
 
 			if(qos != 0x80){
 				rc2 = sub__add(db, context, sub, qos, &db->subs);
+#ifdef WITH_PERSISTENCE
+				if(rc2 == MOSQ_ERR_SUCCESS || rc2 == -1){
+					persist__log_sub(db, context, sub, qos);
+				}
+#endif
 				if(rc2 == MOSQ_ERR_SUCCESS){
 					if(sub__retain_queue(db, context, sub, qos)) rc = 1;
+				}else if(rc2 == MOSQ_ERR_INVAL){
+					/* Malformed $share/<name>/<filter>, refuse this one only. */
+					qos = 0x80;
 				}else if(rc2 != -1){
 					rc = rc2;
 				}
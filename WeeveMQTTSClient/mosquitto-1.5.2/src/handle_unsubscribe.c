@@ -84,6 +84,10 @@ int handle__unsubscribe(struct mosquitto_db *db, struct mosquitto *context)
 
 			log__printf(NULL, MOSQ_LOG_DEBUG, "\t%s", sub);
 			sub__remove(db, context, sub, db->subs);
+			sub__retain_pending_remove(db, context, sub);
+#ifdef WITH_PERSISTENCE
+			persist__log_sub_delete(db, context, sub);
+#endif
 			log__printf(NULL, MOSQ_LOG_UNSUBSCRIBE, "%s %s", context->id, sub);
 			mosquitto__free(sub);
 		}
@@ -27,6 +27,11 @@ Contributors:
 #include <sys/epoll.h>
 #define MAX_EVENTS 1000
 #endif
+#ifdef WITH_IO_URING
+/* io_uring completions carry poll(2) event masks, which have the same values
+ * as their epoll counterparts. */
+#include <sys/epoll.h>
+#endif
 #include <poll.h>
 #include <unistd.h>
 #else
@@ -36,6 +41,7 @@ Contributors:
 #endif
 
 #include <errno.h>
+#include <limits.h>
 #include <signal.h>
 #include <stdio.h>
 #include <string.h>
@@ -47,6 +53,9 @@ Contributors:
 #ifdef WITH_WEBSOCKETS
 #  include <libwebsockets.h>
 #endif
+#ifdef WITH_WEEVE_SMP
+#  include "wclSmp.h"
+#endif
 
 #include "mosquitto_broker_internal.h"
 #include "memory_mosq.h"
@@ -56,6 +65,9 @@ Contributors:
 #include "time_mosq.h"
 #include "util_mosq.h"
 
+/* Most clients on the ready list written together by db__message_write_many(). */
+#define LOOP_WRITE_BATCH 64
+
 extern bool flag_reload;
 #ifdef WITH_PERSISTENCE
 extern bool flag_db_backup;
@@ -63,7 +75,7 @@ extern bool flag_db_backup;
 extern bool flag_tree_print;
 extern int run;
 
-#ifdef WITH_EPOLL
+#if defined(WITH_EPOLL) || defined(WITH_IO_URING)
 static void loop_handle_reads_writes(struct mosquitto_db *db, mosq_sock_t sock, uint32_t events);
 #else
 static void loop_handle_reads_writes(struct mosquitto_db *db, struct pollfd *pollfds);
@@ -99,17 +111,241 @@ static void temp__expire_websockets_clients(struct mosquitto_db *db)
 }
 #endif
 
+#ifdef WITH_EPOLL
+/* Only touch the epoll registration when EPOLLOUT is actually changing. */
+static void loop__update_epollout(struct mosquitto_db *db, struct mosquitto *context)
+{
+	struct epoll_event ev;
+	uint32_t events = EPOLLIN;
+
+	if(context->current_out_packet || context->state == mosq_cs_connect_pending || context->ws_want_write){
+		events |= EPOLLOUT;
+		context->ws_want_write = false;
+	}
+	if(events == context->events){
+		return;
+	}
+
+	memset(&ev, 0, sizeof(struct epoll_event));
+	ev.data.fd = context->sock;
+	ev.events = events;
+	if(epoll_ctl(db->epollfd, EPOLL_CTL_MOD, context->sock, &ev) == -1){
+		if((errno != ENOENT)||(epoll_ctl(db->epollfd, EPOLL_CTL_ADD, context->sock, &ev) == -1)){
+			log__printf(NULL, MOSQ_LOG_DEBUG, "Error in epoll re-registering: %s", strerror(errno));
+		}
+	}
+	context->events = events;
+}
+#endif
+
+#ifdef WITH_IO_URING
+/* POLLOUT is asked for one completion at a time, only while there is
+ * something waiting to go out. */
+static void loop__update_pollout(struct mosquitto_db *db, struct mosquitto *context)
+{
+	if(context->current_out_packet || context->state == mosq_cs_connect_pending || context->ws_want_write){
+		context->ws_want_write = false;
+		uring__poll_out(db, context);
+	}
+}
+#endif
+
+/* Write out what has been queued for each client on the ready list. Clients
+ * that have nothing new to send aren't looked at. They are taken a batch at a
+ * time, so that a message going out to many of them is encrypted for all of
+ * them together. */
+static void loop__process_ready(struct mosquitto_db *db, int *poll_timeout)
+{
+	struct mosquitto *work, *context;
+	struct mosquitto *batch[LOOP_WRITE_BATCH];
+	struct mosquitto *writable[LOOP_WRITE_BATCH];
+	int results[LOOP_WRITE_BATCH];
+	bool again[LOOP_WRITE_BATCH];
+	int count, writable_count;
+	int i, j;
+
+	/* Detach the list first. Anything marked ready while this runs is
+	 * looked at on the next pass. */
+	work = db->ready_contexts;
+	db->ready_contexts = NULL;
+	if(work){
+		work->ready_pprev = &work;
+	}
+	while(work){
+		count = 0;
+		writable_count = 0;
+		for(context=work; context && count < LOOP_WRITE_BATCH; context=context->ready_next){
+			batch[count] = context;
+			again[count] = false;
+			count++;
+			if(context->sock == INVALID_SOCKET){
+				continue;
+			}
+			if(context->retain_pending){
+				if(sub__retain_pending_write(db, context) == -1){
+					again[count-1] = true;
+				}
+			}
+			writable[writable_count++] = context;
+		}
+		db__message_write_many(db, writable, results, writable_count);
+
+		for(i=0, j=0; i<count; i++){
+			context = batch[i];
+			if(j < writable_count && writable[j] == context){
+				if(results[j++] == MOSQ_ERR_SUCCESS){
+					if(context->state == mosq_cs_connected && context->inflight_send_msg){
+						/* Messages moved from the queue into flight can be
+						 * sent straight away. */
+						again[i] = true;
+					}
+#ifdef WITH_EPOLL
+					loop__update_epollout(db, context);
+#elif defined(WITH_IO_URING)
+					loop__update_pollout(db, context);
+#endif
+				}else{
+					do_disconnect(db, context);
+					again[i] = false;
+				}
+			}
+			/* Removed only now, so that anything queued for this client
+			 * while it was being written doesn't put it straight back on the
+			 * list. */
+			context__remove_from_ready(db, context);
+			if(again[i]){
+				context__add_to_ready(db, context);
+				*poll_timeout = 0;
+			}
+		}
+	}
+}
+
+/* Stop watching listeners whose accept_rate token bucket has run dry, and
+ * watch them again once it has refilled. Connections arriving meanwhile wait
+ * in the kernel backlog rather than waking the main loop. */
+static void loop__admission(struct mosquitto_db *db)
+{
+	struct mosquitto__listener *listener;
+	time_t now = mosquitto_time();
+	bool ready;
+	int i;
+#ifdef WITH_EPOLL
+	struct epoll_event ev;
+	int j;
+#endif
+
+	for(i=0; i<db->config->listener_count; i++){
+		listener = &db->config->listeners[i];
+		if(listener->accept_rate == 0){
+			continue;
+		}
+		ready = net__listener_ready(listener, now);
+		if(ready != listener->accept_paused){
+			continue;
+		}
+		listener->accept_paused = !ready;
+		if(listener->accept_paused){
+			G_ACCEPT_THROTTLED_INC();
+		}
+#ifdef WITH_EPOLL
+		memset(&ev, 0, sizeof(struct epoll_event));
+		ev.events = listener->accept_paused ? 0 : EPOLLIN;
+		for(j=0; j<listener->sock_count; j++){
+			ev.data.fd = listener->socks[j];
+			if(epoll_ctl(db->epollfd, EPOLL_CTL_MOD, listener->socks[j], &ev) == -1){
+				log__printf(NULL, MOSQ_LOG_DEBUG, "Error in epoll re-registering listener: %s", strerror(errno));
+			}
+		}
+#endif
+		/* poll() builds its list every pass, and io_uring just doesn't accept
+		 * from a paused listener, so neither have anything to do here. */
+	}
+}
+
+
+/* Accept connections waiting on listensock, as many as are left in the
+ * budget for this pass of the main loop and the listener's token bucket
+ * allows. Returns true if the backlog was emptied. */
+static bool loop__accept(struct mosquitto_db *db, mosq_sock_t listensock, int *budget)
+{
+	struct mosquitto__listener *listener;
+	mosq_sock_t new_sock;
+#if defined(WITH_EPOLL) || defined(WITH_IO_URING)
+	struct mosquitto *context;
+#endif
+#ifdef WITH_EPOLL
+	struct epoll_event ev;
+#endif
+
+	listener = net__listener_get(db, listensock);
+	while(*budget > 0){
+		if(listener && !net__listener_ready(listener, mosquitto_time())){
+			return false;
+		}
+		new_sock = net__socket_accept(db, listensock);
+		if(new_sock == -1){
+			return true;
+		}
+		(*budget)--;
+#if defined(WITH_EPOLL) || defined(WITH_IO_URING)
+		context = NULL;
+		HASH_FIND(hh_sock, db->contexts_by_sock, &new_sock, sizeof(mosq_sock_t), context);
+		if(!context){
+			log__printf(NULL, MOSQ_LOG_ERR, "Error in accepting: no context");
+			continue;
+		}
+#endif
+#ifdef WITH_EPOLL
+		memset(&ev, 0, sizeof(struct epoll_event));
+		ev.data.fd = new_sock;
+		ev.events = EPOLLIN;
+		if(epoll_ctl(db->epollfd, EPOLL_CTL_ADD, new_sock, &ev) == -1){
+			log__printf(NULL, MOSQ_LOG_ERR, "Error in epoll accepting: %s", strerror(errno));
+		}
+		context->events = EPOLLIN;
+#elif defined(WITH_IO_URING)
+		uring__add(db, context);
+#endif
+	}
+	return false;
+}
+
+#ifdef WITH_SYS_TREE
+static void loop__sys_tree_update(struct mosquitto_db *db, struct mosquitto__timer *timer)
+{
+	if(db->config->sys_interval > 0){
+		sys_tree__update(db, db->config->sys_interval, *(time_t *)timer->userdata);
+	}
+	timer__add(db, timer, mosquitto_time()+1);
+}
+#endif
+
+#ifdef WITH_WEEVE_SMP
+/* A ticket is accepted under the current and the previous key, so rotating
+ * every lifetime never cuts a ticket short and drops it within two. */
+static void loop__smp_ticket_rotate(struct mosquitto_db *db, struct mosquitto__timer *timer)
+{
+	if(wclSmpRotateTicketKey(NULL, (uint32_t)db->config->smp_ticket_lifetime) != WCL_SUCCESS){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Unable to rotate the SMP ticket key.");
+	}
+	timer__add(db, timer, mosquitto_time()+db->config->smp_ticket_lifetime);
+}
+#endif
+
 int mosquitto_main_loop(struct mosquitto_db *db, mosq_sock_t *listensock, int listensock_count, int listener_max)
 {
 #ifdef WITH_SYS_TREE
 	time_t start_time = mosquitto_time();
+	struct mosquitto__timer sys_tree_timer;
+#endif
+#ifdef WITH_WEEVE_SMP
+	struct mosquitto__timer smp_ticket_timer;
 #endif
 #ifdef WITH_PERSISTENCE
 	time_t last_backup = mosquitto_time();
 #endif
-	time_t now = 0;
 	time_t now_time;
-	int time_count;
 	int fdcount;
 	struct mosquitto *context, *ctxt_tmp;
 #ifndef WIN32
@@ -119,18 +355,23 @@ int mosquitto_main_loop(struct mosquitto_db *db, mosq_sock_t *listensock, int li
 #ifdef WITH_EPOLL
 	int j;
 	struct epoll_event ev, events[MAX_EVENTS];
-#else
+#elif !defined(WITH_IO_URING)
 	struct pollfd *pollfds = NULL;
 	int pollfd_index;
 	int pollfd_max;
+	struct mosquitto__listener *listener;
 #endif
 #ifdef WITH_BRIDGE
 	int rc;
+	time_t now = 0;
+	int time_count;
+	int err;
+	socklen_t len;
 #endif
 	time_t expiration_check_time = 0;
+	int poll_timeout;
+	int accept_budget = -1;
 	char *id;
-	int err;
-	socklen_t len;
 
 #ifndef WIN32
 	sigemptyset(&sigblock);
@@ -141,7 +382,7 @@ int mosquitto_main_loop(struct mosquitto_db *db, mosq_sock_t *listensock, int li
 	sigaddset(&sigblock, SIGHUP);
 #endif
 
-#ifndef WITH_EPOLL
+#if !defined(WITH_EPOLL) && !defined(WITH_IO_URING)
 #ifdef WIN32
 	pollfd_max = _getmaxstdio();
 #else
@@ -192,145 +433,159 @@ int mosquitto_main_loop(struct mosquitto_db *db, mosq_sock_t *listensock, int li
 		}
 	}
 #endif
+#ifdef WITH_WEEVE_SMP
+	if(smp_async__wake_sock(db) != INVALID_SOCKET){
+		/* Not a client, so its events are only a wake up. */
+		ev.data.fd = smp_async__wake_sock(db);
+		ev.events = EPOLLIN;
+		if (epoll_ctl(db->epollfd, EPOLL_CTL_ADD, ev.data.fd, &ev) == -1) {
+			log__printf(NULL, MOSQ_LOG_ERR, "Error in epoll initial registering SMP workers: %s", strerror(errno));
+			(void)close(db->epollfd);
+			db->epollfd = 0;
+			return MOSQ_ERR_UNKNOWN;
+		}
+	}
+#endif
+#endif
+#ifdef WITH_IO_URING
+	if(uring__init(db, listensock, listensock_count)){
+		return MOSQ_ERR_UNKNOWN;
+	}
+#ifdef WITH_BRIDGE
+	HASH_ITER(hh_sock, db->contexts_by_sock, context, ctxt_tmp){
+		if(context->bridge){
+			uring__add(db, context);
+		}
+	}
+#endif
 #endif
 
-	while(run){
-		context__free_disused(db);
 #ifdef WITH_SYS_TREE
-		if(db->config->sys_interval > 0){
-			sys_tree__update(db, db->config->sys_interval, start_time);
-		}
+	memset(&sys_tree_timer, 0, sizeof(struct mosquitto__timer));
+	sys_tree_timer.callback = loop__sys_tree_update;
+	sys_tree_timer.userdata = &start_time;
+	loop__sys_tree_update(db, &sys_tree_timer);
 #endif
+#ifdef WITH_WEEVE_SMP
+	memset(&smp_ticket_timer, 0, sizeof(struct mosquitto__timer));
+	smp_ticket_timer.callback = loop__smp_ticket_rotate;
+	if(wclSmpSetEarlyDataWindow((uint32_t)db->config->smp_early_data_window, (uint32_t)db->config->smp_early_data_max_connects) != WCL_SUCCESS){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Unable to set the SMP early data window.");
+	}
+	if(db->config->smp_ticket_lifetime > 0){
+		loop__smp_ticket_rotate(db, &smp_ticket_timer);
+	}
+#endif
+
+	while(run){
+		context__free_disused(db);
+		/* Client keepalive expiry and $SYS updates. Only timers that are due
+		 * cost anything here, however many clients are connected. */
+		timer__run(db, mosquitto_time());
+		loop__admission(db);
 
-#ifndef WITH_EPOLL
+#if !defined(WITH_EPOLL) && !defined(WITH_IO_URING)
 		memset(pollfds, -1, sizeof(struct pollfd)*pollfd_max);
 
 		pollfd_index = 0;
 		for(i=0; i<listensock_count; i++){
+			listener = net__listener_get(db, listensock[i]);
 			pollfds[pollfd_index].fd = listensock[i];
+			pollfds[pollfd_index].events = (listener && listener->accept_paused) ? 0 : POLLIN;
+			pollfds[pollfd_index].revents = 0;
+			pollfd_index++;
+		}
+#ifdef WITH_WEEVE_SMP
+		if(smp_async__wake_sock(db) != INVALID_SOCKET){
+			pollfds[pollfd_index].fd = smp_async__wake_sock(db);
 			pollfds[pollfd_index].events = POLLIN;
 			pollfds[pollfd_index].revents = 0;
 			pollfd_index++;
 		}
 #endif
+#elif defined(WITH_IO_URING) && defined(WITH_WEEVE_SMP)
+		if(smp_async__wake_sock(db) != INVALID_SOCKET){
+			uring__wake_arm(db, smp_async__wake_sock(db));
+		}
+#endif
 
 		now_time = time(NULL);
 
-		time_count = 0;
-		HASH_ITER(hh_sock, db->contexts_by_sock, context, ctxt_tmp){
-			if(time_count > 0){
-				time_count--;
-			}else{
-				time_count = 1000;
-				now = mosquitto_time();
-			}
-			context->pollfd_index = -1;
-
-			if(context->sock != INVALID_SOCKET){
 #ifdef WITH_BRIDGE
-				if(context->bridge){
-					mosquitto__check_keepalive(db, context);
-					if(context->bridge->round_robin == false
-							&& context->bridge->cur_address != 0
-							&& context->bridge->primary_retry
-							&& now > context->bridge->primary_retry){
-
-						if(context->bridge->primary_retry_sock == INVALID_SOCKET){
-							rc = net__try_connect(context, context->bridge->addresses[0].address,
-									context->bridge->addresses[0].port,
-									&context->bridge->primary_retry_sock, NULL, false);
-
-							if(rc == 0){
-								COMPAT_CLOSE(context->bridge->primary_retry_sock);
-								context->bridge->primary_retry_sock = INVALID_SOCKET;
-								context->bridge->primary_retry = 0;
-								net__socket_close(db, context);
-								context->bridge->cur_address = 0;
-							}
-						}else{
-							len = sizeof(int);
-							if(!getsockopt(context->bridge->primary_retry_sock, SOL_SOCKET, SO_ERROR, (char *)&err, &len)){
-								if(err == 0){
-									COMPAT_CLOSE(context->bridge->primary_retry_sock);
-									context->bridge->primary_retry_sock = INVALID_SOCKET;
-									context->bridge->primary_retry = 0;
-									net__socket_close(db, context);
-									context->bridge->cur_address = context->bridge->address_count-1;
-								}else{
-									COMPAT_CLOSE(context->bridge->primary_retry_sock);
-									context->bridge->primary_retry_sock = INVALID_SOCKET;
-									context->bridge->primary_retry = now+5;
-								}
-							}else{
-								COMPAT_CLOSE(context->bridge->primary_retry_sock);
-								context->bridge->primary_retry_sock = INVALID_SOCKET;
-								context->bridge->primary_retry = now+5;
-							}
-						}
-					}
-				}
-#endif
+		/* Connected bridges. Incoming clients have nothing to check here,
+		 * their keepalive is handled by the timer wheel. */
+		now = mosquitto_time();
+		for(i=0; i<db->bridge_count; i++){
+			if(!db->bridges[i]) continue;
 
-				/* Local bridges never time out in this fashion. */
-				if(!(context->keepalive)
-						|| context->bridge
-						|| now - context->last_msg_in <= (time_t)(context->keepalive)*3/2){
+			context = db->bridges[i];
+			if(context->sock == INVALID_SOCKET) continue;
 
-					if(db__message_write(db, context) == MOSQ_ERR_SUCCESS){
-#ifdef WITH_EPOLL
-						if(context->current_out_packet || context->state == mosq_cs_connect_pending || context->ws_want_write){
-							if(!(context->events & EPOLLOUT)) {
-								ev.data.fd = context->sock;
-								ev.events = EPOLLIN | EPOLLOUT;
-								if(epoll_ctl(db->epollfd, EPOLL_CTL_ADD, context->sock, &ev) == -1) {
-									if((errno != EEXIST)||(epoll_ctl(db->epollfd, EPOLL_CTL_MOD, context->sock, &ev) == -1)) {
-											log__printf(NULL, MOSQ_LOG_DEBUG, "Error in epoll re-registering to EPOLLOUT: %s", strerror(errno));
-									}
-								}
-								context->events = EPOLLIN | EPOLLOUT;
-							}
-							context->ws_want_write = false;
-						}
-						else{
-							if(context->events & EPOLLOUT) {
-								ev.data.fd = context->sock;
-								ev.events = EPOLLIN;
-								if(epoll_ctl(db->epollfd, EPOLL_CTL_ADD, context->sock, &ev) == -1) {
-									if((errno != EEXIST)||(epoll_ctl(db->epollfd, EPOLL_CTL_MOD, context->sock, &ev) == -1)) {
-											log__printf(NULL, MOSQ_LOG_DEBUG, "Error in epoll re-registering to EPOLLIN: %s", strerror(errno));
-									}
-								}
-								context->events = EPOLLIN;
-							}
-						}
-#else
-						pollfds[pollfd_index].fd = context->sock;
-						pollfds[pollfd_index].events = POLLIN;
-						pollfds[pollfd_index].revents = 0;
-						if(context->current_out_packet || context->state == mosq_cs_connect_pending || context->ws_want_write){
-							pollfds[pollfd_index].events |= POLLOUT;
-							context->ws_want_write = false;
-						}
-						context->pollfd_index = pollfd_index;
-						pollfd_index++;
-#endif
-					}else{
-						do_disconnect(db, context);
+			mosquitto__check_keepalive(db, context);
+			if(context->bridge->round_robin == false
+					&& context->bridge->cur_address != 0
+					&& context->bridge->primary_retry
+					&& now > context->bridge->primary_retry){
+
+				if(context->bridge->primary_retry_sock == INVALID_SOCKET){
+					rc = net__try_connect(context, context->bridge->addresses[0].address,
+							context->bridge->addresses[0].port,
+							&context->bridge->primary_retry_sock, NULL, false);
+
+					if(rc == 0){
+						COMPAT_CLOSE(context->bridge->primary_retry_sock);
+						context->bridge->primary_retry_sock = INVALID_SOCKET;
+						context->bridge->primary_retry = 0;
+						net__socket_close(db, context);
+						context->bridge->cur_address = 0;
 					}
 				}else{
-					if(db->config->connection_messages == true){
-						if(context->id){
-							id = context->id;
+					len = sizeof(int);
+					if(!getsockopt(context->bridge->primary_retry_sock, SOL_SOCKET, SO_ERROR, (char *)&err, &len)){
+						if(err == 0){
+							COMPAT_CLOSE(context->bridge->primary_retry_sock);
+							context->bridge->primary_retry_sock = INVALID_SOCKET;
+							context->bridge->primary_retry = 0;
+							net__socket_close(db, context);
+							context->bridge->cur_address = context->bridge->address_count-1;
 						}else{
-							id = "<unknown>";
+							COMPAT_CLOSE(context->bridge->primary_retry_sock);
+							context->bridge->primary_retry_sock = INVALID_SOCKET;
+							context->bridge->primary_retry = now+5;
 						}
-						log__printf(NULL, MOSQ_LOG_NOTICE, "Client %s has exceeded timeout, disconnecting.", id);
+					}else{
+						COMPAT_CLOSE(context->bridge->primary_retry_sock);
+						context->bridge->primary_retry_sock = INVALID_SOCKET;
+						context->bridge->primary_retry = now+5;
 					}
-					/* Client has exceeded keepalive*1.5 */
-					do_disconnect(db, context);
 				}
 			}
 		}
+#endif
+
+		/* Don't sleep in poll if a client has more that can be sent
+		 * straight away, such as retained messages still waiting to be
+		 * delivered. */
+		poll_timeout = 100;
+		loop__process_ready(db, &poll_timeout);
+
+#if !defined(WITH_EPOLL) && !defined(WITH_IO_URING)
+		HASH_ITER(hh_sock, db->contexts_by_sock, context, ctxt_tmp){
+			context->pollfd_index = -1;
+
+			if(context->sock != INVALID_SOCKET){
+				pollfds[pollfd_index].fd = context->sock;
+				pollfds[pollfd_index].events = POLLIN;
+				pollfds[pollfd_index].revents = 0;
+				if(context->current_out_packet || context->state == mosq_cs_connect_pending || context->ws_want_write){
+					pollfds[pollfd_index].events |= POLLOUT;
+					context->ws_want_write = false;
+				}
+				context->pollfd_index = pollfd_index;
+				pollfd_index++;
+			}
+		}
+#endif
 
 #ifdef WITH_BRIDGE
 		time_count = 0;
@@ -379,6 +634,9 @@ int mosquitto_main_loop(struct mosquitto_db *db, mosq_sock_t *listensock, int li
 									}else{
 										context->events = ev.events;
 									}
+#elif defined(WITH_IO_URING)
+									uring__add(db, context);
+									loop__update_pollout(db, context);
 #else
 									pollfds[pollfd_index].fd = context->sock;
 									pollfds[pollfd_index].events = POLLIN;
@@ -440,6 +698,9 @@ int mosquitto_main_loop(struct mosquitto_db *db, mosq_sock_t *listensock, int li
 								}else{
 									context->events = ev.events;
 								}
+#elif defined(WITH_IO_URING)
+								uring__add(db, context);
+								loop__update_pollout(db, context);
 #else
 								pollfds[pollfd_index].fd = context->sock;
 								pollfds[pollfd_index].events = POLLIN;
@@ -480,6 +741,9 @@ int mosquitto_main_loop(struct mosquitto_db *db, mosq_sock_t *listensock, int li
 						}
 						log__printf(NULL, MOSQ_LOG_NOTICE, "Expiring persistent client %s due to timeout.", id);
 						G_CLIENTS_EXPIRED_INC();
+#ifdef WITH_PERSISTENCE
+						persist__log_client_delete(db, context->id);
+#endif
 						context->clean_session = true;
 						context->state = mosq_cs_expiring;
 						do_disconnect(db, context);
@@ -489,16 +753,29 @@ int mosquitto_main_loop(struct mosquitto_db *db, mosq_sock_t *listensock, int li
 			expiration_check_time = time(NULL) + 3600;
 		}
 
+		if(db->ready_contexts){
+			/* Something, such as a bridge that has just started connecting,
+			 * was marked ready after the list was processed. */
+			poll_timeout = 0;
+		}
+		if(accept_budget == 0){
+			/* Connections were left waiting last time round. */
+			poll_timeout = 0;
+		}
+		accept_budget = db->config->accept_budget ? db->config->accept_budget : INT_MAX;
 #ifndef WIN32
 		sigprocmask(SIG_SETMASK, &sigblock, &origsig);
 #ifdef WITH_EPOLL
-		fdcount = epoll_wait(db->epollfd, events, MAX_EVENTS, 100);
+		fdcount = epoll_wait(db->epollfd, events, MAX_EVENTS, poll_timeout);
+#elif defined(WITH_IO_URING)
+		/* Also submits everything queued since the last pass. */
+		fdcount = uring__wait(db, poll_timeout, loop_handle_reads_writes);
 #else
-		fdcount = poll(pollfds, pollfd_index, 100);
+		fdcount = poll(pollfds, pollfd_index, poll_timeout);
 #endif
 		sigprocmask(SIG_SETMASK, &origsig, NULL);
 #else
-		fdcount = WSAPoll(pollfds, pollfd_index, 100);
+		fdcount = WSAPoll(pollfds, pollfd_index, poll_timeout);
 #endif
 #ifdef WITH_EPOLL
 		switch(fdcount){
@@ -510,23 +787,10 @@ int mosquitto_main_loop(struct mosquitto_db *db, mosq_sock_t *listensock, int li
 		case 0:
 			break;
 		default:
+			/* Connected clients first, new connections get what time is left. */
 			for(i=0; i<fdcount; i++){
 				for(j=0; j<listensock_count; j++){
 					if (events[i].data.fd == listensock[j]) {
-						if (events[i].events & (EPOLLIN | EPOLLPRI)){
-							while((ev.data.fd = net__socket_accept(db, listensock[j])) != -1){
-								ev.events = EPOLLIN;
-								if (epoll_ctl(db->epollfd, EPOLL_CTL_ADD, ev.data.fd, &ev) == -1) {
-									log__printf(NULL, MOSQ_LOG_ERR, "Error in epoll accepting: %s", strerror(errno));
-								}
-								context = NULL;
-								HASH_FIND(hh_sock, db->contexts_by_sock, &(ev.data.fd), sizeof(mosq_sock_t), context);
-								if(!context) {
-									log__printf(NULL, MOSQ_LOG_ERR, "Error in epoll accepting: no context");
-								}
-								context->events = EPOLLIN;
-							}
-						}
 						break;
 					}
 				}
@@ -534,6 +798,28 @@ int mosquitto_main_loop(struct mosquitto_db *db, mosq_sock_t *listensock, int li
 					loop_handle_reads_writes(db, events[i].data.fd, events[i].events);
 				}
 			}
+			for(i=0; i<fdcount; i++){
+				for(j=0; j<listensock_count; j++){
+					if (events[i].data.fd == listensock[j]) {
+						if (events[i].events & (EPOLLIN | EPOLLPRI)){
+							loop__accept(db, listensock[j], &accept_budget);
+						}
+						break;
+					}
+				}
+			}
+		}
+#elif defined(WITH_IO_URING)
+		/* Completions for connected clients were handled while waiting. */
+		if(fdcount == -1 && errno != EINTR){
+			log__printf(NULL, MOSQ_LOG_ERR, "Error in io_uring waiting: %s.", strerror(errno));
+		}
+		for(i=0; i<listensock_count; i++){
+			if(uring__accept_pending(db, listensock[i])
+					&& loop__accept(db, listensock[i], &accept_budget)){
+
+				uring__accept_arm(db, listensock[i]);
+			}
 		}
 #else
 		if(fdcount == -1){
@@ -543,11 +829,16 @@ int mosquitto_main_loop(struct mosquitto_db *db, mosq_sock_t *listensock, int li
 
 			for(i=0; i<listensock_count; i++){
 				if(pollfds[i].revents & (POLLIN | POLLPRI)){
-					while(net__socket_accept(db, listensock[i]) != -1){
-					}
+					loop__accept(db, listensock[i], &accept_budget);
 				}
 			}
 		}
+#endif
+		if(accept_budget == 0){
+			G_ACCEPT_BUDGET_EXHAUSTED_INC();
+		}
+#ifdef WITH_WEEVE_SMP
+		smp_async__handle_completions(db);
 #endif
 #ifdef WITH_PERSISTENCE
 		if(db->config->persistence && db->config->autosave_interval){
@@ -563,6 +854,11 @@ int mosquitto_main_loop(struct mosquitto_db *db, mosq_sock_t *listensock, int li
 				}
 			}
 		}
+		if(db->config->persistence){
+			/* Group commit: everything logged during this pass of the loop
+			 * is flushed with a single fsync. */
+			persist__log_sync(db);
+		}
 #endif
 
 #ifdef WITH_PERSISTENCE
@@ -601,9 +897,18 @@ int mosquitto_main_loop(struct mosquitto_db *db, mosq_sock_t *listensock, int li
 #endif
 	}
 
+#ifdef WITH_SYS_TREE
+	timer__remove(db, &sys_tree_timer);
+#endif
+#ifdef WITH_WEEVE_SMP
+	timer__remove(db, &smp_ticket_timer);
+	wclSmpRotateTicketKey(NULL, 0);
+#endif
 #ifdef WITH_EPOLL
 	(void) close(db->epollfd);
 	db->epollfd = 0;
+#elif defined(WITH_IO_URING)
+	uring__cleanup(db);
 #else
 	mosquitto__free(pollfds);
 #endif
@@ -676,20 +981,20 @@ void do_disconnect(struct mosquitto_db *db, struct mosquitto *context)
 }
 
 
-#ifdef WITH_EPOLL
+#if defined(WITH_EPOLL) || defined(WITH_IO_URING)
 static void loop_handle_reads_writes(struct mosquitto_db *db, mosq_sock_t sock, uint32_t events)
 #else
 static void loop_handle_reads_writes(struct mosquitto_db *db, struct pollfd *pollfds)
 #endif
 {
 	struct mosquitto *context;
-#ifndef WITH_EPOLL
+#if !defined(WITH_EPOLL) && !defined(WITH_IO_URING)
 	struct mosquitto *ctxt_tmp;
 #endif
 	int err;
 	socklen_t len;
 
-#ifdef WITH_EPOLL
+#if defined(WITH_EPOLL) || defined(WITH_IO_URING)
 	int i;
 	context = NULL;
 	HASH_FIND(hh_sock, db->contexts_by_sock, &sock, sizeof(mosq_sock_t), context);
@@ -709,7 +1014,7 @@ static void loop_handle_reads_writes(struct mosquitto_db *db, struct pollfd *pol
 #ifdef WITH_WEBSOCKETS
 		if(context->wsi){
 			struct lws_pollfd wspoll;
-#ifdef WITH_EPOLL
+#if defined(WITH_EPOLL) || defined(WITH_IO_URING)
 			wspoll.fd = context->sock;
 			wspoll.events = context->events;
 			wspoll.revents = events;
@@ -728,7 +1033,7 @@ static void loop_handle_reads_writes(struct mosquitto_db *db, struct pollfd *pol
 #endif
 
 #ifdef WITH_TLS
-#ifdef WITH_EPOLL
+#if defined(WITH_EPOLL) || defined(WITH_IO_URING)
 		if(events & EPOLLOUT ||
 #else
 		if(pollfds[context->pollfd_index].revents & POLLOUT ||
@@ -736,7 +1041,7 @@ static void loop_handle_reads_writes(struct mosquitto_db *db, struct pollfd *pol
 				context->want_write ||
 				(context->ssl && context->state == mosq_cs_new)){
 #else
-#ifdef WITH_EPOLL
+#if defined(WITH_EPOLL) || defined(WITH_IO_URING)
 		if(events & EPOLLOUT){
 #else			
 		if(pollfds[context->pollfd_index].revents & POLLOUT){
@@ -763,10 +1068,14 @@ static void loop_handle_reads_writes(struct mosquitto_db *db, struct pollfd *pol
 				do_disconnect(db, context);
 				continue;
 			}
+#if defined(WITH_EPOLL) || defined(WITH_IO_URING)
+			/* EPOLLOUT may no longer be needed. */
+			context__add_to_ready(db, context);
+#endif
 		}
 	}
 
-#ifdef WITH_EPOLL
+#if defined(WITH_EPOLL) || defined(WITH_IO_URING)
 	context = NULL;
 	HASH_FIND(hh_sock, db->contexts_by_sock, &sock, sizeof(mosq_sock_t), context);
 	if(!context) {
@@ -787,14 +1096,14 @@ static void loop_handle_reads_writes(struct mosquitto_db *db, struct pollfd *pol
 #endif
 
 #ifdef WITH_TLS
-#ifdef WITH_EPOLL
+#if defined(WITH_EPOLL) || defined(WITH_IO_URING)
 		if(events & EPOLLIN ||
 #else
 		if(pollfds[context->pollfd_index].revents & POLLIN ||
 #endif
 				(context->ssl && context->state == mosq_cs_new)){
 #else
-#ifdef WITH_EPOLL
+#if defined(WITH_EPOLL) || defined(WITH_IO_URING)
 		if(events & EPOLLIN){
 #else
 		if(pollfds[context->pollfd_index].revents & POLLIN){
@@ -802,15 +1111,22 @@ static void loop_handle_reads_writes(struct mosquitto_db *db, struct pollfd *pol
 #endif
 			do{
 				if(packet__read(db, context)){
+#ifdef WITH_WEEVE_SMP
+					smp_async__flush(db, context);
+#endif
 					do_disconnect(db, context);
 					continue;
 				}
-			}while(SSL_DATA_PENDING(context));
+			}while(SSL_DATA_PENDING(context) || NET_DATA_PENDING(context));
+			net__read_buffer_release(context);
 		}
-#ifdef WITH_EPOLL
+#if defined(WITH_EPOLL) || defined(WITH_IO_URING)
 		if(events & (EPOLLERR | EPOLLHUP)){
 #else
 		if(context->pollfd_index >= 0 && pollfds[context->pollfd_index].revents & (POLLERR | POLLNVAL | POLLHUP)){
+#endif
+#ifdef WITH_WEEVE_SMP
+			smp_async__flush(db, context);
 #endif
 			do_disconnect(db, context);
 			continue;
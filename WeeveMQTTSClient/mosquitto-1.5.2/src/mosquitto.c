@@ -363,6 +363,11 @@ int main(int argc, char *argv[])
 	CreateThread(NULL, 0, SigThreadProc, NULL, 0, NULL);
 #endif
 
+#if defined(WITH_WEEVE_SMP)
+	rc = smp_async__init(&int_db);
+	if(rc != MOSQ_ERR_SUCCESS) return rc;
+#endif
+
 #ifdef WITH_BRIDGE
 	for(i=0; i<config.bridge_count; i++){
 		if(bridge__new(&int_db, &(config.bridges[i]))){
@@ -444,6 +449,7 @@ int main(int argc, char *argv[])
 		remove(config.pid_file);
 	}
 #if defined(WITH_WEEVE_SMP)
+	smp_async__cleanup(&int_db);
     wclTerminate();
 #endif
 	config__cleanup(int_db.config);
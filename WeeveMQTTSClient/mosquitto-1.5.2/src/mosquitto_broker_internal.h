@@ -213,6 +213,11 @@ struct mosquitto__listener {
 	uint16_t port;
 	char *host;
 	int max_connections;
+	int accept_rate; /* New connections per second, 0 for no limit. */
+	int accept_burst;
+	int accept_tokens;
+	time_t accept_refill_t;
+	bool accept_paused; /* Token bucket empty, the listener isn't watched. */
 	char *mount_point;
 	mosq_sock_t *socks;
 	int sock_count;
@@ -244,6 +249,7 @@ struct mosquitto__listener {
 };
 
 struct mosquitto__config {
+	int accept_budget;
 	bool allow_duplicate_messages;
 	int autosave_interval;
 	bool autosave_on_changes;
@@ -264,11 +270,23 @@ struct mosquitto__config {
 	char *persistence_location;
 	char *persistence_file;
 	char *persistence_filepath;
+	bool persistence_log;
+	int persistence_log_sync_interval;
 	time_t persistent_client_expiration;
 	char *pid_file;
 	bool queue_qos0_messages;
+	unsigned long queue_spill_bytes;
+	char *queue_spill_location;
 	bool per_listener_settings;
+	int retained_batch_size;
 	bool set_tcp_nodelay;
+	int shared_sub_policy;
+	int smp_batch_max_bytes;
+	bool smp_compression;
+	int smp_early_data_max_connects;
+	int smp_early_data_window;
+	int smp_ticket_lifetime;
+	int smp_worker_threads;
 	int sys_interval;
 	bool upgrade_outgoing_qos;
 	char *user;
@@ -290,16 +308,55 @@ struct mosquitto__subleaf {
 	int qos;
 };
 
+/* A $share/<name>/<filter> group. Each message matching the filter goes to
+ * one member of the group instead of all of them. */
+struct mosquitto__subshared {
+	UT_hash_handle hh;
+	char *name;
+	struct mosquitto__subleaf *subs;
+	struct mosquitto__subleaf *next_leaf; /* Next member to try, NULL for the first. */
+	int count;
+};
+
 struct mosquitto__subhier {
 	UT_hash_handle hh;
 	struct mosquitto__subhier *parent;
 	struct mosquitto__subhier *children;
 	struct mosquitto__subleaf *subs;
+	struct mosquitto__subshared *shared;
 	struct mosquitto_msg_store *retained;
+	unsigned long retained_total; /* Retained messages at or below this node. */
 	mosquitto__topic_element_uhpa topic;
 	uint16_t topic_len;
 };
 
+/* Subscription filter a client's pending retained messages were found with,
+ * shared by all of them. */
+struct mosquitto__retain_filter {
+	char *sub;
+	int ref_count;
+};
+
+struct mosquitto__retain_pending {
+	struct mosquitto__retain_pending *next;
+	struct mosquitto_msg_store *store;
+	struct mosquitto__retain_filter *filter;
+	int qos;
+};
+
+/* Offline queue backlog that has been spilled to disk. Records are appended at
+ * write_pos and paged back in from read_pos, so they come back in the order
+ * they were queued. The counts are also included in the context totals. */
+struct mosquitto__spool{
+	int fd;
+	uint64_t read_pos;
+	uint64_t write_pos;
+	unsigned long msg_bytes;
+	unsigned long msg_bytes12;
+	int msg_count;
+	int msg_count12;
+};
+
 struct mosquitto_msg_store_load{
 	UT_hash_handle hh;
 	dbid_t db_id;
@@ -321,10 +378,12 @@ struct mosquitto_msg_store{
 	uint16_t mid;
 	uint8_t qos;
 	bool retain;
+	bool persist_logged; /* already written to the persistence log or snapshot */
 };
 
 struct mosquitto_client_msg{
 	struct mosquitto_client_msg *next;
+	struct mosquitto_client_msg *prev; /* In-flight list only. */
 	struct mosquitto_msg_store *store;
 	time_t timestamp;
 	uint16_t mid;
@@ -360,6 +419,16 @@ struct mosquitto__acl_user{
 	struct mosquitto__acl *acl;
 };
 
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SIZE (1<<TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+
+struct mosquitto__timer_wheel{
+	struct mosquitto__timer *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+	time_t now;
+	int count;
+};
+
 struct mosquitto_db{
 	dbid_t last_db_id;
 	struct mosquitto__subhier *subs;
@@ -388,10 +457,25 @@ struct mosquitto_db{
 	int retained_count;
 #endif
 	int persistence_changes;
+#ifdef WITH_PERSISTENCE
+	FILE *persist_log;
+	uint64_t persist_log_gen;
+	long persist_log_sync_t;
+	int persist_log_child;
+	bool persist_log_dirty;
+#endif
 	struct mosquitto *ll_for_free;
+	struct mosquitto *ready_contexts;
+	struct mosquitto__timer_wheel timers;
 #ifdef WITH_EPOLL
 	int epollfd;
 #endif
+#ifdef WITH_IO_URING
+	struct mosquitto__uring *uring;
+#endif
+#ifdef WITH_WEEVE_SMP
+	struct mosquitto__smp_async *smp_async; /* NULL unless smp_worker_threads is set. */
+#endif
 };
 
 enum mosquitto__bridge_direction{
@@ -400,6 +484,11 @@ enum mosquitto__bridge_direction{
 	bd_both = 2
 };
 
+enum mosquitto__shared_sub_policy{
+	ssp_round_robin = 0,
+	ssp_least_inflight = 1
+};
+
 enum mosquitto_bridge_start_type{
 	bst_automatic = 0,
 	bst_lazy = 1,
@@ -518,6 +607,10 @@ int send__suback(struct mosquitto *context, uint16_t mid, uint32_t payloadlen, c
 void net__broker_init(void);
 void net__broker_cleanup(void);
 int net__socket_accept(struct mosquitto_db *db, mosq_sock_t listensock);
+int net__socket_accepted(struct mosquitto_db *db, mosq_sock_t listensock, mosq_sock_t new_sock);
+struct mosquitto__listener *net__listener_get(struct mosquitto_db *db, mosq_sock_t listensock);
+/* Whether the listener's token bucket allows another connection now. */
+bool net__listener_ready(struct mosquitto__listener *listener, time_t now);
 int net__socket_listen(struct mosquitto__listener *listener);
 int net__socket_get_address(mosq_sock_t sock, char *buf, int len);
 
@@ -540,6 +633,16 @@ int db__close(struct mosquitto_db *db);
 #ifdef WITH_PERSISTENCE
 int persist__backup(struct mosquitto_db *db, bool shutdown);
 int persist__restore(struct mosquitto_db *db);
+int persist__log_open(struct mosquitto_db *db);
+int persist__log_sync(struct mosquitto_db *db);
+void persist__log_client(struct mosquitto_db *db, struct mosquitto *context);
+void persist__log_client_delete(struct mosquitto_db *db, const char *client_id);
+void persist__log_client_msg(struct mosquitto_db *db, struct mosquitto *context, struct mosquitto_client_msg *cmsg);
+void persist__log_client_msg_update(struct mosquitto_db *db, struct mosquitto *context, uint16_t mid, enum mosquitto_msg_direction dir, enum mosquitto_msg_state state);
+void persist__log_client_msg_delete(struct mosquitto_db *db, struct mosquitto *context, uint16_t mid, enum mosquitto_msg_direction dir);
+void persist__log_sub(struct mosquitto_db *db, struct mosquitto *context, const char *topic, int qos);
+void persist__log_sub_delete(struct mosquitto_db *db, struct mosquitto *context, const char *topic);
+void persist__log_retain(struct mosquitto_db *db, struct mosquitto_msg_store *stored);
 #endif
 void db__limits_set(int inflight, unsigned long inflight_bytes, int queued, unsigned long queued_bytes);
 /* Return the number of in-flight messages in count. */
@@ -549,7 +652,14 @@ int db__message_insert(struct mosquitto_db *db, struct mosquitto *context, uint1
 int db__message_release(struct mosquitto_db *db, struct mosquitto *context, uint16_t mid, enum mosquitto_msg_direction dir);
 int db__message_update(struct mosquitto *context, uint16_t mid, enum mosquitto_msg_direction dir, enum mosquitto_msg_state state);
 int db__message_write(struct mosquitto_db *db, struct mosquitto *context);
+void db__message_write_many(struct mosquitto_db *db, struct mosquitto **contexts, int *results, int count);
 void db__message_dequeue_first(struct mosquitto *context);
+void db__inflight_append(struct mosquitto *context, struct mosquitto_client_msg *msg);
+void db__inflight_unlink(struct mosquitto *context, struct mosquitto_client_msg *msg);
+void db__msg_index_add(struct mosquitto *context, struct mosquitto_client_msg *msg);
+void db__msg_index_remove(struct mosquitto *context, struct mosquitto_client_msg *msg);
+struct mosquitto_client_msg *db__msg_index_find(struct mosquitto *context, uint16_t mid, enum mosquitto_msg_direction dir, bool include_queued);
+void db__msg_index_free(struct mosquitto *context);
 int db__messages_delete(struct mosquitto_db *db, struct mosquitto *context);
 int db__messages_easy_queue(struct mosquitto_db *db, struct mosquitto *context, const char *topic, int qos, uint32_t payloadlen, const void *payload, int retain);
 int db__message_store(struct mosquitto_db *db, const char *source, uint16_t source_mid, char *topic, int qos, uint32_t payloadlen, mosquitto__payload_uhpa *payload, int retain, struct mosquitto_msg_store **stored, dbid_t store_id);
@@ -563,6 +673,77 @@ void db__vacuum(void);
 void sys_tree__init(struct mosquitto_db *db);
 void sys_tree__update(struct mosquitto_db *db, int interval, time_t start_time);
 
+/* ============================================================
+ * Offline queue spool functions
+ * ============================================================ */
+bool spool__wanted(struct mosquitto_db *db, struct mosquitto *context, enum mosquitto_msg_direction dir, enum mosquitto_msg_state state, uint32_t payloadlen);
+int spool__message_add(struct mosquitto_db *db, struct mosquitto *context, struct mosquitto_client_msg *msg);
+int spool__message_read(struct mosquitto__spool *spool, uint64_t *pos, struct mosquitto_msg_store **stored, struct mosquitto_client_msg *msg);
+void spool__msg_store_free(struct mosquitto_msg_store *stored);
+int spool__page_in(struct mosquitto_db *db, struct mosquitto *context);
+int spool__trim(struct mosquitto_db *db, struct mosquitto *context);
+void spool__free(struct mosquitto *context);
+
+/* ============================================================
+ * Timer functions
+ * ============================================================ */
+void timer__init(struct mosquitto_db *db);
+/* Schedule (or reschedule) timer to fire at the given mosquitto_time(). */
+void timer__add(struct mosquitto_db *db, struct mosquitto__timer *timer, time_t expires);
+void timer__remove(struct mosquitto_db *db, struct mosquitto__timer *timer);
+/* Fire every timer due up to and including now. */
+void timer__run(struct mosquitto_db *db, time_t now);
+
+/* ============================================================
+ * io_uring reactor functions
+ * ============================================================ */
+#ifdef WITH_IO_URING
+typedef void (*uring__handler)(struct mosquitto_db *db, mosq_sock_t sock, uint32_t events);
+
+int uring__init(struct mosquitto_db *db, mosq_sock_t *listensock, int listensock_count);
+void uring__cleanup(struct mosquitto_db *db);
+/* Start watching a connected socket for input. */
+void uring__add(struct mosquitto_db *db, struct mosquitto *context);
+/* Ask for a single POLLOUT completion, if one isn't already pending. */
+void uring__poll_out(struct mosquitto_db *db, struct mosquitto *context);
+/* Cancel everything outstanding on the socket. Must be done before it is
+ * closed, the ring holds its own reference to the socket until then. */
+void uring__remove(struct mosquitto_db *db, struct mosquitto *context);
+/* Whether the listening socket has reported connections that haven't all been
+ * accepted yet. */
+bool uring__accept_pending(struct mosquitto_db *db, mosq_sock_t listensock);
+/* Watch the listening socket again once its backlog has been drained. */
+void uring__accept_arm(struct mosquitto_db *db, mosq_sock_t listensock);
+/* Watch sock so that a wait ends once it is readable. Once that has happened
+ * it is watched again by the next call. */
+void uring__wake_arm(struct mosquitto_db *db, mosq_sock_t sock);
+/* Submit what is queued, wait up to timeout ms and pass every completion to
+ * handler. Returns the number of completions, or -1 on error. */
+int uring__wait(struct mosquitto_db *db, int timeout, uring__handler handler);
+#endif
+
+/* ============================================================
+ * SMP worker functions
+ * ============================================================ */
+#ifdef WITH_WEEVE_SMP
+/* Start the SMP worker threads if smp_worker_threads is set. */
+int smp_async__init(struct mosquitto_db *db);
+/* Stop the workers, once every client has closed its SMP session. */
+void smp_async__cleanup(struct mosquitto_db *db);
+/* Readable when completions are waiting, INVALID_SOCKET without workers. */
+mosq_sock_t smp_async__wake_sock(struct mosquitto_db *db);
+/* Have a received SMP message processed by the workers, taking smp_message
+ * over. */
+int smp_async__queue(struct mosquitto_db *db, struct mosquitto *context, uint8_t *smp_message, uint32_t length);
+/* Hand the MQTT packets of the processed messages to the broker. */
+void smp_async__handle_completions(struct mosquitto_db *db);
+/* Wait for and hand over the messages a client sent before it went. */
+void smp_async__flush(struct mosquitto_db *db, struct mosquitto *context);
+/* Drop the messages a client has waiting, wait for those the workers are
+ * busy with, then close its SMP session. */
+void smp_async__close_session(struct mosquitto_db *db, struct mosquitto *context);
+#endif
+
 /* ============================================================
  * Subscription functions
  * ============================================================ */
@@ -572,6 +753,9 @@ int sub__remove(struct mosquitto_db *db, struct mosquitto *context, const char *
 void sub__tree_print(struct mosquitto__subhier *root, int level);
 int sub__clean_session(struct mosquitto_db *db, struct mosquitto *context);
 int sub__retain_queue(struct mosquitto_db *db, struct mosquitto *context, const char *sub, int sub_qos);
+int sub__retain_pending_write(struct mosquitto_db *db, struct mosquitto *context);
+void sub__retain_pending_free(struct mosquitto_db *db, struct mosquitto *context);
+void sub__retain_pending_remove(struct mosquitto_db *db, struct mosquitto *context, const char *sub);
 int sub__messages_queue(struct mosquitto_db *db, const char *source_id, const char *topic, int qos, int retain, struct mosquitto_msg_store **stored);
 
 /* ============================================================
@@ -582,7 +766,13 @@ void context__cleanup(struct mosquitto_db *db, struct mosquitto *context, bool d
 void context__disconnect(struct mosquitto_db *db, struct mosquitto *context);
 void context__add_to_disused(struct mosquitto_db *db, struct mosquitto *context);
 void context__free_disused(struct mosquitto_db *db);
+/* Have the main loop look at this client's outgoing messages and EPOLLOUT
+ * state on its next pass. */
+void context__add_to_ready(struct mosquitto_db *db, struct mosquitto *context);
+void context__remove_from_ready(struct mosquitto_db *db, struct mosquitto *context);
 void context__send_will(struct mosquitto_db *db, struct mosquitto *context);
+/* (Re)start the keepalive timer from last_msg_in and the current keepalive. */
+void context__keepalive_arm(struct mosquitto_db *db, struct mosquitto *context);
 
 /* ============================================================
  * Logging functions
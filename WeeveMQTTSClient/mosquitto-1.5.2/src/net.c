@@ -16,6 +16,10 @@ Contributors:
 
 #include "config.h"
 
+#ifndef WIN32
+#  define _GNU_SOURCE
+#endif
+
 #ifndef WIN32
 #include <netdb.h>
 #include <unistd.h>
@@ -100,22 +104,14 @@ static void net__print_error(int log, const char *format_str)
 
 int net__socket_accept(struct mosquitto_db *db, mosq_sock_t listensock)
 {
-	int i;
-	int j;
 	mosq_sock_t new_sock = INVALID_SOCKET;
-	struct mosquitto *new_context;
-#ifdef WITH_TLS
-	BIO *bio;
-	int rc;
-	char ebuf[256];
-	unsigned long e;
-#endif
-#ifdef WITH_WRAP
-	struct request_info wrap_req;
-	char address[1024];
-#endif
 
+#ifdef __linux__
+	/* Saves the fcntl() calls of net__socket_nonblock() on every connection. */
+	new_sock = accept4(listensock, NULL, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
 	new_sock = accept(listensock, NULL, 0);
+#endif
 	if(new_sock == INVALID_SOCKET){
 #ifdef WIN32
 		errno = WSAGetLastError();
@@ -141,12 +137,79 @@ int net__socket_accept(struct mosquitto_db *db, mosq_sock_t listensock)
 		}
 		return -1;
 	}
-
-	G_SOCKET_CONNECTIONS_INC();
-
+#ifndef __linux__
 	if(net__socket_nonblock(&new_sock)){
 		return INVALID_SOCKET;
 	}
+#endif
+
+	return net__socket_accepted(db, listensock, new_sock);
+}
+
+
+struct mosquitto__listener *net__listener_get(struct mosquitto_db *db, mosq_sock_t listensock)
+{
+	int i, j;
+
+	for(i=0; i<db->config->listener_count; i++){
+		for(j=0; j<db->config->listeners[i].sock_count; j++){
+			if(db->config->listeners[i].socks[j] == listensock){
+				return &db->config->listeners[i];
+			}
+		}
+	}
+	return NULL;
+}
+
+
+/* Token bucket limiting how fast new connections are taken on. Each one means
+ * a context, and for TLS a handshake, before it has done anything useful, so
+ * a storm of reconnecting clients is let in at accept_rate per second rather
+ * than starving the clients already connected. */
+bool net__listener_ready(struct mosquitto__listener *listener, time_t now)
+{
+	time_t elapsed;
+
+	if(listener->accept_rate == 0) return true;
+
+	if(listener->accept_refill_t == 0){
+		listener->accept_tokens = listener->accept_burst;
+		listener->accept_refill_t = now;
+	}else if(now > listener->accept_refill_t){
+		elapsed = now - listener->accept_refill_t;
+		if(elapsed >= listener->accept_burst/listener->accept_rate + 1){
+			listener->accept_tokens = listener->accept_burst;
+		}else{
+			listener->accept_tokens += listener->accept_rate*elapsed;
+			if(listener->accept_tokens > listener->accept_burst){
+				listener->accept_tokens = listener->accept_burst;
+			}
+		}
+		listener->accept_refill_t = now;
+	}
+	return listener->accept_tokens > 0;
+}
+
+
+/* Set up a client context for a socket that has just been accepted on
+ * listensock. The socket must already be non-blocking. */
+int net__socket_accepted(struct mosquitto_db *db, mosq_sock_t listensock, mosq_sock_t new_sock)
+{
+	struct mosquitto *new_context;
+#ifdef WITH_TLS
+	int i;
+	int j;
+	BIO *bio;
+	int rc;
+	char ebuf[256];
+	unsigned long e;
+#endif
+#ifdef WITH_WRAP
+	struct request_info wrap_req;
+	char address[1024];
+#endif
+
+	G_SOCKET_CONNECTIONS_INC();
 
 #ifdef WITH_WRAP
 	/* Use tcpd / libwrap to determine whether a connection is allowed. */
@@ -174,19 +237,15 @@ int net__socket_accept(struct mosquitto_db *db, mosq_sock_t listensock)
 		COMPAT_CLOSE(new_sock);
 		return -1;
 	}
-	for(i=0; i<db->config->listener_count; i++){
-		for(j=0; j<db->config->listeners[i].sock_count; j++){
-			if(db->config->listeners[i].socks[j] == listensock){
-				new_context->listener = &db->config->listeners[i];
-				new_context->listener->client_count++;
-				break;
-			}
-		}
-	}
+	new_context->listener = net__listener_get(db, listensock);
 	if(!new_context->listener){
 		context__cleanup(db, new_context, true);
 		return -1;
 	}
+	new_context->listener->client_count++;
+	if(new_context->listener->accept_rate){
+		new_context->listener->accept_tokens--;
+	}
 
 	if(new_context->listener->max_connections > 0 && new_context->listener->client_count > new_context->listener->max_connections){
 		log__printf(NULL, MOSQ_LOG_NOTICE, "Client connection from %s denied: max_connections exceeded.", new_context->address);
@@ -28,18 +28,138 @@ Contributors:
 #include <string.h>
 #include <sys/stat.h>
 #include <time.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
 
 #include "mosquitto_broker_internal.h"
 #include "memory_mosq.h"
 #include "persist.h"
 #include "time_mosq.h"
 #include "util_mosq.h"
+#include "workers.h"
 
 static uint32_t db_version;
+/* Set while restoring a snapshot that no persistence log will be replayed on
+ * top of. Queued messages over the spill budget then go straight to disk
+ * rather than being held in memory until the restore is complete. */
+static bool restore_spool = false;
+/* Set once the client chunks of a snapshot are reached. The message stores
+ * after that point are spilled messages, each referred to only by the client
+ * message that follows it. restore_spilled_load is the last of them read. */
+static bool restore_in_clients = false;
+static struct mosquitto_msg_store_load *restore_spilled_load = NULL;
 
 
 static int persist__restore_sub(struct mosquitto_db *db, const char *client_id, const char *sub, int qos);
 
+/* Milliseconds from a monotonic clock, used for reporting how long saves and
+ * restores take and for spacing out persistence log syncs. */
+static long persist__time_ms(void)
+{
+#ifdef WIN32
+	return (long)GetTickCount();
+#else
+	struct timespec tp;
+
+	clock_gettime(CLOCK_MONOTONIC, &tp);
+	return tp.tv_sec*1000 + tp.tv_nsec/1000000;
+#endif
+}
+
+static char *persist__filename(struct mosquitto_db *db, const char *suffix)
+{
+	char *filename;
+	int len;
+
+	len = strlen(db->config->persistence_filepath) + strlen(suffix) + 1;
+	filename = mosquitto__malloc(len);
+	if(!filename){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Out of memory.");
+		return NULL;
+	}
+	snprintf(filename, len, "%s%s", db->config->persistence_filepath, suffix);
+	return filename;
+}
+
+/* The 64 bit equivalent of htonl(), and of ntohl() as it is its own inverse.
+ * Used for the offsets in the snapshot index. */
+static uint64_t persist__htonll(uint64_t value)
+{
+	uint8_t buf[sizeof(uint64_t)];
+	int i;
+
+	for(i=sizeof(uint64_t)-1; i>=0; i--){
+		buf[i] = value & 0xFF;
+		value >>= 8;
+	}
+	memcpy(&value, buf, sizeof(uint64_t));
+	return value;
+}
+
+#define persist__ntohll(value) persist__htonll(value)
+
+/* Offsets of every chunk written to the snapshot, stored at the end of the
+ * file so the restore can find and decode chunks without reading the file in
+ * order. Only set while a snapshot is being written. The offsets are kept in
+ * network byte order, ready to be written. */
+struct persist__index{
+	uint64_t *offsets;
+	uint32_t count;
+	uint32_t size;
+	uint64_t pos;
+	bool failed;
+};
+static struct persist__index *chunk_index = NULL;
+
+static void persist__index_add(struct persist__index *index, uint32_t length)
+{
+	uint64_t *offsets;
+	uint32_t size;
+
+	if(index->failed == false){
+		if(index->count == index->size){
+			size = index->size ? index->size*2 : 1024;
+			offsets = mosquitto__realloc(index->offsets, size*sizeof(uint64_t));
+			if(offsets){
+				index->offsets = offsets;
+				index->size = size;
+			}else{
+				/* The index is an optimisation only, carry on without it. */
+				index->failed = true;
+			}
+		}
+		if(index->failed == false){
+			index->offsets[index->count] = persist__htonll(index->pos);
+			index->count++;
+		}
+	}
+	index->pos += sizeof(uint16_t) + sizeof(uint32_t) + length;
+}
+
+static int persist__chunk_header_write(FILE *db_fptr, uint16_t chunk, uint32_t length)
+{
+	uint16_t i16temp;
+	uint32_t i32temp;
+
+	i16temp = htons(chunk);
+	write_e(db_fptr, &i16temp, sizeof(uint16_t));
+	i32temp = htonl(length);
+	write_e(db_fptr, &i32temp, sizeof(uint32_t));
+
+	if(chunk_index){
+		persist__index_add(chunk_index, length);
+	}
+	return MOSQ_ERR_SUCCESS;
+error:
+	return 1;
+}
+
 static struct mosquitto *persist__find_or_add_context(struct mosquitto_db *db, const char *client_id, uint16_t last_mid)
 {
 	struct mosquitto *context;
@@ -65,12 +185,61 @@ static struct mosquitto *persist__find_or_add_context(struct mosquitto_db *db, c
 	return context;
 }
 
-static int persist__client_messages_write(struct mosquitto_db *db, FILE *db_fptr, struct mosquitto *context, struct mosquitto_client_msg *queue)
+static int persist__client_msg_chunk_write(FILE *db_fptr, struct mosquitto *context, struct mosquitto_client_msg *cmsg)
 {
 	uint32_t length;
 	dbid_t i64temp;
 	uint16_t i16temp, slen;
 	uint8_t i8temp;
+
+	slen = strlen(context->id);
+
+	length = sizeof(dbid_t) + sizeof(uint16_t) + sizeof(uint8_t) +
+			sizeof(uint8_t) + sizeof(uint8_t) + sizeof(uint8_t) +
+			sizeof(uint8_t) + 2+slen;
+
+	if(persist__chunk_header_write(db_fptr, DB_CHUNK_CLIENT_MSG, length)) goto error;
+
+	i16temp = htons(slen);
+	write_e(db_fptr, &i16temp, sizeof(uint16_t));
+	write_e(db_fptr, context->id, slen);
+
+	i64temp = cmsg->store->db_id;
+	write_e(db_fptr, &i64temp, sizeof(dbid_t));
+
+	i16temp = htons(cmsg->mid);
+	write_e(db_fptr, &i16temp, sizeof(uint16_t));
+
+	i8temp = (uint8_t )cmsg->qos;
+	write_e(db_fptr, &i8temp, sizeof(uint8_t));
+
+	i8temp = (uint8_t )cmsg->retain;
+	write_e(db_fptr, &i8temp, sizeof(uint8_t));
+
+	i8temp = (uint8_t )cmsg->direction;
+	write_e(db_fptr, &i8temp, sizeof(uint8_t));
+
+	i8temp = (uint8_t )cmsg->state;
+	write_e(db_fptr, &i8temp, sizeof(uint8_t));
+
+	i8temp = (uint8_t )cmsg->dup;
+	write_e(db_fptr, &i8temp, sizeof(uint8_t));
+
+	return MOSQ_ERR_SUCCESS;
+error:
+	log__printf(NULL, MOSQ_LOG_ERR, "Error: %s.", strerror(errno));
+	return 1;
+}
+
+/* $SYS messages that are only retained aren't saved. */
+static bool persist__msg_store_skipped(struct mosquitto_msg_store *stored)
+{
+	return stored->topic && !strncmp(stored->topic, "$SYS", 4)
+		&& stored->ref_count <= 1 && stored->dest_id_count == 0;
+}
+
+static int persist__client_messages_write(struct mosquitto_db *db, FILE *db_fptr, struct mosquitto *context, struct mosquitto_client_msg *queue)
+{
 	struct mosquitto_client_msg *cmsg;
 
 	assert(db);
@@ -79,52 +248,78 @@ static int persist__client_messages_write(struct mosquitto_db *db, FILE *db_fptr
 
 	cmsg = queue;
 	while(cmsg){
-		if(!strncmp(cmsg->store->topic, "$SYS", 4)
-				&& cmsg->store->ref_count <= 1
-				&& cmsg->store->dest_id_count == 0){
-
+		if(persist__msg_store_skipped(cmsg->store)){
 			/* This $SYS message won't have been persisted, so we can't persist
 			 * this client message. */
 			cmsg = cmsg->next;
 			continue;
 		}
 
-		slen = strlen(context->id);
+		if(persist__client_msg_chunk_write(db_fptr, context, cmsg)) return 1;
+
+		cmsg = cmsg->next;
+	}
 
-		length = htonl(sizeof(dbid_t) + sizeof(uint16_t) + sizeof(uint8_t) +
-				sizeof(uint8_t) + sizeof(uint8_t) + sizeof(uint8_t) +
-				sizeof(uint8_t) + 2+slen);
+	return MOSQ_ERR_SUCCESS;
+}
 
-		i16temp = htons(DB_CHUNK_CLIENT_MSG);
-		write_e(db_fptr, &i16temp, sizeof(uint16_t));
-		write_e(db_fptr, &length, sizeof(uint32_t));
 
-		i16temp = htons(slen);
-		write_e(db_fptr, &i16temp, sizeof(uint16_t));
-		write_e(db_fptr, context->id, slen);
+static int persist__msg_store_chunk_write(FILE *db_fptr, struct mosquitto_msg_store *stored, bool force_no_retain)
+{
+	uint32_t length;
+	dbid_t i64temp;
+	uint32_t i32temp;
+	uint16_t i16temp, slen, tlen;
+	uint8_t i8temp;
 
-		i64temp = cmsg->store->db_id;
-		write_e(db_fptr, &i64temp, sizeof(dbid_t));
+	if(stored->topic){
+		tlen = strlen(stored->topic);
+	}else{
+		tlen = 0;
+	}
+	length = sizeof(dbid_t) + 2+strlen(stored->source_id) +
+			sizeof(uint16_t) + sizeof(uint16_t) +
+			2+tlen + sizeof(uint32_t) +
+			stored->payloadlen + sizeof(uint8_t) + sizeof(uint8_t);
 
-		i16temp = htons(cmsg->mid);
-		write_e(db_fptr, &i16temp, sizeof(uint16_t));
+	if(persist__chunk_header_write(db_fptr, DB_CHUNK_MSG_STORE, length)) goto error;
 
-		i8temp = (uint8_t )cmsg->qos;
-		write_e(db_fptr, &i8temp, sizeof(uint8_t));
+	i64temp = stored->db_id;
+	write_e(db_fptr, &i64temp, sizeof(dbid_t));
 
-		i8temp = (uint8_t )cmsg->retain;
-		write_e(db_fptr, &i8temp, sizeof(uint8_t));
+	slen = strlen(stored->source_id);
+	i16temp = htons(slen);
+	write_e(db_fptr, &i16temp, sizeof(uint16_t));
+	if(slen){
+		write_e(db_fptr, stored->source_id, slen);
+	}
 
-		i8temp = (uint8_t )cmsg->direction;
-		write_e(db_fptr, &i8temp, sizeof(uint8_t));
+	i16temp = htons(stored->source_mid);
+	write_e(db_fptr, &i16temp, sizeof(uint16_t));
 
-		i8temp = (uint8_t )cmsg->state;
-		write_e(db_fptr, &i8temp, sizeof(uint8_t));
+	i16temp = htons(stored->mid);
+	write_e(db_fptr, &i16temp, sizeof(uint16_t));
 
-		i8temp = (uint8_t )cmsg->dup;
-		write_e(db_fptr, &i8temp, sizeof(uint8_t));
+	i16temp = htons(tlen);
+	write_e(db_fptr, &i16temp, sizeof(uint16_t));
+	if(tlen){
+		write_e(db_fptr, stored->topic, tlen);
+	}
 
-		cmsg = cmsg->next;
+	i8temp = (uint8_t )stored->qos;
+	write_e(db_fptr, &i8temp, sizeof(uint8_t));
+
+	if(force_no_retain == false){
+		i8temp = (uint8_t )stored->retain;
+	}else{
+		i8temp = 0;
+	}
+	write_e(db_fptr, &i8temp, sizeof(uint8_t));
+
+	i32temp = htonl(stored->payloadlen);
+	write_e(db_fptr, &i32temp, sizeof(uint32_t));
+	if(stored->payloadlen){
+		write_e(db_fptr, UHPA_ACCESS_PAYLOAD(stored), (unsigned int)stored->payloadlen);
 	}
 
 	return MOSQ_ERR_SUCCESS;
@@ -133,14 +328,39 @@ error:
 	return 1;
 }
 
+/* Messages that have been spilled to disk aren't in the message store, so each
+ * is written as its own message store chunk followed by the client message. */
+static int persist__client_spool_write(FILE *db_fptr, struct mosquitto *context)
+{
+	struct mosquitto_msg_store *stored;
+	struct mosquitto_client_msg cmsg;
+	uint64_t pos;
+	bool force_no_retain;
+	int rc;
+
+	if(!context->spool) return MOSQ_ERR_SUCCESS;
+
+	pos = context->spool->read_pos;
+	while(pos < context->spool->write_pos){
+		rc = spool__message_read(context->spool, &pos, &stored, &cmsg);
+		if(rc){
+			log__printf(NULL, MOSQ_LOG_ERR, "Error: Unable to read queue spill file for client %s.", context->id);
+			return 1;
+		}
+		cmsg.store = stored;
+		force_no_retain = !strncmp(stored->topic, "$SYS", 4);
+
+		rc = persist__msg_store_chunk_write(db_fptr, stored, force_no_retain);
+		if(!rc) rc = persist__client_msg_chunk_write(db_fptr, context, &cmsg);
+		spool__msg_store_free(stored);
+		if(rc) return 1;
+	}
+
+	return MOSQ_ERR_SUCCESS;
+}
 
 static int persist__message_store_write(struct mosquitto_db *db, FILE *db_fptr)
 {
-	uint32_t length;
-	dbid_t i64temp;
-	uint32_t i32temp;
-	uint16_t i16temp, slen, tlen;
-	uint8_t i8temp;
 	struct mosquitto_msg_store *stored;
 	bool force_no_retain;
 
@@ -149,12 +369,11 @@ static int persist__message_store_write(struct mosquitto_db *db, FILE *db_fptr)
 
 	stored = db->msg_store;
 	while(stored){
+		if(persist__msg_store_skipped(stored)){
+			stored = stored->next;
+			continue;
+		}
 		if(stored->topic && !strncmp(stored->topic, "$SYS", 4)){
-			if(stored->ref_count <= 1 && stored->dest_id_count == 0){
-				/* $SYS messages that are only retained shouldn't be persisted. */
-				stored = stored->next;
-				continue;
-			}
 			/* Don't save $SYS messages as retained otherwise they can give
 			 * misleading information when reloaded. They should still be saved
 			 * because a disconnected durable client may have them in their
@@ -163,59 +382,35 @@ static int persist__message_store_write(struct mosquitto_db *db, FILE *db_fptr)
 		}else{
 			force_no_retain = false;
 		}
-		if(stored->topic){
-			tlen = strlen(stored->topic);
-		}else{
-			tlen = 0;
-		}
-		length = htonl(sizeof(dbid_t) + 2+strlen(stored->source_id) +
-				sizeof(uint16_t) + sizeof(uint16_t) +
-				2+tlen + sizeof(uint32_t) +
-				stored->payloadlen + sizeof(uint8_t) + sizeof(uint8_t));
-
-		i16temp = htons(DB_CHUNK_MSG_STORE);
-		write_e(db_fptr, &i16temp, sizeof(uint16_t));
-		write_e(db_fptr, &length, sizeof(uint32_t));
-
-		i64temp = stored->db_id;
-		write_e(db_fptr, &i64temp, sizeof(dbid_t));
-
-		slen = strlen(stored->source_id);
-		i16temp = htons(slen);
-		write_e(db_fptr, &i16temp, sizeof(uint16_t));
-		if(slen){
-			write_e(db_fptr, stored->source_id, slen);
-		}
-
-		i16temp = htons(stored->source_mid);
-		write_e(db_fptr, &i16temp, sizeof(uint16_t));
+		if(persist__msg_store_chunk_write(db_fptr, stored, force_no_retain)) return 1;
+		stored = stored->next;
+	}
 
-		i16temp = htons(stored->mid);
-		write_e(db_fptr, &i16temp, sizeof(uint16_t));
+	return MOSQ_ERR_SUCCESS;
+}
 
-		i16temp = htons(tlen);
-		write_e(db_fptr, &i16temp, sizeof(uint16_t));
-		if(tlen){
-			write_e(db_fptr, stored->topic, tlen);
-		}
+static int persist__client_chunk_write(FILE *db_fptr, struct mosquitto *context)
+{
+	uint16_t i16temp, slen;
+	uint32_t length;
+	time_t disconnect_t;
 
-		i8temp = (uint8_t )stored->qos;
-		write_e(db_fptr, &i8temp, sizeof(uint8_t));
+	length = 2+strlen(context->id) + sizeof(uint16_t) + sizeof(time_t);
 
-		if(force_no_retain == false){
-			i8temp = (uint8_t )stored->retain;
-		}else{
-			i8temp = 0;
-		}
-		write_e(db_fptr, &i8temp, sizeof(uint8_t));
+	if(persist__chunk_header_write(db_fptr, DB_CHUNK_CLIENT, length)) goto error;
 
-		i32temp = htonl(stored->payloadlen);
-		write_e(db_fptr, &i32temp, sizeof(uint32_t));
-		if(stored->payloadlen){
-			write_e(db_fptr, UHPA_ACCESS_PAYLOAD(stored), (unsigned int)stored->payloadlen);
-		}
-		stored = stored->next;
+	slen = strlen(context->id);
+	i16temp = htons(slen);
+	write_e(db_fptr, &i16temp, sizeof(uint16_t));
+	write_e(db_fptr, context->id, slen);
+	i16temp = htons(context->last_mid);
+	write_e(db_fptr, &i16temp, sizeof(uint16_t));
+	if(context->disconnect_t){
+		disconnect_t = context->disconnect_t;
+	}else{
+		disconnect_t = time(NULL);
 	}
+	write_e(db_fptr, &disconnect_t, sizeof(time_t));
 
 	return MOSQ_ERR_SUCCESS;
 error:
@@ -226,39 +421,62 @@ error:
 static int persist__client_write(struct mosquitto_db *db, FILE *db_fptr)
 {
 	struct mosquitto *context, *ctxt_tmp;
-	uint16_t i16temp, slen;
-	uint32_t length;
-	time_t disconnect_t;
 
 	assert(db);
 	assert(db_fptr);
 
 	HASH_ITER(hh_id, db->contexts_by_id, context, ctxt_tmp){
 		if(context && context->clean_session == false){
-			length = htonl(2+strlen(context->id) + sizeof(uint16_t) + sizeof(time_t));
-
-			i16temp = htons(DB_CHUNK_CLIENT);
-			write_e(db_fptr, &i16temp, sizeof(uint16_t));
-			write_e(db_fptr, &length, sizeof(uint32_t));
-
-			slen = strlen(context->id);
-			i16temp = htons(slen);
-			write_e(db_fptr, &i16temp, sizeof(uint16_t));
-			write_e(db_fptr, context->id, slen);
-			i16temp = htons(context->last_mid);
-			write_e(db_fptr, &i16temp, sizeof(uint16_t));
-			if(context->disconnect_t){
-				disconnect_t = context->disconnect_t;
-			}else{
-				disconnect_t = time(NULL);
-			}
-			write_e(db_fptr, &disconnect_t, sizeof(time_t));
+			if(persist__client_chunk_write(db_fptr, context)) return 1;
 
 			if(persist__client_messages_write(db, db_fptr, context, context->inflight_msgs)) return 1;
 			if(persist__client_messages_write(db, db_fptr, context, context->queued_msgs)) return 1;
+			if(persist__client_spool_write(db_fptr, context)) return 1;
 		}
 	}
 
+	return MOSQ_ERR_SUCCESS;
+}
+
+static int persist__sub_chunk_write(FILE *db_fptr, const char *client_id, const char *topic, int qos)
+{
+	uint32_t length;
+	uint16_t i16temp;
+	uint8_t i8temp;
+	size_t slen;
+
+	length = 2+strlen(client_id) + 2+strlen(topic) + sizeof(uint8_t);
+
+	if(persist__chunk_header_write(db_fptr, DB_CHUNK_SUB, length)) goto error;
+
+	slen = strlen(client_id);
+	i16temp = htons(slen);
+	write_e(db_fptr, &i16temp, sizeof(uint16_t));
+	write_e(db_fptr, client_id, slen);
+
+	slen = strlen(topic);
+	i16temp = htons(slen);
+	write_e(db_fptr, &i16temp, sizeof(uint16_t));
+	write_e(db_fptr, topic, slen);
+
+	i8temp = (uint8_t )qos;
+	write_e(db_fptr, &i8temp, sizeof(uint8_t));
+
+	return MOSQ_ERR_SUCCESS;
+error:
+	log__printf(NULL, MOSQ_LOG_ERR, "Error: %s.", strerror(errno));
+	return 1;
+}
+
+static int persist__retain_chunk_write(FILE *db_fptr, struct mosquitto_msg_store *stored)
+{
+	dbid_t i64temp;
+
+	if(persist__chunk_header_write(db_fptr, DB_CHUNK_RETAIN, sizeof(dbid_t))) goto error;
+
+	i64temp = stored->db_id;
+	write_e(db_fptr, &i64temp, sizeof(dbid_t));
+
 	return MOSQ_ERR_SUCCESS;
 error:
 	log__printf(NULL, MOSQ_LOG_ERR, "Error: %s.", strerror(errno));
@@ -269,11 +487,9 @@ static int persist__subs_retain_write(struct mosquitto_db *db, FILE *db_fptr, st
 {
 	struct mosquitto__subhier *subhier, *subhier_tmp;
 	struct mosquitto__subleaf *sub;
+	struct mosquitto__subshared *shared, *shared_tmp;
 	char *thistopic;
-	uint32_t length;
-	uint16_t i16temp;
-	uint8_t i8temp;
-	dbid_t i64temp;
+	char *sharetopic;
 	size_t slen;
 
 	slen = strlen(topic) + node->topic_len + 2;
@@ -288,38 +504,39 @@ static int persist__subs_retain_write(struct mosquitto_db *db, FILE *db_fptr, st
 	sub = node->subs;
 	while(sub){
 		if(sub->context->clean_session == false){
-			length = htonl(2+strlen(sub->context->id) + 2+strlen(thistopic) + sizeof(uint8_t));
-
-			i16temp = htons(DB_CHUNK_SUB);
-			write_e(db_fptr, &i16temp, sizeof(uint16_t));
-			write_e(db_fptr, &length, sizeof(uint32_t));
-
-			slen = strlen(sub->context->id);
-			i16temp = htons(slen);
-			write_e(db_fptr, &i16temp, sizeof(uint16_t));
-			write_e(db_fptr, sub->context->id, slen);
-
-			slen = strlen(thistopic);
-			i16temp = htons(slen);
-			write_e(db_fptr, &i16temp, sizeof(uint16_t));
-			write_e(db_fptr, thistopic, slen);
-
-			i8temp = (uint8_t )sub->qos;
-			write_e(db_fptr, &i8temp, sizeof(uint8_t));
+			if(persist__sub_chunk_write(db_fptr, sub->context->id, thistopic, sub->qos)){
+				mosquitto__free(thistopic);
+				return 1;
+			}
 		}
 		sub = sub->next;
 	}
+	HASH_ITER(hh, node->shared, shared, shared_tmp){
+		slen = strlen("$share/") + strlen(shared->name) + strlen(thistopic) + 2;
+		sharetopic = mosquitto__malloc(slen);
+		if(!sharetopic){
+			mosquitto__free(thistopic);
+			return MOSQ_ERR_NOMEM;
+		}
+		snprintf(sharetopic, slen, "$share/%s/%s", shared->name, thistopic);
+		for(sub=shared->subs; sub; sub=sub->next){
+			if(sub->context->clean_session == false){
+				if(persist__sub_chunk_write(db_fptr, sub->context->id, sharetopic, sub->qos)){
+					mosquitto__free(sharetopic);
+					mosquitto__free(thistopic);
+					return 1;
+				}
+			}
+		}
+		mosquitto__free(sharetopic);
+	}
 	if(node->retained){
 		if(strncmp(node->retained->topic, "$SYS", 4)){
 			/* Don't save $SYS messages. */
-			length = htonl(sizeof(dbid_t));
-
-			i16temp = htons(DB_CHUNK_RETAIN);
-			write_e(db_fptr, &i16temp, sizeof(uint16_t));
-			write_e(db_fptr, &length, sizeof(uint32_t));
-
-			i64temp = node->retained->db_id;
-			write_e(db_fptr, &i64temp, sizeof(dbid_t));
+			if(persist__retain_chunk_write(db_fptr, node->retained)){
+				mosquitto__free(thistopic);
+				return 1;
+			}
 		}
 	}
 
@@ -328,9 +545,6 @@ static int persist__subs_retain_write(struct mosquitto_db *db, FILE *db_fptr, st
 	}
 	mosquitto__free(thistopic);
 	return MOSQ_ERR_SUCCESS;
-error:
-	log__printf(NULL, MOSQ_LOG_ERR, "Error: %s.", strerror(errno));
-	return 1;
 }
 
 static int persist__subs_retain_write_all(struct mosquitto_db *db, FILE *db_fptr)
@@ -346,22 +560,48 @@ static int persist__subs_retain_write_all(struct mosquitto_db *db, FILE *db_fptr
 	return MOSQ_ERR_SUCCESS;
 }
 
-int persist__backup(struct mosquitto_db *db, bool shutdown)
+static int persist__index_write(FILE *db_fptr, struct persist__index *index)
+{
+	uint32_t i32temp;
+	uint64_t offset;
+
+	/* The index chunk is found from the file offset stored in its last
+	 * 8 bytes, which are also the last 8 bytes of the file. */
+	offset = persist__htonll(index->pos);
+	if(persist__chunk_header_write(db_fptr, DB_CHUNK_INDEX,
+				sizeof(uint32_t) + index->count*sizeof(uint64_t) + sizeof(uint64_t))){
+
+		goto error;
+	}
+	i32temp = htonl(index->count);
+	write_e(db_fptr, &i32temp, sizeof(uint32_t));
+	if(index->count){
+		write_e(db_fptr, index->offsets, index->count*sizeof(uint64_t));
+	}
+	write_e(db_fptr, &offset, sizeof(uint64_t));
+	return MOSQ_ERR_SUCCESS;
+error:
+	return 1;
+}
+
+static int persist__snapshot_write(struct mosquitto_db *db, bool shutdown)
 {
 	int rc = 0;
 	FILE *db_fptr = NULL;
 	uint32_t db_version_w = htonl(MOSQ_DB_VERSION);
 	uint32_t crc = htonl(0);
 	dbid_t i64temp;
-	uint32_t i32temp;
-	uint16_t i16temp;
+	uint64_t log_gen;
 	uint8_t i8temp;
 	char err[256];
 	char *outfile = NULL;
 	int len;
+	long start_ms;
+	struct persist__index index;
 
-	if(!db || !db->config || !db->config->persistence_filepath) return MOSQ_ERR_INVAL;
 	log__printf(NULL, MOSQ_LOG_INFO, "Saving in-memory database to %s.", db->config->persistence_filepath);
+	start_ms = persist__time_ms();
+	memset(&index, 0, sizeof(struct persist__index));
 
 	len = strlen(db->config->persistence_filepath)+5;
 	outfile = mosquitto__malloc(len+1);
@@ -412,12 +652,13 @@ int persist__backup(struct mosquitto_db *db, bool shutdown)
 	write_e(db_fptr, &crc, sizeof(uint32_t));
 	write_e(db_fptr, &db_version_w, sizeof(uint32_t));
 
+	index.pos = 15 + sizeof(uint32_t) + sizeof(uint32_t);
+	chunk_index = &index;
+
 	/* DB config */
-	i16temp = htons(DB_CHUNK_CFG);
-	write_e(db_fptr, &i16temp, sizeof(uint16_t));
-	/* chunk length */
-	i32temp = htonl(sizeof(dbid_t) + sizeof(uint8_t) + sizeof(uint8_t));
-	write_e(db_fptr, &i32temp, sizeof(uint32_t));
+	if(persist__chunk_header_write(db_fptr, DB_CHUNK_CFG, sizeof(dbid_t) + sizeof(uint8_t) + sizeof(uint8_t))){
+		goto error;
+	}
 	/* db written at broker shutdown or not */
 	i8temp = shutdown;
 	write_e(db_fptr, &i8temp, sizeof(uint8_t));
@@ -427,6 +668,13 @@ int persist__backup(struct mosquitto_db *db, bool shutdown)
 	i64temp = db->last_db_id;
 	write_e(db_fptr, &i64temp, sizeof(dbid_t));
 
+	if(db->persist_log_gen){
+		/* First persistence log generation that is not part of this file. */
+		if(persist__chunk_header_write(db_fptr, DB_CHUNK_LOG_GEN, sizeof(uint64_t))) goto error;
+		log_gen = db->persist_log_gen;
+		write_e(db_fptr, &log_gen, sizeof(uint64_t));
+	}
+
 	if(persist__message_store_write(db, db_fptr)){
 		goto error;
 	}
@@ -434,6 +682,13 @@ int persist__backup(struct mosquitto_db *db, bool shutdown)
 	persist__client_write(db, db_fptr);
 	persist__subs_retain_write_all(db, db_fptr);
 
+	chunk_index = NULL;
+	if(index.failed == false){
+		if(persist__index_write(db_fptr, &index)) goto error;
+	}
+	mosquitto__free(index.offsets);
+	index.offsets = NULL;
+
 #ifndef WIN32
 	/**
 	*
@@ -474,8 +729,11 @@ int persist__backup(struct mosquitto_db *db, bool shutdown)
 	}
 	mosquitto__free(outfile);
 	outfile = NULL;
-	return rc;
+	log__printf(NULL, MOSQ_LOG_INFO, "Saved in-memory database in %ld ms.", persist__time_ms() - start_ms);
+	return MOSQ_ERR_SUCCESS;
 error:
+	chunk_index = NULL;
+	mosquitto__free(index.offsets);
 	mosquitto__free(outfile);
 	strerror_r(errno, err, 256);
 	log__printf(NULL, MOSQ_LOG_ERR, "Error: %s.", err);
@@ -486,9 +744,9 @@ error:
 static int persist__client_msg_restore(struct mosquitto_db *db, const char *client_id, uint16_t mid, uint8_t qos, uint8_t retain, uint8_t direction, uint8_t state, uint8_t dup, uint64_t store_id)
 {
 	struct mosquitto_client_msg *cmsg;
-	struct mosquitto_client_msg **msgs, **last_msg;
 	struct mosquitto_msg_store_load *load;
 	struct mosquitto *context;
+	bool spooled;
 
 	cmsg = mosquitto__malloc(sizeof(struct mosquitto_client_msg));
 	if(!cmsg){
@@ -497,6 +755,7 @@ static int persist__client_msg_restore(struct mosquitto_db *db, const char *clie
 	}
 
 	cmsg->next = NULL;
+	cmsg->prev = NULL;
 	cmsg->store = NULL;
 	cmsg->mid = mid;
 	cmsg->qos = qos;
@@ -522,19 +781,46 @@ static int persist__client_msg_restore(struct mosquitto_db *db, const char *clie
 		return 1;
 	}
 
-	if (state == mosq_ms_queued){
-		msgs = &(context->queued_msgs);
-		last_msg = &(context->last_queued_msg);
-	}else{
-		msgs = &(context->inflight_msgs);
-		last_msg = &(context->last_inflight_msg);
+	if(restore_spool){
+		spooled = spool__wanted(db, context, direction, state, cmsg->store->payloadlen)
+				&& spool__message_add(db, context, cmsg) == MOSQ_ERR_SUCCESS;
+
+		/* Needed by spool__wanted(). They are counted again when the client
+		 * reconnects. */
+		context->msg_count++;
+		context->msg_bytes += cmsg->store->payloadlen;
+		if(qos > 0){
+			context->msg_count12++;
+			context->msg_bytes12 += cmsg->store->payloadlen;
+		}
+		if(spooled){
+			db__msg_store_deref(db, &cmsg->store);
+			mosquitto__free(cmsg);
+			if(load == restore_spilled_load){
+				/* Nothing else can refer to it, so it needn't be held
+				 * until the restore is complete. */
+				restore_spilled_load = NULL;
+				HASH_DELETE(hh, db->msg_store_load, load);
+				db__msg_store_deref(db, &load->store);
+				mosquitto__free(load);
+			}
+			return MOSQ_ERR_SUCCESS;
+		}
 	}
-	if(*msgs){
-		(*last_msg)->next = cmsg;
+
+	if (state == mosq_ms_queued){
+		if(context->last_queued_msg){
+			context->last_queued_msg->next = cmsg;
+		}else{
+			context->queued_msgs = cmsg;
+		}
+		context->last_queued_msg = cmsg;
+		if(direction == mosq_md_in){
+			db__msg_index_add(context, cmsg);
+		}
 	}else{
-		*msgs = cmsg;
+		db__inflight_append(context, cmsg);
 	}
-	*last_msg = cmsg;
 
 	return MOSQ_ERR_SUCCESS;
 }
@@ -578,6 +864,7 @@ static int persist__client_chunk_restore(struct mosquitto_db *db, FILE *db_fptr)
 	}else{
 		rc = 1;
 	}
+	restore_in_clients = true;
 
 	mosquitto__free(client_id);
 
@@ -724,7 +1011,19 @@ static int persist__msg_store_chunk_restore(struct mosquitto_db *db, FILE *db_fp
 		load->db_id = stored->db_id;
 		load->store = stored;
 
+		/* Messages replayed from the persistence log may be newer than the
+		 * last id recorded in the snapshot. */
+		if(stored->db_id > db->last_db_id){
+			db->last_db_id = stored->db_id;
+		}
+		stored->persist_logged = true;
+		/* Hold a reference until the restore is complete, so a store that is
+		 * released part way through replaying the log can't be freed while
+		 * a later record still refers to it. */
+		stored->ref_count++;
+
 		HASH_ADD(hh, db->msg_store_load, db_id, sizeof(dbid_t), load);
+		restore_spilled_load = restore_in_clients ? load : NULL;
 		return MOSQ_ERR_SUCCESS;
 	}else{
 		mosquitto__free(load);
@@ -813,25 +1112,758 @@ error:
 	return 1;
 }
 
-int persist__restore(struct mosquitto_db *db)
+static int persist__string_read(FILE *db_fptr, char **str)
 {
-	FILE *fptr;
-	char header[15];
-	int rc = 0;
-	uint32_t crc;
-	dbid_t i64temp;
-	uint32_t i32temp, length;
-	uint16_t i16temp, chunk;
-	uint8_t i8temp;
-	ssize_t rlen;
-	char err[256];
-	struct mosquitto_msg_store_load *load, *load_tmp;
+	uint16_t i16temp, slen;
+	char *s;
 
-	assert(db);
-	assert(db->config);
-	assert(db->config->persistence_filepath);
+	read_e(db_fptr, &i16temp, sizeof(uint16_t));
+	slen = ntohs(i16temp);
+	s = mosquitto__malloc(slen+1);
+	if(!s){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Out of memory.");
+		return MOSQ_ERR_NOMEM;
+	}
+	if(slen && fread(s, 1, slen, db_fptr) != slen){
+		mosquitto__free(s);
+		goto error;
+	}
+	s[slen] = '\0';
+	*str = s;
+	return MOSQ_ERR_SUCCESS;
+error:
+	log__printf(NULL, MOSQ_LOG_ERR, "Error: %s.", strerror(errno));
+	return 1;
+}
 
-	db->msg_store_load = NULL;
+static int persist__client_delete_chunk_restore(struct mosquitto_db *db, FILE *db_fptr)
+{
+	char *client_id;
+	struct mosquitto *context;
+
+	if(persist__string_read(db_fptr, &client_id)){
+		fclose(db_fptr);
+		return 1;
+	}
+	HASH_FIND(hh_id, db->contexts_by_id, client_id, strlen(client_id), context);
+	if(context){
+		context__cleanup(db, context, true);
+	}
+	mosquitto__free(client_id);
+	return MOSQ_ERR_SUCCESS;
+}
+
+static struct mosquitto_client_msg *persist__client_msg_find(struct mosquitto *context, uint16_t mid, uint8_t direction, struct mosquitto_client_msg ***head, struct mosquitto_client_msg ***tail, struct mosquitto_client_msg **prev)
+{
+	struct mosquitto_client_msg *cmsg;
+
+	*head = &context->inflight_msgs;
+	*tail = &context->last_inflight_msg;
+	*prev = NULL;
+	for(cmsg = context->inflight_msgs; cmsg; cmsg = cmsg->next){
+		if(cmsg->mid == mid && cmsg->direction == direction) return cmsg;
+		*prev = cmsg;
+	}
+
+	*head = &context->queued_msgs;
+	*tail = &context->last_queued_msg;
+	*prev = NULL;
+	for(cmsg = context->queued_msgs; cmsg; cmsg = cmsg->next){
+		if(cmsg->mid == mid && cmsg->direction == direction) return cmsg;
+		*prev = cmsg;
+	}
+	return NULL;
+}
+
+static int persist__client_msg_update_chunk_restore(struct mosquitto_db *db, FILE *db_fptr, bool remove)
+{
+	char *client_id = NULL;
+	uint16_t i16temp, mid;
+	uint8_t direction, state = mosq_ms_invalid;
+	struct mosquitto *context;
+	struct mosquitto_client_msg *cmsg, *prev;
+	struct mosquitto_client_msg **head, **tail;
+
+	if(persist__string_read(db_fptr, &client_id)){
+		fclose(db_fptr);
+		return 1;
+	}
+	read_e(db_fptr, &i16temp, sizeof(uint16_t));
+	mid = ntohs(i16temp);
+	read_e(db_fptr, &direction, sizeof(uint8_t));
+	if(!remove){
+		read_e(db_fptr, &state, sizeof(uint8_t));
+	}
+
+	HASH_FIND(hh_id, db->contexts_by_id, client_id, strlen(client_id), context);
+	mosquitto__free(client_id);
+	if(!context) return MOSQ_ERR_SUCCESS;
+
+	cmsg = persist__client_msg_find(context, mid, direction, &head, &tail, &prev);
+	if(!cmsg) return MOSQ_ERR_SUCCESS;
+
+	if(!remove){
+		cmsg->state = state;
+		if(state == mosq_ms_queued || head == &context->inflight_msgs){
+			return MOSQ_ERR_SUCCESS;
+		}
+	}
+
+	if(head == &context->inflight_msgs){
+		db__inflight_unlink(context, cmsg);
+	}else{
+		if(prev){
+			prev->next = cmsg->next;
+		}else{
+			*head = cmsg->next;
+		}
+		if(*tail == cmsg){
+			*tail = prev;
+		}
+		if(cmsg->direction == mosq_md_in){
+			db__msg_index_remove(context, cmsg);
+		}
+	}
+	if(remove){
+		db__msg_store_deref(db, &cmsg->store);
+		mosquitto__free(cmsg);
+	}else{
+		/* The message has moved from the queue into flight. */
+		db__inflight_append(context, cmsg);
+	}
+	return MOSQ_ERR_SUCCESS;
+error:
+	log__printf(NULL, MOSQ_LOG_ERR, "Error: %s.", strerror(errno));
+	fclose(db_fptr);
+	mosquitto__free(client_id);
+	return 1;
+}
+
+static int persist__sub_delete_chunk_restore(struct mosquitto_db *db, FILE *db_fptr)
+{
+	char *client_id = NULL, *topic = NULL;
+	struct mosquitto *context;
+
+	if(persist__string_read(db_fptr, &client_id) || persist__string_read(db_fptr, &topic)){
+		mosquitto__free(client_id);
+		fclose(db_fptr);
+		return 1;
+	}
+	HASH_FIND(hh_id, db->contexts_by_id, client_id, strlen(client_id), context);
+	if(context){
+		sub__remove(db, context, topic, db->subs);
+	}
+	mosquitto__free(client_id);
+	mosquitto__free(topic);
+	return MOSQ_ERR_SUCCESS;
+}
+
+static int persist__chunk_restore(struct mosquitto_db *db, FILE *fptr, uint16_t chunk, uint32_t length)
+{
+	dbid_t i64temp;
+	uint64_t log_gen;
+	uint8_t i8temp;
+	char err[256];
+
+	switch(chunk){
+		case DB_CHUNK_CFG:
+			read_e(fptr, &i8temp, sizeof(uint8_t)); // shutdown
+			read_e(fptr, &i8temp, sizeof(uint8_t)); // sizeof(dbid_t)
+			if(i8temp != sizeof(dbid_t)){
+				log__printf(NULL, MOSQ_LOG_ERR, "Error: Incompatible database configuration (dbid size is %d bytes, expected %lu)",
+						i8temp, (unsigned long)sizeof(dbid_t));
+				fclose(fptr);
+				return 1;
+			}
+			read_e(fptr, &i64temp, sizeof(dbid_t));
+			db->last_db_id = i64temp;
+			break;
+
+		case DB_CHUNK_LOG_GEN:
+			read_e(fptr, &log_gen, sizeof(uint64_t));
+			db->persist_log_gen = log_gen;
+			break;
+
+		case DB_CHUNK_MSG_STORE:
+			return persist__msg_store_chunk_restore(db, fptr);
+
+		case DB_CHUNK_CLIENT_MSG:
+			return persist__client_msg_chunk_restore(db, fptr);
+
+		case DB_CHUNK_RETAIN:
+			return persist__retain_chunk_restore(db, fptr);
+
+		case DB_CHUNK_SUB:
+			return persist__sub_chunk_restore(db, fptr);
+
+		case DB_CHUNK_CLIENT:
+			return persist__client_chunk_restore(db, fptr);
+
+		case DB_CHUNK_CLIENT_DELETE:
+			return persist__client_delete_chunk_restore(db, fptr);
+
+		case DB_CHUNK_CLIENT_MSG_UPDATE:
+			return persist__client_msg_update_chunk_restore(db, fptr, false);
+
+		case DB_CHUNK_CLIENT_MSG_DELETE:
+			return persist__client_msg_update_chunk_restore(db, fptr, true);
+
+		case DB_CHUNK_SUB_DELETE:
+			return persist__sub_delete_chunk_restore(db, fptr);
+
+		case DB_CHUNK_INDEX:
+			fseek(fptr, length, SEEK_CUR);
+			break;
+
+		default:
+			log__printf(NULL, MOSQ_LOG_WARNING, "Warning: Unsupported chunk \"%d\" in persistent database file. Ignoring.", chunk);
+			fseek(fptr, length, SEEK_CUR);
+			break;
+	}
+	return MOSQ_ERR_SUCCESS;
+error:
+	strerror_r(errno, err, 256);
+	log__printf(NULL, MOSQ_LOG_ERR, "Error: %s.", err);
+	fclose(fptr);
+	return 1;
+}
+
+#ifndef WIN32
+/* Indexed restore
+ *
+ * A snapshot that ends with a DB_CHUNK_INDEX chunk is restored by mapping the
+ * file into memory and decoding the message store, client, client message and
+ * subscription chunks on several threads. Decoding only allocates and fills
+ * in the records. A final pass on the main thread links them into the
+ * database in file order, which gives the same result as reading the file
+ * chunk by chunk.
+ */
+
+#define PERSIST_RESTORE_MAX_THREADS 8
+#define PERSIST_RESTORE_MIN_PER_THREAD 1024
+
+struct persist__record{
+	const uint8_t *data;
+	uint32_t length;
+	uint16_t chunk;
+	int rc;
+	/* Left for persist__record_link() to decode, see
+	 * persist__snapshot_restore_mapped(). */
+	bool deferred;
+	union{
+		struct mosquitto_msg_store *stored;
+		struct{
+			char *client_id;
+			time_t disconnect_t;
+			uint16_t last_mid;
+		} client;
+		struct{
+			char *client_id;
+			dbid_t store_id;
+			uint16_t mid;
+			uint8_t qos;
+			uint8_t retain;
+			uint8_t direction;
+			uint8_t state;
+			uint8_t dup;
+		} client_msg;
+		struct{
+			char *client_id;
+			char *topic;
+			uint8_t qos;
+		} sub;
+	} u;
+};
+
+struct persist__cursor{
+	const uint8_t *pos;
+	uint32_t remaining;
+};
+
+struct persist__decode_job{
+	struct persist__record *records;
+	uint32_t count;
+	uint32_t first;
+	uint32_t stride;
+#ifdef REAL_WITH_MEMORY_TRACKING
+	unsigned long max_memcount;
+#endif
+};
+
+static int persist__cursor_read(struct persist__cursor *cur, void *buf, uint32_t len)
+{
+	if(cur->remaining < len) return MOSQ_ERR_INVAL;
+	memcpy(buf, cur->pos, len);
+	cur->pos += len;
+	cur->remaining -= len;
+	return MOSQ_ERR_SUCCESS;
+}
+
+/* Read a length prefixed string. Empty strings are returned as NULL unless
+ * allow_empty is set. */
+static int persist__cursor_string(struct persist__cursor *cur, char **str, bool allow_empty)
+{
+	uint16_t i16temp, slen;
+
+	*str = NULL;
+	if(persist__cursor_read(cur, &i16temp, sizeof(uint16_t))) return MOSQ_ERR_INVAL;
+	slen = ntohs(i16temp);
+	if(slen == 0 && !allow_empty) return MOSQ_ERR_SUCCESS;
+	if(cur->remaining < slen) return MOSQ_ERR_INVAL;
+
+	*str = mosquitto__malloc(slen+1);
+	if(!(*str)) return MOSQ_ERR_NOMEM;
+	memcpy(*str, cur->pos, slen);
+	(*str)[slen] = '\0';
+	cur->pos += slen;
+	cur->remaining -= slen;
+	return MOSQ_ERR_SUCCESS;
+}
+
+static void persist__msg_store_free(struct mosquitto_msg_store *stored)
+{
+	if(!stored) return;
+
+	mosquitto__free(stored->source_id);
+	mosquitto__free(stored->topic);
+	UHPA_FREE_PAYLOAD(stored);
+	mosquitto__free(stored);
+}
+
+static int persist__msg_store_decode(struct persist__cursor *cur, struct mosquitto_msg_store **stored_out)
+{
+	struct mosquitto_msg_store *stored;
+	uint32_t i32temp;
+	uint16_t i16temp;
+	int rc;
+
+	stored = mosquitto__calloc(1, sizeof(struct mosquitto_msg_store));
+	if(!stored) return MOSQ_ERR_NOMEM;
+
+	rc = persist__cursor_read(cur, &stored->db_id, sizeof(dbid_t));
+	if(!rc) rc = persist__cursor_string(cur, &stored->source_id, true);
+	if(!rc) rc = persist__cursor_read(cur, &i16temp, sizeof(uint16_t));
+	if(!rc){
+		stored->source_mid = ntohs(i16temp);
+		/* This is the mid - don't need it */
+		rc = persist__cursor_read(cur, &i16temp, sizeof(uint16_t));
+	}
+	if(!rc) rc = persist__cursor_string(cur, &stored->topic, false);
+	if(!rc) rc = persist__cursor_read(cur, &stored->qos, sizeof(uint8_t));
+	if(!rc) rc = persist__cursor_read(cur, &stored->retain, sizeof(uint8_t));
+	if(!rc) rc = persist__cursor_read(cur, &i32temp, sizeof(uint32_t));
+	if(!rc){
+		if(cur->remaining < ntohl(i32temp)){
+			rc = MOSQ_ERR_INVAL;
+		}else{
+			stored->payloadlen = ntohl(i32temp);
+		}
+	}
+	if(!rc && stored->payloadlen){
+		if(UHPA_ALLOC_PAYLOAD(stored) == 0){
+			stored->payloadlen = 0;
+			rc = MOSQ_ERR_NOMEM;
+		}else{
+			memcpy(UHPA_ACCESS_PAYLOAD(stored), cur->pos, stored->payloadlen);
+		}
+	}
+	if(rc){
+		persist__msg_store_free(stored);
+		return rc;
+	}
+	stored->persist_logged = true;
+	*stored_out = stored;
+	return MOSQ_ERR_SUCCESS;
+}
+
+static void persist__record_decode(struct persist__record *rec)
+{
+	struct persist__cursor cur;
+	uint16_t i16temp;
+	int rc = MOSQ_ERR_SUCCESS;
+
+	cur.pos = rec->data;
+	cur.remaining = rec->length;
+
+	switch(rec->chunk){
+		case DB_CHUNK_MSG_STORE:
+			rc = persist__msg_store_decode(&cur, &rec->u.stored);
+			break;
+
+		case DB_CHUNK_CLIENT:
+			rc = persist__cursor_string(&cur, &rec->u.client.client_id, false);
+			if(!rc && !rec->u.client.client_id) rc = MOSQ_ERR_INVAL;
+			if(!rc) rc = persist__cursor_read(&cur, &i16temp, sizeof(uint16_t));
+			if(!rc){
+				rec->u.client.last_mid = ntohs(i16temp);
+				rc = persist__cursor_read(&cur, &rec->u.client.disconnect_t, sizeof(time_t));
+			}
+			break;
+
+		case DB_CHUNK_CLIENT_MSG:
+			rc = persist__cursor_string(&cur, &rec->u.client_msg.client_id, false);
+			if(!rc && !rec->u.client_msg.client_id) rc = MOSQ_ERR_INVAL;
+			if(!rc) rc = persist__cursor_read(&cur, &rec->u.client_msg.store_id, sizeof(dbid_t));
+			if(!rc) rc = persist__cursor_read(&cur, &i16temp, sizeof(uint16_t));
+			if(!rc){
+				rec->u.client_msg.mid = ntohs(i16temp);
+				rc = persist__cursor_read(&cur, &rec->u.client_msg.qos, sizeof(uint8_t));
+			}
+			if(!rc) rc = persist__cursor_read(&cur, &rec->u.client_msg.retain, sizeof(uint8_t));
+			if(!rc) rc = persist__cursor_read(&cur, &rec->u.client_msg.direction, sizeof(uint8_t));
+			if(!rc) rc = persist__cursor_read(&cur, &rec->u.client_msg.state, sizeof(uint8_t));
+			if(!rc) rc = persist__cursor_read(&cur, &rec->u.client_msg.dup, sizeof(uint8_t));
+			break;
+
+		case DB_CHUNK_SUB:
+			rc = persist__cursor_string(&cur, &rec->u.sub.client_id, true);
+			if(!rc) rc = persist__cursor_string(&cur, &rec->u.sub.topic, true);
+			if(!rc) rc = persist__cursor_read(&cur, &rec->u.sub.qos, sizeof(uint8_t));
+			break;
+
+		default:
+			/* Everything else is cheap and is decoded when it is linked. */
+			break;
+	}
+	rec->rc = rc;
+}
+
+static void persist__record_free(struct persist__record *rec)
+{
+	switch(rec->chunk){
+		case DB_CHUNK_MSG_STORE:
+			persist__msg_store_free(rec->u.stored);
+			rec->u.stored = NULL;
+			break;
+		case DB_CHUNK_CLIENT:
+			mosquitto__free(rec->u.client.client_id);
+			rec->u.client.client_id = NULL;
+			break;
+		case DB_CHUNK_CLIENT_MSG:
+			mosquitto__free(rec->u.client_msg.client_id);
+			rec->u.client_msg.client_id = NULL;
+			break;
+		case DB_CHUNK_SUB:
+			mosquitto__free(rec->u.sub.client_id);
+			mosquitto__free(rec->u.sub.topic);
+			rec->u.sub.client_id = NULL;
+			rec->u.sub.topic = NULL;
+			break;
+	}
+}
+
+static void persist__decode_job_run(void *arg)
+{
+	struct persist__decode_job *job = arg;
+	uint32_t i;
+
+	for(i=job->first; i<job->count; i+=job->stride){
+		if(!job->records[i].deferred){
+			persist__record_decode(&job->records[i]);
+		}
+	}
+#ifdef REAL_WITH_MEMORY_TRACKING
+	/* The peak seen by this thread, merged by the main thread afterwards. */
+	job->max_memcount = mosquitto__max_memory_used();
+#endif
+}
+
+static int persist__records_decode(struct persist__record *records, uint32_t count)
+{
+	struct persist__decode_job jobs[PERSIST_RESTORE_MAX_THREADS];
+	int thread_count = 1;
+	int i;
+#ifdef WITH_PARALLEL_RESTORE
+	struct mosquitto__workers *workers = NULL;
+	bool submitted[PERSIST_RESTORE_MAX_THREADS];
+	long cpus;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if(cpus > 1){
+		thread_count = cpus;
+		if(thread_count > PERSIST_RESTORE_MAX_THREADS){
+			thread_count = PERSIST_RESTORE_MAX_THREADS;
+		}
+		if(count / PERSIST_RESTORE_MIN_PER_THREAD < (uint32_t)thread_count){
+			thread_count = count / PERSIST_RESTORE_MIN_PER_THREAD;
+		}
+		if(thread_count < 1) thread_count = 1;
+	}
+	if(thread_count > 1 && workers__start(&workers, thread_count-1)){
+		thread_count = 1;
+	}
+#endif
+
+	for(i=0; i<thread_count; i++){
+		jobs[i].records = records;
+		jobs[i].count = count;
+		jobs[i].first = i;
+		jobs[i].stride = thread_count;
+#ifdef REAL_WITH_MEMORY_TRACKING
+		jobs[i].max_memcount = 0;
+#endif
+	}
+
+#ifdef WITH_PARALLEL_RESTORE
+	/* The main thread takes the first share itself. */
+	for(i=1; i<thread_count; i++){
+		submitted[i] = (workers__submit(workers, persist__decode_job_run, &jobs[i]) == MOSQ_ERR_SUCCESS);
+	}
+	persist__decode_job_run(&jobs[0]);
+	workers__stop(workers);
+	for(i=1; i<thread_count; i++){
+		if(!submitted[i]){
+			persist__decode_job_run(&jobs[i]);
+		}
+#  ifdef REAL_WITH_MEMORY_TRACKING
+		memory__max_merge(jobs[i].max_memcount);
+#  endif
+	}
+#else
+	persist__decode_job_run(&jobs[0]);
+#endif
+	return thread_count;
+}
+
+static int persist__record_link(struct mosquitto_db *db, struct persist__record *rec)
+{
+	struct persist__cursor cur;
+	struct mosquitto_msg_store *stored;
+	struct mosquitto_msg_store_load *load;
+	struct mosquitto *context;
+	dbid_t i64temp;
+	uint64_t log_gen;
+	uint8_t i8temp;
+	int rc;
+
+	if(rec->deferred){
+		persist__record_decode(rec);
+	}
+	if(rec->rc) return rec->rc;
+
+	cur.pos = rec->data;
+	cur.remaining = rec->length;
+
+	switch(rec->chunk){
+		case DB_CHUNK_CFG:
+			if(persist__cursor_read(&cur, &i8temp, sizeof(uint8_t))) return MOSQ_ERR_INVAL; // shutdown
+			if(persist__cursor_read(&cur, &i8temp, sizeof(uint8_t))) return MOSQ_ERR_INVAL; // sizeof(dbid_t)
+			if(i8temp != sizeof(dbid_t)){
+				log__printf(NULL, MOSQ_LOG_ERR, "Error: Incompatible database configuration (dbid size is %d bytes, expected %lu)",
+						i8temp, (unsigned long)sizeof(dbid_t));
+				return 1;
+			}
+			if(persist__cursor_read(&cur, &i64temp, sizeof(dbid_t))) return MOSQ_ERR_INVAL;
+			db->last_db_id = i64temp;
+			break;
+
+		case DB_CHUNK_LOG_GEN:
+			if(persist__cursor_read(&cur, &log_gen, sizeof(uint64_t))) return MOSQ_ERR_INVAL;
+			db->persist_log_gen = log_gen;
+			break;
+
+		case DB_CHUNK_MSG_STORE:
+			load = mosquitto__malloc(sizeof(struct mosquitto_msg_store_load));
+			if(!load) return MOSQ_ERR_NOMEM;
+
+			stored = rec->u.stored;
+			rec->u.stored = NULL;
+			if(!stored->db_id){
+				stored->db_id = ++db->last_db_id;
+			}else if(stored->db_id > db->last_db_id){
+				db->last_db_id = stored->db_id;
+			}
+			db->msg_store_count++;
+			db->msg_store_bytes += stored->payloadlen;
+			db__msg_store_add(db, stored);
+			/* Held until the restore is complete, as for the chunk by chunk
+			 * restore. */
+			stored->ref_count++;
+
+			load->db_id = stored->db_id;
+			load->store = stored;
+			HASH_ADD(hh, db->msg_store_load, db_id, sizeof(dbid_t), load);
+			restore_spilled_load = restore_in_clients ? load : NULL;
+			break;
+
+		case DB_CHUNK_CLIENT:
+			context = persist__find_or_add_context(db, rec->u.client.client_id, rec->u.client.last_mid);
+			if(!context) return 1;
+			context->disconnect_t = rec->u.client.disconnect_t;
+			restore_in_clients = true;
+			break;
+
+		case DB_CHUNK_CLIENT_MSG:
+			rc = persist__client_msg_restore(db, rec->u.client_msg.client_id,
+					rec->u.client_msg.mid, rec->u.client_msg.qos,
+					rec->u.client_msg.retain, rec->u.client_msg.direction,
+					rec->u.client_msg.state, rec->u.client_msg.dup,
+					rec->u.client_msg.store_id);
+			if(rc) return rc;
+			break;
+
+		case DB_CHUNK_RETAIN:
+			if(persist__cursor_read(&cur, &i64temp, sizeof(dbid_t))) return MOSQ_ERR_INVAL;
+			HASH_FIND(hh, db->msg_store_load, &i64temp, sizeof(dbid_t), load);
+			if(!load){
+				log__printf(NULL, MOSQ_LOG_ERR, "Error: Corrupt database whilst restoring a retained message.");
+				return MOSQ_ERR_INVAL;
+			}
+			sub__messages_queue(db, NULL, load->store->topic, load->store->qos, load->store->retain, &load->store);
+			break;
+
+		case DB_CHUNK_SUB:
+			if(persist__restore_sub(db, rec->u.sub.client_id, rec->u.sub.topic, rec->u.sub.qos)) return 1;
+			break;
+
+		case DB_CHUNK_INDEX:
+			break;
+
+		default:
+			log__printf(NULL, MOSQ_LOG_WARNING, "Warning: Unsupported chunk \"%d\" in persistent database file. Ignoring.", rec->chunk);
+			break;
+	}
+	return MOSQ_ERR_SUCCESS;
+}
+
+/* Returns -1 if the file has no usable index, in which case it should be read
+ * chunk by chunk instead. */
+static int persist__snapshot_restore_mapped(struct mosquitto_db *db)
+{
+	int fd;
+	struct stat st;
+	uint8_t *map;
+	size_t size;
+	uint64_t index_offset, offset;
+	uint32_t i32temp, length, count, i;
+	uint16_t i16temp;
+	const uint8_t *index_data;
+	struct persist__record *records;
+	int rc = MOSQ_ERR_SUCCESS;
+	int thread_count;
+	bool in_clients;
+	const size_t header_len = 15 + sizeof(uint32_t) + sizeof(uint32_t);
+	const size_t chunk_header_len = sizeof(uint16_t) + sizeof(uint32_t);
+
+	fd = open(db->config->persistence_filepath, O_RDONLY);
+	if(fd < 0) return -1;
+	if(fstat(fd, &st) < 0 || (size_t)st.st_size < header_len + chunk_header_len + sizeof(uint32_t) + sizeof(uint64_t)){
+		close(fd);
+		return -1;
+	}
+	size = st.st_size;
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) return -1;
+	madvise(map, size, MADV_WILLNEED);
+
+	memcpy(&i32temp, &map[15+sizeof(uint32_t)], sizeof(uint32_t));
+	if(memcmp(map, magic, 15) || ntohl(i32temp) != MOSQ_DB_VERSION){
+		munmap(map, size);
+		return -1;
+	}
+
+	/* Locate and check the index. */
+	memcpy(&index_offset, &map[size-sizeof(uint64_t)], sizeof(uint64_t));
+	index_offset = persist__ntohll(index_offset);
+	if(index_offset < header_len || index_offset > size - chunk_header_len - sizeof(uint32_t) - sizeof(uint64_t)){
+		munmap(map, size);
+		return -1;
+	}
+	memcpy(&i16temp, &map[index_offset], sizeof(uint16_t));
+	memcpy(&i32temp, &map[index_offset+sizeof(uint16_t)], sizeof(uint32_t));
+	length = ntohl(i32temp);
+	index_data = &map[index_offset+chunk_header_len];
+	memcpy(&i32temp, index_data, sizeof(uint32_t));
+	count = ntohl(i32temp);
+	if(ntohs(i16temp) != DB_CHUNK_INDEX
+			|| length != size - index_offset - chunk_header_len
+			|| (uint64_t)length != sizeof(uint32_t) + (uint64_t)count*sizeof(uint64_t) + sizeof(uint64_t)){
+
+		munmap(map, size);
+		return -1;
+	}
+	index_data += sizeof(uint32_t);
+
+	db_version = MOSQ_DB_VERSION;
+	records = mosquitto__calloc(count ? count : 1, sizeof(struct persist__record));
+	if(!records){
+		munmap(map, size);
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Out of memory.");
+		return MOSQ_ERR_NOMEM;
+	}
+	for(i=0; i<count; i++){
+		memcpy(&offset, &index_data[i*sizeof(uint64_t)], sizeof(uint64_t));
+		offset = persist__ntohll(offset);
+		if(offset < header_len || offset > index_offset - chunk_header_len){
+			rc = MOSQ_ERR_INVAL;
+			break;
+		}
+		memcpy(&i16temp, &map[offset], sizeof(uint16_t));
+		memcpy(&i32temp, &map[offset+sizeof(uint16_t)], sizeof(uint32_t));
+		records[i].chunk = ntohs(i16temp);
+		records[i].length = ntohl(i32temp);
+		records[i].data = &map[offset+chunk_header_len];
+		if(records[i].length > index_offset - offset - chunk_header_len){
+			rc = MOSQ_ERR_INVAL;
+			break;
+		}
+	}
+
+	if(rc == MOSQ_ERR_SUCCESS && restore_spool){
+		/* Spilled messages are decoded one at a time as they are linked, so
+		 * that they can go back to disk without all being held in memory at
+		 * once. */
+		in_clients = false;
+		for(i=0; i<count; i++){
+			if(records[i].chunk == DB_CHUNK_CLIENT){
+				in_clients = true;
+			}else if(records[i].chunk == DB_CHUNK_MSG_STORE && in_clients){
+				records[i].deferred = true;
+			}
+		}
+	}
+	if(rc == MOSQ_ERR_SUCCESS){
+		thread_count = persist__records_decode(records, count);
+		log__printf(NULL, MOSQ_LOG_INFO, "Decoded %u persistent database chunks on %d thread%s.",
+				count, thread_count, thread_count == 1 ? "" : "s");
+
+		for(i=0; i<count; i++){
+			rc = persist__record_link(db, &records[i]);
+			persist__record_free(&records[i]);
+			if(rc) break;
+		}
+		for(; i<count; i++){
+			persist__record_free(&records[i]);
+		}
+	}
+	if(rc){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error restoring persistent database, file is corrupt.");
+		rc = 1;
+	}
+
+	mosquitto__free(records);
+	munmap(map, size);
+	return rc;
+}
+#endif
+
+static int persist__snapshot_restore(struct mosquitto_db *db)
+{
+	FILE *fptr;
+	char header[15];
+	int rc = 0;
+	uint32_t crc;
+	uint32_t i32temp, length;
+	uint16_t i16temp, chunk;
+	ssize_t rlen;
+	char err[256];
+
+#ifndef WIN32
+	rc = persist__snapshot_restore_mapped(db);
+	if(rc != -1) return rc;
+	rc = 0;
+#endif
 
 	fptr = mosquitto__fopen(db->config->persistence_filepath, "rb", false);
 	if(fptr == NULL) return MOSQ_ERR_SUCCESS;
@@ -865,45 +1897,7 @@ int persist__restore(struct mosquitto_db *db)
 			chunk = ntohs(i16temp);
 			read_e(fptr, &i32temp, sizeof(uint32_t));
 			length = ntohl(i32temp);
-			switch(chunk){
-				case DB_CHUNK_CFG:
-					read_e(fptr, &i8temp, sizeof(uint8_t)); // shutdown
-					read_e(fptr, &i8temp, sizeof(uint8_t)); // sizeof(dbid_t)
-					if(i8temp != sizeof(dbid_t)){
-						log__printf(NULL, MOSQ_LOG_ERR, "Error: Incompatible database configuration (dbid size is %d bytes, expected %lu)",
-								i8temp, (unsigned long)sizeof(dbid_t));
-						fclose(fptr);
-						return 1;
-					}
-					read_e(fptr, &i64temp, sizeof(dbid_t));
-					db->last_db_id = i64temp;
-					break;
-
-				case DB_CHUNK_MSG_STORE:
-					if(persist__msg_store_chunk_restore(db, fptr)) return 1;
-					break;
-
-				case DB_CHUNK_CLIENT_MSG:
-					if(persist__client_msg_chunk_restore(db, fptr)) return 1;
-					break;
-
-				case DB_CHUNK_RETAIN:
-					if(persist__retain_chunk_restore(db, fptr)) return 1;
-					break;
-
-				case DB_CHUNK_SUB:
-					if(persist__sub_chunk_restore(db, fptr)) return 1;
-					break;
-
-				case DB_CHUNK_CLIENT:
-					if(persist__client_chunk_restore(db, fptr)) return 1;
-					break;
-
-				default:
-					log__printf(NULL, MOSQ_LOG_WARNING, "Warning: Unsupported chunk \"%d\" in persistent database file. Ignoring.", chunk);
-					fseek(fptr, length, SEEK_CUR);
-					break;
-			}
+			if(persist__chunk_restore(db, fptr, chunk, length)) return 1;
 		}
 		if(rlen < 0) goto error;
 	}else{
@@ -912,11 +1906,6 @@ int persist__restore(struct mosquitto_db *db)
 	}
 
 	fclose(fptr);
-
-	HASH_ITER(hh, db->msg_store_load, load, load_tmp){
-		HASH_DELETE(hh, db->msg_store_load, load);
-		mosquitto__free(load);
-	}
 	return rc;
 error:
 	strerror_r(errno, err, 256);
@@ -925,6 +1914,141 @@ error:
 	return 1;
 }
 
+/* Replay a persistence log on top of the state restored from the snapshot.
+ * Logs older than the snapshot are already contained in it and are skipped.
+ * A record cut short by a crash at the end of the log is ignored. */
+static int persist__log_replay(struct mosquitto_db *db, const char *filename, uint64_t *replayed_gen)
+{
+	FILE *fptr;
+	char header[15];
+	uint32_t crc;
+	uint32_t i32temp, length;
+	uint16_t i16temp, chunk;
+	uint64_t log_gen;
+	struct stat st;
+	long pos;
+	int count = 0;
+	char err[256];
+
+	fptr = mosquitto__fopen(filename, "rb", false);
+	if(fptr == NULL) return MOSQ_ERR_SUCCESS;
+
+	if(fstat(fileno(fptr), &st) < 0) goto error;
+	if(fread(&header, 1, 15, fptr) != 15 || memcmp(header, log_magic, 15)){
+		fclose(fptr);
+		log__printf(NULL, MOSQ_LOG_WARNING, "Warning: Ignoring persistence log %s, unrecognised file format.", filename);
+		return MOSQ_ERR_SUCCESS;
+	}
+	read_e(fptr, &crc, sizeof(uint32_t));
+	read_e(fptr, &i32temp, sizeof(uint32_t));
+	if(ntohl(i32temp) > MOSQ_DB_LOG_VERSION){
+		fclose(fptr);
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Unsupported persistence log format version %d (need version %d).", ntohl(i32temp), MOSQ_DB_LOG_VERSION);
+		return 1;
+	}
+	read_e(fptr, &log_gen, sizeof(uint64_t));
+	if(log_gen < db->persist_log_gen){
+		fclose(fptr);
+		log__printf(NULL, MOSQ_LOG_DEBUG, "Ignoring persistence log %s, already contained in %s.", filename, db->config->persistence_filepath);
+		return MOSQ_ERR_SUCCESS;
+	}
+
+	while(fread(&i16temp, sizeof(uint16_t), 1, fptr) == 1){
+		chunk = ntohs(i16temp);
+		pos = -1;
+		if(fread(&i32temp, sizeof(uint32_t), 1, fptr) == 1){
+			length = ntohl(i32temp);
+			pos = ftell(fptr);
+		}
+		if(pos < 0 || pos + (off_t)length > st.st_size){
+			log__printf(NULL, MOSQ_LOG_WARNING, "Warning: Persistence log %s ends with an incomplete record, ignoring it.", filename);
+			break;
+		}
+		if(persist__chunk_restore(db, fptr, chunk, length)) return 1;
+		count++;
+	}
+	fclose(fptr);
+
+	if(log_gen > *replayed_gen){
+		*replayed_gen = log_gen;
+	}
+	log__printf(NULL, MOSQ_LOG_INFO, "Replayed %d records from persistence log %s.", count, filename);
+	return MOSQ_ERR_SUCCESS;
+error:
+	strerror_r(errno, err, 256);
+	log__printf(NULL, MOSQ_LOG_ERR, "Error: %s.", err);
+	fclose(fptr);
+	return 1;
+}
+
+int persist__restore(struct mosquitto_db *db)
+{
+	int rc;
+	uint64_t replayed_gen = 0;
+	char *log_old = NULL, *log_cur = NULL;
+	struct mosquitto_msg_store_load *load, *load_tmp;
+	struct mosquitto *context, *ctxt_tmp;
+	struct stat st;
+	long start_ms;
+
+	assert(db);
+	assert(db->config);
+	assert(db->config->persistence_filepath);
+
+	start_ms = persist__time_ms();
+	db->msg_store_load = NULL;
+	db->persist_log_gen = 0;
+
+	log_old = persist__filename(db, ".log.old");
+	log_cur = persist__filename(db, ".log");
+	if(!log_old || !log_cur){
+		mosquitto__free(log_old);
+		mosquitto__free(log_cur);
+		return MOSQ_ERR_NOMEM;
+	}
+
+	/* A log may update or delete queued messages, which it can only do while
+	 * they are in memory. */
+	restore_spool = db->config->queue_spill_bytes > 0
+			&& stat(log_old, &st) != 0 && stat(log_cur, &st) != 0;
+	restore_in_clients = false;
+	restore_spilled_load = NULL;
+	rc = persist__snapshot_restore(db);
+	restore_spool = false;
+	restore_spilled_load = NULL;
+	if(rc == MOSQ_ERR_SUCCESS){
+		rc = persist__log_replay(db, log_old, &replayed_gen);
+	}
+	if(rc == MOSQ_ERR_SUCCESS){
+		rc = persist__log_replay(db, log_cur, &replayed_gen);
+	}
+	mosquitto__free(log_old);
+	mosquitto__free(log_cur);
+
+	if(replayed_gen && replayed_gen >= db->persist_log_gen){
+		db->persist_log_gen = replayed_gen + 1;
+	}
+
+	HASH_ITER(hh, db->msg_store_load, load, load_tmp){
+		HASH_DELETE(hh, db->msg_store_load, load);
+		if(load->store){
+			db__msg_store_deref(db, &load->store);
+		}
+		mosquitto__free(load);
+	}
+	if(rc == MOSQ_ERR_SUCCESS){
+		/* Queues restored for offline clients are held to the same memory
+		 * budget as ones built up while the broker was running. Without a log
+		 * this was done as the snapshot was read, otherwise whatever is over
+		 * the budget once the log has been replayed is spilled now. */
+		HASH_ITER(hh_id, db->contexts_by_id, context, ctxt_tmp){
+			spool__trim(db, context);
+		}
+		log__printf(NULL, MOSQ_LOG_INFO, "Restored in-memory database in %ld ms.", persist__time_ms() - start_ms);
+	}
+	return rc;
+}
+
 static int persist__restore_sub(struct mosquitto_db *db, const char *client_id, const char *sub, int qos)
 {
 	struct mosquitto *context;
@@ -938,4 +2062,450 @@ static int persist__restore_sub(struct mosquitto_db *db, const char *client_id,
 	return sub__add(db, context, sub, qos, &db->subs);
 }
 
+/* Persistence log
+ *
+ * With persistence_log enabled every change to persistent state is appended to
+ * <persistence_file>.log as it happens, so the autosave no longer needs to
+ * write a complete snapshot while the event loop waits. Instead the log is
+ * rotated to <persistence_file>.log.old and a forked child writes the snapshot
+ * from its copy of memory. Once the child has finished the old log is no
+ * longer needed. On restart the snapshot is loaded, then any log generation
+ * it does not already contain is replayed on top of it.
+ */
+
+static void persist__log_close(struct mosquitto_db *db)
+{
+	if(!db->persist_log) return;
+
+	fflush(db->persist_log);
+#ifndef WIN32
+	fsync(fileno(db->persist_log));
+#endif
+	fclose(db->persist_log);
+	db->persist_log = NULL;
+	db->persist_log_dirty = false;
+}
+
+static FILE *persist__log_create(struct mosquitto_db *db, const char *filename, bool append)
+{
+	FILE *fptr;
+	uint32_t crc = htonl(0);
+	uint32_t version = htonl(MOSQ_DB_LOG_VERSION);
+	uint64_t log_gen = db->persist_log_gen;
+
+	if(append){
+		fptr = mosquitto__fopen(filename, "ab", true);
+		if(!fptr){
+			log__printf(NULL, MOSQ_LOG_ERR, "Error: Unable to open persistence log %s: %s.", filename, strerror(errno));
+		}
+		return fptr;
+	}
+
+#ifndef WIN32
+	if(unlink(filename) != 0 && errno != ENOENT){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Unable to remove %s: %s.", filename, strerror(errno));
+		return NULL;
+	}
+#endif
+	fptr = mosquitto__fopen(filename, "wb", true);
+	if(!fptr){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Unable to open persistence log %s: %s.", filename, strerror(errno));
+		return NULL;
+	}
+	write_e(fptr, log_magic, 15);
+	write_e(fptr, &crc, sizeof(uint32_t));
+	write_e(fptr, &version, sizeof(uint32_t));
+	write_e(fptr, &log_gen, sizeof(uint64_t));
+	if(fflush(fptr) != 0) goto error;
+#ifndef WIN32
+	fsync(fileno(fptr));
+#endif
+	return fptr;
+error:
+	log__printf(NULL, MOSQ_LOG_ERR, "Error: Unable to write persistence log %s: %s.", filename, strerror(errno));
+	fclose(fptr);
+	return NULL;
+}
+
+/* Mark the stored messages the snapshot being written holds. The others are
+ * written to the new log when a client or retained message needs them. */
+static void persist__log_mark_all(struct mosquitto_db *db)
+{
+	struct mosquitto_msg_store *stored;
+
+	for(stored = db->msg_store; stored; stored = stored->next){
+		stored->persist_logged = !persist__msg_store_skipped(stored);
+	}
+}
+
+static void persist__log_error(struct mosquitto_db *db)
+{
+	log__printf(NULL, MOSQ_LOG_ERR, "Error: Unable to write to persistence log, changes will not be saved until the next autosave.");
+	fclose(db->persist_log);
+	db->persist_log = NULL;
+	db->persist_log_dirty = false;
+}
+
+#ifndef WIN32
+/* Returns 0 if there is no background save or it is still running or it
+ * completed successfully, 1 if it failed. */
+static int persist__log_child_check(struct mosquitto_db *db, bool block)
+{
+	pid_t pid;
+	int status;
+	char *log_old;
+
+	if(db->persist_log_child <= 0) return MOSQ_ERR_SUCCESS;
+
+	do{
+		pid = waitpid(db->persist_log_child, &status, block?0:WNOHANG);
+	}while(pid < 0 && errno == EINTR);
+	if(pid == 0) return MOSQ_ERR_SUCCESS;
+
+	db->persist_log_child = 0;
+	if(pid > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0){
+		log_old = persist__filename(db, ".log.old");
+		if(log_old){
+			unlink(log_old);
+			mosquitto__free(log_old);
+		}
+		log__printf(NULL, MOSQ_LOG_INFO, "Background save of in-memory database complete.");
+		return MOSQ_ERR_SUCCESS;
+	}
+	log__printf(NULL, MOSQ_LOG_ERR, "Error: Background save of in-memory database failed.");
+	return 1;
+}
+#endif
+
+/* Write a snapshot with the event loop stopped, then start a new log. */
+static int persist__log_snapshot(struct mosquitto_db *db, bool shutdown)
+{
+	char *log_cur, *log_old;
+	int rc;
+
+	log_cur = persist__filename(db, ".log");
+	log_old = persist__filename(db, ".log.old");
+	if(!log_cur || !log_old){
+		mosquitto__free(log_cur);
+		mosquitto__free(log_old);
+		return MOSQ_ERR_NOMEM;
+	}
+
+#ifndef WIN32
+	persist__log_child_check(db, true);
+#endif
+	persist__log_close(db);
+
+	db->persist_log_gen++;
+	rc = persist__snapshot_write(db, shutdown);
+	if(rc){
+		/* The existing logs are still needed on top of the old snapshot, so
+		 * carry on appending to the current one. */
+		db->persist_log_gen--;
+		if(!shutdown && db->config->persistence_log){
+			db->persist_log = persist__log_create(db, log_cur, true);
+		}
+	}else{
+		unlink(log_cur);
+		unlink(log_old);
+		persist__log_mark_all(db);
+		if(!shutdown && db->config->persistence_log){
+			db->persist_log = persist__log_create(db, log_cur, false);
+		}
+	}
+	db->persist_log_sync_t = persist__time_ms();
+
+	mosquitto__free(log_cur);
+	mosquitto__free(log_old);
+	return rc;
+}
+
+#ifndef WIN32
+static int persist__log_compact(struct mosquitto_db *db)
+{
+	char *log_cur, *log_old;
+	struct stat st;
+	long start_ms;
+	pid_t pid;
+
+	if(db->persist_log_child > 0){
+		log__printf(NULL, MOSQ_LOG_DEBUG, "Background save of in-memory database already in progress.");
+		return MOSQ_ERR_SUCCESS;
+	}
+
+	log_cur = persist__filename(db, ".log");
+	log_old = persist__filename(db, ".log.old");
+	if(!log_cur || !log_old){
+		mosquitto__free(log_cur);
+		mosquitto__free(log_old);
+		return MOSQ_ERR_NOMEM;
+	}
+	if(stat(log_old, &st) == 0){
+		/* A previous background save failed, so the old log is still needed
+		 * and can't be replaced. */
+		mosquitto__free(log_cur);
+		mosquitto__free(log_old);
+		return persist__log_snapshot(db, false);
+	}
+
+	start_ms = persist__time_ms();
+	persist__log_close(db);
+	if(rename(log_cur, log_old) != 0){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Unable to rename %s: %s.", log_cur, strerror(errno));
+		mosquitto__free(log_cur);
+		mosquitto__free(log_old);
+		return persist__log_snapshot(db, false);
+	}
+	db->persist_log_gen++;
+	db->persist_log = persist__log_create(db, log_cur, false);
+	db->persist_log_sync_t = persist__time_ms();
+	persist__log_mark_all(db);
+	mosquitto__free(log_cur);
+	mosquitto__free(log_old);
+
+	pid = fork();
+	if(pid == 0){
+		/* Child: the snapshot is written from the memory image at the time of
+		 * the fork, everything after that goes into the new log. */
+		_exit(persist__snapshot_write(db, false) ? 1 : 0);
+	}else if(pid < 0){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Unable to start background save: %s.", strerror(errno));
+		return persist__log_snapshot(db, false);
+	}
+	db->persist_log_child = pid;
+	log__printf(NULL, MOSQ_LOG_INFO, "Saving in-memory database to %s in the background, event loop paused for %ld ms.",
+			db->config->persistence_filepath, persist__time_ms() - start_ms);
+	return MOSQ_ERR_SUCCESS;
+}
+#endif
+
+int persist__backup(struct mosquitto_db *db, bool shutdown)
+{
+	if(!db || !db->config || !db->config->persistence_filepath) return MOSQ_ERR_INVAL;
+
+	if(db->config->persistence_log){
+#ifndef WIN32
+		if(!shutdown){
+			return persist__log_compact(db);
+		}
+#endif
+		return persist__log_snapshot(db, shutdown);
+	}
+	return persist__snapshot_write(db, shutdown);
+}
+
+int persist__log_open(struct mosquitto_db *db)
+{
+	char *log_cur, *log_old;
+	struct stat st;
+	int rc = MOSQ_ERR_SUCCESS;
+
+	if(!db->config->persistence || !db->config->persistence_filepath) return MOSQ_ERR_SUCCESS;
+
+	log_cur = persist__filename(db, ".log");
+	log_old = persist__filename(db, ".log.old");
+	if(!log_cur || !log_old){
+		mosquitto__free(log_cur);
+		mosquitto__free(log_old);
+		return MOSQ_ERR_NOMEM;
+	}
+
+	if(db->config->persistence_log && db->persist_log_gen == 0){
+		db->persist_log_gen = 1;
+	}
+	if(stat(log_cur, &st) == 0 || stat(log_old, &st) == 0){
+		/* Fold whatever was replayed into a fresh snapshot so the logs can
+		 * start again from empty. */
+		rc = persist__snapshot_write(db, false);
+		if(rc == MOSQ_ERR_SUCCESS){
+			unlink(log_cur);
+			unlink(log_old);
+		}
+	}
+	if(rc == MOSQ_ERR_SUCCESS && db->config->persistence_log){
+		db->persist_log = persist__log_create(db, log_cur, false);
+		if(!db->persist_log) rc = 1;
+		db->persist_log_sync_t = persist__time_ms();
+	}
+
+	mosquitto__free(log_cur);
+	mosquitto__free(log_old);
+	return rc;
+}
+
+int persist__log_sync(struct mosquitto_db *db)
+{
+	long now;
+
+#ifndef WIN32
+	if(persist__log_child_check(db, false)){
+		return persist__log_snapshot(db, false);
+	}
+#endif
+	if(!db->persist_log || !db->persist_log_dirty) return MOSQ_ERR_SUCCESS;
+
+	now = persist__time_ms();
+	if(db->config->persistence_log_sync_interval > 0
+			&& now - db->persist_log_sync_t < db->config->persistence_log_sync_interval){
+
+		return MOSQ_ERR_SUCCESS;
+	}
+	if(fflush(db->persist_log) != 0){
+		persist__log_error(db);
+		return 1;
+	}
+#ifndef WIN32
+	fsync(fileno(db->persist_log));
+#endif
+	db->persist_log_dirty = false;
+	db->persist_log_sync_t = now;
+	return MOSQ_ERR_SUCCESS;
+}
+
+static int persist__log_msg_store(struct mosquitto_db *db, struct mosquitto_msg_store *stored)
+{
+	bool force_no_retain;
+
+	if(stored->persist_logged) return MOSQ_ERR_SUCCESS;
+
+	force_no_retain = stored->topic && !strncmp(stored->topic, "$SYS", 4);
+	if(persist__msg_store_chunk_write(db->persist_log, stored, force_no_retain)) return 1;
+	stored->persist_logged = true;
+	return MOSQ_ERR_SUCCESS;
+}
+
+static int persist__log_string_write(FILE *db_fptr, const char *str)
+{
+	uint16_t i16temp, slen;
+
+	slen = strlen(str);
+	i16temp = htons(slen);
+	write_e(db_fptr, &i16temp, sizeof(uint16_t));
+	write_e(db_fptr, str, slen);
+	return MOSQ_ERR_SUCCESS;
+error:
+	return 1;
+}
+
+void persist__log_client(struct mosquitto_db *db, struct mosquitto *context)
+{
+	if(!db->persist_log || context->clean_session || !context->id) return;
+
+	if(persist__client_chunk_write(db->persist_log, context)){
+		persist__log_error(db);
+		return;
+	}
+	db->persist_log_dirty = true;
+}
+
+void persist__log_client_delete(struct mosquitto_db *db, const char *client_id)
+{
+	if(!db->persist_log || !client_id) return;
+
+	if(persist__chunk_header_write(db->persist_log, DB_CHUNK_CLIENT_DELETE, 2+strlen(client_id))
+			|| persist__log_string_write(db->persist_log, client_id)){
+
+		persist__log_error(db);
+		return;
+	}
+	db->persist_log_dirty = true;
+}
+
+void persist__log_client_msg(struct mosquitto_db *db, struct mosquitto *context, struct mosquitto_client_msg *cmsg)
+{
+	if(!db->persist_log || context->clean_session || !context->id) return;
+
+	if(persist__log_msg_store(db, cmsg->store)
+			|| persist__client_msg_chunk_write(db->persist_log, context, cmsg)){
+
+		persist__log_error(db);
+		return;
+	}
+	db->persist_log_dirty = true;
+}
+
+void persist__log_client_msg_update(struct mosquitto_db *db, struct mosquitto *context, uint16_t mid, enum mosquitto_msg_direction dir, enum mosquitto_msg_state state)
+{
+	uint8_t i8temp;
+	uint16_t i16temp;
+
+	if(!db->persist_log || context->clean_session || !context->id) return;
+
+	if(persist__chunk_header_write(db->persist_log, DB_CHUNK_CLIENT_MSG_UPDATE, 2+strlen(context->id) + sizeof(uint16_t) + 2*sizeof(uint8_t))
+			|| persist__log_string_write(db->persist_log, context->id)){
+
+		goto error;
+	}
+	i16temp = htons(mid);
+	write_e(db->persist_log, &i16temp, sizeof(uint16_t));
+	i8temp = (uint8_t )dir;
+	write_e(db->persist_log, &i8temp, sizeof(uint8_t));
+	i8temp = (uint8_t )state;
+	write_e(db->persist_log, &i8temp, sizeof(uint8_t));
+	db->persist_log_dirty = true;
+	return;
+error:
+	persist__log_error(db);
+}
+
+void persist__log_client_msg_delete(struct mosquitto_db *db, struct mosquitto *context, uint16_t mid, enum mosquitto_msg_direction dir)
+{
+	uint8_t i8temp;
+	uint16_t i16temp;
+
+	if(!db->persist_log || context->clean_session || !context->id) return;
+
+	if(persist__chunk_header_write(db->persist_log, DB_CHUNK_CLIENT_MSG_DELETE, 2+strlen(context->id) + sizeof(uint16_t) + sizeof(uint8_t))
+			|| persist__log_string_write(db->persist_log, context->id)){
+
+		goto error;
+	}
+	i16temp = htons(mid);
+	write_e(db->persist_log, &i16temp, sizeof(uint16_t));
+	i8temp = (uint8_t )dir;
+	write_e(db->persist_log, &i8temp, sizeof(uint8_t));
+	db->persist_log_dirty = true;
+	return;
+error:
+	persist__log_error(db);
+}
+
+void persist__log_sub(struct mosquitto_db *db, struct mosquitto *context, const char *topic, int qos)
+{
+	if(!db->persist_log || context->clean_session || !context->id) return;
+
+	if(persist__sub_chunk_write(db->persist_log, context->id, topic, qos)){
+		persist__log_error(db);
+		return;
+	}
+	db->persist_log_dirty = true;
+}
+
+void persist__log_sub_delete(struct mosquitto_db *db, struct mosquitto *context, const char *topic)
+{
+	if(!db->persist_log || context->clean_session || !context->id) return;
+
+	if(persist__chunk_header_write(db->persist_log, DB_CHUNK_SUB_DELETE, 2+strlen(context->id) + 2+strlen(topic))
+			|| persist__log_string_write(db->persist_log, context->id)
+			|| persist__log_string_write(db->persist_log, topic)){
+
+		persist__log_error(db);
+		return;
+	}
+	db->persist_log_dirty = true;
+}
+
+void persist__log_retain(struct mosquitto_db *db, struct mosquitto_msg_store *stored)
+{
+	if(!db->persist_log) return;
+
+	if(persist__log_msg_store(db, stored)
+			|| persist__retain_chunk_write(db->persist_log, stored)){
+
+		persist__log_error(db);
+		return;
+	}
+	db->persist_log_dirty = true;
+}
+
 #endif
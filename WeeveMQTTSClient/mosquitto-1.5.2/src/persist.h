@@ -27,8 +27,21 @@ const unsigned char magic[15] = {0x00, 0xB5, 0x00, 'm','o','s','q','u','i','t','
 #define DB_CHUNK_RETAIN 4
 #define DB_CHUNK_SUB 5
 #define DB_CHUNK_CLIENT 6
+#define DB_CHUNK_LOG_GEN 7
+/* Persistence log only */
+#define DB_CHUNK_CLIENT_DELETE 8
+#define DB_CHUNK_CLIENT_MSG_UPDATE 9
+#define DB_CHUNK_CLIENT_MSG_DELETE 10
+#define DB_CHUNK_SUB_DELETE 11
+/* Snapshot only, always the last chunk in the file */
+#define DB_CHUNK_INDEX 12
 /* End DB read/write */
 
+/* Persistence log read/write */
+#define MOSQ_DB_LOG_VERSION 1
+const unsigned char log_magic[15] = {0x00, 0xB5, 0x00, 'm','o','s','q','u','i','t','t','o',' ','l','g'};
+/* End persistence log read/write */
+
 #define read_e(f, b, c) if(fread(b, 1, c, f) != c){ goto error; }
 #define write_e(f, b, c) if(fwrite(b, 1, c, f) != c){ goto error; }
 
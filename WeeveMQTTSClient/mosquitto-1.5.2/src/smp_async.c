@@ -0,0 +1,317 @@
+/*
+Copyright (c) 2010-2018 Roger Light <roger@atchoo.org>
+
+All rights reserved. This program and the accompanying materials
+are made available under the terms of the Eclipse Public License v1.0
+and Eclipse Distribution License v1.0 which accompany this distribution.
+
+The Eclipse Public License is available at
+   http://www.eclipse.org/legal/epl-v10.html
+and the Eclipse Distribution License is available at
+  http://www.eclipse.org/org/documents/edl-v10.php.
+
+Contributors:
+   Roger Light - initial implementation and documentation.
+*/
+
+#include "config.h"
+
+#if defined(WITH_WEEVE_SMP)
+
+#include <assert.h>
+
+#include "mosquitto_broker_internal.h"
+#include "memory_mosq.h"
+#include "net_mosq.h"
+#include "packet_mosq.h"
+#include "workers.h"
+
+#include "wclCommon.h"
+#include "wclSmp.h"
+
+/* Processing of received SMP messages on a pool of worker threads.
+ *
+ * With smp_worker_threads set, packet__read() hands each SMP message it has
+ * read in full to smp_async__queue() rather than processing it there, and goes
+ * on reading. The messages of a client are submitted to
+ * wclSmpProcessMessageAsync() as they arrive, apart from during the session
+ * establishment, when each has to have been handled before the next one is
+ * submitted. Completions are queued by the library, and the executor wakes
+ * the main loop through an eventfd, or a socket pair where there is none.
+ * The main loop then takes the completions with
+ * smp_async__handle_completions() and hands the MQTT packets to the broker in
+ * the order the messages were received, so a slow signature check or storage
+ * lookup for one client doesn't hold up the others.
+ *
+ * Sending is unchanged, the broker still seals packets on the main thread.
+ */
+
+struct mosquitto__smp_job{
+	struct mosquitto__smp_job *next;
+	/* NULL once the client has gone, the job is then freed when its
+	 * completion comes in. */
+	struct mosquitto *context;
+	WosBuffer_t smp_message;
+	WosBuffer_t mqtt_packet;
+	WclError_t result;
+	bool submitted;
+	bool done;
+};
+
+struct mosquitto__smp_async{
+	struct mosquitto__workers *workers;
+	mosq_sock_t wakeR;
+	mosq_sock_t wakeW;
+};
+
+
+static WclError_t smp_async__executor_submit(void *pContext, WclSmpJobFunction_t jobFunction, void *pJob)
+{
+	struct mosquitto__smp_async *async = pContext;
+
+	if(workers__submit(async->workers, jobFunction, pJob)){
+		return WCL_ERROR_OUT_OF_MEMORY;
+	}
+	return WCL_SUCCESS;
+}
+
+
+/* Called on a worker thread. */
+static void smp_async__executor_notify(void *pContext)
+{
+	struct mosquitto__smp_async *async = pContext;
+
+	net__socketpair_wake(async->wakeW);
+}
+
+
+static void smp_async__job_free(struct mosquitto__smp_job *job)
+{
+	mosquitto__free(job->smp_message.data);
+	wclFreeBuffer(&job->mqtt_packet);
+	mosquitto__free(job);
+}
+
+
+/* Submit the messages of a client that are waiting for it. */
+static int smp_async__submit_queued(struct mosquitto *context)
+{
+	struct mosquitto__smp_job *job;
+
+	for(job=context->smp_jobs; job; job=job->next){
+		if(job->submitted){
+			continue;
+		}
+		/* Until the session is established, each message needs the one
+		 * before it to have been handled. */
+		if(job != context->smp_jobs && context->state != mosq_cs_connected){
+			break;
+		}
+		if(wclSmpProcessMessageAsync(context->smpSession, &job->smp_message, NULL, job) != WCL_SUCCESS){
+			return MOSQ_ERR_NOMEM;
+		}
+		job->submitted = true;
+	}
+	return MOSQ_ERR_SUCCESS;
+}
+
+
+/* Hand the MQTT packets of the messages at the head of the client's queue
+ * that have been processed to the broker. */
+static void smp_async__deliver(struct mosquitto_db *db, struct mosquitto *context)
+{
+	struct mosquitto__smp_job *job;
+	int rc = MOSQ_ERR_SUCCESS;
+
+	while(context->smp_jobs && context->smp_jobs->done){
+		job = context->smp_jobs;
+		context->smp_jobs = job->next;
+		if(!context->smp_jobs){
+			context->smp_jobs_last = NULL;
+		}
+
+		if(rc == MOSQ_ERR_SUCCESS && context->sock != INVALID_SOCKET){
+			if(job->result == WCL_SUCCESS && job->mqtt_packet.data && job->mqtt_packet.length){
+				context->in_packet.mqttPacket = job->mqtt_packet;
+				job->mqtt_packet.data = NULL;
+				job->mqtt_packet.length = 0;
+				rc = packet__handle_smp_message(db, context);
+			}else{
+				rc = MOSQ_ERR_PROTOCOL;
+			}
+		}
+		smp_async__job_free(job);
+	}
+
+	if(rc == MOSQ_ERR_SUCCESS && context->sock != INVALID_SOCKET){
+		rc = smp_async__submit_queued(context);
+	}
+	if(rc && context->sock != INVALID_SOCKET){
+		do_disconnect(db, context);
+	}
+}
+
+
+int smp_async__init(struct mosquitto_db *db)
+{
+	struct mosquitto__smp_async *async;
+	WclSmpExecutor_t executor;
+	int rc;
+
+	if(db->config->smp_worker_threads == 0){
+		return MOSQ_ERR_SUCCESS;
+	}
+
+	async = mosquitto__calloc(1, sizeof(struct mosquitto__smp_async));
+	if(!async){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Out of memory.");
+		return MOSQ_ERR_NOMEM;
+	}
+	if(net__socketpair(&async->wakeR, &async->wakeW)){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Unable to create SMP worker wake up socket.");
+		mosquitto__free(async);
+		return MOSQ_ERR_UNKNOWN;
+	}
+	rc = workers__start(&async->workers, db->config->smp_worker_threads);
+	if(rc){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Unable to start SMP worker threads.");
+		net__socketpair_close(&async->wakeR, &async->wakeW);
+		mosquitto__free(async);
+		return rc;
+	}
+
+	executor.submit = smp_async__executor_submit;
+	executor.notify = smp_async__executor_notify;
+	executor.pContext = async;
+	if(wclSmpSetExecutor(&executor) != WCL_SUCCESS){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Unable to set SMP executor.");
+		workers__stop(async->workers);
+		net__socketpair_close(&async->wakeR, &async->wakeW);
+		mosquitto__free(async);
+		return MOSQ_ERR_UNKNOWN;
+	}
+	db->smp_async = async;
+	return MOSQ_ERR_SUCCESS;
+}
+
+
+void smp_async__cleanup(struct mosquitto_db *db)
+{
+	struct mosquitto__smp_async *async = db->smp_async;
+
+	if(!async) return;
+
+	/* Every client has closed its session, so only the completions of
+	 * messages they gave up on can be left. */
+	workers__stop(async->workers);
+	smp_async__handle_completions(db);
+	wclSmpSetExecutor(NULL);
+	net__socketpair_close(&async->wakeR, &async->wakeW);
+	mosquitto__free(async);
+	db->smp_async = NULL;
+}
+
+
+mosq_sock_t smp_async__wake_sock(struct mosquitto_db *db)
+{
+	return db->smp_async ? db->smp_async->wakeR : INVALID_SOCKET;
+}
+
+
+int smp_async__queue(struct mosquitto_db *db, struct mosquitto *context, uint8_t *smp_message, uint32_t length)
+{
+	struct mosquitto__smp_job *job;
+
+	assert(db->smp_async);
+
+	job = mosquitto__calloc(1, sizeof(struct mosquitto__smp_job));
+	if(!job){
+		mosquitto__free(smp_message);
+		return MOSQ_ERR_NOMEM;
+	}
+	job->context = context;
+	job->smp_message.data = smp_message;
+	job->smp_message.length = length;
+	job->result = WCL_ERROR;
+
+	if(context->smp_jobs_last){
+		context->smp_jobs_last->next = job;
+	}else{
+		context->smp_jobs = job;
+	}
+	context->smp_jobs_last = job;
+
+	return smp_async__submit_queued(context);
+}
+
+
+void smp_async__handle_completions(struct mosquitto_db *db)
+{
+	WclSmpCompletion_t completion;
+	struct mosquitto__smp_job *job;
+	bool has_completion = false;
+
+	if(!db->smp_async) return;
+
+	/* Anything completing after this wakes the next pass. */
+	net__socketpair_drain(db->smp_async->wakeR);
+	while(wclSmpPollCompletion(&completion, &has_completion) == WCL_SUCCESS && has_completion){
+		job = completion.pUserData;
+		job->result = completion.result;
+		job->mqtt_packet = completion.output;
+		job->done = true;
+		if(job->context){
+			smp_async__deliver(db, job->context);
+		}else{
+			smp_async__job_free(job);
+		}
+	}
+}
+
+
+void smp_async__flush(struct mosquitto_db *db, struct mosquitto *context)
+{
+	if(!db->smp_async) return;
+
+	/* Without this a client that sends DISCONNECT and closes its connection
+	 * would be seen to have gone before the DISCONNECT was handled, and have
+	 * its will published. */
+	while(context->smp_jobs && context->smp_jobs->submitted && context->sock != INVALID_SOCKET){
+		workers__wait_idle(db->smp_async->workers);
+		smp_async__handle_completions(db);
+	}
+}
+
+
+void smp_async__close_session(struct mosquitto_db *db, struct mosquitto *context)
+{
+	struct mosquitto__smp_job *job, *next;
+	WclError_t wclStatus;
+
+	for(job=context->smp_jobs; job; job=next){
+		next = job->next;
+		if(job->submitted && !job->done){
+			job->context = NULL;
+			job->next = NULL;
+		}else{
+			smp_async__job_free(job);
+		}
+	}
+	context->smp_jobs = NULL;
+	context->smp_jobs_last = NULL;
+
+	if(!context->smpSession) return;
+	wclStatus = wclSmpClose(context->smpSession);
+	if(wclStatus == WCL_ERROR_BAD_SESSION && db && db->smp_async){
+		/* Messages of the session are still with the workers. */
+		workers__wait_idle(db->smp_async->workers);
+		wclStatus = wclSmpClose(context->smpSession);
+	}
+	if(wclStatus != WCL_SUCCESS){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Unable to close SMP session of client %s (%d).",
+				context->id ? context->id : "<unknown>", wclStatus);
+	}
+	context->smpSession = NULL;
+}
+
+#endif
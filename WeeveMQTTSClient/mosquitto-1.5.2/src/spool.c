@@ -0,0 +1,504 @@
+/*
+Copyright (c) 2010-2018 Roger Light <roger@atchoo.org>
+
+All rights reserved. This program and the accompanying materials
+are made available under the terms of the Eclipse Public License v1.0
+and Eclipse Distribution License v1.0 which accompany this distribution.
+
+The Eclipse Public License is available at
+   http://www.eclipse.org/legal/epl-v10.html
+and the Eclipse Distribution License is available at
+  http://www.eclipse.org/org/documents/edl-v10.php.
+
+Contributors:
+   Roger Light - initial implementation and documentation.
+*/
+
+#include "config.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+#include "mosquitto_broker_internal.h"
+#include "memory_mosq.h"
+#include "time_mosq.h"
+
+#ifndef WIN32
+
+/* Fixed part of a spool record. It is followed by the source id, the topic and
+ * the payload. Spool files never outlive the broker process, so the header is
+ * written in host byte order. */
+struct spool__header{
+	dbid_t db_id;
+	uint32_t payloadlen;
+	uint16_t source_mid;
+	uint16_t mid;
+	uint16_t source_id_len;
+	uint16_t topic_len;
+	uint8_t store_qos;
+	uint8_t store_retain;
+	uint8_t qos;
+	uint8_t retain;
+};
+
+/* Records up to this size are written and read with a single system call. */
+#define SPOOL_BUF_SIZE 4096
+
+
+static int spool__pwrite(int fd, const void *buf, size_t len, uint64_t pos)
+{
+	ssize_t rc;
+
+	while(len > 0){
+		rc = pwrite(fd, buf, len, (off_t)pos);
+		if(rc < 0){
+			if(errno == EINTR) continue;
+			return 1;
+		}
+		buf = (const uint8_t *)buf + rc;
+		len -= rc;
+		pos += rc;
+	}
+	return MOSQ_ERR_SUCCESS;
+}
+
+
+static int spool__pread(int fd, void *buf, size_t len, uint64_t pos)
+{
+	ssize_t rc;
+
+	while(len > 0){
+		rc = pread(fd, buf, len, (off_t)pos);
+		if(rc < 0){
+			if(errno == EINTR) continue;
+			return 1;
+		}else if(rc == 0){
+			errno = EIO;
+			return 1;
+		}
+		buf = (uint8_t *)buf + rc;
+		len -= rc;
+		pos += rc;
+	}
+	return MOSQ_ERR_SUCCESS;
+}
+
+
+static struct mosquitto__spool *spool__open(struct mosquitto_db *db, struct mosquitto *context)
+{
+	struct mosquitto__spool *spool;
+	const char *location;
+	char *filename;
+	int len;
+
+	spool = mosquitto__calloc(1, sizeof(struct mosquitto__spool));
+	if(!spool) return NULL;
+	spool->fd = -1;
+
+	if(db->config->queue_spill_location){
+		location = db->config->queue_spill_location;
+	}else if(db->config->persistence_location){
+		location = db->config->persistence_location;
+	}else{
+		location = "";
+	}
+	len = strlen(location) + strlen("mosquitto-spool-XXXXXX") + 1;
+	filename = mosquitto__malloc(len);
+	if(!filename){
+		mosquitto__free(spool);
+		return NULL;
+	}
+	snprintf(filename, len, "%smosquitto-spool-XXXXXX", location);
+
+	spool->fd = mkstemp(filename);
+	if(spool->fd == -1){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Unable to create queue spill file %s: %s. Messages for client %s will be kept in memory.",
+				filename, strerror(errno), context->id);
+	}else{
+		/* Nothing else ever opens the file, so it is removed straight away
+		 * and disappears with the broker. */
+		unlink(filename);
+		log__printf(NULL, MOSQ_LOG_NOTICE,
+				"Outgoing messages for client %s are being spilled to disk.",
+				context->id);
+	}
+	mosquitto__free(filename);
+	return spool;
+}
+
+
+bool spool__wanted(struct mosquitto_db *db, struct mosquitto *context, enum mosquitto_msg_direction dir, enum mosquitto_msg_state state, uint32_t payloadlen)
+{
+	if(dir != mosq_md_out) return false;
+
+	if(context->spool){
+		if(context->spool->fd == -1) return false;
+		/* Anything newer than a spooled message must follow it onto disk,
+		 * otherwise it would overtake it when the client reconnects. */
+		if(context->spool->msg_count) return true;
+	}
+	if(db->config->queue_spill_bytes == 0
+			|| state != mosq_ms_queued
+			|| context->sock != INVALID_SOCKET){
+
+		return false;
+	}
+	return context->msg_bytes + payloadlen > db->config->queue_spill_bytes;
+}
+
+
+int spool__message_add(struct mosquitto_db *db, struct mosquitto *context, struct mosquitto_client_msg *msg)
+{
+	struct mosquitto__spool *spool;
+	struct mosquitto_msg_store *stored = msg->store;
+	struct spool__header header;
+	uint8_t buf[SPOOL_BUF_SIZE];
+	size_t len, slen, tlen;
+
+	if(!context->spool){
+		context->spool = spool__open(db, context);
+		if(!context->spool) return MOSQ_ERR_NOMEM;
+	}
+	spool = context->spool;
+	if(spool->fd == -1) return MOSQ_ERR_UNKNOWN;
+
+	slen = strlen(stored->source_id);
+	tlen = stored->topic ? strlen(stored->topic) : 0;
+
+	memset(&header, 0, sizeof(header));
+	/* Each record gets its own id, so a snapshot taken while the message is
+	 * on disk never collides with a store still held in memory. */
+	header.db_id = ++db->last_db_id;
+	header.payloadlen = stored->payloadlen;
+	header.source_mid = stored->source_mid;
+	header.mid = msg->mid;
+	header.source_id_len = slen;
+	header.topic_len = tlen;
+	header.store_qos = stored->qos;
+	header.store_retain = stored->retain;
+	header.qos = msg->qos;
+	header.retain = msg->retain;
+
+	len = sizeof(header) + slen + tlen;
+	if(len + stored->payloadlen <= SPOOL_BUF_SIZE){
+		memcpy(buf, &header, sizeof(header));
+		memcpy(&buf[sizeof(header)], stored->source_id, slen);
+		if(tlen) memcpy(&buf[sizeof(header)+slen], stored->topic, tlen);
+		if(stored->payloadlen){
+			memcpy(&buf[len], UHPA_ACCESS_PAYLOAD(stored), stored->payloadlen);
+		}
+		if(spool__pwrite(spool->fd, buf, len + stored->payloadlen, spool->write_pos)) goto error;
+	}else{
+		if(len <= SPOOL_BUF_SIZE){
+			memcpy(buf, &header, sizeof(header));
+			memcpy(&buf[sizeof(header)], stored->source_id, slen);
+			if(tlen) memcpy(&buf[sizeof(header)+slen], stored->topic, tlen);
+			if(spool__pwrite(spool->fd, buf, len, spool->write_pos)) goto error;
+		}else{
+			if(spool__pwrite(spool->fd, &header, sizeof(header), spool->write_pos)) goto error;
+			if(spool__pwrite(spool->fd, stored->source_id, slen, spool->write_pos+sizeof(header))) goto error;
+			if(spool__pwrite(spool->fd, stored->topic, tlen, spool->write_pos+sizeof(header)+slen)) goto error;
+		}
+		if(spool__pwrite(spool->fd, UHPA_ACCESS_PAYLOAD(stored), stored->payloadlen, spool->write_pos+len)) goto error;
+	}
+
+	spool->write_pos += len + stored->payloadlen;
+	spool->msg_count++;
+	spool->msg_bytes += stored->payloadlen;
+	if(msg->qos > 0){
+		spool->msg_count12++;
+		spool->msg_bytes12 += stored->payloadlen;
+	}
+	return MOSQ_ERR_SUCCESS;
+error:
+	log__printf(NULL, MOSQ_LOG_ERR, "Error: Unable to write to queue spill file for client %s: %s.",
+			context->id, strerror(errno));
+	return MOSQ_ERR_UNKNOWN;
+}
+
+
+void spool__msg_store_free(struct mosquitto_msg_store *stored)
+{
+	if(!stored) return;
+
+	mosquitto__free(stored->source_id);
+	mosquitto__free(stored->topic);
+	UHPA_FREE_PAYLOAD(stored);
+	mosquitto__free(stored);
+}
+
+
+static int spool__string_copy(char **dest, const uint8_t *src, uint16_t len)
+{
+	*dest = mosquitto__malloc(len+1);
+	if(!(*dest)) return MOSQ_ERR_NOMEM;
+	memcpy(*dest, src, len);
+	(*dest)[len] = '\0';
+	return MOSQ_ERR_SUCCESS;
+}
+
+
+int spool__message_read(struct mosquitto__spool *spool, uint64_t *pos, struct mosquitto_msg_store **stored_out, struct mosquitto_client_msg *msg)
+{
+	struct mosquitto_msg_store *stored;
+	struct spool__header header;
+	uint8_t buf[SPOOL_BUF_SIZE];
+	uint64_t available;
+	size_t len, got;
+	int rc;
+
+	assert(*pos < spool->write_pos);
+
+	available = spool->write_pos - *pos;
+	got = available < SPOOL_BUF_SIZE ? (size_t)available : SPOOL_BUF_SIZE;
+	if(got < sizeof(header)) return MOSQ_ERR_INVAL;
+	if(spool__pread(spool->fd, buf, got, *pos)) return MOSQ_ERR_UNKNOWN;
+	memcpy(&header, buf, sizeof(header));
+
+	len = sizeof(header) + header.source_id_len + header.topic_len;
+	if(len + header.payloadlen > available) return MOSQ_ERR_INVAL;
+
+	stored = mosquitto__calloc(1, sizeof(struct mosquitto_msg_store));
+	if(!stored) return MOSQ_ERR_NOMEM;
+
+	if(len > got){
+		/* Unusually long topic, read the strings separately. */
+		rc = spool__pread(spool->fd, buf, header.source_id_len, *pos+sizeof(header)) ? MOSQ_ERR_UNKNOWN : MOSQ_ERR_SUCCESS;
+		if(!rc) rc = spool__string_copy(&stored->source_id, buf, header.source_id_len);
+		if(!rc){
+			stored->topic = mosquitto__malloc(header.topic_len+1);
+			if(!stored->topic){
+				rc = MOSQ_ERR_NOMEM;
+			}else if(spool__pread(spool->fd, stored->topic, header.topic_len, *pos+sizeof(header)+header.source_id_len)){
+				rc = MOSQ_ERR_UNKNOWN;
+			}else{
+				stored->topic[header.topic_len] = '\0';
+			}
+		}
+	}else{
+		rc = spool__string_copy(&stored->source_id, &buf[sizeof(header)], header.source_id_len);
+		if(!rc) rc = spool__string_copy(&stored->topic, &buf[sizeof(header)+header.source_id_len], header.topic_len);
+	}
+	if(rc) goto error;
+
+	stored->db_id = header.db_id;
+	stored->source_mid = header.source_mid;
+	stored->qos = header.store_qos;
+	stored->retain = header.store_retain;
+	stored->payloadlen = header.payloadlen;
+	if(stored->payloadlen){
+		if(UHPA_ALLOC_PAYLOAD(stored) == 0){
+			stored->payloadlen = 0;
+			rc = MOSQ_ERR_NOMEM;
+			goto error;
+		}
+		if(len + stored->payloadlen <= got){
+			memcpy(UHPA_ACCESS_PAYLOAD(stored), &buf[len], stored->payloadlen);
+		}else if(spool__pread(spool->fd, UHPA_ACCESS_PAYLOAD(stored), stored->payloadlen, *pos+len)){
+			rc = MOSQ_ERR_UNKNOWN;
+			goto error;
+		}
+	}
+
+	memset(msg, 0, sizeof(struct mosquitto_client_msg));
+	msg->mid = header.mid;
+	msg->qos = header.qos;
+	msg->retain = header.retain;
+	msg->direction = mosq_md_out;
+	msg->state = mosq_ms_queued;
+
+	*pos += len + stored->payloadlen;
+	*stored_out = stored;
+	return MOSQ_ERR_SUCCESS;
+error:
+	spool__msg_store_free(stored);
+	return rc;
+}
+
+
+/* Move the oldest spooled messages back into the in-memory queue until it is
+ * back up to the memory budget. */
+int spool__page_in(struct mosquitto_db *db, struct mosquitto *context)
+{
+	struct mosquitto__spool *spool = context->spool;
+	struct mosquitto_msg_store *stored;
+	struct mosquitto_client_msg *msg;
+	struct mosquitto_client_msg tmp;
+	unsigned long limit = db->config->queue_spill_bytes;
+	int rc;
+
+	while(spool->msg_count){
+		if(context->queued_msgs && limit && context->msg_bytes - spool->msg_bytes >= limit){
+			break;
+		}
+
+		rc = spool__message_read(spool, &spool->read_pos, &stored, &tmp);
+		if(rc){
+			log__printf(NULL, MOSQ_LOG_ERR, "Error: Unable to read queue spill file for client %s, %d messages lost.",
+					context->id, spool->msg_count);
+			context->msg_count -= spool->msg_count;
+			context->msg_bytes -= spool->msg_bytes;
+			context->msg_count12 -= spool->msg_count12;
+			context->msg_bytes12 -= spool->msg_bytes12;
+			spool__free(context);
+			/* Carry on with whatever is still in memory. */
+			return MOSQ_ERR_SUCCESS;
+		}
+
+		spool->msg_count--;
+		spool->msg_bytes -= stored->payloadlen;
+		if(tmp.qos > 0){
+			spool->msg_count12--;
+			spool->msg_bytes12 -= stored->payloadlen;
+		}
+
+		/* Access may have changed since the message was spooled. */
+		if(mosquitto_acl_check(db, context, stored->topic, stored->payloadlen, UHPA_ACCESS_PAYLOAD(stored),
+					stored->qos, stored->retain, MOSQ_ACL_READ) != MOSQ_ERR_SUCCESS){
+
+			context->msg_count--;
+			context->msg_bytes -= stored->payloadlen;
+			if(tmp.qos > 0){
+				context->msg_count12--;
+				context->msg_bytes12 -= stored->payloadlen;
+			}
+			spool__msg_store_free(stored);
+			continue;
+		}
+
+		msg = mosquitto__malloc(sizeof(struct mosquitto_client_msg));
+		if(!msg){
+			spool__msg_store_free(stored);
+			return MOSQ_ERR_NOMEM;
+		}
+		memcpy(msg, &tmp, sizeof(struct mosquitto_client_msg));
+		msg->timestamp = mosquitto_time();
+
+		db->msg_store_count++;
+		db->msg_store_bytes += stored->payloadlen;
+		db__msg_store_add(db, stored);
+		stored->ref_count++;
+		msg->store = stored;
+
+		if(context->last_queued_msg){
+			context->last_queued_msg->next = msg;
+		}else{
+			context->queued_msgs = msg;
+		}
+		context->last_queued_msg = msg;
+	}
+
+	if(spool->msg_count == 0){
+		/* Drained, start the file again from the beginning. */
+		spool->read_pos = 0;
+		spool->write_pos = 0;
+		if(ftruncate(spool->fd, 0)){
+			log__printf(NULL, MOSQ_LOG_WARNING, "Warning: Unable to truncate queue spill file for client %s: %s.",
+					context->id, strerror(errno));
+		}
+	}
+	return MOSQ_ERR_SUCCESS;
+}
+
+
+/* Spill the part of an offline client's in-memory queue that is over budget,
+ * as happens after restoring a persistent database. */
+int spool__trim(struct mosquitto_db *db, struct mosquitto *context)
+{
+	struct mosquitto_client_msg *msg, *prev = NULL, *next;
+	unsigned long limit = db->config->queue_spill_bytes;
+	unsigned long bytes = 0;
+
+	if(limit == 0 || context->sock != INVALID_SOCKET) return MOSQ_ERR_SUCCESS;
+	if(context->spool && context->spool->msg_count) return MOSQ_ERR_SUCCESS;
+
+	for(msg = context->inflight_msgs; msg; msg = msg->next){
+		bytes += msg->store->payloadlen;
+	}
+	for(msg = context->queued_msgs; msg; msg = msg->next){
+		if(bytes + msg->store->payloadlen > limit) break;
+		bytes += msg->store->payloadlen;
+		prev = msg;
+	}
+	if(!msg) return MOSQ_ERR_SUCCESS;
+
+	/* Only outgoing messages can be spooled, leave the queue alone if
+	 * anything else is in the part that would be spilled. */
+	for(next = msg; next; next = next->next){
+		if(next->direction != mosq_md_out) return MOSQ_ERR_SUCCESS;
+	}
+
+	while(msg){
+		if(spool__message_add(db, context, msg)){
+			/* Whatever couldn't be written stays in memory. */
+			break;
+		}
+		next = msg->next;
+		db__msg_store_deref(db, &msg->store);
+		mosquitto__free(msg);
+		msg = next;
+	}
+	if(prev){
+		prev->next = msg;
+	}else{
+		context->queued_msgs = msg;
+	}
+	if(!msg){
+		context->last_queued_msg = prev;
+	}
+	return MOSQ_ERR_SUCCESS;
+}
+
+
+void spool__free(struct mosquitto *context)
+{
+	if(!context->spool) return;
+
+	if(context->spool->fd != -1){
+		close(context->spool->fd);
+	}
+	mosquitto__free(context->spool);
+	context->spool = NULL;
+}
+
+#else
+
+bool spool__wanted(struct mosquitto_db *db, struct mosquitto *context, enum mosquitto_msg_direction dir, enum mosquitto_msg_state state, uint32_t payloadlen)
+{
+	return false;
+}
+
+int spool__message_add(struct mosquitto_db *db, struct mosquitto *context, struct mosquitto_client_msg *msg)
+{
+	return MOSQ_ERR_NOT_SUPPORTED;
+}
+
+void spool__msg_store_free(struct mosquitto_msg_store *stored)
+{
+}
+
+int spool__message_read(struct mosquitto__spool *spool, uint64_t *pos, struct mosquitto_msg_store **stored_out, struct mosquitto_client_msg *msg)
+{
+	return MOSQ_ERR_NOT_SUPPORTED;
+}
+
+int spool__page_in(struct mosquitto_db *db, struct mosquitto *context)
+{
+	return MOSQ_ERR_SUCCESS;
+}
+
+int spool__trim(struct mosquitto_db *db, struct mosquitto *context)
+{
+	return MOSQ_ERR_SUCCESS;
+}
+
+void spool__free(struct mosquitto *context)
+{
+}
+
+#endif
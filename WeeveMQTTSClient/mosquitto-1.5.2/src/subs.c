@@ -61,15 +61,108 @@ struct sub__token {
 	uint16_t topic_len;
 };
 
-static int subs__process(struct mosquitto_db *db, struct mosquitto__subhier *hier, const char *source_id, const char *topic, int qos, int retain, struct mosquitto_msg_store *stored, bool set_retain)
+/* Keep the retained message counts of a node and all of its ancestors up to
+ * date, so that retained message searches can skip branches with nothing
+ * retained below them. */
+static void retain__index_update(struct mosquitto__subhier *hier, bool add)
+{
+	while(hier){
+		if(add){
+			hier->retained_total++;
+		}else{
+			hier->retained_total--;
+		}
+		hier = hier->parent;
+	}
+}
+
+/* Queue a message for one subscriber. Returns the ACL check result, any
+ * failure to queue the message is reported through rc. */
+static int subs__send(struct mosquitto_db *db, struct mosquitto__subleaf *leaf, const char *topic, int qos, int retain, struct mosquitto_msg_store *stored, int *rc)
 {
-	int rc = 0;
 	int rc2;
 	int client_qos, msg_qos;
 	uint16_t mid;
-	struct mosquitto__subleaf *leaf;
 	bool client_retain;
 
+	/* Check for ACL topic access. */
+	rc2 = mosquitto_acl_check(db, leaf->context, topic, stored->payloadlen, UHPA_ACCESS(stored->payload, stored->payloadlen), stored->qos, stored->retain, MOSQ_ACL_READ);
+	if(rc2 != MOSQ_ERR_SUCCESS){
+		return rc2;
+	}
+	client_qos = leaf->qos;
+
+	if(db->config->upgrade_outgoing_qos){
+		msg_qos = client_qos;
+	}else{
+		if(qos > client_qos){
+			msg_qos = client_qos;
+		}else{
+			msg_qos = qos;
+		}
+	}
+	if(msg_qos){
+		mid = mosquitto__mid_generate(leaf->context);
+	}else{
+		mid = 0;
+	}
+	if(leaf->context->is_bridge){
+		/* If we know the client is a bridge then we should set retain
+		 * even if the message is fresh. If we don't do this, retained
+		 * messages won't be propagated. */
+		client_retain = retain;
+	}else{
+		/* Client is not a bridge and this isn't a stale message so
+		 * retain should be false. */
+		client_retain = false;
+	}
+	if(db__message_insert(db, leaf->context, mid, mosq_md_out, msg_qos, client_retain, stored) == 1) *rc = 1;
+	return MOSQ_ERR_SUCCESS;
+}
+
+/* Deliver a message to one member of a shared subscription group. Members are
+ * taken in turn, so picking one is O(1) unless members have to be skipped.
+ * With least_inflight the member after the next one is looked at as well, and
+ * the one with fewer messages waiting is used. */
+static int subs__shared_process(struct mosquitto_db *db, struct mosquitto__subshared *shared, const char *source_id, const char *topic, int qos, int retain, struct mosquitto_msg_store *stored)
+{
+	int rc = 0;
+	int rc2;
+	int i;
+	struct mosquitto__subleaf *leaf, *next;
+
+	leaf = shared->next_leaf ? shared->next_leaf : shared->subs;
+	for(i=0; i<shared->count; i++){
+		next = leaf->next ? leaf->next : shared->subs;
+		shared->next_leaf = next;
+
+		if(db->config->shared_sub_policy == ssp_least_inflight
+				&& next != leaf
+				&& next->context->msg_count < leaf->context->msg_count){
+
+			leaf = next;
+		}
+		if(leaf->context->id && !(leaf->context->is_bridge && !strcmp(leaf->context->id, source_id))){
+			rc2 = subs__send(db, leaf, topic, qos, retain, stored, &rc);
+			if(rc2 == MOSQ_ERR_SUCCESS){
+				return rc;
+			}else if(rc2 != MOSQ_ERR_ACL_DENIED){
+				return 1; /* Application error */
+			}
+		}
+		/* Not allowed to have this one, try the next member. */
+		leaf = next;
+	}
+	return rc;
+}
+
+static int subs__process(struct mosquitto_db *db, struct mosquitto__subhier *hier, const char *source_id, const char *topic, int qos, int retain, struct mosquitto_msg_store *stored, bool set_retain)
+{
+	int rc = 0;
+	int rc2;
+	struct mosquitto__subleaf *leaf;
+	struct mosquitto__subshared *shared, *shared_tmp;
+
 	leaf = hier->subs;
 
 	if(retain && set_retain){
@@ -78,10 +171,12 @@ static int subs__process(struct mosquitto_db *db, struct mosquitto__subhier *hie
 			/* Retained messages count as a persistence change, but only if
 			 * they aren't for $SYS. */
 			db->persistence_changes++;
+			persist__log_retain(db, stored);
 		}
 #endif
 		if(hier->retained){
 			db__msg_store_deref(db, &hier->retained);
+			retain__index_update(hier, false);
 #ifdef WITH_SYS_TREE
 			db->retained_count--;
 #endif
@@ -89,6 +184,7 @@ static int subs__process(struct mosquitto_db *db, struct mosquitto__subhier *hie
 		if(stored->payloadlen){
 			hier->retained = stored;
 			hier->retained->ref_count++;
+			retain__index_update(hier, true);
 #ifdef WITH_SYS_TREE
 			db->retained_count++;
 #endif
@@ -101,44 +197,17 @@ static int subs__process(struct mosquitto_db *db, struct mosquitto__subhier *hie
 			leaf = leaf->next;
 			continue;
 		}
-		/* Check for ACL topic access. */
-		rc2 = mosquitto_acl_check(db, leaf->context, topic, stored->payloadlen, UHPA_ACCESS(stored->payload, stored->payloadlen), stored->qos, stored->retain, MOSQ_ACL_READ);
-		if(rc2 == MOSQ_ERR_ACL_DENIED){
-			leaf = leaf->next;
-			continue;
-		}else if(rc2 == MOSQ_ERR_SUCCESS){
-			client_qos = leaf->qos;
-
-			if(db->config->upgrade_outgoing_qos){
-				msg_qos = client_qos;
-			}else{
-				if(qos > client_qos){
-					msg_qos = client_qos;
-				}else{
-					msg_qos = qos;
-				}
-			}
-			if(msg_qos){
-				mid = mosquitto__mid_generate(leaf->context);
-			}else{
-				mid = 0;
-			}
-			if(leaf->context->is_bridge){
-				/* If we know the client is a bridge then we should set retain
-				 * even if the message is fresh. If we don't do this, retained
-				 * messages won't be propagated. */
-				client_retain = retain;
-			}else{
-				/* Client is not a bridge and this isn't a stale message so
-				 * retain should be false. */
-				client_retain = false;
-			}
-			if(db__message_insert(db, leaf->context, mid, mosq_md_out, msg_qos, client_retain, stored) == 1) rc = 1;
-		}else{
+		rc2 = subs__send(db, leaf, topic, qos, retain, stored, &rc);
+		if(rc2 != MOSQ_ERR_SUCCESS && rc2 != MOSQ_ERR_ACL_DENIED){
 			return 1; /* Application error */
 		}
 		leaf = leaf->next;
 	}
+	if(source_id){
+		HASH_ITER(hh, hier->shared, shared, shared_tmp){
+			if(subs__shared_process(db, shared, source_id, topic, qos, retain, stored)) rc = 1;
+		}
+	}
 	return rc;
 }
 
@@ -245,16 +314,159 @@ static void sub__topic_tokens_free(struct sub__token *tokens)
 	}
 }
 
-static int sub__add_recurse(struct mosquitto_db *db, struct mosquitto *context, int qos, struct mosquitto__subhier *subhier, struct sub__token *tokens)
+/* Record on the client which node one of its subscriptions is on, so that
+ * sub__clean_session() can find it. */
+static int sub__context_hier_add(struct mosquitto *context, struct mosquitto__subhier *subhier)
+{
+	struct mosquitto__subhier **subs;
+	int i;
+
+	for(i=0; i<context->sub_count; i++){
+		if(!context->subs[i]){
+			context->subs[i] = subhier;
+			return MOSQ_ERR_SUCCESS;
+		}
+	}
+	subs = mosquitto__realloc(context->subs, sizeof(struct mosquitto__subhier *)*(context->sub_count + 1));
+	if(!subs){
+		return MOSQ_ERR_NOMEM;
+	}
+	context->subs = subs;
+	context->sub_count++;
+	context->subs[context->sub_count-1] = subhier;
+	return MOSQ_ERR_SUCCESS;
+}
+
+static void sub__context_hier_remove(struct mosquitto *context, struct mosquitto__subhier *subhier)
+{
+	int i;
+
+	/* Remove the reference to the sub that the client is keeping.
+	 * It would be nice to be able to use the reference directly,
+	 * but that would involve keeping a copy of the topic string in
+	 * each subleaf. Might be worth considering though. */
+	for(i=0; i<context->sub_count; i++){
+		if(context->subs[i] == subhier){
+			context->subs[i] = NULL;
+			break;
+		}
+	}
+}
+
+static int sub__shared_add(struct mosquitto_db *db, struct mosquitto *context, int qos, struct mosquitto__subhier *subhier, const char *sharename, size_t sharename_len)
+{
+	struct mosquitto__subshared *shared;
+	struct mosquitto__subleaf *leaf, *last_leaf;
+
+	HASH_FIND(hh, subhier->shared, sharename, sharename_len, shared);
+	if(!shared){
+		shared = mosquitto__calloc(1, sizeof(struct mosquitto__subshared));
+		if(!shared) return MOSQ_ERR_NOMEM;
+		shared->name = mosquitto__malloc(sharename_len+1);
+		if(!shared->name){
+			mosquitto__free(shared);
+			return MOSQ_ERR_NOMEM;
+		}
+		memcpy(shared->name, sharename, sharename_len);
+		shared->name[sharename_len] = '\0';
+		HASH_ADD_KEYPTR(hh, subhier->shared, shared->name, sharename_len, shared);
+	}
+
+	leaf = shared->subs;
+	last_leaf = NULL;
+	while(leaf){
+		if(leaf->context && leaf->context->id && !strcmp(leaf->context->id, context->id)){
+			/* Already a member, only need to update QoS. */
+			leaf->qos = qos;
+			return -1;
+		}
+		last_leaf = leaf;
+		leaf = leaf->next;
+	}
+	leaf = mosquitto__malloc(sizeof(struct mosquitto__subleaf));
+	if(!leaf) goto error;
+	leaf->next = NULL;
+	leaf->context = context;
+	leaf->qos = qos;
+	if(sub__context_hier_add(context, subhier)){
+		mosquitto__free(leaf);
+		goto error;
+	}
+	if(last_leaf){
+		last_leaf->next = leaf;
+		leaf->prev = last_leaf;
+	}else{
+		shared->subs = leaf;
+		leaf->prev = NULL;
+	}
+	shared->count++;
+#ifdef WITH_SYS_TREE
+	db->subscription_count++;
+#endif
+	return MOSQ_ERR_SUCCESS;
+
+error:
+	if(!shared->subs){
+		HASH_DELETE(hh, subhier->shared, shared);
+		mosquitto__free(shared->name);
+		mosquitto__free(shared);
+	}
+	return MOSQ_ERR_NOMEM;
+}
+
+/* Take a client out of a shared subscription group on this node, or out of
+ * whichever group it is in if sharename is NULL. Returns true if it was found. */
+static bool sub__shared_remove(struct mosquitto_db *db, struct mosquitto *context, struct mosquitto__subhier *subhier, const char *sharename, size_t sharename_len)
+{
+	struct mosquitto__subshared *shared, *shared_tmp;
+	struct mosquitto__subleaf *leaf;
+
+	HASH_ITER(hh, subhier->shared, shared, shared_tmp){
+		if(sharename && (strlen(shared->name) != sharename_len || strncmp(shared->name, sharename, sharename_len))){
+			continue;
+		}
+		for(leaf=shared->subs; leaf; leaf=leaf->next){
+			if(leaf->context != context) continue;
+
+#ifdef WITH_SYS_TREE
+			db->subscription_count--;
+#endif
+			if(shared->next_leaf == leaf){
+				shared->next_leaf = leaf->next;
+			}
+			if(leaf->prev){
+				leaf->prev->next = leaf->next;
+			}else{
+				shared->subs = leaf->next;
+			}
+			if(leaf->next){
+				leaf->next->prev = leaf->prev;
+			}
+			mosquitto__free(leaf);
+			shared->count--;
+
+			if(!shared->subs){
+				HASH_DELETE(hh, subhier->shared, shared);
+				mosquitto__free(shared->name);
+				mosquitto__free(shared);
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+static int sub__add_recurse(struct mosquitto_db *db, struct mosquitto *context, int qos, struct mosquitto__subhier *subhier, struct sub__token *tokens, const char *sharename, size_t sharename_len)
 	/* FIXME - this function has the potential to leak subhier, audit calling functions. */
 {
 	struct mosquitto__subhier *branch;
 	struct mosquitto__subleaf *leaf, *last_leaf;
-	struct mosquitto__subhier **subs;
-	int i;
 
 	if(!tokens){
 		if(context && context->id){
+			if(sharename){
+				return sub__shared_add(db, context, qos, subhier, sharename, sharename_len);
+			}
 			leaf = subhier->subs;
 			last_leaf = NULL;
 			while(leaf){
@@ -279,21 +491,9 @@ static int sub__add_recurse(struct mosquitto_db *db, struct mosquitto *context,
 			leaf->next = NULL;
 			leaf->context = context;
 			leaf->qos = qos;
-			for(i=0; i<context->sub_count; i++){
-				if(!context->subs[i]){
-					context->subs[i] = subhier;
-					break;
-				}
-			}
-			if(i == context->sub_count){
-				subs = mosquitto__realloc(context->subs, sizeof(struct mosquitto__subhier *)*(context->sub_count + 1));
-				if(!subs){
-					mosquitto__free(leaf);
-					return MOSQ_ERR_NOMEM;
-				}
-				context->subs = subs;
-				context->sub_count++;
-				context->subs[context->sub_count-1] = subhier;
+			if(sub__context_hier_add(context, subhier)){
+				mosquitto__free(leaf);
+				return MOSQ_ERR_NOMEM;
 			}
 			if(last_leaf){
 				last_leaf->next = leaf;
@@ -311,23 +511,28 @@ static int sub__add_recurse(struct mosquitto_db *db, struct mosquitto *context,
 
 	HASH_FIND(hh, subhier->children, UHPA_ACCESS_TOPIC(tokens), tokens->topic_len, branch);
 	if(branch){
-		return sub__add_recurse(db, context, qos, branch, tokens->next);
+		return sub__add_recurse(db, context, qos, branch, tokens->next, sharename, sharename_len);
 	}else{
 		/* Not found */
 		branch = sub__add_hier_entry(subhier, &subhier->children, UHPA_ACCESS_TOPIC(tokens), tokens->topic_len);
 		if(!branch) return MOSQ_ERR_NOMEM;
 
-		return sub__add_recurse(db, context, qos, branch, tokens->next);
+		return sub__add_recurse(db, context, qos, branch, tokens->next, sharename, sharename_len);
 	}
 }
 
-static int sub__remove_recurse(struct mosquitto_db *db, struct mosquitto *context, struct mosquitto__subhier *subhier, struct sub__token *tokens)
+static int sub__remove_recurse(struct mosquitto_db *db, struct mosquitto *context, struct mosquitto__subhier *subhier, struct sub__token *tokens, const char *sharename, size_t sharename_len)
 {
 	struct mosquitto__subhier *branch;
 	struct mosquitto__subleaf *leaf;
-	int i;
 
 	if(!tokens){
+		if(sharename){
+			if(sub__shared_remove(db, context, subhier, sharename, sharename_len)){
+				sub__context_hier_remove(context, subhier);
+			}
+			return MOSQ_ERR_SUCCESS;
+		}
 		leaf = subhier->subs;
 		while(leaf){
 			if(leaf->context==context){
@@ -344,16 +549,7 @@ static int sub__remove_recurse(struct mosquitto_db *db, struct mosquitto *contex
 				}
 				mosquitto__free(leaf);
 
-				/* Remove the reference to the sub that the client is keeping.
-				 * It would be nice to be able to use the reference directly,
-				 * but that would involve keeping a copy of the topic string in
-				 * each subleaf. Might be worth considering though. */
-				for(i=0; i<context->sub_count; i++){
-					if(context->subs[i] == subhier){
-						context->subs[i] = NULL;
-						break;
-					}
-				}
+				sub__context_hier_remove(context, subhier);
 				return MOSQ_ERR_SUCCESS;
 			}
 			leaf = leaf->next;
@@ -363,8 +559,8 @@ static int sub__remove_recurse(struct mosquitto_db *db, struct mosquitto *contex
 
 	HASH_FIND(hh, subhier->children, UHPA_ACCESS_TOPIC(tokens), tokens->topic_len, branch);
 	if(branch){
-		sub__remove_recurse(db, context, branch, tokens->next);
-		if(!branch->children && !branch->subs && !branch->retained){
+		sub__remove_recurse(db, context, branch, tokens->next, sharename, sharename_len);
+		if(!branch->children && !branch->subs && !branch->shared && !branch->retained){
 			HASH_DELETE(hh, subhier->children, branch);
 			UHPA_FREE_TOPIC(branch);
 			mosquitto__free(branch);
@@ -428,8 +624,10 @@ struct mosquitto__subhier *sub__add_hier_entry(struct mosquitto__subhier *parent
 		strncpy(UHPA_ACCESS_TOPIC(child), topic, child->topic_len+1);
 	}
 	child->subs = NULL;
+	child->shared = NULL;
 	child->children = NULL;
 	child->retained = NULL;
+	child->retained_total = 0;
 
 	if(child->topic_len+1 > sizeof(child->topic.array)){
 		if(child->topic.ptr){
@@ -446,21 +644,54 @@ struct mosquitto__subhier *sub__add_hier_entry(struct mosquitto__subhier *parent
 }
 
 
+/* Split a $share/<name>/<filter> subscription into its group name and filter.
+ * Other subscriptions are left as they are, with a NULL name. */
+static int sub__shared_split(const char **sub, const char **sharename, size_t *sharename_len)
+{
+	const char *name, *filter;
+
+	*sharename = NULL;
+	*sharename_len = 0;
+	if(strncmp(*sub, "$share/", strlen("$share/"))){
+		return MOSQ_ERR_SUCCESS;
+	}
+	name = *sub + strlen("$share/");
+	filter = strchr(name, '/');
+	if(!filter || filter == name || filter[1] == '\0'){
+		return MOSQ_ERR_INVAL;
+	}
+	if(strpbrk(name, "+#") && strpbrk(name, "+#") < filter){
+		return MOSQ_ERR_INVAL;
+	}
+	*sharename = name;
+	*sharename_len = filter - name;
+	*sub = filter + 1;
+	return MOSQ_ERR_SUCCESS;
+}
+
 int sub__add(struct mosquitto_db *db, struct mosquitto *context, const char *sub, int qos, struct mosquitto__subhier **root)
 {
 	int rc = 0;
 	struct mosquitto__subhier *subhier;
 	struct sub__token *tokens = NULL;
+	const char *sharename;
+	size_t sharename_len;
 
 	assert(root);
 	assert(*root);
 	assert(sub);
 
+	if(sub__shared_split(&sub, &sharename, &sharename_len)) return MOSQ_ERR_INVAL;
 	if(sub__topic_tokenise(sub, &tokens)) return 1;
 
 	HASH_FIND(hh, *root, UHPA_ACCESS_TOPIC(tokens), tokens->topic_len, subhier);
-	assert(subhier);
-	rc = sub__add_recurse(db, context, qos, subhier, tokens);
+	if(!subhier){
+		/* Only possible for a shared subscription to a $ topic other than
+		 * $SYS. */
+		sub__topic_tokens_free(tokens);
+		return MOSQ_ERR_INVAL;
+	}
+	rc = sub__add_recurse(db, context, qos, subhier, tokens, sharename, sharename_len);
 
 	sub__topic_tokens_free(tokens);
 
@@ -475,14 +706,21 @@ int sub__remove(struct mosquitto_db *db, struct mosquitto *context, const char *
 	struct mosquitto__subhier *subhier;
 	struct sub__token *tokens = NULL;
 
+	const char *sharename;
+	size_t sharename_len;
+
 	assert(root);
 	assert(sub);
 
+	if(sub__shared_split(&sub, &sharename, &sharename_len)) return MOSQ_ERR_INVAL;
 	if(sub__topic_tokenise(sub, &tokens)) return 1;
 
 	HASH_FIND(hh, root, UHPA_ACCESS_TOPIC(tokens), tokens->topic_len, subhier);
-	assert(subhier);
-	rc = sub__remove_recurse(db, context, subhier, tokens);
+	if(!subhier){
+		sub__topic_tokens_free(tokens);
+		return MOSQ_ERR_SUCCESS;
+	}
+	rc = sub__remove_recurse(db, context, subhier, tokens, sharename, sharename_len);
 
 	sub__topic_tokens_free(tokens);
 
@@ -512,7 +750,7 @@ int sub__messages_queue(struct mosquitto_db *db, const char *source_id, const ch
 		/* We have a message that needs to be retained, so ensure that the subscription
 		 * tree for its topic exists.
 		 */
-		sub__add_recurse(db, NULL, 0, subhier, tokens);
+		sub__add_recurse(db, NULL, 0, subhier, tokens, NULL, 0);
 	}
 	sub__search(db, subhier, tokens, source_id, topic, qos, retain, *stored, true);
 	sub__topic_tokens_free(tokens);
@@ -533,7 +771,7 @@ static struct mosquitto__subhier *tmp_remove_subs(struct mosquitto__subhier *sub
 		return NULL;
 	}
 
-	if(sub->children || sub->subs || sub->retained){
+	if(sub->children || sub->subs || sub->shared || sub->retained){
 		return NULL;
 	}
 
@@ -543,6 +781,7 @@ static struct mosquitto__subhier *tmp_remove_subs(struct mosquitto__subhier *sub
 	mosquitto__free(sub);
 
 	if(parent->subs == NULL
+			&& parent->shared == NULL
 			&& parent->children == NULL
 			&& parent->retained == NULL
 			&& parent->parent){
@@ -566,6 +805,8 @@ int sub__clean_session(struct mosquitto_db *db, struct mosquitto *context)
 		if(context->subs[i] == NULL){
 			continue;
 		}
+		/* Each entry stands for one subscription on the node, either a plain
+		 * one or membership of a shared subscription group. */
 		leaf = context->subs[i]->subs;
 		while(leaf){
 			if(leaf->context==context){
@@ -585,7 +826,11 @@ int sub__clean_session(struct mosquitto_db *db, struct mosquitto *context)
 			}
 			leaf = leaf->next;
 		}
+		if(!leaf){
+			sub__shared_remove(db, context, context->subs[i], NULL, 0);
+		}
 		if(context->subs[i]->subs == NULL
+				&& context->subs[i]->shared == NULL
 				&& context->subs[i]->children == NULL
 				&& context->subs[i]->retained == NULL
 				&& context->subs[i]->parent){
@@ -609,6 +854,7 @@ void sub__tree_print(struct mosquitto__subhier *root, int level)
 	int i;
 	struct mosquitto__subhier *branch, *branch_tmp;
 	struct mosquitto__subleaf *leaf;
+	struct mosquitto__subshared *shared, *shared_tmp;
 
 	HASH_ITER(hh, root, branch, branch_tmp){
 	for(i=0; i<(level+2)*2; i++){
@@ -624,6 +870,11 @@ void sub__tree_print(struct mosquitto__subhier *root, int level)
 		}
 		leaf = leaf->next;
 	}
+	HASH_ITER(hh, branch->shared, shared, shared_tmp){
+		for(leaf=shared->subs; leaf; leaf=leaf->next){
+			printf(" ($share/%s %s, %d)", shared->name, leaf->context->id, leaf->qos);
+		}
+	}
 	if(branch->retained){
 		printf(" (r)");
 	}
@@ -633,7 +884,7 @@ void sub__tree_print(struct mosquitto__subhier *root, int level)
 	}
 }
 
-static int retain__process(struct mosquitto_db *db, struct mosquitto_msg_store *retained, struct mosquitto *context, const char *sub, int sub_qos)
+static int retain__process(struct mosquitto_db *db, struct mosquitto_msg_store *retained, struct mosquitto *context, int sub_qos)
 {
 	int rc = 0;
 	int qos;
@@ -661,7 +912,65 @@ static int retain__process(struct mosquitto_db *db, struct mosquitto_msg_store *
 	return db__message_insert(db, context, mid, mosq_md_out, qos, true, retained);
 }
 
-static int retain__search(struct mosquitto_db *db, struct mosquitto__subhier *subhier, struct sub__token *tokens, struct mosquitto *context, const char *sub, int sub_qos, int level)
+/* Retained messages aren't delivered from within retain__search(). Instead
+ * they are added to a per client pending list which is drained a bounded
+ * number of messages at a time by the main loop, so that a single large
+ * subscribe doesn't stall every other client. */
+static int retain__pending_add(struct mosquitto_db *db, struct mosquitto *context, struct mosquitto_msg_store *retained, struct mosquitto__retain_filter *filter, int sub_qos)
+{
+	struct mosquitto__retain_pending *pending;
+
+	pending = mosquitto__malloc(sizeof(struct mosquitto__retain_pending));
+	if(!pending) return MOSQ_ERR_NOMEM;
+
+	pending->next = NULL;
+	pending->store = retained;
+	pending->store->ref_count++;
+	pending->filter = filter;
+	pending->filter->ref_count++;
+	pending->qos = sub_qos;
+
+	if(context->last_retain_pending){
+		context->last_retain_pending->next = pending;
+	}else{
+		context->retain_pending = pending;
+	}
+	context->last_retain_pending = pending;
+	context__add_to_ready(db, context);
+
+	return MOSQ_ERR_SUCCESS;
+}
+
+static void retain__pending_delete(struct mosquitto_db *db, struct mosquitto__retain_pending *pending)
+{
+	db__msg_store_deref(db, &pending->store);
+	pending->filter->ref_count--;
+	if(pending->filter->ref_count == 0){
+		mosquitto__free(pending->filter->sub);
+		mosquitto__free(pending->filter);
+	}
+	mosquitto__free(pending);
+}
+
+/* Find the node of a topic, or NULL if it isn't in the hierarchy. */
+static struct mosquitto__subhier *retain__hier_find(struct mosquitto_db *db, const char *topic)
+{
+	struct mosquitto__subhier *subhier, *branch;
+	struct sub__token *tokens = NULL, *token;
+
+	if(sub__topic_tokenise(topic, &tokens)) return NULL;
+
+	HASH_FIND(hh, db->subs, UHPA_ACCESS_TOPIC(tokens), tokens->topic_len, subhier);
+	for(token=tokens; subhier && token; token=token->next){
+		HASH_FIND(hh, subhier->children, UHPA_ACCESS_TOPIC(token), token->topic_len, branch);
+		subhier = branch;
+	}
+	sub__topic_tokens_free(tokens);
+
+	return subhier;
+}
+
+static int retain__search(struct mosquitto_db *db, struct mosquitto__subhier *subhier, struct sub__token *tokens, struct mosquitto *context, struct mosquitto__retain_filter *filter, int sub_qos, int level)
 {
 	struct mosquitto__subhier *branch, *branch_tmp;
 	int flag = 0;
@@ -676,26 +985,31 @@ static int retain__search(struct mosquitto_db *db, struct mosquitto__subhier *su
 			 * this function and return to an earlier retain__search().
 			 */
 			flag = -1;
+			if(branch->retained_total == 0){
+				/* Nothing retained anywhere below here. */
+				continue;
+			}
 			if(branch->retained){
-				retain__process(db, branch->retained, context, sub, sub_qos);
+				retain__pending_add(db, context, branch->retained, filter, sub_qos);
 			}
 			if(branch->children){
-				retain__search(db, branch, tokens, context, sub, sub_qos, level+1);
+				retain__search(db, branch, tokens, context, filter, sub_qos, level+1);
 			}
-		}else if(strcmp(UHPA_ACCESS_TOPIC(branch), "+")
+		}else if(branch->retained_total
+					&& strcmp(UHPA_ACCESS_TOPIC(branch), "+")
 					&& (!strcmp(UHPA_ACCESS_TOPIC(branch), UHPA_ACCESS_TOPIC(tokens))
 					|| !strcmp(UHPA_ACCESS_TOPIC(tokens), "+"))){
 			if(tokens->next){
-				if(retain__search(db, branch, tokens->next, context, sub, sub_qos, level+1) == -1
+				if(retain__search(db, branch, tokens->next, context, filter, sub_qos, level+1) == -1
 						|| (!branch_tmp && tokens->next && !strcmp(UHPA_ACCESS_TOPIC(tokens->next), "#") && level>0)){
 
 					if(branch->retained){
-						retain__process(db, branch->retained, context, sub, sub_qos);
+						retain__pending_add(db, context, branch->retained, filter, sub_qos);
 					}
 				}
 			}else{
 				if(branch->retained){
-					retain__process(db, branch->retained, context, sub, sub_qos);
+					retain__pending_add(db, context, branch->retained, filter, sub_qos);
 				}
 			}
 		}
@@ -707,17 +1021,41 @@ int sub__retain_queue(struct mosquitto_db *db, struct mosquitto *context, const
 {
 	struct mosquitto__subhier *subhier;
 	struct sub__token *tokens = NULL, *tail;
+	struct mosquitto__retain_filter *filter;
 
 	assert(db);
 	assert(context);
 	assert(sub);
 
+	/* Shared subscriptions are for spreading new messages, retained messages
+	 * aren't sent to them. */
+	if(!strncmp(sub, "$share/", strlen("$share/"))) return MOSQ_ERR_SUCCESS;
+
 	if(sub__topic_tokenise(sub, &tokens)) return 1;
 
 	HASH_FIND(hh, db->subs, UHPA_ACCESS_TOPIC(tokens), tokens->topic_len, subhier);
 	assert(subhier);
 
-	retain__search(db, subhier, tokens, context, sub, sub_qos, 0);
+	if(subhier->retained_total){
+		/* Held by the pending messages found, so that they can be dropped
+		 * if the client unsubscribes before they are delivered. */
+		filter = mosquitto__malloc(sizeof(struct mosquitto__retain_filter));
+		if(filter){
+			filter->sub = mosquitto__strdup(sub);
+			filter->ref_count = 1;
+		}
+		if(!filter || !filter->sub){
+			mosquitto__free(filter);
+			sub__topic_tokens_free(tokens);
+			return MOSQ_ERR_NOMEM;
+		}
+		retain__search(db, subhier, tokens, context, filter, sub_qos, 0);
+		filter->ref_count--;
+		if(filter->ref_count == 0){
+			mosquitto__free(filter->sub);
+			mosquitto__free(filter);
+		}
+	}
 	while(tokens){
 		tail = tokens->next;
 		UHPA_FREE_TOPIC(tokens);
@@ -728,3 +1066,79 @@ int sub__retain_queue(struct mosquitto_db *db, struct mosquitto *context, const
 	return MOSQ_ERR_SUCCESS;
 }
 
+/* Deliver up to retained_batch_size pending retained messages to a client.
+ * Messages that have since been replaced or cleared on their topic are
+ * skipped, the client has had the newer one through its subscription.
+ * Returns MOSQ_ERR_SUCCESS once the pending list is empty, or -1 if there are
+ * still messages waiting for a later loop iteration. */
+int sub__retain_pending_write(struct mosquitto_db *db, struct mosquitto *context)
+{
+	struct mosquitto__retain_pending *pending;
+	struct mosquitto__subhier *hier;
+	int count = 0;
+	int rc = MOSQ_ERR_SUCCESS;
+
+	assert(db);
+	assert(context);
+
+	while(context->retain_pending){
+		if(db->config->retained_batch_size > 0 && count >= db->config->retained_batch_size){
+			return -1;
+		}
+		pending = context->retain_pending;
+		context->retain_pending = pending->next;
+		if(!context->retain_pending){
+			context->last_retain_pending = NULL;
+		}
+
+		hier = retain__hier_find(db, pending->store->topic);
+		if(hier && hier->retained == pending->store){
+			if(retain__process(db, pending->store, context, pending->qos)) rc = 1;
+		}
+		retain__pending_delete(db, pending);
+		count++;
+	}
+	return rc;
+}
+
+/* Drop the pending retained messages found with a subscription the client has
+ * unsubscribed from. */
+void sub__retain_pending_remove(struct mosquitto_db *db, struct mosquitto *context, const char *sub)
+{
+	struct mosquitto__retain_pending *pending, *next, *prev = NULL;
+
+	assert(db);
+	assert(context);
+	assert(sub);
+
+	pending = context->retain_pending;
+	while(pending){
+		next = pending->next;
+		if(!strcmp(pending->filter->sub, sub)){
+			if(prev){
+				prev->next = next;
+			}else{
+				context->retain_pending = next;
+			}
+			retain__pending_delete(db, pending);
+		}else{
+			prev = pending;
+		}
+		pending = next;
+	}
+	context->last_retain_pending = prev;
+}
+
+void sub__retain_pending_free(struct mosquitto_db *db, struct mosquitto *context)
+{
+	struct mosquitto__retain_pending *pending, *next;
+
+	pending = context->retain_pending;
+	while(pending){
+		next = pending->next;
+		retain__pending_delete(db, pending);
+		pending = next;
+	}
+	context->retain_pending = NULL;
+	context->last_retain_pending = NULL;
+}
@@ -38,9 +38,12 @@ unsigned long g_msgs_sent = 0;
 unsigned long g_pub_msgs_received = 0;
 unsigned long g_pub_msgs_sent = 0;
 unsigned long g_msgs_dropped = 0;
+unsigned long g_socket_writes = 0;
 int g_clients_expired = 0;
 unsigned int g_socket_connections = 0;
 unsigned int g_connection_count = 0;
+unsigned long g_accept_budget_exhausted = 0;
+unsigned long g_accept_throttled = 0;
 
 void sys_tree__init(struct mosquitto_db *db)
 {
@@ -99,6 +102,29 @@ static void sys_tree__update_clients(struct mosquitto_db *db, char *buf)
 	}
 }
 
+static void sys_tree__update_accept(struct mosquitto_db *db, char *buf)
+{
+	static int accept_budget = -1;
+	static unsigned long budget_exhausted = -1;
+	static unsigned long throttled = -1;
+
+	if(db->config->accept_budget != accept_budget){
+		accept_budget = db->config->accept_budget;
+		snprintf(buf, BUFLEN, "%d", accept_budget);
+		db__messages_easy_queue(db, NULL, "$SYS/broker/accept/budget", SYS_TREE_QOS, strlen(buf), buf, 1);
+	}
+	if(g_accept_budget_exhausted != budget_exhausted){
+		budget_exhausted = g_accept_budget_exhausted;
+		snprintf(buf, BUFLEN, "%lu", budget_exhausted);
+		db__messages_easy_queue(db, NULL, "$SYS/broker/accept/budget exhausted", SYS_TREE_QOS, strlen(buf), buf, 1);
+	}
+	if(g_accept_throttled != throttled){
+		throttled = g_accept_throttled;
+		snprintf(buf, BUFLEN, "%lu", throttled);
+		db__messages_easy_queue(db, NULL, "$SYS/broker/accept/throttled", SYS_TREE_QOS, strlen(buf), buf, 1);
+	}
+}
+
 #ifdef REAL_WITH_MEMORY_TRACKING
 static void sys_tree__update_memory(struct mosquitto_db *db, char *buf)
 {
@@ -157,6 +183,7 @@ void sys_tree__update(struct mosquitto_db *db, int interval, time_t start_time)
 	static unsigned long msgs_received = -1;
 	static unsigned long msgs_sent = -1;
 	static unsigned long publish_dropped = -1;
+	static unsigned long socket_writes = -1;
 	static unsigned long pub_msgs_received = -1;
 	static unsigned long pub_msgs_sent = -1;
 	static unsigned long long bytes_received = -1;
@@ -214,6 +241,7 @@ void sys_tree__update(struct mosquitto_db *db, int interval, time_t start_time)
 		db__messages_easy_queue(db, NULL, "$SYS/broker/uptime", SYS_TREE_QOS, strlen(buf), buf, 1);
 
 		sys_tree__update_clients(db, buf);
+		sys_tree__update_accept(db, buf);
 		bool initial_publish = false;
 		if(last_update == 0){
 			initial_publish = true;
@@ -318,6 +346,12 @@ void sys_tree__update(struct mosquitto_db *db, int interval, time_t start_time)
 			db__messages_easy_queue(db, NULL, "$SYS/broker/messages/sent", SYS_TREE_QOS, strlen(buf), buf, 1);
 		}
 
+		if(socket_writes != g_socket_writes){
+			socket_writes = g_socket_writes;
+			snprintf(buf, BUFLEN, "%lu", socket_writes);
+			db__messages_easy_queue(db, NULL, "$SYS/broker/messages/socket writes", SYS_TREE_QOS, strlen(buf), buf, 1);
+		}
+
 		if(publish_dropped != g_msgs_dropped){
 			publish_dropped = g_msgs_dropped;
 			snprintf(buf, BUFLEN, "%lu", publish_dropped);
@@ -27,9 +27,12 @@ extern unsigned long g_msgs_sent;
 extern unsigned long g_pub_msgs_received;
 extern unsigned long g_pub_msgs_sent;
 extern unsigned long g_msgs_dropped;
+extern unsigned long g_socket_writes;
 extern int g_clients_expired;
 extern unsigned int g_socket_connections;
 extern unsigned int g_connection_count;
+extern unsigned long g_accept_budget_exhausted;
+extern unsigned long g_accept_throttled;
 
 #define G_BYTES_RECEIVED_INC(A) (g_bytes_received+=(A))
 #define G_BYTES_SENT_INC(A) (g_bytes_sent+=(A))
@@ -40,9 +43,12 @@ extern unsigned int g_connection_count;
 #define G_PUB_MSGS_RECEIVED_INC(A) (g_pub_msgs_received+=(A))
 #define G_PUB_MSGS_SENT_INC(A) (g_pub_msgs_sent+=(A))
 #define G_MSGS_DROPPED_INC() (g_msgs_dropped++)
+#define G_SOCKET_WRITES_INC() (g_socket_writes++)
 #define G_CLIENTS_EXPIRED_INC() (g_clients_expired++)
 #define G_SOCKET_CONNECTIONS_INC() (g_socket_connections++)
 #define G_CONNECTION_COUNT_INC() (g_connection_count++)
+#define G_ACCEPT_BUDGET_EXHAUSTED_INC() (g_accept_budget_exhausted++)
+#define G_ACCEPT_THROTTLED_INC() (g_accept_throttled++)
 
 #else
 
@@ -55,9 +61,12 @@ extern unsigned int g_connection_count;
 #define G_PUB_MSGS_RECEIVED_INC(A)
 #define G_PUB_MSGS_SENT_INC(A)
 #define G_MSGS_DROPPED_INC(A)
+#define G_SOCKET_WRITES_INC(A)
 #define G_CLIENTS_EXPIRED_INC(A)
 #define G_SOCKET_CONNECTIONS_INC(A)
 #define G_CONNECTION_COUNT_INC(A)
+#define G_ACCEPT_BUDGET_EXHAUSTED_INC(A)
+#define G_ACCEPT_THROTTLED_INC(A)
 
 #endif
 
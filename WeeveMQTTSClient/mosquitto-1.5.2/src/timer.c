@@ -0,0 +1,168 @@
+/*
+Copyright (c) 2010-2018 Roger Light <roger@atchoo.org>
+
+All rights reserved. This program and the accompanying materials
+are made available under the terms of the Eclipse Public License v1.0
+and Eclipse Distribution License v1.0 which accompany this distribution.
+
+The Eclipse Public License is available at
+   http://www.eclipse.org/legal/epl-v10.html
+and the Eclipse Distribution License is available at
+  http://www.eclipse.org/org/documents/edl-v10.php.
+
+Contributors:
+   Roger Light - initial implementation and documentation.
+*/
+
+#include "config.h"
+
+#include <string.h>
+
+#include "mosquitto_broker_internal.h"
+#include "time_mosq.h"
+
+/* Hierarchical timer wheel with a resolution of one second.
+ *
+ * Level 0 has one slot per second for the next TIMER_WHEEL_SIZE seconds. Each
+ * slot of level n covers TIMER_WHEEL_SIZE slots of level n-1. When the lower
+ * level wraps, the next slot of the level above is emptied and its timers are
+ * added again, which drops them into a lower level. Adding, removing and
+ * firing a timer are all O(1). A tick with nothing due only looks at one
+ * level 0 slot.
+ *
+ * Timers further out than the wheel covers are parked in the top level and
+ * put back when they come round.
+ */
+
+#define TIMER_WHEEL_SPAN(level) ((time_t)1 << (TIMER_WHEEL_BITS*((level)+1)))
+
+
+static void timer__link(struct mosquitto__timer **head, struct mosquitto__timer *timer)
+{
+	timer->next = *head;
+	if(timer->next){
+		timer->next->pprev = &timer->next;
+	}
+	timer->pprev = head;
+	*head = timer;
+}
+
+
+static void timer__unlink(struct mosquitto__timer *timer)
+{
+	*timer->pprev = timer->next;
+	if(timer->next){
+		timer->next->pprev = timer->pprev;
+	}
+	timer->next = NULL;
+	timer->pprev = NULL;
+}
+
+
+static void timer__place(struct mosquitto__timer_wheel *wheel, struct mosquitto__timer *timer)
+{
+	time_t expires = timer->expires;
+	time_t delta;
+	int level;
+
+	if(expires <= wheel->now){
+		/* Already due, fire on the next tick. */
+		expires = wheel->now + 1;
+	}
+	delta = expires - wheel->now;
+	if(delta >= TIMER_WHEEL_SPAN(TIMER_WHEEL_LEVELS-1)){
+		expires = wheel->now + TIMER_WHEEL_SPAN(TIMER_WHEEL_LEVELS-1) - 1;
+		delta = expires - wheel->now;
+	}
+	for(level=0; level<TIMER_WHEEL_LEVELS-1; level++){
+		if(delta < TIMER_WHEEL_SPAN(level)) break;
+	}
+	timer__link(&wheel->slots[level][(expires >> (TIMER_WHEEL_BITS*level)) & (TIMER_WHEEL_SIZE-1)], timer);
+}
+
+
+void timer__init(struct mosquitto_db *db)
+{
+	memset(&db->timers, 0, sizeof(struct mosquitto__timer_wheel));
+	db->timers.now = mosquitto_time();
+}
+
+
+void timer__add(struct mosquitto_db *db, struct mosquitto__timer *timer, time_t expires)
+{
+	if(timer->pprev){
+		timer__unlink(timer);
+	}else{
+		db->timers.count++;
+	}
+	timer->expires = expires;
+	timer__place(&db->timers, timer);
+}
+
+
+void timer__remove(struct mosquitto_db *db, struct mosquitto__timer *timer)
+{
+	if(timer->pprev){
+		timer__unlink(timer);
+		db->timers.count--;
+	}
+}
+
+
+/* Move every timer in a slot to where it belongs now. */
+static void timer__cascade(struct mosquitto__timer_wheel *wheel, int level)
+{
+	struct mosquitto__timer *list, *timer;
+	int slot;
+
+	slot = (wheel->now >> (TIMER_WHEEL_BITS*level)) & (TIMER_WHEEL_SIZE-1);
+	list = wheel->slots[level][slot];
+	wheel->slots[level][slot] = NULL;
+	while(list){
+		timer = list;
+		list = list->next;
+		timer__place(wheel, timer);
+	}
+}
+
+
+void timer__run(struct mosquitto_db *db, time_t now)
+{
+	struct mosquitto__timer_wheel *wheel = &db->timers;
+	struct mosquitto__timer *work, *timer;
+	int slot, level;
+
+	while(wheel->now < now){
+		wheel->now++;
+		if(wheel->count == 0){
+			/* Nothing to cascade or fire, so skip straight to now. */
+			wheel->now = now;
+			break;
+		}
+
+		for(level=1; level<TIMER_WHEEL_LEVELS; level++){
+			if(wheel->now & (TIMER_WHEEL_SPAN(level-1)-1)) break;
+			timer__cascade(wheel, level);
+		}
+
+		/* Detach the slot before firing, so callbacks can add or remove any
+		 * timer, including others from this same slot. */
+		slot = wheel->now & (TIMER_WHEEL_SIZE-1);
+		work = wheel->slots[0][slot];
+		wheel->slots[0][slot] = NULL;
+		if(work){
+			work->pprev = &work;
+		}
+		while(work){
+			timer = work;
+			timer__unlink(timer);
+			if(timer->expires > wheel->now){
+				/* Parked beyond the range of the wheel. */
+				timer__place(wheel, timer);
+				continue;
+			}
+			wheel->count--;
+			timer->callback(db, timer);
+		}
+	}
+}
@@ -0,0 +1,628 @@
+/*
+Copyright (c) 2010-2018 Roger Light <roger@atchoo.org>
+
+All rights reserved. This program and the accompanying materials
+are made available under the terms of the Eclipse Public License v1.0
+and Eclipse Distribution License v1.0 which accompany this distribution.
+
+The Eclipse Public License is available at
+   http://www.eclipse.org/legal/epl-v10.html
+and the Eclipse Distribution License is available at
+  http://www.eclipse.org/org/documents/edl-v10.php.
+
+Contributors:
+   Roger Light - initial implementation and documentation.
+*/
+
+#include "config.h"
+
+#ifdef WITH_IO_URING
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+#include "mosquitto_broker_internal.h"
+#include "memory_mosq.h"
+#include "net_mosq.h"
+
+/* io_uring reactor for the main loop, talking to the kernel directly rather
+ * than through liburing.
+ *
+ * Listeners are watched with one shot poll requests. The main loop accepts
+ * from them itself, after the completions for connected clients have been
+ * handled and only as many as its accept budget allows, then asks for the next
+ * poll once the backlog is empty. Plain TCP clients use multishot recv from a
+ * ring of provided buffers: the buffer a completion arrives in is lent to the
+ * client as its in_buf while the packets in it are handled, then handed back
+ * to the kernel. TLS clients and bridges are watched with one shot poll
+ * requests instead, because their reads have to go through the socket. POLLOUT
+ * is one shot too, and only asked for while something is waiting to go out.
+ *
+ * Arming requests is just filling in entries of the submission queue. They
+ * all go to the kernel with the next wait, which also carries the timeout, so
+ * a pass of the main loop is one io_uring_enter() however many clients were
+ * serviced. Writes are still made directly, see packet__write().
+ *
+ * The ring holds a reference to every socket with a request outstanding, so
+ * closing a socket must be preceded by uring__remove(), which net__socket_close()
+ * takes care of.
+ */
+
+#define URING_SQ_ENTRIES 1024
+#define URING_CQ_ENTRIES 8192
+#define URING_BUF_COUNT 256 /* Must be a power of two. */
+#define URING_BUF_SIZE NET_RX_BUF_SIZE
+#define URING_BUF_GROUP 0
+
+enum uring__op{
+	uop_accept = 1,
+	uop_recv = 2,
+	uop_pollin = 3,
+	uop_pollout = 4,
+	uop_cancel = 5,
+	uop_wake = 6,
+};
+
+/* Completions carry the operation, the generation of the context the request
+ * was made for, and the socket. A socket number can be reused as soon as it is
+ * closed, the generation tells the new client from the old. */
+#define URING_DATA(op, gen, sock) (((uint64_t)(op)<<56) | ((uint64_t)((gen)&0xFFFFFF)<<32) | (uint32_t)(sock))
+#define URING_DATA_OP(data) ((int)((data)>>56))
+#define URING_DATA_GEN(data) ((uint32_t)(((data)>>32)&0xFFFFFF))
+#define URING_DATA_SOCK(data) ((mosq_sock_t)((data)&0xFFFFFFFF))
+
+struct mosquitto__uring{
+	int fd;
+	void *ring_mem;
+	size_t ring_mem_len;
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned sq_mask;
+	unsigned sq_entries;
+	unsigned sq_queued; /* Entries filled in but not yet submitted. */
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned cq_mask;
+	struct io_uring_cqe *cqes;
+	struct io_uring_buf_ring *buf_ring;
+	unsigned char *bufs;
+	uint16_t buf_tail;
+	uint32_t gen;
+	mosq_sock_t *listensock;
+	bool *accept_pending;
+	int listensock_count;
+	bool wake_armed;
+};
+
+
+static int uring__enter(struct mosquitto__uring *ring, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz)
+{
+	return syscall(__NR_io_uring_enter, ring->fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+
+static int uring__submit(struct mosquitto__uring *ring)
+{
+	int rc;
+
+	if(ring->sq_queued == 0){
+		return 0;
+	}
+	rc = uring__enter(ring, ring->sq_queued, 0, 0, NULL, 0);
+	if(rc > 0){
+		ring->sq_queued -= rc;
+	}
+	return rc;
+}
+
+
+static struct io_uring_sqe *uring__get_sqe(struct mosquitto__uring *ring)
+{
+	struct io_uring_sqe *sqe;
+	unsigned tail;
+
+	tail = *ring->sq_tail;
+	if(tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries){
+		if(uring__submit(ring) <= 0){
+			log__printf(NULL, MOSQ_LOG_ERR, "Error: io_uring submission queue full.");
+			return NULL;
+		}
+	}
+	sqe = &ring->sqes[tail & ring->sq_mask];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	return sqe;
+}
+
+
+/* Make a filled in entry visible to the kernel. */
+static void uring__queue(struct mosquitto__uring *ring)
+{
+	__atomic_store_n(ring->sq_tail, *ring->sq_tail + 1, __ATOMIC_RELEASE);
+	ring->sq_queued++;
+}
+
+
+static void uring__buf_recycle(struct mosquitto__uring *ring, uint16_t bid)
+{
+	struct io_uring_buf *buf;
+
+	buf = &ring->buf_ring->bufs[ring->buf_tail & (URING_BUF_COUNT-1)];
+	buf->addr = (uint64_t)(uintptr_t)&ring->bufs[(size_t)bid*URING_BUF_SIZE];
+	buf->len = URING_BUF_SIZE;
+	buf->bid = bid;
+	ring->buf_tail++;
+	__atomic_store_n(&ring->buf_ring->tail, ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+
+static void uring__arm_accept(struct mosquitto__uring *ring, mosq_sock_t listensock)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = uring__get_sqe(ring);
+	if(!sqe) return;
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = listensock;
+	sqe->poll32_events = POLLIN;
+	sqe->user_data = URING_DATA(uop_accept, 0, listensock);
+	uring__queue(ring);
+}
+
+
+static void uring__arm_recv(struct mosquitto__uring *ring, struct mosquitto *context)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = uring__get_sqe(ring);
+	if(!sqe) return;
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = context->sock;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_BUF_GROUP;
+	sqe->user_data = URING_DATA(uop_recv, context->uring_gen, context->sock);
+	uring__queue(ring);
+}
+
+
+static void uring__arm_poll(struct mosquitto__uring *ring, struct mosquitto *context, uint32_t events)
+{
+	struct io_uring_sqe *sqe;
+
+	if(context->events & events){
+		return;
+	}
+	sqe = uring__get_sqe(ring);
+	if(!sqe) return;
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = context->sock;
+	sqe->poll32_events = events;
+	sqe->user_data = URING_DATA(events == POLLOUT ? uop_pollout : uop_pollin, context->uring_gen, context->sock);
+	uring__queue(ring);
+	context->events |= events;
+}
+
+
+int uring__init(struct mosquitto_db *db, mosq_sock_t *listensock, int listensock_count)
+{
+	struct mosquitto__uring *ring;
+	struct io_uring_params params;
+	struct io_uring_buf_reg reg;
+	size_t sq_len, cq_len;
+	unsigned *sq_array;
+	unsigned i;
+
+	ring = mosquitto__calloc(1, sizeof(struct mosquitto__uring));
+	if(!ring){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Out of memory.");
+		return MOSQ_ERR_NOMEM;
+	}
+	ring->fd = -1;
+	db->uring = ring;
+
+	/* Only the main loop uses the ring, so completion work can wait until it
+	 * asks for completions rather than interrupting whatever it is doing. */
+	memset(&params, 0, sizeof(struct io_uring_params));
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+	params.cq_entries = URING_CQ_ENTRIES;
+	ring->fd = syscall(__NR_io_uring_setup, URING_SQ_ENTRIES, &params);
+	if(ring->fd < 0 && errno == EINVAL){
+		/* Before Linux 6.1. */
+		memset(&params, 0, sizeof(struct io_uring_params));
+		params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+		params.cq_entries = URING_CQ_ENTRIES;
+		ring->fd = syscall(__NR_io_uring_setup, URING_SQ_ENTRIES, &params);
+	}
+	if(ring->fd < 0){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error in io_uring setup: %s", strerror(errno));
+		goto error;
+	}
+	if(!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error in io_uring setup: kernel is too old.");
+		goto error;
+	}
+
+	sq_len = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+	cq_len = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+	ring->ring_mem_len = sq_len > cq_len ? sq_len : cq_len;
+	ring->ring_mem = mmap(NULL, ring->ring_mem_len, PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if(ring->ring_mem == MAP_FAILED){
+		ring->ring_mem = NULL;
+		log__printf(NULL, MOSQ_LOG_ERR, "Error in io_uring setup: %s", strerror(errno));
+		goto error;
+	}
+	ring->sqes_len = params.sq_entries*sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if(ring->sqes == MAP_FAILED){
+		ring->sqes = NULL;
+		log__printf(NULL, MOSQ_LOG_ERR, "Error in io_uring setup: %s", strerror(errno));
+		goto error;
+	}
+
+	ring->sq_head = (unsigned *)((char *)ring->ring_mem + params.sq_off.head);
+	ring->sq_tail = (unsigned *)((char *)ring->ring_mem + params.sq_off.tail);
+	ring->sq_mask = *(unsigned *)((char *)ring->ring_mem + params.sq_off.ring_mask);
+	ring->sq_entries = params.sq_entries;
+	ring->cq_head = (unsigned *)((char *)ring->ring_mem + params.cq_off.head);
+	ring->cq_tail = (unsigned *)((char *)ring->ring_mem + params.cq_off.tail);
+	ring->cq_mask = *(unsigned *)((char *)ring->ring_mem + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((char *)ring->ring_mem + params.cq_off.cqes);
+
+	/* Submission queue entries are always used in order. */
+	sq_array = (unsigned *)((char *)ring->ring_mem + params.sq_off.array);
+	for(i=0; i<params.sq_entries; i++){
+		sq_array[i] = i;
+	}
+
+	/* Receive buffers. */
+	if(posix_memalign((void **)&ring->buf_ring, sysconf(_SC_PAGESIZE), URING_BUF_COUNT*sizeof(struct io_uring_buf))){
+		ring->buf_ring = NULL;
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Out of memory.");
+		goto error;
+	}
+	memset(ring->buf_ring, 0, URING_BUF_COUNT*sizeof(struct io_uring_buf));
+	ring->bufs = mosquitto__malloc((size_t)URING_BUF_COUNT*URING_BUF_SIZE);
+	if(!ring->bufs){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Out of memory.");
+		goto error;
+	}
+	memset(&reg, 0, sizeof(struct io_uring_buf_reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)ring->buf_ring;
+	reg.ring_entries = URING_BUF_COUNT;
+	reg.bgid = URING_BUF_GROUP;
+	if(syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error in io_uring buffer registering: %s", strerror(errno));
+		goto error;
+	}
+	for(i=0; i<URING_BUF_COUNT; i++){
+		uring__buf_recycle(ring, i);
+	}
+
+	ring->accept_pending = mosquitto__calloc(listensock_count ? listensock_count : 1, sizeof(bool));
+	if(!ring->accept_pending){
+		log__printf(NULL, MOSQ_LOG_ERR, "Error: Out of memory.");
+		goto error;
+	}
+	ring->listensock = listensock;
+	ring->listensock_count = listensock_count;
+	for(i=0; i<(unsigned)listensock_count; i++){
+		uring__arm_accept(ring, listensock[i]);
+	}
+	return MOSQ_ERR_SUCCESS;
+
+error:
+	uring__cleanup(db);
+	return MOSQ_ERR_UNKNOWN;
+}
+
+
+void uring__cleanup(struct mosquitto_db *db)
+{
+	struct mosquitto__uring *ring = db->uring;
+	struct io_uring_sqe *sqe;
+
+	if(!ring) return;
+
+	/* Closing the ring would cancel everything still outstanding too, but
+	 * in the background. The listening sockets have to be let go of before
+	 * returning, or a broker started straight after can't bind. */
+	if(ring->fd >= 0 && ring->sqes){
+		sqe = uring__get_sqe(ring);
+		if(sqe){
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY | IORING_ASYNC_CANCEL_ALL;
+			sqe->user_data = URING_DATA(uop_cancel, 0, 0);
+			uring__queue(ring);
+			uring__enter(ring, ring->sq_queued, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		}
+	}
+	if(ring->sqes){
+		munmap(ring->sqes, ring->sqes_len);
+	}
+	if(ring->ring_mem){
+		munmap(ring->ring_mem, ring->ring_mem_len);
+	}
+	if(ring->fd >= 0){
+		close(ring->fd);
+	}
+	free(ring->buf_ring);
+	mosquitto__free(ring->bufs);
+	mosquitto__free(ring->accept_pending);
+	mosquitto__free(ring);
+	db->uring = NULL;
+}
+
+
+void uring__add(struct mosquitto_db *db, struct mosquitto *context)
+{
+	struct mosquitto__uring *ring = db->uring;
+
+	if(!ring || context->sock == INVALID_SOCKET) return;
+
+	context->uring_gen = ++ring->gen;
+	context->events = 0;
+	context->uring_recv = false;
+#ifdef WITH_TLS
+	if(context->ssl){
+		uring__arm_poll(ring, context, POLLIN);
+		return;
+	}
+#endif
+	if(context->listener){
+		context->uring_recv = true;
+		context->events = POLLIN;
+		uring__arm_recv(ring, context);
+	}else{
+		uring__arm_poll(ring, context, POLLIN);
+	}
+}
+
+
+void uring__poll_out(struct mosquitto_db *db, struct mosquitto *context)
+{
+	if(!db->uring || context->sock == INVALID_SOCKET) return;
+
+	uring__arm_poll(db->uring, context, POLLOUT);
+}
+
+
+void uring__remove(struct mosquitto_db *db, struct mosquitto *context)
+{
+	struct mosquitto__uring *ring = db->uring;
+	struct io_uring_sqe *sqe;
+
+	if(!ring || context->events == 0) return;
+
+	sqe = uring__get_sqe(ring);
+	if(!sqe) return;
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = context->sock;
+	sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+	sqe->user_data = URING_DATA(uop_cancel, 0, context->sock);
+	uring__queue(ring);
+	/* Straight away, so the socket really is closed by the caller. */
+	if(uring__submit(ring) < 0){
+		log__printf(NULL, MOSQ_LOG_DEBUG, "Error in io_uring cancelling: %s", strerror(errno));
+	}
+	context->events = 0;
+	context->uring_gen = 0;
+}
+
+
+static struct mosquitto *uring__context(struct mosquitto_db *db, uint64_t data)
+{
+	struct mosquitto *context = NULL;
+	mosq_sock_t sock = URING_DATA_SOCK(data);
+
+	HASH_FIND(hh_sock, db->contexts_by_sock, &sock, sizeof(mosq_sock_t), context);
+	if(context && (context->uring_gen&0xFFFFFF) != URING_DATA_GEN(data)){
+		/* A completion for a client that has since gone away. */
+		return NULL;
+	}
+	return context;
+}
+
+
+static int uring__listener_index(struct mosquitto__uring *ring, mosq_sock_t listensock)
+{
+	int i;
+
+	for(i=0; i<ring->listensock_count; i++){
+		if(ring->listensock[i] == listensock){
+			return i;
+		}
+	}
+	return -1;
+}
+
+
+static void uring__handle_accept(struct mosquitto_db *db, struct io_uring_cqe *cqe)
+{
+	int i;
+
+	if(cqe->res == -ECANCELED) return;
+
+	/* Errors included, the accept will find out what is wrong. */
+	i = uring__listener_index(db->uring, URING_DATA_SOCK(cqe->user_data));
+	if(i != -1){
+		db->uring->accept_pending[i] = true;
+	}
+}
+
+
+void uring__wake_arm(struct mosquitto_db *db, mosq_sock_t sock)
+{
+	struct io_uring_sqe *sqe;
+
+	if(db->uring->wake_armed) return;
+
+	sqe = uring__get_sqe(db->uring);
+	if(!sqe) return;
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = sock;
+	sqe->poll32_events = POLLIN;
+	sqe->user_data = URING_DATA(uop_wake, 0, sock);
+	uring__queue(db->uring);
+	db->uring->wake_armed = true;
+}
+
+
+bool uring__accept_pending(struct mosquitto_db *db, mosq_sock_t listensock)
+{
+	int i;
+
+	i = uring__listener_index(db->uring, listensock);
+	return i != -1 && db->uring->accept_pending[i];
+}
+
+
+void uring__accept_arm(struct mosquitto_db *db, mosq_sock_t listensock)
+{
+	int i;
+
+	i = uring__listener_index(db->uring, listensock);
+	if(i != -1 && db->uring->accept_pending[i]){
+		db->uring->accept_pending[i] = false;
+		uring__arm_accept(db->uring, listensock);
+	}
+}
+
+
+static void uring__handle_recv(struct mosquitto_db *db, struct io_uring_cqe *cqe, uring__handler handler)
+{
+	struct mosquitto__uring *ring = db->uring;
+	struct mosquitto *context;
+	uint16_t bid = 0;
+	bool have_buf;
+
+	have_buf = cqe->flags & IORING_CQE_F_BUFFER;
+	if(have_buf){
+		bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+	}
+
+	context = uring__context(db, cqe->user_data);
+	if(context && cqe->res > 0 && have_buf){
+		context->in_buf = &ring->bufs[(size_t)bid*URING_BUF_SIZE];
+		context->in_buf_pos = 0;
+		context->in_buf_len = cqe->res;
+		handler(db, context->sock, POLLIN);
+		/* The context isn't freed until the next pass of the main loop, even
+		 * if it was disconnected while handling this. */
+		context->in_buf = NULL;
+		context->in_buf_pos = 0;
+		context->in_buf_len = 0;
+	}else if(context && cqe->res != -ENOBUFS && cqe->res != -ECANCELED){
+		/* End of stream or an error. */
+		handler(db, context->sock, cqe->res < 0 ? POLLERR : POLLHUP);
+	}
+	if(have_buf){
+		uring__buf_recycle(ring, bid);
+	}
+
+	if(!(cqe->flags & IORING_CQE_F_MORE)){
+		/* Still connected, so recv stopped for want of buffers. They are
+		 * handed back as each completion is dealt with, so start again. */
+		context = uring__context(db, cqe->user_data);
+		if(context && context->events){
+			uring__arm_recv(ring, context);
+		}
+	}
+}
+
+
+static void uring__handle_poll(struct mosquitto_db *db, struct io_uring_cqe *cqe, uring__handler handler)
+{
+	struct mosquitto *context;
+	uint32_t events = URING_DATA_OP(cqe->user_data) == uop_pollout ? POLLOUT : POLLIN;
+	mosq_sock_t sock;
+
+	context = uring__context(db, cqe->user_data);
+	if(!context || cqe->res == -ECANCELED){
+		return;
+	}
+	sock = context->sock;
+	context->events &= ~events;
+	handler(db, sock, cqe->res < 0 ? POLLERR : (uint32_t)cqe->res);
+
+	if(events == POLLIN){
+		context = uring__context(db, cqe->user_data);
+		if(context && context->sock == sock){
+			uring__arm_poll(db->uring, context, POLLIN);
+		}
+	}
+}
+
+
+int uring__wait(struct mosquitto_db *db, int timeout, uring__handler handler)
+{
+	struct mosquitto__uring *ring = db->uring;
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	struct io_uring_cqe cqe;
+	unsigned head, tail;
+	unsigned min_complete;
+	int rc;
+	int count = 0;
+
+	/* Always asks for completions, even when not waiting for any, because
+	 * that is when deferred completion work is run. */
+	memset(&arg, 0, sizeof(struct io_uring_getevents_arg));
+	if(*ring->cq_head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) && timeout != 0){
+		ts.tv_sec = timeout/1000;
+		ts.tv_nsec = (timeout%1000)*1000000;
+		arg.ts = (uint64_t)(uintptr_t)&ts;
+		min_complete = 1;
+	}else{
+		min_complete = 0;
+	}
+	rc = uring__enter(ring, ring->sq_queued, min_complete,
+			IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+	if(rc >= 0){
+		ring->sq_queued -= rc;
+	}else if(errno != ETIME && errno != EINTR){
+		return -1;
+	}
+
+	head = *ring->cq_head;
+	tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	while(head != tail){
+		/* Take a copy and release the slot first, handlers can make more
+		 * requests. */
+		memcpy(&cqe, &ring->cqes[head & ring->cq_mask], sizeof(struct io_uring_cqe));
+		head++;
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+		count++;
+
+		switch(URING_DATA_OP(cqe.user_data)){
+			case uop_accept:
+				uring__handle_accept(db, &cqe);
+				break;
+			case uop_recv:
+				uring__handle_recv(db, &cqe, handler);
+				break;
+			case uop_pollin:
+			case uop_pollout:
+				uring__handle_poll(db, &cqe, handler);
+				break;
+			case uop_wake:
+				/* The main loop deals with what woke it. */
+				ring->wake_armed = false;
+				break;
+			default:
+				break;
+		}
+	}
+	return count;
+}
+
+#endif
@@ -662,6 +662,7 @@ static int callback_http(struct libwebsocket_context *context,
 			HASH_FIND(hh_sock, db->contexts_by_sock, &pollargs->fd, sizeof(pollargs->fd), mosq);
 			if(mosq && (pollargs->events & POLLOUT)){
 				mosq->ws_want_write = true;
+				context__add_to_ready(db, mosq);
 			}
 			break;
 
@@ -0,0 +1,188 @@
+/*
+Copyright (c) 2010-2018 Roger Light <roger@atchoo.org>
+
+All rights reserved. This program and the accompanying materials
+are made available under the terms of the Eclipse Public License v1.0
+and Eclipse Distribution License v1.0 which accompany this distribution.
+
+The Eclipse Public License is available at
+   http://www.eclipse.org/legal/epl-v10.html
+and the Eclipse Distribution License is available at
+  http://www.eclipse.org/org/documents/edl-v10.php.
+
+Contributors:
+   Roger Light - initial implementation and documentation.
+*/
+
+#include "config.h"
+
+#if defined(WITH_PARALLEL_RESTORE) || defined(WITH_WEEVE_SMP)
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+
+/* Deliberately not mosquitto_broker_internal.h, which pulls in
+ * dummypthread.h. */
+#include "mosquitto.h"
+#include "memory_mosq.h"
+#include "workers.h"
+
+#define WORKERS_QUEUE_INITIAL 64
+
+struct workers__slot{
+	workers__job job;
+	void *arg;
+};
+
+struct mosquitto__workers{
+	pthread_mutex_t mutex;
+	pthread_cond_t queued; /* Signalled when a job is queued or on stop. */
+	pthread_cond_t idle; /* Broadcast when the last busy thread finishes. */
+	/* Jobs waiting for a thread, a ring only ever grown by the main thread,
+	 * under the mutex. */
+	struct workers__slot *queue;
+	int queue_size;
+	int queue_head;
+	int queue_count;
+	int busy;
+	bool stopping;
+	pthread_t *threads;
+	int thread_count;
+};
+
+
+static void *workers__thread(void *arg)
+{
+	struct mosquitto__workers *workers = arg;
+	struct workers__slot slot;
+
+	pthread_mutex_lock(&workers->mutex);
+	while(1){
+		while(workers->queue_count == 0 && !workers->stopping){
+			pthread_cond_wait(&workers->queued, &workers->mutex);
+		}
+		if(workers->queue_count == 0){
+			break;
+		}
+		slot = workers->queue[workers->queue_head];
+		workers->queue_head = (workers->queue_head + 1) % workers->queue_size;
+		workers->queue_count--;
+		workers->busy++;
+		pthread_mutex_unlock(&workers->mutex);
+
+		slot.job(slot.arg);
+
+		pthread_mutex_lock(&workers->mutex);
+		workers->busy--;
+		if(workers->busy == 0 && workers->queue_count == 0){
+			pthread_cond_broadcast(&workers->idle);
+		}
+	}
+	pthread_mutex_unlock(&workers->mutex);
+	return NULL;
+}
+
+
+int workers__start(struct mosquitto__workers **workers, int count)
+{
+	struct mosquitto__workers *w;
+	sigset_t sigblock, origsig;
+	int i;
+
+	w = mosquitto__calloc(1, sizeof(struct mosquitto__workers));
+	if(!w) return MOSQ_ERR_NOMEM;
+	w->threads = mosquitto__calloc(count, sizeof(pthread_t));
+	w->queue = mosquitto__malloc(WORKERS_QUEUE_INITIAL*sizeof(struct workers__slot));
+	if(!w->threads || !w->queue){
+		mosquitto__free(w->threads);
+		mosquitto__free(w->queue);
+		mosquitto__free(w);
+		return MOSQ_ERR_NOMEM;
+	}
+	w->queue_size = WORKERS_QUEUE_INITIAL;
+	pthread_mutex_init(&w->mutex, NULL);
+	pthread_cond_init(&w->queued, NULL);
+	pthread_cond_init(&w->idle, NULL);
+
+	/* Signals are left to the main thread. */
+	sigfillset(&sigblock);
+	pthread_sigmask(SIG_SETMASK, &sigblock, &origsig);
+	for(i=0; i<count; i++){
+		if(pthread_create(&w->threads[w->thread_count], NULL, workers__thread, w) == 0){
+			w->thread_count++;
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &origsig, NULL);
+	if(w->thread_count == 0){
+		workers__stop(w);
+		return MOSQ_ERR_UNKNOWN;
+	}
+	*workers = w;
+	return MOSQ_ERR_SUCCESS;
+}
+
+
+int workers__submit(struct mosquitto__workers *workers, workers__job job, void *arg)
+{
+	struct workers__slot *queue;
+	int i, tail;
+
+	pthread_mutex_lock(&workers->mutex);
+	if(workers->queue_count == workers->queue_size){
+		queue = mosquitto__malloc(2*workers->queue_size*sizeof(struct workers__slot));
+		if(!queue){
+			pthread_mutex_unlock(&workers->mutex);
+			return MOSQ_ERR_NOMEM;
+		}
+		for(i=0; i<workers->queue_count; i++){
+			queue[i] = workers->queue[(workers->queue_head + i) % workers->queue_size];
+		}
+		mosquitto__free(workers->queue);
+		workers->queue = queue;
+		workers->queue_head = 0;
+		workers->queue_size *= 2;
+	}
+	tail = (workers->queue_head + workers->queue_count) % workers->queue_size;
+	workers->queue[tail].job = job;
+	workers->queue[tail].arg = arg;
+	workers->queue_count++;
+	pthread_cond_signal(&workers->queued);
+	pthread_mutex_unlock(&workers->mutex);
+	return MOSQ_ERR_SUCCESS;
+}
+
+
+void workers__wait_idle(struct mosquitto__workers *workers)
+{
+	pthread_mutex_lock(&workers->mutex);
+	while(workers->busy || workers->queue_count){
+		pthread_cond_wait(&workers->idle, &workers->mutex);
+	}
+	pthread_mutex_unlock(&workers->mutex);
+}
+
+
+void workers__stop(struct mosquitto__workers *workers)
+{
+	int i;
+
+	if(!workers) return;
+
+	pthread_mutex_lock(&workers->mutex);
+	workers->stopping = true;
+	pthread_cond_broadcast(&workers->queued);
+	pthread_mutex_unlock(&workers->mutex);
+	for(i=0; i<workers->thread_count; i++){
+		pthread_join(workers->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&workers->idle);
+	pthread_cond_destroy(&workers->queued);
+	pthread_mutex_destroy(&workers->mutex);
+	mosquitto__free(workers->queue);
+	mosquitto__free(workers->threads);
+	mosquitto__free(workers);
+}
+
+#endif
@@ -0,0 +1,41 @@
+/*
+Copyright (c) 2010-2018 Roger Light <roger@atchoo.org>
+
+All rights reserved. This program and the accompanying materials
+are made available under the terms of the Eclipse Public License v1.0
+and Eclipse Distribution License v1.0 which accompany this distribution.
+
+The Eclipse Public License is available at
+   http://www.eclipse.org/legal/epl-v10.html
+and the Eclipse Distribution License is available at
+  http://www.eclipse.org/org/documents/edl-v10.php.
+
+Contributors:
+   Roger Light - initial implementation and documentation.
+*/
+
+#ifndef WORKERS_H
+#define WORKERS_H
+
+/* A pool of threads running jobs handed to it by the main thread.
+ *
+ * The broker is single threaded and builds with the pthread calls stubbed
+ * out by dummypthread.h, so the few places that do run work on other threads
+ * go through here rather than using pthreads directly. Jobs must not touch
+ * broker state the main thread may be using. */
+
+struct mosquitto__workers;
+
+typedef void (*workers__job)(void *arg);
+
+/* Start count threads. Returns MOSQ_ERR_SUCCESS, MOSQ_ERR_NOMEM, or
+ * MOSQ_ERR_UNKNOWN if no thread could be started. */
+int workers__start(struct mosquitto__workers **workers, int count);
+/* Have job(arg) run on one of the threads. Main thread only. */
+int workers__submit(struct mosquitto__workers *workers, workers__job job, void *arg);
+/* Wait until every job submitted so far has finished. Main thread only. */
+void workers__wait_idle(struct mosquitto__workers *workers);
+/* Finish the jobs still queued, then stop the threads and free the pool. */
+void workers__stop(struct mosquitto__workers *workers);
+
+#endif
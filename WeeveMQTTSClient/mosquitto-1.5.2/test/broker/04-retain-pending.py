@@ -0,0 +1,114 @@
+#!/usr/bin/env python
+
+# Test that retained messages still waiting to be delivered after a SUBSCRIBE
+# are dropped when the client unsubscribes, and aren't delivered after a newer
+# retained message on the same topic. The broker delivers one pending message
+# per loop iteration so that both happen while the backlog drains.
+
+import socket
+import struct
+
+import inspect, os, sys
+# From http://stackoverflow.com/questions/279237/python-import-a-module-from-a-folder
+cmd_subfolder = os.path.realpath(os.path.abspath(os.path.join(os.path.split(inspect.getfile( inspect.currentframe() ))[0],"..")))
+if cmd_subfolder not in sys.path:
+    sys.path.insert(0, cmd_subfolder)
+
+import mosq_test
+
+def read_packet(sock):
+    data = sock.recv(1)
+    if len(data) == 0:
+        raise ValueError("connection closed")
+    command = struct.unpack("!B", data)[0]
+    remaining_length = 0
+    multiplier = 1
+    while True:
+        byte = struct.unpack("!B", sock.recv(1))[0]
+        remaining_length += (byte & 127) * multiplier
+        multiplier *= 128
+        if byte & 128 == 0:
+            break
+    body = ""
+    while len(body) < remaining_length:
+        body += sock.recv(remaining_length - len(body))
+    return (command, body)
+
+def publish_topic_payload(body):
+    topic_len = struct.unpack("!H", body[0:2])[0]
+    return (body[2:2+topic_len], body[2+topic_len:])
+
+rc = 1
+keepalive = 60
+topic_count = 100
+connect_packet = mosq_test.gen_connect("retain-pending-test", keepalive=keepalive)
+connack_packet = mosq_test.gen_connack(rc=0)
+
+mid_sub = 10
+subscribe_packet = mosq_test.gen_subscribe(mid_sub, "retain/pending/#", 0)
+suback_packet = mosq_test.gen_suback(mid_sub, 0)
+
+mid_unsub = 11
+unsubscribe_packet = mosq_test.gen_unsubscribe(mid_unsub, "retain/pending/#")
+unsuback_packet = mosq_test.gen_unsuback(mid_unsub)
+
+pingreq_packet = mosq_test.gen_pingreq()
+pingresp_packet = mosq_test.gen_pingresp()
+
+old_packets = ""
+new_packets = ""
+for i in range(topic_count):
+    old_packets += mosq_test.gen_publish("retain/pending/%d" % (i), qos=0, payload="old", retain=True)
+for i in range(topic_count/2):
+    new_packets += mosq_test.gen_publish("retain/pending/%d" % (i), qos=0, payload="new", retain=True)
+
+broker = mosq_test.start_broker(filename=os.path.basename(__file__))
+
+try:
+    sock = mosq_test.do_client_connect(connect_packet, connack_packet, timeout=4)
+    sock.send(old_packets)
+    mosq_test.do_send_receive(sock, pingreq_packet, pingresp_packet, "pingresp")
+
+    # Unsubscribe while the retained messages are pending, none may follow
+    # the UNSUBACK.
+    sock.send(subscribe_packet + unsubscribe_packet)
+    if mosq_test.expect_packet(sock, "suback", suback_packet):
+        (command, body) = read_packet(sock)
+        while command == 0x31:
+            (command, body) = read_packet(sock)
+        if command != 0xB0 or body != unsuback_packet[2:]:
+            raise ValueError("expected unsuback, got %02x" % (command))
+        mosq_test.do_send_receive(sock, pingreq_packet, pingresp_packet, "pingresp")
+
+        # Replace half of the retained messages while they are pending, no
+        # old message may follow the new one of its topic and the other half
+        # is still delivered.
+        sock.send(subscribe_packet + new_packets)
+        if mosq_test.expect_packet(sock, "suback", suback_packet):
+            received = {}
+            failed = False
+            try:
+                while True:
+                    (command, body) = read_packet(sock)
+                    (topic, payload) = publish_topic_payload(body)
+                    if payload == "old" and received.get(topic) == "new":
+                        print("FAIL: stale retained message on %s." % (topic))
+                        failed = True
+                    received[topic] = payload
+            except socket.timeout:
+                pass
+            expected = {}
+            for i in range(topic_count):
+                expected["retain/pending/%d" % (i)] = "new" if i < topic_count/2 else "old"
+            if not failed and received == expected:
+                rc = 0
+
+    sock.close()
+finally:
+    broker.terminate()
+    broker.wait()
+    (stdo, stde) = broker.communicate()
+    if rc:
+        print(stde)
+
+exit(rc)
@@ -0,0 +1,90 @@
+#!/usr/bin/env python
+
+# Test whether a message queued for a persistent client after a background
+# save is restored from the persistence log after the broker is killed, when
+# its stored message was left out of the snapshot. Retained $SYS messages
+# aren't saved unless a client has them queued.
+
+import inspect, os, signal, sys, time
+# From http://stackoverflow.com/questions/279237/python-import-a-module-from-a-folder
+cmd_subfolder = os.path.realpath(os.path.abspath(os.path.join(os.path.split(inspect.getfile( inspect.currentframe() ))[0],"..")))
+if cmd_subfolder not in sys.path:
+    sys.path.insert(0, cmd_subfolder)
+
+import mosq_test
+
+def write_config(filename, port):
+    with open(filename, 'w') as f:
+        f.write("port %d\n" % (port))
+        f.write("persistence true\n")
+        f.write("persistence_file mosquitto-%d.db\n" % (port))
+        f.write("persistence_log true\n")
+        f.write("autosave_interval 1\n")
+
+def remove_db(port):
+    for ext in ['', '.log', '.log.old']:
+        if os.path.exists('mosquitto-%d.db%s' % (port, ext)):
+            os.unlink('mosquitto-%d.db%s' % (port, ext))
+
+port = mosq_test.get_port()
+conf_file = os.path.basename(__file__).replace('.py', '.conf')
+write_config(conf_file, port)
+
+rc = 1
+keepalive = 60
+connect_packet = mosq_test.gen_connect(
+    "persistence-log-crash-test", keepalive=keepalive, clean_session=False,
+)
+connack_packet = mosq_test.gen_connack(rc=0)
+connack_packet2 = mosq_test.gen_connack(rc=0, resv=1)  # session present
+
+mid = 53
+subscribe_packet = mosq_test.gen_subscribe(mid, "$SYS/broker/version", 2)
+suback_packet = mosq_test.gen_suback(mid, 2)
+
+mid = 1
+publish_packet = mosq_test.gen_publish("$SYS/broker/version", qos=2, mid=mid, payload="mosquitto version 1.5.2", retain=True)
+publish_dup_packet = mosq_test.gen_publish("$SYS/broker/version", qos=2, mid=mid, payload="mosquitto version 1.5.2", retain=True, dup=True)
+
+remove_db(port)
+
+broker = mosq_test.start_broker(filename=os.path.basename(__file__), use_conf=True, port=port)
+
+(stdo1, stde1) = ("", "")
+try:
+    # Let a background save write the snapshot, which leaves out the
+    # $SYS/broker/version message.
+    time.sleep(2.5)
+
+    sock = mosq_test.do_client_connect(connect_packet, connack_packet, timeout=20, port=port)
+    mosq_test.do_send_receive(sock, subscribe_packet, suback_packet, "suback")
+    if mosq_test.expect_packet(sock, "publish", publish_packet):
+        # Give the log its fsync, then don't let the broker save anything
+        # else.
+        time.sleep(0.5)
+        broker.send_signal(signal.SIGKILL)
+        broker.wait()
+        (stdo1, stde1) = broker.communicate()
+        sock.close()
+        broker = mosq_test.start_broker(filename=os.path.basename(__file__), use_conf=True, port=port)
+
+        sock = mosq_test.do_client_connect(connect_packet, connack_packet2, timeout=20, port=port)
+        # The message is only restored from the log if no save happened
+        # between sending it and the kill. Otherwise the snapshot has it as
+        # sent, and it is resent with dup set.
+        packet = sock.recv(len(publish_packet))
+        if packet == publish_dup_packet or mosq_test.packet_matches("resent publish", packet, publish_packet):
+            rc = 0
+
+    sock.close()
+finally:
+    os.remove(conf_file)
+    broker.terminate()
+    broker.wait()
+    (stdo, stde) = broker.communicate()
+    if rc:
+        print(stde1 + stde)
+    remove_db(port)
+
+
+exit(rc)
@@ -0,0 +1,94 @@
+#!/usr/bin/env python
+
+# Test whether messages restored for offline clients are spilled to disk as the
+# database is read when there is a queue_spill_bytes budget, and are delivered
+# in order when the clients reconnect. The two clients have their messages in
+# the same stored messages.
+
+import inspect, os, sys
+# From http://stackoverflow.com/questions/279237/python-import-a-module-from-a-folder
+cmd_subfolder = os.path.realpath(os.path.abspath(os.path.join(os.path.split(inspect.getfile( inspect.currentframe() ))[0],"..")))
+if cmd_subfolder not in sys.path:
+    sys.path.insert(0, cmd_subfolder)
+
+import mosq_test
+
+def write_config(filename, port, spill):
+    with open(filename, 'w') as f:
+        f.write("port %d\n" % (port))
+        f.write("persistence true\n")
+        f.write("persistence_file mosquitto-%d.db\n" % (port))
+        if spill:
+            f.write("queue_spill_bytes 30\n")
+
+port = mosq_test.get_port()
+conf_file = os.path.basename(__file__).replace('.py', '.conf')
+write_config(conf_file, port, False)
+
+rc = 1
+keepalive = 60
+connack_packet = mosq_test.gen_connack(rc=0)
+connack_packet2 = mosq_test.gen_connack(rc=0, resv=1)  # session present
+disconnect_packet = mosq_test.gen_disconnect()
+
+connect_packets = []
+for client_id in ["persistence-spill-test1", "persistence-spill-test2"]:
+    connect_packets.append(mosq_test.gen_connect(client_id, keepalive=keepalive, clean_session=False))
+
+mid = 530
+subscribe_packet = mosq_test.gen_subscribe(mid, "spill/qos1", 1)
+suback_packet = mosq_test.gen_suback(mid, 1)
+
+pub_connect_packet = mosq_test.gen_connect("persistence-spill-pub", keepalive=keepalive)
+
+if os.path.exists('mosquitto-%d.db' % (port)):
+    os.unlink('mosquitto-%d.db' % (port))
+
+broker = mosq_test.start_broker(filename=os.path.basename(__file__), use_conf=True, port=port)
+
+(stdo1, stde1) = ("", "")
+try:
+    for connect_packet in connect_packets:
+        sock = mosq_test.do_client_connect(connect_packet, connack_packet, timeout=20, port=port)
+        mosq_test.do_send_receive(sock, subscribe_packet, suback_packet, "suback")
+        sock.send(disconnect_packet)
+        sock.close()
+
+    pub_sock = mosq_test.do_client_connect(pub_connect_packet, connack_packet, timeout=20, port=port)
+    for i in range(10):
+        publish_packet = mosq_test.gen_publish("spill/qos1", qos=1, mid=300+i, payload="message-%d" % (i))
+        puback_packet = mosq_test.gen_puback(300+i)
+        mosq_test.do_send_receive(pub_sock, publish_packet, puback_packet, "puback")
+    pub_sock.close()
+
+    broker.terminate()
+    broker.wait()
+    (stdo1, stde1) = broker.communicate()
+    write_config(conf_file, port, True)
+    broker = mosq_test.start_broker(filename=os.path.basename(__file__), use_conf=True, port=port)
+
+    rc = 0
+    for connect_packet in connect_packets:
+        sock = mosq_test.do_client_connect(connect_packet, connack_packet2, timeout=20, port=port)
+        for i in range(10):
+            publish_packet = mosq_test.gen_publish("spill/qos1", qos=1, mid=1+i, payload="message-%d" % (i))
+            puback_packet = mosq_test.gen_puback(1+i)
+            if not mosq_test.expect_packet(sock, "publish", publish_packet):
+                rc = 1
+                break
+            sock.send(puback_packet)
+        sock.close()
+finally:
+    os.remove(conf_file)
+    broker.terminate()
+    broker.wait()
+    (stdo, stde) = broker.communicate()
+    if rc == 0 and "persistence-spill-test2 are being spilled to disk" not in stde:
+        rc = 1
+    if rc:
+        print(stde1 + stde)
+    if os.path.exists('mosquitto-%d.db' % (port)):
+        os.unlink('mosquitto-%d.db' % (port))
+
+
+exit(rc)
@@ -51,6 +51,7 @@ tests = [
     (1, './04-retain-qos1-qos0.py'),
     (1, './04-retain-qos0-clear.py'),
     (1, './04-retain-upgrade-outgoing-qos.py'),
+    (1, './04-retain-pending.py'),
 
     (1, './05-clean-session-qos1.py'),
 
@@ -96,6 +97,8 @@ tests = [
 
     (2, './10-listener-mount-point.py'),
 
+    (1, './11-persistence-log-crash.py'),
+    (1, './11-persistence-spill-restore.py'),
     (1, './11-persistent-subscription.py'),
     ]
 
@@ -0,0 +1,43 @@
+#!/bin/sh
+# End to end bridge throughput in messages/s. msgsps_pub publishes to an edge
+# broker, which bridges perf/# to a core broker that msgsps_sub is subscribed
+# to. Build msgsps_pub and msgsps_sub first. A broker built with
+# WITH_WEEVE_SMP secures the bridge with SMP, so run it from a directory that
+# holds the SMP credentials.
+#
+# Usage: msgsps_bridge.sh [core port] [edge port]
+
+CORE_PORT=${1:-1888}
+EDGE_PORT=${2:-1889}
+BROKER=${BROKER:-../src/mosquitto}
+DIR=$(mktemp -d)
+
+cat > ${DIR}/core.conf << EOC
+port ${CORE_PORT}
+EOC
+
+cat > ${DIR}/edge.conf << EOC
+port ${EDGE_PORT}
+
+connection perf
+address 127.0.0.1:${CORE_PORT}
+topic perf/# out 1
+EOC
+
+${BROKER} -c ${DIR}/core.conf > ${DIR}/core.log 2>&1 &
+CORE_PID=$!
+${BROKER} -c ${DIR}/edge.conf > ${DIR}/edge.log 2>&1 &
+EDGE_PID=$!
+sleep 1
+
+./msgsps_sub ${CORE_PORT} > ${DIR}/sub.log &
+SUB_PID=$!
+sleep 1
+
+./msgsps_pub ${EDGE_PORT} > /dev/null
+wait ${SUB_PID}
+grep Messages/s ${DIR}/sub.log
+
+kill ${EDGE_PID} ${CORE_PID}
+wait ${EDGE_PID} ${CORE_PID} 2>/dev/null
+rm -rf ${DIR}
@@ -29,7 +29,7 @@ void my_publish_callback(struct mosquitto *mosq, void *obj, int mid)
 	message_count++;
 	if(message_count == MESSAGE_COUNT){
 		gettimeofday(&stop, NULL);
-		mosquitto_disconnect((struct mosquitto *)obj);
+		mosquitto_disconnect(mosq);
 	}
 }
 
@@ -39,7 +39,12 @@ int main(int argc, char *argv[])
 	int i;
 	double dstart, dstop, diff;
 	uint8_t *buf;
-	
+	int port = PORT;
+
+	if(argc > 1){
+		port = atoi(argv[1]);
+	}
+
 	buf = malloc(MESSAGE_SIZE*MESSAGE_COUNT);
 	if(!buf){
 		printf("Error: Out of memory.\n");
@@ -58,7 +63,7 @@ int main(int argc, char *argv[])
 	mosquitto_disconnect_callback_set(mosq, my_disconnect_callback);
 	mosquitto_publish_callback_set(mosq, my_publish_callback);
 
-	mosquitto_connect(mosq, HOST, PORT, 600);
+	mosquitto_connect(mosq, HOST, port, 600);
 
 	mosquitto_loop_start(mosq);
 
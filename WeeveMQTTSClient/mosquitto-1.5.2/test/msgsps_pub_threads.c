@@ -0,0 +1,128 @@
+/* This provides a crude manner of testing how fast several application threads
+ * can publish through one threaded client, in messages/s. Messages are sent
+ * with QoS 0 so that the time is spent handing packets to the network thread
+ * rather than waiting for acknowledgements. */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <mosquitto.h>
+
+#include <msgsps_common.h>
+
+#define MAX_THREADS 8
+
+static struct mosquitto *mosq;
+static uint8_t *buf;
+static int thread_count = 1;
+static bool connected = false;
+static int message_count = 0;
+static struct timeval start, stop;
+static pthread_mutex_t state_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t state_cond = PTHREAD_COND_INITIALIZER;
+
+
+void my_connect_callback(struct mosquitto *mosq, void *obj, int rc)
+{
+	printf("rc: %d\n", rc);
+	pthread_mutex_lock(&state_mutex);
+	connected = true;
+	pthread_cond_signal(&state_cond);
+	pthread_mutex_unlock(&state_mutex);
+}
+
+void my_publish_callback(struct mosquitto *mosq, void *obj, int mid)
+{
+	message_count++;
+	if(message_count == MESSAGE_COUNT){
+		gettimeofday(&stop, NULL);
+		pthread_mutex_lock(&state_mutex);
+		pthread_cond_signal(&state_cond);
+		pthread_mutex_unlock(&state_mutex);
+	}
+}
+
+void *publish_thread(void *obj)
+{
+	int thread = *(int *)obj;
+	int i;
+
+	for(i=thread; i<MESSAGE_COUNT; i+=thread_count){
+		mosquitto_publish(mosq, NULL, "perf/test", MESSAGE_SIZE, &buf[i*MESSAGE_SIZE], 0, false);
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t threads[MAX_THREADS];
+	int index[MAX_THREADS];
+	double dstart, dstop, diff;
+	int port = PORT;
+	int i;
+
+	if(argc > 1){
+		thread_count = atoi(argv[1]);
+	}
+	if(argc > 2){
+		port = atoi(argv[2]);
+	}
+	if(thread_count < 1 || thread_count > MAX_THREADS){
+		printf("Error: Between 1 and %d threads are supported.\n", MAX_THREADS);
+		return 1;
+	}
+
+	buf = malloc(MESSAGE_SIZE*MESSAGE_COUNT);
+	if(!buf){
+		printf("Error: Out of memory.\n");
+		return 1;
+	}
+
+	mosquitto_lib_init();
+
+	mosq = mosquitto_new("perftest", true, NULL);
+	mosquitto_connect_callback_set(mosq, my_connect_callback);
+	mosquitto_publish_callback_set(mosq, my_publish_callback);
+
+	mosquitto_connect(mosq, HOST, port, 600);
+	mosquitto_loop_start(mosq);
+
+	pthread_mutex_lock(&state_mutex);
+	while(!connected){
+		pthread_cond_wait(&state_cond, &state_mutex);
+	}
+	pthread_mutex_unlock(&state_mutex);
+
+	gettimeofday(&start, NULL);
+	for(i=0; i<thread_count; i++){
+		index[i] = i;
+		pthread_create(&threads[i], NULL, publish_thread, &index[i]);
+	}
+	for(i=0; i<thread_count; i++){
+		pthread_join(threads[i], NULL);
+	}
+
+	pthread_mutex_lock(&state_mutex);
+	while(message_count < MESSAGE_COUNT){
+		pthread_cond_wait(&state_cond, &state_mutex);
+	}
+	pthread_mutex_unlock(&state_mutex);
+
+	mosquitto_disconnect(mosq);
+	mosquitto_loop_stop(mosq, false);
+
+	dstart = (double)start.tv_sec*1.0e6 + (double)start.tv_usec;
+	dstop = (double)stop.tv_sec*1.0e6 + (double)stop.tv_usec;
+	diff = (dstop-dstart)/1.0e6;
+
+	printf("Threads: %d\nDiff: %g\nMessages/s: %g\n", thread_count, diff, (double)MESSAGE_COUNT/diff);
+
+	mosquitto_destroy(mosq);
+	mosquitto_lib_cleanup();
+	free(buf);
+
+	return 0;
+}
@@ -0,0 +1,108 @@
+/* This provides a crude manner of testing how well a shared subscription
+ * spreads messages across its members, in messages/s. Run msgsps_pub once all
+ * members have connected. */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <mosquitto.h>
+
+#include <msgsps_common.h>
+
+#define MAX_MEMBERS 64
+
+static int message_count = 0;
+static int member_count[MAX_MEMBERS];
+static struct timeval start, stop;
+static pthread_mutex_t count_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+
+void my_connect_callback(struct mosquitto *mosq, void *obj, int rc)
+{
+	if(rc){
+		printf("rc: %d\n", rc);
+	}else{
+		mosquitto_subscribe(mosq, NULL, "$share/perf/perf/test", SUB_QOS);
+	}
+}
+
+void my_message_callback(struct mosquitto *mosq, void *obj, const struct mosquitto_message *msg)
+{
+	int member = *(int *)obj;
+
+	pthread_mutex_lock(&count_mutex);
+	if(message_count == 0){
+		gettimeofday(&start, NULL);
+	}
+	message_count++;
+	member_count[member]++;
+	if(message_count == MESSAGE_COUNT){
+		gettimeofday(&stop, NULL);
+		pthread_cond_signal(&done_cond);
+	}
+	pthread_mutex_unlock(&count_mutex);
+}
+
+int main(int argc, char *argv[])
+{
+	struct mosquitto *mosq[MAX_MEMBERS];
+	int index[MAX_MEMBERS];
+	double dstart, dstop, diff;
+	char id[50];
+	int port = PORT;
+	int members = 1;
+	int i, least, most;
+
+	if(argc > 1){
+		members = atoi(argv[1]);
+	}
+	if(argc > 2){
+		port = atoi(argv[2]);
+	}
+	if(members < 1 || members > MAX_MEMBERS){
+		printf("Error: Between 1 and %d members are supported.\n", MAX_MEMBERS);
+		return 1;
+	}
+
+	mosquitto_lib_init();
+
+	for(i=0; i<members; i++){
+		index[i] = i;
+		snprintf(id, 50, "msgps_shared_%d_%d", getpid(), i);
+		mosq[i] = mosquitto_new(id, true, &index[i]);
+		mosquitto_connect_callback_set(mosq[i], my_connect_callback);
+		mosquitto_message_callback_set(mosq[i], my_message_callback);
+
+		mosquitto_connect(mosq[i], HOST, port, 600);
+		mosquitto_loop_start(mosq[i]);
+	}
+
+	pthread_mutex_lock(&count_mutex);
+	while(message_count < MESSAGE_COUNT){
+		pthread_cond_wait(&done_cond, &count_mutex);
+	}
+	pthread_mutex_unlock(&count_mutex);
+
+	least = most = member_count[0];
+	for(i=0; i<members; i++){
+		mosquitto_disconnect(mosq[i]);
+		mosquitto_loop_stop(mosq[i], false);
+		mosquitto_destroy(mosq[i]);
+		if(member_count[i] < least) least = member_count[i];
+		if(member_count[i] > most) most = member_count[i];
+	}
+	mosquitto_lib_cleanup();
+
+	dstart = (double)start.tv_sec*1.0e6 + (double)start.tv_usec;
+	dstop = (double)stop.tv_sec*1.0e6 + (double)stop.tv_usec;
+	diff = (dstop-dstart)/1.0e6;
+
+	printf("Members: %d\nLeast: %d\nMost: %d\nDiff: %g\nMessages/s: %g\n", members, least, most, diff, (double)MESSAGE_COUNT/diff);
+
+	return 0;
+}
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Shared subscription fan-out in messages/s. For each group size, msgsps_shared
+# subscribes that many members to $share/perf/perf/test and msgsps_pub publishes
+# to perf/test. Every message should reach exactly one member, so the rate
+# should hold up as the group grows. Build msgsps_pub and msgsps_shared first.
+#
+# Usage: msgsps_shared.sh [port] [round_robin|least_inflight]
+
+PORT=${1:-1888}
+POLICY=${2:-round_robin}
+BROKER=${BROKER:-../src/mosquitto}
+DIR=$(mktemp -d)
+
+cat > ${DIR}/broker.conf << EOC
+port ${PORT}
+shared_subscription_policy ${POLICY}
+EOC
+
+${BROKER} -c ${DIR}/broker.conf > ${DIR}/broker.log 2>&1 &
+BROKER_PID=$!
+sleep 1
+
+for MEMBERS in 1 2 4 8 16 32 64; do
+	./msgsps_shared ${MEMBERS} ${PORT} > ${DIR}/shared.log &
+	SHARED_PID=$!
+	sleep 1
+
+	./msgsps_pub ${PORT} > /dev/null
+	wait ${SHARED_PID}
+	echo "${MEMBERS} members: $(grep Messages/s ${DIR}/shared.log) ($(grep Least ${DIR}/shared.log), $(grep Most ${DIR}/shared.log))"
+done
+
+kill ${BROKER_PID}
+wait ${BROKER_PID} 2>/dev/null
+rm -rf ${DIR}
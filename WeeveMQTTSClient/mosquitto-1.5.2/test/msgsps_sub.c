@@ -3,6 +3,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/time.h>
 #include <unistd.h>
 #include <mosquitto.h>
@@ -34,7 +35,7 @@ void my_message_callback(struct mosquitto *mosq, void *obj, const struct mosquit
 	message_count++;
 	if(message_count == MESSAGE_COUNT){
 		gettimeofday(&stop, NULL);
-		mosquitto_disconnect((struct mosquitto *)obj);
+		mosquitto_disconnect(mosq);
 	}
 }
 
@@ -44,6 +45,11 @@ int main(int argc, char *argv[])
 	double dstart, dstop, diff;
 	int mid = 0;
 	char id[50];
+	int port = PORT;
+
+	if(argc > 1){
+		port = atoi(argv[1]);
+	}
 
 	start.tv_sec = 0;
 	start.tv_usec = 0;
@@ -63,7 +69,7 @@ int main(int argc, char *argv[])
 	mosquitto_disconnect_callback_set(mosq, my_disconnect_callback);
 	mosquitto_message_callback_set(mosq, my_message_callback);
 
-	mosquitto_connect(mosq, HOST, PORT, 600);
+	mosquitto_connect(mosq, HOST, port, 600);
 	mosquitto_subscribe(mosq, &mid, "perf/test", SUB_QOS);
 
 	mosquitto_loop_forever(mosq, 10, 1);